@@ -1,9 +1,14 @@
 #include "devices/block.h"
+#include <arithmetic.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
+#include <sysstat.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/trace.h"
 
 /* A block device. */
 struct block
@@ -16,18 +21,36 @@ struct block
 
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
+    int channel;                        /* See block_channel(). */
+    unsigned idx;                       /* Position in probe order. */
+    size_t io_size;                     /* See block_io_size(). */
+    block_sector_t io_align;            /* See block_io_align(). */
 
+    /* I/O statistics, guarded by disabling interrupts.  See
+       struct blockstat. */
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long request_cnt;     /* Number of requests. */
+    unsigned in_flight;                 /* Requests not yet finished. */
+    unsigned long long latency[BLOCKSTAT_LATENCY_BUCKETS];
+    unsigned long long depth[BLOCKSTAT_DEPTH_BUCKETS];
+    unsigned sectors[BLOCKSTAT_SECONDS];  /* Indexed by second mod
+                                             BLOCKSTAT_SECONDS. */
+    int64_t second;                     /* Second of newest sectors[]. */
   };
 
 /* List of all block devices. */
-static struct list all_blocks = LIST_INITIALIZER (all_blocks);
+static struct clist all_blocks = CLIST_INITIALIZER (all_blocks);
 
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static uint64_t request_begin (struct block *);
+static void request_end (struct block *, uint64_t start,
+                         block_sector_t sector, size_t cnt, bool write);
+static void advance_second (struct block *, int64_t now);
+static void get_stats (struct block *, struct blockstat *);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -70,7 +93,7 @@ block_set_role (enum block_type role, struct block *block)
 struct block *
 block_first (void)
 {
-  return list_elem_to_block (list_begin (&all_blocks));
+  return list_elem_to_block (list_begin (&all_blocks.list));
 }
 
 /* Returns the block device following BLOCK in kernel probe
@@ -88,7 +111,7 @@ block_get_by_name (const char *name)
 {
   struct list_elem *e;
 
-  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+  for (e = list_begin (&all_blocks.list); e != list_end (&all_blocks.list);
        e = list_next (e))
     {
       struct block *block = list_entry (e, struct block, list_elem);
@@ -120,9 +143,12 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
+  uint64_t start;
+
   check_sector (block, sector);
+  start = request_begin (block);
   block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  request_end (block, start, sector, 1, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +159,64 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  uint64_t start;
+
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  start = request_begin (block);
   block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  request_end (block, start, sector, 1, true);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from BLOCK,
+   sector I into BUFFERS[I], each of which must have room for
+   BLOCK_SECTOR_SIZE bytes.  Drivers that can do so transfer the
+   whole run in as few requests as possible; others fall back to
+   one block_read() per sector. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *const buffers[])
+{
+  uint64_t start;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  start = request_begin (block);
+  if (block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffers);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i, buffers[i]);
+  request_end (block, start, sector, cnt, false);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK,
+   sector I from BUFFERS[I], each of which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the block device has
+   acknowledged receiving all of the data.  Drivers that can do so
+   transfer the whole run in as few requests as possible. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *const buffers[])
+{
+  uint64_t start;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  start = request_begin (block);
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffers);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i, buffers[i]);
+  request_end (block, start, sector, cnt, true);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,21 +240,103 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Fills in *STATS for the block device with index IDX in kernel
+   probe order.  Returns false if there is no such device. */
+bool
+block_get_stats (size_t idx, struct blockstat *stats)
+{
+  struct block *block;
+
+  for (block = block_first (); block != NULL && idx > 0;
+       block = block_next (block))
+    idx--;
+  if (block == NULL)
+    return false;
+  get_stats (block, stats);
+  return true;
+}
+
+/* Fills in the block I/O totals in STATS, adding up the devices
+   used for a Pintos role, so that I/O through a partition is not
+   counted again for its disk. */
+void
+block_get_totals (struct sysstat *stats)
+{
+  enum intr_level old_level;
+  int role;
+
+  stats->sectors_read = stats->sectors_written = stats->block_requests = 0;
+  old_level = intr_disable ();
+  for (role = 0; role < BLOCK_ROLE_CNT; role++)
+    {
+      struct block *block = block_by_role[role];
+
+      if (block == NULL)
+        continue;
+      stats->sectors_read += block->read_cnt;
+      stats->sectors_written += block->write_cnt;
+      stats->block_requests += block->request_cnt;
+    }
+  intr_set_level (old_level);
+}
+
+/* Fills in *STATS for BLOCK. */
+static void
+get_stats (struct block *block, struct blockstat *stats)
+{
+  enum intr_level old_level;
+  int i;
+
+  strlcpy (stats->name, block->name, sizeof stats->name);
+  strlcpy (stats->role, block_type_name (block->type), sizeof stats->role);
+
+  old_level = intr_disable ();
+  advance_second (block, udiv64_32 (timer_ticks (), TIMER_FREQ));
+  stats->read_cnt = block->read_cnt;
+  stats->write_cnt = block->write_cnt;
+  stats->request_cnt = block->request_cnt;
+  memcpy (stats->latency, block->latency, sizeof stats->latency);
+  memcpy (stats->depth, block->depth, sizeof stats->depth);
+  for (i = 0; i < BLOCKSTAT_SECONDS; i++)
+    stats->sectors[i] = block->sectors[(block->second - i + BLOCKSTAT_SECONDS)
+                                       % BLOCKSTAT_SECONDS];
+  intr_set_level (old_level);
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
 {
-  int i;
+  int role, i;
 
-  for (i = 0; i < BLOCK_ROLE_CNT; i++)
+  for (role = 0; role < BLOCK_ROLE_CNT; role++)
     {
-      struct block *block = block_by_role[i];
-      if (block != NULL)
-        {
-          printf ("%s (%s): %llu reads, %llu writes\n",
-                  block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
-        }
+      struct block *block = block_by_role[role];
+      struct blockstat s;
+      unsigned long long peak = 0;
+
+      if (block == NULL)
+        continue;
+
+      get_stats (block, &s);
+      for (i = 0; i < BLOCKSTAT_SECONDS; i++)
+        if (s.sectors[i] > peak)
+          peak = s.sectors[i];
+      printf ("%s (%s): %llu reads, %llu writes, %llu requests, "
+              "peak %llu bytes/s\n",
+              s.name, s.role, s.read_cnt, s.write_cnt, s.request_cnt,
+              peak * BLOCK_SECTOR_SIZE);
+      if (s.request_cnt == 0)
+        continue;
+      printf ("%s: request latency in cycles:\n", s.name);
+      for (i = 0; i < BLOCKSTAT_LATENCY_BUCKETS; i++)
+        if (s.latency[i] != 0)
+          printf ("  < 2^%-2d %llu\n", i, s.latency[i]);
+      printf ("%s: requests already in flight:\n", s.name);
+      for (i = 0; i < BLOCKSTAT_DEPTH_BUCKETS; i++)
+        if (s.depth[i] != 0)
+          printf ("  %s%d %llu\n", i < BLOCKSTAT_DEPTH_BUCKETS - 1 ? "" : ">=",
+                  i, s.depth[i]);
     }
 }
 
@@ -192,14 +354,24 @@ block_register (const char *name, enum block_type type,
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
-  list_push_back (&all_blocks, &block->list_elem);
+  block->idx = clist_size (&all_blocks);
+  clist_push_back (&all_blocks, &block->list_elem);
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
   block->ops = ops;
   block->aux = aux;
+  block->channel = -1;
+  block->io_size = 1;
+  block->io_align = 0;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
+  block->in_flight = 0;
+  memset (block->latency, 0, sizeof block->latency);
+  memset (block->depth, 0, sizeof block->depth);
+  memset (block->sectors, 0, sizeof block->sectors);
+  block->second = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,13 +383,138 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Records that BLOCK's requests are served by the controller
+   channel CHANNEL, a small number chosen by the driver. */
+void
+block_set_channel (struct block *block, int channel)
+{
+  block->channel = channel;
+}
+
+/* Returns the number of the controller channel serving BLOCK's
+   requests, or -1 if unknown.  Devices on different channels can
+   transfer at the same time, so it makes sense to spread busy
+   roles across them. */
+int
+block_channel (struct block *block)
+{
+  return block->channel;
+}
+
+/* Records that BLOCK transfers data most efficiently in units of
+   IO_SIZE sectors, a power of 2, that start at sectors S with
+   S % IO_SIZE == IO_ALIGN.  A request that covers only part of a
+   unit may cost the device a read-modify-write of the whole. */
+void
+block_set_io_hint (struct block *block, size_t io_size,
+                   block_sector_t io_align)
+{
+  ASSERT (io_size > 0 && (io_size & (io_size - 1)) == 0);
+  ASSERT (io_align < io_size);
+
+  block->io_size = io_size;
+  block->io_align = io_align;
+}
+
+/* Returns the number of sectors in the units BLOCK transfers most
+   efficiently, a power of 2, or 1 if the device has no preference.
+   See block_unit_start(). */
+size_t
+block_io_size (struct block *block)
+{
+  return block->io_size;
+}
+
+/* Returns the first sector of the unit of block_io_size() sectors
+   of BLOCK that contains SECTOR. */
+block_sector_t
+block_unit_start (struct block *block, block_sector_t sector)
+{
+  block_sector_t ofs = (sector + block->io_size - block->io_align)
+                       % block->io_size;
+  return sector >= ofs ? sector - ofs : 0;
+}
+
+/* Returns the sector offset within the first unit of BLOCK, that
+   is, the lowest sector at which a whole unit starts. */
+block_sector_t
+block_io_align (struct block *block)
+{
+  return block->io_align;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
 list_elem_to_block (struct list_elem *list_elem)
 {
-  return (list_elem != list_end (&all_blocks)
+  return (list_elem != list_end (&all_blocks.list)
           ? list_entry (list_elem, struct block, list_elem)
           : NULL);
 }
 
+
+/* Notes the start of a request on BLOCK and returns the cycle
+   count at which it started. */
+static uint64_t
+request_begin (struct block *block)
+{
+  enum intr_level old_level = intr_disable ();
+  unsigned depth = block->in_flight++;
+
+  if (depth >= BLOCKSTAT_DEPTH_BUCKETS)
+    depth = BLOCKSTAT_DEPTH_BUCKETS - 1;
+  block->depth[depth]++;
+  intr_set_level (old_level);
+  return timer_cycles ();
+}
+
+/* Accounts for the request on BLOCK started at cycle count START,
+   which read the CNT sectors starting at SECTOR or, if WRITE is
+   true, wrote them. */
+static void
+request_end (struct block *block, uint64_t start, block_sector_t sector,
+             size_t cnt, bool write)
+{
+  uint64_t cycles = timer_cycles () - start;
+  enum intr_level old_level;
+  int b = 0;
+
+  trace (write ? TRACE_BLOCK_WRITE : TRACE_BLOCK_READ, block->idx, sector,
+         cnt, cycles);
+
+  while (b < BLOCKSTAT_LATENCY_BUCKETS - 1 && cycles >> b != 0)
+    b++;
+
+  old_level = intr_disable ();
+  block->in_flight--;
+  block->request_cnt++;
+  block->latency[b]++;
+  if (write)
+    block->write_cnt += cnt;
+  else
+    block->read_cnt += cnt;
+  advance_second (block, udiv64_32 (timer_ticks (), TIMER_FREQ));
+  block->sectors[block->second % BLOCKSTAT_SECONDS] += cnt;
+  intr_set_level (old_level);
+}
+
+/* Moves BLOCK's throughput history forward to second NOW,
+   clearing the seconds in which it transferred nothing.
+   Interrupts must be off. */
+static void
+advance_second (struct block *block, int64_t now)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (now - block->second >= BLOCKSTAT_SECONDS)
+    {
+      memset (block->sectors, 0, sizeof block->sectors);
+      block->second = now;
+    }
+  while (block->second < now)
+    {
+      block->second++;
+      block->sectors[block->second % BLOCKSTAT_SECONDS] = 0;
+    }
+}
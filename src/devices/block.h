@@ -1,6 +1,8 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <blockstat.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
 
@@ -53,10 +55,21 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *const buffers[]);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *const buffers[]);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
+int block_channel (struct block *);
+size_t block_io_size (struct block *);
+block_sector_t block_io_align (struct block *);
+block_sector_t block_unit_start (struct block *, block_sector_t);
 
 /* Statistics. */
+struct sysstat;
+bool block_get_stats (size_t idx, struct blockstat *);
+void block_get_totals (struct sysstat *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
@@ -65,10 +78,20 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional: transfer CNT consecutive sectors, sector I to or
+       from BUFFERS[I], in as few device requests as possible. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *const buffers[]);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *const buffers[]);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_set_channel (struct block *, int channel);
+void block_set_io_hint (struct block *, size_t io_size,
+                        block_sector_t io_align);
 
 #endif /* devices/block.h */
@@ -1,17 +1,54 @@
 #include "devices/ide.h"
 #include <ctype.h>
 #include <debug.h>
+#include <list.h>
+#include <round.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Transfers are not carried out by the threads asking for them.
+   Each channel has a queue of requests and a worker thread that
+   serves them, one at a time, as the disk's interrupts say the
+   previous one is done.  The worker takes requests in C-LOOK
+   elevator order, sweeping upward across the disk and then jumping
+   back to the lowest request, and merges requests for consecutive
+   sectors in the same direction into a single command, so that
+   concurrent swap and file system traffic costs fewer seeks and
+   commands.  Each requester sleeps on its own semaphore until its
+   request is done.
+
+   Only the requests of the highest priority waiting take part in
+   the sweep, so that a batch process's swap traffic does not hold
+   up a more important thread's page fault.  A request's priority
+   is its requester's effective priority at the time the worker
+   picks, donations included: a thread that waits for a lock held
+   by the requester, such as that of a cache entry being read in,
+   raises the priority of the queued request as well.  As for the
+   scheduler, lower priorities wait as long as higher ones queue.
+
+   If the PCI bus has an IDE controller capable of bus-master DMA,
+   such as the one QEMU emulates, sectors are transferred
+   with READ DMA and WRITE DMA: the controller copies the data
+   between memory and the disk by itself, as listed in a physical
+   region descriptor table, and interrupts once when the whole
+   command is done, so the CPU runs other threads meanwhile instead
+   of copying every word.  Otherwise, or for buffers DMA cannot
+   reach, sectors are transferred with programmed I/O. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +67,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master port addresses, relative to a channel's bm_base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_ERROR 0x02           /* Transfer failed; write 1 to clear. */
+#define BM_INTR 0x04            /* Disk interrupted; write 1 to clear. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +101,24 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors one READ or WRITE SECTOR command can transfer. */
+#define ATA_MAX_SECTORS 256
+
+/* A physical region descriptor: one piece of memory taking part
+   in a DMA transfer.  The piece may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last descriptor. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_WINDOW 0x10000      /* A piece stays within one of these. */
+#define PRD_MAX (PGSIZE / sizeof (struct prd))  /* Table is a page. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +127,7 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Does it do DMA on a DMA channel? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,20 +143,79 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master ports, 0 if no DMA. */
+    struct prd *prdt;           /* PRD table, a page. */
+
+    struct lock queue_lock;     /* Guards queue and head_pos. */
+    struct list queue;          /* Pending struct ide_requests. */
+    struct condition queued;    /* Signaled when queue gets a request. */
+    uint32_t head_pos;          /* Where the last transfer ended. */
+    const void *merged[ATA_MAX_SECTORS]; /* Buffers of a merged batch. */
+    unsigned long long merge_cnt;       /* Requests merged into others. */
+    unsigned long long ahead_cnt;       /* Picks passing over requests of
+                                           lower priority. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
+/* A request waiting in a channel's queue. */
+struct ide_request
+  {
+    struct list_elem elem;      /* Element in the channel's queue. */
+    struct ata_disk *disk;      /* Disk to transfer to or from. */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    const void *const *buffers; /* Sector I goes to or from BUFFERS[I]. */
+    bool read;                  /* Into the buffers? */
+    struct thread *thread;      /* Requester, blocked until done. */
+    int priority;               /* Requester's priority when last
+                                   looked at. */
+    struct semaphore done;      /* Up'd once transferred. */
+  };
+
 /* We support the two "legacy" ATA channels found in a standard PC. */
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* Probing of one channel at boot.  Resetting a channel and
+   waiting for its disks to answer takes milliseconds of sleeping
+   per device, so each channel is probed by a thread of its own,
+   in parallel.  What the disks report is kept in ID until
+   ide_init() registers them, in order, so that disks and their
+   partitions are registered in the same order on every boot. */
+struct channel_probe
+  {
+    struct channel *channel;            /* Channel to probe. */
+    struct semaphore done;              /* Up'd when probed. */
+    char id[2][BLOCK_SECTOR_SIZE];      /* IDENTIFY DEVICE data. */
+  };
+
 static struct block_operations ide_operations;
 
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
-static void identify_ata_device (struct ata_disk *);
-
-static void select_sector (struct ata_disk *, block_sector_t);
+static void probe_channel (void *);
+static bool identify_ata_device (struct ata_disk *, char *id);
+static void register_ata_device (struct ata_disk *, char *id);
+
+static void ide_read_multiple (void *, block_sector_t, size_t cnt,
+                               void *const buffers[]);
+static void ide_write_multiple (void *, block_sector_t, size_t cnt,
+                                const void *const buffers[]);
+
+static void submit (struct ata_disk *, block_sector_t, size_t cnt,
+                    const void *const buffers[], bool read);
+static thread_func channel_worker NO_RETURN;
+static void transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                      const void *const buffers[], bool read);
+
+static uint16_t find_bus_master (void);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          const void *const buffers[], bool read);
+static bool build_prdt (struct channel *, size_t cnt,
+                        const void *const buffers[]);
+
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -101,8 +231,13 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
+  struct channel_probe *probes;
   size_t chan_no;
 
+  ASSERT (CHANNEL_CNT * sizeof *probes <= PGSIZE);
+  probes = palloc_get_page (PAL_ASSERT);
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +261,20 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      lock_init (&c->queue_lock);
+      list_init (&c->queue);
+      cond_init (&c->queued);
+      c->head_pos = 0;
+      c->merge_cnt = 0;
+      c->ahead_cnt = 0;
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + 8 * chan_no;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,23 +285,62 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
 
-      /* Reset hardware. */
-      reset_channel (c);
+      /* Start probing. */
+      probes[chan_no].channel = c;
+      sema_init (&probes[chan_no].done, 0);
+      thread_create ("ide-probe", PRI_MAX, probe_channel, &probes[chan_no]);
+    }
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel_probe *p = &probes[chan_no];
+      struct channel *c = p->channel;
+      int dev_no;
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+      sema_down (&p->done);
+
+      /* Start serving requests, which registering a disk makes by
+         scanning it for partitions. */
+      if (c->devices[0].is_ata || c->devices[1].is_ata)
+        thread_create (c->name, PRI_MAX, channel_worker, c);
 
-      /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
-          identify_ata_device (&c->devices[dev_no]);
+          register_ata_device (&c->devices[dev_no], p->id[dev_no]);
     }
+  palloc_free_page (probes);
+}
+
+/* Thread function that resets the channel of struct channel_probe
+   PROBE_, finds its ATA disks and reads their identity
+   information. */
+static void
+probe_channel (void *probe_)
+{
+  struct channel_probe *p = probe_;
+  struct channel *c = p->channel;
+  int dev_no;
+
+  /* Reset hardware. */
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  /* Read hard disk identity information. */
+  for (dev_no = 0; dev_no < 2; dev_no++)
+    if (c->devices[dev_no].is_ata
+        && !identify_ata_device (&c->devices[dev_no], p->id[dev_no]))
+      c->devices[dev_no].is_ata = false;
+
+  sema_up (&p->done);
 }
 
 /* Disk detection and identification. */
@@ -254,40 +442,54 @@ check_device_type (struct ata_disk *d)
 }
 
 /* Sends an IDENTIFY DEVICE command to disk D and reads the
-   response.  Registers the disk with the block device
-   layer. */
-static void
-identify_ata_device (struct ata_disk *d) 
+   response into ID, which must have room for BLOCK_SECTOR_SIZE
+   bytes.  Returns true if successful, false if D did not
+   respond. */
+static bool
+identify_ata_device (struct ata_disk *d, char *id) 
 {
   struct channel *c = d->channel;
-  char id[BLOCK_SECTOR_SIZE];
-  block_sector_t capacity;
-  char *model, *serial;
-  char extra_info[128];
-  struct block *block;
 
   ASSERT (d->is_ata);
 
   /* Send the IDENTIFY DEVICE command, wait for an interrupt
      indicating the device's response is ready, and read the data
-     into our buffer. */
+     into ID. */
   select_device_wait (d);
   issue_pio_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
-    {
-      d->is_ata = false;
-      return;
-    }
+    return false;
   input_sector (c, id);
+  return true;
+}
+
+/* Registers ATA disk D as a block device, given the
+   BLOCK_SECTOR_SIZE bytes of identity information ID that
+   identify_ata_device() read from it, and scans it for
+   partitions. */
+static void
+register_ata_device (struct ata_disk *d, char *id)
+{
+  struct channel *c = d->channel;
+  block_sector_t capacity;
+  char *model, *serial;
+  char extra_info[128];
+  struct block *block;
+  uint16_t w106, w209;
+
+  ASSERT (d->is_ata);
 
   /* Calculate capacity.
-     Read model name and serial number. */
+     Read model name and serial number.
+     Note whether the disk does DMA. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s", model, serial,
+            d->dma ? ", DMA" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -306,6 +508,22 @@ identify_ata_device (struct ata_disk *d)
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_set_channel (block, c - channels);
+
+  /* Disks with physical sectors larger than their logical ones say
+     so in word 106, and where logical sector 0 lies within a
+     physical sector in word 209.  Each word is valid if its bit 14
+     is set and bit 15 clear. */
+  w106 = *(uint16_t *) &id[106 * 2];
+  w209 = *(uint16_t *) &id[209 * 2];
+  if ((w106 & 0xe000) == 0x6000 && (w106 & 0xf) <= 7)
+    {
+      size_t io_size = (size_t) 1 << (w106 & 0xf);
+      size_t ofs = ((w209 & 0xc000) == 0x4000
+                    ? (w209 & 0x3fff) % io_size : 0);
+
+      block_set_io_hint (block, io_size, (io_size - ofs) % io_size);
+    }
   partition_scan (block);
 }
 
@@ -344,16 +562,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multiple (d_, sec_no, 1, &buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -364,36 +573,418 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
+  ide_write_multiple (d_, sec_no, 1, &buffer);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D, sector I
+   into BUFFERS[I], once the request's turn in the channel's queue
+   comes. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *const buffers[])
+{
+  submit (d_, sec_no, cnt, (const void *const *) buffers, true);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D, sector I
+   from BUFFERS[I], once the request's turn in the channel's queue
+   comes.  Returns after the disk has acknowledged receiving the
+   data. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *const buffers[])
+{
+  submit (d_, sec_no, cnt, buffers, false);
+}
+
+/* Prints, for each channel in use, how many requests were merged
+   into others and how often priority reordered the queue. */
+void
+ide_print_stats (void)
+{
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+
+      if (c->devices[0].is_ata || c->devices[1].is_ata)
+        printf ("%s: %llu requests merged, %llu picked by priority\n",
+                c->name, c->merge_cnt, c->ahead_cnt);
+    }
+}
+
+/* Request queue. */
+
+/* Queues a request to transfer the CNT sectors starting at SEC_NO
+   on disk D, sector I to or from BUFFERS[I], into the buffers if
+   READ, and waits for the channel's worker to carry it out. */
+static void
+submit (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+        const void *const buffers[], bool read)
+{
   struct channel *c = d->channel;
+  struct ide_request r;
+
+  if (cnt == 0)
+    return;
+
+  r.disk = d;
+  r.sector = sec_no;
+  r.cnt = cnt;
+  r.buffers = buffers;
+  r.read = read;
+  r.thread = thread_current ();
+  sema_init (&r.done, 0);
+
+  lock_acquire (&c->queue_lock);
+  list_push_back (&c->queue, &r.elem);
+  cond_signal (&c->queued, &c->queue_lock);
+  lock_release (&c->queue_lock);
+
+  sema_down (&r.done);
+}
+
+/* Returns the position of request R in the elevator's order. */
+static uint32_t
+request_pos (const struct ide_request *r)
+{
+  return ((uint32_t) r->disk->dev_no << 28) | r->sector;
+}
+
+/* Removes and returns the request in channel C's queue, which must
+   not be empty, that the elevator serves next: among those of the
+   highest priority, C-LOOK, the one at or nearest above where the
+   last one ended, or the lowest if none lies above.  Must be
+   called with C's queue lock held. */
+static struct ide_request *
+pick_request (struct channel *c)
+{
+  struct ide_request *next = NULL;
+  struct ide_request *lowest = NULL;
+  struct list_elem *e;
+  int priority = PRI_MIN;
+  bool mixed = false;
+
+  ASSERT (lock_held_by_current_thread (&c->queue_lock));
+  ASSERT (!list_empty (&c->queue));
+
+  /* Take each requester's priority once, since donations may change
+     it while we look. */
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+
+      r->priority = r->thread->priority;
+      if (e != list_begin (&c->queue) && r->priority != priority)
+        mixed = true;
+      if (r->priority > priority || e == list_begin (&c->queue))
+        priority = r->priority;
+    }
+  if (mixed)
+    c->ahead_cnt++;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+      uint32_t pos = request_pos (r);
+
+      if (r->priority < priority)
+        continue;
+
+      if (pos >= c->head_pos && (next == NULL || pos < request_pos (next)))
+        next = r;
+      if (lowest == NULL || pos < request_pos (lowest))
+        lowest = r;
+    }
+  if (next == NULL)
+    next = lowest;
+  list_remove (&next->elem);
+  return next;
+}
+
+/* Removes from channel C's queue and returns a request in the same
+   direction that continues on disk right where FIRST, which is
+   followed in the batch by CNT sectors in all, ends, if there is
+   one and the batch would stay within ATA_MAX_SECTORS.  Must be
+   called with C's queue lock held. */
+static struct ide_request *
+pick_adjacent (struct channel *c, const struct ide_request *first,
+               size_t cnt)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+
+      if (r->disk == first->disk && r->read == first->read
+          && r->sector == first->sector + cnt
+          && cnt + r->cnt <= ATA_MAX_SECTORS)
+        {
+          list_remove (&r->elem);
+          return r;
+        }
+    }
+  return NULL;
+}
+
+/* Serves channel C's request queue in elevator order, merging
+   requests for consecutive sectors into one transfer.  Each
+   transfer sleeps until the disk interrupts, so the worker is
+   driven by the interrupt handler. */
+static void
+channel_worker (void *c_)
+{
+  struct channel *c = c_;
+
+  for (;;)
+    {
+      struct ide_request *batch[ATA_MAX_SECTORS];
+      struct ide_request *first;
+      size_t req_cnt = 1;
+      size_t cnt;
+      size_t i;
+
+      lock_acquire (&c->queue_lock);
+      while (list_empty (&c->queue))
+        cond_wait (&c->queued, &c->queue_lock);
+      first = batch[0] = pick_request (c);
+      cnt = first->cnt;
+      if (cnt < ATA_MAX_SECTORS)
+        {
+          struct ide_request *r;
+
+          while ((r = pick_adjacent (c, first, cnt)) != NULL)
+            {
+              batch[req_cnt++] = r;
+              cnt += r->cnt;
+            }
+        }
+      c->head_pos = request_pos (first) + cnt;
+      lock_release (&c->queue_lock);
+
+      if (req_cnt == 1)
+        transfer (first->disk, first->sector, cnt, first->buffers,
+                  first->read);
+      else
+        {
+          size_t n = 0;
+
+          for (i = 0; i < req_cnt; i++)
+            {
+              memcpy (c->merged + n, batch[i]->buffers,
+                      batch[i]->cnt * sizeof *c->merged);
+              n += batch[i]->cnt;
+            }
+          transfer (first->disk, first->sector, cnt, c->merged,
+                    first->read);
+          c->merge_cnt += req_cnt - 1;
+        }
+
+      for (i = 0; i < req_cnt; i++)
+        sema_up (&batch[i]->done);
+    }
+}
+
+/* Transfers the CNT sectors starting at SEC_NO on disk D, sector I
+   to or from BUFFERS[I], into the buffers if READ, issuing one
+   command per ATA_MAX_SECTORS.  With DMA the disk interrupts once
+   per command, and otherwise once for each sector. */
+static void
+transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+          const void *const buffers[], bool read)
+{
+  struct channel *c = d->channel;
+  size_t i;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < ATA_MAX_SECTORS ? cnt : ATA_MAX_SECTORS;
+
+      if (dma_transfer (d, sec_no, n, buffers, read))
+        ;
+      else if (read)
+        {
+          select_sector (d, sec_no, n);
+          issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+                       sec_no + i);
+              input_sector (c, (void *) buffers[i]);
+            }
+        }
+      else
+        {
+          select_sector (d, sec_no, n);
+          issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+                       sec_no + i);
+              output_sector (c, buffers[i]);
+              sema_down (&c->completion_wait);
+            }
+        }
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
+
+/* Bus-master DMA. */
+
+/* Looks on PCI bus 0 for an IDE controller that can do bus-master
+   DMA and lets it master the bus.  Returns its bus master ports,
+   those of the second channel following the first's by 8, or 0 if
+   there is none. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev = -1, func;
+
+  while (pci_next_function (&dev, &func))
+    {
+      uint32_t class, bar;
+
+      /* Mass storage, IDE, bus master capable. */
+      class = pci_read_config (dev, func, PCI_REG_CLASS);
+      if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+        continue;
+
+      /* BAR4 holds the bus master ports. */
+      bar = pci_read_config (dev, func, PCI_REG_BAR0 + 16);
+      if ((bar & 1) == 0 || (bar & 0xfffc) == 0)
+        continue;
+
+      pci_write_config (dev, func, PCI_REG_COMMAND,
+                        pci_read_config (dev, func, PCI_REG_COMMAND)
+                        | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+      return bar & 0xfffc;
+    }
+  return 0;
+}
+
+/* Transfers the CNT sectors, at most ATA_MAX_SECTORS, starting at
+   SEC_NO on disk D, sector I to or from BUFFERS[I], by DMA: into
+   the buffers if READ, out of them otherwise.  The caller must
+   hold D's channel lock.  Returns false, having transferred
+   nothing, if D does not do DMA or a buffer is out of DMA's reach;
+   if the transfer itself fails, turns DMA off for the channel and
+   also returns false, so that the caller can retry with PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const void *const buffers[], bool read)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = read ? BM_READ : 0;
+  uint8_t bm_status, status;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  if (!d->dma || c->bm_base == 0 || !build_prdt (c, cnt, buffers))
+    return false;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_ERROR | BM_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, read ? CMD_READ_DMA : CMD_WRITE_DMA);
+  outb (reg_bm_command (c), direction | BM_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+
+  wait_while_busy (d);
+  status = inb (reg_alt_status (c));
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_ERROR | BM_INTR);
+  if ((status & (STA_ERR | STA_DF)) != 0 || (bm_status & BM_ERROR) != 0)
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu"; falling back to PIO\n",
+              d->name, read ? "read" : "write", sec_no);
+      c->bm_base = 0;
+      return false;
+    }
+  return true;
+}
+
+/* Fills channel C's PRD table with the CNT sectors at BUFFERS,
+   merging pieces that are adjacent in physical memory.  Returns
+   false if a buffer is not in kernel memory or not word aligned,
+   or the table would overflow. */
+static bool
+build_prdt (struct channel *c, size_t cnt, const void *const buffers[])
+{
+  struct prd *p = c->prdt;
+  size_t n = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr, end;
+
+      if (!is_kernel_vaddr (buffers[i]) || (uintptr_t) buffers[i] % 2 != 0)
+        return false;
+      addr = vtop (buffers[i]);
+      end = addr + BLOCK_SECTOR_SIZE;
+      while (addr < end)
+        {
+          uintptr_t window_end = ROUND_DOWN (addr, PRD_WINDOW) + PRD_WINDOW;
+          uintptr_t piece_end = end < window_end ? end : window_end;
+          size_t size = piece_end - addr;
+
+          if (n > 0 && addr % PRD_WINDOW != 0
+              && p[n - 1].addr + (p[n - 1].size ? p[n - 1].size
+                                                : PRD_WINDOW) == addr)
+            p[n - 1].size += size;
+          else if (n < PRD_MAX)
+            {
+              p[n].addr = addr;
+              p[n].size = size;
+              p[n].flags = 0;
+              n++;
+            }
+          else
+            return false;
+          addr = piece_end;
+        }
+    }
+  p[n - 1].flags = PRD_EOT;
+  return true;
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the count CNT, at most ATA_MAX_SECTORS, to the
+   disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= ATA_MAX_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  /* A count of 0 means 256 sectors. */
+  outb (reg_nsect (c), cnt == ATA_MAX_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
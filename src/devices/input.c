@@ -1,5 +1,6 @@
 #include "devices/input.h"
 #include <debug.h>
+#include <string.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
 
@@ -41,6 +42,47 @@ input_getc (void)
   return key;
 }
 
+/* Retrieves up to SIZE keys from the input buffer into BUF and
+   returns the number retrieved, which is at least 1 if SIZE is
+   nonzero.  If the buffer is empty, waits for a key to be
+   pressed, then takes every key already buffered.  BUF may be in
+   user memory: keys are copied to it with interrupts on, so that
+   page faults can be handled. */
+size_t
+input_getbuf (void *buf, size_t size) 
+{
+  enum intr_level old_level;
+  uint8_t keys[64];
+  size_t cnt;
+
+  if (size > sizeof keys)
+    size = sizeof keys;
+
+  old_level = intr_disable ();
+  cnt = intq_getbuf (&buffer, keys, size);
+  serial_notify ();
+  intr_set_level (old_level);
+
+  memcpy (buf, keys, cnt);
+  return cnt;
+}
+
+/* Waits until a key is buffered or TICKS timer ticks have passed,
+   forever if TICKS is negative, and returns true if one is.  With
+   TICKS of 0 it only checks.  Takes no key, and any number of
+   threads may wait at once. */
+bool
+input_wait (int64_t ticks)
+{
+  enum intr_level old_level;
+  bool ready;
+
+  old_level = intr_disable ();
+  ready = intq_wait (&buffer, ticks);
+  intr_set_level (old_level);
+  return ready;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
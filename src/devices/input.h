@@ -2,11 +2,14 @@
 #define DEVICES_INPUT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 void input_init (void);
 void input_putc (uint8_t);
 uint8_t input_getc (void);
+size_t input_getbuf (void *, size_t);
+bool input_wait (int64_t ticks);
 bool input_full (void);
 
 #endif /* devices/input.h */
@@ -2,7 +2,14 @@
 #include <debug.h>
 #include "threads/thread.h"
 
-static int next (int pos);
+/* A thread in intq_wait(). */
+struct poller
+  {
+    struct list_elem elem;      /* Element in the queue's pollers. */
+    struct semaphore ready;     /* Upped when a byte is added. */
+  };
+
+static unsigned used (const struct intq *q);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
 
@@ -10,8 +17,11 @@ static void signal (struct intq *q, struct thread **waiter);
 void
 intq_init (struct intq *q) 
 {
+  ASSERT ((INTQ_BUFSIZE & (INTQ_BUFSIZE - 1)) == 0);
+
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
+  list_init (&q->pollers);
   q->head = q->tail = 0;
 }
 
@@ -20,7 +30,7 @@ bool
 intq_empty (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return q->head == q->tail;
+  return used (q) == 0;
 }
 
 /* Returns true if Q is full, false otherwise. */
@@ -28,7 +38,7 @@ bool
 intq_full (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return used (q) == INTQ_BUFSIZE;
 }
 
 /* Removes a byte from Q and returns it.
@@ -48,8 +58,9 @@ intq_getc (struct intq *q)
       lock_release (&q->lock);
     }
   
-  byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  byte = q->buf[q->tail % INTQ_BUFSIZE];
+  barrier ();
+  q->tail++;
   signal (q, &q->not_full);
   return byte;
 }
@@ -69,16 +80,112 @@ intq_putc (struct intq *q, uint8_t byte)
       lock_release (&q->lock);
     }
 
-  q->buf[q->head] = byte;
-  q->head = next (q->head);
+  q->buf[q->head % INTQ_BUFSIZE] = byte;
+  barrier ();
+  q->head++;
   signal (q, &q->not_empty);
 }
+
+/* Removes up to SIZE bytes from Q into BUF and returns the
+   number removed.  If Q is empty, sleeps until a byte is added,
+   then takes everything available, so a consumer is woken once
+   per burst rather than once per byte.
+   When called from an interrupt handler, Q must not be empty. */
+size_t
+intq_getbuf (struct intq *q, uint8_t *buf, size_t size) 
+{
+  size_t cnt;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (size == 0)
+    return 0;
+  while (intq_empty (q)) 
+    {
+      ASSERT (!intr_context ());
+      lock_acquire (&q->lock);
+      wait (q, &q->not_empty);
+      lock_release (&q->lock);
+    }
+
+  cnt = used (q);
+  if (cnt > size)
+    cnt = size;
+  for (i = 0; i < cnt; i++)
+    buf[i] = q->buf[(q->tail + i) % INTQ_BUFSIZE];
+  barrier ();
+  q->tail += cnt;
+  signal (q, &q->not_full);
+  return cnt;
+}
+
+/* Adds the SIZE bytes in BUF to the end of Q, sleeping whenever
+   Q is full until there is room for more.
+   When called from an interrupt handler, Q must have room for
+   all SIZE bytes. */
+void
+intq_putbuf (struct intq *q, const uint8_t *buf, size_t size) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  while (size > 0)
+    {
+      size_t cnt;
+      size_t i;
+
+      while (intq_full (q))
+        {
+          ASSERT (!intr_context ());
+          lock_acquire (&q->lock);
+          wait (q, &q->not_full);
+          lock_release (&q->lock);
+        }
+
+      cnt = INTQ_BUFSIZE - used (q);
+      if (cnt > size)
+        cnt = size;
+      for (i = 0; i < cnt; i++)
+        q->buf[(q->head + i) % INTQ_BUFSIZE] = buf[i];
+      barrier ();
+      q->head += cnt;
+      signal (q, &q->not_empty);
+      buf += cnt;
+      size -= cnt;
+    }
+}
 
-/* Returns the position after POS within an intq. */
-static int
-next (int pos) 
+/* Waits until Q is not empty or TICKS timer ticks have passed,
+   forever if TICKS is negative, without removing anything, and
+   returns true if Q is not empty.  With TICKS of 0 it only checks.
+   Unlike a reader, any number of threads may wait at once, so a
+   thread can wait on more than one source by polling.
+   Must not be called from an interrupt handler. */
+bool
+intq_wait (struct intq *q, int64_t ticks)
+{
+  struct poller p;
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!intq_empty (q) || ticks == 0)
+    return !intq_empty (q);
+
+  /* The poller stays listed until we remove it, so that a wakeup
+     racing with the timeout only ups a semaphore no one needs. */
+  sema_init (&p.ready, 0);
+  list_push_back (&q->pollers, &p.elem);
+  if (ticks < 0)
+    sema_down (&p.ready);
+  else
+    sema_down_timeout (&p.ready, ticks);
+  list_remove (&p.elem);
+  return !intq_empty (q);
+}
+
+/* Returns the number of bytes in Q. */
+static unsigned
+used (const struct intq *q) 
 {
-  return (pos + 1) % INTQ_BUFSIZE;
+  return q->head - q->tail;
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -100,7 +207,7 @@ wait (struct intq *q UNUSED, struct thread **waiter)
    thread is waiting for the condition, wakes it up and resets
    the waiting thread. */
 static void
-signal (struct intq *q UNUSED, struct thread **waiter) 
+signal (struct intq *q, struct thread **waiter) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT ((waiter == &q->not_empty && !intq_empty (q))
@@ -111,4 +218,12 @@ signal (struct intq *q UNUSED, struct thread **waiter)
       thread_unblock (*waiter);
       *waiter = NULL;
     }
+  if (waiter == &q->not_empty)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&q->pollers); e != list_end (&q->pollers);
+           e = list_next (e))
+        sema_up (&list_entry (e, struct poller, elem)->ready);
+    }
 }
@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <stddef.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -15,10 +16,18 @@
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.
 
-/* Queue buffer size, in bytes. */
-#define INTQ_BUFSIZE 64
+   The buffer itself is a single-producer, single-consumer ring:
+   only the producer advances `head' and only the consumer
+   advances `tail', so the bytes need no further protection.
+   Both counters run freely and are reduced modulo the buffer
+   size on access, which lets the ring use every slot. */
+
+/* Queue buffer size, in bytes.  Must be a power of 2. */
+#ifndef INTQ_BUFSIZE
+#define INTQ_BUFSIZE 256
+#endif
 
 /* A circular queue of bytes. */
 struct intq
@@ -27,11 +36,12 @@ struct intq
     struct lock lock;           /* Only one thread may wait at once. */
     struct thread *not_full;    /* Thread waiting for not-full condition. */
     struct thread *not_empty;   /* Thread waiting for not-empty condition. */
+    struct list pollers;        /* Threads in intq_wait(), any number. */
 
     /* Queue. */
     uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
-    int head;                   /* New data is written here. */
-    int tail;                   /* Old data is read here. */
+    unsigned head;              /* New data is written here. */
+    unsigned tail;              /* Old data is read here. */
   };
 
 void intq_init (struct intq *);
@@ -39,5 +49,8 @@ bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+size_t intq_getbuf (struct intq *, uint8_t *, size_t);
+void intq_putbuf (struct intq *, const uint8_t *, size_t);
+bool intq_wait (struct intq *, int64_t ticks);
 
 #endif /* devices/intq.h */
@@ -0,0 +1,226 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC, the interrupt controller built into each CPU since
+   the Pentium Pro.  See [IA32-v3a] chapter 10 "Advanced
+   Programmable Interrupt Controller (APIC)".
+
+   Pintos still takes device interrupts through the 8259 PICs,
+   which the APIC passes on unchanged ("virtual wire" mode, with
+   LINT0 as ExtINT), so no I/O APIC has to be found and set up.
+   What the local APIC adds is its timer, which raises the timer
+   vector that PIC IRQ 0 used to.  Its end-of-interrupt is a
+   single store to memory instead of I/O port writes, it can count
+   down once for tickless idling, and on CPUs that support it, it
+   can interrupt when the time stamp counter reaches a deadline. */
+
+/* Model-specific registers. */
+#define MSR_APIC_BASE 0x1b              /* APIC physical base + enable. */
+#define MSR_TSC_DEADLINE 0x6e0          /* TSC deadline for the timer. */
+#define APIC_BASE_ENABLE (1u << 11)     /* Global enable in MSR_APIC_BASE. */
+
+/* Register offsets. */
+#define LAPIC_TPR 0x080                 /* Task priority. */
+#define LAPIC_EOI 0x0b0                 /* End of interrupt. */
+#define LAPIC_SVR 0x0f0                 /* Spurious vector. */
+#define LAPIC_LVT_TIMER 0x320           /* Timer interrupt. */
+#define LAPIC_LVT_LINT0 0x350           /* LINT0 pin, from the PIC. */
+#define LAPIC_LVT_LINT1 0x360           /* LINT1 pin, NMI. */
+#define LAPIC_TIMER_INIT 0x380          /* Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390           /* Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0           /* Timer divide configuration. */
+
+/* Bits in local vector table (LVT) entries and the SVR. */
+#define LVT_EXTINT (7u << 8)            /* Deliver as from the PIC. */
+#define LVT_NMI (4u << 8)               /* Deliver as NMI. */
+#define LVT_MASKED (1u << 16)           /* Do not deliver. */
+#define LVT_PERIODIC (1u << 17)         /* Timer reloads at zero. */
+#define LVT_TSC_DEADLINE (2u << 17)     /* Timer fires at TSC deadline. */
+#define SVR_ENABLE (1u << 8)            /* APIC software enable. */
+
+/* Timer divide configuration value for dividing the bus clock by
+   16, so that a 32-bit count spans minutes rather than seconds. */
+#define TIMER_DIV_16 0x3
+
+/* Vectors.  The timer uses the vector of PIC IRQ 0, which is
+   masked once the APIC timer drives the tick; see
+   intr_timer_from_lapic(). */
+#define TIMER_VEC 0x20
+#define SPURIOUS_VEC 0xff
+
+/* Kernel virtual address at which the APIC's registers are
+   mapped: the last page of the address space, far above any RAM
+   that the kernel maps at PHYS_BASE. */
+#define LAPIC_VADDR ((uint8_t *) 0xfffff000)
+
+/* CPUID leaf 1 feature bits. */
+#define CPUID_EDX_APIC (1u << 9)
+#define CPUID_ECX_TSC_DEADLINE (1u << 24)
+
+bool lapic_enable;
+
+/* Registers, or null if the APIC is not in use. */
+static volatile uint32_t *regs;
+
+/* Does the timer support TSC-deadline mode? */
+static bool tsc_deadline;
+
+/* Is the timer's LVT entry currently set for TSC-deadline mode? */
+static bool in_deadline_mode;
+
+static intr_handler_func spurious_interrupt;
+
+/* Returns the APIC register at byte offset REG. */
+static inline uint32_t
+reg_read (unsigned reg)
+{
+  return regs[reg / sizeof *regs];
+}
+
+/* Sets the APIC register at byte offset REG to VALUE. */
+static inline void
+reg_write (unsigned reg, uint32_t value)
+{
+  regs[reg / sizeof *regs] = value;
+}
+
+/* Returns model-specific register MSR. */
+static inline uint64_t
+read_msr (uint32_t msr)
+{
+  uint64_t value;
+  asm volatile ("rdmsr" : "=A" (value) : "c" (msr));
+  return value;
+}
+
+/* Sets model-specific register MSR to VALUE. */
+static inline void
+write_msr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* If -apic was given and the CPU has a local APIC, maps and
+   enables it and returns true.  Otherwise returns false, leaving
+   interrupts to the PIC alone. */
+bool
+lapic_init (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  uint32_t base;
+  uint32_t *pde, *pt;
+
+  if (!lapic_enable)
+    return false;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if (!(edx & CPUID_EDX_APIC))
+    {
+      printf ("CPU lacks a local APIC, ignoring -apic.\n");
+      return false;
+    }
+  tsc_deadline = (ecx & CPUID_ECX_TSC_DEADLINE) != 0;
+
+  /* Map the registers, uncached, in the kernel's page directory,
+     which every process's page directory copies. */
+  pde = &init_page_dir[pd_no (LAPIC_VADDR)];
+  if (*pde != 0)
+    {
+      printf ("No address space for the local APIC, ignoring -apic.\n");
+      return false;
+    }
+  base = read_msr (MSR_APIC_BASE) & PTE_ADDR;
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  pt[pt_no (LAPIC_VADDR)] = base | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  *pde = pde_create (pt);
+  regs = (volatile uint32_t *) LAPIC_VADDR;
+
+  /* Enable the APIC, accept every priority, and pass PIC
+     interrupts and NMIs through as the BIOS would have left
+     them. */
+  write_msr (MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+  intr_register_int (SPURIOUS_VEC, 0, INTR_OFF, spurious_interrupt,
+                     "APIC Spurious");
+  reg_write (LAPIC_SVR, SVR_ENABLE | SPURIOUS_VEC);
+  reg_write (LAPIC_TPR, 0);
+  reg_write (LAPIC_LVT_LINT0, LVT_EXTINT);
+  reg_write (LAPIC_LVT_LINT1, LVT_NMI);
+  reg_write (LAPIC_LVT_TIMER, LVT_MASKED | TIMER_VEC);
+  reg_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  return true;
+}
+
+/* Returns true if the APIC timer can fire at a TSC deadline. */
+bool
+lapic_has_tsc_deadline (void)
+{
+  return regs != NULL && tsc_deadline;
+}
+
+/* Signals the end of the interrupt being handled to the APIC. */
+void
+lapic_eoi (void)
+{
+  reg_write (LAPIC_EOI, 0);
+}
+
+/* Starts the APIC timer counting down from COUNT, in units of 16
+   bus clocks, in the given MODE. */
+void
+lapic_timer_start (enum lapic_timer_mode mode, uint32_t count)
+{
+  uint32_t lvt = TIMER_VEC;
+
+  ASSERT (regs != NULL);
+
+  if (mode == LAPIC_TIMER_PERIODIC)
+    lvt |= LVT_PERIODIC;
+  else if (mode == LAPIC_TIMER_SILENT)
+    lvt |= LVT_MASKED;
+  reg_write (LAPIC_LVT_TIMER, lvt);
+  in_deadline_mode = false;
+  reg_write (LAPIC_TIMER_INIT, count);
+}
+
+/* Returns the APIC timer's current count. */
+uint32_t
+lapic_timer_current (void)
+{
+  ASSERT (regs != NULL);
+
+  return reg_read (LAPIC_TIMER_CUR);
+}
+
+/* Makes the APIC timer interrupt once the time stamp counter
+   reaches TSC, at once if it already has.  The CPU must support
+   TSC-deadline mode. */
+void
+lapic_timer_deadline (uint64_t tsc)
+{
+  ASSERT (lapic_has_tsc_deadline ());
+
+  if (!in_deadline_mode)
+    {
+      reg_write (LAPIC_LVT_TIMER, LVT_TSC_DEADLINE | TIMER_VEC);
+
+      /* The new mode must take effect before the deadline is
+         written.  See [IA32-v3a] 10.5.4.1 "TSC-Deadline Mode". */
+      asm volatile ("mfence" : : : "memory");
+      in_deadline_mode = true;
+    }
+  write_msr (MSR_TSC_DEADLINE, tsc);
+}
+
+/* Spurious interrupt handler.  The APIC raises SPURIOUS_VEC when
+   an interrupt goes away before it can be delivered; there is
+   nothing to do, not even an EOI. */
+static void
+spurious_interrupt (struct intr_frame *f UNUSED)
+{
+}
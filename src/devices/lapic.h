@@ -0,0 +1,26 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* How the local APIC timer counts down. */
+enum lapic_timer_mode
+  {
+    LAPIC_TIMER_ONESHOT,        /* Interrupt once, at zero. */
+    LAPIC_TIMER_PERIODIC,       /* Interrupt at zero and reload. */
+    LAPIC_TIMER_SILENT          /* Count down once, no interrupt. */
+  };
+
+/* -apic: Use the local APIC, if the CPU has one? */
+extern bool lapic_enable;
+
+bool lapic_init (void);
+bool lapic_has_tsc_deadline (void);
+void lapic_eoi (void);
+
+void lapic_timer_start (enum lapic_timer_mode, uint32_t count);
+uint32_t lapic_timer_current (void);
+void lapic_timer_deadline (uint64_t tsc);
+
+#endif /* devices/lapic.h */
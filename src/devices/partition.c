@@ -168,7 +168,9 @@ found_partition (struct block *block, uint8_t part_type,
                               : part_type == 0x22 ? BLOCK_SCRATCH
                               : part_type == 0x23 ? BLOCK_SWAP
                               : BLOCK_FOREIGN);
+      size_t io_size = block_io_size (block);
       struct partition *p;
+      struct block *part;
       char extra_info[128];
       char name[16];
 
@@ -181,7 +183,14 @@ found_partition (struct block *block, uint8_t part_type,
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
                 partition_type_name (part_type), part_type);
-      block_register (name, type, extra_info, size, &partition_operations, p);
+      part = block_register (name, type, extra_info, size,
+                             &partition_operations, p);
+      block_set_channel (part, block_channel (block));
+
+      /* The disk's units, as numbered from the partition's start. */
+      block_set_io_hint (part, io_size,
+                         (block_io_align (block) + io_size - start % io_size)
+                         % io_size);
     }
 }
 
@@ -317,8 +326,30 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT consecutive sectors starting at SECTOR from partition
+   P, sector I into BUFFERS[I]. */
+static void
+partition_read_multiple (void *p_, block_sector_t sector, size_t cnt,
+                         void *const buffers[])
+{
+  struct partition *p = p_;
+  block_read_multiple (p->block, p->start + sector, cnt, buffers);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to partition
+   P, sector I from BUFFERS[I]. */
+static void
+partition_write_multiple (void *p_, block_sector_t sector, size_t cnt,
+                          const void *const buffers[])
+{
+  struct partition *p = p_;
+  block_write_multiple (p->block, p->start + sector, cnt, buffers);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multiple,
+    partition_write_multiple
   };
@@ -0,0 +1,67 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* Configuration space access through the PCI host bridge's I/O
+   ports, PCI configuration mechanism #1.  Only bus 0 is
+   examined, which is where QEMU and Bochs put every device. */
+
+/* Configuration space ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Selects the 32-bit configuration register at byte offset REG
+   of function FUNC of device DEV on bus 0. */
+static void
+select_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+}
+
+/* Returns the 32-bit configuration register at byte offset REG of
+   function FUNC of device DEV on bus 0. */
+uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  select_config (dev, func, reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Sets the 32-bit configuration register at byte offset REG of
+   function FUNC of device DEV on bus 0 to VALUE. */
+void
+pci_write_config (int dev, int func, int reg, uint32_t value)
+{
+  select_config (dev, func, reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Advances *DEV and *FUNC to the next function present on bus 0.
+   Start with *DEV at -1 to get the first.  Returns false after the
+   last one.  A typical loop:
+
+   int dev = -1, func;
+   while (pci_next_function (&dev, &func))
+     ...use function FUNC of device DEV...
+*/
+bool
+pci_next_function (int *dev, int *func)
+{
+  if (*dev < 0)
+    {
+      *dev = 0;
+      *func = 0;
+    }
+  else
+    ++*func;
+
+  for (; *dev < PCI_DEV_CNT; ++*dev, *func = 0)
+    for (; *func < PCI_FUNC_CNT; ++*func)
+      if ((pci_read_config (*dev, *func, PCI_REG_ID) & 0xffff) != 0xffff)
+        return true;
+      else if (*func == 0)
+        {
+          /* No function 0 means no device. */
+          break;
+        }
+  return false;
+}
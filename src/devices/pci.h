@@ -0,0 +1,26 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Devices on a PCI bus, and functions per device. */
+#define PCI_DEV_CNT 32
+#define PCI_FUNC_CNT 8
+
+/* Configuration space registers, by byte offset. */
+#define PCI_REG_ID 0x00         /* Vendor ID, device ID. */
+#define PCI_REG_COMMAND 0x04    /* Command, status. */
+#define PCI_REG_CLASS 0x08      /* Revision, class code. */
+#define PCI_REG_BAR0 0x10       /* First base address register. */
+#define PCI_REG_IRQ 0x3c        /* Interrupt line, pin. */
+
+/* Command register bits. */
+#define PCI_COMMAND_IO 0x01     /* Respond to I/O space accesses. */
+#define PCI_COMMAND_MASTER 0x04 /* May master the bus. */
+
+uint32_t pci_read_config (int dev, int func, int reg);
+void pci_write_config (int dev, int func, int reg, uint32_t value);
+bool pci_next_function (int *dev, int *func);
+
+#endif /* devices/pci.h */
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -46,7 +43,6 @@ void
 pit_configure_channel (int channel, int mode, int frequency)
 {
   uint16_t count;
-  enum intr_level old_level;
 
   ASSERT (channel == 0 || channel == 2);
   ASSERT (mode == 2 || mode == 3);
@@ -74,6 +70,22 @@ pit_configure_channel (int channel, int mode, int frequency)
   else
     count = (PIT_HZ + frequency / 2) / frequency;
 
+  pit_configure_channel_count (channel, mode, count);
+}
+
+/* Configures the given CHANNEL in the PIT in MODE, as
+   pit_configure_channel() does, but with a period of exactly
+   COUNT cycles of the PIT_HZ clock.  A COUNT of 0 means 65536.
+   Writing the mode restarts the channel's period immediately. */
+void
+pit_configure_channel_count (int channel, int mode, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (mode == 2 || mode == 3);
+  ASSERT (count != 1);
+
   /* Configure the PIT mode and load its counters. */
   old_level = intr_disable ();
   outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
@@ -81,3 +93,23 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Returns the number of PIT_HZ cycles left in the current period
+   of the given CHANNEL, which counts down towards 0. */
+uint16_t
+pit_read_channel (int channel)
+{
+  enum intr_level old_level;
+  uint16_t count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the counter so that both bytes come from one value. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  return count;
+}
@@ -0,0 +1,90 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in kernel memory.  Its contents are lost at
+   shutdown, but transfers cost a memcpy() instead of a trip to the
+   disk, which makes it a fast swap or scratch device, or a
+   scratch file system to format with -f on every boot.
+
+   The backing store is a table of separately allocated pages, so
+   that a large disk does not need a contiguous run of the kernel
+   pool. */
+struct ramdisk
+  {
+    size_t page_cnt;            /* Number of pages. */
+    uint8_t **pages;            /* The pages, in sector order. */
+  };
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static int ramdisk_cnt;         /* Number of RAM disks created. */
+
+/* Returns the address of SECTOR in D. */
+static void *
+sector_addr (struct ramdisk *d, block_sector_t sector)
+{
+  return (d->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SECTOR from RAM disk D into BUFFER.  Transfers of
+   different sectors may run at once; callers already serialize
+   those of the same sector, as they would have to for a real
+   disk. */
+static void
+ramdisk_read (void *d, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, sector_addr (d, sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER to SECTOR of RAM disk D. */
+static void
+ramdisk_write (void *d, block_sector_t sector, const void *buffer)
+{
+  memcpy (sector_addr (d, sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static const struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL,
+  };
+
+/* Creates a zeroed RAM disk of PAGE_CNT pages from the kernel pool,
+   registers it as a block device of the given TYPE named "ram0",
+   "ram1", and so on, and returns it.  Panics if memory runs out. */
+struct block *
+ramdisk_create (enum block_type type, size_t page_cnt)
+{
+  struct ramdisk *d;
+  char name[16];
+  size_t i;
+
+  ASSERT (page_cnt > 0);
+
+  d = malloc (sizeof *d);
+  if (d != NULL)
+    d->pages = malloc (page_cnt * sizeof *d->pages);
+  if (d == NULL || d->pages == NULL)
+    PANIC ("ramdisk: out of memory for a %zu-page disk", page_cnt);
+  d->page_cnt = page_cnt;
+  for (i = 0; i < page_cnt; i++)
+    {
+      d->pages[i] = palloc_get_page (PAL_ZERO);
+      if (d->pages[i] == NULL)
+        PANIC ("ramdisk: kernel pool ran out after %zu of %zu pages",
+               i, page_cnt);
+    }
+
+  snprintf (name, sizeof name, "ram%d", ramdisk_cnt++);
+  return block_register (name, type, "RAM disk", page_cnt * SECTORS_PER_PAGE,
+                         &ramdisk_operations, d);
+}
@@ -0,0 +1,9 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+struct block *ramdisk_create (enum block_type, size_t page_cnt);
+
+#endif /* devices/ramdisk.h */
@@ -1,7 +1,7 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <string.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -33,6 +33,13 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable the receive and transmit FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear both FIFOs. */
+
+/* Bytes the transmit FIFO holds once it reports empty. */
+#define XMIT_FIFO_SIZE 16
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -51,27 +58,43 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted, a ring much larger than the UART's
+   FIFO so that heavy console output rarely has to wait.  TX_HEAD
+   and TX_TAIL count bytes ever added and removed; their
+   difference is the number of bytes queued. */
+#define TXQ_SIZE 4096
+static uint8_t txq[TXQ_SIZE];
+static size_t tx_head, tx_tail;
+
+/* Threads waiting for room in the ring, woken by the interrupt
+   handler once half of it is free. */
+static struct semaphore tx_room;
+static int tx_waiters;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void fill_fifo (void);
+static void poll_fifo (void);
+static bool txq_empty (void);
+static bool txq_full (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
 /* Initializes the serial port device for polling mode.
    Polling mode busy-waits for the serial port to become free
    before writing to it.  It's slow, but until interrupts have
-   been initialized it's all we can do. */
+   been initialized it's all we can do.  The FIFOs are enabled
+   even so, so that each wait can be followed by a burst of
+   XMIT_FIFO_SIZE bytes. */
 static void
 init_poll (void) 
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR); /* Enable and clear FIFOs. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  sema_init (&tx_room, 0);
   mode = POLL;
 } 
 
@@ -97,35 +120,71 @@ serial_init_queue (void)
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
+{
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the SIZE bytes in BUFFER to the serial port.  In queued
+   mode the bytes are copied into the transmit ring and the call
+   returns at once, leaving the transmit interrupt to move them
+   into the UART's FIFO.  If the ring fills, we wait for it to
+   drain, or drain it by polling if interrupts were off. */
+void
+serial_putbuf (const uint8_t *buffer, size_t size) 
 {
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
-      /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (size-- > 0)
+        putc_poll (*buffer++);
     }
-  else 
+  else
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      while (size > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t ofs, chunk;
+
+          if (txq_full ())
+            {
+              /* Waiting for the ring to drain would mean turning
+                 interrupts back on, which is impolite if they
+                 were off, so transmit a FIFO's worth by polling
+                 instead.  Otherwise make sure the transmit
+                 interrupt is on before sleeping. */
+              if (old_level == INTR_OFF)
+                poll_fifo ();
+              else
+                {
+                  write_ier ();
+                  tx_waiters++;
+                  sema_down (&tx_room);
+                }
+              continue;
+            }
+
+          /* Copy as much as fits before the ring wraps. */
+          ofs = tx_head % TXQ_SIZE;
+          chunk = TXQ_SIZE - (tx_head - tx_tail);
+          if (chunk > TXQ_SIZE - ofs)
+            chunk = TXQ_SIZE - ofs;
+          if (chunk > size)
+            chunk = size;
+          memcpy (txq + ofs, buffer, chunk);
+          tx_head += chunk;
+          buffer += chunk;
+          size -= chunk;
         }
 
-      intq_putc (&txq, byte); 
+      /* Start transmitting now if the UART is idle, rather than
+         waiting for the interrupt that enabling it would raise. */
+      if ((inb (LSR_REG) & LSR_THRE) != 0)
+        fill_fifo ();
       write_ier ();
     }
-  
+
   intr_set_level (old_level);
 }
 
@@ -135,8 +194,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (!txq_empty ())
+    poll_fifo ();
   intr_set_level (old_level);
 }
 
@@ -182,7 +241,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (!txq_empty ())
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -205,6 +264,45 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Moves up to XMIT_FIFO_SIZE bytes from the transmit ring into
+   the UART, whose transmit FIFO must be empty. */
+static void
+fill_fifo (void)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < XMIT_FIFO_SIZE && !txq_empty (); i++)
+    outb (THR_REG, txq[tx_tail++ % TXQ_SIZE]);
+}
+
+/* Polls the serial port until its transmit FIFO is empty, and
+   then refills it from the transmit ring. */
+static void
+poll_fifo (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while ((inb (LSR_REG) & LSR_THRE) == 0)
+    continue;
+  fill_fifo ();
+}
+
+/* Returns true if the transmit ring is empty. */
+static bool
+txq_empty (void)
+{
+  return tx_head == tx_tail;
+}
+
+/* Returns true if the transmit ring is full. */
+static bool
+txq_full (void)
+{
+  return tx_head - tx_tail == TXQ_SIZE;
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -218,10 +316,14 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* THRE means the whole transmit FIFO is empty, so refill it
+     all at once, and wake anyone waiting for room in the ring
+     once half of it is free. */
+  if ((inb (LSR_REG) & LSR_THRE) != 0)
+    fill_fifo ();
+  if (tx_waiters > 0 && tx_head - tx_tail <= TXQ_SIZE / 2)
+    for (; tx_waiters > 0; tx_waiters--)
+      sema_up (&tx_room);
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -4,14 +4,32 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "devices/vga.h"
+#include "threads/fpu.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/shrinker.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 
 /* Keyboard control register port. */
@@ -98,6 +116,7 @@ shutdown_power_off (void)
 
   printf ("Powering off...\n");
   serial_flush ();
+  vga_flush ();
 
   /* ACPI power-off */
   outw (0xB004, 0x2000);
@@ -129,13 +148,31 @@ static void
 print_stats (void)
 {
   timer_print_stats ();
+  intr_print_stats ();
   thread_print_stats ();
+  fpu_print_stats ();
+  lock_print_stats ();
+  palloc_print_stats ();
+  shrinker_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  ide_print_stats ();
+  cache_print_stats ();
+  dcache_print_stats ();
+  journal_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  pagedir_print_stats ();
+  syscall_print_stats ();
+#endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+  zswap_print_stats ();
 #endif
+  trace_print_stats ();
+  profile_print_stats ();
 }
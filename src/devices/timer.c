@@ -3,8 +3,12 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/lapic.h"
 #include "devices/pit.h"
+#include "devices/vga.h"
+#include <list.h>
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -24,8 +28,76 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* -tickless: Stop the periodic tick while only the idle thread
+   is runnable? */
+bool timer_tickless;
+
+/* PIT cycles per timer tick, and the most timer ticks that fit in
+   one period of the PIT's 16-bit counter. */
+#define PIT_COUNT_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define TIMER_MAX_IDLE_TICKS (65535 / PIT_COUNT_PER_TICK)
+
+/* Number of timer ticks that the next timer interrupt accounts
+   for.  Only more than 1 in tickless mode, after the timer has been
+   reprogrammed by timer_idle_enter() or timer_idle_exit(). */
+static unsigned tick_period = 1;
+
+/* True if the timer must be set back to one interrupt per tick at
+   the next timer interrupt. */
+static bool tick_restore;
+
+/* What raises the timer interrupt. */
+enum tick_source
+  {
+    TICK_PIT,                   /* 8254 PIT through the PIC. */
+    TICK_LAPIC,                 /* Local APIC timer counting down. */
+    TICK_TSC_DEADLINE           /* Local APIC timer at TSC deadlines. */
+  };
+static enum tick_source tick_source = TICK_PIT;
+
+/* Timer ticks over which the TSC and the local APIC timer are
+   calibrated. */
+#define CALIBRATE_TICKS (TIMER_FREQ / 10)
+
+/* TSC cycles and local APIC timer counts per timer tick, measured
+   by cycles_calibrate(), and TSC cycles per second.  In
+   TSC-deadline mode, TICK_TSC is the TSC value at which the last
+   counted tick was due. */
+static uint64_t tsc_per_tick;
+static uint64_t tsc_per_sec;
+static uint32_t lapic_count_per_tick;
+static uint64_t tick_tsc;
+
+/* TSC value when timer_init() ran, the zero of timer_nsec(). */
+static uint64_t boot_tsc;
+
+/* Sleeps shorter than this many nanoseconds spin rather than
+   block, because blocking and waking take about as long. */
+#define HRTIMER_MIN_NS 10000
+
+/* A thread sleeping on a high-resolution timer until the TSC
+   reaches DEADLINE.  Only used in TSC-deadline mode, where the
+   local APIC timer's deadline is moved in from the next tick to
+   the earliest sleeper's. */
+struct hrtimer
+  {
+    uint64_t deadline;          /* Wake-up TSC value. */
+    struct semaphore sema;      /* Upped at DEADLINE. */
+    struct list_elem elem;      /* In hrtimers. */
+  };
+
+/* Sleeping hrtimers, in order of increasing deadline. */
+static struct list hrtimers = LIST_INITIALIZER (hrtimers);
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
+static void cycles_calibrate (bool lapic);
+static void lapic_start (void);
+static uint64_t tick_due (void);
+static void arm_deadline (void);
+static void hrtimer_sleep (uint64_t deadline);
+static void hrtimer_wake (uint64_t now);
+static unsigned max_idle_ticks (void);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
@@ -37,15 +109,43 @@ timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  boot_tsc = timer_cycles ();
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Sets loops_per_tick to LOOPS and, if CYCLES is nonzero, the TSC
+   rate to CYCLES per tick, so that timer_calibrate() need not
+   measure them.  Called for the -calibrate option, whose values
+   an earlier boot on the same machine printed. */
+void
+timer_set_calibration (unsigned loops, unsigned cycles)
+{
+  loops_per_tick = loops;
+  tsc_per_tick = cycles;
+  tsc_per_sec = (uint64_t) cycles * TIMER_FREQ;
+}
+
+/* Calibrates loops_per_tick, used to implement brief delays, and
+   the TSC rate, used by timer_nsec(), unless -calibrate gave them.
+   Then, with -apic, hands the tick over to the local APIC timer,
+   calibrated against the PIT. */
 void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
+  bool lapic;
 
   ASSERT (intr_get_level () == INTR_ON);
+
+  lapic = lapic_init ();
+  if (loops_per_tick != 0)
+    {
+      /* Given on the command line.  The local APIC timer's rate
+         must still be measured. */
+      if (tsc_per_tick == 0 || lapic)
+        cycles_calibrate (lapic);
+      goto calibrated;
+    }
+
   printf ("Calibrating timer...  ");
 
   /* Approximate loops_per_tick as the largest power-of-two
@@ -64,6 +164,18 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  cycles_calibrate (lapic);
+  printf ("Timer: -calibrate=%u,%"PRIu64" skips calibration.\n",
+          loops_per_tick, tsc_per_tick);
+
+ calibrated:
+  if (lapic)
+    {
+      if (lapic_count_per_tick > 0)
+        lapic_start ();
+      else
+        printf ("Local APIC timer does not count, keeping the PIT.\n");
+    }
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -76,6 +188,33 @@ timer_ticks (void)
   return t;
 }
 
+/* Returns the value of the CPU's time stamp counter, which counts
+   processor cycles.  Suitable for measuring short intervals much
+   finer than a timer tick. */
+uint64_t
+timer_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns the number of nanoseconds since the OS booted, as
+   measured by the time stamp counter.  Until timer_calibrate()
+   has measured the TSC's rate, only counts whole timer ticks. */
+int64_t
+timer_nsec (void)
+{
+  uint64_t cycles = timer_cycles () - boot_tsc;
+
+  if (tsc_per_sec == 0)
+    return timer_ticks () * (1000 * 1000 * 1000 / TIMER_FREQ);
+
+  /* Split the conversion so that CYCLES * 10**9 cannot overflow. */
+  return (cycles / tsc_per_sec * 1000 * 1000 * 1000
+          + cycles % tsc_per_sec * 1000 * 1000 * 1000 / tsc_per_sec);
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
@@ -166,6 +305,103 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before
+   halting the CPU.  In tickless mode, reprograms the timer to
+   interrupt at the earliest sleeping thread's wake time instead of
+   at the next tick, as far as the PIT's counter allows. */
+void
+timer_idle_enter (void)
+{
+  int64_t idle_ticks;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* The screen may not be updated for a while. */
+  vga_flush ();
+
+  if (!timer_tickless || tick_restore)
+    return;
+
+  idle_ticks = thread_get_next_wakeup () - ticks;
+  if (idle_ticks > max_idle_ticks ())
+    idle_ticks = max_idle_ticks ();
+  if (idle_ticks <= 1)
+    return;
+
+  tick_period = idle_ticks;
+  tick_restore = true;
+  switch (tick_source)
+    {
+    case TICK_PIT:
+      pit_configure_channel_count (0, 2, idle_ticks * PIT_COUNT_PER_TICK);
+      break;
+    case TICK_LAPIC:
+      lapic_timer_start (LAPIC_TIMER_ONESHOT,
+                         idle_ticks * lapic_count_per_tick);
+      break;
+    case TICK_TSC_DEADLINE:
+      arm_deadline ();
+      break;
+    }
+}
+
+/* Called by the scheduler, with interrupts off, when switching
+   from the idle thread to another thread.  If the timer was set
+   up for a long idle period, cuts the period short at the next
+   tick boundary, so that the new thread is preempted on time.  The
+   timer ticks elapsed in the idle period are counted at the next
+   timer interrupt. */
+void
+timer_idle_exit (void)
+{
+  unsigned elapsed, rest;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tick_period <= 1)
+    return;
+
+  switch (tick_source)
+    {
+    case TICK_PIT:
+      /* End the period with the rest of the current tick.  A
+         count of 1 is illegal in mode 2, so round it up. */
+      elapsed = tick_period * PIT_COUNT_PER_TICK - pit_read_channel (0);
+      rest = PIT_COUNT_PER_TICK - elapsed % PIT_COUNT_PER_TICK;
+      pit_configure_channel_count (0, 2, rest > 1 ? rest : 2);
+      tick_period = elapsed / PIT_COUNT_PER_TICK + 1;
+      break;
+
+    case TICK_LAPIC:
+      {
+        /* Likewise, unless the period is already over and its
+           interrupt pending. */
+        uint32_t left = lapic_timer_current ();
+
+        if (left == 0)
+          break;
+        elapsed = tick_period * lapic_count_per_tick - left;
+        rest = lapic_count_per_tick - elapsed % lapic_count_per_tick;
+        lapic_timer_start (LAPIC_TIMER_ONESHOT, rest);
+        tick_period = elapsed / lapic_count_per_tick + 1;
+      }
+      break;
+
+    case TICK_TSC_DEADLINE:
+      {
+        /* Move the deadline in to the next tick boundary. */
+        unsigned period = (timer_cycles () - tick_tsc) / tsc_per_tick + 1;
+
+        if (period < tick_period)
+          {
+            tick_period = period;
+            arm_deadline ();
+          }
+      }
+      break;
+    }
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -175,13 +411,201 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
-  ticks++;
-  thread_tick ();
+  unsigned elapsed = tick_period;
+
+  if (tick_source == TICK_TSC_DEADLINE)
+    {
+      uint64_t now = timer_cycles ();
+
+      /* The deadline may have been an hrtimer's rather than the
+         tick's. */
+      hrtimer_wake (now);
+      if (now < tick_due ())
+        {
+          arm_deadline ();
+          return;
+        }
+
+      /* There is no periodic mode: set up the next tick now. */
+      tick_tsc += elapsed * tsc_per_tick;
+      tick_period = 1;
+      tick_restore = false;
+      arm_deadline ();
+    }
+  else if (tick_restore)
+    {
+      if (tick_source == TICK_LAPIC)
+        lapic_timer_start (LAPIC_TIMER_PERIODIC, lapic_count_per_tick);
+      else
+        pit_configure_channel (0, 2, TIMER_FREQ);
+      tick_period = 1;
+      tick_restore = false;
+    }
+
+  if (profile_enabled)
+    profile_sample (args);
+  while (elapsed-- > 0)
+    {
+      ticks++;
+      thread_tick ((args->cs & 3) != 0);
+    }
   
   thread_wake_sleeping (ticks);
+  vga_flush ();
+
+}
+
+/* Measures tsc_per_tick and, if LAPIC is true,
+   lapic_count_per_tick against the PIT tick.  Interrupts must be
+   on. */
+static void
+cycles_calibrate (bool lapic)
+{
+  int64_t start;
+  uint64_t tsc;
+
+  ASSERT (intr_get_level () == INTR_ON);
 
+  /* Wait for a timer tick, then count for a whole number of
+     them. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  if (lapic)
+    lapic_timer_start (LAPIC_TIMER_SILENT, UINT32_MAX);
+  tsc = timer_cycles ();
+
+  start = ticks;
+  while (ticks - start < CALIBRATE_TICKS)
+    barrier ();
+  if (lapic)
+    lapic_count_per_tick = ((UINT32_MAX - lapic_timer_current ())
+                            / CALIBRATE_TICKS);
+  tsc_per_tick = (timer_cycles () - tsc) / CALIBRATE_TICKS;
+  tsc_per_sec = tsc_per_tick * TIMER_FREQ;
+}
+
+/* Makes the local APIC timer, rather than the PIT, raise the timer
+   interrupt from now on. */
+static void
+lapic_start (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  intr_timer_from_lapic ();
+  tick_period = 1;
+  tick_restore = false;
+  if (lapic_has_tsc_deadline ())
+    {
+      tick_source = TICK_TSC_DEADLINE;
+      tick_tsc = timer_cycles ();
+      arm_deadline ();
+    }
+  else
+    {
+      tick_source = TICK_LAPIC;
+      lapic_timer_start (LAPIC_TIMER_PERIODIC, lapic_count_per_tick);
+    }
+  intr_set_level (old_level);
+
+  printf ("Timer: local APIC, %'"PRIu32" counts, %'"PRIu64" cycles "
+          "per tick%s.\n", lapic_count_per_tick, tsc_per_tick,
+          tick_source == TICK_TSC_DEADLINE ? ", TSC deadline" : "");
+}
+
+/* In TSC-deadline mode, returns the TSC value at which the timer
+   interrupt for the current tick period is due. */
+static uint64_t
+tick_due (void)
+{
+  return tick_tsc + tick_period * tsc_per_tick;
+}
+
+/* In TSC-deadline mode, sets the local APIC timer to interrupt at
+   the end of the current tick period or at the earliest hrtimer's
+   deadline, whichever comes first.  Interrupts must be off. */
+static void
+arm_deadline (void)
+{
+  uint64_t deadline = tick_due ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&hrtimers))
+    {
+      struct hrtimer *h = list_entry (list_front (&hrtimers),
+                                      struct hrtimer, elem);
+      if (h->deadline < deadline)
+        deadline = h->deadline;
+    }
+  lapic_timer_deadline (deadline);
+}
+
+/* Returns true if hrtimer A's deadline is earlier than B's. */
+static bool
+hrtimer_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct hrtimer *a = list_entry (a_, struct hrtimer, elem);
+  const struct hrtimer *b = list_entry (b_, struct hrtimer, elem);
+
+  return a->deadline < b->deadline;
+}
+
+/* Blocks the current thread until the TSC reaches DEADLINE.  Must
+   be in TSC-deadline mode, with interrupts on. */
+static void
+hrtimer_sleep (uint64_t deadline)
+{
+  struct hrtimer h;
+  enum intr_level old_level;
+
+  ASSERT (tick_source == TICK_TSC_DEADLINE);
+  ASSERT (intr_get_level () == INTR_ON);
+
+  h.deadline = deadline;
+  sema_init (&h.sema, 0);
+
+  old_level = intr_disable ();
+  list_insert_ordered (&hrtimers, &h.elem, hrtimer_less, NULL);
+  if (list_front (&hrtimers) == &h.elem)
+    arm_deadline ();
+  sema_down (&h.sema);
+  intr_set_level (old_level);
+}
+
+/* Wakes the threads whose hrtimers are due at TSC value NOW.
+   Called from the timer interrupt. */
+static void
+hrtimer_wake (uint64_t now)
+{
+  while (!list_empty (&hrtimers))
+    {
+      struct hrtimer *h = list_entry (list_front (&hrtimers),
+                                      struct hrtimer, elem);
+      if (h->deadline > now)
+        break;
+      list_pop_front (&hrtimers);
+      sema_up (&h->sema);
+    }
+}
+
+/* Returns the most timer ticks that one interrupt of the current
+   tick source can be put off for. */
+static unsigned
+max_idle_ticks (void)
+{
+  switch (tick_source)
+    {
+    case TICK_LAPIC:
+      return UINT32_MAX / lapic_count_per_tick;
+    case TICK_TSC_DEADLINE:
+      return TIMER_FREQ * 60;
+    default:
+      return TIMER_MAX_IDLE_TICKS;
+    }
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -237,6 +661,14 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
+  else if (tick_source == TICK_TSC_DEADLINE
+           && num * (1000 * 1000 * 1000 / denom) >= HRTIMER_MIN_NS)
+    {
+      /* The local APIC timer can wake us mid-tick, so block on an
+         hrtimer instead of spinning.  NUM is under DENOM /
+         TIMER_FREQ here, so the product cannot overflow. */
+      hrtimer_sleep (timer_cycles () + num * tsc_per_sec / denom);
+    }
   else 
     {
       /* Otherwise, use a busy-wait loop for more accurate
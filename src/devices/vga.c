@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <string.h>
 #include "devices/speaker.h"
+#include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/vaddr.h"
@@ -26,28 +27,49 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Shadow of the framebuffer in RAM, which is what vga_putc()
+   writes.  It is a ring of rows: screen row Y is shadow[(top + Y)
+   % ROW_CNT], so scrolling advances TOP instead of copying the
+   screen.  vga_flush() copies the rows set in DIRTY, a bitmap of
+   screen rows, to video memory, so that any number of scrolls
+   between flushes cost one copy of the screen. */
+static uint8_t shadow[ROW_CNT][COL_CNT][2];
+static size_t top;
+static uint32_t dirty;
+static bool cursor_dirty;
+
+#define ALL_ROWS ((1u << ROW_CNT) - 1)
+
+static bool inited;
+
+static uint8_t *shadow_row (size_t y);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
+static void flush (void);
 static void move_cursor (void);
 static void find_cursor (size_t *x, size_t *y);
 
-/* Initializes the VGA text display. */
+/* Initializes the VGA text display, starting the shadow with
+   whatever is already on the screen. */
 static void
 init (void)
 {
   /* Already initialized? */
-  static bool inited;
   if (!inited)
     {
       fb = ptov (0xb8000);
+      memcpy (shadow, fb, sizeof shadow);
       find_cursor (&cx, &cy);
       inited = true; 
     }
 }
 
 /* Writes C to the VGA text display, interpreting control
-   characters in the conventional ways.  */
+   characters in the conventional ways.  The screen itself is
+   updated by the next vga_flush(), which the timer calls every
+   tick; until the timer starts, every character is flushed at
+   once. */
 void
 vga_putc (int c)
 {
@@ -89,19 +111,45 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
-      if (++cx >= COL_CNT)
-        newline ();
+      {
+        uint8_t *row = shadow_row (cy);
+
+        row[cx * 2] = c;
+        row[cx * 2 + 1] = GRAY_ON_BLACK;
+        dirty |= 1u << cy;
+        if (++cx >= COL_CNT)
+          newline ();
+      }
       break;
     }
 
   /* Update cursor position. */
-  move_cursor ();
+  cursor_dirty = true;
+  if (timer_ticks () == 0)
+    flush ();
+
+  intr_set_level (old_level);
+}
+
+/* Copies any changes to the screen since the last call to video
+   memory. */
+void
+vga_flush (void)
+{
+  enum intr_level old_level = intr_disable ();
 
+  if (inited)
+    flush ();
   intr_set_level (old_level);
 }
-
+
+/* Returns screen row Y of the shadow. */
+static uint8_t *
+shadow_row (size_t y)
+{
+  return shadow[(top + y) % ROW_CNT][0];
+}
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void)
@@ -112,20 +160,21 @@ cls (void)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
 }
 
 /* Clears row Y to spaces. */
 static void
 clear_row (size_t y) 
 {
+  uint8_t *row = shadow_row (y);
   size_t x;
 
   for (x = 0; x < COL_CNT; x++)
     {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
+      row[x * 2] = ' ';
+      row[x * 2 + 1] = GRAY_ON_BLACK;
     }
+  dirty |= 1u << y;
 }
 
 /* Advances the cursor to the first column in the next line on
@@ -139,8 +188,28 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      top = (top + 1) % ROW_CNT;
       clear_row (ROW_CNT - 1);
+      dirty = ALL_ROWS;
+    }
+}
+
+/* Copies the dirty rows of the shadow to video memory and moves
+   the hardware cursor, if it has moved. */
+static void
+flush (void)
+{
+  size_t y;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (y = 0; dirty != 0; y++, dirty >>= 1)
+    if (dirty & 1)
+      memcpy (fb[y], shadow_row (y), sizeof fb[y]);
+  if (cursor_dirty)
+    {
+      move_cursor ();
+      cursor_dirty = false;
     }
 }
 
@@ -2,5 +2,6 @@
 #define DEVICES_VGA_H
 
 void vga_putc (int);
+void vga_flush (void);
 
 #endif /* devices/vga.h */
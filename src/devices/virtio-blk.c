@@ -0,0 +1,500 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives the virtio block devices that QEMU
+   provides with "-drive if=virtio", through the legacy virtio PCI
+   interface of virtio 0.9.5, whose registers are in I/O space.
+
+   Each disk has one virtqueue of requests shared with the device.
+   A request is a chain of descriptors: a header naming the
+   operation and first sector, one descriptor per physically
+   contiguous run of the data buffers, and a status byte the device
+   fills in.  Any number of threads may have requests in the queue
+   at once, as far as descriptors go; each sleeps on its own
+   semaphore, which the interrupt handler ups when the device puts
+   the request in the used ring.  The device transfers the data
+   itself, so the CPU copies nothing. */
+
+/* Legacy virtio PCI registers, relative to BAR0. */
+#define reg_device_features(D) ((D)->io_base + 0x00)
+#define reg_guest_features(D) ((D)->io_base + 0x04)
+#define reg_queue_pfn(D) ((D)->io_base + 0x08)
+#define reg_queue_size(D) ((D)->io_base + 0x0c)
+#define reg_queue_select(D) ((D)->io_base + 0x0e)
+#define reg_queue_notify(D) ((D)->io_base + 0x10)
+#define reg_status(D) ((D)->io_base + 0x12)
+#define reg_isr(D) ((D)->io_base + 0x13)
+#define reg_capacity(D) ((D)->io_base + 0x14)   /* 64 bits, in sectors. */
+#define reg_physical_block_exp(D) ((D)->io_base + 0x2c)
+#define reg_alignment_offset(D) ((D)->io_base + 0x2d)
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has seen the device. */
+#define STATUS_DRIVER 0x02      /* Guest has a driver for it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+
+/* Feature bits. */
+#define VIRTIO_BLK_F_TOPOLOGY (1u << 10)        /* Physical block size. */
+
+/* PCI identity of a legacy or transitional virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* A descriptor: one piece of memory in a request. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Bytes. */
+    uint16_t flags;             /* VRING_DESC_F_*. */
+    uint16_t next;              /* Next in chain, if VRING_DESC_F_NEXT. */
+  };
+
+#define VRING_DESC_F_NEXT 1     /* Chain continues at next. */
+#define VRING_DESC_F_WRITE 2    /* Device writes, rather than reads. */
+
+/* Requests offered to the device, by head descriptor. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry will go. */
+    uint16_t ring[];
+  };
+
+/* Requests the device is done with. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head descriptor. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+
+struct vring_used
+  {
+    volatile uint16_t flags;    /* VRING_USED_F_NO_NOTIFY. */
+    volatile uint16_t idx;      /* Where the device will put the next. */
+    struct vring_used_elem ring[];
+  };
+
+#define VRING_USED_F_NO_NOTIFY 1        /* Device needs no kick. */
+#define VRING_ALIGN PGSIZE      /* Alignment of the used ring. */
+
+/* The header of a request. */
+struct virtio_blk_header
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+
+/* A request in flight.  It lives on the requesting thread's
+   stack, which is kernel memory the device can reach. */
+struct vblk_request
+  {
+    struct virtio_blk_header header;
+    volatile uint8_t status;    /* 0 once done without error. */
+    struct semaphore done;      /* Up'd by the interrupt handler. */
+  };
+
+/* A virtio block device. */
+struct vblk_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* BAR0 I/O port. */
+    uint8_t irq;                /* Interrupt vector. */
+    size_t io_size;             /* Physical block, in sectors. */
+    block_sector_t io_align;    /* First physically aligned sector. */
+
+    uint16_t qsize;             /* Descriptors in the queue. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t last_used;         /* Used entries the handler consumed. */
+    struct vblk_request **pending;      /* By head descriptor. */
+
+    struct lock lock;           /* Guards the free list and avail. */
+    struct condition desc_freed;        /* Signaled when some are. */
+    uint16_t free_head;         /* First free descriptor. */
+    uint16_t free_cnt;          /* Number of free descriptors. */
+  };
+
+/* Most disks driven, and their channel numbers (see
+   block_set_channel()), after those of the two IDE channels. */
+#define VBLK_MAX 4
+#define VBLK_CHANNEL_BASE 2
+static struct vblk_disk *disks[VBLK_MAX];
+static size_t disk_cnt;
+
+static bool setup_disk (struct vblk_disk *, int dev, int func);
+static void vblk_read_multiple (void *, block_sector_t, size_t cnt,
+                                void *const buffers[]);
+static void vblk_write_multiple (void *, block_sector_t, size_t cnt,
+                                 const void *const buffers[]);
+static void transfer (struct vblk_disk *, block_sector_t, size_t cnt,
+                      const void *const buffers[], bool read);
+static void submit (struct vblk_disk *, block_sector_t, size_t cnt,
+                    const void *const buffers[], bool read);
+static size_t count_pieces (size_t cnt, const void *const buffers[]);
+static void interrupt_handler (struct intr_frame *);
+
+/* Most sectors in one request.  Leaves room for a few requests of
+   this size in a queue of QSIZE descriptors. */
+static size_t
+max_sectors (const struct vblk_disk *d)
+{
+  return d->qsize / 4 - 2;
+}
+
+static struct block_operations vblk_operations;
+
+/* Finds the virtio block devices on the PCI bus and registers
+   them as block devices. */
+void
+virtio_blk_init (void)
+{
+  int dev = -1, func;
+
+  while (pci_next_function (&dev, &func) && disk_cnt < VBLK_MAX)
+    {
+      uint32_t id = pci_read_config (dev, func, PCI_REG_ID);
+      struct vblk_disk *d;
+      struct block *block;
+      uint32_t cap_lo, cap_hi;
+      char extra_info[32];
+      size_t i;
+      bool shared = false;
+
+      if ((id & 0xffff) != VIRTIO_VENDOR || (id >> 16) != VIRTIO_BLK_DEVICE)
+        continue;
+
+      d = malloc (sizeof *d);
+      if (d == NULL)
+        {
+          printf ("virtio-blk: out of memory\n");
+          return;
+        }
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      if (!setup_disk (d, dev, func))
+        {
+          free (d);
+          continue;
+        }
+
+      /* A shared interrupt line gets one handler for all its
+         disks. */
+      for (i = 0; i < disk_cnt; i++)
+        if (disks[i]->irq == d->irq)
+          shared = true;
+      if (!shared)
+        intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+      disks[disk_cnt] = d;
+
+      cap_lo = inl (reg_capacity (d));
+      cap_hi = inl (reg_capacity (d) + 4);
+      snprintf (extra_info, sizeof extra_info, "virtio, queue of %"PRIu16,
+                d->qsize);
+      block = block_register (d->name, BLOCK_RAW, extra_info,
+                              cap_hi != 0 ? UINT32_MAX : cap_lo,
+                              &vblk_operations, d);
+      block_set_channel (block, VBLK_CHANNEL_BASE + disk_cnt);
+      block_set_io_hint (block, d->io_size, d->io_align);
+      disk_cnt++;
+      partition_scan (block);
+    }
+}
+
+/* Brings up the virtio block device at function FUNC of PCI device
+   DEV as disk D, whose name is set.  Returns false if it cannot be
+   used. */
+static bool
+setup_disk (struct vblk_disk *d, int dev, int func)
+{
+  uint32_t bar = pci_read_config (dev, func, PCI_REG_BAR0);
+  uint8_t irq = pci_read_config (dev, func, PCI_REG_IRQ) & 0xff;
+  size_t avail_size, used_ofs, used_size;
+  uint32_t features;
+  uint8_t *ring;
+  uint16_t i;
+
+  if ((bar & 1) == 0 || irq >= 16)
+    {
+      printf ("%s: no I/O ports or legacy interrupt, skipping\n", d->name);
+      return false;
+    }
+  d->io_base = bar & 0xfffc;
+  d->irq = 0x20 + irq;
+  pci_write_config (dev, func, PCI_REG_COMMAND,
+                    pci_read_config (dev, func, PCI_REG_COMMAND)
+                    | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+  /* Reset, then say we drive it.  The only optional feature we use
+     is the report of the physical block size. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  features = inl (reg_device_features (d)) & VIRTIO_BLK_F_TOPOLOGY;
+  outl (reg_guest_features (d), features);
+  d->io_size = 1;
+  d->io_align = 0;
+  if (features != 0 && inb (reg_physical_block_exp (d)) <= 7)
+    {
+      d->io_size = (size_t) 1 << inb (reg_physical_block_exp (d));
+      d->io_align = inb (reg_alignment_offset (d)) % d->io_size;
+    }
+
+  /* The device chooses the queue size.  The descriptor table and
+     available ring come first, then the used ring on the next
+     VRING_ALIGN boundary. */
+  outw (reg_queue_select (d), 0);
+  d->qsize = inw (reg_queue_size (d));
+  if (d->qsize < 16)
+    {
+      printf ("%s: queue of %"PRIu16" is too small, skipping\n",
+              d->name, d->qsize);
+      outb (reg_status (d), 0);
+      return false;
+    }
+  avail_size = sizeof *d->avail + (d->qsize + 1) * sizeof (uint16_t);
+  used_ofs = ROUND_UP (d->qsize * sizeof *d->desc + avail_size, VRING_ALIGN);
+  used_size = sizeof *d->used + d->qsize * sizeof *d->used->ring
+              + sizeof (uint16_t);
+  ring = palloc_get_multiple (PAL_ZERO,
+                              DIV_ROUND_UP (used_ofs + used_size, PGSIZE));
+  d->pending = malloc (d->qsize * sizeof *d->pending);
+  if (ring == NULL || d->pending == NULL)
+    {
+      printf ("%s: out of memory for queue, skipping\n", d->name);
+      if (ring != NULL)
+        palloc_free_multiple (ring,
+                              DIV_ROUND_UP (used_ofs + used_size, PGSIZE));
+      free (d->pending);
+      outb (reg_status (d), 0);
+      return false;
+    }
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + d->qsize * sizeof *d->desc);
+  d->used = (struct vring_used *) (ring + used_ofs);
+  d->last_used = 0;
+
+  lock_init (&d->lock);
+  cond_init (&d->desc_freed);
+  for (i = 0; i < d->qsize; i++)
+    {
+      d->desc[i].next = i + 1;
+      d->pending[i] = NULL;
+    }
+  d->free_head = 0;
+  d->free_cnt = d->qsize;
+
+  outl (reg_queue_pfn (d), vtop (ring) / PGSIZE);
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Reads a sector into BUFFER from disk D. */
+static void
+vblk_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  void *const buffers[1] = { buffer };
+  vblk_read_multiple (d, sec_no, 1, buffers);
+}
+
+/* Writes a sector from BUFFER to disk D. */
+static void
+vblk_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  const void *const buffers[1] = { buffer };
+  vblk_write_multiple (d, sec_no, 1, buffers);
+}
+
+/* Reads the CNT consecutive sectors starting at SEC_NO from disk
+   D, sector I into BUFFERS[I]. */
+static void
+vblk_read_multiple (void *d, block_sector_t sec_no, size_t cnt,
+                    void *const buffers[])
+{
+  transfer (d, sec_no, cnt, (const void *const *) buffers, true);
+}
+
+/* Writes the CNT consecutive sectors starting at SEC_NO to disk D,
+   sector I from BUFFERS[I]. */
+static void
+vblk_write_multiple (void *d, block_sector_t sec_no, size_t cnt,
+                     const void *const buffers[])
+{
+  transfer (d, sec_no, cnt, buffers, false);
+}
+
+static struct block_operations vblk_operations =
+  {
+    vblk_read,
+    vblk_write,
+    vblk_read_multiple,
+    vblk_write_multiple
+  };
+
+/* Transfers the CNT sectors starting at SEC_NO on disk D, sector I
+   to or from BUFFERS[I], into the buffers if READ, in requests of
+   at most max_sectors() sectors. */
+static void
+transfer (struct vblk_disk *d, block_sector_t sec_no, size_t cnt,
+          const void *const buffers[], bool read)
+{
+  while (cnt > 0)
+    {
+      size_t n = cnt < max_sectors (d) ? cnt : max_sectors (d);
+
+      submit (d, sec_no, n, buffers, read);
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
+}
+
+/* Puts a request for the CNT sectors starting at SEC_NO on disk D
+   in the queue and waits for the device to finish it.  Panics if
+   the device reports an error. */
+static void
+submit (struct vblk_disk *d, block_sector_t sec_no, size_t cnt,
+        const void *const buffers[], bool read)
+{
+  struct vblk_request r;
+  size_t need = count_pieces (cnt, buffers) + 2;
+  uint16_t head, tail;
+  size_t s;
+
+  ASSERT (!intr_context ());
+
+  r.header.type = read ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT;
+  r.header.reserved = 0;
+  r.header.sector = sec_no;
+  r.status = 0xff;
+  sema_init (&r.done, 0);
+
+  lock_acquire (&d->lock);
+  while (d->free_cnt < need)
+    cond_wait (&d->desc_freed, &d->lock);
+
+  /* Header. */
+  head = tail = d->free_head;
+  d->desc[tail].addr = vtop (&r.header);
+  d->desc[tail].len = sizeof r.header;
+  d->desc[tail].flags = VRING_DESC_F_NEXT;
+
+  /* Data, merging buffers adjacent in physical memory. */
+  for (s = 0; s < cnt; s++)
+    {
+      uintptr_t addr = vtop (buffers[s]);
+      struct vring_desc *last = &d->desc[tail];
+
+      if (s > 0 && last->addr + last->len == addr)
+        last->len += BLOCK_SECTOR_SIZE;
+      else
+        {
+          tail = last->next;
+          d->desc[tail].addr = addr;
+          d->desc[tail].len = BLOCK_SECTOR_SIZE;
+          d->desc[tail].flags = (VRING_DESC_F_NEXT
+                                 | (read ? VRING_DESC_F_WRITE : 0));
+        }
+    }
+
+  /* Status. */
+  tail = d->desc[tail].next;
+  d->desc[tail].addr = vtop ((const void *) &r.status);
+  d->desc[tail].len = sizeof r.status;
+  d->desc[tail].flags = VRING_DESC_F_WRITE;
+  d->free_head = d->desc[tail].next;
+  d->free_cnt -= need;
+
+  /* Offer it.  The device must see the ring entry before the new
+     index, and the index before the kick. */
+  d->pending[head] = &r;
+  d->avail->ring[d->avail->idx % d->qsize] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  if ((d->used->flags & VRING_USED_F_NO_NOTIFY) == 0)
+    outw (reg_queue_notify (d), 0);
+  lock_release (&d->lock);
+
+  sema_down (&r.done);
+
+  /* Return the chain to the free list. */
+  lock_acquire (&d->lock);
+  d->desc[tail].next = d->free_head;
+  d->free_head = head;
+  d->free_cnt += need;
+  cond_broadcast (&d->desc_freed, &d->lock);
+  lock_release (&d->lock);
+
+  if (r.status != 0)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu", status %d",
+           d->name, read ? "read" : "write", sec_no, r.status);
+}
+
+/* Returns the number of physically contiguous pieces the CNT
+   sectors at BUFFERS, which must be in kernel memory, make up. */
+static size_t
+count_pieces (size_t cnt, const void *const buffers[])
+{
+  size_t pieces = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT (is_kernel_vaddr (buffers[i]));
+      if (i == 0 || vtop (buffers[i - 1]) + BLOCK_SECTOR_SIZE
+                    != vtop (buffers[i]))
+        pieces++;
+    }
+  return pieces;
+}
+
+/* Virtio block interrupt handler.  Wakes the requesters of
+   everything the device has finished on each disk using the
+   interrupt. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct vblk_disk *d = disks[i];
+
+      if (d->irq != f->vec_no)
+        continue;
+
+      /* Reading the ISR acknowledges the interrupt, so a request
+         finished after this raises another. */
+      inb (reg_isr (d));
+      while (d->last_used != d->used->idx)
+        {
+          struct vring_used_elem *e;
+          struct vblk_request *r;
+
+          barrier ();
+          e = &d->used->ring[d->last_used % d->qsize];
+          r = d->pending[e->id];
+          d->pending[e->id] = NULL;
+          d->last_used++;
+          sema_up (&r->done);
+        }
+    }
+}
@@ -24,38 +24,45 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      char names[512];
+      int len;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
+      /* Fetch as many names per call as fit in NAMES. */
+      while ((len = getdents (dir_fd, names, sizeof names)) > 0)
         {
-          printf ("%s", name); 
-          if (verbose) 
+          const char *name;
+
+          for (name = names; name < names + len; name += strlen (name) + 1)
             {
-              char full_name[128];
-              int entry_fd;
+              printf ("%s", name); 
+              if (verbose) 
+                {
+                  char full_name[128];
+                  int entry_fd;
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+                  snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
+                  entry_fd = open (full_name);
 
-              printf (": ");
-              if (entry_fd != -1)
-                {
-                  if (isdir (entry_fd))
-                    printf ("directory");
+                  printf (": ");
+                  if (entry_fd != -1)
+                    {
+                      if (isdir (entry_fd))
+                        printf ("directory");
+                      else
+                        printf ("%d-byte file", filesize (entry_fd));
+                      printf (", inumber %d", inumber (entry_fd));
+                    }
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    printf ("open failed");
+                  close (entry_fd);
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
             }
-          printf ("\n");
         }
     }
   else 
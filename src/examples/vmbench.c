@@ -0,0 +1,255 @@
+/* vmbench.c
+
+   Measures the virtual memory system from user space, so that
+   changes to the frame table, page table and swap can be compared:
+
+        vmbench seq [PAGES]     Writes each page of a region of PAGES
+                                pages, by default twice the user
+                                pool, in order, twice over.
+        vmbench rand [PAGES]    Writes random pages of such a region.
+        vmbench mmap FILE       Maps FILE and reads it in order.
+        vmbench stack           Grows the stack a page at a time.
+        vmbench fork            Forks a child that exits at once.
+        vmbench exec            Execs "vmbench nop" and waits for it.
+
+   Each result is printed as "vmbench NAME N cycles/op OPS ops",
+   timed with the CPU's time stamp counter.  The region of the seq
+   and rand tests does not fit in memory, so that the second pass
+   and the random writes page in from swap. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define PGSIZE 4096
+
+/* Where "vmbench mmap" maps its file. */
+#define MAP_ADDR ((uint8_t *) 0x10000000)
+
+/* Stack pages that "vmbench stack" grows by, within the kernel's
+   1 MB stack limit. */
+#define STACK_PAGES 200
+
+#define RAND_CNT 4096
+#define FORK_CNT 64
+#define EXEC_CNT 16
+
+static unsigned default_pages (void);
+static uint8_t *get_region (unsigned pages);
+static void bench_seq (unsigned pages);
+static void bench_rand (unsigned pages);
+static void bench_mmap (const char *file);
+static void bench_stack (void);
+static void bench_fork (void);
+static void bench_exec (void);
+static void report (const char *name, uint64_t cycles, unsigned ops);
+
+/* Returns the CPU's time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *test = argc > 1 ? argv[1] : "";
+  unsigned pages = argc > 2 ? (unsigned) atoi (argv[2]) : default_pages ();
+
+  if (!strcmp (test, "seq") && pages > 0)
+    bench_seq (pages);
+  else if (!strcmp (test, "rand") && pages > 0)
+    bench_rand (pages);
+  else if (!strcmp (test, "mmap") && argc > 2)
+    bench_mmap (argv[2]);
+  else if (!strcmp (test, "stack"))
+    bench_stack ();
+  else if (!strcmp (test, "fork"))
+    bench_fork ();
+  else if (!strcmp (test, "exec"))
+    bench_exec ();
+  else if (!strcmp (test, "nop"))
+    ;
+  else
+    {
+      printf ("usage: vmbench seq|rand [PAGES] | mmap FILE "
+              "| stack | fork | exec\n");
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Returns twice the number of pages in the user pool. */
+static unsigned
+default_pages (void)
+{
+  struct sysstat s;
+
+  if (stats (&s, sizeof s) != sizeof s)
+    return 1024;
+  return 2 * s.user_pages;
+}
+
+/* Returns a new heap region of PAGES pages, or exits. */
+static uint8_t *
+get_region (unsigned pages)
+{
+  uint8_t *region = sbrk ((intptr_t) pages * PGSIZE);
+
+  if (region == (uint8_t *) -1)
+    {
+      printf ("vmbench: sbrk of %u pages failed\n", pages);
+      exit (EXIT_FAILURE);
+    }
+  return region;
+}
+
+/* Writes every page of a region in order, first as fresh zero
+   pages and then again, when the first pages written have been
+   evicted. */
+static void
+bench_seq (unsigned pages)
+{
+  uint8_t *region = get_region (pages);
+  int pass;
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      uint64_t start = rdtsc ();
+      unsigned i;
+
+      for (i = 0; i < pages; i++)
+        region[i * PGSIZE] = i;
+      report (pass == 0 ? "seq-first" : "seq-again", rdtsc () - start, pages);
+    }
+}
+
+/* Writes every page of a region once, then writes pages at random,
+   most of which are out on swap. */
+static void
+bench_rand (unsigned pages)
+{
+  uint8_t *region = get_region (pages);
+  uint64_t start;
+  unsigned i;
+
+  for (i = 0; i < pages; i++)
+    region[i * PGSIZE] = i;
+
+  random_init (0);
+  start = rdtsc ();
+  for (i = 0; i < RAND_CNT; i++)
+    region[random_ulong () % pages * PGSIZE]++;
+  report ("rand", rdtsc () - start, RAND_CNT);
+}
+
+/* Maps FILE and reads all of it in order. */
+static void
+bench_mmap (const char *file)
+{
+  int fd = open (file);
+  unsigned size, i, sum = 0;
+  uint64_t start;
+  mapid_t map;
+
+  if (fd < 0)
+    {
+      printf ("vmbench: %s: open failed\n", file);
+      exit (EXIT_FAILURE);
+    }
+  size = filesize (fd);
+  map = mmap (fd, MAP_ADDR);
+  if (map == MAP_FAILED || size == 0)
+    {
+      printf ("vmbench: %s: mmap failed\n", file);
+      exit (EXIT_FAILURE);
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < size; i += sizeof (unsigned))
+    sum += *(volatile unsigned *) (MAP_ADDR + i);
+  report ("mmap-page", rdtsc () - start, (size + PGSIZE - 1) / PGSIZE);
+  printf ("vmbench: %u bytes, checksum %08x\n", size, sum);
+  munmap (map);
+  close (fd);
+}
+
+/* Touches a new stack page, then recurses DEPTH more times.  Reads
+   the page back afterward, so that the recursion is not turned into
+   a loop that reuses one frame. */
+static int
+grow_stack (int depth)
+{
+  volatile char page[PGSIZE - 64];
+
+  page[0] = depth;
+  if (depth > 0)
+    grow_stack (depth - 1);
+  return page[0];
+}
+
+/* Grows the stack by STACK_PAGES pages, a fault per page. */
+static void
+bench_stack (void)
+{
+  uint64_t start = rdtsc ();
+
+  grow_stack (STACK_PAGES - 1);
+  report ("stack-page", rdtsc () - start, STACK_PAGES);
+}
+
+/* Forks children that exit at once, waiting for each. */
+static void
+bench_fork (void)
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < FORK_CNT; i++)
+    {
+      pid_t pid = fork ();
+
+      if (pid == 0)
+        exit (0);
+      if (pid == PID_ERROR || wait (pid) != 0)
+        {
+          printf ("vmbench: fork failed\n");
+          exit (EXIT_FAILURE);
+        }
+    }
+  report ("fork", rdtsc () - start, FORK_CNT);
+}
+
+/* Runs "vmbench nop" repeatedly, waiting for each. */
+static void
+bench_exec (void)
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < EXEC_CNT; i++)
+    {
+      pid_t pid = exec ("vmbench nop");
+
+      if (pid == PID_ERROR || wait (pid) != 0)
+        {
+          printf ("vmbench: exec failed\n");
+          exit (EXIT_FAILURE);
+        }
+    }
+  report ("exec", rdtsc () - start, EXEC_CNT);
+}
+
+/* Prints that OPS operations called NAME took CYCLES in all. */
+static void
+report (const char *name, uint64_t cycles, unsigned ops)
+{
+  printf ("vmbench %s %llu cycles/op %u ops\n",
+          name, (unsigned long long) (cycles / ops), ops);
+}
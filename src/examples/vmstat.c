@@ -0,0 +1,70 @@
+/* vmstat.c
+
+   Samples the kernel's counters with the stats system call and
+   prints one line per interval, like Unix vmstat:
+
+        vmstat [MSECS [COUNT]]
+
+   samples every MSECS milliseconds, 1000 by default, COUNT times,
+   by default 10.  The first line shows totals since boot and the
+   rest show the change over each interval, except for the free
+   page, swap and load average columns, which are always current. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+static void print_line (const struct sysstat *, const struct sysstat *);
+
+int
+main (int argc, char *argv[])
+{
+  struct sysstat old, new;
+  int msecs = argc > 1 ? atoi (argv[1]) : 1000;
+  int count = argc > 2 ? atoi (argv[2]) : 10;
+  int i;
+
+  if (msecs <= 0 || count <= 0)
+    {
+      printf ("usage: vmstat [MSECS [COUNT]]\n");
+      return EXIT_FAILURE;
+    }
+
+  printf ("%6s %6s %6s %6s %6s %6s %6s %6s %6s %6s %6s %5s\n",
+          "free", "swap", "majflt", "minflt", "evict", "si", "so",
+          "bi", "bo", "vcs", "ics", "load");
+  memset (&old, 0, sizeof old);
+  for (i = 0; i < count; i++)
+    {
+      if (i > 0)
+        poll (NULL, 0, msecs);
+      if (stats (&new, sizeof new) != sizeof new)
+        {
+          printf ("vmstat: stats failed\n");
+          return EXIT_FAILURE;
+        }
+      print_line (&old, &new);
+      old = new;
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Prints the change from OLD to NEW. */
+static void
+print_line (const struct sysstat *old, const struct sysstat *new)
+{
+  printf ("%6u %6u %6llu %6llu %6llu %6llu %6llu %6llu %6llu %6llu %6llu "
+          "%2d.%02d\n",
+          new->user_free, new->swap_used,
+          new->major_faults - old->major_faults,
+          new->minor_faults - old->minor_faults,
+          new->evictions - old->evictions,
+          new->swap_ins - old->swap_ins,
+          new->swap_outs - old->swap_outs,
+          new->sectors_read - old->sectors_read,
+          new->sectors_written - old->sectors_written,
+          new->vol_switches - old->vol_switches,
+          new->invol_switches - old->invol_switches,
+          new->load_avg / 100, new->load_avg % 100);
+}
@@ -0,0 +1,889 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <crc32.h>
+#include <hash.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache.
+
+   All file system I/O goes through a fixed set of sector buffers.
+   Entries are found through a hash table keyed by sector and
+   replaced with the clock algorithm.  Writes only dirty the cached
+   copy; dirty entries are written back when they are replaced, by a
+   flush thread once they have been dirty for FLUSH_INTERVAL ticks
+   or, oldest first, while more than DIRTY_BACKGROUND are dirty, and
+   by cache_flush() at shutdown.  A thread that dirties more than its
+   share of the cache while more than DIRTY_LIMIT entries are dirty
+   writes back its own oldest ones before it goes on, so a heavy
+   writer is held to the speed of the disk instead of filling the
+   cache and making everyone else wait for clean entries.  A flush
+   writes runs of consecutive dirty sectors with
+   one multi-sector request each, padded with the clean cached
+   sectors that complete the device's units (see block_io_size()),
+   so that the device need not read them back in to write a part of
+   a unit.  Sectors queued by
+   cache_read_ahead() are read in by a second thread while their
+   requester carries on.
+
+   Entries written through cache_write_logged() belong to the
+   running journal transaction and must not reach their home sector
+   before it commits, so they are neither replaced nor flushed until
+   cache_unlog_all().
+
+   cache_write_owned() also puts the entry on a list of dirty entries
+   kept by the caller, such as an inode, so that cache_sync() can
+   write back just those; an entry leaves the list when it is
+   cleaned.
+
+   With cache_checksums set, an entry written through
+   cache_write_logged(), which holds file system metadata, keeps a
+   CRC-32 of its data from then on until it is replaced.  Each later
+   use and each write-back checks it, so that a stray store into the
+   cache panics the kernel instead of reaching the disk.
+
+   cache_read_direct() serves callers that keep what they read, such
+   as page faults filling a frame: a sector not in the cache is read
+   straight into the caller's buffer and left uncached, so the data
+   is copied once and does not push out sectors others will use.
+
+   The cache lock guards the table and each entry's bookkeeping.  An
+   entry's own lock is held while its data is read in, copied or
+   written back; it may be taken before the cache lock but never
+   after it; a flush, which alone holds several entry locks, takes
+   them in order of sector.  An entry with users is never
+   replaced. */
+
+/* A cached sector. */
+struct cache_entry
+  {
+    struct hash_elem elem;              /* Element in cache_map. */
+    block_sector_t sector;              /* Sector held. */
+    bool mapped;                        /* In cache_map. */
+    bool valid;                         /* Data read in; guarded by lock. */
+    bool dirty;                         /* Data newer than on disk. */
+    bool accessed;                      /* Used since the hand passed. */
+    bool logged;                        /* Held back for the journal. */
+    bool padding;                       /* Clean, in flush_list; guarded
+                                           by flush_lock. */
+    tid_t writer;                       /* Thread that last dirtied it. */
+    struct list_elem owner_elem;        /* In an owner's dirty list. */
+    bool owned;                         /* In an owner's dirty list? */
+    int64_t dirtied;                    /* Ticks when it became dirty. */
+    bool checked;                       /* CRC valid; guarded by lock. */
+    uint32_t crc;                       /* CRC-32 of data, if checked. */
+    int users;                          /* Threads using the entry. */
+    struct lock lock;                   /* Guards data. */
+    uint8_t *data;                      /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+/* Ticks an entry stays dirty at most, give or take a FLUSH_TICK,
+   and ticks between looks by the flush thread. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+#define FLUSH_TICK (TIMER_FREQ / 10)
+
+/* Dirty entries beyond which the flush thread writes back the
+   oldest, and beyond which heavy writers are throttled. */
+#define DIRTY_BACKGROUND (cache_size / 4)
+#define DIRTY_LIMIT (cache_size / 2)
+
+/* Most sectors waiting to be read ahead. */
+#define AHEAD_MAX 16
+
+/* Most sectors cache_read_direct_multiple() reads in one request. */
+#define DIRECT_RUN_MAX 16
+
+size_t cache_size = 64;
+bool cache_checksums;
+
+static struct cache_entry *entries;     /* cache_size entries. */
+static struct hash cache_map;           /* Mapped entries by sector. */
+static struct lock cache_lock;          /* Guards all but entry data. */
+static struct condition entry_unused;   /* An entry lost its last user. */
+static size_t clock_hand;               /* Next entry to consider. */
+static size_t dirty_cnt;                /* Dirty entries. */
+
+/* Dirty entries being flushed, by sector, and their data or a null
+   pointer for those found clean on a second look, guarded by
+   flush_lock. */
+static struct lock flush_lock;
+static struct cache_entry **flush_list; /* cache_size entries. */
+static const void **flush_bufs;         /* cache_size entries. */
+
+/* Read-ahead queue, a ring guarded by cache_lock. */
+static block_sector_t ahead_queue[AHEAD_MAX];
+static size_t ahead_head;               /* Oldest queued sector. */
+static size_t ahead_cnt;                /* Sectors queued. */
+static struct condition ahead_queued;   /* Signaled on queueing. */
+
+static unsigned long long hit_cnt;      /* Lookups found in cache. */
+static unsigned long long miss_cnt;     /* Lookups read from disk. */
+static unsigned long long write_cnt;    /* Sectors written back. */
+static unsigned long long ahead_total;  /* Sectors read ahead. */
+static unsigned long long direct_cnt;   /* Misses read past the cache. */
+static unsigned long long pad_cnt;      /* Clean sectors written. */
+static unsigned long long throttle_cnt; /* Writers made to flush. */
+static unsigned long long fill_cnt;     /* Partial writes zero-filled. */
+static unsigned long long verify_cnt;   /* Checksums verified. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static thread_func flush_daemon NO_RETURN;
+static thread_func read_ahead_daemon NO_RETURN;
+static struct cache_entry *cache_get (block_sector_t, bool overwrite);
+static void cache_put (struct cache_entry *, bool dirty, bool logged,
+                       struct list *owner);
+static void disown (struct cache_entry *);
+static void write_flush_list (size_t cnt);
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *pick_victim (void);
+static void clean (struct cache_entry *);
+static void balance_dirty (void);
+static void flush_dirty (tid_t writer, int64_t before, size_t keep);
+static int compare_dirtied (const void *, const void *);
+static size_t add_padding (size_t cnt);
+static void clean_run (size_t first, size_t cnt);
+static int compare_sectors (const void *, const void *);
+static void unuse (struct cache_entry *);
+static void verify (struct cache_entry *);
+
+/* Initializes the buffer cache and starts its flush thread. */
+void
+cache_init (void)
+{
+  uint8_t *data;
+  size_t i;
+
+  entries = calloc (cache_size, sizeof *entries);
+  data = malloc (cache_size * BLOCK_SECTOR_SIZE);
+  flush_list = malloc (cache_size * sizeof *flush_list);
+  flush_bufs = malloc (cache_size * sizeof *flush_bufs);
+  if (entries == NULL || data == NULL || flush_list == NULL
+      || flush_bufs == NULL)
+    PANIC ("buffer cache allocation failed");
+  for (i = 0; i < cache_size; i++)
+    {
+      lock_init (&entries[i].lock);
+      entries[i].data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  hash_init (&cache_map, entry_hash, entry_less, NULL);
+  lock_init (&cache_lock);
+  lock_set_name (&cache_lock, "cache");
+  lock_init (&flush_lock);
+  cond_init (&entry_unused);
+  cond_init (&ahead_queued);
+
+  thread_create ("cache-flush", PRI_DEFAULT, flush_daemon, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, false);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e, false, false, NULL);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS.
+   The write reaches the disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer, size_t ofs,
+             size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, ofs == 0 && size == BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  cache_put (e, true, false, NULL);
+  balance_dirty ();
+}
+
+/* Like cache_write(), but also puts SECTOR's entry on list OWNER of
+   dirty entries until it is written back, for cache_sync(). */
+void
+cache_write_owned (block_sector_t sector, const void *buffer, size_t ofs,
+                   size_t size, struct list *owner)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, ofs == 0 && size == BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  cache_put (e, true, false, owner);
+  balance_dirty ();
+}
+
+/* Like cache_write_owned(), for a SECTOR newly allocated to OWNER's
+   file that no one else can yet reach: its bytes outside those
+   written become zeros instead of being read from disk. */
+void
+cache_write_new (block_sector_t sector, const void *buffer, size_t ofs,
+                 size_t size, struct list *owner)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  if (ofs != 0 || size != BLOCK_SECTOR_SIZE)
+    {
+      memset (e->data, 0, ofs);
+      memset (e->data + ofs + size, 0, BLOCK_SECTOR_SIZE - ofs - size);
+      fill_cnt++;
+    }
+  memcpy (e->data + ofs, buffer, size);
+  cache_put (e, true, false, owner);
+  balance_dirty ();
+}
+
+/* Writes back the dirty entries on list OWNER, filled by
+   cache_write_owned(), except those held back for the journal,
+   which reach disk when it commits. */
+void
+cache_sync (struct list *owner)
+{
+  struct list_elem *elem;
+  size_t cnt = 0;
+
+  lock_acquire (&flush_lock);
+  lock_acquire (&cache_lock);
+  for (elem = list_begin (owner); elem != list_end (owner);
+       elem = list_next (elem))
+    {
+      struct cache_entry *e = list_entry (elem, struct cache_entry,
+                                          owner_elem);
+      if (!e->logged)
+        {
+          e->users++;
+          flush_list[cnt++] = e;
+        }
+    }
+  if (cnt > 0 && block_io_size (fs_device) > 1)
+    cnt = add_padding (cnt);
+  lock_release (&cache_lock);
+  write_flush_list (cnt);
+  lock_release (&flush_lock);
+}
+
+/* Takes the entries off list OWNER, whose owner is going away.  They
+   stay dirty and are written back as usual. */
+void
+cache_disown_all (struct list *owner)
+{
+  lock_acquire (&cache_lock);
+  while (!list_empty (owner))
+    disown (list_entry (list_front (owner), struct cache_entry,
+                        owner_elem));
+  lock_release (&cache_lock);
+}
+
+/* Like cache_write(), but also holds SECTOR back from being written
+   in place until cache_unlog_all(). */
+void
+cache_write_logged (block_sector_t sector, const void *buffer, size_t ofs,
+                    size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, ofs == 0 && size == BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  cache_put (e, true, true, NULL);
+}
+
+/* Lets every entry held back by cache_write_logged() be written in
+   place again. */
+void
+cache_unlog_all (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_size; i++)
+    entries[i].logged = false;
+  cond_broadcast (&entry_unused, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Copies all of SECTOR into BUFFER.  If SECTOR is not cached, reads
+   it from disk directly into BUFFER without caching it. */
+void
+cache_read_direct (block_sector_t sector, void *buffer)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e != NULL)
+    {
+      hit_cnt++;
+      e->users++;
+      e->accessed = true;
+    }
+  else
+    direct_cnt++;
+  lock_release (&cache_lock);
+
+  if (e == NULL)
+    {
+      block_read (fs_device, sector, buffer);
+      return;
+    }
+
+  /* E may still be waiting for its first reader. */
+  lock_acquire (&e->lock);
+  if (!e->valid)
+    {
+      block_read (fs_device, sector, e->data);
+      e->valid = true;
+    }
+  else
+    verify (e);
+  memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  cache_put (e, false, false, NULL);
+}
+
+/* Like cache_read_direct() for the CNT consecutive sectors starting
+   at SECTOR, copied one after another into BUFFER.  Each run of
+   them that is not cached is read from disk in one request. */
+void
+cache_read_direct_multiple (block_sector_t sector, size_t cnt, void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  void *bufs[DIRECT_RUN_MAX];
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      size_t run = 0;
+
+      lock_acquire (&cache_lock);
+      while (i + run < cnt && run < DIRECT_RUN_MAX
+             && lookup (sector + i + run) == NULL)
+        {
+          bufs[run] = buffer + (i + run) * BLOCK_SECTOR_SIZE;
+          run++;
+        }
+      direct_cnt += run;
+      lock_release (&cache_lock);
+
+      if (run == 0)
+        {
+          cache_read_direct (sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+          i++;
+        }
+      else
+        {
+          block_read_multiple (fs_device, sector + i, run, bufs);
+          i += run;
+        }
+    }
+}
+
+/* Queues SECTOR to be read into the cache in the background, unless
+   it is cached or queued already.  Does not wait for the read, and
+   drops the request if the queue is full. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  if (lookup (sector) != NULL || ahead_cnt >= AHEAD_MAX)
+    goto done;
+  for (i = 0; i < ahead_cnt; i++)
+    if (ahead_queue[(ahead_head + i) % AHEAD_MAX] == sector)
+      goto done;
+  ahead_queue[(ahead_head + ahead_cnt++) % AHEAD_MAX] = sector;
+  cond_signal (&ahead_queued, &cache_lock);
+
+ done:
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty entry not held back for the journal back to
+   disk. */
+void
+cache_flush (void)
+{
+  flush_dirty (TID_ERROR, INT64_MAX, 0);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Buffer cache: %llu hits, %llu misses, %llu writes, "
+          "%llu read ahead, %llu read direct, %llu padding, "
+          "%llu throttled, %llu zero-filled, %llu verified\n",
+          hit_cnt, miss_cnt, write_cnt, ahead_total, direct_cnt, pad_cnt,
+          throttle_cnt, fill_cnt, verify_cnt);
+}
+
+/* Every FLUSH_TICK ticks, writes back the entries that have been
+   dirty for FLUSH_INTERVAL ticks, so that a crash loses little, and
+   then the oldest others while more than DIRTY_BACKGROUND are
+   dirty, so that writers seldom have to. */
+static void
+flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_TICK);
+      flush_dirty (TID_ERROR, timer_ticks () - FLUSH_INTERVAL,
+                   DIRTY_BACKGROUND);
+    }
+}
+
+/* Makes the running thread, which has just dirtied an entry, write
+   back its own oldest dirty entries if too many entries are dirty
+   and more than half of them are its own. */
+static void
+balance_dirty (void)
+{
+  tid_t writer = thread_current ()->tid;
+  size_t total = 0, own = 0;
+  size_t i;
+
+  if (dirty_cnt <= DIRTY_LIMIT)
+    return;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_size; i++)
+    if (entries[i].dirty && !entries[i].logged)
+      {
+        total++;
+        if (entries[i].writer == writer)
+          own++;
+      }
+  lock_release (&cache_lock);
+
+  if (total > DIRTY_LIMIT && own > DIRTY_LIMIT / 2)
+    {
+      throttle_cnt++;
+      flush_dirty (writer, -1, DIRTY_LIMIT / 4);
+    }
+}
+
+/* Writes back dirty entries not held back for the journal, among
+   those last dirtied by WRITER, or all if WRITER is TID_ERROR:
+   those that became dirty at or before tick BEFORE, then the oldest
+   of the rest until at most KEEP remain dirty. */
+static void
+flush_dirty (tid_t writer, int64_t before, size_t keep)
+{
+  size_t cnt = 0, old_cnt;
+  size_t i;
+
+  lock_acquire (&flush_lock);
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_size; i++)
+    if (entries[i].dirty && !entries[i].logged
+        && (writer == TID_ERROR || entries[i].writer == writer))
+      flush_list[cnt++] = &entries[i];
+  qsort (flush_list, cnt, sizeof *flush_list, compare_dirtied);
+  for (old_cnt = 0; old_cnt < cnt; old_cnt++)
+    if (flush_list[old_cnt]->dirtied > before)
+      break;
+  if (cnt - old_cnt > keep)
+    old_cnt = cnt - keep;
+  cnt = old_cnt;
+  for (i = 0; i < cnt; i++)
+    flush_list[i]->users++;
+  if (cnt > 0 && block_io_size (fs_device) > 1)
+    cnt = add_padding (cnt);
+  lock_release (&cache_lock);
+  write_flush_list (cnt);
+  lock_release (&flush_lock);
+}
+
+/* Writes back the CNT entries in flush_list, on each of which the
+   caller holds a use, in runs of consecutive sectors, and drops the
+   uses. */
+static void
+write_flush_list (size_t cnt)
+{
+  size_t i, j;
+
+  ASSERT (lock_held_by_current_thread (&flush_lock));
+
+  /* Their users keep the entries' sectors from changing. */
+  qsort (flush_list, cnt, sizeof *flush_list, compare_sectors);
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i + 1; j < cnt; j++)
+        if (flush_list[j]->sector != flush_list[j - 1]->sector + 1)
+          break;
+      clean_run (i, j - i);
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      flush_list[i]->padding = false;
+      unuse (flush_list[i]);
+    }
+}
+
+/* Reads queued sectors into the cache, oldest first. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&cache_lock);
+      while (ahead_cnt == 0)
+        cond_wait (&ahead_queued, &cache_lock);
+      sector = ahead_queue[ahead_head];
+      ahead_head = (ahead_head + 1) % AHEAD_MAX;
+      ahead_cnt--;
+      ahead_total++;
+      lock_release (&cache_lock);
+
+      cache_put (cache_get (sector, false), false, false, NULL);
+    }
+}
+
+/* Returns the entry for SECTOR with its lock held, reading the
+   sector in first unless OVERWRITE says the caller is about to
+   replace all of it. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool overwrite)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          hit_cnt++;
+          break;
+        }
+
+      e = pick_victim ();
+      if (e == NULL)
+        cond_wait (&entry_unused, &cache_lock);
+      else if (!e->dirty)
+        {
+          if (e->mapped)
+            hash_delete (&cache_map, &e->elem);
+          e->sector = sector;
+          e->mapped = true;
+          e->valid = false;
+          e->checked = false;
+          hash_insert (&cache_map, &e->elem);
+          miss_cnt++;
+          break;
+        }
+      else
+        {
+          /* Write the victim back, then look again: SECTOR may have
+             been brought in meanwhile. */
+          e->users++;
+          lock_release (&cache_lock);
+          clean (e);
+          unuse (e);
+          lock_acquire (&cache_lock);
+        }
+    }
+  e->users++;
+  e->accessed = true;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  if (!e->valid)
+    {
+      if (!overwrite)
+        block_read (fs_device, sector, e->data);
+      e->valid = true;
+    }
+  else
+    verify (e);
+  return e;
+}
+
+/* Releases entry E obtained from cache_get(), marking it dirty if
+   DIRTY, held back for the journal if LOGGED and on dirty list OWNER
+   if that is nonnull. */
+static void
+cache_put (struct cache_entry *e, bool dirty, bool logged,
+           struct list *owner)
+{
+  if (dirty && cache_checksums && (logged || e->checked))
+    {
+      e->crc = crc32 (0, e->data, BLOCK_SECTOR_SIZE);
+      e->checked = true;
+    }
+  lock_release (&e->lock);
+  if (dirty)
+    {
+      lock_acquire (&cache_lock);
+      if (!e->dirty)
+        {
+          dirty_cnt++;
+          e->dirtied = timer_ticks ();
+        }
+      e->dirty = true;
+      e->writer = thread_current ()->tid;
+      if (logged)
+        e->logged = true;
+      if (owner != NULL)
+        {
+          disown (e);
+          list_push_back (owner, &e->owner_elem);
+          e->owned = true;
+        }
+      lock_release (&cache_lock);
+    }
+  unuse (e);
+}
+
+/* Returns the mapped entry for SECTOR, or a null pointer. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  key.sector = sector;
+  e = hash_find (&cache_map, &key.elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Picks an entry without users to replace, giving entries used
+   since the clock hand last passed a second chance.  Returns a
+   null pointer if every entry is in use. */
+static struct cache_entry *
+pick_victim (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < 2 * cache_size; i++)
+    {
+      struct cache_entry *e = &entries[clock_hand];
+
+      clock_hand = (clock_hand + 1) % cache_size;
+      if (e->users > 0 || e->logged)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Writes entry E, on which the caller holds a use, back to disk if
+   it is dirty and not held back for the journal. */
+static void
+clean (struct cache_entry *e)
+{
+  block_sector_t sector;
+  bool dirty;
+
+  lock_acquire (&e->lock);
+  lock_acquire (&cache_lock);
+  dirty = e->dirty && !e->logged;
+  if (dirty)
+    {
+      e->dirty = false;
+      dirty_cnt--;
+      write_cnt++;
+      disown (e);
+    }
+  sector = e->sector;
+  lock_release (&cache_lock);
+  if (dirty)
+    {
+      verify (e);
+      block_write (fs_device, sector, e->data);
+    }
+  lock_release (&e->lock);
+}
+
+/* Adds to the CNT dirty entries in flush_list the clean entries
+   that share a unit of fs_device with one of them and returns the
+   new count. */
+static size_t
+add_padding (size_t cnt)
+{
+  size_t dirty_cnt = cnt;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&flush_lock));
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < dirty_cnt; i++)
+    {
+      block_sector_t sector = flush_list[i]->sector;
+      block_sector_t s = block_unit_start (fs_device, sector);
+      block_sector_t end = block_unit_start (fs_device, sector
+                                             + block_io_size (fs_device));
+
+      for (; s < end; s++)
+        {
+          struct cache_entry *e = lookup (s);
+
+          if (e != NULL && !e->dirty && !e->logged && !e->padding)
+            {
+              e->users++;
+              e->padding = true;
+              flush_list[cnt++] = e;
+            }
+        }
+    }
+  return cnt;
+}
+
+/* Writes back the CNT entries of flush_list starting at FIRST,
+   which hold consecutive sectors, with as few requests as the
+   entries still dirty and not held back allow.  Padding entries
+   are written with them if the run still has a dirty entry. */
+static void
+clean_run (size_t first, size_t cnt)
+{
+  struct cache_entry **run = flush_list + first;
+  const void **bufs = flush_bufs + first;
+  size_t run_dirty;
+  size_t i, n;
+
+  for (i = 0; i < cnt; i++)
+    lock_acquire (&run[i]->lock);
+  lock_acquire (&cache_lock);
+  run_dirty = 0;
+  for (i = 0; i < cnt; i++)
+    if (run[i]->dirty && !run[i]->logged)
+      {
+        run[i]->dirty = false;
+        dirty_cnt--;
+        write_cnt++;
+        disown (run[i]);
+        run_dirty++;
+        bufs[i] = run[i]->data;
+      }
+    else
+      bufs[i] = NULL;
+  for (i = 0; i < cnt; i++)
+    if (run_dirty > 0 && bufs[i] == NULL && run[i]->padding
+        && run[i]->valid && !run[i]->logged)
+      {
+        pad_cnt++;
+        bufs[i] = run[i]->data;
+      }
+  lock_release (&cache_lock);
+
+  for (i = 0; i < cnt; i++)
+    if (bufs[i] != NULL)
+      verify (run[i]);
+  for (i = 0; i < cnt; i += n)
+    {
+      for (n = 0; i + n < cnt && bufs[i + n] != NULL; n++)
+        continue;
+      if (n > 0)
+        block_write_multiple (fs_device, run[i]->sector, n, bufs + i);
+      else
+        n = 1;
+    }
+
+  for (i = 0; i < cnt; i++)
+    lock_release (&run[i]->lock);
+}
+
+/* Takes entry E off its owner's dirty list, if it is on one. */
+static void
+disown (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  if (e->owned)
+    {
+      list_remove (&e->owner_elem);
+      e->owned = false;
+    }
+}
+
+/* Drops the caller's use of entry E. */
+static void
+unuse (struct cache_entry *e)
+{
+  lock_acquire (&cache_lock);
+  if (--e->users == 0)
+    cond_signal (&entry_unused, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Panics if entry E, whose lock the caller holds, has a checksum
+   that its data no longer matches. */
+static void
+verify (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (e->checked)
+    {
+      if (crc32 (0, e->data, BLOCK_SECTOR_SIZE) != e->crc)
+        PANIC ("buffer cache: sector %"PRDSNu" corrupted", e->sector);
+      verify_cnt++;
+    }
+}
+
+/* Returns a hash of entry E's sector. */
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *c = hash_entry (e, struct cache_entry, elem);
+  return hash_int (c->sector);
+}
+
+/* Orders pointers to cache entries by sector, for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Orders pointers to cache entries by the time they became dirty,
+   for qsort(). */
+static int
+compare_dirtied (const void *a_, const void *b_)
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+
+  return a->dirtied < b->dirtied ? -1 : a->dirtied > b->dirtied;
+}
+
+/* Returns true if entry A's sector precedes entry B's. */
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct cache_entry, elem)->sector
+          < hash_entry (b, struct cache_entry, elem)->sector);
+}
@@ -0,0 +1,37 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors the buffer cache holds.  May be set before
+   cache_init(). */
+extern size_t cache_size;
+
+/* If true, entries written through cache_write_logged() carry a
+   checksum that is verified each time they are used.  May be set
+   before cache_init(). */
+extern bool cache_checksums;
+
+void cache_init (void);
+void cache_read (block_sector_t, void *buffer, size_t ofs, size_t size);
+void cache_write (block_sector_t, const void *buffer, size_t ofs,
+                  size_t size);
+void cache_write_owned (block_sector_t, const void *buffer, size_t ofs,
+                        size_t size, struct list *owner);
+void cache_write_new (block_sector_t, const void *buffer, size_t ofs,
+                      size_t size, struct list *owner);
+void cache_sync (struct list *owner);
+void cache_disown_all (struct list *owner);
+void cache_write_logged (block_sector_t, const void *buffer, size_t ofs,
+                         size_t size);
+void cache_unlog_all (void);
+void cache_read_direct (block_sector_t, void *buffer);
+void cache_read_direct_multiple (block_sector_t, size_t cnt, void *buffer);
+void cache_read_ahead (block_sector_t);
+void cache_flush (void);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
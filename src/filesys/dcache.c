@@ -0,0 +1,150 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers what looking up a name in a directory found, keyed by
+   the directory's inode sector and the name, so that opening the
+   same path again needs no directory I/O.  A failed lookup is
+   remembered too, as a negative entry with sector 0, which no file
+   uses.  The directory code updates the cache whenever it adds or
+   removes a name, while holding the directory's inode lock, so the
+   cache is never stale.  The least recently used entry is replaced
+   once all DCACHE_SIZE are in use. */
+
+/* A cached name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentry_map. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up. */
+    block_sector_t sector;              /* File's inode sector, or 0. */
+  };
+
+/* Number of cached names. */
+#define DCACHE_SIZE 256
+
+static struct dentry dentries[DCACHE_SIZE];
+static struct hash dentry_map;          /* Entries in use. */
+static struct list lru_list;            /* All entries, most recent first. */
+static struct lock dcache_lock;         /* Guards all of the above. */
+
+static unsigned long long hit_cnt;      /* Lookups answered. */
+static unsigned long long miss_cnt;     /* Lookups not cached. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find (block_sector_t dir, const char *name);
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  hash_init (&dentry_map, dentry_hash, dentry_less, NULL);
+  list_init (&lru_list);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back (&lru_list, &dentries[i].lru_elem);
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in directory DIR in the cache.  If it is cached,
+   stores the sector of its inode, or 0 if DIR has no such name,
+   into *SECTOR and returns true.  Otherwise returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sector)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      *sector = d->sector;
+      hit_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in directory DIR has its inode in SECTOR, or
+   that DIR has no such name if SECTOR is 0. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  ASSERT (strlen (name) <= NAME_MAX);
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+      if (d->name[0] != '\0')
+        hash_delete (&dentry_map, &d->hash_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentry_map, &d->hash_elem);
+    }
+  d->sector = sector;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Directory entry cache: %llu hits, %llu misses\n",
+          hit_cnt, miss_cnt);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_map, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Returns a hash of dentry E's directory and name. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
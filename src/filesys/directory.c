@@ -1,8 +1,11 @@
 #include "filesys/directory.h"
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
@@ -21,12 +24,61 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* A directory is a hash table of buckets, one per sector, and the
+   number of buckets is a power of two.  An entry lives in the
+   bucket its name hashes to, so a lookup reads a single sector.
+   When a name's bucket is full, every bucket is split in two: the
+   number of buckets doubles and the entries that hash to the new
+   half move there.  A directory of one bucket is just a short
+   linear list, as it always was. */
+#define BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Most buckets in a directory. */
+#define BUCKET_MAX 1024
+
+/* A bucket. */
+struct bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRIES];
+    uint8_t unused[BLOCK_SECTOR_SIZE
+                   - BUCKET_ENTRIES * sizeof (struct dir_entry)];
+  };
+
+static bool is_dot (const char *name);
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent is the directory in sector PARENT,
+   and adds its "." and ".." entries.  Returns true if successful,
+   false on failure, in which case SECTOR and anything allocated
+   for the directory have been released. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  size_t cnt = 1;
+  bool success;
+
+  while (cnt * BUCKET_ENTRIES < entry_cnt + 2)
+    cnt *= 2;
+  if (!inode_create (sector, cnt * BLOCK_SECTOR_SIZE, true))
+    {
+      free_map_release (sector, 1);
+      return false;
+    }
+
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent));
+  if (!success)
+    {
+      if (dir != NULL)
+        inode_remove (dir->inode);
+      else
+        free_map_release (sector, 1);
+    }
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -37,6 +89,7 @@ dir_open (struct inode *inode)
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
     {
+      inode_set_metadata (inode);
       dir->inode = inode;
       dir->pos = 0;
       return dir;
@@ -83,32 +136,148 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns true if NAME is "." or "..", which every directory
+   has and which are never listed or removed. */
+static bool
+is_dot (const char *name)
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
+}
+
+/* Returns the number of buckets in DIR. */
+static size_t
+bucket_cnt (const struct dir *dir)
+{
+  size_t cnt = DIV_ROUND_UP (inode_length (dir->inode), BLOCK_SECTOR_SIZE);
+  return cnt > 0 ? cnt : 1;
+}
+
+/* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
+#define FNV_32_PRIME 16777619u
+#define FNV_32_BASIS 2166136261u
+
+/* Returns the bucket of NAME in a directory of CNT buckets.  The
+   bucket an entry lives in is part of the on-disk format, so this
+   keeps its own hash function instead of hash_string(), which is
+   free to change. */
+static size_t
+bucket_of (const char *name, size_t cnt)
+{
+  const unsigned char *s = (const unsigned char *) name;
+  unsigned hash = FNV_32_BASIS;
+
+  while (*s != '\0')
+    hash = (hash * FNV_32_PRIME) ^ *s++;
+  return hash & (cnt - 1);
+}
+
+/* Returns the byte offset in its directory of entry SLOT of bucket
+   IDX. */
+static off_t
+entry_ofs (size_t idx, size_t slot)
+{
+  return idx * BLOCK_SECTOR_SIZE + slot * sizeof (struct dir_entry);
+}
+
+/* Reads bucket IDX of directory INODE into B.  Slots past the end
+   of the directory read as free. */
+static void
+read_bucket (struct inode *inode, size_t idx, struct bucket *b)
+{
+  memset (b, 0, sizeof *b);
+  inode_read_at (inode, b, sizeof *b, entry_ofs (idx, 0));
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   Only NAME's bucket is read. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct bucket *b;
+  size_t idx, slot;
+  bool found = false;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+  idx = bucket_of (name, bucket_cnt (dir));
+  read_bucket (dir->inode, idx, b);
+  for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+    {
+      struct dir_entry *e = &b->entries[slot];
+
+      if (e->in_use && !strcmp (name, e->name)) 
+        {
+          if (ep != NULL)
+            *ep = *e;
+          if (ofsp != NULL)
+            *ofsp = entry_ofs (idx, slot);
+          found = true;
+          break;
+        }
+    }
+  free (b);
+  return found;
+}
+
+/* Doubles the number of buckets in DIR from CNT, moving each entry
+   that now hashes to a new bucket there.  Returns false if DIR is
+   as large as it may grow or a disk or memory error occurs. */
+static bool
+split_buckets (struct dir *dir, size_t cnt)
+{
+  struct bucket *old = malloc (sizeof *old);
+  struct bucket *new = malloc (sizeof *new);
+  bool success = false;
+  size_t idx;
+
+  if (old == NULL || new == NULL || 2 * cnt > BUCKET_MAX)
+    goto done;
+
+  /* Allocate the new buckets first, so that nothing after can fail
+     for lack of space. */
+  memset (new, 0, sizeof *new);
+  if (inode_write_at (dir->inode, new, sizeof *new,
+                      entry_ofs (2 * cnt - 1, 0)) != sizeof *new)
+    goto done;
+
+  for (idx = 0; idx < cnt; idx++)
+    {
+      size_t slot, moved = 0;
+
+      read_bucket (dir->inode, idx, old);
+      memset (new, 0, sizeof *new);
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+        {
+          struct dir_entry *e = &old->entries[slot];
+
+          if (e->in_use && bucket_of (e->name, 2 * cnt) != idx)
+            {
+              new->entries[moved++] = *e;
+              e->in_use = false;
+            }
+        }
+      if (moved > 0)
+        {
+          inode_write_at (dir->inode, new, sizeof *new,
+                          entry_ofs (idx + cnt, 0));
+          inode_write_at (dir->inode, old, sizeof *old, entry_ofs (idx, 0));
+        }
+    }
+  success = true;
+
+ done:
+  free (old);
+  free (new);
+  return success;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -121,13 +290,22 @@ dir_lookup (const struct dir *dir, const char *name,
 {
   struct dir_entry e;
 
+  block_sector_t dir_sector, sector;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  /* Keep the entry from being removed before its inode is open. */
+  inode_lock (dir->inode);
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+      if (strlen (name) <= NAME_MAX)
+        dcache_insert (dir_sector, name, sector);
+    }
+  *inode = sector != 0 ? inode_open (sector) : NULL;
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -142,7 +320,8 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
-  off_t ofs;
+  struct bucket *b;
+  block_sector_t sector;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -151,48 +330,89 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   /* Check NAME for validity. */
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
+  if (inode_is_removed (dir->inode))
+    return false;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
 
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_lock (dir->inode);
+  if (!dcache_lookup (inode_get_inumber (dir->inode), name, &sector))
+    sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+  if (sector != 0)
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* Find a free slot in NAME's bucket, splitting buckets until
+     there is one. */
+  for (;;)
+    {
+      size_t cnt = bucket_cnt (dir);
+      size_t idx = bucket_of (name, cnt);
+      size_t slot;
+
+      read_bucket (dir->inode, idx, b);
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+        if (!b->entries[slot].in_use)
+          break;
+      if (slot < BUCKET_ENTRIES)
+        {
+          /* Write slot. */
+          e.in_use = true;
+          strlcpy (e.name, name, sizeof e.name);
+          e.inode_sector = inode_sector;
+          success = (inode_write_at (dir->inode, &e, sizeof e,
+                                     entry_ofs (idx, slot)) == sizeof e);
+          if (success)
+            dcache_insert (inode_get_inumber (dir->inode), name,
+                           inode_sector);
+          break;
+        }
+      if (!split_buckets (dir, cnt))
+        break;
+    }
 
  done:
+  inode_unlock (dir->inode);
+  free (b);
   return success;
 }
 
+/* Returns true if directory INODE contains nothing but its "."
+   and ".." entries.  The caller must hold INODE's lock. */
+static bool
+is_empty (struct inode *inode)
+{
+  struct dir dir;
+  char name[NAME_MAX + 1];
+
+  dir.inode = inode;
+  dir.pos = 0;
+  return !dir_readdir (&dir, name);
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME, if NAME
+   is "." or "..", or if NAME is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool is_dir = false;
   bool success = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (is_dot (name))
+    return false;
+
   /* Find directory entry. */
+  inode_lock (dir->inode);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -201,6 +421,16 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only an empty directory may be removed.  Its lock, taken after
+     its parent's, keeps entries from being added meanwhile. */
+  is_dir = inode_is_dir (inode);
+  if (is_dir)
+    {
+      inode_lock (inode);
+      if (!is_empty (inode))
+        goto done;
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
@@ -208,25 +438,34 @@ dir_remove (struct dir *dir, const char *name)
 
   /* Remove inode. */
   inode_remove (inode);
+  dcache_insert (inode_get_inumber (dir->inode), name, 0);
   success = true;
 
  done:
+  if (is_dir)
+    inode_unlock (inode);
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  "." and ".." are skipped. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  for (;;)
     {
+      /* Skip the unused tail of each bucket. */
+      if (dir->pos % BLOCK_SECTOR_SIZE >= entry_ofs (0, BUCKET_ENTRIES))
+        dir->pos = ROUND_UP (dir->pos, BLOCK_SECTOR_SIZE);
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        break;
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && !is_dot (e.name))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -234,3 +473,47 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Copies the names in directory INODE, starting with the entry at
+   byte offset *POS, into BUF as consecutive null-terminated
+   strings, as many as fit in its SIZE bytes, skipping "." and
+   "..".  Reads a whole bucket
+   at a time.  Advances *POS past the entries copied and returns the
+   number of bytes stored, which is 0 at the end of the directory or
+   if SIZE is too small to hold the next name. */
+size_t
+dir_read_names (struct inode *inode, off_t *pos, char *buf, size_t size)
+{
+  struct bucket *b = malloc (sizeof *b);
+  size_t used = 0;
+
+  if (b == NULL)
+    return 0;
+  while (*pos < inode_length (inode))
+    {
+      size_t idx = *pos / BLOCK_SECTOR_SIZE;
+      size_t slot = *pos % BLOCK_SECTOR_SIZE / sizeof (struct dir_entry);
+
+      read_bucket (inode, idx, b);
+      for (; slot < BUCKET_ENTRIES; slot++)
+        {
+          struct dir_entry *e = &b->entries[slot];
+
+          if (e->in_use && !is_dot (e->name))
+            {
+              size_t len = strlen (e->name) + 1;
+
+              if (used + len > size)
+                goto done;
+              memcpy (buf + used, e->name, len);
+              used += len;
+            }
+          *pos = entry_ofs (idx, slot + 1);
+        }
+      *pos = entry_ofs (idx + 1, 0);
+    }
+
+ done:
+  free (b);
+  return used;
+}
@@ -1,65 +1,139 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "filesys/pipe.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
 
-/* An open file. */
+/* An open file, or an end of a pipe.  A pipe end has no inode,
+   position or length and reads or writes only in order. */
 struct file 
   {
-    struct inode *inode;        /* File's inode. */
+    struct inode *inode;        /* File's inode, null for a pipe. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    int ref_cnt;                /* References, dropped by file_close(). */
+    struct pipe *pipe;          /* Pipe this is an end of, or null. */
+    bool pipe_writer;           /* Writing end of PIPE? */
   };
 
+/* Open files. */
+static struct kmem_cache file_cache;
+
+/* Initializes the allocator for open files. */
+void
+file_init (void) 
+{
+  kmem_cache_init (&file_cache, "file", sizeof (struct file), NULL, NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_alloc (&file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ref_cnt = 1;
+      file->pipe = NULL;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (&file_cache, file);
       return NULL; 
     }
 }
 
-/* Opens and returns a new file for the same inode as FILE.
+/* Opens and returns a new end of PIPE, its writing end if WRITER
+   is true.  Returns a null pointer if an allocation fails. */
+struct file *
+file_open_pipe (struct pipe *pipe, bool writer)
+{
+  struct file *file = kmem_cache_alloc (&file_cache);
+  if (file == NULL)
+    return NULL;
+  file->inode = NULL;
+  file->pos = 0;
+  file->deny_write = false;
+  file->ref_cnt = 1;
+  file->pipe = pipe;
+  file->pipe_writer = writer;
+  pipe_open (pipe, writer);
+  return file;
+}
+
+/* Opens and returns a new file for the same inode as FILE, or a
+   new end of the same kind of the same pipe.
    Returns a null pointer if unsuccessful. */
 struct file *
 file_reopen (struct file *file) 
 {
+  if (file->pipe != NULL)
+    return file_open_pipe (file->pipe, file->pipe_writer);
   return file_open (inode_reopen (file->inode));
 }
 
-/* Closes FILE. */
+/* Adds a reference to FILE, which must not be null, and returns
+   it.  The same file, position included, is then shared until
+   each reference has been dropped with file_close(). */
+struct file *
+file_dup (struct file *file)
+{
+  enum intr_level old_level = intr_disable ();
+  file->ref_cnt++;
+  intr_set_level (old_level);
+  return file;
+}
+
+/* Drops a reference to FILE, closing it with the last. */
 void
 file_close (struct file *file) 
 {
   if (file != NULL)
     {
-      file_allow_write (file);
-      inode_close (file->inode);
-      free (file); 
+      enum intr_level old_level = intr_disable ();
+      int ref_cnt = --file->ref_cnt;
+      intr_set_level (old_level);
+
+      if (ref_cnt > 0)
+        return;
+      if (file->pipe != NULL)
+        pipe_close (file->pipe, file->pipe_writer);
+      else
+        {
+          file_allow_write (file);
+          inode_close (file->inode);
+        }
+      kmem_cache_free (&file_cache, file); 
     }
 }
 
-/* Returns the inode encapsulated by FILE. */
+/* Returns the inode encapsulated by FILE, or a null pointer if
+   FILE is a pipe end. */
 struct inode *
 file_get_inode (struct file *file) 
 {
   return file->inode;
 }
 
+/* Returns the pipe FILE is an end of, or a null pointer if it is
+   a file. */
+struct pipe *
+file_get_pipe (struct file *file)
+{
+  return file->pipe;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -68,7 +142,11 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? -1 : pipe_read (file->pipe, buffer, size);
+  bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,6 +159,8 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
+  if (file->pipe != NULL)
+    return -1;
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -94,7 +174,11 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? pipe_write (file->pipe, buffer, size) : -1;
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -110,9 +194,105 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  if (file->pipe != NULL)
+    return -1;
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Allocates disk space for the LENGTH bytes of FILE starting at
+   offset FILE_OFS, growing FILE to cover them if needed, so that
+   later writes there need no allocation.
+   Returns true if successful, false if the disk is full or writes
+   to FILE are denied.
+   The file's current position is unaffected. */
+bool
+file_allocate (struct file *file, off_t file_ofs, off_t length)
+{
+  if (file->pipe != NULL)
+    return false;
+  return inode_allocate (file->inode, file_ofs, length);
+}
+
+/* Writes FILE's data, and its size and allocation or with METADATA
+   all metadata, to disk.  Returns false if FILE is a pipe. */
+bool
+file_sync (struct file *file, bool metadata)
+{
+  if (file->pipe != NULL)
+    return false;
+  inode_sync (file->inode, metadata);
+  return true;
+}
+
+/* Copies up to SIZE bytes from IN, starting at its current
+   position, to OUT at its current position, without the data
+   passing through user memory.  The copy reads and writes through
+   the buffer cache a page at a time, after allocating OUT's share
+   of disk space in one go.
+   Returns the number of bytes copied, which may be less than SIZE
+   if end of file is reached in IN or OUT cannot grow.
+   Advances both positions by the number of bytes copied, or the
+   one position once if IN and OUT are the same file.
+   Either end may be a pipe, which is read or written in order and
+   may end the copy early with a short transfer. */
+off_t
+file_copy (struct file *out, struct file *in, off_t size)
+{
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  uint8_t *buffer;
+  size_t buffer_size;
+  off_t bytes_copied = 0;
+
+  if (in->pipe == NULL && size > inode_length (in->inode) - in->pos)
+    size = inode_length (in->inode) - in->pos;
+  if (size <= 0)
+    return 0;
+  if (out->pipe == NULL)
+    file_allocate (out, out->pos, size);
+
+  /* Fall back on a single sector if no page is free. */
+  buffer = palloc_get_page (0);
+  buffer_size = PGSIZE;
+  if (buffer == NULL)
+    {
+      buffer = sector;
+      buffer_size = sizeof sector;
+    }
+
+  while (bytes_copied < size)
+    {
+      off_t chunk = size - bytes_copied;
+      off_t bytes_read, bytes_written;
+
+      if (chunk > (off_t) buffer_size)
+        chunk = buffer_size;
+      if (in->pipe != NULL)
+        bytes_read = file_read (in, buffer, chunk);
+      else
+        bytes_read = inode_read_at (in->inode, buffer, chunk,
+                                    in->pos + bytes_copied);
+      if (bytes_read <= 0)
+        break;
+      if (out->pipe != NULL)
+        bytes_written = file_write (out, buffer, bytes_read);
+      else
+        bytes_written = inode_write_at (out->inode, buffer, bytes_read,
+                                        out->pos + bytes_copied);
+      if (bytes_written <= 0)
+        break;
+      bytes_copied += bytes_written;
+      if (bytes_read < chunk || bytes_written < bytes_read)
+        break;
+    }
+
+  if (buffer != sector)
+    palloc_free_page (buffer);
+  in->pos += bytes_copied;
+  if (out != in)
+    out->pos += bytes_copied;
+  return bytes_copied;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -140,11 +320,13 @@ file_allow_write (struct file *file)
     }
 }
 
-/* Returns the size of FILE in bytes. */
+/* Returns the size of FILE in bytes, 0 for a pipe end. */
 off_t
 file_length (struct file *file) 
 {
   ASSERT (file != NULL);
+  if (file->pipe != NULL)
+    return 0;
   return inode_length (file->inode);
 }
 
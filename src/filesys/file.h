@@ -1,21 +1,30 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
+struct pipe;
 
 /* Opening and closing files. */
+void file_init (void);
 struct file *file_open (struct inode *);
+struct file *file_open_pipe (struct pipe *, bool writer);
 struct file *file_reopen (struct file *);
+struct file *file_dup (struct file *);
 void file_close (struct file *);
 struct inode *file_get_inode (struct file *);
+struct pipe *file_get_pipe (struct file *);
 
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+bool file_allocate (struct file *, off_t start, off_t length);
+bool file_sync (struct file *, bool metadata);
+off_t file_copy (struct file *out, struct file *in, off_t size);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -2,14 +2,30 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+#ifdef USERPROG
+/* Orders changes of a process's working directory against its
+   other threads taking references to it. */
+static struct lock cwd_lock;
+#endif
+
+/* Entries a new directory has room for before it grows. */
+#define DIR_ENTRY_CNT 16
+
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
+static struct inode *lookup_path (const char *path);
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -21,8 +37,15 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  journal_init (format);
+  dcache_init ();
   inode_init ();
+  file_init ();
   free_map_init ();
+#ifdef USERPROG
+  lock_init (&cwd_lock);
+#endif
 
   if (format) 
     do_format ();
@@ -35,60 +58,254 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  journal_commit ();
   free_map_close ();
+  cache_flush ();
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Creates a file at PATH with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
-   Fails if a file named NAME already exists,
-   or if internal memory allocation fails. */
+   Fails if a file named PATH already exists, if a directory on
+   the way to it does not, or if internal memory allocation
+   fails. */
 bool
-filesys_create (const char *name, off_t initial_size) 
+filesys_create (const char *path, off_t initial_size) 
 {
+  char name[NAME_MAX + 1];
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir = resolve (path, name);
+  /* Place the inode near its directory's. */
+  block_sector_t near = dir != NULL ? inode_get_inumber (dir_get_inode (dir))
+                                    : 0;
+  size_t cnt;
+  bool success;
+
+  journal_begin ();
+  success = (dir != NULL
+             && free_map_allocate_extent (1, near, false,
+                                          &inode_sector, &cnt)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file at PATH.  A directory may be opened too, to be
+   read with dir_read_names() but not written.
    Returns the new file if successful or a null pointer
    otherwise.
-   Fails if no file named NAME exists,
+   Fails if no file named PATH exists,
    or if an internal memory allocation fails. */
 struct file *
-filesys_open (const char *name)
+filesys_open (const char *path)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
+  struct inode *inode = lookup_path (path);
+  struct file *file = file_open (inode);
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
-
-  return file_open (inode);
+  if (file != NULL && inode_is_dir (inode))
+    file_deny_write (file);
+  return file;
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory at PATH.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
+   Fails if no file named PATH exists,
    or if an internal memory allocation fails. */
 bool
-filesys_remove (const char *name) 
+filesys_remove (const char *path) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (path, name);
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
+
+/* Creates a directory at PATH.
+   Returns true if successful, false otherwise.
+   Fails if a file named PATH already exists, if a directory on
+   the way to it does not, or if internal memory allocation
+   fails. */
+bool
+filesys_mkdir (const char *path)
+{
+  char name[NAME_MAX + 1];
+  block_sector_t sector, near;
+  struct dir *dir;
+  size_t cnt;
+  bool success = false;
+
+  journal_begin ();
+  dir = resolve (path, name);
+  if (dir != NULL)
+    {
+      near = inode_get_inumber (dir_get_inode (dir));
+      if (free_map_allocate_extent (1, near, false, &sector, &cnt)
+          && dir_create (sector, DIR_ENTRY_CNT, near))
+        {
+          success = dir_add (dir, name, sector);
+          if (!success)
+            {
+              struct inode *inode = inode_open (sector);
+
+              if (inode != NULL)
+                inode_remove (inode);
+              inode_close (inode);
+            }
+        }
+    }
+  dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+#ifdef USERPROG
+/* Makes the directory at PATH the running process's working
+   directory, which relative paths are looked up in.  Returns true
+   if successful, false if PATH is not a directory. */
+bool
+filesys_chdir (const char *path)
+{
+  struct thread *process = thread_current ()->process;
+  struct inode *inode = lookup_path (path);
+  struct dir *dir, *old;
+
+  if (inode != NULL && !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+
+  lock_acquire (&cwd_lock);
+  old = process->cwd;
+  process->cwd = dir;
+  lock_release (&cwd_lock);
+  dir_close (old);
+  return true;
+}
+
+/* Returns a new reference to the working directory of PROCESS,
+   the root if it has never changed it, for a child to inherit.
+   Returns a null pointer on failure. */
+struct dir *
+filesys_cwd (struct thread *process)
+{
+  struct dir *dir;
+
+  lock_acquire (&cwd_lock);
+  dir = process->cwd != NULL ? dir_reopen (process->cwd) : dir_open_root ();
+  lock_release (&cwd_lock);
+  return dir;
+}
+#endif
+
+/* Returns the directory that PATH is looked up from: the root if
+   PATH is absolute, otherwise the running process's working
+   directory.  Returns a null pointer on failure. */
+static struct dir *
+open_start (const char *path)
+{
+#ifdef USERPROG
+  if (*path != '/')
+    return filesys_cwd (thread_current ()->process);
+#endif
+  return dir_open_root ();
+}
+
+/* Copies the next component of *PATH into NAME and advances *PATH
+   past it.  Returns 1 if successful, 0 if no components remain,
+   or -1 if the component is longer than NAME_MAX. */
+static int
+next_name (const char **path, char name[NAME_MAX + 1])
+{
+  const char *s = *path + strspn (*path, "/");
+  size_t len = strcspn (s, "/");
+
+  if (len == 0)
+    return 0;
+  if (len > NAME_MAX)
+    return -1;
+  memcpy (name, s, len);
+  name[len] = '\0';
+  *path = s + len;
+  return 1;
+}
+
+/* Walks PATH to the directory that holds its last component,
+   which it copies into NAME, and returns that directory.  NAME is
+   empty if PATH is "/".  Only the directory being searched stays
+   open on the way down: each step opens the next before letting
+   go of its parent, and the dcache answers most lookups without
+   reading the directory.  Returns a null pointer if PATH is empty
+   or a directory on the way does not exist. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  char next[NAME_MAX + 1];
+  struct dir *dir;
+  int status;
+
+  if (*path == '\0')
+    return NULL;
+  dir = open_start (path);
+  status = next_name (&path, name);
+  if (status == 0)
+    *name = '\0';
+  while (dir != NULL && status > 0
+         && (status = next_name (&path, next)) > 0)
+    {
+      struct inode *inode = NULL;
+
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      if (inode != NULL && !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          inode = NULL;
+        }
+      dir = dir_open (inode);
+      memcpy (name, next, sizeof next);
+    }
+  if (status < 0)
+    {
+      dir_close (dir);
+      dir = NULL;
+    }
+  return dir;
+}
+
+/* Opens and returns the inode of the file or directory at PATH,
+   or a null pointer if there is none. */
+static struct inode *
+lookup_path (const char *path)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir = resolve (path, name);
+  struct inode *inode = NULL;
+
+  if (dir == NULL)
+    return NULL;
+  if (*name == '\0')
+    inode = inode_reopen (dir_get_inode (dir));
+  else
+    dir_lookup (dir, name, &inode);
+  dir_close (dir);
+  return inode;
+}
 
 /* Formats the file system. */
 static void
@@ -96,7 +313,7 @@ do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, DIR_ENTRY_CNT, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -7,14 +7,23 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* First sector of the journal. */
+#define JOURNAL_SECTORS 64      /* Sectors reserved for the journal. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
 
 void filesys_init (bool format);
 void filesys_done (void);
-bool filesys_create (const char *name, off_t initial_size);
-struct file *filesys_open (const char *name);
-bool filesys_remove (const char *name);
+bool filesys_create (const char *path, off_t initial_size);
+struct file *filesys_open (const char *path);
+bool filesys_remove (const char *path);
+bool filesys_mkdir (const char *path);
+#ifdef USERPROG
+struct thread;
+struct dir;
+bool filesys_chdir (const char *path);
+struct dir *filesys_cwd (struct thread *process);
+#endif
 
 #endif /* filesys/filesys.h */
@@ -4,9 +4,12 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Guards free_map, next_fit. */
+static size_t next_fit;              /* Where the next search starts. */
 
 /* Initializes the free map. */
 void
@@ -15,26 +18,136 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  /* Without the summary, allocation just scans more slowly. */
+  bitmap_enable_summary (free_map);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  lock_init (&free_map_lock);
+}
+
+/* Returns the first of CNT consecutive free sectors at or after
+   START, wrapping around to the start of the disk, or BITMAP_ERROR
+   if there are none. */
+static size_t
+scan_from (size_t start, size_t cnt)
+{
+  size_t sector;
+
+  if (start >= bitmap_size (free_map))
+    start = 0;
+  sector = bitmap_scan (free_map, start, cnt, false);
+  if (sector == BITMAP_ERROR && start > 0)
+    sector = bitmap_scan (free_map, 0, cnt, false);
+  return sector;
+}
+
+/* Marks the CNT sectors starting at SECTOR as ALLOCATED or free,
+   and writes just the bytes of the free map that changed.  Returns
+   false, with the free map unchanged, if they could not be
+   written. */
+static bool
+mark (size_t sector, size_t cnt, bool allocated)
+{
+  bitmap_set_multiple (free_map, sector, cnt, allocated);
+  if (free_map_file != NULL
+      && !bitmap_write_range (free_map, free_map_file, sector, cnt))
+    {
+      bitmap_set_multiple (free_map, sector, cnt, !allocated);
+      return false;
+    }
+  return true;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The search starts where the last one
+   left off, so that allocations do not all crowd the start of the
+   disk and each search need not step over them again.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = scan_from (next_fit, cnt);
+  if (sector != BITMAP_ERROR && !mark (sector, cnt, true))
+    sector = BITMAP_ERROR;
+  if (sector != BITMAP_ERROR)
+    next_fit = sector + cnt;
+  lock_release (&free_map_lock);
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Allocates a run of up to CNT consecutive sectors, storing its
+   first sector into *SECTORP and its length into *CNTP.  The run
+   starts at HINT if that sector is free, so that a file growing
+   there stays contiguous.  Otherwise, unless AT_HINT_ONLY, it is
+   the first run of CNT free sectors after HINT or, failing that,
+   as much as is free after the first free sector after HINT, so
+   that it lands near related data such as the file's inode.
+   Returns true if successful, false if no suitable sector was free
+   or if the free_map file could not be written. */
+bool
+free_map_allocate_extent (size_t cnt, block_sector_t hint, bool at_hint_only,
+                          block_sector_t *sectorp, size_t *cntp)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start, n;
+  bool success = false;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&free_map_lock);
+  if (hint < size && !bitmap_test (free_map, hint))
+    start = hint;
+  else if (at_hint_only)
+    goto done;
+  else
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      start = scan_from (hint, cnt);
+      if (start == BITMAP_ERROR)
+        start = scan_from (hint, 1);
+      if (start == BITMAP_ERROR)
+        goto done;
     }
+
+  for (n = 1; n < cnt && start + n < size; n++)
+    if (bitmap_test (free_map, start + n))
+      break;
+  if (!mark (start, n, true))
+    goto done;
+  *sectorp = start;
+  *cntp = n;
+  success = true;
+
+ done:
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Allocates the lowest run of CNT consecutive free sectors on the
+   disk if it ends at or before LIMIT, and stores its first sector
+   into *SECTORP.  Used to move data toward the start of the disk,
+   so that free space gathers at the end.  Returns true if
+   successful, false if there is no such run or the free_map file
+   could not be written. */
+bool
+free_map_allocate_below (size_t cnt, block_sector_t limit,
+                         block_sector_t *sectorp)
+{
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR
+      && (sector + cnt > limit || !mark (sector, cnt, true)))
+    sector = BITMAP_ERROR;
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
@@ -44,9 +157,10 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark (sector, cnt, false);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,6 +170,7 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
 }
@@ -72,14 +187,20 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
-  /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  struct inode *inode = NULL;
+
+  /* Create inode.  Its sectors are allocated before free_map_file
+     is set, so that writing the free map never allocates. */
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false)
+      || (inode = inode_open (FREE_MAP_SECTOR)) == NULL
+      || !inode_allocate (inode, 0, bitmap_file_size (free_map)))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  free_map_file = file_open (inode);
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
@@ -12,6 +12,11 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_extent (size_t cnt, block_sector_t hint,
+                               bool at_hint_only, block_sector_t *sectorp,
+                               size_t *cntp);
+bool free_map_allocate_below (size_t cnt, block_sector_t limit,
+                              block_sector_t *sectorp);
 void free_map_release (block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
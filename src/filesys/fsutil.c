@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -67,21 +69,35 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Pages of file data that fsutil_extract() reads from the
+   scratch device at a time. */
+#define EXTRACT_PAGES 8
+#define EXTRACT_SECTORS (EXTRACT_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.
+
+   Each file is created at its final size, then copied in runs of
+   up to EXTRACT_SECTORS sectors, each read from the device as one
+   request and written to the file with one file_write(). */
 void
 fsutil_extract (char **argv UNUSED) 
 {
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  void *header;
+  uint8_t *data;
+  void *buffers[EXTRACT_SECTORS];
+  size_t i;
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = palloc_get_multiple (0, EXTRACT_PAGES);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
+  for (i = 0; i < EXTRACT_SECTORS; i++)
+    buffers[i] = data + i * BLOCK_SECTOR_SIZE;
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
@@ -127,10 +143,14 @@ fsutil_extract (char **argv UNUSED)
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
+                                ? EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              size_t sector_cnt = DIV_ROUND_UP (chunk_size,
+                                                BLOCK_SECTOR_SIZE);
+
+              block_read_multiple (src, sector, sector_cnt, buffers);
+              sector += sector_cnt;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -151,7 +171,7 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
+  palloc_free_multiple (data, EXTRACT_PAGES);
   free (header);
 }
 
@@ -221,3 +241,41 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Defragments the file system: moves each file in the root
+   directory that is split over several runs of sectors into a
+   single run, and each other file into the lowest free run that
+   holds it, if that is lower than where it is, until no file
+   moves.  Free space then gathers toward the end of the disk, in
+   runs long enough for large files. */
+void
+fsutil_defrag (char **argv UNUSED)
+{
+  char name[NAME_MAX + 1];
+  size_t moved, total = 0;
+
+  printf ("Defragmenting file system...\n");
+  do
+    {
+      struct dir *dir = dir_open_root ();
+
+      if (dir == NULL)
+        PANIC ("root dir open failed");
+      moved = 0;
+      while (dir_readdir (dir, name))
+        {
+          struct inode *inode;
+
+          if (dir_lookup (dir, name, &inode))
+            {
+              if (inode_defrag (inode))
+                moved++;
+              inode_close (inode);
+            }
+        }
+      dir_close (dir);
+      total += moved;
+    }
+  while (moved > 0);
+  printf ("Moved %zu files.\n", total);
+}
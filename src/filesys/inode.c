@@ -1,23 +1,82 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
 
-/* Identifies an inode. */
+/* Identify an inode, and an inode that holds a directory. */
 #define INODE_MAGIC 0x494e4f44
+#define DIR_MAGIC 0x44495220
+
+/* Sectors read ahead after a sequential read. */
+#define INODE_READ_AHEAD 2
+
+/* Most sectors inode_read_direct() reads in one request, a page. */
+#define INODE_DIRECT_RUN 8
+
+/* Sectors reserved past the end of a file a write extends, so that
+   a file grown by many small appends is still laid out in long
+   runs.  The reserve is returned when the file is last closed. */
+#define INODE_RESERVE 64
+
+/* Extents held in the inode. */
+#define EXTENT_CNT 61
+
+/* A file that has never been longer than INLINE_MAX bytes keeps its
+   data in the inode sector, where the extents would go, so reading
+   it costs no further sector. */
+#define INLINE_OFS offsetof (struct inode_disk, extents)
+#define INLINE_MAX (EXTENT_CNT * sizeof (struct extent))
+
+/* Sector numbers in an index sector. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* A run of contiguous data sectors. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    uint32_t cnt;                       /* Number of sectors. */
+  };
 
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   The leading data sectors are described by up to EXTENT_CNT
+   extents, in file order, which are allocated as long as the free
+   map allows, so finding a sector of a file that is not badly
+   fragmented needs no index sectors at all.  Once the extents run
+   out, later sectors go into a multi-level index: the first
+   PTRS_PER_SECTOR through the indirect sector and the rest through
+   the doubly indirect sector, which holds indirect sectors.
+   Sector 0, the free map's inode, is never a data or index sector,
+   so 0 marks an index entry not yet allocated.
+   Data sectors are allocated when first written, so a file may have
+   holes, index entries still 0, which read as zeros.  Extents can
+   only grow while the index is empty, since index entries are
+   numbered after the extents' sectors.
+   A file no longer than INLINE_MAX bytes with no data sectors at all
+   has its data inline, in the bytes of EXTENTS, with the bytes past
+   its length kept zero; it moves into data sectors once it grows
+   past INLINE_MAX. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Extents in use. */
+    uint32_t extent_sectors;            /* Data sectors they cover. */
+    struct extent extents[EXTENT_CNT];  /* Leading data sectors. */
+    block_sector_t indirect;            /* Indirect index sector. */
+    block_sector_t doubly_indirect;     /* Doubly indirect index sector. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +87,184 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+   Only the fields of the on-disk inode needed to map most offsets
+   are copied here; the extents themselves, and everything else, are
+   read from the inode's sector through the buffer cache when used.
+   ELEM, OPEN_CNT and REMOVED are guarded by open_inodes_lock.  RW is
+   held for reading while data is read or written in place, and for
+   writing while the file is extended or moved or DENY_WRITE_CNT
+   changes, so readers and writers of one file only wait for
+   extensions.  LOCK is for callers, such as directories, whose
+   updates span several reads and writes. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /* Inode content. */
+    off_t read_next;                    /* End of the last read. */
+    bool metadata;                      /* Data is journaled. */
+    bool is_dir;                        /* Holds a directory? */
+    struct rwlock rw;                   /* Guards the fields below. */
+    struct lock lock;                   /* See inode_lock(). */
+    off_t length;                       /* File size in bytes. */
+    uint32_t extent_sectors;            /* Data sectors in extents. */
+    block_sector_t indirect;            /* Indirect index sector. */
+    block_sector_t doubly_indirect;     /* Doubly indirect index sector. */
+    unsigned write_cnt;                 /* Writes since opened. */
+    bool grown;                         /* Size or sectors changed since
+                                           inode_sync()? */
+    struct list dirty;                  /* Dirty data sectors in the
+                                           buffer cache; see
+                                           cache_write_owned(). */
   };
 
+static bool grow (struct inode *, off_t offset, off_t size, size_t reserve,
+                  bool fill);
+static bool has_hole (const struct inode *, off_t offset, off_t size);
+static bool trim_reserve (struct inode_disk *);
+static void release_sectors (struct inode_disk *);
+static off_t read_at (struct inode *, void *, off_t size, off_t offset,
+                      bool direct);
+
+/* Returns entry IDX of index sector INDEX. */
+static block_sector_t
+index_get (block_sector_t index, size_t idx)
+{
+  block_sector_t sector;
+
+  cache_read (index, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Sets entry IDX of index sector INDEX to SECTOR. */
+static void
+index_set (block_sector_t index, size_t idx, block_sector_t sector)
+{
+  journal_write (index, &sector, idx * sizeof sector, sizeof sector);
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, or 0 if POS lies in a hole.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  block_sector_t index;
+  size_t idx;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  if (pos >= inode->length)
     return -1;
+
+  idx = pos / BLOCK_SECTOR_SIZE;
+  if (idx < inode->extent_sectors)
+    {
+      size_t ofs = offsetof (struct inode_disk, extents);
+      struct extent e;
+
+      for (;;)
+        {
+          cache_read (inode->sector, &e, ofs, sizeof e);
+          if (idx < e.cnt)
+            return e.start + idx;
+          idx -= e.cnt;
+          ofs += sizeof e;
+        }
+    }
+  idx -= inode->extent_sectors;
+  if (idx < PTRS_PER_SECTOR)
+    return inode->indirect != 0 ? index_get (inode->indirect, idx) : 0;
+  idx -= PTRS_PER_SECTOR;
+
+  /* A sparse file may be longer than its index can map. */
+  if (inode->doubly_indirect == 0
+      || idx >= PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    return 0;
+  index = index_get (inode->doubly_indirect, idx / PTRS_PER_SECTOR);
+  return index != 0 ? index_get (index, idx % PTRS_PER_SECTOR) : 0;
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Returns true if INODE's data is inline in its sector. */
+static inline bool
+is_inline (const struct inode *inode)
+{
+  return (inode->extent_sectors == 0 && inode->indirect == 0
+          && inode->doubly_indirect == 0
+          && inode->length <= (off_t) INLINE_MAX);
+}
+
+/* Stores in *SECTORP the sector holding the byte at offset POS of
+   INODE's data, which must be below INODE's length, and in *OFSP its
+   offset within that sector.  Returns false if POS lies in a
+   hole. */
+static bool
+locate (const struct inode *inode, off_t pos, block_sector_t *sectorp,
+        int *ofsp)
+{
+  if (is_inline (inode))
+    {
+      *sectorp = inode->sector;
+      *ofsp = INLINE_OFS + pos;
+      return true;
+    }
+  *sectorp = byte_to_sector (inode, pos);
+  *ofsp = pos % BLOCK_SECTOR_SIZE;
+  return *sectorp != 0;
+}
+
+/* Copies the fields of D kept in memory into INODE. */
+static void
+copy_hot_fields (struct inode *inode, const struct inode_disk *d)
+{
+  inode->length = d->length;
+  inode->extent_sectors = d->extent_sectors;
+  inode->indirect = d->indirect;
+  inode->doubly_indirect = d->doubly_indirect;
+}
+
+/* Returns a copy of INODE's on-disk inode, which the caller must
+   free, or a null pointer if memory is short. */
+static struct inode_disk *
+read_disk_inode (const struct inode *inode)
+{
+  struct inode_disk *d = malloc (sizeof *d);
+
+  if (d != NULL)
+    cache_read (inode->sector, d, 0, sizeof *d);
+  return d;
+}
+
+/* Open inodes by sector, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+
+/* Allocator for in-memory inodes. */
+static struct kmem_cache inode_cache;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  kmem_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL, NULL);
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Initializes an inode with LENGTH bytes of data, all of it a
+   hole, marked as a directory if IS_DIR, and writes the new inode
+   to sector SECTOR on the file system device.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -84,22 +278,10 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      disk_inode->magic = is_dir ? DIR_MAGIC : INODE_MAGIC;
       disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      journal_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = true; 
       free (disk_inode);
     }
   return success;
@@ -111,33 +293,55 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct hash_elem *e;
   struct inode *inode;
+  struct inode key;
+  unsigned magic;
+
+  lock_acquire (&open_inodes_lock);
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      goto done;
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
-    return NULL;
+    goto done;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->read_next = 0;
+  inode->metadata = false;
+  inode->write_cnt = 0;
+  inode->grown = false;
+  list_init (&inode->dirty);
+  rwlock_init (&inode->rw);
+  lock_init (&inode->lock);
+  cache_read (sector, &inode->length, offsetof (struct inode_disk, length),
+              sizeof inode->length);
+  cache_read (sector, &inode->extent_sectors,
+              offsetof (struct inode_disk, extent_sectors),
+              sizeof inode->extent_sectors);
+  cache_read (sector, &inode->indirect,
+              offsetof (struct inode_disk, indirect),
+              2 * sizeof (block_sector_t));
+  cache_read (sector, &magic, offsetof (struct inode_disk, magic),
+              sizeof magic);
+  inode->is_dir = magic == DIR_MAGIC;
+
+ done:
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +350,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -168,21 +376,54 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  journal_begin ();
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      /* Give back the reserve while the inode cannot be reopened,
+         as a new opener would read the disk inode. */
+      if (!inode->removed
+          && inode->extent_sectors > bytes_to_sectors (inode->length)
+          && inode->indirect == 0 && inode->doubly_indirect == 0)
+        {
+          struct inode_disk *d = read_disk_inode (inode);
+
+          if (d != NULL && trim_reserve (d))
+            journal_write (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+          free (d);
+        }
+
+      /* Remove from open inodes and release lock. */
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          struct inode_disk *d = read_disk_inode (inode);
+
+          if (d != NULL)
+            {
+              release_sectors (d);
+              free (d);
+            }
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      cache_disown_all (&inode->dirty);
+      kmem_cache_free (&inode_cache, inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
+  journal_end ();
+}
+
+/* Marks INODE as holding metadata, such as a directory or the free
+   map, whose writes are journaled like the inode's own. */
+void
+inode_set_metadata (struct inode *inode)
+{
+  inode->metadata = true;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,139 +432,300 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
+}
+
+/* Acquires INODE's own lock, which serializes updates that consist
+   of several reads and writes of INODE, such as adding an entry to
+   a directory.  Plain reads and writes do not need it. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's own lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   A read that starts where the previous one ended queues the
+   sectors after it to be read ahead.  Pages of the file that are
+   mapped into memory are read from the mapping. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  off_t bytes_read = read_at (inode, buffer, size, offset, false);
+
+#ifdef VM
+  frame_mmap_read (inode->sector, offset, buffer, bytes_read);
+#endif
+  return bytes_read;
+}
+
+/* Like inode_read_at(), but for a caller that keeps the data, such
+   as a page fault filling a frame: whole sectors not in the buffer
+   cache are read straight into BUFFER and not cached, and nothing
+   is read ahead. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
+                   off_t offset)
+{
+  return read_at (inode, buffer, size, offset, true);
+}
+
+/* Does the work of inode_read_at() and, if DIRECT, of
+   inode_read_direct(). */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+         bool direct)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool sequential = !direct && offset == inode->read_next;
 
+  rwlock_acquire_read (&inode->rw);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
+      int sector_ofs;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int sector_left;
+      int min_left;
 
       /* Number of bytes to actually copy out of this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int chunk_size;
+      bool stored;
+
+      if (inode_left <= 0)
         break;
+      stored = locate (inode, offset, &sector_idx, &sector_ofs);
+      sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      min_left = inode_left < sector_left ? inode_left : sector_left;
+      chunk_size = size < min_left ? size : min_left;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
+      if (!stored)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else if (direct && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          /* Take in the whole sectors that follow on disk too. */
+          block_sector_t next;
+          int next_ofs;
+          size_t cnt = 1;
+
+          while (cnt < INODE_DIRECT_RUN
+                 && size >= (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE
+                 && inode_left >= (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE
+                 && locate (inode, offset + cnt * BLOCK_SECTOR_SIZE, &next,
+                            &next_ofs)
+                 && next == sector_idx + cnt)
+            cnt++;
+          cache_read_direct_multiple (sector_idx, cnt, buffer + bytes_read);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
+      else
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  if (sequential && bytes_read > 0 && !is_inline (inode))
+    {
+      off_t pos = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+      size_t unit = block_io_size (fs_device);
+      size_t i;
+
+      /* Go on to the end of the device's unit, while the file's
+         sectors stay consecutive, so a request can fetch it whole. */
+      for (i = 0; i < INODE_READ_AHEAD + unit && pos < inode_length (inode);
+           i++)
+        {
+          block_sector_t sector = byte_to_sector (inode, pos);
+
+          if (sector != 0)
+            cache_read_ahead (sector);
+          pos += BLOCK_SECTOR_SIZE;
+          if (i + 1 >= INODE_READ_AHEAD
+              && (unit == 1 || sector == 0 || pos >= inode_length (inode)
+                  || block_unit_start (fs_device, sector + 1) == sector + 1
+                  || byte_to_sector (inode, pos) != sector + 1))
+            break;
+        }
+    }
+  rwlock_release_read (&inode->rw);
+  if (!direct)
+    inode->read_next = offset;
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.  A write past end of file
+   extends the inode, leaving any gap a hole, and a write into a
+   hole allocates sectors for it; if the disk fills up nothing is
+   written.  Pages of the file that are mapped into memory get the
+   new data as well.  Sectors allocated past the old end of file
+   are not zeroed and then read back for a partial write: the write
+   fills them itself, zeros included, before others can see them. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
+  off_t start = offset;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  size_t fresh;
+  bool grows;
+  /* Files only grow and holes only fill, so a write that looks like
+     it needs no allocation does not. */
+  bool journaled = inode->metadata || offset + size > inode_length (inode);
 
-  if (inode->deny_write_cnt)
-    return 0;
+  if (!journaled)
+    {
+      rwlock_acquire_read (&inode->rw);
+      journaled = has_hole (inode, offset, size);
+      rwlock_release_read (&inode->rw);
+    }
+
+  if (journaled)
+    journal_begin ();
+  rwlock_acquire_write (&inode->rw);
+  fresh = bytes_to_sectors (inode->length);
+  grows = offset + size > inode->length;
+  if (inode->deny_write_cnt
+      || ((grows || has_hole (inode, offset, size))
+          && !grow (inode, offset, size, INODE_RESERVE, !inode->metadata)))
+    {
+      rwlock_release_write (&inode->rw);
+      goto done;
+    }
+  inode->write_cnt++;
 
+  /* Extents and index entries, once there, never change while the
+     inode is open, except as inode_defrag() moves them with RW held
+     for writing, so the copy only has to keep extensions out.  A
+     write that grows INODE keeps readers out as well, until the
+     sectors it left unzeroed hold its data. */
+  if (!grows)
+    {
+      rwlock_release_write (&inode->rw);
+      rwlock_acquire_read (&inode->rw);
+    }
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
+      int sector_ofs;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int sector_left;
+      int min_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int chunk_size;
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      bool stored UNUSED;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+      if (inode_left <= 0)
+        break;
+      stored = locate (inode, offset, &sector_idx, &sector_ofs);
+      ASSERT (stored);
+      sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      min_left = inode_left < sector_left ? inode_left : sector_left;
+      chunk_size = size < min_left ? size : min_left;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* Inline data shares its sector with the inode, which must
+         not reach disk ahead of the transaction that changed it. */
+      if (inode->metadata || (journaled && sector_idx == inode->sector))
+        journal_write (sector_idx, buffer + bytes_written, sector_ofs,
+                       chunk_size);
+      else if (grows && idx >= fresh && idx < inode->extent_sectors)
+        cache_write_new (sector_idx, buffer + bytes_written, sector_ofs,
+                         chunk_size, &inode->dirty);
+      else
+        cache_write_owned (sector_idx, buffer + bytes_written, sector_ofs,
+                           chunk_size, &inode->dirty);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+  if (grows)
+    rwlock_release_write (&inode->rw);
+  else
+    rwlock_release_read (&inode->rw);
+#ifdef VM
+  frame_mmap_write (inode->sector, start, buffer, bytes_written);
+#endif
 
+ done:
+  if (journaled)
+    journal_end ();
   return bytes_written;
 }
 
+/* Writes INODE's dirty data sectors back to disk, then commits the
+   metadata journal if METADATA is true, if INODE's size or sectors
+   changed since the last call or if INODE's data is journaled, so
+   that what was written to INODE survives a crash. */
+void
+inode_sync (struct inode *inode, bool metadata)
+{
+  cache_sync (&inode->dirty);
+  if (metadata || inode->grown || inode->metadata)
+    {
+      inode->grown = false;
+      journal_commit ();
+    }
+}
+
+/* Allocates zeroed data sectors for the LENGTH bytes of INODE at
+   OFFSET, as contiguously as the free map allows, and grows INODE
+   to OFFSET + LENGTH bytes if it is shorter.  Returns false if the
+   disk fills up first or writes to INODE are denied. */
+bool
+inode_allocate (struct inode *inode, off_t offset, off_t length)
+{
+  bool success;
+
+  ASSERT (offset >= 0 && length >= 0);
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rw);
+  success = (inode->deny_write_cnt == 0
+             && grow (inode, offset, length, 0, false));
+  if (success)
+    inode->write_cnt++;
+  rwlock_release_write (&inode->rw);
+  journal_end ();
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +734,428 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
 {
-  return inode->data.length;
+  return inode->length;
+}
+
+/* Returns the number of writes to INODE since it was first
+   opened, so a caller that keeps INODE open can tell whether data
+   it derived from the contents is still current. */
+unsigned
+inode_write_cnt (const struct inode *inode)
+{
+  return inode->write_cnt;
+}
+
+/* Returns true if INODE holds a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->is_dir;
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Moves INODE's data into one run of free sectors if it is spread
+   over several now, or into a run lower on the disk if one is
+   free, so that the file reads sequentially and the space it
+   leaves joins other free space.  Only plain files with all their
+   data in sectors move: journaled, inline and sparse files stay
+   put.  Readers and writers of INODE wait until the move is done.
+   Returns true if INODE was moved. */
+bool
+inode_defrag (struct inode *inode)
+{
+  struct inode_disk *d = NULL;
+  uint8_t *buf = NULL;
+  struct list moved;
+  block_sector_t start, limit;
+  size_t cnt, i;
+  bool success = false;
+
+  list_init (&moved);
+  journal_begin ();
+  rwlock_acquire_write (&inode->rw);
+  cnt = bytes_to_sectors (inode->length);
+  if (inode->metadata || inode->is_dir || inode->removed || cnt == 0
+      || is_inline (inode)
+      || has_hole (inode, 0, inode->length))
+    goto done;
+  d = read_disk_inode (inode);
+  buf = malloc (BLOCK_SECTOR_SIZE);
+  if (d == NULL || buf == NULL)
+    goto done;
+
+  /* A file in one extent moves only toward the start of the disk. */
+  if (d->extent_cnt == 1 && d->indirect == 0 && d->doubly_indirect == 0)
+    limit = d->extents[0].start;
+  else
+    limit = (block_sector_t) -1;
+  if (!free_map_allocate_below (cnt, limit, &start))
+    goto done;
+
+  /* Copy through the cache, which may hold newer data than the
+     disk, and write the copy back before the transaction that
+     points INODE at it can commit. */
+  for (i = 0; i < cnt; i++)
+    {
+      cache_read_direct (byte_to_sector (inode, i * BLOCK_SECTOR_SIZE),
+                         buf);
+      cache_write_owned (start + i, buf, 0, BLOCK_SECTOR_SIZE, &moved);
+    }
+  cache_sync (&moved);
+  cache_disown_all (&moved);
+  cache_disown_all (&inode->dirty);
+
+  release_sectors (d);
+  memset (d->extents, 0, sizeof d->extents);
+  d->extents[0].start = start;
+  d->extents[0].cnt = cnt;
+  d->extent_cnt = 1;
+  d->extent_sectors = cnt;
+  d->indirect = d->doubly_indirect = 0;
+  journal_write (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+  copy_hot_fields (inode, d);
+  inode->grown = true;
+  success = true;
+
+ done:
+  rwlock_release_write (&inode->rw);
+  journal_end ();
+  free (buf);
+  free (d);
+  return success;
+}
+
+/* Returns a hash of inode E's sector. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
+
+/* Allocates a zeroed sector into *SECTORP unless it holds one
+   already.  Returns false if the disk is full. */
+static bool
+alloc_zeroed (block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (*sectorp != 0)
+    return true;
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  journal_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Allocates a zeroed sector for entry IDX of index sector INDEX
+   unless it holds one already.  Returns false if the disk is
+   full. */
+static bool
+alloc_in_index (block_sector_t index, size_t idx)
+{
+  block_sector_t sector = index_get (index, idx);
+
+  if (sector != 0)
+    return true;
+  if (!alloc_zeroed (&sector))
+    return false;
+  index_set (index, idx, sector);
+  return true;
+}
+
+/* Allocates up to CNT data sectors for D, the inode in SECTOR, as
+   an extent after the sectors its extents already cover.
+   The first extent is placed near the inode and later ones right
+   after the last.  Returns false if that is not possible: the disk
+   is full, or the extents are used up and the sector after the last
+   one is taken. */
+static bool
+alloc_extent (struct inode_disk *d, block_sector_t sector, size_t cnt)
+{
+  struct extent *last = d->extent_cnt > 0 ? &d->extents[d->extent_cnt - 1]
+                                          : NULL;
+  block_sector_t hint = last != NULL ? last->start + last->cnt : sector + 1;
+  block_sector_t start;
+  size_t got;
+
+  if (!free_map_allocate_extent (cnt, hint, d->extent_cnt == EXTENT_CNT,
+                                 &start, &got))
+    return false;
+
+  if (last != NULL && start == hint)
+    last->cnt += got;
+  else
+    {
+      d->extents[d->extent_cnt].start = start;
+      d->extents[d->extent_cnt].cnt = got;
+      d->extent_cnt++;
+    }
+  d->extent_sectors += got;
+  return true;
+}
+
+/* Allocates data sector IDX of D's index, and the index sectors
+   leading to it, where not allocated yet.  Returns false if the
+   disk is full or IDX is past the largest file. */
+static bool
+alloc_sector (struct inode_disk *d, size_t idx)
+{
+  if (idx < PTRS_PER_SECTOR)
+    return alloc_zeroed (&d->indirect) && alloc_in_index (d->indirect, idx);
+  idx -= PTRS_PER_SECTOR;
+  if (idx >= PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    return false;
+  if (!alloc_zeroed (&d->doubly_indirect)
+      || !alloc_in_index (d->doubly_indirect, idx / PTRS_PER_SECTOR))
+    return false;
+  return alloc_in_index (index_get (d->doubly_indirect,
+                                    idx / PTRS_PER_SECTOR),
+                         idx % PTRS_PER_SECTOR);
+}
+
+/* Returns the sector of D's extents holding data sector IDX. */
+static block_sector_t
+extent_sector (const struct inode_disk *d, size_t idx)
+{
+  const struct extent *e;
+
+  ASSERT (idx < d->extent_sectors);
+
+  for (e = d->extents; idx >= e->cnt; e++)
+    idx -= e->cnt;
+  return e->start + idx;
+}
+
+/* Allocates data sectors for D, the inode in SECTOR, to cover the
+   SIZE bytes at OFFSET, where not allocated yet, without changing
+   D's length.  Allocated sectors are zeroed up to the larger of D's
+   length and OFFSET + SIZE, including any reserved before that the
+   file now grows over.  An allocation reaching the end of the file
+   that starts a new extent asks for RESERVE sectors beyond it as
+   well; they are only zeroed once the file grows over them.  The
+   zeroing is journaled if D holds METADATA.  If FILL, sectors past
+   D's length that the range touches are left to the caller, which
+   must write them with cache_write_new().  Returns false if the
+   disk is full or the range is past the largest file; sectors
+   already allocated stay in D, to be freed with it. */
+static bool
+allocate (struct inode_disk *d, block_sector_t sector, off_t offset,
+          off_t size, size_t reserve, bool metadata, bool fill)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  off_t end = offset + size;
+  size_t have = bytes_to_sectors (d->length);
+  size_t want = bytes_to_sectors (end > d->length ? end : d->length);
+  size_t old_extent_sectors = d->extent_sectors;
+  size_t last = bytes_to_sectors (end);
+  size_t i = offset / BLOCK_SECTOR_SIZE;
+  bool success = true;
+
+  if (last < want)
+    reserve = 0;
+  while (i < last)
+    {
+      if (i < d->extent_sectors)
+        i = d->extent_sectors;
+      else if (i == d->extent_sectors && d->indirect == 0
+               && d->doubly_indirect == 0
+               && alloc_extent (d, sector, last - i + reserve))
+        i = d->extent_sectors;
+      else if (alloc_sector (d, i - d->extent_sectors))
+        i++;
+      else
+        {
+          success = false;
+          break;
+        }
+    }
+
+  /* New extent sectors and reserved ones the file grows over; new
+     index entries come zeroed already. */
+  i = have < old_extent_sectors ? have : old_extent_sectors;
+  for (; i < want && i < d->extent_sectors; i++)
+    if (fill && i >= have && i >= (size_t) offset / BLOCK_SECTOR_SIZE)
+      break;
+    else if (metadata)
+      journal_write (extent_sector (d, i), zeros, 0, BLOCK_SECTOR_SIZE);
+    else
+      cache_write (extent_sector (d, i), zeros, 0, BLOCK_SECTOR_SIZE);
+  return success;
+}
+
+/* Moves the data of D, the inode in SECTOR, whose data is inline,
+   into data sectors and allocates sectors for the SIZE bytes at
+   OFFSET as allocate() does, RESERVE, METADATA and FILL included, without
+   changing D's length.  Does nothing if OFFSET + SIZE fits inline.
+   Returns false, leaving D as it was, if the disk is full. */
+static bool
+grow_inline (struct inode_disk *d, block_sector_t sector, off_t offset,
+             off_t size, size_t reserve, bool metadata, bool fill)
+{
+  uint8_t data[INLINE_MAX];
+  off_t length = d->length;
+
+  if (offset + size <= (off_t) INLINE_MAX)
+    return true;
+
+  memcpy (data, d->extents, length);
+  memset (d->extents, 0, INLINE_MAX);
+  if ((length > 0 && !allocate (d, sector, 0, length, 0, metadata, false))
+      || !allocate (d, sector, offset, size, reserve, metadata, fill))
+    {
+      release_sectors (d);
+      d->extent_cnt = d->extent_sectors = 0;
+      d->indirect = d->doubly_indirect = 0;
+      memset (d->extents, 0, INLINE_MAX);
+      memcpy (d->extents, data, length);
+      return false;
+    }
+
+  /* The data was metadata until now, so it is journaled on the
+     way out. */
+  if (length > 0)
+    journal_write (d->extent_sectors > 0 ? extent_sector (d, 0)
+                                         : index_get (d->indirect, 0),
+                   data, 0, length);
+  return true;
+}
+
+/* Allocates sectors for the SIZE bytes of INODE at OFFSET, with
+   RESERVE sectors to spare and FILL as allocate() does, and grows
+   INODE to OFFSET + SIZE bytes if it is shorter.  The caller must hold
+   INODE's rw lock for writing inside a journal transaction.
+   Returns false if the disk is full or memory is short. */
+static bool
+grow (struct inode *inode, off_t offset, off_t size, size_t reserve,
+      bool fill)
+{
+  struct inode_disk *d = read_disk_inode (inode);
+  bool success;
+
+  if (d == NULL)
+    return false;
+  if (is_inline (inode))
+    success = grow_inline (d, inode->sector, offset, size, reserve,
+                           inode->metadata, fill);
+  else
+    success = allocate (d, inode->sector, offset, size, reserve,
+                        inode->metadata, fill);
+
+  /* Record even a partial allocation, so that its sectors are found
+     again rather than leaked. */
+  if (success && offset + size > d->length)
+    d->length = offset + size;
+  journal_write (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+  copy_hot_fields (inode, d);
+  inode->grown = true;
+  free (d);
+  return success;
+}
+
+/* Returns true if any of the SIZE bytes of INODE at OFFSET that
+   are below its length lie in a hole. */
+static bool
+has_hole (const struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size < inode->length ? offset + size : inode->length;
+  size_t i;
+
+  if (is_inline (inode))
+    return false;
+  for (i = offset / BLOCK_SECTOR_SIZE; (off_t) (i * BLOCK_SECTOR_SIZE) < end;
+       i++)
+    if (i >= inode->extent_sectors
+        && byte_to_sector (inode, i * BLOCK_SECTOR_SIZE) == 0)
+      return true;
+  return false;
+}
+
+/* Frees the sectors of D's extents past its length, reserved by
+   allocate().  Returns true if there were any. */
+static bool
+trim_reserve (struct inode_disk *d)
+{
+  size_t keep = bytes_to_sectors (d->length);
+  bool trimmed = false;
+
+  /* Index entries are numbered after the extents' sectors. */
+  if (d->indirect != 0 || d->doubly_indirect != 0)
+    return false;
+  while (d->extent_sectors > keep)
+    {
+      struct extent *last = &d->extents[d->extent_cnt - 1];
+      size_t drop = d->extent_sectors - keep;
+
+      if (drop > last->cnt)
+        drop = last->cnt;
+      free_map_release (last->start + last->cnt - drop, drop);
+      last->cnt -= drop;
+      d->extent_sectors -= drop;
+      if (last->cnt == 0)
+        d->extent_cnt--;
+      trimmed = true;
+    }
+  return trimmed;
+}
+
+/* Frees the sectors listed in index sector INDEX, which holds data
+   sectors if DEPTH is 1 and index sectors of depth DEPTH - 1
+   otherwise, and INDEX itself. */
+static void
+release_index (block_sector_t index, int depth)
+{
+  size_t i;
+
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    {
+      block_sector_t sector = index_get (index, i);
+
+      if (sector == 0)
+        continue;
+      if (depth > 1)
+        release_index (sector, depth - 1);
+      else
+        free_map_release (sector, 1);
+    }
+  free_map_release (index, 1);
+}
+
+/* Frees all of D's data and index sectors. */
+static void
+release_sectors (struct inode_disk *d)
+{
+  size_t i;
+
+  for (i = 0; i < d->extent_cnt; i++)
+    free_map_release (d->extents[i].start, d->extents[i].cnt);
+  if (d->indirect != 0)
+    release_index (d->indirect, 1);
+  if (d->doubly_indirect != 0)
+    release_index (d->doubly_indirect, 2);
 }
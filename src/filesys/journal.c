@@ -0,0 +1,253 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   Operations that change metadata (inodes, index sectors, the free
+   map, directories) run between journal_begin() and journal_end()
+   and write metadata with journal_write().  Such a write goes to
+   the buffer cache as usual, but the sector is also noted in the
+   running transaction and its cache entry is kept from being
+   written in place.  Many operations share one transaction, which
+   is committed every COMMIT_INTERVAL ticks, when it is half full,
+   and at shutdown: with no operation in progress, the logged
+   sectors are copied into the journal, then the header naming them
+   is written, which makes the transaction durable; then they are
+   written in place and the header is cleared.  If the system
+   crashes, journal_init() finds a written header and copies the
+   sectors again, so that the metadata reflects either all of a
+   transaction or none of it.
+
+   An operation that would log more sectors than the journal holds
+   writes the excess in place, unprotected.
+
+   The journal is JOURNAL_SECTORS sectors starting at
+   JOURNAL_SECTOR: the header, then the logged sectors, in header
+   order. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Most sectors in a transaction. */
+#define JOURNAL_MAX (JOURNAL_SECTORS - 1)
+
+/* Ticks between commits. */
+#define COMMIT_INTERVAL TIMER_FREQ
+
+/* Journal header. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t cnt;                       /* Sectors logged, 0 if none. */
+    block_sector_t sectors[JOURNAL_MAX]; /* Where they belong. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8 - 4 * JOURNAL_MAX];
+  };
+
+/* Held for reading by operations and for writing by a commit. */
+static struct rwlock tx_lock;
+
+/* Running transaction, guarded by log_lock. */
+static struct lock log_lock;
+static block_sector_t log_sectors[JOURNAL_MAX];
+static size_t log_cnt;
+static size_t log_max;                  /* Capacity used. */
+
+/* Copies of logged sectors on their way into or out of the
+   journal, and pointers to each for the multi-sector block calls.
+   Used by a commit, or by journal_init() before there can be
+   one. */
+static uint8_t *log_data;
+static void *log_bufs[JOURNAL_MAX];
+
+static unsigned long long commit_cnt;   /* Transactions committed. */
+static unsigned long long logged_cnt;   /* Sectors committed. */
+static unsigned long long overflow_cnt; /* Writes not logged. */
+
+static thread_func commit_daemon NO_RETURN;
+static void write_header (size_t cnt, const block_sector_t *sectors);
+static bool log_sector (block_sector_t);
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+   one; otherwise replays the last transaction if the system
+   stopped before checkpointing it.  Must be called before anything
+   reads the file system through the buffer cache. */
+void
+journal_init (bool format)
+{
+  size_t i;
+
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+
+  rwlock_init (&tx_lock);
+  lock_init (&log_lock);
+  log_max = cache_size / 2 < JOURNAL_MAX ? cache_size / 2 : JOURNAL_MAX;
+
+  /* Replay may need room for a whole journal, however small the
+     cache is now. */
+  log_data = malloc (JOURNAL_MAX * BLOCK_SECTOR_SIZE);
+  if (log_data == NULL)
+    PANIC ("journal allocation failed");
+  for (i = 0; i < JOURNAL_MAX; i++)
+    log_bufs[i] = log_data + i * BLOCK_SECTOR_SIZE;
+
+  if (!format)
+    {
+      static struct journal_header h;
+
+      block_read (fs_device, JOURNAL_SECTOR, &h);
+      if (h.magic == JOURNAL_MAGIC && h.cnt > 0 && h.cnt <= JOURNAL_MAX)
+        {
+          printf ("Replaying journal: %u sectors.\n", (unsigned) h.cnt);
+          block_read_multiple (fs_device, JOURNAL_SECTOR + 1, h.cnt,
+                               log_bufs);
+          for (i = 0; i < h.cnt; i++)
+            block_write (fs_device, h.sectors[i], log_bufs[i]);
+        }
+    }
+  write_header (0, NULL);
+
+  thread_create ("journal", PRI_DEFAULT, commit_daemon, NULL);
+}
+
+/* Starts an operation whose metadata writes form part of the
+   running transaction.  May be nested; only the outermost call
+   counts.  Commits first if the transaction is half full. */
+void
+journal_begin (void)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->journal_depth++ > 0)
+    return;
+  if (log_cnt >= log_max / 2)
+    journal_commit ();
+  rwlock_acquire_read (&tx_lock);
+}
+
+/* Ends an operation started with journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (cur->journal_depth > 0);
+  if (--cur->journal_depth == 0)
+    rwlock_release_read (&tx_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into metadata SECTOR at byte OFS,
+   logging SECTOR in the running transaction if called within an
+   operation. */
+void
+journal_write (block_sector_t sector, const void *buffer, size_t ofs,
+               size_t size)
+{
+  if (thread_current ()->journal_depth > 0 && log_sector (sector))
+    cache_write_logged (sector, buffer, ofs, size);
+  else
+    cache_write (sector, buffer, ofs, size);
+}
+
+/* Commits the running transaction, waiting for operations in
+   progress to end first, and writes it in place. */
+void
+journal_commit (void)
+{
+  static block_sector_t sectors[JOURNAL_MAX];
+  size_t cnt, i;
+
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  rwlock_acquire_write (&tx_lock);
+  lock_acquire (&log_lock);
+  cnt = log_cnt;
+  memcpy (sectors, log_sectors, cnt * sizeof *sectors);
+  log_cnt = 0;
+  lock_release (&log_lock);
+
+  if (cnt > 0)
+    {
+      for (i = 0; i < cnt; i++)
+        cache_read (sectors[i], log_bufs[i], 0, BLOCK_SECTOR_SIZE);
+      block_write_multiple (fs_device, JOURNAL_SECTOR + 1, cnt,
+                            (const void *const *) log_bufs);
+      write_header (cnt, sectors);
+
+      /* Checkpoint. */
+      cache_unlog_all ();
+      cache_flush ();
+      write_header (0, NULL);
+      commit_cnt++;
+      logged_cnt += cnt;
+    }
+  rwlock_release_write (&tx_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %llu commits, %llu sectors logged, %llu unlogged\n",
+          commit_cnt, logged_cnt, overflow_cnt);
+}
+
+/* Commits every COMMIT_INTERVAL ticks, grouping the operations in
+   between into one transaction. */
+static void
+commit_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (COMMIT_INTERVAL);
+      if (log_cnt > 0)
+        journal_commit ();
+    }
+}
+
+/* Writes a journal header naming the CNT SECTORS. */
+static void
+write_header (size_t cnt, const block_sector_t *sectors)
+{
+  static struct journal_header h;
+
+  memset (&h, 0, sizeof h);
+  h.magic = JOURNAL_MAGIC;
+  h.cnt = cnt;
+  if (cnt > 0)
+    memcpy (h.sectors, sectors, cnt * sizeof *sectors);
+  block_write (fs_device, JOURNAL_SECTOR, &h);
+}
+
+/* Adds SECTOR to the running transaction.  Returns false if the
+   transaction is full. */
+static bool
+log_sector (block_sector_t sector)
+{
+  bool logged = true;
+  size_t i;
+
+  lock_acquire (&log_lock);
+  for (i = 0; i < log_cnt; i++)
+    if (log_sectors[i] == sector)
+      goto done;
+  if (log_cnt < log_max)
+    log_sectors[log_cnt++] = sector;
+  else
+    {
+      overflow_cnt++;
+      logged = false;
+    }
+
+ done:
+  lock_release (&log_lock);
+  return logged;
+}
@@ -0,0 +1,222 @@
+#include "filesys/pipe.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A pipe: a page-sized ring of bytes that one or more writer ends
+   fill and reader ends drain.  Readers wait while it is empty and
+   writers while it is full, for as long as an end of the other
+   kind is open.  A writer wakes the readers once per run of bytes
+   it copies in, not once per byte, and a reader wakes the writers
+   once per read.  Freed with the last end. */
+struct pipe
+  {
+    struct lock lock;           /* Guards the members below. */
+    struct condition not_empty; /* Signaled when bytes are added. */
+    struct condition not_full;  /* Signaled when bytes are taken. */
+    uint8_t *buf;               /* PGSIZE bytes of ring. */
+    unsigned head;              /* Bytes ever written. */
+    unsigned tail;              /* Bytes ever read. */
+    int readers;                /* Reader ends open. */
+    int writers;                /* Writer ends open. */
+  };
+
+static size_t used (const struct pipe *);
+static void copy_in (struct pipe *, const uint8_t *, size_t);
+static void copy_out (struct pipe *, uint8_t *, size_t);
+
+/* Creates a pipe and stores a new file for its reading end in
+   *READ_END and for its writing end in *WRITE_END.  Returns false
+   if memory is short. */
+bool
+pipe_create (struct file **read_end, struct file **write_end)
+{
+  struct pipe *p = malloc (sizeof *p);
+
+  if (p == NULL)
+    return false;
+  p->buf = palloc_get_page (0);
+  if (p->buf == NULL)
+    {
+      free (p);
+      return false;
+    }
+  lock_init (&p->lock);
+  cond_init (&p->not_empty);
+  cond_init (&p->not_full);
+  p->head = p->tail = 0;
+  p->readers = p->writers = 0;
+
+  *read_end = file_open_pipe (p, false);
+  *write_end = file_open_pipe (p, true);
+  if (*read_end != NULL && *write_end != NULL)
+    return true;
+
+  /* Closing an end that did open frees P. */
+  if (*read_end == NULL && *write_end == NULL)
+    {
+      palloc_free_page (p->buf);
+      free (p);
+    }
+  file_close (*read_end);
+  file_close (*write_end);
+  return false;
+}
+
+/* Counts one more end of P, a writer if WRITER is true. */
+void
+pipe_open (struct pipe *p, bool writer)
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Drops an end of P, a writer if WRITER is true, waking the other
+   side so that it sees end of file or a broken pipe.  Frees P
+   with its last end. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  bool dead;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers--;
+  else
+    p->readers--;
+  cond_broadcast (&p->not_empty, &p->lock);
+  cond_broadcast (&p->not_full, &p->lock);
+  dead = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (dead)
+    {
+      palloc_free_page (p->buf);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into BUFFER, waiting until there
+   is at least one byte unless no writer is left.  Returns the
+   number of bytes read, 0 at end of file.  BUFFER must not page
+   fault. */
+off_t
+pipe_read (struct pipe *p, void *buffer, off_t size)
+{
+  size_t cnt;
+
+  if (size <= 0)
+    return 0;
+
+  lock_acquire (&p->lock);
+  while (used (p) == 0 && p->writers > 0)
+    cond_wait (&p->not_empty, &p->lock);
+  cnt = used (p);
+  if (cnt > (size_t) size)
+    cnt = size;
+  copy_out (p, buffer, cnt);
+  if (cnt > 0)
+    cond_broadcast (&p->not_full, &p->lock);
+  lock_release (&p->lock);
+  return cnt;
+}
+
+/* Writes the SIZE bytes in BUFFER to P, waiting for room as
+   needed.  Returns the number of bytes written, which is less
+   than SIZE only if the last reader goes away, or -1 if there was
+   no reader to begin with.  BUFFER must not page fault. */
+off_t
+pipe_write (struct pipe *p, const void *buffer, off_t size)
+{
+  const uint8_t *src = buffer;
+  off_t written = 0;
+  bool broken;
+
+  lock_acquire (&p->lock);
+  while (written < size && p->readers > 0)
+    {
+      size_t cnt;
+
+      while (used (p) == PGSIZE && p->readers > 0)
+        cond_wait (&p->not_full, &p->lock);
+      if (p->readers == 0)
+        break;
+
+      cnt = PGSIZE - used (p);
+      if (cnt > (size_t) (size - written))
+        cnt = size - written;
+      copy_in (p, src + written, cnt);
+      written += cnt;
+      cond_broadcast (&p->not_empty, &p->lock);
+    }
+  broken = p->readers == 0;
+  lock_release (&p->lock);
+  return broken && written == 0 && size > 0 ? -1 : written;
+}
+
+/* Returns true if reading P would not wait: it holds bytes or has
+   no writer left. */
+bool
+pipe_readable (struct pipe *p)
+{
+  bool readable;
+
+  lock_acquire (&p->lock);
+  readable = used (p) > 0 || p->writers == 0;
+  lock_release (&p->lock);
+  return readable;
+}
+
+/* Returns true if writing P would not wait: it has room or no
+   reader left. */
+bool
+pipe_writable (struct pipe *p)
+{
+  bool writable;
+
+  lock_acquire (&p->lock);
+  writable = used (p) < PGSIZE || p->readers == 0;
+  lock_release (&p->lock);
+  return writable;
+}
+
+/* Returns the number of bytes in P. */
+static size_t
+used (const struct pipe *p)
+{
+  return p->head - p->tail;
+}
+
+/* Appends the CNT bytes at SRC to P, which has room for them, in
+   at most two copies. */
+static void
+copy_in (struct pipe *p, const uint8_t *src, size_t cnt)
+{
+  size_t ofs = p->head % PGSIZE;
+  size_t first = cnt < PGSIZE - ofs ? cnt : PGSIZE - ofs;
+
+  memcpy (p->buf + ofs, src, first);
+  memcpy (p->buf, src + first, cnt - first);
+  p->head += cnt;
+}
+
+/* Removes the first CNT bytes of P, which holds that many, into
+   DST, in at most two copies. */
+static void
+copy_out (struct pipe *p, uint8_t *dst, size_t cnt)
+{
+  size_t ofs = p->tail % PGSIZE;
+  size_t first = cnt < PGSIZE - ofs ? cnt : PGSIZE - ofs;
+
+  memcpy (dst, p->buf + ofs, first);
+  memcpy (dst + first, p->buf, cnt - first);
+  p->tail += cnt;
+}
@@ -0,0 +1,18 @@
+#ifndef FILESYS_PIPE_H
+#define FILESYS_PIPE_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct pipe;
+
+bool pipe_create (struct file **read_end, struct file **write_end);
+void pipe_open (struct pipe *, bool writer);
+void pipe_close (struct pipe *, bool writer);
+off_t pipe_read (struct pipe *, void *buffer, off_t size);
+off_t pipe_write (struct pipe *, const void *buffer, off_t size);
+bool pipe_readable (struct pipe *);
+bool pipe_writable (struct pipe *);
+
+#endif /* filesys/pipe.h */
@@ -38,38 +38,32 @@ divl (uint64_t n, uint32_t d)
 
 /* Returns the number of leading zero bits in X,
    which must be nonzero. */
-static int
+static inline int
 nlz (uint32_t x) 
 {
-  /* This technique is portable, but there are better ways to do
-     it on particular systems.  With sufficiently new enough GCC,
-     you can use __builtin_clz() to take advantage of GCC's
-     knowledge of how to do it.  Or you can use the x86 BSR
-     instruction directly. */
-  int n = 0;
-  if (x <= 0x0000FFFF)
-    {
-      n += 16;
-      x <<= 16; 
-    }
-  if (x <= 0x00FFFFFF)
-    {
-      n += 8;
-      x <<= 8; 
-    }
-  if (x <= 0x0FFFFFFF)
-    {
-      n += 4;
-      x <<= 4;
-    }
-  if (x <= 0x3FFFFFFF)
-    {
-      n += 2;
-      x <<= 2; 
-    }
-  if (x <= 0x7FFFFFFF)
-    n++;
-  return n;
+  uint32_t bit;
+
+  /* BSR yields the index of the most significant set bit. */
+  asm ("bsrl %1, %0" : "=r" (bit) : "rm" (x) : "cc");
+  return 31 - bit;
+}
+
+/* Returns the number of trailing zero bits in X,
+   which must be nonzero. */
+static inline int
+ntz (uint32_t x) 
+{
+  uint32_t bit;
+
+  asm ("bsfl %1, %0" : "=r" (bit) : "rm" (x) : "cc");
+  return bit;
+}
+
+/* Returns true if X, which must be nonzero, is a power of 2. */
+static inline int
+is_pow2 (uint64_t x)
+{
+  return (x & (x - 1)) == 0;
 }
 
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
@@ -79,6 +73,21 @@ udiv64 (uint64_t n, uint64_t d)
 {
   if ((d >> 32) == 0) 
     {
+      uint32_t d0 = d;
+
+      /* Most divisions that reach here only have 64-bit types:
+         both operands fit in 32 bits, which takes one DIVL, or
+         the divisor is a power of 2, which takes a shift.  A
+         zero divisor falls through to a DIVL that traps. */
+      if ((n >> 32) == 0)
+        return (uint32_t) n / d0;
+      if (d0 != 0 && is_pow2 (d0))
+        return n >> ntz (d0);
+
+      /* If the quotient fits in 32 bits, one DIVL does. */
+      if ((n >> 32) < d0)
+        return divl (n, d0);
+
       /* Proof of correctness:
 
          Let n, d, b, n1, and n0 be defined as in this function.
@@ -106,7 +115,6 @@ udiv64 (uint64_t n, uint64_t d)
       uint64_t b = 1ULL << 32;
       uint32_t n1 = n >> 32;
       uint32_t n0 = n; 
-      uint32_t d0 = d;
 
       return divl (b * (n1 % d0) + n0, d0) + b * (n1 / d0); 
     }
@@ -116,6 +124,8 @@ udiv64 (uint64_t n, uint64_t d)
          http://www.hackersdelight.org/revisions.pdf. */
       if (n < d)
         return 0;
+      else if (is_pow2 (d))
+        return n >> (32 + ntz (d >> 32));
       else 
         {
           uint32_t d1 = d >> 32;
@@ -128,9 +138,13 @@ udiv64 (uint64_t n, uint64_t d)
 
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
    remainder. */
-static uint32_t
+static uint64_t
 umod64 (uint64_t n, uint64_t d)
 {
+  if ((n >> 32) == 0 && (d >> 32) == 0)
+    return (uint32_t) n % (uint32_t) d;
+  if (d != 0 && is_pow2 (d))
+    return n & (d - 1);
   return n - d * udiv64 (n, d);
 }
 
@@ -147,7 +161,7 @@ sdiv64 (int64_t n, int64_t d)
 
 /* Divides signed 64-bit N by signed 64-bit D and returns the
    remainder. */
-static int32_t
+static int64_t
 smod64 (int64_t n, int64_t d)
 {
   return n - d * sdiv64 (n, d);
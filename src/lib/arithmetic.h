@@ -0,0 +1,34 @@
+#ifndef __LIB_ARITHMETIC_H
+#define __LIB_ARITHMETIC_H
+
+#include <stdint.h>
+
+/* 64-bit by 32-bit division.
+
+   Dividing a 64-bit value always calls __udivdi3() in
+   lib/arithmetic.c, even by a constant, because GCC has no
+   inline sequence for it on x86.  The values actually divided,
+   such as tick counts divided by TIMER_FREQ, nearly always fit
+   in 32 bits, though.  These functions test for that inline and
+   then do a 32-bit division, which GCC turns into a multiply by
+   the reciprocal when D is a constant. */
+
+/* Returns N / D. */
+static inline uint64_t
+udiv64_32 (uint64_t n, uint32_t d)
+{
+  if ((n >> 32) == 0)
+    return (uint32_t) n / d;
+  return n / d;
+}
+
+/* Returns N % D. */
+static inline uint32_t
+umod64_32 (uint64_t n, uint32_t d)
+{
+  if ((n >> 32) == 0)
+    return (uint32_t) n % d;
+  return n % d;
+}
+
+#endif /* lib/arithmetic.h */
@@ -0,0 +1,36 @@
+#ifndef __LIB_BLOCKSTAT_H
+#define __LIB_BLOCKSTAT_H
+
+/* Number of buckets in each histogram of struct blockstat. */
+#define BLOCKSTAT_LATENCY_BUCKETS 40
+#define BLOCKSTAT_DEPTH_BUCKETS 8
+
+/* Seconds of throughput history kept. */
+#define BLOCKSTAT_SECONDS 16
+
+/* I/O statistics for one block device, as reported by the
+   kernel's block_get_stats() and the blockstat system call.  A
+   request is one call into the block layer, of one or more
+   consecutive sectors. */
+struct blockstat
+  {
+    char name[16];              /* Device name, e.g. "hda1". */
+    char role[8];               /* "filesys", "swap", "scratch", ... */
+    unsigned long long read_cnt;        /* Sectors read. */
+    unsigned long long write_cnt;       /* Sectors written. */
+    unsigned long long request_cnt;     /* Requests completed. */
+
+    /* Requests that took fewer than 2**I CPU cycles, counting the
+       time spent waiting in the driver's queue, in LATENCY[I]. */
+    unsigned long long latency[BLOCKSTAT_LATENCY_BUCKETS];
+
+    /* Requests that found I others already in flight on the
+       device in DEPTH[I], the last bucket counting the rest. */
+    unsigned long long depth[BLOCKSTAT_DEPTH_BUCKETS];
+
+    /* Sectors transferred during the current second in SECTORS[0],
+       the second before in SECTORS[1], and so on. */
+    unsigned sectors[BLOCKSTAT_SECONDS];
+  };
+
+#endif /* lib/blockstat.h */
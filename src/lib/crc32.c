@@ -0,0 +1,66 @@
+#include <crc32.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* The reflected CRC-32 polynomial. */
+#define CRC32_POLY 0xedb88320
+
+/* TABLE[0][B] is the CRC of byte B.  TABLE[K][B] is the CRC of
+   byte B followed by K zero bytes, so that eight bytes can be
+   folded into the CRC with one lookup each. */
+static uint32_t table[8][256];
+static bool table_ready;
+
+static void make_table (void);
+
+/* Returns the CRC-32 of the SIZE bytes at BUF appended to data
+   whose CRC-32 is CRC.  Pass 0 as CRC to start. */
+uint32_t
+crc32 (uint32_t crc, const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+
+  if (!table_ready)
+    make_table ();
+
+  crc = ~crc;
+  for (; size > 0 && ((uintptr_t) buf & 3) != 0; size--)
+    crc = table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  for (; size >= 8; size -= 8)
+    {
+      uint32_t lo, hi;
+
+      memcpy (&lo, buf, sizeof lo);
+      memcpy (&hi, buf + 4, sizeof hi);
+      lo ^= crc;
+      crc = (table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff]
+             ^ table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24]
+             ^ table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff]
+             ^ table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24]);
+      buf += 8;
+    }
+  for (; size > 0; size--)
+    crc = table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+/* Fills in TABLE.  Computing it twice at once is harmless, since
+   both computations store the same values. */
+static void
+make_table (void)
+{
+  int b, k;
+
+  for (b = 0; b < 256; b++)
+    {
+      uint32_t crc = b;
+
+      for (k = 0; k < 8; k++)
+        crc = (crc >> 1) ^ (crc & 1 ? CRC32_POLY : 0);
+      table[0][b] = crc;
+    }
+  for (b = 0; b < 256; b++)
+    for (k = 1; k < 8; k++)
+      table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+  table_ready = true;
+}
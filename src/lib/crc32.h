@@ -0,0 +1,14 @@
+#ifndef __LIB_CRC32_H
+#define __LIB_CRC32_H
+
+/* CRC-32, as used by Ethernet, zlib and PNG: the reflected
+   polynomial 0xedb88320, with the register and result inverted.
+   Computed eight bytes at a time with the "slicing-by-8" tables of
+   Kounavis and Berry, which cost 8 kB of memory. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t crc32 (uint32_t crc, const void *, size_t size);
+
+#endif /* lib/crc32.h */
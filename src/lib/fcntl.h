@@ -0,0 +1,11 @@
+#ifndef __LIB_FCNTL_H
+#define __LIB_FCNTL_H
+
+/* fcntl() commands. */
+#define F_GETFL 3               /* Returns the descriptor's flags. */
+#define F_SETFL 4               /* Sets them to the argument. */
+
+/* Descriptor flags. */
+#define O_NONBLOCK 04000        /* Fail reads rather than wait. */
+
+#endif /* lib/fcntl.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_INTRSTAT_H
+#define __LIB_INTRSTAT_H
+
+/* Statistics for one interrupt vector, as reported by the
+   kernel's intr_get_stats() and the intrstat system call.  Times
+   are in CPU cycles, from entry to the kernel's interrupt handler
+   until the vector's handler returns, so for a fault or system
+   call that sleeps they include the time spent asleep. */
+struct intrstat
+  {
+    char name[40];                      /* Vector name, e.g. "8254 Timer". */
+    unsigned long long count;           /* Interrupts handled. */
+    unsigned long long cycles;          /* Cycles spent, in total. */
+    unsigned long long max_cycles;      /* Longest single interrupt. */
+  };
+
+#endif /* lib/intrstat.h */
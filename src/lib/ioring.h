@@ -0,0 +1,50 @@
+#ifndef __LIB_IORING_H
+#define __LIB_IORING_H
+
+/* A submission and completion ring, for issuing many file
+   operations with one system call.  The process sets up a struct
+   ioring and its two arrays in its own memory, registers it with
+   ioring_setup(), queues operations by filling sq[sq_tail %
+   entries] and advancing sq_tail, and calls ioring_enter().  The
+   kernel carries out queued operations in order, each posting a
+   completion at cq[cq_tail % entries] and advancing sq_head and
+   cq_tail, until the submission ring is empty, the completion ring
+   is full, or it has done as many as asked.  The process consumes
+   completions by advancing cq_head.  The counters run freely and
+   wrap around. */
+
+/* Operations. */
+#define IORING_READ  0          /* read (fd, buffer, size). */
+#define IORING_WRITE 1          /* write (fd, buffer, size). */
+#define IORING_SEEK  2          /* seek (fd, size). */
+#define IORING_CLOSE 3          /* close (fd). */
+
+/* A queued operation. */
+struct ioring_sqe
+  {
+    int op;                     /* IORING_*. */
+    int fd;                     /* File descriptor. */
+    void *buffer;               /* Data, for reads and writes. */
+    unsigned size;              /* Bytes, or position for a seek. */
+    unsigned user_data;         /* Copied to the completion. */
+  };
+
+/* A finished operation. */
+struct ioring_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int result;                 /* Bytes read or written, 0, or -1. */
+  };
+
+struct ioring
+  {
+    unsigned entries;           /* Entries in each of sq and cq. */
+    unsigned sq_head;           /* Next submission; kernel advances. */
+    unsigned sq_tail;           /* End of submissions; process advances. */
+    unsigned cq_head;           /* Next completion; process advances. */
+    unsigned cq_tail;           /* End of completions; kernel advances. */
+    struct ioring_sqe *sq;      /* Submission ring. */
+    struct ioring_cqe *cq;      /* Completion ring. */
+  };
+
+#endif /* lib/ioring.h */
@@ -0,0 +1,16 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One buffer of a readv() or writev() call. */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    size_t iov_len;             /* Bytes in the buffer. */
+  };
+
+/* Most buffers one call accepts. */
+#define IOV_MAX 1024
+
+#endif /* lib/iovec.h */
@@ -28,6 +28,8 @@ struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Summary, or null.  Bit I is set if
+                           element I of `bits' is all ones. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -53,6 +55,42 @@ elem_cnt (size_t bit_cnt)
   return DIV_ROUND_UP (bit_cnt, ELEM_BITS);
 }
 
+/* Returns an elem_type with the bits of element ELEM that lie
+   within bits START through END, exclusive, turned on.  START must
+   be less than END. */
+static inline elem_type
+range_mask (size_t elem, size_t start, size_t end)
+{
+  elem_type mask = ~(elem_type) 0;
+
+  if (elem == elem_idx (start))
+    mask &= mask << (start % ELEM_BITS);
+  if (elem == elem_idx (end - 1))
+    mask &= ~(elem_type) 0 >> (ELEM_BITS - 1 - (end - 1) % ELEM_BITS);
+  return mask;
+}
+
+/* Returns the index of the lowest set bit in X, which must not
+   be zero. */
+static inline size_t
+first_set (elem_type x)
+{
+  size_t idx;
+
+  asm ("bsfl %1, %0" : "=r" (idx) : "rm" (x) : "cc");
+  return idx;
+}
+
+/* Returns the number of set bits in X. */
+static inline size_t
+count_set (elem_type x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
+
 /* Returns the number of bytes required for BIT_CNT bits. */
 static inline size_t
 byte_cnt (size_t bit_cnt)
@@ -68,6 +106,57 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns true if every bit of element I of B that is in use is
+   set. */
+static inline bool
+elem_full (const struct bitmap *b, size_t i)
+{
+  elem_type bits = b->bits[i];
+
+  if (i == elem_cnt (b->bit_cnt) - 1)
+    bits |= ~last_mask (b);
+  return bits == ~(elem_type) 0;
+}
+
+/* Brings B's summary bit for element I up to date, if B has a
+   summary. */
+static inline void
+update_summary (struct bitmap *b, size_t i)
+{
+  if (b->full != NULL)
+    {
+      if (elem_full (b, i))
+        b->full[elem_idx (i)] |= bit_mask (i);
+      else
+        b->full[elem_idx (i)] &= ~bit_mask (i);
+    }
+}
+
+/* Returns the index of the first element of B from I through LAST
+   that B's summary does not mark full, or LAST + 1 if there is
+   none.  Skips ELEM_BITS elements for each summary element that is
+   all ones. */
+static size_t
+next_nonfull (const struct bitmap *b, size_t i, size_t last)
+{
+  size_t si, slast;
+  elem_type x;
+
+  if (i > last)
+    return last + 1;
+  si = elem_idx (i);
+  slast = elem_idx (last);
+  x = ~b->full[si] & (~(elem_type) 0 << (i % ELEM_BITS));
+  while (x == 0)
+    {
+      if (++si > slast)
+        return last + 1;
+      x = ~b->full[si];
+    }
+  i = si * ELEM_BITS + first_set (x);
+  return i <= last ? i : last + 1;
+}
 
 /* Creation and destruction. */
 
@@ -83,6 +172,7 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->full = NULL;
       if (b->bits != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
@@ -105,6 +195,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->full = NULL;
   bitmap_set_all (b, false);
   return b;
 }
@@ -124,11 +215,37 @@ bitmap_destroy (struct bitmap *b)
 {
   if (b != NULL) 
     {
+      free (b->full);
       free (b->bits);
       free (b);
     }
 }
 
+/* Adds a summary to B, created by bitmap_create(), with one bit for
+   each element of B that is set while the element's bits are all
+   set.  bitmap_scan() for unset bits then skips full stretches of B
+   a summary element, or 1,024 bits, at a time.  A bit and its
+   summary bit are not updated together atomically, so once B has a
+   summary the caller must serialize all changes to it.  Returns
+   false if memory is short, leaving B without a summary, which
+   only makes scans slower. */
+bool
+bitmap_enable_summary (struct bitmap *b)
+{
+  size_t i;
+
+  ASSERT (b != NULL);
+
+  if (b->full != NULL || b->bit_cnt == 0)
+    return true;
+  b->full = calloc (elem_cnt (elem_cnt (b->bit_cnt)), sizeof *b->full);
+  if (b->full == NULL)
+    return false;
+  for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+    update_summary (b, i);
+  return true;
+}
+
 /* Bitmap size. */
 
 /* Returns the number of bits in B. */
@@ -163,6 +280,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -176,6 +294,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +310,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -217,14 +337,26 @@ bitmap_set_all (struct bitmap *b, bool value)
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t end = start + cnt;
   size_t i;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+
+  /* A word at a time, each atomically, as bitmap_set() would. */
+  for (i = elem_idx (start); i <= elem_idx (end - 1); i++)
+    {
+      elem_type mask = range_mask (i, start, end);
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[i]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[i]) : "r" (~mask) : "cc");
+      update_summary (b, i);
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,17 +364,55 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t i, set_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  if (cnt == 0)
+    return 0;
+
+  set_cnt = 0;
+  for (i = elem_idx (start); i <= elem_idx (end - 1); i++)
+    set_cnt += count_set (b->bits[i] & range_mask (i, start, end));
+  return value ? set_cnt : cnt - set_cnt;
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Searches a word at a time: words with no bit set to VALUE are
+   skipped whole, and the bit within the first other one is found
+   with BSF.  When looking for unset bits in a bitmap with a
+   summary, full words are skipped by scanning the summary. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  elem_type flip = value ? 0 : ~(elem_type) 0;
+  size_t last, i, idx;
+  elem_type x;
+
+  if (start >= end)
+    return end;
+
+  i = elem_idx (start);
+  last = elem_idx (end - 1);
+  x = (b->bits[i] ^ flip) & (~(elem_type) 0 << (start % ELEM_BITS));
+  while (x == 0)
+    {
+      if (++i > last)
+        return end;
+      if (!value && b->full != NULL)
+        {
+          i = next_nonfull (b, i, last);
+          if (i > last)
+            return end;
+        }
+      x = b->bits[i] ^ flip;
+    }
+  idx = i * ELEM_BITS + first_set (x);
+  return idx < end ? idx : end;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,16 +420,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +463,28 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump to the next bit set to VALUE, then check that the
+         group starting there holds no bit set to !VALUE.  If it
+         does, no group can start before the bit after that one. */
+      while (i <= last)
+        {
+          size_t mismatch;
+
+          i = find_next (b, i, last + 1, value);
+          if (i > last)
+            break;
+          mismatch = find_next (b, i, i + cnt, !value);
+          if (mismatch == i + cnt)
+            return i;
+          i = mismatch + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -346,6 +526,12 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      if (b->full != NULL)
+        {
+          size_t i;
+          for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+            update_summary (b, i);
+        }
     }
   return success;
 }
@@ -358,6 +544,27 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the bytes of B holding bits START through START + CNT,
+   exclusive, to the same place in FILE, to which all of B was
+   written before.  Return true if successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  off_t ofs;
+  off_t size;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  ofs = start / CHAR_BIT;
+  size = DIV_ROUND_UP (start + cnt, CHAR_BIT) - ofs;
+  return (file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+          == size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -1,6 +1,11 @@
 #ifndef __LIB_KERNEL_CONSOLE_H
 #define __LIB_KERNEL_CONSOLE_H
 
+#include <stdbool.h>
+
+/* If true, console output goes to the serial port only. */
+extern bool console_headless;
+
 void console_init (void);
 void console_panic (void);
 void console_print_stats (void);
@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/vaddr.h"
 #include "devices/serial.h"
+#include "devices/vga.h"
 #include "devices/shutdown.h"
 
 /* Halts the OS, printing the source file name, line number, and
@@ -46,6 +47,7 @@ debug_panic (const char *file, int line, const char *function,
     }
 
   serial_flush ();
+  vga_flush ();
   shutdown ();
   for (;;);
 }
@@ -7,6 +7,7 @@
 
 #include "hash.h"
 #include "../debug.h"
+#include "../string.h"
 #include "threads/malloc.h"
 
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
@@ -18,6 +19,7 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static struct list *next_bucket (struct hash *, struct list *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -28,6 +30,9 @@ hash_init (struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_bucket_cnt = 0;
+  h->old_buckets = NULL;
+  h->migrate_idx = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -53,12 +58,10 @@ hash_init (struct hash *h,
 void
 hash_clear (struct hash *h, hash_action_func *destructor) 
 {
-  size_t i;
+  struct list *bucket;
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket))
     {
-      struct list *bucket = &h->buckets[i];
-
       if (destructor != NULL) 
         while (!list_empty (bucket)) 
           {
@@ -70,6 +73,12 @@ hash_clear (struct hash *h, hash_action_func *destructor)
       list_init (bucket); 
     }    
 
+  /* With every old bucket empty, the resize is finished. */
+  free (h->old_buckets);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->migrate_idx = 0;
+
   h->elem_cnt = 0;
 }
 
@@ -88,6 +97,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 {
   if (destructor != NULL)
     hash_clear (h, destructor);
+  free (h->old_buckets);
   free (h->buckets);
 }
 
@@ -162,13 +172,12 @@ hash_delete (struct hash *h, struct hash_elem *e)
 void
 hash_apply (struct hash *h, hash_action_func *action) 
 {
-  size_t i;
+  struct list *bucket;
   
   ASSERT (action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket))
     {
-      struct list *bucket = &h->buckets[i];
       struct list_elem *elem, *next;
 
       for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
@@ -223,7 +232,8 @@ hash_next (struct hash_iterator *i)
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
-      if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+      i->bucket = next_bucket (i->hash, i->bucket);
+      if (i->bucket == NULL)
         {
           i->elem = NULL;
           break;
@@ -257,56 +267,129 @@ hash_empty (struct hash *h)
   return h->elem_cnt == 0;
 }
 
-/* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
-#define FNV_32_PRIME 16777619u
-#define FNV_32_BASIS 2166136261u
+/* MurmurHash3 block constants. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+
+/* Returns X rotated left by N bits. */
+static inline uint32_t
+rotl32 (uint32_t x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+/* MurmurHash3's finalizer: mixes every bit of H into every other,
+   so that keys differing only in a few bits, such as consecutive
+   integers, land far apart. */
+static inline uint32_t
+fmix32 (uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+/* Scrambles block K of MurmurHash3's input before it is mixed into
+   the hash. */
+static inline uint32_t
+murmur_block (uint32_t k)
+{
+  k *= MURMUR_C1;
+  k = rotl32 (k, 15);
+  k *= MURMUR_C2;
+  return k;
+}
 
 /* Returns a hash of the SIZE bytes in BUF. */
 unsigned
 hash_bytes (const void *buf_, size_t size)
 {
-  /* Fowler-Noll-Vo 32-bit hash, for bytes. */
+  /* MurmurHash3, 32-bit, taking the input a word at a time. */
   const unsigned char *buf = buf_;
-  unsigned hash;
+  uint32_t hash = 0;
+  uint32_t k = 0;
+  size_t i;
 
   ASSERT (buf != NULL);
 
-  hash = FNV_32_BASIS;
-  while (size-- > 0)
-    hash = (hash * FNV_32_PRIME) ^ *buf++;
+  for (i = 0; i + 4 <= size; i += 4)
+    {
+      k = (buf[i] | (buf[i + 1] << 8) | (buf[i + 2] << 16)
+           | ((uint32_t) buf[i + 3] << 24));
+      hash ^= murmur_block (k);
+      hash = rotl32 (hash, 13) * 5 + 0xe6546b64u;
+    }
 
-  return hash;
+  /* Up to 3 trailing bytes. */
+  k = 0;
+  switch (size & 3)
+    {
+    case 3:
+      k ^= buf[i + 2] << 16;
+      /* Fall through. */
+    case 2:
+      k ^= buf[i + 1] << 8;
+      /* Fall through. */
+    case 1:
+      k ^= buf[i];
+      hash ^= murmur_block (k);
+    }
+
+  return fmix32 (hash ^ size);
 } 
 
 /* Returns a hash of string S. */
 unsigned
-hash_string (const char *s_) 
+hash_string (const char *s) 
 {
-  const unsigned char *s = (const unsigned char *) s_;
-  unsigned hash;
-
   ASSERT (s != NULL);
 
-  hash = FNV_32_BASIS;
-  while (*s != '\0')
-    hash = (hash * FNV_32_PRIME) ^ *s++;
-
-  return hash;
+  return hash_bytes (s, strlen (s));
 }
 
-/* Returns a hash of integer I. */
+/* Returns a hash of integer I.  Cheaper than hashing its bytes,
+   and good enough for keys such as page numbers and sectors that
+   differ mostly in their low bits.  Strip bits known to be the
+   same in every key, such as a page address's offset bits, before
+   calling. */
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  return fmix32 (i);
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* Returns the bucket in H that E belongs in.  During a resize,
+   that is E's old bucket if it has not been moved yet. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->migrate_idx)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns the bucket of H that follows BUCKET when visiting every
+   bucket that may hold elements, or a null pointer after the last.
+   The new buckets come first, then the old buckets not yet
+   moved. */
+static struct list *
+next_bucket (struct hash *h, struct list *bucket)
+{
+  bucket++;
+  if (bucket == h->buckets + h->bucket_cnt)
+    bucket = h->old_buckets != NULL ? h->old_buckets + h->migrate_idx : NULL;
+  if (h->old_buckets != NULL && bucket == h->old_buckets + h->old_bucket_cnt)
+    bucket = NULL;
+  return bucket;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -344,22 +427,59 @@ is_power_of_2 (size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Old buckets moved per insertion or deletion during a resize.  A
+   resize starts only when the element count has doubled or halved
+   since the last one, so each finishes long before the next is
+   due. */
+#define MIGRATE_BUCKETS 4
+
+/* Moves up to MIGRATE_BUCKETS of H's old buckets into its new
+   bucket array, and frees the old array once it is empty. */
+static void
+migrate (struct hash *h)
+{
+  size_t n;
+
+  for (n = 0; n < MIGRATE_BUCKETS && h->migrate_idx < h->old_bucket_cnt; n++)
+    {
+      struct list *old_bucket = &h->old_buckets[h->migrate_idx++];
+
+      while (!list_empty (old_bucket))
+        {
+          struct list_elem *elem = list_pop_front (old_bucket);
+          struct hash_elem *e = list_elem_to_hash_elem (elem);
+          size_t idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
+          list_push_front (&h->buckets[idx], elem);
+        }
+    }
+
+  if (h->migrate_idx >= h->old_bucket_cnt)
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+      h->old_bucket_cnt = 0;
+      h->migrate_idx = 0;
+    }
+}
+
+/* Moves H toward the ideal number of buckets: continues a resize
+   in progress, or starts one if the bucket count is off.  Starting
+   can fail because of an out-of-memory condition, but that'll just
+   make hash accesses less efficient; we can still continue. */
 static void
 rehash (struct hash *h) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
+  size_t new_bucket_cnt;
+  struct list *new_buckets;
   size_t i;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  if (h->old_buckets != NULL)
+    {
+      migrate (h);
+      return;
+    }
 
   /* Calculate the number of buckets to use now.
      We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -372,7 +492,7 @@ rehash (struct hash *h)
     new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
 
   /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  if (new_bucket_cnt == h->bucket_cnt)
     return;
 
   /* Allocate new buckets and initialize them as empty. */
@@ -387,29 +507,14 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until their
+     elements have all been moved. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->migrate_idx = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
-
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
-    {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
-
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
-        {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
-        }
-    }
-
-  free (old_buckets);
+  migrate (h);
 }
 
 /* Inserts E into BUCKET (in hash table H). */
@@ -18,7 +18,14 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   Resizing is incremental.  When the bucket array needs to grow
+   or shrink, a new one is allocated and the old one is kept
+   alongside it; each later insertion or deletion then moves a
+   few of the old buckets' elements into the new array, so that
+   no single operation pays for the whole table.  An element
+   whose old bucket has not been moved yet is still found there. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -61,6 +68,9 @@ struct hash
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    size_t old_bucket_cnt;      /* Number of old buckets, a power of 2. */
+    struct list *old_buckets;   /* Array being resized from, or null. */
+    size_t migrate_idx;         /* Old buckets before this are empty. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -0,0 +1,195 @@
+/* Pairing heap.
+
+   See heap.h for basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes H as an empty heap that orders its elements with
+   LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  h->root = NULL;
+  h->size = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->size++;
+}
+
+/* Returns the least element of H, which must not be empty,
+   without removing it. */
+struct heap_elem *
+heap_top (struct heap *h)
+{
+  ASSERT (!heap_empty (h));
+
+  return h->root;
+}
+
+/* Removes and returns the least element of H, which must not be
+   empty. */
+struct heap_elem *
+heap_pop (struct heap *h)
+{
+  struct heap_elem *top;
+
+  ASSERT (!heap_empty (h));
+
+  top = h->root;
+  h->root = merge_pairs (h, top->child);
+  h->size--;
+  return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (!heap_empty (h));
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    {
+      heap_pop (h);
+      return;
+    }
+  detach (e);
+  h->root = meld (h, h->root, merge_pairs (h, e->child));
+  h->size--;
+}
+
+/* Restores the order of H after the key of E, which must be in
+   H, changed so that E belongs nearer the top than before. */
+void
+heap_decrease (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (!heap_empty (h));
+  ASSERT (e != NULL);
+
+  /* E's subtree is still in order, so only its link to its parent
+     can be wrong. */
+  if (e != h->root)
+    {
+      detach (e);
+      h->root = meld (h, h->root, e);
+    }
+}
+
+/* Restores the order of H after the key of E, which must be in
+   H, changed either way. */
+void
+heap_update (struct heap *h, struct heap_elem *e)
+{
+  heap_remove (h, e);
+  heap_push (h, e);
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (struct heap *h)
+{
+  return h->size;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Melds the heaps rooted at A and B, either of which may be null,
+   into one and returns its root.  Neither root may have siblings. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (h->less (b, a, h->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the first child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  return a;
+}
+
+/* Melds the list of sibling heaps starting at FIRST into one and
+   returns its root, or a null pointer if FIRST is null.  Pairs are
+   melded left to right, then the results right to left, which is
+   what gives the pairing heap its amortized bounds. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *stack = NULL;
+  struct heap_elem *root = NULL;
+
+  /* Meld each pair, pushing the result on STACK through its NEXT
+     member. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->prev = a->next = NULL;
+      if (b != NULL)
+        {
+          b->prev = b->next = NULL;
+          a = meld (h, a, b);
+        }
+      a->next = stack;
+      stack = a;
+    }
+
+  /* Meld the pairs, last first. */
+  while (stack != NULL)
+    {
+      struct heap_elem *a = stack;
+
+      stack = a->next;
+      a->next = NULL;
+      root = meld (h, root, a);
+    }
+  return root;
+}
+
+/* Unlinks E, which must not be a root, from its parent and
+   siblings, keeping its children. */
+static void
+detach (struct heap_elem *e)
+{
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->prev = e->next = NULL;
+}
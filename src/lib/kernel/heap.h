@@ -0,0 +1,78 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap: a tree in which every element is no
+   greater than its children, each element keeping its children
+   on a linked list.  Insertion and melding take constant time;
+   removing the least element, or any other, takes O(log n)
+   amortized time; and moving an element whose key decreased,
+   the "decrease-key" that priority donation needs, takes O(log n)
+   amortized time as well.
+
+   Like struct list, a heap needs no dynamic allocation.  Each
+   structure that can be in a heap embeds a struct heap_elem
+   member, and heap_entry converts a struct heap_elem back to the
+   structure that contains it, as list_entry does.  See
+   lib/kernel/list.h for the details of that technique.
+
+   Which element is "least" is up to the heap's heap_less_func.
+   A heap of threads ordered so that the highest priority comes
+   first, for example, uses a function that returns true when A's
+   priority is higher than B's.  The heap does not keep equal
+   elements in insertion order; a caller that wants first come,
+   first served among equals must break ties in its less
+   function. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First child, or null. */
+    struct heap_elem *next;     /* Next sibling, or null. */
+    struct heap_elem *prev;     /* Previous sibling, or the parent if
+                                   this is the first child, or null
+                                   for the root. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) (HEAP_ELEM)            \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A belongs nearer the top
+   of the heap than B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null if empty. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_decrease (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+size_t heap_size (struct heap *);
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
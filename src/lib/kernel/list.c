@@ -522,3 +522,84 @@ list_min (struct list *list, list_less_func *less, void *aux)
     }
   return min;
 }
+
+/* Initializes CLIST as an empty counted list. */
+void
+clist_init (struct clist *clist)
+{
+  ASSERT (clist != NULL);
+  list_init (&clist->list);
+  clist->size = 0;
+}
+
+/* Inserts ELEM just before BEFORE, which must be an interior
+   element of CLIST's list or its tail. */
+void
+clist_insert (struct clist *clist, struct list_elem *before,
+              struct list_elem *elem)
+{
+  list_insert (before, elem);
+  clist->size++;
+}
+
+/* Inserts ELEM at the beginning of CLIST, so that it becomes the
+   front in CLIST. */
+void
+clist_push_front (struct clist *clist, struct list_elem *elem)
+{
+  list_push_front (&clist->list, elem);
+  clist->size++;
+}
+
+/* Inserts ELEM at the end of CLIST, so that it becomes the back
+   in CLIST. */
+void
+clist_push_back (struct clist *clist, struct list_elem *elem)
+{
+  list_push_back (&clist->list, elem);
+  clist->size++;
+}
+
+/* Removes ELEM, which must be in CLIST, and returns the element
+   that followed it, as list_remove() does. */
+struct list_elem *
+clist_remove (struct clist *clist, struct list_elem *elem)
+{
+  ASSERT (clist->size > 0);
+  clist->size--;
+  return list_remove (elem);
+}
+
+/* Removes the front element from CLIST and returns it.
+   Undefined behavior if CLIST is empty before removal. */
+struct list_elem *
+clist_pop_front (struct clist *clist)
+{
+  ASSERT (clist->size > 0);
+  clist->size--;
+  return list_pop_front (&clist->list);
+}
+
+/* Removes the back element from CLIST and returns it.
+   Undefined behavior if CLIST is empty before removal. */
+struct list_elem *
+clist_pop_back (struct clist *clist)
+{
+  ASSERT (clist->size > 0);
+  clist->size--;
+  return list_pop_back (&clist->list);
+}
+
+/* Returns the number of elements in CLIST, in constant time. */
+size_t
+clist_size (struct clist *clist)
+{
+  return clist->size;
+}
+
+/* Returns true if CLIST is empty, false otherwise. */
+bool
+clist_empty (struct clist *clist)
+{
+  return clist->size == 0;
+}
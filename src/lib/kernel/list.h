@@ -178,4 +178,36 @@ void list_unique (struct list *, struct list *duplicates,
 struct list_elem *list_max (struct list *, list_less_func *, void *aux);
 struct list_elem *list_min (struct list *, list_less_func *, void *aux);
 
+/* Counted list.
+
+   A list that also keeps its number of elements, so that
+   clist_size() takes constant time instead of list_size()'s
+   linear walk.  Elements must be added and removed only through
+   the clist_*() functions, which keep the count; the list member
+   may be traversed with the ordinary list functions, as in
+
+       for (e = list_begin (&cl.list); e != list_end (&cl.list);
+            e = list_next (e))
+
+   A clist may be initialized by calling clist_init() or with an
+   initializer using CLIST_INITIALIZER. */
+struct clist
+  {
+    struct list list;           /* Elements. */
+    size_t size;                /* Number of elements. */
+  };
+
+#define CLIST_INITIALIZER(NAME) { LIST_INITIALIZER ((NAME).list), 0 }
+
+void clist_init (struct clist *);
+void clist_insert (struct clist *, struct list_elem *before,
+                   struct list_elem *);
+void clist_push_front (struct clist *, struct list_elem *);
+void clist_push_back (struct clist *, struct list_elem *);
+struct list_elem *clist_remove (struct clist *, struct list_elem *);
+struct list_elem *clist_pop_front (struct clist *);
+struct list_elem *clist_pop_back (struct clist *);
+size_t clist_size (struct clist *);
+bool clist_empty (struct clist *);
+
 #endif /* lib/kernel/list.h */
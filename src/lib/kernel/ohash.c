@@ -0,0 +1,306 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Smallest slot array allocated. */
+#define MIN_SLOTS 8
+
+static bool grow (struct ohash *);
+static size_t find_slot (struct ohash *, const void *, unsigned hash);
+
+/* Returns the slot at which an element with hash value HASH
+   would ideally be placed in H. */
+static inline size_t
+home (const struct ohash *h, unsigned hash)
+{
+  return hash & (h->slot_cnt - 1);
+}
+
+/* Returns how far slot IDX in H lies from the home slot of the
+   element with hash value HASH. */
+static inline size_t
+distance (const struct ohash *h, size_t idx, unsigned hash)
+{
+  return (idx - home (h, hash)) & (h->slot_cnt - 1);
+}
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare elements using EQUAL, given auxiliary data AUX.  No
+   memory is allocated until the first insertion, so this cannot
+   fail. */
+void
+ohash_init (struct ohash *h,
+            ohash_hash_func *hash, ohash_equal_func *equal, void *aux)
+{
+  h->elem_cnt = 0;
+  h->slot_cnt = 0;
+  h->slots = NULL;
+  h->hash = hash;
+  h->equal = equal;
+  h->aux = aux;
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash, given H's auxiliary data.  DESTRUCTOR may
+   deallocate the element's memory but must not modify H.  The
+   slot array is kept for reuse. */
+void
+ohash_clear (struct ohash *h, ohash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < h->slot_cnt; i++)
+    {
+      struct ohash_slot *s = &h->slots[i];
+      if (s->elem != NULL)
+        {
+          if (destructor != NULL)
+            destructor (s->elem, h->aux);
+          s->elem = NULL;
+        }
+    }
+  h->elem_cnt = 0;
+}
+
+/* Destroys hash table H, as ohash_clear(), then frees its slot
+   array. */
+void
+ohash_destroy (struct ohash *h, ohash_action_func *destructor)
+{
+  ohash_clear (h, destructor);
+  free (h->slots);
+  h->slots = NULL;
+  h->slot_cnt = 0;
+}
+
+/* Inserts E into H.  Returns a null pointer if no equal element
+   is already in the table.  If an equal element is already in
+   the table, returns it without inserting E.  If the slot array
+   had to grow and memory was short, returns E itself without
+   inserting it. */
+void *
+ohash_insert (struct ohash *h, void *e)
+{
+  struct ohash_slot cur;
+  size_t idx, dist;
+
+  if ((h->elem_cnt + 1) * 4 > h->slot_cnt * 3)
+    {
+      /* Growing is pointless if E's key is already present. */
+      void *old = ohash_find (h, e);
+      if (old != NULL)
+        return old;
+      if (!grow (h))
+        return e;
+    }
+
+  cur.hash = h->hash (e, h->aux);
+  cur.elem = e;
+  idx = home (h, cur.hash);
+  for (dist = 0; ; dist++, idx = (idx + 1) & (h->slot_cnt - 1))
+    {
+      struct ohash_slot *s = &h->slots[idx];
+      size_t s_dist;
+
+      if (s->elem == NULL)
+        {
+          *s = cur;
+          h->elem_cnt++;
+          return NULL;
+        }
+
+      /* Until the first swap, CUR is E, and an equal element can
+         only lie in the run before the first slot closer to home
+         than E would be. */
+      if (cur.elem == e && s->hash == cur.hash
+          && h->equal (s->elem, e, h->aux))
+        return s->elem;
+
+      s_dist = distance (h, idx, s->hash);
+      if (s_dist < dist)
+        {
+          struct ohash_slot tmp = *s;
+          *s = cur;
+          cur = tmp;
+          dist = s_dist;
+        }
+    }
+}
+
+/* Finds and returns an element in H equal to E, or a null
+   pointer if none exists. */
+void *
+ohash_find (struct ohash *h, const void *e)
+{
+  size_t idx;
+
+  if (h->elem_cnt == 0)
+    return NULL;
+  idx = find_slot (h, e, h->hash (e, h->aux));
+  return idx < h->slot_cnt ? h->slots[idx].elem : NULL;
+}
+
+/* Finds, removes, and returns an element in H equal to E.
+   Returns a null pointer if no equal element existed.  The
+   following elements of the probe run are shifted back one slot,
+   so no tombstone is left behind. */
+void *
+ohash_delete (struct ohash *h, const void *e)
+{
+  size_t idx, next;
+  void *found;
+
+  if (h->elem_cnt == 0)
+    return NULL;
+  idx = find_slot (h, e, h->hash (e, h->aux));
+  if (idx >= h->slot_cnt)
+    return NULL;
+
+  found = h->slots[idx].elem;
+  for (;;)
+    {
+      struct ohash_slot *s;
+
+      next = (idx + 1) & (h->slot_cnt - 1);
+      s = &h->slots[next];
+      if (s->elem == NULL || distance (h, next, s->hash) == 0)
+        break;
+      h->slots[idx] = *s;
+      idx = next;
+    }
+  h->slots[idx].elem = NULL;
+  h->elem_cnt--;
+  return found;
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+      struct ohash_iterator i;
+      void *e;
+
+      ohash_first (&i, h);
+      while ((e = ohash_next (&i)) != NULL)
+        {
+          ...do something with e...
+        }
+
+   Modifying H during iteration, using any of ohash_clear(),
+   ohash_destroy(), ohash_insert(), or ohash_delete(),
+   invalidates all iterators. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h)
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->idx = 0;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+void *
+ohash_next (struct ohash_iterator *i)
+{
+  ASSERT (i != NULL);
+
+  while (i->idx < i->hash->slot_cnt)
+    {
+      void *e = i->hash->slots[i->idx++].elem;
+      if (e != NULL)
+        return e;
+    }
+  return NULL;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h)
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns the index of the slot in H holding an element equal
+   to E, whose hash value is HASH, or H->slot_cnt if there is
+   none.  H must have at least one element. */
+static size_t
+find_slot (struct ohash *h, const void *e, unsigned hash)
+{
+  size_t idx = home (h, hash);
+  size_t dist;
+
+  for (dist = 0; dist < h->slot_cnt;
+       dist++, idx = (idx + 1) & (h->slot_cnt - 1))
+    {
+      const struct ohash_slot *s = &h->slots[idx];
+
+      /* An empty slot, or one whose element is closer to its home
+         than E would be here, ends E's run. */
+      if (s->elem == NULL || distance (h, idx, s->hash) < dist)
+        break;
+      if (s->hash == hash && h->equal (s->elem, e, h->aux))
+        return idx;
+    }
+  return h->slot_cnt;
+}
+
+/* Doubles the size of H's slot array, reinserting every element.
+   Returns false, leaving H unchanged, if memory is short. */
+static bool
+grow (struct ohash *h)
+{
+  struct ohash_slot *old_slots = h->slots;
+  size_t old_cnt = h->slot_cnt;
+  size_t new_cnt = old_cnt < MIN_SLOTS ? MIN_SLOTS : old_cnt * 2;
+  struct ohash_slot *new_slots;
+  size_t i;
+
+  new_slots = calloc (new_cnt, sizeof *new_slots);
+  if (new_slots == NULL)
+    return false;
+
+  h->slots = new_slots;
+  h->slot_cnt = new_cnt;
+  for (i = 0; i < old_cnt; i++)
+    {
+      struct ohash_slot cur = old_slots[i];
+      size_t idx, dist;
+
+      if (cur.elem == NULL)
+        continue;
+
+      /* Keys are known distinct, so no comparisons are needed. */
+      idx = home (h, cur.hash);
+      for (dist = 0; h->slots[idx].elem != NULL;
+           dist++, idx = (idx + 1) & (h->slot_cnt - 1))
+        {
+          size_t s_dist = distance (h, idx, h->slots[idx].hash);
+          if (s_dist < dist)
+            {
+              struct ohash_slot tmp = h->slots[idx];
+              h->slots[idx] = cur;
+              cur = tmp;
+              dist = s_dist;
+            }
+        }
+      h->slots[idx] = cur;
+    }
+  free (old_slots);
+  return true;
+}
@@ -0,0 +1,84 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+
+   Unlike struct hash, which chains elements through a struct
+   hash_elem embedded in each of them, this table keeps an array
+   of slots, each holding a pointer to an element and the
+   element's hash value.  Elements need embed nothing.  A lookup
+   compares stored hash values along a short run of consecutive
+   slots and touches an element only when its hash value matches,
+   so it usually reads one or two cache lines.
+
+   Collisions are resolved with Robin Hood linear probing: an
+   element being inserted takes the slot of any element it finds
+   that is closer to its own home slot, so every element stays near
+   its home and a lookup can stop as soon as it passes elements
+   closer to home than the key would be.  Deletion shifts the
+   following run back by one slot instead of leaving tombstones.
+
+   The slot array grows by doubling, at 3/4 full.  A table that has
+   never had an element allocates nothing. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Computes and returns the hash value for element E, given
+   auxiliary data AUX. */
+typedef unsigned ohash_hash_func (const void *e, void *aux);
+
+/* Returns true if elements A and B have equal keys, given
+   auxiliary data AUX. */
+typedef bool ohash_equal_func (const void *a, const void *b, void *aux);
+
+/* Performs some operation on element E, given auxiliary data
+   AUX. */
+typedef void ohash_action_func (void *e, void *aux);
+
+/* A slot: an element and its hash value, or empty if ELEM is
+   null. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Hash value of ELEM. */
+    void *elem;                 /* Element, or null. */
+  };
+
+/* Hash table. */
+struct ohash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, 0 or a power of 2. */
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+    ohash_hash_func *hash;      /* Hash function. */
+    ohash_equal_func *equal;    /* Key comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `equal'. */
+  };
+
+/* A hash table iterator. */
+struct ohash_iterator
+  {
+    struct ohash *hash;         /* The hash table. */
+    size_t idx;                 /* Slot after the current element. */
+  };
+
+/* Basic life cycle. */
+void ohash_init (struct ohash *, ohash_hash_func *, ohash_equal_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, ohash_action_func *);
+void ohash_destroy (struct ohash *, ohash_action_func *);
+
+/* Search, insertion, deletion. */
+void *ohash_insert (struct ohash *, void *);
+void *ohash_find (struct ohash *, const void *);
+void *ohash_delete (struct ohash *, const void *);
+
+/* Iteration. */
+void ohash_first (struct ohash_iterator *, struct ohash *);
+void *ohash_next (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
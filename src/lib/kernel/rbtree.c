@@ -0,0 +1,475 @@
+/* Red-black tree.
+
+   The algorithms are those of Cormen, Leiserson, Rivest and Stein,
+   _Introduction to Algorithms_, chapter 13, with null pointers in
+   place of the sentinel leaf, so removal tracks the parent of the
+   node being fixed up separately.
+
+   See rbtree.h for basic information. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void transplant (struct rb_tree *, struct rb_elem *,
+                        struct rb_elem *);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *);
+
+/* Returns true if E is a red node; null leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Returns the least element of the subtree rooted at E. */
+static inline struct rb_elem *
+subtree_min (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the greatest element of the subtree rooted at E. */
+static inline struct rb_elem *
+subtree_max (struct rb_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
+
+/* Initializes T as an empty tree that orders its elements with
+   LESS, given auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux)
+{
+  t->root = NULL;
+  t->size = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Removes all the elements from T.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the tree, children before their parents.  DESTRUCTOR may, if
+   appropriate, deallocate the memory used by the element, but
+   must not otherwise use T. */
+void
+rb_clear (struct rb_tree *t, rb_action_func *destructor)
+{
+  struct rb_elem *e = t->root;
+
+  while (e != NULL)
+    {
+      if (e->left != NULL)
+        e = e->left;
+      else if (e->right != NULL)
+        e = e->right;
+      else
+        {
+          struct rb_elem *parent = e->parent;
+
+          if (parent != NULL)
+            {
+              if (parent->left == e)
+                parent->left = NULL;
+              else
+                parent->right = NULL;
+            }
+          if (destructor != NULL)
+            destructor (e, t->aux);
+          e = parent;
+        }
+    }
+  t->root = NULL;
+  t->size = 0;
+}
+
+/* Inserts NEW into T and returns a null pointer, if no equal
+   element is already in the tree.  If an equal element is
+   already in the tree, returns it without inserting NEW. */
+struct rb_elem *
+rb_insert (struct rb_tree *t, struct rb_elem *new)
+{
+  struct rb_elem **link = &t->root;
+  struct rb_elem *parent = NULL;
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (t->less (new, parent, t->aux))
+        link = &parent->left;
+      else if (t->less (parent, new, t->aux))
+        link = &parent->right;
+      else
+        return parent;
+    }
+
+  new->parent = parent;
+  new->left = new->right = NULL;
+  new->red = true;
+  *link = new;
+  insert_fixup (t, new);
+  t->size++;
+  return NULL;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *x, *x_parent;
+  bool removed_red = e->red;
+
+  ASSERT (t->size > 0);
+
+  if (e->left == NULL)
+    {
+      x = e->right;
+      x_parent = e->parent;
+      transplant (t, e, e->right);
+    }
+  else if (e->right == NULL)
+    {
+      x = e->left;
+      x_parent = e->parent;
+      transplant (t, e, e->left);
+    }
+  else
+    {
+      /* Move E's successor Y, which has no left child, into E's
+         place. */
+      struct rb_elem *y = subtree_min (e->right);
+
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == e)
+        x_parent = y;
+      else
+        {
+          x_parent = y->parent;
+          transplant (t, y, y->right);
+          y->right = e->right;
+          y->right->parent = y;
+        }
+      transplant (t, e, y);
+      y->left = e->left;
+      y->left->parent = y;
+      y->red = e->red;
+    }
+
+  if (!removed_red)
+    remove_fixup (t, x, x_parent);
+  t->size--;
+}
+
+/* Finds and returns an element equal to KEY in T, or a null
+   pointer if no equal element exists in the tree. */
+struct rb_elem *
+rb_find (struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = rb_lower_bound (t, key);
+
+  return e != NULL && !t->less (key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the least element of T that is not less than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_lower_bound (struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (!t->less (e, key, t->aux))
+      {
+        bound = e;
+        e = e->left;
+      }
+    else
+      e = e->right;
+  return bound;
+}
+
+/* Returns the least element of T that is greater than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_upper_bound (struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (t->less (key, e, t->aux))
+      {
+        bound = e;
+        e = e->left;
+      }
+    else
+      e = e->right;
+  return bound;
+}
+
+/* Returns the greatest element of T that is not greater than KEY,
+   or a null pointer if there is none.  For a tree of ranges keyed
+   by their start, that is the only range that can contain
+   KEY. */
+struct rb_elem *
+rb_floor (struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (!t->less (key, e, t->aux))
+      {
+        bound = e;
+        e = e->right;
+      }
+    else
+      e = e->left;
+  return bound;
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_first (struct rb_tree *t)
+{
+  return t->root != NULL ? subtree_min (t->root) : NULL;
+}
+
+/* Returns the greatest element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_last (struct rb_tree *t)
+{
+  return t->root != NULL ? subtree_max (t->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest. */
+struct rb_elem *
+rb_next (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    return subtree_min (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the least. */
+struct rb_elem *
+rb_prev (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    return subtree_max (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (struct rb_tree *t)
+{
+  return t->size;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (struct rb_tree *t)
+{
+  return t->root == NULL;
+}
+
+/* Makes X's right child take X's place in T, with X as its left
+   child. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Makes X's left child take X's place in T, with X as its right
+   child. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Puts the subtree rooted at V, which may be null, in the place of
+   U's subtree in T.  U's own links are left alone. */
+static void
+transplant (struct rb_tree *t, struct rb_elem *u, struct rb_elem *v)
+{
+  if (u->parent == NULL)
+    t->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v != NULL)
+    v->parent = u->parent;
+}
+
+/* Restores the red-black properties of T after red element E was
+   inserted. */
+static void
+insert_fixup (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *p;
+
+  while (is_red (p = e->parent))
+    {
+      /* A red node is never the root, so P has a parent G. */
+      struct rb_elem *g = p->parent;
+
+      if (p == g->left)
+        {
+          struct rb_elem *u = g->right;
+
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->right)
+            {
+              rotate_left (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (t, g);
+        }
+      else
+        {
+          struct rb_elem *u = g->left;
+
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->left)
+            {
+              rotate_right (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (t, g);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black properties of T after a black element was
+   removed from above X, which may be null, whose parent is now
+   PARENT. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_elem *x, struct rb_elem *parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      /* X is one black short, so its sibling W is not null. */
+      if (x == parent->left)
+        {
+          struct rb_elem *w = parent->right;
+
+          if (is_red (w))
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              w = parent->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (w->right))
+            {
+              w->left->red = false;
+              w->red = true;
+              rotate_right (t, w);
+              w = parent->right;
+            }
+          w->red = parent->red;
+          parent->red = false;
+          w->right->red = false;
+          rotate_left (t, parent);
+        }
+      else
+        {
+          struct rb_elem *w = parent->left;
+
+          if (is_red (w))
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              w = parent->left;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+              continue;
+            }
+          if (!is_red (w->left))
+            {
+              w->right->red = false;
+              w->red = true;
+              rotate_left (t, w);
+              w = parent->left;
+            }
+          w->red = parent->red;
+          parent->red = false;
+          w->left->red = false;
+          rotate_right (t, parent);
+        }
+      x = t->root;
+    }
+  if (x != NULL)
+    x->red = false;
+}
@@ -0,0 +1,107 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree: lookups, insertions and
+   deletions take O(log n) time in the worst case, and the
+   elements can be visited in order, starting from any of them.
+   That makes it the container for keys that are looked up by
+   range, such as "the area containing this address", which a
+   hash table cannot answer.
+
+   As with struct hash and struct list, the tree does not use
+   dynamic allocation.  Each structure that can be in a tree
+   embeds a struct rb_elem member, and rb_entry converts a struct
+   rb_elem back to the structure that contains it.  See
+   lib/kernel/list.h for the details of that technique.
+
+   Elements are ordered by an rb_less_func.  Functions that take
+   a key, such as rb_find() and rb_lower_bound(), take it as an
+   element too: fill in the key members of a structure of the
+   kind in the tree, often a local variable, and pass a pointer to
+   its rb_elem.
+
+   Iteration idiom:
+
+      struct rb_elem *e;
+
+      for (e = rb_first (&tree); e != NULL; e = rb_next (e))
+        {
+          struct foo *f = rb_entry (e, struct foo, elem);
+          ...do something with f...
+        }
+
+   and from the first element not less than KEY:
+
+      for (e = rb_lower_bound (&tree, &key.elem); e != NULL;
+           e = rb_next (e))
+        ...
+
+   Inserting or removing any element other than the current one
+   does not disturb an iteration. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null for the root. */
+    struct rb_elem *left;       /* Lesser child, or null. */
+    struct rb_elem *right;      /* Greater child, or null. */
+    bool red;                   /* Red or black? */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)               \
+        ((STRUCT *) ((uint8_t *) (RB_ELEM)              \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Performs some operation on tree element E, given auxiliary
+   data AUX. */
+typedef void rb_action_func (struct rb_elem *e, void *aux);
+
+/* Red-black tree. */
+struct rb_tree
+  {
+    struct rb_elem *root;       /* Root, or null if empty. */
+    size_t size;                /* Number of elements. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+/* Basic life cycle. */
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+void rb_clear (struct rb_tree *, rb_action_func *);
+
+/* Search, insertion, deletion. */
+struct rb_elem *rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+struct rb_elem *rb_find (struct rb_tree *, const struct rb_elem *);
+struct rb_elem *rb_lower_bound (struct rb_tree *, const struct rb_elem *);
+struct rb_elem *rb_upper_bound (struct rb_tree *, const struct rb_elem *);
+struct rb_elem *rb_floor (struct rb_tree *, const struct rb_elem *);
+
+/* Traversal. */
+struct rb_elem *rb_first (struct rb_tree *);
+struct rb_elem *rb_last (struct rb_tree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+/* Information. */
+size_t rb_size (struct rb_tree *);
+bool rb_empty (struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
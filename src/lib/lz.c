@@ -0,0 +1,207 @@
+#include <lz.h>
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Each sequence starts with a token byte whose high nibble is the
+   number of literals and whose low nibble is the match length less
+   LZ_MIN_MATCH.  A nibble of 15 means the length continues in the
+   following bytes, each added to it, until a byte other than 255.
+   The literals come next, then the match offset as two bytes, least
+   significant first, then the match length's continuation.  The
+   last sequence has literals only and ends the input. */
+
+static bool put_length (uint8_t **op, uint8_t *op_end, size_t len);
+static bool get_length (const uint8_t **ip, const uint8_t *ip_end,
+                        size_t *len);
+static bool emit (uint8_t **op, uint8_t *op_end, const uint8_t *literals,
+                  size_t literal_cnt, size_t offset, size_t match_len);
+
+/* Returns the 4 bytes at P as a little-endian number. */
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Returns the hash table index for the 4 bytes SEQ. */
+static inline unsigned
+hash (uint32_t seq)
+{
+  return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the SIZE bytes at SRC, at most LZ_MAX_INPUT, into
+   DST, which has room for CAPACITY bytes, using the LZ_WORK_SIZE
+   bytes at WORK as scratch space.  Returns the compressed size, or
+   0 if it would not fit in CAPACITY bytes. */
+size_t
+lz_compress (const void *src_, size_t size, void *dst_, size_t capacity,
+             void *work)
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + size;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint16_t *table = work;
+
+  ASSERT (size <= LZ_MAX_INPUT);
+
+  /* Stale entries are harmless: every candidate is verified. */
+  memset (table, 0, LZ_WORK_SIZE);
+  while ((size_t) (end - ip) >= LZ_MIN_MATCH)
+    {
+      uint32_t seq = read32 (ip);
+      unsigned h = hash (seq);
+      const uint8_t *ref = src + table[h];
+
+      table[h] = ip - src;
+      if (ref < ip && read32 (ref) == seq)
+        {
+          const uint8_t *m = ip + LZ_MIN_MATCH;
+
+          ref += LZ_MIN_MATCH;
+          while (m < end && *m == *ref)
+            {
+              m++;
+              ref++;
+            }
+          if (!emit (&op, dst + capacity, anchor, ip - anchor,
+                     m - ref, m - ip))
+            return 0;
+          ip = anchor = m;
+        }
+      else
+        ip++;
+    }
+  if (!emit (&op, dst + capacity, anchor, end - anchor, 0, 0))
+    return 0;
+  return op - dst;
+}
+
+/* Decompresses the SIZE bytes at SRC, produced by lz_compress(),
+   into DST, which has room for CAPACITY bytes.  Returns the
+   decompressed size, or 0 if SRC is corrupt or the output would not
+   fit. */
+size_t
+lz_decompress (const void *src, size_t size, void *dst_, size_t capacity)
+{
+  const uint8_t *ip = src;
+  const uint8_t *ip_end = ip + size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + capacity;
+
+  while (ip < ip_end)
+    {
+      unsigned token = *ip++;
+      size_t len = token >> 4;
+      size_t offset;
+      const uint8_t *ref;
+
+      if (len == 15 && !get_length (&ip, ip_end, &len))
+        return 0;
+      if ((size_t) (ip_end - ip) < len || (size_t) (op_end - op) < len)
+        return 0;
+      memcpy (op, ip, len);
+      ip += len;
+      op += len;
+      if (ip == ip_end)
+        break;
+
+      if (ip_end - ip < 2)
+        return 0;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      len = token & 15;
+      if (len == 15 && !get_length (&ip, ip_end, &len))
+        return 0;
+      len += LZ_MIN_MATCH;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || (size_t) (op_end - op) < len)
+        return 0;
+
+      /* Byte by byte, since the copy may overlap its own output. */
+      ref = op - offset;
+      while (len-- > 0)
+        *op++ = *ref++;
+    }
+  return op - dst;
+}
+
+/* Appends the continuation of a length whose nibble was 15, LEN
+   being what is left after the 15, at *OP.  Returns false if it
+   does not fit before OP_END. */
+static bool
+put_length (uint8_t **op, uint8_t *op_end, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    {
+      if (*op >= op_end)
+        return false;
+      *(*op)++ = 255;
+    }
+  if (*op >= op_end)
+    return false;
+  *(*op)++ = len;
+  return true;
+}
+
+/* Adds the continuation of a length whose nibble was 15, read from
+   *IP, to *LEN.  Returns false if the input ends first. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *ip_end, size_t *len)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ip >= ip_end)
+        return false;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Appends a sequence of the LITERAL_CNT bytes at LITERALS followed
+   by a MATCH_LEN byte back-reference OFFSET bytes back, or by no
+   back-reference if MATCH_LEN is 0, at *OP.  Returns false if it
+   does not fit before OP_END. */
+static bool
+emit (uint8_t **op_, uint8_t *op_end, const uint8_t *literals,
+      size_t literal_cnt, size_t offset, size_t match_len)
+{
+  uint8_t *op = *op_;
+  uint8_t *token;
+
+  if (op >= op_end)
+    return false;
+  token = op++;
+  *token = (literal_cnt < 15 ? literal_cnt : 15) << 4;
+  if (literal_cnt >= 15 && !put_length (&op, op_end, literal_cnt - 15))
+    return false;
+  if ((size_t) (op_end - op) < literal_cnt)
+    return false;
+  memcpy (op, literals, literal_cnt);
+  op += literal_cnt;
+
+  if (match_len > 0)
+    {
+      size_t len = match_len - LZ_MIN_MATCH;
+
+      *token |= len < 15 ? len : 15;
+      if (op_end - op < 2)
+        return false;
+      *op++ = offset & 0xff;
+      *op++ = offset >> 8;
+      if (len >= 15 && !put_length (&op, op_end, len - 15))
+        return false;
+    }
+  *op_ = op;
+  return true;
+}
@@ -0,0 +1,27 @@
+#ifndef __LIB_LZ_H
+#define __LIB_LZ_H
+
+/* A small LZ77-family compressor in the style of LZ4: the output
+   is a series of sequences, each a run of literal bytes followed by
+   a back-reference to an earlier copy of at least LZ_MIN_MATCH
+   bytes.  It favors speed over ratio, for data such as memory pages
+   that is compressed and decompressed often. */
+
+#include <stddef.h>
+
+/* Shortest back-reference encoded. */
+#define LZ_MIN_MATCH 4
+
+/* Largest input accepted by lz_compress(), in bytes. */
+#define LZ_MAX_INPUT 65536
+
+/* Bytes of scratch memory lz_compress() needs. */
+#define LZ_HASH_BITS 10
+#define LZ_WORK_SIZE ((1 << LZ_HASH_BITS) * 2)
+
+size_t lz_compress (const void *src, size_t size, void *dst, size_t capacity,
+                    void *work);
+size_t lz_decompress (const void *src, size_t size, void *dst,
+                      size_t capacity);
+
+#endif /* lib/lz.h */
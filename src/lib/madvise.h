@@ -0,0 +1,12 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Advice for the madvise system call about how a range of pages
+   will be used. */
+#define MADV_NORMAL     0       /* No advice; the default. */
+#define MADV_RANDOM     1       /* Random access: no read-ahead. */
+#define MADV_SEQUENTIAL 2       /* Sequential access: full read-ahead. */
+#define MADV_WILLNEED   3       /* Read the pages in now. */
+#define MADV_DONTNEED   4       /* Evict the pages now. */
+
+#endif /* lib/madvise.h */
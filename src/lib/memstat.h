@@ -0,0 +1,18 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+#include <stddef.h>
+
+/* Page allocator statistics for one pool, as reported by the
+   kernel's palloc_get_stats() and the memstat system call.  All
+   counts are in pages. */
+struct memstat
+  {
+    size_t total;               /* Pages in the pool. */
+    size_t free;                /* Pages not allocated. */
+    size_t largest_free;        /* Largest contiguous free block. */
+    size_t peak_used;           /* Most pages ever allocated at once. */
+    size_t failures;            /* Allocations that found no memory. */
+  };
+
+#endif /* lib/memstat.h */
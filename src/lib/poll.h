@@ -0,0 +1,17 @@
+#ifndef __LIB_POLL_H
+#define __LIB_POLL_H
+
+/* One descriptor of a poll() call. */
+struct pollfd
+  {
+    int fd;                     /* Descriptor, ignored if negative. */
+    short events;               /* Conditions asked about. */
+    short revents;              /* Conditions found, set by poll(). */
+  };
+
+/* Conditions. */
+#define POLLIN 0x001            /* A read would not block. */
+#define POLLOUT 0x004           /* A write would not block. */
+#define POLLNVAL 0x020          /* FD is not open; always reported. */
+
+#endif /* lib/poll.h */
@@ -84,3 +84,16 @@ random_ulong (void)
   random_bytes (&ul, sizeof ul);
   return ul;
 }
+
+/* Seeds X from SEED.  The seed is scrambled first, so that similar
+   seeds, such as consecutive ones, give unrelated sequences. */
+void
+xorshift_seed (struct xorshift *x, uint64_t seed)
+{
+  /* One step of SplitMix64. */
+  seed += 0x9e3779b97f4a7c15ULL;
+  seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+  seed ^= seed >> 31;
+  x->state = seed != 0 ? seed : 1;
+}
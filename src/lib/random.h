@@ -2,9 +2,43 @@
 #define __LIB_RANDOM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 void random_init (unsigned seed);
 void random_bytes (void *, size_t);
 unsigned long random_ulong (void);
 
+/* A fast xorshift64* generator, for randomized policies that draw
+   often and need speed more than the quality of the RC4 generator
+   above.  Its state is kept by the caller, one per thread or CPU,
+   so that users do not contend for it.  See Vigna, "An experimental
+   exploration of Marsaglia's xorshift generators, scrambled". */
+struct xorshift
+  {
+    uint64_t state;             /* Never 0 once seeded. */
+  };
+
+void xorshift_seed (struct xorshift *, uint64_t seed);
+
+/* Returns the next 32 pseudo-random bits from X. */
+static inline uint32_t
+xorshift_next (struct xorshift *x)
+{
+  uint64_t s = x->state;
+
+  s ^= s >> 12;
+  s ^= s << 25;
+  s ^= s >> 27;
+  x->state = s;
+  return (s * 0x2545f4914f6cdd1dULL) >> 32;
+}
+
+/* Returns a pseudo-random number in the range 0...N (exclusive)
+   from X, without the division that % would take. */
+static inline uint32_t
+xorshift_range (struct xorshift *x, uint32_t n)
+{
+  return ((uint64_t) xorshift_next (x) * n) >> 32;
+}
+
 #endif /* lib/random.h */
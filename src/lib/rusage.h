@@ -0,0 +1,26 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stddef.h>
+#include <syscall-nr.h>
+
+/* Resources used by one process, counted over all of its threads
+   and reported to its parent by the wait_rusage system call.
+   Ticks are timer ticks. */
+struct rusage
+  {
+    long long user_ticks;               /* Ticks in user mode. */
+    long long kernel_ticks;             /* Ticks in the kernel, on its
+                                           behalf. */
+    unsigned long long minor_faults;    /* Faults resolved without I/O. */
+    unsigned long long major_faults;    /* Faults read from file or swap. */
+    unsigned long long swap_ins;        /* Pages read back from swap. */
+    unsigned long long swap_outs;       /* Pages evicted to swap. */
+    unsigned long long read_bytes;      /* Bytes read by system calls. */
+    unsigned long long write_bytes;     /* Bytes written by system calls. */
+    size_t peak_rss;                    /* Most frames held at once. */
+    unsigned syscalls[SYS_CNT];         /* Calls made, by system call
+                                           number. */
+  };
+
+#endif /* lib/rusage.h */
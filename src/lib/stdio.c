@@ -295,6 +295,14 @@ __vprintf (const char *format, va_list args,
             if (s == NULL)
               s = "(null)";
 
+            /* Plain %s, the common case, needs no length. */
+            if (c.width == 0 && c.precision < 0)
+              {
+                while (*s != '\0')
+                  output (*s++, aux);
+                break;
+              }
+
             /* Limit string length according to precision.
                Note: if c.precision == -1 then strnlen() will get
                SIZE_MAX for MAXLEN, which is just what we want. */
@@ -500,10 +508,14 @@ format_integer (uintmax_t value, bool is_signed, bool negative,
 
   /* Accumulate digits into buffer.
      This algorithm produces digits in reverse order, so later we
-     will output the buffer's content in reverse. */
+     will output the buffer's content in reverse.  Digits are taken
+     with 64-bit division only while the value needs it, which
+     costs a call to __udivdi3() per digit; the rest, and nearly
+     every value printed, use 32-bit division, by a constant for
+     the common bases so that it becomes a multiply or shift. */
   cp = buf;
   digit_cnt = 0;
-  while (value > 0) 
+  while (value > UINT32_MAX) 
     {
       if ((c->flags & GROUP) && digit_cnt > 0 && digit_cnt % b->group == 0)
         *cp++ = ',';
@@ -511,6 +523,27 @@ format_integer (uintmax_t value, bool is_signed, bool negative,
       value /= b->base;
       digit_cnt++;
     }
+  if (value > 0)
+    {
+      uint32_t v = value;
+
+      while (v > 0)
+        {
+          unsigned digit;
+
+          if ((c->flags & GROUP) && digit_cnt > 0
+              && digit_cnt % b->group == 0)
+            *cp++ = ',';
+          switch (b->base)
+            {
+            case 10: digit = v % 10; v /= 10; break;
+            case 16: digit = v & 15; v >>= 4; break;
+            default: digit = v % b->base; v /= b->base; break;
+            }
+          *cp++ = b->digits[digit];
+          digit_cnt++;
+        }
+    }
 
   /* Append enough zeros to match precision.
      If requested precision is 0, then a value of zero is
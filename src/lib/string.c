@@ -1,5 +1,36 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Blocks shorter than this are copied or set a byte at a time,
+   since REP's startup cost outweighs its gain on them. */
+#define REP_MIN 16
+
+/* Word-at-a-time scanning.  An aligned word never straddles a
+   page, so reading all of the word that holds a string's last byte
+   cannot fault even if the rest lies past the string's end.
+   WORD_T may alias any object, as the words read overlay chars. */
+typedef uint32_t word_t __attribute__ ((may_alias));
+#define WORD_SIZE sizeof (word_t)
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+
+/* Returns nonzero if some byte of W is zero. */
+static inline uint32_t
+has_zero (uint32_t w)
+{
+  return (w - ONES) & ~w & HIGHS;
+}
+
+/* Returns true if P is word aligned. */
+static inline bool
+word_aligned (const void *p)
+{
+  return (uintptr_t) p % WORD_SIZE == 0;
+}
+
+static void copy_up (unsigned char *, const unsigned char *, size_t);
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,12 +43,32 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
-
+  copy_up (dst, src, size);
   return dst_;
 }
 
+/* Copies SIZE bytes from SRC to DST, lowest address first, which
+   is safe if DST does not overlap the part of SRC above it.  After
+   bytes up to a word boundary of DST, whole words go with REP
+   MOVSL and the last few bytes with REP MOVSB. */
+static void
+copy_up (unsigned char *dst, const unsigned char *src, size_t size)
+{
+  if (size >= REP_MIN)
+    {
+      size_t head = -(uintptr_t) dst % sizeof (uint32_t);
+      size_t words = (size - head) / sizeof (uint32_t);
+
+      size -= head + words * sizeof (uint32_t);
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+}
+
 /* Copies SIZE bytes from SRC to DST, which are allowed to
    overlap.  Returns DST. */
 void *
@@ -30,19 +81,30 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (src != NULL || size == 0);
 
   if (dst < src) 
+    copy_up (dst, src, size);
+  else if (size > 0)
     {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
+      /* Copy from the top down: the last SIZE % 4 bytes, then the
+         words below them.  The direction flag is set and cleared
+         in one statement so that compiled code never sees it set. */
+      unsigned char *d = dst + size - 1;
+      const unsigned char *s = src + size - 1;
+      size_t bytes = size % sizeof (uint32_t);
+      size_t words = size / sizeof (uint32_t);
+
+      asm volatile ("std\n\t"
+                    "rep movsb\n\t"
+                    "subl $3, %%edi\n\t"
+                    "subl $3, %%esi\n\t"
+                    "movl %3, %%ecx\n\t"
+                    "rep movsl\n\t"
+                    "cld"
+                    : "+D" (d), "+S" (s), "+c" (bytes)
+                    : "r" (words)
+                    : "memory");
     }
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +120,17 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words when A and B can be aligned together. */
+  if ((uintptr_t) a % WORD_SIZE == (uintptr_t) b % WORD_SIZE)
+    {
+      for (; size > 0 && !word_aligned (a); size--, a++, b++)
+        if (*a != *b)
+          return *a > *b ? +1 : -1;
+      for (; size >= WORD_SIZE && *(const word_t *) a == *(const word_t *) b;
+           size -= WORD_SIZE, a += WORD_SIZE, b += WORD_SIZE)
+        continue;
+    }
+
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -78,6 +151,21 @@ strcmp (const char *a_, const char *b_)
   ASSERT (a != NULL);
   ASSERT (b != NULL);
 
+  /* Skip equal words without a null when A and B can be aligned
+     together. */
+  if ((uintptr_t) a % WORD_SIZE == (uintptr_t) b % WORD_SIZE)
+    {
+      for (; !word_aligned (a); a++, b++)
+        if (*a == '\0' || *a != *b)
+          return *a < *b ? -1 : *a > *b;
+      while (*(const word_t *) a == *(const word_t *) b
+             && !has_zero (*(const word_t *) a))
+        {
+          a += WORD_SIZE;
+          b += WORD_SIZE;
+        }
+    }
+
   while (*a != '\0' && *a == *b) 
     {
       a++;
@@ -98,6 +186,12 @@ memchr (const void *block_, int ch_, size_t size)
 
   ASSERT (block != NULL || size == 0);
 
+  for (; size > 0 && !word_aligned (block); size--, block++)
+    if (*block == ch)
+      return (void *) block;
+  for (; size >= WORD_SIZE && !has_zero (*(const word_t *) block ^ ch * ONES);
+       size -= WORD_SIZE, block += WORD_SIZE)
+    continue;
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -113,9 +207,20 @@ char *
 strchr (const char *string, int c_) 
 {
   char c = c_;
+  uint32_t pattern = (unsigned char) c * ONES;
 
   ASSERT (string != NULL);
 
+  /* Skip words holding neither C nor a null. */
+  for (; !word_aligned (string); string++)
+    if (*string == c)
+      return (char *) string;
+    else if (*string == '\0')
+      return NULL;
+  while (!has_zero (*(const word_t *) string)
+         && !has_zero (*(const word_t *) string ^ pattern))
+    string += WORD_SIZE;
+
   for (;;) 
     if (*string == c)
       return (char *) string;
@@ -282,8 +387,22 @@ memset (void *dst_, int value, size_t size)
 
   ASSERT (dst != NULL || size == 0);
   
-  while (size-- > 0)
-    *dst++ = value;
+  /* Bytes up to a word boundary of DST, then words with REP STOSL,
+     then the last few bytes, as in copy_up(). */
+  if (size >= REP_MIN)
+    {
+      uint32_t word = (unsigned char) value * 0x01010101u;
+      size_t head = -(uintptr_t) dst % sizeof (uint32_t);
+      size_t words = (size - head) / sizeof (uint32_t);
+
+      size -= head + words * sizeof (uint32_t);
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (head) : "a" (word) : "memory");
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (word) : "memory");
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size) : "a" (value) : "memory");
 
   return dst_;
 }
@@ -296,7 +415,12 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  for (p = string; !word_aligned (p); p++)
+    if (*p == '\0')
+      return p - string;
+  while (!has_zero (*(const word_t *) p))
+    p += WORD_SIZE;
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
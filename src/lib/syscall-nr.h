@@ -28,7 +28,40 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_WAIT_ON,                /* Sleep while a user word has a value. */
+    SYS_WAKE,                   /* Wake threads sleeping on a user word. */
+    SYS_MEMSTAT,                /* Report page allocator statistics. */
+    SYS_FORK,                   /* Duplicate the calling process. */
+    SYS_MSYNC,                  /* Write back a memory mapping. */
+    SYS_MADVISE,                /* Advise on use of a range of pages. */
+    SYS_SBRK,                   /* Grow or shrink the heap. */
+    SYS_GETDENTS,               /* Read many directory entries. */
+    SYS_FALLOCATE,              /* Allocate disk space for a file. */
+    SYS_BLOCKSTAT,              /* Report block device statistics. */
+    SYS_IORING_SETUP,           /* Register a submission ring. */
+    SYS_IORING_ENTER,           /* Run operations queued on the ring. */
+    SYS_PREAD,                  /* Read from a file at a given offset. */
+    SYS_PWRITE,                 /* Write to a file at a given offset. */
+    SYS_READV,                  /* Read into many buffers. */
+    SYS_WRITEV,                 /* Write from many buffers. */
+    SYS_COPY_FILE_RANGE,        /* Copy between files in the kernel. */
+    SYS_THREAD_SPAWN,           /* Start a thread in this process. */
+    SYS_POLL,                   /* Wait for descriptors to be ready. */
+    SYS_FCNTL,                  /* Get or set descriptor flags. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_INTRSTAT,               /* Report interrupt statistics. */
+    SYS_TRACE_READ,             /* Fetch kernel trace records. */
+    SYS_STATS,                  /* Report system-wide counters. */
+    SYS_WAIT_RUSAGE,            /* Wait for a child, with its usage. */
+    SYS_FSYNC,                  /* Write a file's data and metadata to disk. */
+    SYS_FDATASYNC,              /* Write a file's data to disk. */
+    SYS_SCHED_DEADLINE,         /* Schedule a thread by deadline. */
+    SYS_SPAWN,                  /* Start a process without waiting. */
+
+    SYS_CNT                     /* Number of system calls. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,31 @@
+#ifndef __LIB_SYSENTER_H
+#define __LIB_SYSENTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Returns true if the CPU has working SYSENTER and SYSEXIT
+   instructions.  The kernel sets up its fast system call entry
+   only in that case, and user programs make the same check to
+   decide whether to use it, so the two always agree.
+
+   CPUID leaf 1 reports the instructions in EDX bit 11, but early
+   Pentium Pro steppings set the bit without supporting them.  See
+   [IA32-v2b] "SYSENTER--Fast System Call". */
+static inline bool
+cpu_has_sysenter (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  unsigned family, model, stepping;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if ((edx & (1u << 11)) == 0)
+    return false;
+
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+  return !(family == 6 && model < 3 && stepping < 3);
+}
+
+#endif /* lib/sysenter.h */
@@ -0,0 +1,45 @@
+#ifndef __LIB_SYSSTAT_H
+#define __LIB_SYSSTAT_H
+
+/* Snapshot of system-wide counters, as reported by the stats
+   system call.  Counts are totals since boot.  Fields are only
+   ever added at the end, so that a program built against an
+   older version of this structure still gets the fields it knows
+   about. */
+struct sysstat
+  {
+    /* Memory. */
+    unsigned user_pages;                /* Pages in the user pool. */
+    unsigned user_free;                 /* Of those, pages free. */
+    unsigned kernel_pages;              /* Pages in the kernel pool. */
+    unsigned kernel_free;               /* Of those, pages free. */
+    unsigned swap_slots;                /* Swap slots, all devices. */
+    unsigned swap_used;                 /* Of those, slots in use. */
+
+    /* Virtual memory. */
+    unsigned long long page_faults;     /* Page faults taken. */
+    unsigned long long major_faults;    /* Resolved from file or swap. */
+    unsigned long long minor_faults;    /* Resolved without reading. */
+    unsigned long long evictions;       /* Pages evicted. */
+    unsigned long long swap_outs;       /* Pages written to swap. */
+    unsigned long long swap_ins;        /* Pages read from swap. */
+
+    /* Block devices, all together. */
+    unsigned long long sectors_read;    /* Sectors read. */
+    unsigned long long sectors_written; /* Sectors written. */
+    unsigned long long block_requests;  /* Requests completed. */
+
+    /* Scheduler. */
+    unsigned long long vol_switches;    /* Switches away from blocking. */
+    unsigned long long invol_switches;  /* Switches away by preemption. */
+    unsigned long long idle_ticks;      /* Timer ticks spent idle. */
+    unsigned long long kernel_ticks;    /* Ticks in kernel threads. */
+    unsigned long long user_ticks;      /* Ticks in user programs. */
+    int load_avg;                       /* 100 times the load average. */
+
+    /* Time. */
+    long long ticks;                    /* Timer ticks since boot. */
+    int timer_freq;                     /* Timer ticks per second. */
+  };
+
+#endif /* lib/sysstat.h */
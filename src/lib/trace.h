@@ -0,0 +1,32 @@
+#ifndef __LIB_TRACE_H
+#define __LIB_TRACE_H
+
+/* Kinds of kernel trace records, and what their arguments mean. */
+enum trace_type
+  {
+    TRACE_SWITCH,               /* Thread switch: prev tid, next tid,
+                                   prev's new status. */
+    TRACE_PAGE_FAULT,           /* Page fault: address, error code,
+                                   tid. */
+    TRACE_EVICT,                /* Eviction: pages evicted, pages
+                                   written to swap. */
+    TRACE_SWAP_READ,            /* Swap read: first sector, slots. */
+    TRACE_SWAP_WRITE,           /* Swap write: first sector, slots. */
+    TRACE_BLOCK_READ,           /* Block read: device index, first
+                                   sector, sectors, cycles taken. */
+    TRACE_BLOCK_WRITE,          /* Block write: likewise. */
+    TRACE_SYSCALL,              /* System call: number, tid. */
+    TRACE_TYPE_CNT
+  };
+
+/* One kernel trace record, as returned by the trace_read system
+   call and printed at shutdown with -trace. */
+struct trace_record
+  {
+    unsigned long long tsc;     /* Time stamp counter when recorded. */
+    unsigned seq;               /* Sequence number, from 0 at boot. */
+    unsigned type;              /* A TRACE_* value. */
+    unsigned arg[4];            /* Meaning depends on TYPE. */
+  };
+
+#endif /* lib/trace.h */
@@ -1,19 +1,68 @@
 #include <stdio.h>
+#include <malloc.h>
+#include <mutex.h>
 #include <string.h>
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* Output buffering.
+
+   Output to a handle that has a struct outbuf collects in its
+   buffer and is written with one write() system call when the
+   buffer fills or, depending on the handle's buffering mode, when
+   a call that produced output ends.  The console starts out line
+   buffered, so every printf() that ends a line still shows up
+   immediately, but a program that prints piecemeal, or that
+   switches to HBUF_FULL with hsetbuf(), makes a system call per
+   buffer instead of per call or per character.
+
+   Output to other handles is written by the end of each call, as
+   though unbuffered.
+
+   exit() and fork() flush every buffer first, so output is not
+   lost or duplicated.  A handle must be flushed with hflush()
+   before it is closed. */
+
+/* Output buffer for one handle. */
+struct outbuf
+  {
+    int handle;                 /* File handle. */
+    enum hbuf_mode mode;        /* When to write the buffer. */
+    char *data;                 /* Buffer, or null if slot is free. */
+    size_t size;                /* Bytes allocated for DATA. */
+    size_t len;                 /* Bytes buffered in DATA. */
+    bool newline;               /* New-line buffered? */
+    struct mutex lock;          /* Protects all of the above. */
+  };
+
+/* Size of a handle's buffer. */
+#define OUTBUF_SIZE 4096
+
+/* Maximum number of buffered handles. */
+#define OUTBUF_CNT 8
+
+static char stdout_data[OUTBUF_SIZE];
+static struct outbuf outbufs[OUTBUF_CNT] =
+  {
+    { STDOUT_FILENO, HBUF_LINE, stdout_data, OUTBUF_SIZE, 0, false, { 0 } },
+  };
+
+static struct outbuf *find_outbuf (int handle);
+static void outbuf_put (struct outbuf *, const void *, size_t);
+static void outbuf_end (struct outbuf *);
+static void flush (struct outbuf *);
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
-vprintf (const char *format, va_list args) 
+vprintf (const char *format, va_list args)
 {
   return vhprintf (STDOUT_FILENO, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
 int
-hprintf (int handle, const char *format, ...) 
+hprintf (int handle, const char *format, ...)
 {
   va_list args;
   int retval;
@@ -28,67 +77,222 @@ hprintf (int handle, const char *format, ...)
 /* Writes string S to the console, followed by a new-line
    character. */
 int
-puts (const char *s) 
+puts (const char *s)
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  struct outbuf *ob = find_outbuf (STDOUT_FILENO);
+
+  mutex_acquire (&ob->lock);
+  outbuf_put (ob, s, strlen (s));
+  outbuf_put (ob, "\n", 1);
+  outbuf_end (ob);
+  mutex_release (&ob->lock);
 
   return 0;
 }
 
 /* Writes C to the console. */
 int
-putchar (int c) 
+putchar (int c)
 {
   char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
+
+  hwrite (STDOUT_FILENO, &c2, 1);
   return c;
 }
-
+
+/* Writes the SIZE bytes in BUFFER to HANDLE, through HANDLE's
+   buffer if it has one.  Returns the number of bytes written or
+   buffered, or -1 if writing failed. */
+int
+hwrite (int handle, const void *buffer, size_t size)
+{
+  struct outbuf *ob = find_outbuf (handle);
+
+  if (ob == NULL)
+    return write (handle, buffer, size);
+
+  mutex_acquire (&ob->lock);
+  outbuf_put (ob, buffer, size);
+  outbuf_end (ob);
+  mutex_release (&ob->lock);
+  return size;
+}
+
+/* Sets how output to HANDLE is buffered to MODE, first writing
+   out anything already buffered.  Returns true if successful,
+   false if HANDLE needs a buffer and none could be allocated.
+   Should be called before other threads write to HANDLE. */
+bool
+hsetbuf (int handle, enum hbuf_mode mode)
+{
+  struct outbuf *ob = find_outbuf (handle);
+
+  if (ob == NULL)
+    {
+      if (mode == HBUF_NONE)
+        return true;
+
+      /* Find a free slot and give it a buffer. */
+      for (ob = outbufs; ob < outbufs + OUTBUF_CNT; ob++)
+        if (ob->data == NULL)
+          break;
+      if (ob == outbufs + OUTBUF_CNT)
+        return false;
+      ob->data = malloc (OUTBUF_SIZE);
+      if (ob->data == NULL)
+        return false;
+      ob->handle = handle;
+      ob->size = OUTBUF_SIZE;
+      ob->len = 0;
+      ob->newline = false;
+    }
+
+  mutex_acquire (&ob->lock);
+  flush (ob);
+  ob->mode = mode;
+  mutex_release (&ob->lock);
+  return true;
+}
+
+/* Writes out anything buffered for HANDLE. */
+void
+hflush (int handle)
+{
+  struct outbuf *ob = find_outbuf (handle);
+
+  if (ob != NULL)
+    {
+      mutex_acquire (&ob->lock);
+      flush (ob);
+      mutex_release (&ob->lock);
+    }
+}
+
+/* Writes out the buffers of all handles.  Called by exit() and
+   fork(). */
+void
+hflush_all (void)
+{
+  struct outbuf *ob;
+
+  for (ob = outbufs; ob < outbufs + OUTBUF_CNT; ob++)
+    if (ob->data != NULL)
+      {
+        mutex_acquire (&ob->lock);
+        flush (ob);
+        mutex_release (&ob->lock);
+      }
+}
+
 /* Auxiliary data for vhprintf_helper(). */
-struct vhprintf_aux 
+struct vhprintf_aux
   {
-    char buf[64];       /* Character buffer. */
-    char *p;            /* Current position in buffer. */
+    struct outbuf *ob;  /* Output buffer. */
     int char_cnt;       /* Total characters written so far. */
-    int handle;         /* Output file handle. */
   };
 
 static void add_char (char, void *);
-static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
    HANDLE. */
 int
-vhprintf (int handle, const char *format, va_list args) 
+vhprintf (int handle, const char *format, va_list args)
 {
+  struct outbuf *ob = find_outbuf (handle);
+  struct outbuf local;
   struct vhprintf_aux aux;
-  aux.p = aux.buf;
+  char buf[64];
+
+  if (ob == NULL)
+    {
+      /* Collect the output in a small buffer of our own. */
+      local.handle = handle;
+      local.mode = HBUF_NONE;
+      local.data = buf;
+      local.size = sizeof buf;
+      local.len = 0;
+      local.newline = false;
+      ob = &local;
+    }
+  else
+    mutex_acquire (&ob->lock);
+
+  aux.ob = ob;
   aux.char_cnt = 0;
-  aux.handle = handle;
   __vprintf (format, args, add_char, &aux);
-  flush (&aux);
+  outbuf_end (ob);
+
+  if (ob != &local)
+    mutex_release (&ob->lock);
   return aux.char_cnt;
 }
 
 /* Adds C to the buffer in AUX, flushing it if the buffer fills
    up. */
 static void
-add_char (char c, void *aux_) 
+add_char (char c, void *aux_)
 {
   struct vhprintf_aux *aux = aux_;
-  *aux->p++ = c;
-  if (aux->p >= aux->buf + sizeof aux->buf)
-    flush (aux);
+  struct outbuf *ob = aux->ob;
+
+  if (ob->len >= ob->size)
+    flush (ob);
+  ob->data[ob->len++] = c;
+  if (c == '\n')
+    ob->newline = true;
   aux->char_cnt++;
 }
 
-/* Flushes the buffer in AUX. */
+/* Returns HANDLE's output buffer, or a null pointer if it has
+   none. */
+static struct outbuf *
+find_outbuf (int handle)
+{
+  struct outbuf *ob;
+
+  for (ob = outbufs; ob < outbufs + OUTBUF_CNT; ob++)
+    if (ob->data != NULL && ob->handle == handle)
+      return ob;
+  return NULL;
+}
+
+/* Appends the SIZE bytes in BUFFER to OB, writing out OB's
+   buffer first if they do not fit.  A write too big for the
+   buffer goes straight to the handle. */
+static void
+outbuf_put (struct outbuf *ob, const void *buffer, size_t size)
+{
+  if (size > ob->size - ob->len)
+    {
+      flush (ob);
+      if (size >= ob->size)
+        {
+          write (ob->handle, buffer, size);
+          return;
+        }
+    }
+  memcpy (ob->data + ob->len, buffer, size);
+  ob->len += size;
+  if (ob->mode == HBUF_LINE && memchr (buffer, '\n', size) != NULL)
+    ob->newline = true;
+}
+
+/* Writes out OB's buffer, as its mode requires at the end of a
+   call that output to it. */
+static void
+outbuf_end (struct outbuf *ob)
+{
+  if (ob->mode == HBUF_NONE || (ob->mode == HBUF_LINE && ob->newline))
+    flush (ob);
+}
+
+/* Writes out OB's buffer. */
 static void
-flush (struct vhprintf_aux *aux)
+flush (struct outbuf *ob)
 {
-  if (aux->p > aux->buf)
-    write (aux->handle, aux->buf, aux->p - aux->buf);
-  aux->p = aux->buf;
+  if (ob->len > 0)
+    write (ob->handle, ob->data, ob->len);
+  ob->len = 0;
+  ob->newline = false;
 }
@@ -0,0 +1,437 @@
+#include <malloc.h>
+#include <debug.h>
+#include <mutex.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "threads/vaddr.h"
+
+/* User-level malloc().
+
+   This follows threads/malloc.c.  Each request is rounded up to
+   a power of 2 and served by the "descriptor" for blocks of that
+   size, which carves one-page "arenas" into blocks.  Requests
+   too big for a descriptor get a run of whole pages of their own,
+   with the arena header in front recording the page count.
+
+   The pages come from the heap that sbrk() grows.  Pages that
+   are given back, by freeing an empty arena or a big block, go
+   on a list of free runs that is kept sorted by address, so
+   neighbouring runs merge and later requests can reuse them.
+   When enough free pages collect at the top of the heap, the
+   break is moved back down to return them to the kernel.
+
+   Each descriptor keeps the arenas that still have free blocks
+   on a list, and each arena keeps its own list of free blocks,
+   so allocation and freeing take constant time.  A new arena's
+   blocks are handed out in address order before its free list is
+   used, so creating an arena does not have to touch every block.
+
+   A process may run several threads, so the descriptors and the
+   free runs are each protected by a struct mutex.  Single-threaded
+   programs never contend for them, so they make no system call
+   except to move the break. */
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct arena *partial;      /* Arenas with free blocks. */
+    struct mutex lock;          /* Lock. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+    size_t unused_idx;          /* First block never handed out. */
+    struct block *free_list;    /* Blocks freed since. */
+    struct arena *prev;         /* Previous arena in `partial'. */
+    struct arena *next;         /* Next arena in `partial'. */
+  };
+
+/* Bytes at the start of an arena taken by its header.  Rounding
+   up keeps every block aligned to 16 bytes. */
+#define ARENA_HDR ROUND_UP (sizeof (struct arena), 16)
+
+/* Free block. */
+struct block
+  {
+    struct block *next;         /* Next free block in arena. */
+  };
+
+/* Run of free pages. */
+struct run
+  {
+    size_t page_cnt;            /* Number of pages. */
+    struct run *next;           /* Next run, at a higher address. */
+  };
+
+/* Free pages at the top of the heap are returned to the kernel
+   once there are at least this many. */
+#define TRIM_PAGES 16
+
+#define DESC(SIZE) { SIZE, (PGSIZE - ARENA_HDR) / (SIZE), NULL, { 0 } }
+
+/* Our set of descriptors. */
+static struct desc descs[] =
+  {
+    DESC (16), DESC (32), DESC (64), DESC (128),
+    DESC (256), DESC (512), DESC (1024),
+  };
+#define DESC_CNT (sizeof descs / sizeof *descs)
+
+static struct run *free_runs;   /* Free runs, in address order. */
+static struct mutex runs_lock;  /* Protects `free_runs'. */
+
+static void *get_pages (size_t page_cnt);
+static void free_pages (void *, size_t page_cnt);
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+static void partial_push (struct desc *, struct arena *);
+static void partial_remove (struct desc *, struct arena *);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + DESC_CNT; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + DESC_CNT)
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - ARENA_HDR - PGSIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + ARENA_HDR, PGSIZE);
+      a = get_pages (page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return (uint8_t *) a + ARENA_HDR;
+    }
+
+  mutex_acquire (&d->lock);
+
+  /* If no arena has a free block, create a new one. */
+  a = d->partial;
+  if (a == NULL)
+    {
+      a = get_pages (1);
+      if (a == NULL)
+        {
+          mutex_release (&d->lock);
+          return NULL;
+        }
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      a->unused_idx = 0;
+      a->free_list = NULL;
+      partial_push (d, a);
+    }
+
+  /* Take a block from the arena, retiring the arena from the
+     partial list if that was its last. */
+  if (a->free_list != NULL)
+    {
+      b = a->free_list;
+      a->free_list = b->next;
+    }
+  else
+    b = arena_to_block (a, a->unused_idx++);
+  if (--a->free_cnt == 0)
+    partial_remove (d, a);
+
+  mutex_release (&d->lock);
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (b != 0 && size / b != a)
+    return NULL;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - ARENA_HDR;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   A block that already has room for NEW_SIZE bytes is returned
+   unchanged, so growing a buffer a little at a time copies it
+   only when it crosses a size class. */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    return old_block;
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          memcpy (new_block, old_block, block_size (old_block));
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  if (p != NULL)
+    {
+      struct block *b = p;
+      struct arena *a = block_to_arena (b);
+      struct desc *d = a->desc;
+
+      if (d != NULL)
+        {
+          /* It's a normal block.  We handle it here. */
+
+#ifndef NDEBUG
+          /* Clear the block to help detect use-after-free bugs. */
+          memset (b, 0xcc, d->block_size);
+#endif
+
+          mutex_acquire (&d->lock);
+
+          /* Add block to its arena's free list. */
+          b->next = a->free_list;
+          a->free_list = b;
+          if (a->free_cnt++ == 0)
+            partial_push (d, a);
+
+          /* If the arena is now entirely unused, free it, unless
+             it is the only arena left with free blocks: keeping
+             that one spares a program that allocates and frees a
+             single block in a loop from moving the break each
+             time. */
+          if (a->free_cnt >= d->blocks_per_arena
+              && (a->prev != NULL || a->next != NULL))
+            {
+              ASSERT (a->free_cnt == d->blocks_per_arena);
+              partial_remove (d, a);
+              free_pages (a, 1);
+            }
+
+          mutex_release (&d->lock);
+        }
+      else
+        {
+          /* It's a big block.  Free its pages. */
+          free_pages (a, a->free_cnt);
+        }
+    }
+}
+
+/* Returns PAGE_CNT contiguous free pages, taken from the free
+   runs if one is big enough and from the top of the heap
+   otherwise, or a null pointer if memory is not available. */
+static void *
+get_pages (size_t page_cnt)
+{
+  struct run **link;
+  uint8_t *pages = NULL;
+
+  mutex_acquire (&runs_lock);
+
+  /* Take the pages from the end of the first run that is big
+     enough, so that what is left of the run stays in place. */
+  for (link = &free_runs; *link != NULL; link = &(*link)->next)
+    {
+      struct run *r = *link;
+      if (r->page_cnt >= page_cnt)
+        {
+          r->page_cnt -= page_cnt;
+          pages = (uint8_t *) r + r->page_cnt * PGSIZE;
+          if (r->page_cnt == 0)
+            *link = r->next;
+          break;
+        }
+    }
+
+  if (pages == NULL && page_cnt <= (size_t) INTPTR_MAX / PGSIZE - 1)
+    {
+      /* Grow the heap, padding it first to a page boundary if
+         something else left the break in the middle of a page. */
+      uint8_t *brk = sbrk (0);
+      size_t pad = ROUND_UP ((uintptr_t) brk, PGSIZE) - (uintptr_t) brk;
+
+      if (brk != (void *) -1
+          && sbrk (pad + page_cnt * PGSIZE) != (void *) -1)
+        pages = brk + pad;
+    }
+
+  mutex_release (&runs_lock);
+  return pages;
+}
+
+/* Returns the PAGE_CNT pages at PAGES to the free runs, merging
+   them with the runs on either side, and gives the run at the top
+   of the heap back to the kernel once it is large. */
+static void
+free_pages (void *pages, size_t page_cnt)
+{
+  struct run **link, **r_link;
+  struct run *prev = NULL, *next, *r;
+
+  mutex_acquire (&runs_lock);
+
+  /* Find the runs on either side of PAGES. */
+  r_link = link = &free_runs;
+  for (next = free_runs; next != NULL && (void *) next < pages;
+       next = next->next)
+    {
+      r_link = link;
+      prev = next;
+      link = &next->next;
+    }
+
+  /* Merge with the run below, or link in a new run. */
+  if (prev != NULL && (uint8_t *) prev + prev->page_cnt * PGSIZE == pages)
+    {
+      r = prev;
+      r->page_cnt += page_cnt;
+    }
+  else
+    {
+      r = pages;
+      r->page_cnt = page_cnt;
+      r->next = next;
+      *link = r;
+      r_link = link;
+    }
+
+  /* Merge with the run above. */
+  if (next != NULL && (uint8_t *) r + r->page_cnt * PGSIZE == (void *) next)
+    {
+      r->page_cnt += next->page_cnt;
+      r->next = next->next;
+    }
+
+  /* Move the break down over a large run at the top of the
+     heap. */
+  if (r->next == NULL && r->page_cnt >= TRIM_PAGES
+      && (uint8_t *) r + r->page_cnt * PGSIZE == sbrk (0)
+      && sbrk (-(intptr_t) (r->page_cnt * PGSIZE)) != (void *) -1)
+    *r_link = NULL;
+
+  mutex_release (&runs_lock);
+}
+
+/* Adds A to the front of D's list of arenas with free blocks. */
+static void
+partial_push (struct desc *d, struct arena *a)
+{
+  a->prev = NULL;
+  a->next = d->partial;
+  if (d->partial != NULL)
+    d->partial->prev = a;
+  d->partial = a;
+}
+
+/* Removes A from D's list of arenas with free blocks. */
+static void
+partial_remove (struct desc *d, struct arena *a)
+{
+  if (a->prev != NULL)
+    a->prev->next = a->next;
+  else
+    d->partial = a->next;
+  if (a->next != NULL)
+    a->next->prev = a->prev;
+  a->prev = a->next = NULL;
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = pg_round_down (b);
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || (pg_ofs (b) - ARENA_HDR) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || pg_ofs (b) == ARENA_HDR);
+
+  return a;
+}
+
+/* Returns the IDX'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx)
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + ARENA_HDR
+                           + idx * a->desc->block_size);
+}
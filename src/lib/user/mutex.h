@@ -0,0 +1,48 @@
+#ifndef __LIB_USER_MUTEX_H
+#define __LIB_USER_MUTEX_H
+
+#include <syscall.h>
+
+/* Mutex for threads of one process, built on wait_on() and
+   wake().  Acquiring or releasing a mutex that no other thread
+   wants is a single atomic exchange; only a thread that has to
+   wait for it enters the kernel.
+
+   A zeroed struct mutex is free, so statically allocated mutexes
+   need no initialization. */
+struct mutex
+  {
+    int state;                  /* 0 = free, 1 = held, 2 = waiters. */
+  };
+
+/* Atomically stores NEW in *P and returns the old value. */
+static inline int
+mutex_exchange (int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Acquires M, sleeping until it is free if another thread holds
+   it. */
+static inline void
+mutex_acquire (struct mutex *m)
+{
+  if (mutex_exchange (&m->state, 1) == 0)
+    return;
+
+  /* Mark the mutex as having waiters, so that the holder wakes
+     one of us when it releases it. */
+  while (mutex_exchange (&m->state, 2) != 0)
+    wait_on (&m->state, 2);
+}
+
+/* Releases M, which the current thread must hold. */
+static inline void
+mutex_release (struct mutex *m)
+{
+  if (mutex_exchange (&m->state, 0) == 2)
+    wake (&m->state, 1);
+}
+
+#endif /* lib/user/mutex.h */
@@ -1,7 +1,20 @@
 #ifndef __LIB_USER_STDIO_H
 #define __LIB_USER_STDIO_H
 
+/* How output to a handle is buffered. */
+enum hbuf_mode
+  {
+    HBUF_NONE,          /* Written by the end of each call. */
+    HBUF_LINE,          /* Written by the end of each call that
+                           outputs a new-line. */
+    HBUF_FULL           /* Written when the buffer fills. */
+  };
+
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
+int hwrite (int, const void *, size_t);
+bool hsetbuf (int, enum hbuf_mode);
+void hflush (int);
+void hflush_all (void);
 
 #endif /* lib/user/stdio.h */
@@ -1,31 +1,49 @@
 #include <syscall.h>
+#include <stdio.h>
+#include <sysenter.h>
 #include "../syscall-nr.h"
 
+/* Nonzero if the CPU has SYSENTER, set by syscall_init(). */
+static char use_sysenter;
+
+/* Traps into the kernel with the system call number and
+   arguments already pushed, through SYSENTER if USE_SYSENTER is
+   set and "int $0x30" otherwise.  SYSENTER takes the stack
+   pointer to give the kernel in %ecx and the address to return to
+   in %edx, so both are clobbered. */
+#define SYSCALL_TRAP                                            \
+        "cmpb $0, %[fast]; je 1f; "                             \
+        "movl %%esp, %%ecx; movl $2f, %%edx; sysenter; "        \
+        "1: int $0x30; 2: "
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_TRAP "addl $4, %%esp"  \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : [number] "i" (NUMBER),                         \
+                 [fast] "m" (use_sysenter)                      \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
    return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
-        ({                                                               \
-          int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
-          retval;                                                        \
+#define syscall1(NUMBER, ARG0)                                  \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg0]; pushl %[number]; "                 \
+             SYSCALL_TRAP "addl $8, %%esp"                      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [fast] "m" (use_sysenter),                     \
+                 [arg0] "g" (ARG0)                              \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
@@ -35,12 +53,13 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP "addl $12, %%esp" \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
+                 [fast] "m" (use_sysenter),                     \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -51,16 +70,45 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_TRAP "addl $16, %%esp" \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
+                 [fast] "m" (use_sysenter),                     \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
                  [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
+        })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; "                 \
+             SYSCALL_TRAP "addl $20, %%esp"                     \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [fast] "m" (use_sysenter),                     \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "g" (ARG3)                              \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
+/* Chooses how system calls enter the kernel.  Called by _start()
+   before anything else. */
+void
+syscall_init (void)
+{
+  use_sysenter = cpu_has_sysenter ();
+}
+
 void
 halt (void) 
 {
@@ -68,9 +116,11 @@ halt (void)
   NOT_REACHED ();
 }
 
+/* Writes out buffered output, then ends the process. */
 void
 exit (int status)
 {
+  hflush_all ();
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -182,3 +232,197 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+wait_on (int *addr, int expected)
+{
+  return syscall2 (SYS_WAIT_ON, addr, expected);
+}
+
+int
+wake (int *addr, int n)
+{
+  return syscall2 (SYS_WAKE, addr, n);
+}
+
+bool
+memstat (bool user_pool, struct memstat *stats)
+{
+  return syscall2 (SYS_MEMSTAT, (int) user_pool, stats);
+}
+
+/* Writes out buffered output, so that the child does not write
+   it again, then duplicates the process. */
+pid_t
+fork (void)
+{
+  hflush_all ();
+  return syscall0 (SYS_FORK);
+}
+
+void
+msync (mapid_t mapid)
+{
+  syscall1 (SYS_MSYNC, mapid);
+}
+
+bool
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+int
+getdents (int fd, char *buffer, unsigned size)
+{
+  return syscall3 (SYS_GETDENTS, fd, buffer, size);
+}
+
+bool
+fallocate (int fd, unsigned offset, unsigned length)
+{
+  return syscall3 (SYS_FALLOCATE, fd, offset, length);
+}
+
+bool
+blockstat (unsigned idx, struct blockstat *stats)
+{
+  return syscall2 (SYS_BLOCKSTAT, idx, stats);
+}
+
+bool
+ioring_setup (struct ioring *ring)
+{
+  return syscall1 (SYS_IORING_SETUP, ring);
+}
+
+int
+ioring_enter (unsigned n)
+{
+  return syscall1 (SYS_IORING_ENTER, n);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
+
+/* Where a thread_spawn() thread starts: the kernel calls it with
+   ARG, and ENTRY is the word above, left there by
+   thread_spawn(). */
+static void
+spawn_start (void *arg, void (*entry) (void *))
+{
+  entry (arg);
+  exit (0);
+}
+
+/* Starts a thread in this process that runs ENTRY (ARG) on the
+   stack whose top is STACK, and exits with status 0 if ENTRY
+   returns.  The thread shares the process's memory and open
+   files; wait() for its id returns its exit status. */
+pid_t
+thread_spawn (void (*entry) (void *), void *arg, void *stack)
+{
+  void (**top) (void *) = stack;
+
+  *--top = entry;
+  return syscall3 (SYS_THREAD_SPAWN, spawn_start, arg, top);
+}
+
+int
+poll (struct pollfd *fds, unsigned nfds, int timeout)
+{
+  return syscall3 (SYS_POLL, fds, nfds, timeout);
+}
+
+int
+fcntl (int fd, int cmd, int arg)
+{
+  return syscall3 (SYS_FCNTL, fd, cmd, arg);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+bool
+intrstat (unsigned vec, struct intrstat *stats)
+{
+  return syscall2 (SYS_INTRSTAT, vec, stats);
+}
+
+int
+trace_read (struct trace_record *records, unsigned cnt)
+{
+  return syscall2 (SYS_TRACE_READ, records, cnt);
+}
+
+int
+stats (struct sysstat *stats, size_t size)
+{
+  return syscall2 (SYS_STATS, stats, size);
+}
+
+int
+wait_rusage (pid_t pid, struct rusage *rusage)
+{
+  return syscall2 (SYS_WAIT_RUSAGE, pid, rusage);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+bool
+fdatasync (int fd)
+{
+  return syscall1 (SYS_FDATASYNC, fd);
+}
+
+bool
+sched_deadline (unsigned runtime, unsigned deadline, unsigned period)
+{
+  return syscall3 (SYS_SCHED_DEADLINE, runtime, deadline, period);
+}
+
+pid_t
+spawn (const char *cmd_line, const int *fds, unsigned cnt)
+{
+  return (pid_t) syscall3 (SYS_SPAWN, cmd_line, fds, cnt);
+}
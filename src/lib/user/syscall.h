@@ -2,7 +2,19 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <blockstat.h>
 #include <debug.h>
+#include <fcntl.h>
+#include <intrstat.h>
+#include <trace.h>
+#include <ioring.h>
+#include <iovec.h>
+#include <madvise.h>
+#include <memstat.h>
+#include <poll.h>
+#include <rusage.h>
+#include <sysstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +57,38 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int wait_on (int *addr, int expected);
+int wake (int *addr, int n);
+bool memstat (bool user_pool, struct memstat *);
+pid_t fork (void);
+void msync (mapid_t);
+bool madvise (void *addr, unsigned length, int advice);
+void *sbrk (intptr_t increment);
+int getdents (int fd, char *buffer, unsigned size);
+bool fallocate (int fd, unsigned offset, unsigned length);
+bool blockstat (unsigned idx, struct blockstat *);
+bool ioring_setup (struct ioring *);
+int ioring_enter (unsigned n);
+int pread (int fd, void *buffer, unsigned size, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned size, unsigned offset);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+pid_t thread_spawn (void (*entry) (void *), void *arg, void *stack);
+int poll (struct pollfd *, unsigned nfds, int timeout);
+int fcntl (int fd, int cmd, int arg);
+bool pipe (int fds[2]);
+bool intrstat (unsigned vec, struct intrstat *);
+int trace_read (struct trace_record *, unsigned cnt);
+int stats (struct sysstat *, size_t size);
+int wait_rusage (pid_t, struct rusage *);
+bool fsync (int fd);
+bool fdatasync (int fd);
+bool sched_deadline (unsigned runtime, unsigned deadline, unsigned period);
+pid_t spawn (const char *cmd_line, const int *fds, unsigned cnt);
+
+/* Run by _start() before main(). */
+void syscall_init (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,64 @@
+/* Measures allocator throughput: palloc_get_page() and
+   palloc_free_page() of single pages, and malloc() and free() of
+   small and large blocks.  Each round allocates a batch and then
+   frees it, so that the allocators see more than one block in use
+   at a time. */
+
+#include "tests/bench/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "devices/timer.h"
+
+#define ROUND_CNT 100
+#define BATCH 64
+
+static void bench_malloc (const char *name, size_t size);
+
+void
+test_bench_alloc (void)
+{
+  void *pages[BATCH];
+  uint64_t start;
+  int round, i;
+
+  start = timer_cycles ();
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < BATCH; i++)
+        {
+          pages[i] = palloc_get_page (0);
+          if (pages[i] == NULL)
+            fail ("palloc_get_page() failed");
+        }
+      for (i = 0; i < BATCH; i++)
+        palloc_free_page (pages[i]);
+    }
+  bench_report ("palloc-page", timer_cycles () - start, ROUND_CNT * BATCH);
+
+  bench_malloc ("malloc-32", 32);
+  bench_malloc ("malloc-1024", 1024);
+  pass ();
+}
+
+/* Reports the cost of a malloc() and free() of SIZE bytes. */
+static void
+bench_malloc (const char *name, size_t size)
+{
+  void *blocks[BATCH];
+  uint64_t start;
+  int round, i;
+
+  start = timer_cycles ();
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < BATCH; i++)
+        {
+          blocks[i] = malloc (size);
+          if (blocks[i] == NULL)
+            fail ("malloc(%zu) failed", size);
+        }
+      for (i = 0; i < BATCH; i++)
+        free (blocks[i]);
+    }
+  bench_report (name, timer_cycles () - start, ROUND_CNT * BATCH);
+}
@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench::bench;
+check_bench ('palloc-page', 'malloc-32', 'malloc-1024');
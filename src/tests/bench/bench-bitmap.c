@@ -0,0 +1,55 @@
+/* Measures bitmap_scan() for a free bit in a nearly full bitmap,
+   as palloc sees when memory runs low, first plainly and then with
+   a summary added by bitmap_enable_summary(). */
+
+#include <bitmap.h>
+#include <random.h>
+#include "tests/bench/tests.h"
+#include "devices/timer.h"
+
+#define BIT_CNT 16384
+#define SCAN_CNT 2000
+
+static void bench_scan (const char *name, struct bitmap *);
+
+void
+test_bench_bitmap (void)
+{
+  struct bitmap *plain = bitmap_create (BIT_CNT);
+  struct bitmap *summarized = bitmap_create (BIT_CNT);
+
+  if (plain == NULL || summarized == NULL
+      || !bitmap_enable_summary (summarized))
+    fail ("out of memory");
+
+  bench_scan ("bitmap-scan", plain);
+  bench_scan ("bitmap-scan-summary", summarized);
+  bitmap_destroy (plain);
+  bitmap_destroy (summarized);
+  pass ();
+}
+
+/* Reports the cost of finding the one clear bit in B, at a random
+   position each time. */
+static void
+bench_scan (const char *name, struct bitmap *b)
+{
+  uint64_t cycles = 0;
+  int i;
+
+  bitmap_set_all (b, true);
+  random_init (0);
+  for (i = 0; i < SCAN_CNT; i++)
+    {
+      size_t idx = random_ulong () % BIT_CNT;
+      uint64_t start;
+
+      bitmap_reset (b, idx);
+      start = timer_cycles ();
+      if (bitmap_scan (b, 0, 1, false) != idx)
+        fail ("scan did not find bit %zu", idx);
+      cycles += timer_cycles () - start;
+      bitmap_mark (b, idx);
+    }
+  bench_report (name, cycles, SCAN_CNT);
+}
@@ -0,0 +1,69 @@
+/* Measures hash_insert() into a growing table and hash_find() of
+   keys present in it. */
+
+#include <hash.h>
+#include "tests/bench/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+#define ITEM_CNT 4096
+#define FIND_ROUNDS 4
+
+struct item
+  {
+    struct hash_elem elem;
+    int key;
+  };
+
+static hash_hash_func item_hash;
+static hash_less_func item_less;
+
+void
+test_bench_hash (void)
+{
+  struct item *items = malloc (ITEM_CNT * sizeof *items);
+  struct hash h;
+  uint64_t start;
+  int round, i;
+
+  if (items == NULL || !hash_init (&h, item_hash, item_less, NULL))
+    fail ("out of memory");
+  for (i = 0; i < ITEM_CNT; i++)
+    items[i].key = i * 7919;
+
+  start = timer_cycles ();
+  for (i = 0; i < ITEM_CNT; i++)
+    hash_insert (&h, &items[i].elem);
+  bench_report ("hash-insert", timer_cycles () - start, ITEM_CNT);
+
+  start = timer_cycles ();
+  for (round = 0; round < FIND_ROUNDS; round++)
+    for (i = 0; i < ITEM_CNT; i++)
+      {
+        struct item key;
+
+        key.key = items[i].key;
+        if (hash_find (&h, &key.elem) != &items[i].elem)
+          fail ("key %d not found", key.key);
+      }
+  bench_report ("hash-find", timer_cycles () - start,
+                FIND_ROUNDS * ITEM_CNT);
+
+  hash_destroy (&h, NULL);
+  free (items);
+  pass ();
+}
+
+static unsigned
+item_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct item, elem)->key);
+}
+
+static bool
+item_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return (hash_entry (a, struct item, elem)->key
+          < hash_entry (b, struct item, elem)->key);
+}
@@ -0,0 +1,26 @@
+/* Measures an uncontended lock_acquire() and lock_release() round
+   trip. */
+
+#include "tests/bench/tests.h"
+#include "threads/synch.h"
+#include "devices/timer.h"
+
+#define LOCK_CNT 100000
+
+void
+test_bench_lock (void)
+{
+  struct lock lock;
+  uint64_t start;
+  int i;
+
+  lock_init (&lock);
+  start = timer_cycles ();
+  for (i = 0; i < LOCK_CNT; i++)
+    {
+      lock_acquire (&lock);
+      lock_release (&lock);
+    }
+  bench_report ("lock", timer_cycles () - start, LOCK_CNT);
+  pass ();
+}
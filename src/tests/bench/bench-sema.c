@@ -0,0 +1,53 @@
+/* Measures a semaphore ping-pong: the main thread ups one
+   semaphore and downs another, and a second thread of the same
+   priority does the reverse, so that each round trip blocks and
+   wakes each thread once. */
+
+#include "tests/bench/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define ROUND_CNT 10000
+
+struct ping_pong
+  {
+    struct semaphore ping;
+    struct semaphore pong;
+  };
+
+static void ponger (void *pp_);
+
+void
+test_bench_sema (void)
+{
+  struct ping_pong pp;
+  uint64_t start;
+  int i;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  thread_create ("ponger", thread_get_priority (), ponger, &pp);
+
+  start = timer_cycles ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  bench_report ("sema-ping-pong", timer_cycles () - start, ROUND_CNT);
+  pass ();
+}
+
+static void
+ponger (void *pp_)
+{
+  struct ping_pong *pp = pp_;
+  int i;
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+}
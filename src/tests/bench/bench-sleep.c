@@ -0,0 +1,38 @@
+/* Measures timer_sleep() wakeup jitter: sleeps one tick at a time
+   and reports the mean time between wakeups, which should be one
+   tick's worth of cycles, and the spread between the shortest and
+   longest. */
+
+#include <inttypes.h>
+#include "tests/bench/tests.h"
+#include "devices/timer.h"
+
+#define SLEEP_CNT 100
+
+void
+test_bench_sleep (void)
+{
+  uint64_t min = UINT64_MAX, max = 0;
+  uint64_t start, prev;
+  int i;
+
+  /* Start just after a tick. */
+  timer_sleep (1);
+  start = prev = timer_cycles ();
+  for (i = 0; i < SLEEP_CNT; i++)
+    {
+      uint64_t now, interval;
+
+      timer_sleep (1);
+      now = timer_cycles ();
+      interval = now - prev;
+      if (interval < min)
+        min = interval;
+      if (interval > max)
+        max = interval;
+      prev = now;
+    }
+  bench_report ("sleep-tick", prev - start, SLEEP_CNT);
+  msg ("bench sleep-jitter %"PRIu64" cycles %d ops", max - min, SLEEP_CNT);
+  pass ();
+}
@@ -0,0 +1,43 @@
+/* Measures the cost of a context switch: two threads of the same
+   priority each call thread_yield() in a loop, so that every
+   yield switches to the other. */
+
+#include "tests/bench/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define YIELD_CNT 10000
+
+static void yielder (void *done_);
+
+void
+test_bench_switch (void)
+{
+  struct semaphore done;
+  uint64_t start;
+  int i;
+
+  sema_init (&done, 0);
+  thread_create ("yielder", thread_get_priority (), yielder, &done);
+
+  /* Let the yielder start, then time both loops together. */
+  thread_yield ();
+  start = timer_cycles ();
+  for (i = 0; i < YIELD_CNT; i++)
+    thread_yield ();
+  sema_down (&done);
+  bench_report ("switch", timer_cycles () - start, 2 * YIELD_CNT);
+  pass ();
+}
+
+static void
+yielder (void *done_)
+{
+  struct semaphore *done = done_;
+  int i;
+
+  for (i = 0; i < YIELD_CNT; i++)
+    thread_yield ();
+  sema_up (done);
+}
@@ -0,0 +1,26 @@
+# Checks that benchmark $test ran to completion and reported each of
+# the results named in @names, in lines of the form
+# "(TEST) bench NAME VALUE UNIT OPS ops", where UNIT is, say,
+# "cycles/op" or "kB/s".  The results themselves stay in
+# $test.output.
+sub check_bench {
+    my (@names) = @_;
+    our ($test);
+
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    fail "missing end in output\n" if !grep (/^\(\S+\) end$/, @output);
+
+    my (%results);
+    foreach (@output) {
+	my ($name, $value) = /^\(\S+\) bench (\S+) (\d+) \S+ \d+ ops$/
+	  or next;
+	$results{$name} = $value;
+    }
+    foreach my $name (@names) {
+	fail "no result for \"$name\"\n" if !defined $results{$name};
+    }
+    pass;
+}
+
+1;
@@ -0,0 +1,93 @@
+#include "tests/bench/tests.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+
+struct test
+  {
+    const char *name;
+    test_func *function;
+  };
+
+static const struct test tests[] =
+  {
+    {"bench-switch", test_bench_switch},
+    {"bench-lock", test_bench_lock},
+    {"bench-sema", test_bench_sema},
+    {"bench-sleep", test_bench_sleep},
+    {"bench-alloc", test_bench_alloc},
+    {"bench-hash", test_bench_hash},
+    {"bench-bitmap", test_bench_bitmap},
+  };
+
+static const char *test_name;
+
+/* Runs the benchmark named NAME. */
+void
+run_test (const char *name)
+{
+  const struct test *t;
+
+  for (t = tests; t < tests + sizeof tests / sizeof *tests; t++)
+    if (!strcmp (name, t->name))
+      {
+        test_name = name;
+        msg ("begin");
+        t->function ();
+        msg ("end");
+        return;
+      }
+  PANIC ("no test named \"%s\"", name);
+}
+
+/* Prints FORMAT as if with printf(),
+   prefixing the output by the name of the test
+   and following it with a new-line character. */
+void
+msg (const char *format, ...)
+{
+  va_list args;
+
+  printf ("(%s) ", test_name);
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+  putchar ('\n');
+}
+
+/* Prints failure message FORMAT as if with printf(),
+   prefixing the output by the name of the test and FAIL:
+   and following it with a new-line character,
+   and then panics the kernel. */
+void
+fail (const char *format, ...)
+{
+  va_list args;
+
+  printf ("(%s) FAIL: ", test_name);
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+  putchar ('\n');
+
+  PANIC ("test failed");
+}
+
+/* Prints a message indicating the current test passed. */
+void
+pass (void)
+{
+  printf ("(%s) PASS\n", test_name);
+}
+
+/* Reports that OPS operations of the kind called NAME took CYCLES
+   CPU cycles in all, as a line of the form
+   "(TEST) bench NAME CYCLES-PER-OP cycles/op OPS ops" that
+   tests/bench/bench.pm, or a script, can pick out. */
+void
+bench_report (const char *name, uint64_t cycles, unsigned ops)
+{
+  ASSERT (ops > 0);
+  msg ("bench %s %"PRIu64" cycles/op %u ops", name, cycles / ops, ops);
+}
@@ -0,0 +1,24 @@
+#ifndef TESTS_BENCH_TESTS_H
+#define TESTS_BENCH_TESTS_H
+
+#include <stdint.h>
+
+void run_test (const char *);
+
+typedef void test_func (void);
+
+extern test_func test_bench_switch;
+extern test_func test_bench_lock;
+extern test_func test_bench_sema;
+extern test_func test_bench_sleep;
+extern test_func test_bench_alloc;
+extern test_func test_bench_hash;
+extern test_func test_bench_bitmap;
+
+void msg (const char *, ...);
+void fail (const char *, ...);
+void pass (void);
+
+void bench_report (const char *name, uint64_t cycles, unsigned ops);
+
+#endif /* tests/bench/tests.h */
@@ -0,0 +1,28 @@
+/* Calls fsync() and fdatasync() on descriptors that are not open
+   files: the console, a closed descriptor, a descriptor out of
+   range and a pipe.  Each call must return false. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fds[2];
+  int fd;
+
+  CHECK (!fsync (STDOUT_FILENO), "fsync stdout");
+  CHECK (!fdatasync (STDIN_FILENO), "fdatasync stdin");
+  CHECK (create ("deadbeef", 0), "create \"deadbeef\"");
+  CHECK ((fd = open ("deadbeef")) > 1, "open \"deadbeef\"");
+  msg ("close \"deadbeef\"");
+  close (fd);
+  CHECK (!fsync (fd), "fsync closed fd");
+  CHECK (!fdatasync (fd), "fdatasync closed fd");
+  CHECK (!fsync (-1), "fsync fd -1");
+  CHECK (!fsync (0x12345678), "fsync fd 0x12345678");
+  CHECK (pipe (fds), "pipe");
+  CHECK (!fsync (fds[1]), "fsync pipe");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-bad-fd) begin
+(fsync-bad-fd) fsync stdout
+(fsync-bad-fd) fdatasync stdin
+(fsync-bad-fd) create "deadbeef"
+(fsync-bad-fd) open "deadbeef"
+(fsync-bad-fd) close "deadbeef"
+(fsync-bad-fd) fsync closed fd
+(fsync-bad-fd) fdatasync closed fd
+(fsync-bad-fd) fsync fd -1
+(fsync-bad-fd) fsync fd 0x12345678
+(fsync-bad-fd) pipe
+(fsync-bad-fd) fsync pipe
+(fsync-bad-fd) end
+EOF
+pass;
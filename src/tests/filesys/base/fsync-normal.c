@@ -0,0 +1,31 @@
+/* Writes a file in two parts, flushing it with fsync() after
+   the first and fdatasync() after the second.  Both must succeed
+   and leave the contents as written. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5678];
+
+void
+test_main (void) 
+{
+  const char *file_name = "deadbeef";
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, 5000) == 5000, "write 5000 bytes");
+  CHECK (fsync (fd), "fsync \"%s\"", file_name);
+  CHECK (write (fd, buf + 5000, sizeof buf - 5000) == sizeof buf - 5000,
+         "write %zu more bytes", sizeof buf - 5000);
+  CHECK (fdatasync (fd), "fdatasync \"%s\"", file_name);
+  CHECK (fsync (fd), "fsync \"%s\" with nothing to write", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
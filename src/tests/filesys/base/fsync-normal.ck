@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-normal) begin
+(fsync-normal) create "deadbeef"
+(fsync-normal) open "deadbeef"
+(fsync-normal) write 5000 bytes
+(fsync-normal) fsync "deadbeef"
+(fsync-normal) write 678 more bytes
+(fsync-normal) fdatasync "deadbeef"
+(fsync-normal) fsync "deadbeef" with nothing to write
+(fsync-normal) close "deadbeef"
+(fsync-normal) open "deadbeef" for verification
+(fsync-normal) verified contents of "deadbeef"
+(fsync-normal) close "deadbeef"
+(fsync-normal) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Times creating, looking up and removing many files in one
+   directory, so that the directory grows large. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+#define FILE_CNT 200
+
+static const char dir_name[] = "meta";
+
+static void file_name (char *name, size_t size, int i);
+
+void
+test_main (void)
+{
+  char name[32];
+  uint64_t start;
+  int i;
+
+  bench_init ();
+  CHECK (mkdir (dir_name), "mkdir \"%s\"", dir_name);
+
+  start = bench_cycles ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, sizeof name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  bench_ops ("create", bench_cycles () - start, FILE_CNT);
+
+  /* Look the files up in an order unlike the one they were made in. */
+  start = bench_cycles ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      file_name (name, sizeof name, i * 7 % FILE_CNT);
+      fd = open (name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", name);
+      close (fd);
+    }
+  bench_ops ("lookup", bench_cycles () - start, FILE_CNT);
+
+  start = bench_cycles ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, sizeof name, i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  bench_ops ("remove", bench_cycles () - start, FILE_CNT);
+
+  CHECK (remove (dir_name), "remove \"%s\"", dir_name);
+}
+
+/* Stores the name of file I in the directory in NAME. */
+static void
+file_name (char *name, size_t size, int i)
+{
+  snprintf (name, size, "%s/file%d", dir_name, i);
+}
@@ -0,0 +1,57 @@
+/* Times writing and then reading small blocks at random offsets in
+   a large file. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+#define FILE_SIZE (512 * 1024)
+#define BLOCK_SIZE 512
+#define OP_CNT 1024
+
+static const char file_name[] = "random";
+static char buf[BLOCK_SIZE];
+
+static void random_io (const char *name, int fd, bool writing);
+
+void
+test_main (void)
+{
+  int fd;
+
+  bench_init ();
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  random_io ("rand-write", fd, true);
+  random_io ("rand-read", fd, false);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
+
+/* Writes, if WRITING, or reads OP_CNT blocks at random block
+   offsets in FD, and reports the rate as NAME. */
+static void
+random_io (const char *name, int fd, bool writing)
+{
+  uint64_t start = bench_cycles ();
+  int i;
+
+  for (i = 0; i < OP_CNT; i++)
+    {
+      unsigned ofs = random_ulong () % (FILE_SIZE / BLOCK_SIZE) * BLOCK_SIZE;
+      int n = (writing
+               ? pwrite (fd, buf, BLOCK_SIZE, ofs)
+               : pread (fd, buf, BLOCK_SIZE, ofs));
+
+      if (n != BLOCK_SIZE)
+        fail ("%s of %d bytes at offset %u failed",
+              writing ? "write" : "read", BLOCK_SIZE, ofs);
+    }
+  bench_rate (name, bench_cycles () - start,
+              (unsigned long long) OP_CNT * BLOCK_SIZE, OP_CNT);
+}
@@ -0,0 +1,45 @@
+/* Times 1, 2, 4 and 8 child processes reading the same file at
+   once, like syn-read, and reports the total rate for each count,
+   to show how reads scale with concurrent readers. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+#include "tests/filesys/bench/readers.h"
+
+#define MAX_READERS 8
+
+static char buf[BLOCK_SIZE];
+
+void
+test_main (void)
+{
+  pid_t children[MAX_READERS];
+  size_t cnt, ofs;
+  int fd;
+
+  bench_init ();
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("write %d bytes at offset %zu failed", BLOCK_SIZE, ofs);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  for (cnt = 1; cnt <= MAX_READERS; cnt *= 2)
+    {
+      uint64_t start = bench_cycles ();
+      char name[16];
+
+      exec_children ("child-bench-read", children, cnt);
+      wait_children (children, cnt);
+      snprintf (name, sizeof name, "readers-%zu", cnt);
+      bench_rate (name, bench_cycles () - start,
+                  (unsigned long long) cnt * READ_PASSES * FILE_SIZE, cnt);
+    }
+}
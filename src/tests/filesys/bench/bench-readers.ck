@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::bench::bench;
+check_bench ('readers-1', 'readers-2', 'readers-4', 'readers-8');
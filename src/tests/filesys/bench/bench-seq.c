@@ -0,0 +1,45 @@
+/* Times writing a large file in order, a block at a time, then
+   reading it back the same way. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/bench/bench.h"
+
+#define FILE_SIZE (512 * 1024)
+#define BLOCK_SIZE 4096
+
+static const char file_name[] = "seq";
+static char buf[BLOCK_SIZE];
+
+void
+test_main (void)
+{
+  uint64_t start;
+  size_t ofs;
+  int fd;
+
+  bench_init ();
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  start = bench_cycles ();
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("write %d bytes at offset %zu failed", BLOCK_SIZE, ofs);
+  bench_rate ("seq-write", bench_cycles () - start, FILE_SIZE,
+              FILE_SIZE / BLOCK_SIZE);
+
+  seek (fd, 0);
+  start = bench_cycles ();
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    if (read (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("read %d bytes at offset %zu failed", BLOCK_SIZE, ofs);
+  bench_rate ("seq-read", bench_cycles () - start, FILE_SIZE,
+              FILE_SIZE / BLOCK_SIZE);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
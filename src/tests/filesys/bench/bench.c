@@ -0,0 +1,63 @@
+#include "tests/filesys/bench/bench.h"
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Timer ticks to time the cycle counter against. */
+#define CALIBRATE_TICKS 10
+
+/* Cycles per second, as measured by bench_init(). */
+static uint64_t cycles_per_sec;
+
+/* Returns the kernel's timer tick count, and the timer's frequency
+   in *FREQ. */
+static long long
+get_ticks (int *freq)
+{
+  struct sysstat s;
+
+  if (stats (&s, sizeof s) != sizeof s)
+    fail ("stats failed");
+  *freq = s.timer_freq;
+  return s.ticks;
+}
+
+/* Measures how fast the cycle counter runs, by spinning for
+   CALIBRATE_TICKS timer ticks. */
+void
+bench_init (void)
+{
+  long long start_tick;
+  uint64_t start;
+  int freq;
+
+  start_tick = get_ticks (&freq) + 1;
+  while (get_ticks (&freq) < start_tick)
+    continue;
+  start = bench_cycles ();
+  while (get_ticks (&freq) < start_tick + CALIBRATE_TICKS)
+    continue;
+  cycles_per_sec = (bench_cycles () - start) * freq / CALIBRATE_TICKS;
+}
+
+/* Reports that OPS operations called NAME moved BYTES bytes in
+   CYCLES cycles, as a rate in kB/s. */
+void
+bench_rate (const char *name, uint64_t cycles, unsigned long long bytes,
+            unsigned ops)
+{
+  if (cycles == 0)
+    cycles = 1;
+  msg ("bench %s %llu kB/s %u ops",
+       name, bytes * cycles_per_sec / 1024 / cycles, ops);
+}
+
+/* Reports that OPS operations called NAME took CYCLES cycles, as a
+   rate in operations per second. */
+void
+bench_ops (const char *name, uint64_t cycles, unsigned ops)
+{
+  if (cycles == 0)
+    cycles = 1;
+  msg ("bench %s %llu ops/s %u ops",
+       name, (unsigned long long) ops * cycles_per_sec / cycles, ops);
+}
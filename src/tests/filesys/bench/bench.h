@@ -0,0 +1,25 @@
+#ifndef TESTS_FILESYS_BENCH_BENCH_H
+#define TESTS_FILESYS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+/* Timing for the file system benchmarks.  These are not run by
+   "make check" unless tests/filesys/bench is added to
+   TEST_SUBDIRS, e.g. "make check TEST_SUBDIRS=tests/filesys/bench",
+   since their results are rates, not pass or fail. */
+
+/* Returns the CPU's time stamp counter. */
+static inline uint64_t
+bench_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+void bench_init (void);
+void bench_rate (const char *name, uint64_t cycles,
+                 unsigned long long bytes, unsigned ops);
+void bench_ops (const char *name, uint64_t cycles, unsigned ops);
+
+#endif /* tests/filesys/bench/bench.h */
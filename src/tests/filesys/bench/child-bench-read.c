@@ -0,0 +1,36 @@
+/* Child process for bench-readers.
+   Reads the whole test file READ_PASSES times over, a block at a
+   time, and exits with its index. */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/bench/readers.h"
+
+static char buf[BLOCK_SIZE];
+
+int
+main (int argc, const char *argv[])
+{
+  int child_idx;
+  int pass, fd;
+  size_t ofs;
+
+  test_name = "child-bench-read";
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (pass = 0; pass < READ_PASSES; pass++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+        CHECK (read (fd, buf, BLOCK_SIZE) == BLOCK_SIZE,
+               "read \"%s\"", file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_BENCH_READERS_H
+#define TESTS_FILESYS_BENCH_READERS_H
+
+#define FILE_SIZE (256 * 1024)
+#define BLOCK_SIZE 4096
+#define READ_PASSES 4
+static const char file_name[] = "readers";
+
+#endif /* tests/filesys/bench/readers.h */
@@ -0,0 +1,29 @@
+/* Passes getdents() arguments it must refuse: a regular file, a
+   buffer too small for the longest name, a descriptor that is not
+   open, and finally a buffer in kernel memory, which must
+   terminate the process with exit code -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[READDIR_MAX_LEN + 2];
+  int fd;
+
+  CHECK (create ("f", 0), "create \"f\"");
+  CHECK ((fd = open ("f")) > 1, "open \"f\"");
+  CHECK (getdents (fd, buf, sizeof buf) == -1, "getdents on a file");
+  msg ("close \"f\"");
+  close (fd);
+  CHECK (getdents (fd, buf, sizeof buf) == -1, "getdents on a closed fd");
+
+  CHECK ((fd = open ("/")) > 1, "open \"/\"");
+  CHECK (getdents (fd, buf, READDIR_MAX_LEN) == -1,
+         "getdents with a short buffer");
+  msg ("getdents into kernel memory");
+  getdents (fd, (char *) 0xc0000000, sizeof buf);
+  fail ("should have exited with -1");
+}
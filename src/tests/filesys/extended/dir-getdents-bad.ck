@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-getdents-bad) begin
+(dir-getdents-bad) create "f"
+(dir-getdents-bad) open "f"
+(dir-getdents-bad) getdents on a file
+(dir-getdents-bad) close "f"
+(dir-getdents-bad) getdents on a closed fd
+(dir-getdents-bad) open "/"
+(dir-getdents-bad) getdents with a short buffer
+(dir-getdents-bad) getdents into kernel memory
+dir-getdents-bad: exit(-1)
+EOF
+pass;
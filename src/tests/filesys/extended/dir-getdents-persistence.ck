@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"d" => {"alpha-file" => [''], "beta-file" => [''],
+                        "gamma-dir" => {}}});
+pass;
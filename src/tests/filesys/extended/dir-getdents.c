@@ -0,0 +1,52 @@
+/* Lists a directory with getdents(), through a buffer that holds
+   only one of its names at a time.  Every entry but "." and ".."
+   must come back exactly once, and then getdents() must return 0. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char *names[] = {"alpha-file", "beta-file", "gamma-dir"};
+#define NAME_CNT (sizeof names / sizeof *names)
+
+void
+test_main (void) 
+{
+  char buf[READDIR_MAX_LEN + 2];
+  int seen[NAME_CNT] = {0};
+  int fd, byte_cnt, call_cnt = 0;
+  size_t i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (create ("d/alpha-file", 0), "create \"d/alpha-file\"");
+  CHECK (create ("d/beta-file", 0), "create \"d/beta-file\"");
+  CHECK (mkdir ("d/gamma-dir"), "mkdir \"d/gamma-dir\"");
+  CHECK ((fd = open ("d")) > 1, "open \"d\"");
+
+  while ((byte_cnt = getdents (fd, buf, sizeof buf)) > 0)
+    {
+      char *name;
+
+      if (buf[byte_cnt - 1] != '\0')
+        fail ("getdents() returned an unterminated name");
+      for (name = buf; name < buf + byte_cnt; name += strlen (name) + 1)
+        {
+          for (i = 0; i < NAME_CNT; i++)
+            if (!strcmp (name, names[i]))
+              break;
+          if (i == NAME_CNT)
+            fail ("getdents() returned unexpected name \"%s\"", name);
+          if (seen[i]++)
+            fail ("getdents() returned \"%s\" twice", name);
+        }
+      call_cnt++;
+    }
+  if (byte_cnt < 0)
+    fail ("getdents() returned %d", byte_cnt);
+  for (i = 0; i < NAME_CNT; i++)
+    if (!seen[i])
+      fail ("getdents() did not return \"%s\"", names[i]);
+  msg ("getdents returned every name once in %d calls", call_cnt);
+  CHECK (getdents (fd, buf, sizeof buf) == 0, "getdents at end of \"d\"");
+}
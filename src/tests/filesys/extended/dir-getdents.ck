@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "d"
+(dir-getdents) create "d/alpha-file"
+(dir-getdents) create "d/beta-file"
+(dir-getdents) mkdir "d/gamma-dir"
+(dir-getdents) open "d"
+(dir-getdents) getdents returned every name once in 3 calls
+(dir-getdents) getdents at end of "d"
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Passes fallocate() arguments it must refuse: the console, a
+   closed descriptor, a directory, a pipe, an offset past INT32_MAX
+   and a range whose end overflows.  Each call must return false
+   and leave the file it names unchanged. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fds[2];
+  int fd;
+
+  CHECK (!fallocate (STDOUT_FILENO, 0, 512), "fallocate stdout");
+  CHECK (create ("blargle", 0), "create \"blargle\"");
+  CHECK ((fd = open ("blargle")) > 1, "open \"blargle\"");
+  CHECK (!fallocate (fd, 0x80000000, 512), "fallocate past INT32_MAX");
+  CHECK (!fallocate (fd, 512, 0x7fffffff), "fallocate overflowing range");
+  CHECK (filesize (fd) == 0, "filesize still 0");
+  msg ("close \"blargle\"");
+  close (fd);
+  CHECK (!fallocate (fd, 0, 512), "fallocate closed fd");
+
+  CHECK ((fd = open ("/")) > 1, "open \"/\"");
+  CHECK (!fallocate (fd, 0, 512), "fallocate directory");
+  CHECK (pipe (fds), "pipe");
+  CHECK (!fallocate (fds[1], 0, 512), "fallocate pipe");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fallocate-bad) begin
+(grow-fallocate-bad) fallocate stdout
+(grow-fallocate-bad) create "blargle"
+(grow-fallocate-bad) open "blargle"
+(grow-fallocate-bad) fallocate past INT32_MAX
+(grow-fallocate-bad) fallocate overflowing range
+(grow-fallocate-bad) filesize still 0
+(grow-fallocate-bad) close "blargle"
+(grow-fallocate-bad) fallocate closed fd
+(grow-fallocate-bad) open "/"
+(grow-fallocate-bad) fallocate directory
+(grow-fallocate-bad) pipe
+(grow-fallocate-bad) fallocate pipe
+(grow-fallocate-bad) end
+EOF
+pass;
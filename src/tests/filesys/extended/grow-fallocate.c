@@ -0,0 +1,28 @@
+/* Grows an empty file with fallocate() to cover a range past its
+   end.  The file must grow to the end of the range and read back
+   as zeros, without its position moving, and allocating a range
+   inside it must leave its size alone. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char zeros[6000];
+
+void
+test_main (void) 
+{
+  const char *file_name = "blargle";
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fallocate (fd, 1000, 5000), "fallocate 5000 bytes at 1000");
+  CHECK (filesize (fd) == 6000, "filesize is 6000");
+  CHECK (tell (fd) == 0, "position unchanged");
+  CHECK (fallocate (fd, 0, 100), "fallocate 100 bytes at 0");
+  CHECK (filesize (fd) == 6000, "filesize still 6000");
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, zeros, sizeof zeros);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fallocate) begin
+(grow-fallocate) create "blargle"
+(grow-fallocate) open "blargle"
+(grow-fallocate) fallocate 5000 bytes at 1000
+(grow-fallocate) filesize is 6000
+(grow-fallocate) position unchanged
+(grow-fallocate) fallocate 100 bytes at 0
+(grow-fallocate) filesize still 6000
+(grow-fallocate) close "blargle"
+(grow-fallocate) open "blargle" for verification
+(grow-fallocate) verified contents of "blargle"
+(grow-fallocate) close "blargle"
+(grow-fallocate) end
+EOF
+pass;
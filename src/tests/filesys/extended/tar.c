@@ -1,6 +1,12 @@
 /* tar.c
 
-   Creates a tar archive. */
+   Creates a tar archive.
+
+   Headers and padding are built in place in an output buffer of
+   BUF_SIZE bytes, which is written to the archive only when it
+   fills up or a file body follows, and file bodies go from file to
+   archive with copy_file_range(), without passing through user
+   memory at all. */
 
 #include <ustar.h>
 #include <syscall.h>
@@ -45,10 +51,19 @@ static bool write_header (const char *file_name, enum ustar_type, int size,
 
 static bool do_write (int fd, const char *buffer, int size, bool *write_error);
 
+/* Bytes collected before a write to the archive. */
+#define BUF_SIZE (16 * 1024)
+
+static char out_buf[BUF_SIZE];
+static int out_len;
+
+static char *out_reserve (int size, int archive_fd, bool *write_error);
+static bool out_zeros (int size, int archive_fd, bool *write_error);
+static bool out_flush (int archive_fd, bool *write_error);
+
 static bool
 make_tar_archive (const char *archive_name, char *files[], size_t file_cnt) 
 {
-  static const char zeros[512];
   int archive_fd;
   bool success = true;
   bool write_error = false;
@@ -76,8 +91,8 @@ make_tar_archive (const char *archive_name, char *files[], size_t file_cnt)
         success = false;
     }
 
-  if (!do_write (archive_fd, zeros, 512, &write_error)
-      || !do_write (archive_fd, zeros, 512, &write_error)) 
+  if (!out_zeros (2 * USTAR_HEADER_SIZE, archive_fd, &write_error)
+      || !out_flush (archive_fd, &write_error))
     success = false;
 
   close (archive_fd);
@@ -124,35 +139,35 @@ static bool
 archive_ordinary_file (const char *file_name, int file_fd,
                        int archive_fd, bool *write_error)
 {
-  bool read_error = false;
   bool success = true;
   int file_size = filesize (file_fd);
+  int copied = 0;
 
   if (!write_header (file_name, USTAR_REGULAR, file_size,
-                     archive_fd, write_error))
+                     archive_fd, write_error)
+      || !out_flush (archive_fd, write_error))
     return false;
 
-  while (file_size > 0) 
+  while (copied < file_size)
     {
-      static char buf[512];
-      int chunk_size = file_size > 512 ? 512 : file_size;
-      int read_retval = read (file_fd, buf, chunk_size);
-      int bytes_read = read_retval > 0 ? read_retval : 0;
+      int retval = copy_file_range (file_fd, archive_fd, file_size - copied);
 
-      if (bytes_read != chunk_size && !read_error) 
+      if (retval <= 0)
         {
           printf ("%s: read error\n", file_name);
-          read_error = true;
           success = false;
+          break;
         }
-
-      memset (buf + bytes_read, 0, 512 - bytes_read);
-      if (!do_write (archive_fd, buf, 512, write_error))
-        success = false;
-
-      file_size -= chunk_size;
+      copied += retval;
     }
 
+  /* Zero-fill what could not be read, then pad to a whole block. */
+  if (!out_zeros (file_size - copied
+                  + (USTAR_HEADER_SIZE - file_size % USTAR_HEADER_SIZE)
+                    % USTAR_HEADER_SIZE,
+                  archive_fd, write_error))
+    success = false;
+
   return success;
 }
 
@@ -186,9 +201,56 @@ static bool
 write_header (const char *file_name, enum ustar_type type, int size,
               int archive_fd, bool *write_error) 
 {
-  static char header[512];
-  return (ustar_make_header (file_name, type, size, header)
-          && do_write (archive_fd, header, 512, write_error));
+  char *header = out_reserve (USTAR_HEADER_SIZE, archive_fd, write_error);
+
+  if (header == NULL || !ustar_make_header (file_name, type, size, header))
+    {
+      out_len -= header != NULL ? USTAR_HEADER_SIZE : 0;
+      return false;
+    }
+  return true;
+}
+
+/* Makes room for SIZE bytes, at most BUF_SIZE, at the end of the
+   output buffer, writing it out first if it is too full, and
+   returns them.  Returns a null pointer on a write error. */
+static char *
+out_reserve (int size, int archive_fd, bool *write_error)
+{
+  char *p;
+
+  if (out_len + size > BUF_SIZE && !out_flush (archive_fd, write_error))
+    return NULL;
+  p = out_buf + out_len;
+  out_len += size;
+  return p;
+}
+
+/* Appends SIZE zero bytes to the output buffer. */
+static bool
+out_zeros (int size, int archive_fd, bool *write_error)
+{
+  while (size > 0)
+    {
+      int chunk = size < BUF_SIZE ? size : BUF_SIZE;
+      char *p = out_reserve (chunk, archive_fd, write_error);
+
+      if (p == NULL)
+        return false;
+      memset (p, 0, chunk);
+      size -= chunk;
+    }
+  return true;
+}
+
+/* Writes the output buffer to the archive and empties it. */
+static bool
+out_flush (int archive_fd, bool *write_error)
+{
+  int len = out_len;
+
+  out_len = 0;
+  return len == 0 || do_write (archive_fd, out_buf, len, write_error);
 }
 
 static bool
@@ -0,0 +1,59 @@
+/* Sleeps until ticks that begin a new round of the timing wheel
+   that holds sleeping threads, both exactly and by way of timer
+   slack rounding, and checks that each sleep wakes on time.  Such
+   sleepers are moved into the near wheel in the very tick they are
+   due. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Ticks per round of the near wheel, SLEEP_NEAR_SIZE in
+   threads/thread.c. */
+#define ROUND 256
+
+static void sleep_until (int64_t target, int64_t slack);
+
+void
+test_alarm_round (void) 
+{
+  int64_t base;
+  int i;
+
+  thread_set_timer_slack (0);
+
+  /* Wake at the start of the next few rounds, the later ones from
+     a far slot of the wheel. */
+  for (i = 1; i <= 3; i++)
+    {
+      base = timer_ticks ();
+      sleep_until ((base / ROUND + i) * ROUND, 0);
+      msg ("woke at the start of round %d ahead", i);
+    }
+
+  /* A sleep of a whole number of seconds whose slack rounds it to
+     the start of a round. */
+  thread_set_timer_slack (ROUND - 1);
+  base = timer_ticks ();
+  sleep_until (base + TIMER_FREQ, ROUND - 1);
+  msg ("woke within slack after one second");
+  thread_set_timer_slack (0);
+
+  pass ();
+}
+
+/* Sleeps until tick TARGET and fails unless it wakes no later
+   than SLACK ticks after it. */
+static void
+sleep_until (int64_t target, int64_t slack)
+{
+  int64_t woke;
+
+  timer_sleep (target - timer_ticks ());
+  woke = timer_ticks ();
+  if (woke < target)
+    fail ("woke at tick %lld, before tick %lld", woke, target);
+  if (woke > target + slack + 1)
+    fail ("woke at tick %lld, long after tick %lld", woke, target);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-round) begin
+(alarm-round) woke at the start of round 1 ahead
+(alarm-round) woke at the start of round 2 ahead
+(alarm-round) woke at the start of round 3 ahead
+(alarm-round) woke within slack after one second
+(alarm-round) PASS
+(alarm-round) end
+EOF
+pass;
@@ -0,0 +1,15 @@
+/* Passes blockstat a buffer in kernel memory.  The process must
+   be terminated with exit code -1. */
+
+#include <blockstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  msg ("blockstat into kernel memory");
+  blockstat (0, (struct blockstat *) 0xc0000000);
+  fail ("should have exited with -1");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(blockstat-bad) begin
+(blockstat-bad) blockstat into kernel memory
+blockstat-bad: exit(-1)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Reads the I/O statistics of every block device, checking that
+   each is consistent and that the file system device has been
+   read from. */
+
+#include <blockstat.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct blockstat st;
+  bool found_filesys = false;
+  unsigned idx;
+
+  for (idx = 0; blockstat (idx, &st); idx++) 
+    {
+      unsigned long long latency_sum = 0, depth_sum = 0;
+      int i;
+
+      for (i = 0; i < BLOCKSTAT_LATENCY_BUCKETS; i++)
+        latency_sum += st.latency[i];
+      for (i = 0; i < BLOCKSTAT_DEPTH_BUCKETS; i++)
+        depth_sum += st.depth[i];
+      if (latency_sum != st.request_cnt)
+        fail ("%s: %llu requests but %llu latencies", st.name,
+              st.request_cnt, latency_sum);
+      if (depth_sum < st.request_cnt)
+        fail ("%s: %llu requests but %llu started", st.name,
+              st.request_cnt, depth_sum);
+      if (st.request_cnt > st.read_cnt + st.write_cnt)
+        fail ("%s: %llu requests for %llu sectors", st.name,
+              st.request_cnt, st.read_cnt + st.write_cnt);
+      if (!strcmp (st.role, "filesys") && st.read_cnt > 0)
+        found_filesys = true;
+    }
+  CHECK (idx > 0, "blockstat found devices");
+  CHECK (found_filesys, "file system device has been read");
+  CHECK (!blockstat (idx + 100, &st), "blockstat past the last device");
+}
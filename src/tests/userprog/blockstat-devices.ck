@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(blockstat-devices) begin
+(blockstat-devices) blockstat found devices
+(blockstat-devices) file system device has been read
+(blockstat-devices) blockstat past the last device
+(blockstat-devices) end
+blockstat-devices: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Copies a file onto itself with copy_file_range(), first through
+   two descriptors whose ranges overlap, then through one descriptor
+   used as both ends.  The overlapping copy must move the data as
+   memmove() would, and a descriptor used as both ends must advance
+   only once. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char expected[sizeof sample - 1];
+  int a, b;
+
+  CHECK (create ("test.txt", sizeof sample - 1), "create \"test.txt\"");
+  CHECK ((a = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (write (a, sample, sizeof sample - 1) == sizeof sample - 1,
+         "write \"test.txt\"");
+  CHECK ((b = open ("test.txt")) > 1, "open \"test.txt\" again");
+
+  seek (a, 0);
+  seek (b, 10);
+  CHECK (copy_file_range (a, b, 50) == 50, "copy 50 bytes 10 bytes up");
+  CHECK (tell (a) == 50 && tell (b) == 60, "both positions advanced");
+
+  seek (a, 0);
+  CHECK (copy_file_range (a, a, 20) == 20, "copy 20 bytes onto themselves");
+  CHECK (tell (a) == 20, "position advanced once");
+
+  msg ("close \"test.txt\" twice");
+  close (a);
+  close (b);
+  memcpy (expected, sample, sizeof expected);
+  memmove (expected + 10, sample, 50);
+  check_file ("test.txt", expected, sizeof expected);
+}
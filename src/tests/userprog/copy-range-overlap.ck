@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range-overlap) begin
+(copy-range-overlap) create "test.txt"
+(copy-range-overlap) open "test.txt"
+(copy-range-overlap) write "test.txt"
+(copy-range-overlap) open "test.txt" again
+(copy-range-overlap) copy 50 bytes 10 bytes up
+(copy-range-overlap) both positions advanced
+(copy-range-overlap) copy 20 bytes onto themselves
+(copy-range-overlap) position advanced once
+(copy-range-overlap) close "test.txt" twice
+(copy-range-overlap) open "test.txt" for verification
+(copy-range-overlap) verified contents of "test.txt"
+(copy-range-overlap) close "test.txt"
+(copy-range-overlap) end
+copy-range-overlap: exit(0)
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Copies the tail of sample.txt into a new file with
+   copy_file_range(), asking for more than is left.  The copy must
+   stop at the end of the input and advance both file positions by
+   what it copied. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int in, out, byte_cnt;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((out = open ("test.txt")) > 1, "open \"test.txt\"");
+  seek (in, 200);
+  byte_cnt = copy_file_range (in, out, 100);
+  if (byte_cnt != (int) sizeof sample - 1 - 200)
+    fail ("copy_file_range() returned %d instead of %zu", byte_cnt,
+          sizeof sample - 1 - 200);
+  msg ("copy clamped at end of file");
+  CHECK (tell (in) == sizeof sample - 1, "input position at end of file");
+  CHECK (tell (out) == sizeof sample - 1 - 200, "output position advanced");
+  CHECK (copy_file_range (in, out, 100) == 0, "copy at end of file");
+  msg ("close \"test.txt\"");
+  close (out);
+  check_file ("test.txt", sample + 200, sizeof sample - 1 - 200);
+}
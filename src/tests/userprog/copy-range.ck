@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range) begin
+(copy-range) open "sample.txt"
+(copy-range) create "test.txt"
+(copy-range) open "test.txt"
+(copy-range) copy clamped at end of file
+(copy-range) input position at end of file
+(copy-range) output position advanced
+(copy-range) copy at end of file
+(copy-range) close "test.txt"
+(copy-range) open "test.txt" for verification
+(copy-range) verified contents of "test.txt"
+(copy-range) close "test.txt"
+(copy-range) end
+copy-range: exit(0)
+EOF
+pass;
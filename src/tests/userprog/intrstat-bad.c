@@ -0,0 +1,15 @@
+/* Passes intrstat a buffer in kernel memory.  The process must be
+   terminated with exit code -1. */
+
+#include <intrstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  msg ("intrstat into kernel memory");
+  intrstat (0x30, (struct intrstat *) 0xc0000000);
+  fail ("should have exited with -1");
+}
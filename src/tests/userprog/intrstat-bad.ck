@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(intrstat-bad) begin
+(intrstat-bad) intrstat into kernel memory
+intrstat-bad: exit(-1)
+EOF
+pass;
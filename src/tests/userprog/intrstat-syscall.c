@@ -0,0 +1,22 @@
+/* Reads the statistics of the system call vector twice and checks
+   that the first call was counted. */
+
+#include <intrstat.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct intrstat before, after;
+
+  CHECK (intrstat (0x30, &before), "intrstat 0x30");
+  CHECK (!strcmp (before.name, "syscall"), "vector 0x30 is \"syscall\"");
+  CHECK (intrstat (0x30, &after), "intrstat 0x30 again");
+  CHECK (after.count > before.count, "system call was counted");
+  CHECK (after.cycles > before.cycles, "its cycles were counted");
+  CHECK (after.max_cycles <= after.cycles, "longest within total");
+  CHECK (!intrstat (256, &after), "intrstat 256");
+}
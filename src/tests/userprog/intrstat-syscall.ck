@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(intrstat-syscall) begin
+(intrstat-syscall) intrstat 0x30
+(intrstat-syscall) vector 0x30 is "syscall"
+(intrstat-syscall) intrstat 0x30 again
+(intrstat-syscall) system call was counted
+(intrstat-syscall) its cycles were counted
+(intrstat-syscall) longest within total
+(intrstat-syscall) intrstat 256
+(intrstat-syscall) end
+intrstat-syscall: exit(0)
+EOF
+pass;
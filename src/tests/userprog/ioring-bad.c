@@ -0,0 +1,47 @@
+/* Passes the I/O ring calls arguments they must refuse: entering
+   with no ring registered, a ring in kernel memory, an unknown
+   operation and a read into kernel memory, each of which must fail
+   without killing the process.  Finally registers a ring whose
+   submission array is in kernel memory, which must terminate the
+   process with exit code -1 when entered. */
+
+#include <ioring.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRIES 2
+
+static struct ioring_sqe sq[ENTRIES];
+static struct ioring_cqe cq[ENTRIES];
+static struct ioring ring = {ENTRIES, 0, 0, 0, 0, sq, cq};
+
+void
+test_main (void) 
+{
+  CHECK (ioring_enter (1) == -1, "ioring_enter with no ring");
+  CHECK (!ioring_setup ((struct ioring *) 0xc0000000),
+         "ioring_setup in kernel memory");
+  CHECK (ioring_setup (&ring), "ioring_setup");
+
+  sq[0].op = 99;
+  sq[0].user_data = 1;
+  sq[1].op = IORING_READ;
+  sq[1].fd = 0;
+  sq[1].buffer = (void *) 0xc0000000;
+  sq[1].size = 1;
+  sq[1].user_data = 2;
+  ring.sq_tail = 2;
+  CHECK (ioring_enter (ENTRIES) == 2, "ioring_enter 2 bad operations");
+  CHECK (cq[0].user_data == 1 && cq[0].result == -1,
+         "unknown operation failed");
+  CHECK (cq[1].user_data == 2 && cq[1].result == -1,
+         "read into kernel memory failed");
+  ring.cq_head = 2;
+
+  ring.sq = (struct ioring_sqe *) 0xc0000000;
+  ring.sq_tail++;
+  msg ("ioring_enter with submissions in kernel memory");
+  ioring_enter (1);
+  fail ("should have exited with -1");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ioring-bad) begin
+(ioring-bad) ioring_enter with no ring
+(ioring-bad) ioring_setup in kernel memory
+(ioring-bad) ioring_setup
+(ioring-bad) ioring_enter 2 bad operations
+(ioring-bad) unknown operation failed
+(ioring-bad) read into kernel memory failed
+(ioring-bad) ioring_enter with submissions in kernel memory
+ioring-bad: exit(-1)
+EOF
+pass;
@@ -0,0 +1,73 @@
+/* Writes a file, seeks back and reads it again through an I/O
+   ring, all in one ioring_enter(), then checks that ioring_enter()
+   does no more operations than it is asked to. */
+
+#include <ioring.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRIES 4
+
+static struct ioring_sqe sq[ENTRIES];
+static struct ioring_cqe cq[ENTRIES];
+static struct ioring ring = {ENTRIES, 0, 0, 0, 0, sq, cq};
+
+/* Queues operation OP on FD, tagged with USER_DATA. */
+static void
+submit (int op, int fd, void *buffer, unsigned size, unsigned user_data)
+{
+  struct ioring_sqe *sqe = &sq[ring.sq_tail % ENTRIES];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buffer = buffer;
+  sqe->size = size;
+  sqe->user_data = user_data;
+  ring.sq_tail++;
+}
+
+/* Takes the next completion, which must be tagged USER_DATA, and
+   returns its result. */
+static int
+complete (unsigned user_data)
+{
+  struct ioring_cqe *cqe;
+
+  if (ring.cq_head == ring.cq_tail)
+    fail ("no completion for operation %u", user_data);
+  cqe = &cq[ring.cq_head++ % ENTRIES];
+  if (cqe->user_data != user_data)
+    fail ("completion for operation %u, not %u", cqe->user_data,
+          user_data);
+  return cqe->result;
+}
+
+void
+test_main (void) 
+{
+  char buf[6] = "";
+  int fd;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((fd = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (ioring_setup (&ring), "ioring_setup");
+
+  submit (IORING_WRITE, fd, "hello", 5, 1);
+  submit (IORING_SEEK, fd, NULL, 0, 2);
+  submit (IORING_READ, fd, buf, 5, 3);
+  CHECK (ioring_enter (ENTRIES) == 3, "ioring_enter 3 operations");
+  CHECK (complete (1) == 5, "write completed");
+  CHECK (complete (2) == 0, "seek completed");
+  CHECK (complete (3) == 5, "read completed");
+  CHECK (!strcmp (buf, "hello"), "read back \"hello\"");
+
+  submit (IORING_SEEK, fd, NULL, 1, 4);
+  submit (IORING_SEEK, fd, NULL, 2, 5);
+  CHECK (ioring_enter (1) == 1, "ioring_enter 1 of 2 operations");
+  CHECK (tell (fd) == 1 && complete (4) == 0, "first seek done");
+  CHECK (ioring_enter (ENTRIES) == 1, "ioring_enter the rest");
+  CHECK (tell (fd) == 2 && complete (5) == 0, "second seek done");
+  CHECK (ioring_enter (ENTRIES) == 0, "ioring_enter with nothing queued");
+}
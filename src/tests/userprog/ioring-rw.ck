@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ioring-rw) begin
+(ioring-rw) create "test.txt"
+(ioring-rw) open "test.txt"
+(ioring-rw) ioring_setup
+(ioring-rw) ioring_enter 3 operations
+(ioring-rw) write completed
+(ioring-rw) seek completed
+(ioring-rw) read completed
+(ioring-rw) read back "hello"
+(ioring-rw) ioring_enter 1 of 2 operations
+(ioring-rw) first seek done
+(ioring-rw) ioring_enter the rest
+(ioring-rw) second seek done
+(ioring-rw) ioring_enter with nothing queued
+(ioring-rw) end
+ioring-rw: exit(0)
+EOF
+pass;
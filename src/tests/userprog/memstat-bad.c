@@ -0,0 +1,15 @@
+/* Passes memstat a buffer in kernel memory.  The process must be
+   terminated with exit code -1. */
+
+#include <memstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  msg ("memstat into kernel memory");
+  memstat (true, (struct memstat *) 0xc0000000);
+  fail ("should have exited with -1");
+}
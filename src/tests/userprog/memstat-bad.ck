@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(memstat-bad) begin
+(memstat-bad) memstat into kernel memory
+memstat-bad: exit(-1)
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Reads the page allocator statistics of both pools and checks
+   that they are consistent. */
+
+#include <memstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Checks the statistics of the pool named NAME. */
+static void
+check_pool (const char *name, bool user)
+{
+  struct memstat st;
+
+  CHECK (memstat (user, &st), "memstat %s pool", name);
+  if (st.total == 0)
+    fail ("%s pool has no pages", name);
+  if (st.free > st.total)
+    fail ("%s pool has %zu of %zu pages free", name, st.free, st.total);
+  if (st.largest_free > st.free)
+    fail ("%s pool's largest free block %zu exceeds %zu free pages",
+          name, st.largest_free, st.free);
+  if (st.peak_used < st.total - st.free || st.peak_used > st.total)
+    fail ("%s pool's peak use %zu is not between %zu and %zu", name,
+          st.peak_used, st.total - st.free, st.total);
+}
+
+void
+test_main (void) 
+{
+  check_pool ("user", true);
+  check_pool ("kernel", false);
+}
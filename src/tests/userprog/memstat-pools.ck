@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(memstat-pools) begin
+(memstat-pools) memstat user pool
+(memstat-pools) memstat kernel pool
+(memstat-pools) end
+memstat-pools: exit(0)
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Passes poll() and fcntl() arguments they must refuse or flag:
+   too many descriptors, a closed descriptor, an unknown fcntl()
+   command, and finally a pollfd array in kernel memory, which
+   must terminate the process with exit code -1. */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd pfds[2];
+  int fd;
+
+  CHECK (poll (pfds, 0x10000000, 0) == -1, "poll too many descriptors");
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((fd = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (fcntl (fd, 12345, 0) == -1, "fcntl unknown command");
+  msg ("close \"test.txt\"");
+  close (fd);
+  CHECK (fcntl (fd, F_GETFL, 0) == -1, "fcntl closed fd");
+
+  pfds[0].fd = fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = -1;
+  pfds[1].events = POLLIN;
+  CHECK (poll (pfds, 2, 0) == 1, "poll closed fd and fd -1");
+  CHECK (pfds[0].revents == POLLNVAL && pfds[1].revents == 0,
+         "closed fd flagged, fd -1 ignored");
+
+  msg ("poll kernel memory");
+  poll ((struct pollfd *) 0xc0000000, 1, 0);
+  fail ("should have exited with -1");
+}
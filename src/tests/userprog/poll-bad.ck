@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-bad) begin
+(poll-bad) poll too many descriptors
+(poll-bad) create "test.txt"
+(poll-bad) open "test.txt"
+(poll-bad) fcntl unknown command
+(poll-bad) close "test.txt"
+(poll-bad) fcntl closed fd
+(poll-bad) poll closed fd and fd -1
+(poll-bad) closed fd flagged, fd -1 ignored
+(poll-bad) poll kernel memory
+poll-bad: exit(-1)
+EOF
+pass;
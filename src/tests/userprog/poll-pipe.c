@@ -0,0 +1,42 @@
+/* Polls the two ends of a pipe before and after writing to it,
+   and times out polling an empty pipe.  Then sets O_NONBLOCK on
+   the console with fcntl(), so that reading it with no input
+   returns -1 rather than waiting. */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd pfds[2];
+  int fds[2];
+  char c;
+
+  CHECK (pipe (fds), "pipe");
+  pfds[0].fd = fds[0];
+  pfds[0].events = POLLIN;
+  pfds[1].fd = fds[1];
+  pfds[1].events = POLLOUT;
+  CHECK (poll (pfds, 2, 0) == 1, "poll empty pipe");
+  CHECK (pfds[0].revents == 0 && pfds[1].revents == POLLOUT,
+         "only the writing end is ready");
+  CHECK (write (fds[1], "x", 1) == 1, "write 1 byte");
+  CHECK (poll (pfds, 2, 0) == 2, "poll pipe with a byte in it");
+  CHECK (pfds[0].revents == POLLIN, "reading end is ready");
+  CHECK (read (fds[0], &c, 1) == 1 && c == 'x', "read the byte back");
+  CHECK (poll (pfds, 1, 50) == 0, "poll empty pipe times out");
+
+  CHECK (fcntl (STDIN_FILENO, F_GETFL, 0) == 0, "stdin is blocking");
+  CHECK (fcntl (STDIN_FILENO, F_SETFL, O_NONBLOCK) == 0,
+         "set O_NONBLOCK on stdin");
+  CHECK (fcntl (STDIN_FILENO, F_GETFL, 0) == O_NONBLOCK,
+         "stdin is non-blocking");
+  CHECK (read (STDIN_FILENO, &c, 1) == -1, "read stdin with no input");
+  CHECK (fcntl (STDIN_FILENO, F_SETFL, 0) == 0, "clear O_NONBLOCK");
+  CHECK (fcntl (STDIN_FILENO, F_GETFL, 0) == 0, "stdin is blocking again");
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-pipe) begin
+(poll-pipe) pipe
+(poll-pipe) poll empty pipe
+(poll-pipe) only the writing end is ready
+(poll-pipe) write 1 byte
+(poll-pipe) poll pipe with a byte in it
+(poll-pipe) reading end is ready
+(poll-pipe) read the byte back
+(poll-pipe) poll empty pipe times out
+(poll-pipe) stdin is blocking
+(poll-pipe) set O_NONBLOCK on stdin
+(poll-pipe) stdin is non-blocking
+(poll-pipe) read stdin with no input
+(poll-pipe) clear O_NONBLOCK
+(poll-pipe) stdin is blocking again
+(poll-pipe) end
+poll-pipe: exit(0)
+EOF
+pass;
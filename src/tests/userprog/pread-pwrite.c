@@ -0,0 +1,46 @@
+/* Reads and writes files with pread() and pwrite() at explicit
+   offsets.  Neither may move the file position, and a read that
+   reaches the end of the file must stop there. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  /* test.txt from position 4 on, after the pwrite(). */
+  static const char expected[12] = {0, 0, 0, 0, 0, 0, 'a', 'b', 'c'};
+  char buf[64];
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  byte_cnt = pread (handle, buf, 20, 100);
+  if (byte_cnt != 20)
+    fail ("pread() returned %d instead of 20", byte_cnt);
+  compare_bytes (buf, sample + 100, 20, 100, "sample.txt");
+  msg ("pread 20 bytes at offset 100");
+  CHECK (tell (handle) == 0, "file position unchanged");
+  byte_cnt = pread (handle, buf, sizeof buf, 230);
+  if (byte_cnt != (int) sizeof sample - 1 - 230)
+    fail ("pread() returned %d instead of %zu", byte_cnt,
+          sizeof sample - 1 - 230);
+  compare_bytes (buf, sample + 230, byte_cnt, 230, "sample.txt");
+  msg ("short pread at end of file");
+  CHECK (pread (handle, buf, sizeof buf, sizeof sample - 1) == 0,
+         "pread at end of file");
+  msg ("close \"sample.txt\"");
+  close (handle);
+
+  CHECK (create ("test.txt", 4 + sizeof expected), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  seek (handle, 4);
+  CHECK (pwrite (handle, "abc", 3, 10) == 3, "pwrite 3 bytes at offset 10");
+  CHECK (tell (handle) == 4, "file position unchanged");
+  byte_cnt = read (handle, buf, sizeof buf);
+  if (byte_cnt != (int) sizeof expected)
+    fail ("read() returned %d instead of %zu", byte_cnt, sizeof expected);
+  compare_bytes (buf, expected, sizeof expected, 4, "test.txt");
+  msg ("read back from position 4");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) open "sample.txt"
+(pread-pwrite) pread 20 bytes at offset 100
+(pread-pwrite) file position unchanged
+(pread-pwrite) short pread at end of file
+(pread-pwrite) pread at end of file
+(pread-pwrite) close "sample.txt"
+(pread-pwrite) create "test.txt"
+(pread-pwrite) open "test.txt"
+(pread-pwrite) pwrite 3 bytes at offset 10
+(pread-pwrite) file position unchanged
+(pread-pwrite) read back from position 4
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Writes a few bytes into a pipe and closes its only writing end.
+   Reading must return the bytes, then 0 for end of file rather
+   than waiting for more. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char data[] = "pipe data";
+  char buf[32];
+  int fds[2];
+  int byte_cnt;
+
+  CHECK (pipe (fds), "pipe");
+  CHECK (write (fds[1], data, sizeof data) == (int) sizeof data,
+         "write %zu bytes", sizeof data);
+  msg ("close writing end");
+  close (fds[1]);
+
+  byte_cnt = read (fds[0], buf, sizeof buf);
+  if (byte_cnt != (int) sizeof data)
+    fail ("read() returned %d instead of %zu", byte_cnt, sizeof data);
+  if (memcmp (buf, data, sizeof data))
+    fail ("read() returned bad data");
+  msg ("read %d bytes", byte_cnt);
+
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "read at end of file");
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "read at end of file again");
+}
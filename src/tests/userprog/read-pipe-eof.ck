@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(read-pipe-eof) begin
+(read-pipe-eof) pipe
+(read-pipe-eof) write 10 bytes
+(read-pipe-eof) close writing end
+(read-pipe-eof) read 10 bytes
+(read-pipe-eof) read at end of file
+(read-pipe-eof) read at end of file again
+(read-pipe-eof) end
+read-pipe-eof: exit(0)
+EOF
+pass;
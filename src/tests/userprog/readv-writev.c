@@ -0,0 +1,44 @@
+/* Writes a file with writev() and reads it back with readv(),
+   splitting the data differently each time.  Both must move the
+   file position past what they transferred, and readv() must stop
+   at the end of the file. */
+
+#include <iovec.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  struct iovec iov[3];
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", 100), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = sample + 10;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sample + 10;
+  iov[2].iov_len = 90;
+  CHECK (writev (handle, iov, 3) == 100, "writev 100 bytes in 3 buffers");
+  CHECK (tell (handle) == 100, "file position at 100");
+
+  seek (handle, 0);
+  memset (buf, 0, sizeof buf);
+  iov[0].iov_base = buf;
+  iov[0].iov_len = 60;
+  iov[1].iov_base = buf + 60;
+  iov[1].iov_len = 60;
+  byte_cnt = readv (handle, iov, 2);
+  if (byte_cnt != 100)
+    fail ("readv() returned %d instead of 100", byte_cnt);
+  compare_bytes (buf, sample, 100, 0, "test.txt");
+  msg ("short readv at end of file");
+  CHECK (tell (handle) == 100, "file position at 100");
+  CHECK (readv (handle, iov, 2) == 0, "readv at end of file");
+}
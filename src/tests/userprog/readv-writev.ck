@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "test.txt"
+(readv-writev) open "test.txt"
+(readv-writev) writev 100 bytes in 3 buffers
+(readv-writev) file position at 100
+(readv-writev) short readv at end of file
+(readv-writev) file position at 100
+(readv-writev) readv at end of file
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
@@ -0,0 +1,13 @@
+/* Invokes a system call with a number past the last one.  The
+   process must be terminated with -1 exit code. */
+
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  asm volatile ("pushl %0; int $0x30" : : "i" (SYS_CNT));
+  fail ("should have called exit(-1)");
+}
@@ -0,0 +1,21 @@
+/* Passes sched_deadline inconsistent times and more bandwidth than
+   may be reserved, which must all be refused, then invokes it with
+   its arguments above the top of the user address space.  The
+   process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (!sched_deadline (60, 50, 100), "runtime past deadline");
+  CHECK (!sched_deadline (10, 150, 100), "deadline past period");
+  CHECK (!sched_deadline (100, 100, 100), "whole CPU");
+  msg ("sched_deadline with arguments in kernel memory");
+  asm volatile ("movl $0xbffffffc, %%esp; movl %0, (%%esp); int $0x30"
+                : : "i" (SYS_SCHED_DEADLINE));
+  fail ("should have called exit(-1)");
+}
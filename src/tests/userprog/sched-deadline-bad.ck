@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-deadline-bad) begin
+(sched-deadline-bad) runtime past deadline
+(sched-deadline-bad) deadline past period
+(sched-deadline-bad) whole CPU
+(sched-deadline-bad) sched_deadline with arguments in kernel memory
+sched-deadline-bad: exit(-1)
+EOF
+pass;
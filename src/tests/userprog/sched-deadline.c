@@ -0,0 +1,22 @@
+/* Moves the process into the deadline scheduling class, changes
+   its reservation while there, does some work, and leaves the
+   class again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  volatile int i;
+
+  CHECK (sched_deadline (10, 50, 100), "sched_deadline 10/50/100 ms");
+  CHECK (sched_deadline (50, 100, 100), "sched_deadline 50/100/100 ms");
+  for (i = 0; i < 1000000; i++)
+    continue;
+  msg ("work done");
+  CHECK (sched_deadline (0, 0, 0), "leave the deadline class");
+  CHECK (sched_deadline (90, 100, 100), "sched_deadline 90/100/100 ms");
+  CHECK (sched_deadline (0, 0, 0), "leave the deadline class again");
+}
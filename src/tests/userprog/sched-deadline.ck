@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-deadline) begin
+(sched-deadline) sched_deadline 10/50/100 ms
+(sched-deadline) sched_deadline 50/100/100 ms
+(sched-deadline) work done
+(sched-deadline) leave the deadline class
+(sched-deadline) sched_deadline 90/100/100 ms
+(sched-deadline) leave the deadline class again
+(sched-deadline) end
+sched-deadline: exit(0)
+EOF
+pass;
@@ -0,0 +1,18 @@
+/* Spawns a nonexistent program, then an existing one with a
+   descriptor that is not open.  spawn() does not wait for the
+   child to load, so the first child must exit with -1 for wait()
+   to return, and the second spawn() must return -1 itself. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const int bad_fd = 100;
+
+  msg ("wait(spawn(\"no-such-file\")) = %d",
+       wait (spawn ("no-such-file", NULL, 0)));
+  msg ("spawn() with a bad fd = %d", spawn ("child-simple", &bad_fd, 1));
+}
@@ -0,0 +1,11 @@
+/* Starts a subprocess with spawn() and waits for it to finish. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  msg ("wait(spawn()) = %d", wait (spawn ("child-simple", NULL, 0)));
+}
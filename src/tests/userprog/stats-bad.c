@@ -0,0 +1,15 @@
+/* Passes stats a buffer in kernel memory.  The process must be
+   terminated with exit code -1. */
+
+#include <syscall.h>
+#include <sysstat.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  msg ("stats into kernel memory");
+  stats ((struct sysstat *) 0xc0000000, sizeof (struct sysstat));
+  fail ("should have exited with -1");
+}
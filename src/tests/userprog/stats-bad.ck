@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stats-bad) begin
+(stats-bad) stats into kernel memory
+stats-bad: exit(-1)
+EOF
+pass;
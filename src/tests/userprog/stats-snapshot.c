@@ -0,0 +1,30 @@
+/* Takes a snapshot of the system-wide counters, checks that it is
+   consistent, and checks that a short buffer gets only the
+   leading fields. */
+
+#include <string.h>
+#include <syscall.h>
+#include <sysstat.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct sysstat st;
+
+  CHECK (stats (&st, sizeof st + 16) == sizeof st, "stats");
+  CHECK (st.user_free <= st.user_pages && st.kernel_free <= st.kernel_pages,
+         "free pages within pools");
+  CHECK (st.swap_used <= st.swap_slots, "used swap within swap");
+  CHECK (st.major_faults + st.minor_faults <= st.page_faults,
+         "resolved faults within faults");
+  CHECK (st.sectors_read > 0, "reads counted while loading");
+  CHECK (st.ticks > 0 && st.timer_freq > 0, "time counted");
+
+  memset (&st, 0xcc, sizeof st);
+  CHECK (stats (&st, sizeof st.user_pages) == sizeof st.user_pages,
+         "stats of the first field");
+  CHECK (st.user_pages != 0xcccccccc && st.user_free == 0xcccccccc,
+         "only the first field copied");
+}
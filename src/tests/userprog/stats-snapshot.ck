@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stats-snapshot) begin
+(stats-snapshot) stats
+(stats-snapshot) free pages within pools
+(stats-snapshot) used swap within swap
+(stats-snapshot) resolved faults within faults
+(stats-snapshot) reads counted while loading
+(stats-snapshot) time counted
+(stats-snapshot) stats of the first field
+(stats-snapshot) only the first field copied
+(stats-snapshot) end
+stats-snapshot: exit(0)
+EOF
+pass;
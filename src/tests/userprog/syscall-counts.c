@@ -0,0 +1,31 @@
+/* Forks a child that makes a known set of system calls, then
+   checks that wait_rusage() reports exactly those calls, counted
+   by system call number. */
+
+#include <rusage.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct rusage ru;
+  pid_t pid;
+
+  pid = fork ();
+  if (pid == 0) 
+    {
+      remove ("no-such-file");
+      remove ("no-such-file");
+      remove ("no-such-file");
+      exit (0);
+    }
+  CHECK (pid > 0, "fork");
+  CHECK (wait_rusage (pid, &ru) == 0, "wait_rusage");
+  CHECK (ru.syscalls[SYS_REMOVE] == 3, "child's 3 remove() calls counted");
+  CHECK (ru.syscalls[SYS_EXIT] == 1, "child's exit() call counted");
+  CHECK (ru.syscalls[SYS_WRITE] == 0 && ru.syscalls[SYS_FORK] == 0,
+         "parent's calls not counted");
+}
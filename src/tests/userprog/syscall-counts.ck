@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(syscall-counts) begin
+(syscall-counts) fork
+(syscall-counts) wait_rusage
+(syscall-counts) child's 3 remove() calls counted
+(syscall-counts) child's exit() call counted
+(syscall-counts) parent's calls not counted
+(syscall-counts) end
+syscall-counts: exit(0)
+EOF
+pass;
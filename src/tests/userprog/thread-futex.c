@@ -0,0 +1,50 @@
+/* Passes a turn back and forth between two threads of a process
+   ROUNDS times, each waiting with wait_on() for the other to take
+   its turn and wake it.  The turn is in a page of BSS that neither
+   thread has touched before, so that the first waiter may find it
+   mapped to the shared zero page and the first write move it to a
+   frame of its own. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STACK_SIZE 4096
+#define ROUNDS 50
+
+static char stack[STACK_SIZE] __attribute__ ((aligned (16)));
+static int turn;
+
+/* Takes the odd turns. */
+static void
+partner (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      while (turn != 2 * i + 1)
+        wait_on (&turn, 2 * i);
+      turn = 2 * i + 2;
+      wake (&turn, 1);
+    }
+}
+
+void
+test_main (void)
+{
+  pid_t tid;
+  int i;
+
+  CHECK ((tid = thread_spawn (partner, NULL, stack + STACK_SIZE))
+         != PID_ERROR, "thread_spawn");
+  for (i = 0; i < ROUNDS; i++)
+    {
+      turn = 2 * i + 1;
+      wake (&turn, 1);
+      while (turn != 2 * i + 2)
+        wait_on (&turn, 2 * i + 1);
+    }
+  msg ("passed the turn %d times", ROUNDS);
+  CHECK (wait (tid) == 0, "join partner");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-futex) begin
+(thread-futex) thread_spawn
+(thread-futex) passed the turn 50 times
+(thread-futex) join partner
+(thread-futex) end
+thread-futex: exit(0)
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Starts a thread in the process that writes a result to memory
+   the two share, and joins it with wait(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STACK_SIZE 4096
+
+static char stack[STACK_SIZE] __attribute__ ((aligned (16)));
+static int result;
+
+static void
+worker (void *arg)
+{
+  result = (int) arg * 2;
+}
+
+void
+test_main (void)
+{
+  pid_t tid;
+
+  CHECK ((tid = thread_spawn (worker, (void *) 21, stack + STACK_SIZE))
+         != PID_ERROR, "thread_spawn");
+  CHECK (wait (tid) == 0, "join thread");
+  if (result != 42)
+    fail ("thread's result is %d instead of 42", result);
+  msg ("thread computed 42");
+}
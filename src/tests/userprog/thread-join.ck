@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-join) begin
+(thread-join) thread_spawn
+(thread-join) join thread
+(thread-join) thread computed 42
+(thread-join) end
+thread-join: exit(0)
+EOF
+pass;
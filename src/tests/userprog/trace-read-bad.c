@@ -0,0 +1,20 @@
+/* Asks trace_read for more records than fit in memory, which must
+   fail, then passes it a buffer in kernel memory.  The process
+   must be terminated with exit code -1. */
+
+#include <syscall.h>
+#include <trace.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct trace_record record;
+
+  CHECK (trace_read (&record, 0x7fffffff) == -1,
+         "trace_read too many records");
+  msg ("trace_read into kernel memory");
+  trace_read ((struct trace_record *) 0xc0000000, 1);
+  fail ("should have exited with -1");
+}
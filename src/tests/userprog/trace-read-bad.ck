@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(trace-read-bad) begin
+(trace-read-bad) trace_read too many records
+(trace-read-bad) trace_read into kernel memory
+trace-read-bad: exit(-1)
+EOF
+pass;
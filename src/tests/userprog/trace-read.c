@@ -0,0 +1,36 @@
+/* Reads the most recent kernel trace records, which -trace turns
+   on, and checks that they are in order and end with this
+   process's trace_read call. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include <trace.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RECORD_CNT 8
+
+void
+test_main (void) 
+{
+  struct trace_record records[RECORD_CNT];
+  int n, i, last_syscall = -1;
+
+  CHECK (trace_read (records, 0) == 0, "trace_read 0 records");
+  n = trace_read (records, RECORD_CNT);
+  CHECK (n > 0 && n <= RECORD_CNT, "trace_read %d records", RECORD_CNT);
+  for (i = 0; i < n; i++) 
+    {
+      if (i > 0 && records[i].seq <= records[i - 1].seq)
+        fail ("record %u follows record %u", records[i].seq,
+              records[i - 1].seq);
+      if (records[i].type >= TRACE_TYPE_CNT)
+        fail ("record %u has bad type %u", records[i].seq,
+              records[i].type);
+      if (records[i].type == TRACE_SYSCALL)
+        last_syscall = i;
+    }
+  CHECK (last_syscall >= 0
+         && records[last_syscall].arg[0] == SYS_TRACE_READ,
+         "last system call traced is trace_read");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(trace-read) begin
+(trace-read) trace_read 0 records
+(trace-read) trace_read 8 records
+(trace-read) last system call traced is trace_read
+(trace-read) end
+trace-read: exit(0)
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Waits for a subprocess with wait_rusage(), which must report the
+   child's exit status and the resources it used, then checks that
+   the wait was consumed: the child cannot be waited for again by
+   either wait_rusage() or wait(). */
+
+#include <rusage.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct rusage ru;
+  pid_t pid;
+
+  pid = exec ("child-simple");
+  msg ("wait_rusage(exec()) = %d", wait_rusage (pid, &ru));
+  CHECK (ru.write_bytes > 0, "child's output counted");
+  CHECK (ru.syscalls[SYS_WRITE] > 0, "child's write() calls counted");
+  CHECK (ru.minor_faults + ru.major_faults > 0,
+         "child's page faults counted");
+  CHECK (ru.peak_rss > 0, "child's resident pages counted");
+  msg ("wait_rusage(pid) again = %d", wait_rusage (pid, &ru));
+  msg ("wait(pid) = %d", wait (pid));
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(wait-rusage) begin
+(child-simple) run
+child-simple: exit(81)
+(wait-rusage) wait_rusage(exec()) = 81
+(wait-rusage) child's output counted
+(wait-rusage) child's write() calls counted
+(wait-rusage) child's page faults counted
+(wait-rusage) child's resident pages counted
+(wait-rusage) wait_rusage(pid) again = -1
+(wait-rusage) wait(pid) = -1
+(wait-rusage) end
+wait-rusage: exit(0)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Checks the basic behavior of wait_on() and wake(): waiting on a
+   word that holds another value returns -1 at once, waking with no
+   waiters wakes no one, and a thread waiting on a word is woken,
+   and counted, by one wake() call. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STACK_SIZE 4096
+
+static char stack[STACK_SIZE] __attribute__ ((aligned (16)));
+static int word;
+
+/* Waits on word while it holds 1 and exits with what wait_on()
+   returned. */
+static void
+waiter (void *aux UNUSED)
+{
+  exit (wait_on (&word, 1));
+}
+
+void
+test_main (void) 
+{
+  pid_t tid;
+  int woken;
+
+  word = 1;
+  CHECK (wait_on (&word, 2) == -1, "wait_on with another value");
+  CHECK (wake (&word, 1) == 0, "wake with no waiters");
+
+  CHECK ((tid = thread_spawn (waiter, NULL, stack + STACK_SIZE))
+         != PID_ERROR, "thread_spawn waiter");
+
+  /* The waiter may not be asleep yet, so keep waking until it
+     is. */
+  while ((woken = wake (&word, 2)) == 0)
+    continue;
+  CHECK (woken == 1, "wake woke one waiter");
+  CHECK (wait (tid) == 0, "waiter's wait_on returned 0");
+}
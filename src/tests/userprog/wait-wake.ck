@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(wait-wake) begin
+(wait-wake) wait_on with another value
+(wait-wake) wake with no waiters
+(wait-wake) thread_spawn waiter
+(wait-wake) wake woke one waiter
+(wait-wake) waiter's wait_on returned 0
+(wait-wake) end
+wait-wake: exit(0)
+EOF
+pass;
@@ -0,0 +1,19 @@
+/* Closes the only reading end of a pipe and writes to it, which
+   must return -1 without waiting. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf = 123;
+  int fds[2];
+
+  CHECK (pipe (fds), "pipe");
+  msg ("close reading end");
+  close (fds[0]);
+  CHECK (write (fds[1], &buf, 1) == -1, "write with no reader");
+  CHECK (write (fds[1], &buf, 0) == 0, "0-byte write with no reader");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(write-pipe-closed) begin
+(write-pipe-closed) pipe
+(write-pipe-closed) close reading end
+(write-pipe-closed) write with no reader
+(write-pipe-closed) 0-byte write with no reader
+(write-pipe-closed) end
+write-pipe-closed: exit(0)
+EOF
+pass;
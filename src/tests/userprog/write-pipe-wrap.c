@@ -0,0 +1,62 @@
+/* Writes several times more than a pipe holds in a single write,
+   starting partway around the pipe's ring, while another thread
+   of the process reads it out in odd-sized pieces.  The reader
+   must get every byte in order. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096 + 100)
+#define OFFSET 100
+#define CHUNK 1000
+#define STACK_SIZE 4096
+
+static char stack[STACK_SIZE] __attribute__ ((aligned (16)));
+static char out[SIZE];
+static char in[SIZE];
+static int fds[2];
+
+/* Reads SIZE bytes from the pipe and checks them against out. */
+static void
+reader (void *aux UNUSED)
+{
+  size_t ofs = 0;
+
+  while (ofs < SIZE)
+    {
+      size_t want = SIZE - ofs < CHUNK ? SIZE - ofs : CHUNK;
+      int byte_cnt = read (fds[0], in + ofs, want);
+
+      if (byte_cnt <= 0)
+        fail ("read() returned %d at offset %zu", byte_cnt, ofs);
+      ofs += byte_cnt;
+    }
+  if (memcmp (in, out, SIZE))
+    fail ("reader got bad data");
+  exit (0x42);
+}
+
+void
+test_main (void) 
+{
+  char buf[OFFSET];
+  pid_t tid;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    out[i] = i % 251;
+
+  CHECK (pipe (fds), "pipe");
+
+  /* Leave the ring's ends partway round. */
+  memset (buf, 'x', OFFSET);
+  CHECK (write (fds[1], buf, OFFSET) == OFFSET, "write %d bytes", OFFSET);
+  CHECK (read (fds[0], buf, OFFSET) == OFFSET, "read %d bytes", OFFSET);
+
+  CHECK ((tid = thread_spawn (reader, NULL, stack + STACK_SIZE))
+         != PID_ERROR, "thread_spawn reader");
+  CHECK (write (fds[1], out, SIZE) == SIZE, "write %d bytes", SIZE);
+  CHECK (wait (tid) == 0x42, "wait for reader");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(write-pipe-wrap) begin
+(write-pipe-wrap) pipe
+(write-pipe-wrap) write 100 bytes
+(write-pipe-wrap) read 100 bytes
+(write-pipe-wrap) thread_spawn reader
+(write-pipe-wrap) write 12388 bytes
+(write-pipe-wrap) wait for reader
+(write-pipe-wrap) end
+write-pipe-wrap: exit(0)
+EOF
+pass;
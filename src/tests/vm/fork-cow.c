@@ -0,0 +1,56 @@
+/* Forks a child, then writes to a page that parent and child
+   still share copy-on-write while the child waits on a pipe.  The
+   write must land in a private copy: the child still sees the old
+   contents, and its own later write does not reach the parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 4096
+
+static char buf[SIZE];
+
+static void check_buf (char c, const char *who);
+
+void
+test_main (void)
+{
+  int fds[2];
+  pid_t child;
+  char token;
+
+  CHECK (pipe (fds), "pipe");
+  memset (buf, 'a', SIZE);
+
+  child = fork ();
+  if (child == 0)
+    {
+      /* Wait until the parent has written its copy. */
+      if (read (fds[0], &token, 1) != 1)
+        fail ("child read from pipe");
+      check_buf ('a', "child");
+      memset (buf, 'c', SIZE);
+      check_buf ('c', "child");
+      exit (0x42);
+    }
+
+  CHECK (child != PID_ERROR, "fork");
+  memset (buf, 'b', SIZE);
+  CHECK (write (fds[1], "x", 1) == 1, "write to pipe");
+  CHECK (wait (child) == 0x42, "wait for child");
+  check_buf ('b', "parent");
+  msg ("parent and child kept their own copies");
+}
+
+/* Fails unless every byte of buf is C, naming WHO. */
+static void
+check_buf (char c, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      fail ("%s sees byte %zu = '%c' instead of '%c'", who, i, buf[i], c);
+}
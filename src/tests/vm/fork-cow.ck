@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) pipe
+(fork-cow) fork
+(fork-cow) write to pipe
+(fork-cow) wait for child
+(fork-cow) parent and child kept their own copies
+(fork-cow) end
+EOF
+pass;
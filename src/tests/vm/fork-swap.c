@@ -0,0 +1,49 @@
+/* Fills 2 MB of memory, more than fits in the user pool, so that
+   part of it is in swap, then forks.  The child checks that every
+   page came through the fork intact, and so does the parent once
+   the child is done. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+
+static void check_buf (const char *who);
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  msg ("initialize");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  child = fork ();
+  if (child == 0)
+    {
+      check_buf ("child");
+      exit (0x42);
+    }
+
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  check_buf ("parent");
+  msg ("parent's pages intact");
+}
+
+/* Fails unless buf still holds the pattern written to it, naming
+   WHO. */
+static void
+check_buf (const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("%s sees bad byte %zu", who, i);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-swap) begin
+(fork-swap) initialize
+(fork-swap) fork
+(fork-swap) wait for child
+(fork-swap) parent's pages intact
+(fork-swap) end
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Forks a child that writes to a page it shares copy-on-write
+   with its parent, and checks that the write does not show up in
+   the parent. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int value = 1;
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  value = 42;
+  child = fork ();
+  if (child == 0)
+    {
+      if (value != 42)
+        fail ("child sees %d instead of 42", value);
+      value = 99;
+      exit (value == 99 ? 0x42 : 1);
+    }
+
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  if (value != 42)
+    fail ("parent sees child's write: %d instead of 42", value);
+  msg ("parent still sees 42");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-write) begin
+(fork-write) fork
+(fork-write) wait for child
+(fork-write) parent still sees 42
+(fork-write) end
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Calls msync() on a mapping that does not exist, which must do
+   nothing, then passes madvise() ranges and advice it must refuse:
+   a misaligned address, an empty range, a range reaching into the
+   kernel and an unknown advice value.  Each madvise() call must
+   return false. */
+
+#include <madvise.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  msg ("msync unknown mapping");
+  msync (map + 1);
+  CHECK (!madvise ((char *) ACTUAL + 1, 4096, MADV_WILLNEED),
+         "madvise misaligned address");
+  CHECK (!madvise (ACTUAL, 0, MADV_WILLNEED), "madvise empty range");
+  CHECK (!madvise ((void *) 0xbffff000, 8192, MADV_WILLNEED),
+         "madvise range into the kernel");
+  CHECK (!madvise (ACTUAL, 4096, 99), "madvise unknown advice");
+  CHECK (madvise (ACTUAL, 4096, MADV_WILLNEED), "madvise MADV_WILLNEED");
+  munmap (map);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(msync-bad) begin
+(msync-bad) open "sample.txt"
+(msync-bad) mmap "sample.txt"
+(msync-bad) msync unknown mapping
+(msync-bad) madvise misaligned address
+(msync-bad) madvise empty range
+(msync-bad) madvise range into the kernel
+(msync-bad) madvise unknown advice
+(msync-bad) madvise MADV_WILLNEED
+(msync-bad) end
+msync-bad: exit(0)
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Writes to a file through a mapping and calls msync(), then reads
+   the file back with read() while the mapping is still in place.
+   Dropping the synced page with madvise() and touching it again
+   must read the same data back in from the file. */
+
+#include <madvise.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  msg ("msync \"sample.txt\"");
+  msync (map);
+
+  CHECK (read (handle, buf, strlen (sample)) == (int) strlen (sample),
+         "read \"sample.txt\"");
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+
+  CHECK (madvise (ACTUAL, 4096, MADV_DONTNEED), "madvise MADV_DONTNEED");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)),
+         "compare mapping against written data");
+  munmap (map);
+  close (handle);
+}
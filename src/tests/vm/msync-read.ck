@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(msync-read) begin
+(msync-read) create "sample.txt"
+(msync-read) open "sample.txt"
+(msync-read) mmap "sample.txt"
+(msync-read) msync "sample.txt"
+(msync-read) read "sample.txt"
+(msync-read) compare read data against written data
+(msync-read) madvise MADV_DONTNEED
+(msync-read) compare mapping against written data
+(msync-read) end
+msync-read: exit(0)
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Shrinks the heap with sbrk(), checks that it cannot shrink below
+   where it starts, then touches the page the heap just gave back.
+   The process must be terminated with -1 exit code. */
+
+#include <round.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+
+void
+test_main (void)
+{
+  uint8_t *brk = sbrk (0);
+  uint8_t *top;
+
+  CHECK (sbrk (ROUND_UP ((uintptr_t) brk, PAGE) - (uintptr_t) brk) == brk,
+         "align the break");
+  top = sbrk (0);
+  CHECK (sbrk (PAGE) == top, "grow the heap by a page");
+  top[0] = 1;
+  CHECK (sbrk (-PAGE) == top + PAGE, "shrink the heap by a page");
+  CHECK (sbrk (-(intptr_t) top) == (void *) -1,
+         "shrink below the start of the heap");
+  CHECK (sbrk (0) == top, "break unchanged");
+
+  msg ("read past the break");
+  msg ("byte past the break is %d", *(volatile uint8_t *) top);
+  fail ("survived reading past the break");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(sbrk-bad) begin
+(sbrk-bad) align the break
+(sbrk-bad) grow the heap by a page
+(sbrk-bad) shrink the heap by a page
+(sbrk-bad) shrink below the start of the heap
+(sbrk-bad) break unchanged
+(sbrk-bad) read past the break
+sbrk-bad: exit(-1)
+EOF
+pass;
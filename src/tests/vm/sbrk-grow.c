@@ -0,0 +1,57 @@
+/* Grows the heap with sbrk(), writes to it, shrinks it and grows
+   it again.  New heap pages must read as zeros, including pages
+   that were written before the heap shrank past them. */
+
+#include <round.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE 4096
+#define PAGE_CNT 3
+
+/* Fails unless all SIZE bytes at P are zero. */
+static void
+check_zeros (const uint8_t *p, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != 0)
+      fail ("byte %zu of new heap is %d, not 0", i, p[i]);
+}
+
+void
+test_main (void)
+{
+  uint8_t *brk = sbrk (0);
+  uint8_t *start;
+  size_t i;
+
+  /* Start on a page boundary, so that whole pages come and go. */
+  CHECK (sbrk (ROUND_UP ((uintptr_t) brk, PAGE) - (uintptr_t) brk) == brk,
+         "align the break");
+  start = sbrk (0);
+  CHECK (sbrk (PAGE_CNT * PAGE) == start, "grow the heap by %d pages",
+         PAGE_CNT);
+  CHECK (sbrk (0) == start + PAGE_CNT * PAGE, "break moved up");
+  check_zeros (start, PAGE_CNT * PAGE);
+  msg ("new heap is zeroed");
+  for (i = 0; i < PAGE_CNT * PAGE; i++)
+    start[i] = i % 251 + 1;
+  for (i = 0; i < PAGE_CNT * PAGE; i++)
+    if (start[i] != i % 251 + 1)
+      fail ("byte %zu of heap reads back wrong", i);
+  msg ("wrote and read back the heap");
+
+  CHECK (sbrk (-(PAGE_CNT - 1) * PAGE) == start + PAGE_CNT * PAGE,
+         "shrink the heap by %d pages", PAGE_CNT - 1);
+  CHECK (sbrk (0) == start + PAGE, "break moved down");
+  CHECK (start[PAGE - 1] == (PAGE - 1) % 251 + 1, "first page kept");
+
+  CHECK (sbrk ((PAGE_CNT - 1) * PAGE) == start + PAGE,
+         "grow the heap again");
+  check_zeros (start + PAGE, (PAGE_CNT - 1) * PAGE);
+  msg ("regrown heap is zeroed");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sbrk-grow) begin
+(sbrk-grow) align the break
+(sbrk-grow) grow the heap by 3 pages
+(sbrk-grow) break moved up
+(sbrk-grow) new heap is zeroed
+(sbrk-grow) wrote and read back the heap
+(sbrk-grow) shrink the heap by 2 pages
+(sbrk-grow) break moved down
+(sbrk-grow) first page kept
+(sbrk-grow) grow the heap again
+(sbrk-grow) regrown heap is zeroed
+(sbrk-grow) end
+sbrk-grow: exit(0)
+EOF
+pass;
@@ -0,0 +1,200 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/vaddr.h"
+
+/* Processors.
+
+   Processors are found through the Intel MultiProcessor
+   Specification tables that the BIOS leaves in low memory.  See
+   [MP-1.4] chapter 4 "MP Configuration Table".  Each CPU gets a
+   struct cpu that holds its own idle thread and ready queues, so
+   that the scheduler reaches them through cpu_current() instead
+   of through globals.
+
+   Only the bootstrap processor runs Pintos.  The kernel still
+   relies on turning interrupts off to exclude every other thread,
+   which holds only on a single CPU, so the application processors
+   are left halted where the BIOS put them. */
+
+struct cpu cpus[CPU_MAX];
+unsigned cpu_cnt;
+
+/* MP floating pointer structure. */
+struct mp_float
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t version;            /* Specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    uint8_t features[5];        /* Nonzero features[0]: default config. */
+  } __attribute__ ((packed));
+
+/* MP configuration table header, followed by its entries. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of header plus entries. */
+    uint8_t version;            /* Specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    char oem[20];               /* OEM and product IDs. */
+    uint32_t oem_table;         /* OEM table address. */
+    uint16_t oem_length;        /* OEM table length. */
+    uint16_t entry_cnt;         /* Number of entries. */
+    uint32_t lapic_addr;        /* Local APIC address. */
+    uint16_t ext_length;        /* Extended table length. */
+    uint8_t ext_checksum;       /* Extended table checksum. */
+    uint8_t reserved;
+  } __attribute__ ((packed));
+
+/* MP configuration table processor entry.  Entries of every other
+   type are 8 bytes long. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;       /* Local APIC version. */
+    uint8_t flags;              /* MP_CPU_* flags. */
+    uint32_t signature;         /* CPUID signature. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint32_t reserved[2];
+  } __attribute__ ((packed));
+
+#define MP_PROCESSOR 0          /* Processor entry type. */
+#define MP_CPU_ENABLED 0x01     /* Processor is usable. */
+#define MP_CPU_BSP 0x02         /* Processor is the bootstrap CPU. */
+
+static struct mp_float *find_mp_float (void);
+static struct mp_float *scan_mp_float (uintptr_t, size_t);
+static void *map_table (uintptr_t, size_t);
+static bool checksum_ok (const void *, size_t);
+
+/* Finds the processors in the machine and records them in cpus[],
+   the bootstrap processor, the one running this code, first.
+   Must be called after paging_init(), which maps the BIOS areas
+   that the MP tables live in. */
+void
+cpu_init (void)
+{
+  struct mp_float *mp;
+  struct mp_config *config;
+  uint8_t *entry, *end;
+  unsigned i;
+
+  ASSERT (cpus[0].online);
+
+  /* Seed every CPU's fast generator from the main one, which -rs
+     controls. */
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      uint64_t seed = random_ulong ();
+
+      xorshift_seed (&cpus[i].rng, seed << 32 | random_ulong ());
+    }
+
+  cpu_cnt = 1;
+  mp = find_mp_float ();
+  if (mp == NULL || mp->config == 0)
+    return;
+  config = map_table (mp->config, sizeof *config);
+  if (config == NULL || memcmp (config->signature, "PCMP", 4)
+      || map_table (mp->config, config->length) == NULL
+      || !checksum_ok (config, config->length))
+    return;
+
+  /* Record each enabled processor after the bootstrap processor,
+     whose entry only supplies its APIC ID. */
+  entry = (uint8_t *) (config + 1);
+  end = (uint8_t *) config + config->length;
+  for (i = 0; i < config->entry_cnt && entry < end; i++)
+    {
+      if (*entry == MP_PROCESSOR)
+        {
+          struct mp_processor *p = (struct mp_processor *) entry;
+
+          if (entry + sizeof *p > end)
+            break;
+          if (p->flags & MP_CPU_BSP)
+            cpus[0].apic_id = p->apic_id;
+          else if ((p->flags & MP_CPU_ENABLED) && cpu_cnt < CPU_MAX)
+            {
+              struct cpu *cpu = &cpus[cpu_cnt];
+
+              cpu->id = cpu_cnt++;
+              cpu->apic_id = p->apic_id;
+            }
+          entry += sizeof *p;
+        }
+      else
+        entry += 8;
+    }
+
+  if (cpu_cnt > 1)
+    printf ("Found %u CPUs; only the boot CPU runs Pintos.\n", cpu_cnt);
+}
+
+/* Searches the areas that the MP specification allows for the MP
+   floating pointer structure and returns it, or a null pointer if
+   there is none. */
+static struct mp_float *
+find_mp_float (void)
+{
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  struct mp_float *mp = NULL;
+
+  /* First KB of the Extended BIOS Data Area, or the last KB of
+     base memory, then the BIOS ROM. */
+  if (ebda_seg != 0)
+    mp = scan_mp_float ((uintptr_t) ebda_seg << 4, 1024);
+  if (mp == NULL)
+    mp = scan_mp_float (0x9fc00, 1024);
+  if (mp == NULL)
+    mp = scan_mp_float (0xf0000, 0x10000);
+  return mp;
+}
+
+/* Scans the SIZE bytes of physical memory at PADDR for an MP
+   floating pointer structure, which is aligned on a 16-byte
+   boundary. */
+static struct mp_float *
+scan_mp_float (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = map_table (paddr, size);
+  uint8_t *end = p + size;
+
+  if (p == NULL)
+    return NULL;
+  for (; p + sizeof (struct mp_float) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum_ok (p, sizeof (struct mp_float)))
+      return (struct mp_float *) p;
+  return NULL;
+}
+
+/* Returns the kernel virtual address for the SIZE bytes of
+   physical memory at PADDR, or a null pointer if they are not
+   all mapped.  paging_init() maps all of RAM, counting the
+   BIOS areas below 1 MB. */
+static void *
+map_table (uintptr_t paddr, size_t size)
+{
+  uintptr_t limit = (uintptr_t) init_ram_pages * PGSIZE;
+
+  if (paddr >= limit || size > limit - paddr)
+    return NULL;
+  return ptov (paddr);
+}
+
+/* Returns true if the SIZE bytes at P sum to 0, modulo 256. */
+static bool
+checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
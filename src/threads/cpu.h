@@ -0,0 +1,65 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <list.h>
+#include <random.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Most processors recorded. */
+#define CPU_MAX 16
+
+/* Words in a ready-queue bitmap, one bit per priority. */
+#define READY_BITMAP_WORDS ((PRI_MAX + 1 + 31) / 32)
+
+/* A processor.
+
+   The scheduler state that belongs to one CPU lives here rather
+   than in globals: the thread it runs when nothing else is ready,
+   and its multi-level ready queue.  There is one FIFO list per
+   priority, and bit P of READY_BITMAP is set exactly when
+   READY_QUEUES[P] is non-empty, so the highest priority ready
+   thread is found with a single bit scan. */
+struct cpu
+  {
+    unsigned id;                /* Index in cpus[]. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    bool online;                /* Running Pintos threads? */
+    struct thread *idle_thread; /* Runs when no thread is ready. */
+    struct list ready_queues[PRI_MAX + 1];      /* Ready threads. */
+    uint32_t ready_bitmap[READY_BITMAP_WORDS];  /* Nonempty queues. */
+    int ready_cnt;              /* Threads in the ready queues. */
+    struct xorshift rng;        /* Fast random numbers. */
+  };
+
+/* Processors found, the bootstrap processor first. */
+extern struct cpu cpus[CPU_MAX];
+extern unsigned cpu_cnt;
+
+void cpu_init (void);
+
+/* Returns the CPU running the caller.  Only the bootstrap
+   processor runs Pintos, so that is always cpus[0]. */
+static inline struct cpu *
+cpu_current (void)
+{
+  return &cpus[0];
+}
+
+/* Returns a pseudo-random number in the range 0...N (exclusive)
+   from the running CPU's fast generator, for randomized policies.
+   The sequence follows from the -rs seed like random_ulong()'s, so
+   runs stay reproducible. */
+static inline uint32_t
+cpu_random (uint32_t n)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t r = xorshift_range (&cpu_current ()->rng, n);
+
+  intr_set_level (old_level);
+  return r;
+}
+
+#endif /* threads/cpu.h */
@@ -1,3 +1,6 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
 #include <stdint.h>
 
 /* We use a signed 32-bit integer to create
@@ -19,22 +22,82 @@ typedef int32_t fixed_point;
 /* Constant factor used to get fixed points as integers*/
 #define PRINT_FP_CONST 100
 
-fixed_point int_to_fp (int n);
+/* The operations below are defined inline so that the scheduler's
+   per-tick and per-second arithmetic compiles to a few instructions.
+   Only fp_div() needs a 64-bit division, which goes through the
+   software helpers in lib/arithmetic.c; the other operations divide
+   by the constant F, which the compiler reduces to a shift. */
+
+/* Converts integer to fixed point representation */
+static inline fixed_point 
+int_to_fp (int n) 
+{
+    return n * F;
+}
+
+/* Converts fixed point representation to integer.
+   Rounds toward nearest integer. */
+static inline int 
+fp_to_int (fixed_point fp) 
+{
+    if (fp > 0) return (fp + F / 2) / F;
+    return (fp - F / 2) / F;
+}
 
-int fp_to_int (fixed_point fp);
+/* Sums two fixed points. */
+static inline fixed_point 
+fp_add (fixed_point x, fixed_point y) 
+{
+    return x + y;
+}
 
-fixed_point fp_add (fixed_point x, fixed_point y);
+/* Subtracts fixed point y from fixed point x. */
+static inline fixed_point 
+fp_sub (fixed_point x, fixed_point y) 
+{
+    return x - y;
+}
 
-fixed_point fp_sub (fixed_point x, fixed_point y);
+/* Multiplies two fixed points. */
+static inline fixed_point 
+fp_mult (fixed_point x, fixed_point y) 
+{
+    return ((int64_t) x) * y / F;
+}
 
-fixed_point fp_mult (fixed_point x, fixed_point y);
+/* Divides fixed point x by y. */
+static inline fixed_point 
+fp_div (fixed_point x, fixed_point y) 
+{
+    return ((int64_t) x) * F / y;
+}
 
-fixed_point fp_div (fixed_point x, fixed_point y);
+/* Adds int to fixed point and returns sum as fixed point. */
+static inline fixed_point 
+add_int_to_fp (fixed_point fp, int n) 
+{
+    return fp + n * F;
+}
 
-fixed_point add_int_to_fp (fixed_point fp, int n);
+/* Subtracts int from fixed point and returns difference as fixed point. */
+static inline fixed_point 
+sub_int_from_fp (fixed_point fp, int n) 
+{
+    return fp - n * F;
+}
 
-fixed_point sub_int_from_fp (fixed_point fp, int n);
+/* Multiplies fixed point by int and returns product as fixed point. */
+static inline fixed_point 
+mult_fp_by_int (fixed_point fp, int n) 
+{
+    return fp * n;
+}
 
-fixed_point mult_fp_by_int (fixed_point fp, int n);
+/* Divides fixed point by int and returns quotient as fixed point. */
+static inline fixed_point 
+div_fp_by_int (fixed_point fp, int n) 
+{
+    return fp / n;
+}
 
-fixed_point div_fp_by_int (fixed_point fp, int n);
\ No newline at end of file
+#endif /* threads/fixed-point.h */
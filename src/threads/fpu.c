@@ -0,0 +1,266 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+
+/* Lazy floating-point context switching.
+
+   Only user programs use the x87 FPU and the SSE unit; the kernel
+   is compiled with -msoft-float.  Their registers are not part of
+   switch_threads() or the interrupt frame.  Instead, at most one
+   thread, FPU_OWNER, has its state in the registers, and every
+   switch to any other thread sets CR0.TS.  The first
+   floating-point instruction such a thread executes then raises
+   #NM, whose handler saves the owner's state to memory, loads the
+   current thread's, and makes it the owner.  A thread that never
+   touches the FPU never takes the trap and has no save area.  See
+   [IA32-v3a] 12.5 "Saving the FPU, MMX, SSE and SSE2 State". */
+
+/* CR0 and CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task Switched. */
+#define CR0_NE 0x00000020       /* Native FPU error reporting. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE, FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* SSE exceptions raise #XF. */
+
+/* CPUID leaf 1 EDX bits. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1u << 25)    /* SSE. */
+
+/* Bytes saved by FXSAVE, which must be 16-byte aligned, and by
+   FNSAVE, which we fall back to without FXSR. */
+#define FXSAVE_SIZE 512
+#define FNSAVE_SIZE 108
+#define FPU_ALIGN 16
+
+/* Thread whose state is in the FPU registers, or null. */
+static struct thread *fpu_owner;
+
+/* True if the CPU has FXSAVE and FXRSTOR. */
+static bool use_fxsr;
+
+/* State of a freshly initialized FPU, given to a thread the first
+   time it uses floating point. */
+static uint8_t initial_state[FXSAVE_SIZE] __attribute__ ((aligned (16)));
+
+/* Save areas, FPU_ALIGN - 1 bytes larger than needed so that each
+   can be aligned. */
+static struct kmem_cache fpu_cache;
+
+/* Statistics. */
+static long long trap_cnt;      /* #NM traps taken. */
+static long long save_cnt;      /* Owner states saved to memory. */
+
+static intr_handler_func fpu_trap;
+static void *save_area (struct thread *);
+static void save_state (void *);
+static void restore_state (const void *);
+static uint32_t read_cr0 (void);
+static void write_cr0 (uint32_t);
+
+/* Enables the FPU, and SSE if the CPU has it, and registers the
+   #NM handler.  Floating point traps until a thread first uses
+   it. */
+void
+fpu_init (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  use_fxsr = (edx & CPUID_FXSR) != 0;
+  if (use_fxsr)
+    {
+      uint32_t cr4, bits = CR4_OSFXSR;
+
+      if (edx & CPUID_SSE)
+        bits |= CR4_OSXMMEXCPT;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | bits));
+    }
+  write_cr0 ((read_cr0 () & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+
+  asm volatile ("fninit");
+  save_state (initial_state);
+  write_cr0 (read_cr0 () | CR0_TS);
+
+  kmem_cache_init (&fpu_cache, "fpu",
+                   (use_fxsr ? FXSAVE_SIZE : FNSAVE_SIZE) + FPU_ALIGN - 1,
+                   NULL, NULL);
+  intr_register_int (7, 0, INTR_ON, fpu_trap,
+                     "#NM Device Not Available Exception");
+}
+
+/* Called on each switch to thread CUR, with interrupts off.
+   Leaves the FPU usable only if CUR's state is already loaded. */
+void
+fpu_switch (struct thread *cur)
+{
+  uint32_t cr0 = read_cr0 ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cur == fpu_owner)
+    {
+      if (cr0 & CR0_TS)
+        asm volatile ("clts");
+    }
+  else if (!(cr0 & CR0_TS))
+    write_cr0 (cr0 | CR0_TS);
+}
+
+/* Gives the running thread a copy of the floating-point state of
+   PARENT, as fork requires.  Returns false if out of memory. */
+bool
+fpu_copy (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (parent->fpu == NULL)
+    return true;
+
+  ASSERT (cur->fpu == NULL);
+  cur->fpu = kmem_cache_alloc (&fpu_cache);
+  if (cur->fpu == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  if (fpu_owner == parent)
+    {
+      /* Spill the parent's live registers so that we copy them.
+         The parent stays the owner, since they are unchanged. */
+      asm volatile ("clts");
+      save_state (save_area (parent));
+      if (!use_fxsr)
+        restore_state (save_area (parent));
+      write_cr0 (read_cr0 () | CR0_TS);
+    }
+  memcpy (save_area (cur), save_area (parent),
+          use_fxsr ? FXSAVE_SIZE : FNSAVE_SIZE);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Releases the running thread's floating-point state, as it
+   exits. */
+void
+fpu_exit (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (cur->fpu == NULL)
+    return;
+
+  old_level = intr_disable ();
+  if (fpu_owner == cur)
+    {
+      fpu_owner = NULL;
+      write_cr0 (read_cr0 () | CR0_TS);
+    }
+  intr_set_level (old_level);
+
+  kmem_cache_free (&fpu_cache, cur->fpu);
+  cur->fpu = NULL;
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void)
+{
+  printf ("FPU: %lld lazy loads, %lld saves\n", trap_cnt, save_cnt);
+}
+
+/* #NM handler.  Makes the FPU usable by the running thread, with
+   its own state loaded. */
+static void
+fpu_trap (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if ((f->cs & 3) == 0)
+    {
+      intr_dump_frame (f);
+      PANIC ("Kernel bug - floating point in kernel");
+    }
+
+  if (cur->fpu == NULL)
+    {
+      cur->fpu = kmem_cache_alloc (&fpu_cache);
+      if (cur->fpu == NULL)
+        {
+          printf ("%s: out of memory for FPU state.\n", thread_name ());
+#ifdef USERPROG
+          cur->exit_status = -1;
+#endif
+          thread_exit ();
+        }
+      memcpy (save_area (cur), initial_state,
+              use_fxsr ? FXSAVE_SIZE : FNSAVE_SIZE);
+    }
+
+  old_level = intr_disable ();
+  asm volatile ("clts");
+  if (fpu_owner != cur)
+    {
+      if (fpu_owner != NULL)
+        {
+          save_state (save_area (fpu_owner));
+          save_cnt++;
+        }
+      restore_state (save_area (cur));
+      fpu_owner = cur;
+    }
+  trap_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Returns the aligned save area of thread T. */
+static void *
+save_area (struct thread *t)
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu, FPU_ALIGN);
+}
+
+/* Saves the FPU registers to AREA.  FNSAVE also reinitializes the
+   FPU. */
+static void
+save_state (void *area)
+{
+  if (use_fxsr)
+    asm volatile ("fxsave (%0)" : : "r" (area) : "memory");
+  else
+    asm volatile ("fnsave (%0)" : : "r" (area) : "memory");
+}
+
+/* Loads the FPU registers from AREA. */
+static void
+restore_state (const void *area)
+{
+  if (use_fxsr)
+    asm volatile ("fxrstor (%0)" : : "r" (area) : "memory");
+  else
+    asm volatile ("frstor (%0)" : : "r" (area) : "memory");
+}
+
+static uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
@@ -0,0 +1,14 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init (void);
+void fpu_switch (struct thread *);
+bool fpu_copy (struct thread *);
+void fpu_exit (void);
+void fpu_print_stats (void);
+
+#endif /* threads/fpu.h */
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "devices/lapic.h"
 #include "devices/kbd.h"
 #include "devices/input.h"
 #include "devices/serial.h"
@@ -15,17 +16,22 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/profile.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
@@ -34,12 +40,19 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/vma.h"
+#include "vm/zswap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -53,25 +66,43 @@ static bool format_filesys;
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -ramdisk: RAM disks to create, as ROLE:PAGES,... */
+static char *ramdisk_specs;
 #ifdef VM
-static const char *swap_bdev_name;
+static char *swap_bdev_names;
 #endif
 #endif /* FILESYS */
 
+/* -pse: Map physical memory with 4 MB pages where possible? */
+static bool large_pages;
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static uint32_t cpu_features (void);
+
+/* CPUID leaf 1 feature bits, in EDX. */
+#define CPUID_PSE (1u << 3)     /* 4 MB pages. */
+#define CPUID_PGE (1u << 13)    /* Global pages. */
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+static void parse_quanta (char *value);
+static void parse_calibrate (char *value);
 static void run_actions (char **argv);
 static void usage (void);
 
 #ifdef FILESYS
+static void create_ramdisks (char *specs);
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+#ifdef VM
+static void locate_swap_devices (char *names);
+static void add_swap_device (struct block *, int priority);
+#endif
 #endif
 
 int main (void) NO_RETURN;
@@ -101,7 +132,10 @@ main (void)
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
+  trace_init ();
+  profile_init ();
   paging_init ();
+  cpu_init ();
   /* Segmentation. */
 #ifdef USERPROG
   tss_init ();
@@ -110,29 +144,42 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
+  pagedir_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+#ifdef USERPROG
+  palloc_start_zeroer ();
+#endif
   serial_init_queue ();
   timer_calibrate ();
 
 #ifdef FILESYS
   /* Initialize file system. */
+  create_ramdisks (ramdisk_specs);
   ide_init ();
+  virtio_blk_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
 
 #ifdef VM
   frame_table_init ();
+  spt_init ();
+  mmap_init ();
+  vma_init ();
   swap_init ();
+  frame_start_pageout ();
+  process_start_reaper ();
 #endif
 
   printf ("Boot complete.\n");
@@ -161,13 +208,26 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, the kernel's mappings are made global,
+   so that the TLB keeps them when CR3 is reloaded on a switch
+   between processes and only user entries need refilling.  This
+   is safe because they never change after this function. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  uint32_t global = (features & CPUID_PGE) ? PTE_G : 0;
+
+  if (large_pages && !(features & CPUID_PSE))
+    {
+      printf ("CPU lacks 4 MB page support, ignoring -pse.\n");
+      large_pages = false;
+    }
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -179,13 +239,27 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      /* With -pse, map each whole 4 MB chunk with a single PDE.
+         The chunk holding kernel text keeps 4 kB pages so that
+         the text stays read-only, as does a partial chunk at the
+         top of memory. */
+      if (large_pages && pte_idx == 0
+          && page + LARGE_PGSIZE / PGSIZE <= init_ram_pages
+          && ((char *) ptov (paddr + LARGE_PGSIZE) <= &_start
+              || &_end_kernel_text <= vaddr))
+        {
+          pd[pde_idx] = pde_create_large (vaddr) | global;
+          page += LARGE_PGSIZE / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -193,7 +267,34 @@ paging_init (void)
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
+  if (large_pages)
+    {
+      /* Set CR4.PSE so the processor honors PTE_PS in PDEs.  See
+         [IA32-v3a] 2.5 "Control Registers". */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | 0x10));
+    }
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+  if (global)
+    {
+      /* Set CR4.PGE so the processor honors PTE_G.  See
+         [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | 0x80));
+    }
+}
+
+/* Returns the CPU's feature bits from CPUID leaf 1, in EDX.  See
+   [IA32-v2a] "CPUID--CPU Identification". */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -255,15 +356,57 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_size = atoi (value);
+      else if (!strcmp (name, "-cache-crc"))
+        cache_checksums = true;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_specs = value;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
-        swap_bdev_name = value;
+        swap_bdev_names = value;
+      else if (!strcmp (name, "-wsclock"))
+        frame_wsclock = true;
+      else if (!strcmp (name, "-ksm"))
+        frame_ksm = true;
+      else if (!strcmp (name, "-rss"))
+        frame_rss_limit = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_limit = atoi (value);
+      else if (!strcmp (name, "-prefetch"))
+        exec_prefetch_pages = atoi (value);
 #endif
 #endif
+      else if (!strcmp (name, "-timeslice"))
+        thread_set_quanta (atoi (value), atoi (value), atoi (value));
+      else if (!strcmp (name, "-quanta"))
+        parse_quanta (value);
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-slack"))
+        thread_default_slack = atoi (value);
+      else if (!strcmp (name, "-apic"))
+        lapic_enable = true;
+      else if (!strcmp (name, "-calibrate"))
+        parse_calibrate (value);
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-mlfqs-lazy"))
+        thread_mlfqs = thread_mlfqs_lazy = true;
+      else if (!strcmp (name, "-stride"))
+        thread_stride = true;
+      else if (!strcmp (name, "-adaptive-locks"))
+        lock_adaptive = true;
+      else if (!strcmp (name, "-pse"))
+        large_pages = true;
+      else if (!strcmp (name, "-headless"))
+        console_headless = true;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -272,6 +415,9 @@ parse_options (char **argv)
         PANIC ("unknown option `%s' (use -h for help)", name);
     }
 
+  if (thread_mlfqs && thread_stride)
+    PANIC ("options `-mlfqs' and `-stride' are mutually exclusive");
+
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
 
@@ -285,6 +431,53 @@ parse_options (char **argv)
   return argv;
 }
 
+/* Parses the value of the "-quanta" option, three comma-separated
+   time slices in timer ticks for the low, default and high priority
+   bands, and applies it. */
+static void
+parse_quanta (char *value)
+{
+  unsigned quanta[QUANTUM_BANDS];
+  char *token, *save_ptr;
+  int i = 0;
+
+  if (value == NULL)
+    PANIC ("option `-quanta' requires a value (use -h for help)");
+
+  for (token = strtok_r (value, ",", &save_ptr); token != NULL;
+       token = strtok_r (NULL, ",", &save_ptr))
+    {
+      if (i == QUANTUM_BANDS)
+        PANIC ("option `-quanta' takes %d values", QUANTUM_BANDS);
+      quanta[i++] = atoi (token);
+    }
+  if (i != QUANTUM_BANDS)
+    PANIC ("option `-quanta' takes %d values", QUANTUM_BANDS);
+
+  thread_set_quanta (quanta[QUANTUM_BAND_LOW], quanta[QUANTUM_BAND_MID],
+                     quanta[QUANTUM_BAND_HIGH]);
+}
+
+/* Parses the value of the "-calibrate" option, the loops per
+   timer tick and, optionally, TSC cycles per tick that
+   timer_calibrate() would otherwise measure, and applies it. */
+static void
+parse_calibrate (char *value)
+{
+  char *loops, *cycles, *save_ptr;
+
+  if (value == NULL)
+    PANIC ("option `-calibrate' requires a value (use -h for help)");
+
+  loops = strtok_r (value, ",", &save_ptr);
+  cycles = strtok_r (NULL, ",", &save_ptr);
+  if (loops == NULL || atoi (loops) <= 0
+      || (cycles != NULL && atoi (cycles) <= 0))
+    PANIC ("option `-calibrate' takes positive counts");
+
+  timer_set_calibration (atoi (loops), cycles != NULL ? atoi (cycles) : 0);
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -293,7 +486,7 @@ run_task (char **argv)
   
   printf ("Executing '%s':\n", task);
 #ifdef USERPROG
-  process_wait (process_execute (task));
+  process_wait (process_execute (task), NULL);
 #else
   run_test (task);
 #endif
@@ -323,6 +516,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"defrag", 1, fsutil_defrag},
 #endif
       {NULL, 0, NULL},
     };
@@ -372,6 +566,7 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  defrag             Make files contiguous, gather free space.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -381,12 +576,33 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=SECTORS     Cache SECTORS file system sectors in RAM.\n"
+          "  -cache-crc         Checksum cached metadata, verify on each use.\n"
+          "  -ramdisk=ROLE:PAGES,... Create RAM disks of ROLE, e.g. swap.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV[:P],... Swap to each BDEV, highest priority P first.\n"
+          "  -wsclock           Evict with WSClock instead of plain clock.\n"
+          "  -ksm               Merge identical pages in the background.\n"
+          "  -rss=PAGES         Limit each process to PAGES resident pages.\n"
+          "  -zswap=PAGES       Keep up to PAGES of compressed swap in RAM.\n"
+          "  -prefetch=PAGES    Read executable segments of PAGES or less whole.\n"
 #endif
 #endif
+          "  -timeslice=TICKS   Give each thread TICKS timer ticks per slice.\n"
+          "  -quanta=L,M,H      Slices for low, default, high priority bands.\n"
+          "  -tickless          Stop the timer tick while the CPU is idle.\n"
+          "  -slack=TICKS       Let sleeps end up to TICKS ticks late, batched.\n"
+          "  -apic              Drive the timer tick with the local APIC.\n"
+          "  -calibrate=L[,C]   Take L loops and C TSC cycles per tick as given.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -mlfqs-lazy        Like -mlfqs, but update blocked threads on wakeup.\n"
+          "  -stride            Use proportional-share stride scheduler.\n"
+          "  -adaptive-locks    Yield to a preempted lock holder before blocking.\n"
+          "  -pse               Map kernel memory with 4 MB pages.\n"
+          "  -headless          Send console output to the serial port only.\n"
+          "  -trace             Record kernel events, print them at shutdown.\n"
+          "  -profile           Sample code addresses at each timer tick.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -395,6 +611,35 @@ usage (void)
 }
 
 #ifdef FILESYS
+/* Creates the RAM disks described by SPECS, a comma-separated list
+   of a role name ("filesys", "scratch" or "swap"), a colon, and a
+   size in pages, if SPECS is non-null.  They are registered ahead
+   of the IDE disks, so each is the default device for its role. */
+static void
+create_ramdisks (char *specs)
+{
+  char *spec, *save_ptr;
+
+  if (specs == NULL)
+    return;
+
+  for (spec = strtok_r (specs, ",", &save_ptr); spec != NULL;
+       spec = strtok_r (NULL, ",", &save_ptr))
+    {
+      char *pages = strchr (spec, ':');
+      enum block_type type;
+
+      if (pages != NULL)
+        *pages++ = '\0';
+      for (type = BLOCK_FILESYS; type < BLOCK_ROLE_CNT; type++)
+        if (!strcmp (spec, block_type_name (type)))
+          break;
+      if (type == BLOCK_ROLE_CNT || pages == NULL || atoi (pages) <= 0)
+        PANIC ("bad -ramdisk entry \"%s\" (use -h for help)", spec);
+      ramdisk_create (type, atoi (pages));
+    }
+}
+
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void
 locate_block_devices (void)
@@ -402,7 +647,7 @@ locate_block_devices (void)
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
 #ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
+  locate_swap_devices (swap_bdev_names);
 #endif
 }
 
@@ -434,4 +679,57 @@ locate_block_device (enum block_type role, const char *name)
       block_set_role (role, block);
     }
 }
+
+#ifdef VM
+/* Adds the swap devices named in NAMES, a comma-separated list of
+   block device names each optionally followed by a colon and a
+   priority, or every block device of swap type if NAMES is
+   null.  In the latter case, devices on another controller channel
+   than the file system's get priority 1, so that paging and file
+   I/O proceed in parallel while they have room, and the rest 0. */
+static void
+locate_swap_devices (char *names)
+{
+  struct block *block;
+  char *name, *save_ptr;
+
+  if (names == NULL)
+    {
+      struct block *filesys = block_get_role (BLOCK_FILESYS);
+      int filesys_channel = filesys != NULL ? block_channel (filesys) : -1;
+
+      for (block = block_first (); block != NULL; block = block_next (block))
+        if (block_type (block) == BLOCK_SWAP)
+          add_swap_device (block,
+                           (filesys_channel != -1
+                            && block_channel (block) != -1
+                            && block_channel (block) != filesys_channel));
+      return;
+    }
+
+  for (name = strtok_r (names, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      char *priority = strchr (name, ':');
+
+      if (priority != NULL)
+        *priority++ = '\0';
+      block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      add_swap_device (block, priority != NULL ? atoi (priority) : 0);
+    }
+}
+
+/* Swaps to BLOCK with the given PRIORITY. The first swap device
+   also takes the swap role. */
+static void
+add_swap_device (struct block *block, int priority)
+{
+  printf ("swap: using %s, priority %d\n", block_name (block), priority);
+  if (block_get_role (BLOCK_SWAP) == NULL)
+    block_set_role (BLOCK_SWAP, block);
+  swap_add_device (block, priority);
+}
+#endif
 #endif
@@ -3,11 +3,13 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -21,6 +23,9 @@
 /* Number of x86 interrupts. */
 #define INTR_CNT 256
 
+/* Vector of the 8254 timer, IRQ 0. */
+#define TIMER_VEC 0x20
+
 /* The Interrupt Descriptor Table (IDT).  The format is fixed by
    the CPU.  See [IA32-v3a] sections 5.10 "Interrupt Descriptor
    Table (IDT)", 5.11 "IDT Descriptors", 5.12.1.2 "Flag Usage By
@@ -37,6 +42,15 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Time spent handling each vector, in CPU cycles. */
+struct vec_stats
+  {
+    uint64_t count;             /* Interrupts handled. */
+    uint64_t cycles;            /* Total cycles. */
+    uint64_t max_cycles;        /* Longest interrupt. */
+  };
+static struct vec_stats vec_stats[INTR_CNT];
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
@@ -47,6 +61,10 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Is the timer vector raised by the local APIC, rather than by
+   the PIT on PIC IRQ 0?  See intr_timer_from_lapic(). */
+static bool lapic_timer;
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -58,7 +76,9 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+static void timer_intr (struct intr_frame *, uint64_t start);
 static void unexpected_interrupt (const struct intr_frame *);
+static void account (uint8_t vec_no, uint64_t start);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -224,6 +244,55 @@ intr_yield_on_return (void)
   ASSERT (intr_context ());
   yield_on_return = true;
 }
+
+/* Directs the timer vector's end-of-interrupt to the local APIC,
+   whose timer now raises it, and masks IRQ 0 on the PIC so that
+   the PIT no longer does.  Interrupts must be off. */
+void
+intr_timer_from_lapic (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  outb (PIC0_DATA, inb (PIC0_DATA) | 0x01);
+  lapic_timer = true;
+}
+
+/* Fills in *STATS for interrupt vector VEC_NO.  Returns false if
+   VEC_NO is not a vector. */
+bool
+intr_get_stats (unsigned vec_no, struct intrstat *stats)
+{
+  enum intr_level old_level;
+
+  if (vec_no >= INTR_CNT)
+    return false;
+
+  strlcpy (stats->name, intr_names[vec_no], sizeof stats->name);
+  old_level = intr_disable ();
+  stats->count = vec_stats[vec_no].count;
+  stats->cycles = vec_stats[vec_no].cycles;
+  stats->max_cycles = vec_stats[vec_no].max_cycles;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Prints the time spent handling each vector that has been
+   raised. */
+void
+intr_print_stats (void)
+{
+  int i;
+
+  for (i = 0; i < INTR_CNT; i++)
+    {
+      const struct vec_stats *s = &vec_stats[i];
+
+      if (s->count > 0)
+        printf ("Interrupt %#04x (%s): %"PRIu64" handled, %"PRIu64
+                " cycles avg, %"PRIu64" max\n", i, intr_names[i], s->count,
+                s->cycles / s->count, s->max_cycles);
+    }
+}
 
 /* 8259A Programmable Interrupt Controller. */
 
@@ -266,6 +335,13 @@ pic_end_of_interrupt (int irq)
 {
   ASSERT (irq >= 0x20 && irq < 0x30);
 
+  /* The local APIC's timer does not go through the PICs. */
+  if (irq == TIMER_VEC && lapic_timer)
+    {
+      lapic_eoi ();
+      return;
+    }
+
   /* Acknowledge master PIC. */
   outb (0x20, 0x20);
 
@@ -344,9 +420,16 @@ make_idtr_operand (uint16_t limit, void *base)
 void
 intr_handler (struct intr_frame *frame) 
 {
+  uint64_t start = timer_cycles ();
   bool external;
   intr_handler_func *handler;
 
+  if (frame->vec_no == TIMER_VEC && intr_handlers[TIMER_VEC] != NULL)
+    {
+      timer_intr (frame, start);
+      return;
+    }
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
@@ -382,10 +465,58 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
+      account (frame->vec_no, start);
 
       if (yield_on_return) 
         thread_yield (); 
     }
+  else
+    {
+      /* The handler may have run with interrupts on, so another
+         interrupt on the same vector could be updating its
+         statistics. */
+      enum intr_level old_level = intr_disable ();
+      account (frame->vec_no, start);
+      intr_set_level (old_level);
+    }
+}
+
+/* Handles a timer interrupt with interrupt frame FRAME, which
+   arrived when the CPU's cycle counter read START.  The timer
+   interrupts more often than anything else, so this does only
+   what intr_handler() would do for it: it skips the checks and the
+   search for a handler that apply to other vectors, and
+   acknowledges only the master PIC, or the local APIC with a
+   single store if its timer raised the interrupt. */
+static void
+timer_intr (struct intr_frame *frame, uint64_t start)
+{
+  in_external_intr = true;
+  yield_on_return = false;
+  intr_handlers[TIMER_VEC] (frame);
+  in_external_intr = false;
+  if (lapic_timer)
+    lapic_eoi ();
+  else
+    outb (PIC0_CTRL, 0x20);
+  account (TIMER_VEC, start);
+
+  if (yield_on_return)
+    thread_yield ();
+}
+
+/* Adds the time since START, a cycle count, to the statistics of
+   vector VEC_NO.  Interrupts must be off. */
+static void
+account (uint8_t vec_no, uint64_t start)
+{
+  struct vec_stats *s = &vec_stats[vec_no];
+  uint64_t cycles = timer_cycles () - start;
+
+  s->count++;
+  s->cycles += cycles;
+  if (cycles > s->max_cycles)
+    s->max_cycles = cycles;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <intrstat.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -63,8 +64,12 @@ void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
+void intr_timer_from_lapic (void);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
+bool intr_get_stats (unsigned vec, struct intrstat *);
+void intr_print_stats (void);
+
 #endif /* threads/interrupt.h */
@@ -5,8 +5,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/shrinker.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -28,6 +31,33 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
+   In front of the free list, each descriptor keeps a small cache
+   of blocks that are free but still counted as in use by their
+   arenas.  The cache is manipulated with interrupts briefly
+   disabled instead of under the descriptor's lock, so most
+   malloc() and free() calls never touch the lock.  When the
+   cache runs dry it is refilled with a batch of blocks from the
+   free list; when it overflows, the block goes back to the free
+   list as before.  Under memory pressure the page-out daemon
+   empties the caches through a shrinker, so that arenas pinned
+   only by cached blocks go back to the page allocator.
+
+   In front of that, each thread keeps a magazine per descriptor:
+   a stack of up to MAG_MAX free blocks, or fewer for big sizes,
+   that only the thread itself touches, so that a thread freeing
+   and then allocating blocks of one size needs neither the lock
+   nor the interrupt level.  An empty magazine is refilled, and a
+   full one drained by half, in one batch from the descriptor; a
+   thread drains its magazines as it exits.  Interrupt handlers
+   run on the interrupted thread's stack and so bypass the
+   magazines.
+
+   realloc() keeps a block where it is when the new size still
+   belongs to the block's descriptor.  A big block shrinks by
+   giving back its trailing pages and grows by taking the free
+   pages that follow it, if there are enough; only otherwise is
+   the block copied.
+
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
@@ -41,8 +71,20 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    struct clist cache;         /* Recently freed blocks. */
+    size_t mag_max;             /* Capacity of a thread's magazine. */
   };
 
+/* Most blocks in a thread's magazine, and most bytes. */
+#define MAG_MAX 32
+#define MAG_BYTES PGSIZE
+
+/* Maximum number of blocks in a descriptor's cache. */
+#define CACHE_MAX 32
+
+/* Number of blocks moved from the free list to an empty cache. */
+#define CACHE_BATCH 16
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -60,12 +102,38 @@ struct block
     struct list_elem free_elem; /* Free list element. */
   };
 
+/* Free block in a magazine. */
+struct mag_block
+  {
+    struct mag_block *next;     /* Next block down the stack. */
+  };
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CLASS_CNT]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *cache_pop (struct desc *);
+static bool cache_push (struct desc *, struct block *);
+static bool resize_in_place (void *block, size_t new_size);
+static bool new_arena (struct desc *);
+static void release_block (struct desc *, struct block *);
+static struct block *mag_refill (struct desc *, struct magazine *);
+static void mag_drain (struct desc *, struct magazine *, size_t cnt);
+static void mag_push (struct magazine *, struct block *);
+static struct block *mag_pop (struct magazine *);
+static size_t cache_count (void);
+static size_t cache_scan (size_t cnt);
+
+/* Gives back the blocks in the descriptors' caches. */
+static struct shrinker cache_shrinker =
+  {
+    .name = "malloc",
+    .user = false,
+    .count = cache_count,
+    .scan = cache_scan,
+  };
 
 /* Initializes the malloc() descriptors. */
 void
@@ -81,7 +149,12 @@ malloc_init (void)
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
       lock_init (&d->lock);
+      clist_init (&d->cache);
+      d->mag_max = MAG_BYTES / block_size < MAG_MAX
+                   ? MAG_BYTES / block_size : MAG_MAX;
     }
+  ASSERT (desc_cnt == MALLOC_CLASS_CNT);
+  shrinker_register (&cache_shrinker);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -119,36 +192,44 @@ malloc (size_t size)
       return a + 1;
     }
 
+  if (!intr_context ())
+    {
+      struct magazine *m = &thread_current ()->magazines[d - descs];
+
+      return m->cnt > 0 ? mag_pop (m) : mag_refill (d, m);
+    }
+
+  b = cache_pop (d);
+  if (b != NULL)
+    return b;
+
   lock_acquire (&d->lock);
 
   /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  if (list_empty (&d->free_list) && !new_arena (d))
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      lock_release (&d->lock);
+      return NULL; 
     }
 
-  /* Get a block from free list and return it. */
+  /* Get a block from free list and return it, taking a batch
+     more for the cache while we hold the lock. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  while (clist_size (&d->cache) < CACHE_BATCH && !list_empty (&d->free_list))
+    {
+      struct block *c = list_entry (list_pop_front (&d->free_list),
+                                    struct block, free_elem);
+      block_to_arena (c)->free_cnt--;
+      if (!cache_push (d, c))
+        {
+          /* The cache filled up behind our back. */
+          list_push_front (&d->free_list, &c->free_elem);
+          block_to_arena (c)->free_cnt++;
+          break;
+        }
+    }
   lock_release (&d->lock);
   return b;
 }
@@ -199,6 +280,8 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    return old_block;
   else 
     {
       void *new_block = malloc (new_size);
@@ -232,26 +315,22 @@ free (void *p)
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          if (!intr_context ())
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              struct magazine *m = &thread_current ()->magazines[d - descs];
+
+              if (m->cnt >= d->mag_max)
+                mag_drain (d, m, d->mag_max / 2);
+              mag_push (m, b);
+              return;
             }
 
+          if (cache_push (d, b))
+            return;
+  
+          lock_acquire (&d->lock);
+          release_block (d, b);
           lock_release (&d->lock);
         }
       else
@@ -263,6 +342,252 @@ free (void *p)
     }
 }
 
+/* Returns the blocks in the running thread's magazines to their
+   descriptors.  Called as the thread exits. */
+void
+malloc_thread_exit (void)
+{
+  struct thread *cur = thread_current ();
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    mag_drain (&descs[i], &cur->magazines[i], cur->magazines[i].cnt);
+}
+
+/* Obtains a page for a new arena for D, whose lock the caller
+   holds, and adds its blocks to D's free list.  Returns false if
+   no page is available. */
+static bool
+new_arena (struct desc *d)
+{
+  struct arena *a;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  a = palloc_get_page (0);
+  if (a == NULL)
+    return false;
+
+  a->magic = ARENA_MAGIC;
+  a->desc = d;
+  a->free_cnt = d->blocks_per_arena;
+  for (i = 0; i < d->blocks_per_arena; i++) 
+    {
+      struct block *b = arena_to_block (a, i);
+      list_push_back (&d->free_list, &b->free_elem);
+    }
+  return true;
+}
+
+/* Adds block B to the free list of D, whose lock the caller holds,
+   and gives B's arena back to the page allocator if it is now
+   entirely unused. */
+static void
+release_block (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  list_push_front (&d->free_list, &b->free_elem);
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+    }
+}
+
+/* Refills the running thread's empty magazine M for D with half
+   its capacity of blocks, from D's cache and then its free list,
+   and returns one block more.  Returns a null pointer if memory is
+   not available. */
+static struct block *
+mag_refill (struct desc *d, struct magazine *m)
+{
+  size_t want = d->mag_max / 2 + 1;
+  enum intr_level old_level;
+
+  ASSERT (m->cnt == 0);
+
+  old_level = intr_disable ();
+  while (m->cnt < want && !clist_empty (&d->cache))
+    mag_push (m, list_entry (clist_pop_front (&d->cache),
+                             struct block, free_elem));
+  intr_set_level (old_level);
+
+  if (m->cnt < want)
+    {
+      lock_acquire (&d->lock);
+      while (m->cnt < want
+             && (!list_empty (&d->free_list) || new_arena (d)))
+        {
+          struct block *b = list_entry (list_pop_front (&d->free_list),
+                                        struct block, free_elem);
+          block_to_arena (b)->free_cnt--;
+          mag_push (m, b);
+        }
+      lock_release (&d->lock);
+    }
+
+  return m->cnt > 0 ? mag_pop (m) : NULL;
+}
+
+/* Moves CNT blocks from the running thread's magazine M for D back
+   to D: to its cache while there is room, then to its free list. */
+static void
+mag_drain (struct desc *d, struct magazine *m, size_t cnt)
+{
+  ASSERT (cnt <= m->cnt);
+
+  while (cnt > 0)
+    {
+      struct block *b = mag_pop (m);
+
+      if (!cache_push (d, b))
+        {
+          mag_push (m, b);
+          break;
+        }
+      cnt--;
+    }
+  if (cnt > 0)
+    {
+      lock_acquire (&d->lock);
+      for (; cnt > 0; cnt--)
+        release_block (d, mag_pop (m));
+      lock_release (&d->lock);
+    }
+}
+
+/* Pushes free block B onto magazine M. */
+static void
+mag_push (struct magazine *m, struct block *b)
+{
+  struct mag_block *mb = (struct mag_block *) b;
+
+  mb->next = m->top;
+  m->top = mb;
+  m->cnt++;
+}
+
+/* Pops and returns the top block of nonempty magazine M. */
+static struct block *
+mag_pop (struct magazine *m)
+{
+  struct mag_block *mb = m->top;
+
+  ASSERT (m->cnt > 0);
+  m->top = mb->next;
+  m->cnt--;
+  return (struct block *) mb;
+}
+
+/* Tries to make BLOCK hold NEW_SIZE bytes without moving it.
+   Returns true if successful, false if BLOCK is unchanged. */
+static bool
+resize_in_place (void *block, size_t new_size)
+{
+  struct arena *a = block_to_arena (block);
+  struct desc *d = a->desc;
+  size_t page_cnt;
+
+  /* A small block stays put if malloc() would pick the same
+     descriptor for NEW_SIZE. */
+  if (d != NULL)
+    return new_size <= d->block_size
+           && (d == descs || new_size > d[-1].block_size);
+
+  /* A big block cut down to a descriptor's size moves, so that its
+     pages are freed. */
+  if (new_size <= descs[desc_cnt - 1].block_size)
+    return false;
+
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (page_cnt < a->free_cnt)
+    palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                          a->free_cnt - page_cnt);
+  else if (!palloc_extend (a, a->free_cnt, page_cnt))
+    return false;
+  a->free_cnt = page_cnt;
+  return true;
+}
+
+/* Removes and returns a block from D's cache, or returns a null
+   pointer if the cache is empty. */
+static struct block *
+cache_pop (struct desc *d) 
+{
+  struct block *b = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (!clist_empty (&d->cache))
+    b = list_entry (clist_pop_front (&d->cache), struct block, free_elem);
+  intr_set_level (old_level);
+  return b;
+}
+
+/* Returns the number of blocks in all the descriptors' caches. */
+static size_t
+cache_count (void)
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < desc_cnt; i++)
+    cnt += clist_size (&descs[i].cache);
+  return cnt;
+}
+
+/* Returns up to CNT blocks from the descriptors' caches to their
+   free lists, releasing any arena left with no blocks in use.
+   Returns the number of blocks returned. */
+static size_t
+cache_scan (size_t cnt)
+{
+  size_t i, done = 0;
+
+  for (i = 0; i < desc_cnt && done < cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      struct block *b;
+
+      lock_acquire (&d->lock);
+      while (done < cnt && (b = cache_pop (d)) != NULL)
+        {
+          release_block (d, b);
+          done++;
+        }
+      lock_release (&d->lock);
+    }
+  return done;
+}
+
+/* Adds block B to D's cache and returns true, or returns false if
+   the cache is full. */
+static bool
+cache_push (struct desc *d, struct block *b) 
+{
+  bool success = false;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (clist_size (&d->cache) < CACHE_MAX)
+    {
+      clist_push_front (&d->cache, &b->free_elem);
+      success = true;
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
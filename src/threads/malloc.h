@@ -4,10 +4,22 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of block sizes malloc() hands out from arenas. */
+#define MALLOC_CLASS_CNT 7
+
+/* A thread's private stack of free blocks of one size.  See
+   malloc.c. */
+struct magazine
+  {
+    struct mag_block *top;      /* Most recently freed block. */
+    size_t cnt;                 /* Blocks held. */
+  };
+
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_thread_exit (void);
 
 #endif /* threads/malloc.h */
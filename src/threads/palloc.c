@@ -2,13 +2,17 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/shrinker.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +27,80 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**ORDER pages,
+   aligned to their size relative to the pool's base, on one free
+   list per order.  An allocation of N pages takes the smallest
+   block that fits, splitting larger blocks as needed, and gives
+   the pages beyond N back.  Freeing a block merges it with its
+   buddy, the other half of the block it was split from, for as
+   long as the buddy is free too.  Both take O(log n) time.
+
+   The free list links live in the free pages themselves.  Each
+   pool also records, for each page, the order of the free block
+   that starts there, if any, which is how a buddy is recognized
+   as free.
+
+   The pools are protected by disabling interrupts rather than by
+   a lock, because pages are freed from the scheduler, where
+   sleeping is not allowed, and every operation is short. */
+
+/* Largest block order: blocks of up to 2**PALLOC_MAX_ORDER pages. */
+#define PALLOC_MAX_ORDER 12
+
+/* Value in a pool's order map for pages that do not begin a free
+   block. */
+#define ORDER_NONE 0xff
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *orders;                    /* Free block order by page. */
+    struct list free_lists[PALLOC_MAX_ORDER + 1]; /* Free blocks. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Statistics. */
+    size_t used_cnt;                    /* Pages allocated. */
+    size_t peak_used;                   /* Maximum of used_cnt. */
+    size_t failures;                    /* Failed allocations. */
+  };
+
+/* A free block, stored in its first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Reserve of user pages that are already zeroed, kept topped up
+   by a low-priority background thread so that zeroed user pages
+   can be handed out on the page fault path without a memset.
+   Pages in the reserve are allocated as far as the buddy lists
+   are concerned; they are given out to any user allocation once
+   the user pool is otherwise exhausted. */
+#define ZERO_RESERVE 32                 /* Pages kept zeroed. */
+#define ZERO_LOW_WATER 16               /* Wake zeroer below this. */
+static struct clist zeroed_pages;       /* Zeroed pages, as free_blocks. */
+static struct semaphore zero_wanted;    /* Upped to wake the zeroer. */
+static bool zeroer_running;             /* Has the zeroer started? */
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *get_pages (struct pool *, size_t page_cnt);
+static void *take_zeroed (void);
+static thread_func zeroer;
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_claim (struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_free_block (struct pool *, size_t page_idx, int order);
+static struct free_block *page_block (const struct pool *, size_t page_idx);
+static size_t block_page (const struct pool *, struct free_block *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -59,6 +121,19 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+
+  clist_init (&zeroed_pages);
+  sema_init (&zero_wanted, 0);
+}
+
+/* Starts the background thread that keeps a reserve of zeroed
+   user pages.  Until it runs, zeroed user pages are zeroed on
+   demand as usual. */
+void
+palloc_start_zeroer (void)
+{
+  zeroer_running = true;
+  thread_create ("zeroer", PRI_MIN, zeroer, NULL);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -71,28 +146,27 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
-  size_t page_idx;
+  bool single_user = pool == &user_pool && page_cnt == 1;
+  void *pages = NULL;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
-
-  if (pages != NULL) 
+  /* A zeroed user page comes from the reserve if possible. */
+  if (single_user && (flags & PAL_ZERO))
+    pages = take_zeroed ();
+  if (pages == NULL)
     {
-      if (flags & PAL_ZERO)
+      pages = get_pages (pool, page_cnt);
+      if (pages != NULL && (flags & PAL_ZERO))
         memset (pages, 0, PGSIZE * page_cnt);
+      else if (pages == NULL && single_user)
+        pages = take_zeroed ();
     }
-  else 
+
+  if (pages == NULL) 
     {
+      pool->failures++;
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
     }
@@ -100,6 +174,83 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Takes PAGE_CNT contiguous pages from POOL's buddy lists and
+   returns the first, or a null pointer if none are available. */
+static void *
+get_pages (struct pool *pool, size_t page_cnt)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+
+  old_level = intr_disable ();
+  page_idx = buddy_alloc (pool, page_cnt);
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      pool->used_cnt += page_cnt;
+      if (pool->used_cnt > pool->peak_used)
+        pool->peak_used = pool->used_cnt;
+    }
+  intr_set_level (old_level);
+
+  return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Takes a page from the zeroed reserve and returns it, or returns
+   a null pointer if the reserve is empty.  Wakes the zeroer when
+   the reserve runs low. */
+static void *
+take_zeroed (void)
+{
+  enum intr_level old_level;
+  struct free_block *b = NULL;
+
+  old_level = intr_disable ();
+  if (!clist_empty (&zeroed_pages))
+    {
+      b = list_entry (clist_pop_front (&zeroed_pages), struct free_block,
+                      elem);
+      /* The list link was the only thing written to the page. */
+      memset (b, 0, sizeof *b);
+    }
+  if (zeroer_running && clist_size (&zeroed_pages) < ZERO_LOW_WATER
+      && !list_empty (&zero_wanted.waiters))
+    sema_up (&zero_wanted);
+  intr_set_level (old_level);
+  return b;
+}
+
+/* Background thread that tops up the zeroed page reserve, then
+   sleeps until the reserve runs low again.  Runs at the lowest
+   priority, so pages are zeroed while the CPU would otherwise
+   idle. */
+static void
+zeroer (void *aux UNUSED)
+{
+  if (thread_mlfqs)
+    thread_set_nice (NICE_MAX);
+  for (;;)
+    {
+      /* Pages the user pool is short of are not worth zeroing. */
+      while (clist_size (&zeroed_pages) < ZERO_RESERVE
+             && !shrinker_pressure (true))
+        {
+          enum intr_level old_level;
+          void *page = get_pages (&user_pool, 1);
+
+          if (page == NULL)
+            break;
+          memset (page, 0, PGSIZE);
+          old_level = intr_disable ();
+          clist_push_front (&zeroed_pages,
+                            &((struct free_block *) page)->elem);
+          intr_set_level (old_level);
+        }
+      sema_down (&zero_wanted);
+    }
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -118,6 +269,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +289,12 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->used_cnt -= page_cnt;
+  buddy_free (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +304,143 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Grows the group of PAGE_CNT pages starting at PAGES, obtained
+   from palloc_get_multiple(), to NEW_CNT pages by taking the pages
+   that follow it, if they are all free.  Returns true if
+   successful, false if the group is left as it was.  The new pages
+   are not zeroed. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_cnt)
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx, extra;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base) + page_cnt;
+  extra = new_cnt - page_cnt;
+  if (extra == 0)
+    return true;
+
+  old_level = intr_disable ();
+  if (page_idx + extra <= bitmap_size (pool->used_map)
+      && bitmap_none (pool->used_map, page_idx, extra))
+    {
+      buddy_claim (pool, page_idx, extra);
+      bitmap_set_multiple (pool->used_map, page_idx, extra, true);
+      pool->used_cnt += extra;
+      if (pool->used_cnt > pool->peak_used)
+        pool->peak_used = pool->used_cnt;
+      success = true;
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Fills in *STATS for the user pool if USER is true, otherwise
+   for the kernel pool.  Pages in the zeroed reserve count as
+   allocated. */
+void
+palloc_get_stats (bool user, struct memstat *stats)
+{
+  struct pool *pool = user ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  int order;
+
+  old_level = intr_disable ();
+  stats->total = bitmap_size (pool->used_map);
+  stats->free = stats->total - pool->used_cnt;
+  stats->largest_free = 0;
+  for (order = PALLOC_MAX_ORDER; order >= 0; order--)
+    if (!list_empty (&pool->free_lists[order]))
+      {
+        stats->largest_free = (size_t) 1 << order;
+        break;
+      }
+  stats->peak_used = pool->peak_used;
+  stats->failures = pool->failures;
+  intr_set_level (old_level);
+}
+
+/* Returns the number of user pages held in the zeroed reserve. */
+size_t
+palloc_zeroed_cnt (void)
+{
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  cnt = clist_size (&zeroed_pages);
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Returns the first page of the user pool and stores the number
+   of pages in it in *PAGE_CNT.  The pool is contiguous, so
+   per-frame tables may be indexed by page offset from the base. */
+void *
+palloc_user_base (size_t *page_cnt)
+{
+  *page_cnt = bitmap_size (user_pool.used_map);
+  return user_pool.base;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  int user;
+
+  for (user = 0; user <= 1; user++)
+    {
+      struct memstat s;
+
+      palloc_get_stats (user, &s);
+      printf ("Palloc: %s pool: %zu of %zu pages free, largest free block "
+              "%zu, peak use %zu, %zu failures\n",
+              user ? "user" : "kernel", s.free, s.total, s.largest_free,
+              s.peak_used, s.failures);
+    }
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and order map at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool, then hand all of its pages to the buddy
+     lists. */
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->orders = (uint8_t *) base + bm_size;
+  memset (p->orders, ORDER_NONE, page_cnt);
+  for (order = 0; order <= PALLOC_MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  p->used_cnt = p->peak_used = p->failures = 0;
+  buddy_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +454,132 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Takes PAGE_CNT contiguous pages from POOL's buddy lists and
+   returns the index of the first, or BITMAP_ERROR if no free
+   block is large enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  struct free_block *b;
+  size_t page_idx;
+  int want, order;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Find the smallest order that holds PAGE_CNT pages, then the
+     smallest nonempty free list at least that large. */
+  for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+    if (want == PALLOC_MAX_ORDER)
+      return BITMAP_ERROR;
+  for (order = want; order <= PALLOC_MAX_ORDER; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order > PALLOC_MAX_ORDER)
+    return BITMAP_ERROR;
+
+  b = list_entry (list_pop_front (&pool->free_lists[order]),
+                  struct free_block, elem);
+  page_idx = block_page (pool, b);
+  ASSERT (pool->orders[page_idx] == order);
+  pool->orders[page_idx] = ORDER_NONE;
+
+  /* Split off upper halves until the block is the wanted size. */
+  while (order > want)
+    {
+      order--;
+      buddy_free_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+
+  /* Give back the pages we were not asked for. */
+  buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Takes the PAGE_CNT free pages starting at PAGE_IDX, which
+   follows an allocated page, off POOL's buddy lists, giving back
+   the part of the last free block they end inside. */
+static void
+buddy_claim (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t end = page_idx + page_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Free blocks are disjoint and never span an allocated page, so
+     a free block begins at PAGE_IDX and then at each page just
+     past the one before it. */
+  while (page_idx < end)
+    {
+      int order = pool->orders[page_idx];
+
+      ASSERT (order != ORDER_NONE);
+      list_remove (&page_block (pool, page_idx)->elem);
+      pool->orders[page_idx] = ORDER_NONE;
+      page_idx += (size_t) 1 << order;
+    }
+  buddy_free (pool, end, page_idx - end);
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's buddy
+   lists, as the largest aligned blocks that cover them. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < PALLOC_MAX_ORDER
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      buddy_free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Adds the free block of 2**ORDER pages at PAGE_IDX to POOL's
+   buddy lists, first merging it with its buddy for as long as
+   the buddy is also free. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, int order)
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT ((page_idx & (((size_t) 1 << order) - 1)) == 0);
+
+  while (order < PALLOC_MAX_ORDER)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > page_cnt
+          || pool->orders[buddy] != order)
+        break;
+      list_remove (&page_block (pool, buddy)->elem);
+      pool->orders[buddy] = ORDER_NONE;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+
+  pool->orders[page_idx] = order;
+  list_push_front (&pool->free_lists[order],
+                   &page_block (pool, page_idx)->elem);
+}
+
+/* Returns the free block header in page PAGE_IDX of POOL. */
+static struct free_block *
+page_block (const struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index within POOL of the page holding block B. */
+static size_t
+block_page (const struct pool *pool, struct free_block *b)
+{
+  return pg_no (b) - pg_no (pool->base);
+}
@@ -1,6 +1,8 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <memstat.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -12,9 +14,15 @@ enum palloc_flags
   };
 
 void palloc_init (size_t user_page_limit);
+void palloc_start_zeroer (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend (void *, size_t page_cnt, size_t new_cnt);
+void palloc_get_stats (bool user, struct memstat *);
+size_t palloc_zeroed_cnt (void);
+void *palloc_user_base (size_t *page_cnt);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
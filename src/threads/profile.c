@@ -0,0 +1,96 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Sampling profiler.
+
+   With -profile, every timer tick counts the eip it interrupted,
+   user or kernel, in a histogram kept in a hash table.  Nothing
+   else is recorded, so a sample costs a few dozen instructions in
+   an interrupt that is taken anyway.  The histogram is printed at
+   shutdown, for utils/pintos-profile to turn into a flat profile
+   by function. */
+
+bool profile_enabled;
+
+/* One histogram bucket. */
+struct profile_slot
+  {
+    uint32_t eip;               /* Sampled address, 0 if slot free. */
+    uint32_t count;             /* Samples at EIP. */
+  };
+
+/* Pages in the hash table, slots that fit in them, and slots
+   searched for an address before its sample is dropped. */
+#define PROFILE_PAGES 8
+#define PROFILE_SLOTS (PROFILE_PAGES * PGSIZE / sizeof (struct profile_slot))
+#define PROFILE_PROBES 16
+
+static struct profile_slot *slots;
+static unsigned long long sample_cnt;   /* Samples taken. */
+static unsigned long long user_cnt;     /* Samples in user code. */
+static unsigned long long drop_cnt;     /* Samples not counted. */
+
+/* Allocates the histogram, if -profile was given. */
+void
+profile_init (void)
+{
+  if (!profile_enabled)
+    return;
+  slots = palloc_get_multiple (PAL_ZERO, PROFILE_PAGES);
+  if (slots == NULL)
+    {
+      printf ("profile: no memory for histogram, ignoring -profile.\n");
+      profile_enabled = false;
+    }
+}
+
+/* Counts a sample of the eip in interrupt frame F.  Called by the
+   timer interrupt handler. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  uint32_t eip = (uint32_t) f->eip;
+  size_t i, probe;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  sample_cnt++;
+  if ((f->cs & 3) != 0)
+    user_cnt++;
+
+  i = (eip * 2654435761u) % PROFILE_SLOTS;
+  for (probe = 0; probe < PROFILE_PROBES; probe++)
+    {
+      struct profile_slot *s = &slots[(i + probe) % PROFILE_SLOTS];
+
+      if (s->eip == eip || s->eip == 0)
+        {
+          s->eip = eip;
+          s->count++;
+          return;
+        }
+    }
+  drop_cnt++;
+}
+
+/* Prints the histogram, one address per line, in the form that
+   utils/pintos-profile reads. */
+void
+profile_print_stats (void)
+{
+  size_t i;
+
+  if (slots == NULL)
+    return;
+
+  printf ("Profile: %llu samples, %llu in user code, %llu dropped\n",
+          sample_cnt, user_cnt, drop_cnt);
+  for (i = 0; i < PROFILE_SLOTS; i++)
+    if (slots[i].count != 0)
+      printf ("profile %08"PRIx32" %"PRIu32"\n", slots[i].eip,
+              slots[i].count);
+}
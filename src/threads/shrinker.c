@@ -0,0 +1,129 @@
+#include "threads/shrinker.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Reclaim hooks for kernel caches.
+
+   A cache that keeps memory it could give back, such as the
+   blocks malloc() holds in front of its free lists, registers a
+   shrinker: a count of the objects it could free and a callback
+   that frees some of them.  When a pool runs low, the page-out
+   daemon calls shrink_caches(), which asks every shrinker on that
+   pool for a share of the objects wanted in proportion to how
+   many it holds, so that the biggest cache gives back the most.
+   For the user pool this happens before any user page is evicted.
+
+   Each call also marks the pool as under pressure for
+   PRESSURE_TICKS, which caches that would otherwise grow on their
+   own read with shrinker_pressure() and take as a cue to hold
+   back.  When memory is plentiful no shrinker is called and
+   caches grow as they like.
+
+   Shrinkers are registered once, during initialization, and never
+   removed, so the registry is walked without a lock.  Callbacks
+   run in the page-out thread and may sleep. */
+
+/* Ticks a pool counts as under pressure after a shrink. */
+#define PRESSURE_TICKS TIMER_FREQ
+
+static struct list shrinkers = LIST_INITIALIZER (shrinkers);
+
+/* Ticks of the last shrink of the kernel and user pools, and
+   whether there has been one. */
+static int64_t pressure_ticks[2];
+static bool pressured[2];
+
+/* Adds SHRINKER to the registry. */
+void
+shrinker_register (struct shrinker *shrinker)
+{
+  enum intr_level old_level;
+
+  ASSERT (shrinker->count != NULL && shrinker->scan != NULL);
+
+  shrinker->freed = 0;
+  old_level = intr_disable ();
+  list_push_back (&shrinkers, &shrinker->elem);
+  intr_set_level (old_level);
+}
+
+/* Asks the shrinkers of the user pool if USER, otherwise of the
+   kernel pool, to free CNT objects in all, each in proportion to
+   the objects it holds, and marks the pool as under pressure.
+   Returns the number of objects freed. */
+size_t
+shrink_caches (bool user, size_t cnt)
+{
+  struct list_elem *e;
+  size_t total = 0, freed = 0;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  pressure_ticks[user] = timer_ticks ();
+  pressured[user] = true;
+  intr_set_level (old_level);
+  if (cnt == 0)
+    return 0;
+
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+
+      if (s->user == user)
+        total += s->count ();
+    }
+  if (total == 0)
+    return 0;
+
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+      size_t want, done;
+
+      if (s->user != user)
+        continue;
+      want = DIV_ROUND_UP ((unsigned long long) cnt * s->count (), total);
+      if (want == 0)
+        continue;
+      done = s->scan (want);
+      s->freed += done;
+      freed += done;
+    }
+  return freed;
+}
+
+/* Returns true if the user pool if USER, otherwise the kernel
+   pool, has been short of memory within the last PRESSURE_TICKS. */
+bool
+shrinker_pressure (bool user)
+{
+  enum intr_level old_level;
+  bool pressure;
+
+  old_level = intr_disable ();
+  pressure = (pressured[user]
+              && timer_elapsed (pressure_ticks[user]) < PRESSURE_TICKS);
+  intr_set_level (old_level);
+  return pressure;
+}
+
+/* Prints, for each shrinker that has freed anything, how much. */
+void
+shrinker_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+
+      if (s->freed > 0)
+        printf ("Shrinker %s: %llu objects freed\n", s->name, s->freed);
+    }
+}
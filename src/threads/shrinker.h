@@ -0,0 +1,26 @@
+#ifndef THREADS_SHRINKER_H
+#define THREADS_SHRINKER_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A kernel cache that can give memory back under pressure.  See
+   shrinker.c for details. */
+struct shrinker
+  {
+    const char *name;           /* Name, for statistics. */
+    bool user;                  /* Holds user pool pages? */
+    size_t (*count) (void);     /* Objects it could free now. */
+    size_t (*scan) (size_t cnt); /* Frees up to CNT objects and
+                                    returns how many it freed. */
+    struct list_elem elem;      /* Element in the registry. */
+    unsigned long long freed;   /* Objects freed so far. */
+  };
+
+void shrinker_register (struct shrinker *);
+size_t shrink_caches (bool user, size_t cnt);
+bool shrinker_pressure (bool user);
+void shrinker_print_stats (void);
+
+#endif /* threads/shrinker.h */
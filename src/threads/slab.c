@@ -0,0 +1,203 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator for fixed-size kernel objects.
+
+   Each cache hands out objects of one size, packed back to back
+   into single pages called slabs, so there is none of the
+   rounding up to a power of 2 that malloc() does.  A slab starts
+   with a header, followed by as many object buffers as fit.
+   Each buffer holds an object followed by a pointer that links
+   it into its slab's free list while it is free, so that a free
+   object keeps whatever state the cache's constructor gave it.
+
+   A cache keeps its slabs on two lists, partial and full, and
+   holds on to at most one empty slab.  Allocation takes an
+   object from the first partial slab, and freeing finds the slab
+   by rounding the object's address down to a page boundary, so
+   both are O(1).
+
+   The constructor, if any, is run on every object when its slab
+   is created, and the destructor when the slab is given back to
+   the page allocator.  An object allocated from the cache is in
+   the state the constructor left it in, or that its last user
+   left it in before freeing it. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A slab, at the beginning of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in partial or full list. */
+    size_t in_use;              /* Number of allocated objects. */
+    void *free;                 /* First free object, or null. */
+  };
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct slab *);
+static void **free_link (struct kmem_cache *, void *obj);
+
+/* Initializes CACHE to hand out objects of SIZE bytes, with the
+   given NAME and optional CTOR and DTOR hooks. */
+void
+kmem_cache_init (struct kmem_cache *cache, const char *name, size_t size,
+                 kmem_ctor_func *ctor, kmem_dtor_func *dtor)
+{
+  ASSERT (cache != NULL);
+  ASSERT (size > 0);
+
+  cache->name = name;
+  cache->obj_size = ROUND_UP (size, sizeof (void *));
+  cache->buf_size = cache->obj_size + sizeof (void *);
+  cache->objs_per_slab = (PGSIZE - sizeof (struct slab)) / cache->buf_size;
+  ASSERT (cache->objs_per_slab > 0);
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+  list_init (&cache->partial);
+  list_init (&cache->full);
+  cache->empty = NULL;
+  lock_init (&cache->lock);
+}
+
+/* Obtains and returns an object from CACHE.
+   Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&cache->lock);
+  if (!list_empty (&cache->partial))
+    s = list_entry (list_front (&cache->partial), struct slab, elem);
+  else
+    {
+      if (cache->empty != NULL)
+        {
+          s = cache->empty;
+          cache->empty = NULL;
+        }
+      else
+        {
+          s = slab_create (cache);
+          if (s == NULL)
+            {
+              lock_release (&cache->lock);
+              return NULL;
+            }
+        }
+      list_push_front (&cache->partial, &s->elem);
+    }
+
+  obj = s->free;
+  s->free = *free_link (cache, obj);
+  if (++s->in_use == cache->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_back (&cache->full, &s->elem);
+    }
+  lock_release (&cache->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from CACHE, to
+   CACHE.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+  ASSERT ((pg_ofs (obj) - sizeof *s) % cache->buf_size == 0);
+
+  lock_acquire (&cache->lock);
+  *free_link (cache, obj) = s->free;
+  s->free = obj;
+  if (s->in_use-- == cache->objs_per_slab)
+    {
+      /* Full slab becomes partial. */
+      list_remove (&s->elem);
+      list_push_front (&cache->partial, &s->elem);
+    }
+  if (s->in_use == 0)
+    {
+      list_remove (&s->elem);
+      if (cache->empty == NULL)
+        cache->empty = s;
+      else
+        slab_destroy (s);
+    }
+  lock_release (&cache->lock);
+}
+
+/* Allocates a new slab for CACHE, with all its objects free and
+   constructed.  Returns a null pointer if no page is available. */
+static struct slab *
+slab_create (struct kmem_cache *cache)
+{
+  struct slab *s;
+  uint8_t *buf;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->in_use = 0;
+  s->free = NULL;
+
+  /* Thread the free list from the last object down, so that
+     allocation proceeds in address order. */
+  buf = (uint8_t *) (s + 1) + cache->objs_per_slab * cache->buf_size;
+  for (i = 0; i < cache->objs_per_slab; i++)
+    {
+      buf -= cache->buf_size;
+      if (cache->ctor != NULL)
+        cache->ctor (buf);
+      *free_link (cache, buf) = s->free;
+      s->free = buf;
+    }
+  return s;
+}
+
+/* Runs the destructor on each object of empty slab S and gives
+   its page back to the page allocator. */
+static void
+slab_destroy (struct slab *s)
+{
+  struct kmem_cache *cache = s->cache;
+
+  ASSERT (s->in_use == 0);
+
+  if (cache->dtor != NULL)
+    {
+      uint8_t *buf = (uint8_t *) (s + 1);
+      size_t i;
+
+      for (i = 0; i < cache->objs_per_slab; i++, buf += cache->buf_size)
+        cache->dtor (buf);
+    }
+  s->magic = 0;
+  palloc_free_page (s);
+}
+
+/* Returns the free list link that follows OBJ in CACHE. */
+static void **
+free_link (struct kmem_cache *cache, void *obj)
+{
+  return (void **) ((uint8_t *) obj + cache->obj_size);
+}
@@ -0,0 +1,33 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Constructor and destructor hooks for the objects of a cache. */
+typedef void kmem_ctor_func (void *obj);
+typedef void kmem_dtor_func (void *obj);
+
+/* A cache of fixed-size objects, carved out of whole pages
+   ("slabs").  See slab.c for details. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for debugging. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t buf_size;            /* Object plus free list link. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor_func *ctor;       /* Run on each object of a new slab. */
+    kmem_dtor_func *dtor;       /* Run on each object of a freed slab. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct slab *empty;         /* One spare slab, or null. */
+    struct lock lock;           /* Protects the lists above. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      kmem_ctor_func *, kmem_dtor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
+#endif /* threads/slab.h */
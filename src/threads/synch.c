@@ -29,12 +29,39 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
 static bool compare_semaphore_elem (const struct list_elem *,
                              const struct list_elem *,
                              void *aux);
+static bool semaphore_elem_higher_priority (const struct list_elem *,
+                                            const struct list_elem *,
+                                            void *aux);
+static bool waiter_higher_priority (const struct list_elem *,
+                                    const struct list_elem *,
+                                    void *aux);
+static struct list_elem *waiters_highest (struct list *,
+                                          list_less_func *);
+static void sema_reposition_waiter (struct semaphore *, struct thread *);
+static int sema_wake_one (struct semaphore *);
+static void yield_to_priority (int priority);
+static void lock_update_max_waiter (struct lock *);
+static void lock_spin (struct lock *);
+
+/* If true, lock_acquire() lets a preempted holder run before
+   blocking.  Controlled by kernel command-line option
+   "-adaptive-locks". */
+bool lock_adaptive;
+
+/* Maximum number of times lock_acquire() yields to a runnable
+   holder before blocking. */
+#define LOCK_SPIN_YIELDS 4
+
+/* Locks named with lock_set_name(), whose statistics are printed
+   by lock_print_stats(). */
+static struct list named_locks = LIST_INITIALIZER (named_locks);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -72,13 +99,56 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back(&sema->waiters, &thread_current ()->elem); 
+      list_insert_ordered (&sema->waiters, &thread_current ()->elem,
+                           waiter_higher_priority, NULL);
       thread_block ();
     }
   sema->value--;
   intr_set_level (old_level);
 }
 
+/* Down or "P" operation on a semaphore that gives up after
+   TICKS timer ticks.  Returns true if SEMA was decremented, false
+   if the timeout expired first.  A waiting thread sits in the
+   timing wheel of threads/thread.c rather than polling, so it
+   costs nothing until it is signaled or the deadline passes.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks) 
+{
+  enum intr_level old_level;
+  int64_t deadline = timer_ticks () + ticks;
+  struct thread *cur = thread_current ();
+  bool success = true;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (sema->value == 0) 
+    {
+      if (!thread_timeout_arm (cur, deadline))
+        {
+          success = false;
+          break;
+        }
+      list_insert_ordered (&sema->waiters, &cur->elem,
+                           waiter_higher_priority, NULL);
+      thread_block ();
+      if (cur->timed_out)
+        {
+          success = false;
+          break;
+        }
+    }
+  if (success)
+    sema->value--;
+  intr_set_level (old_level);
+  return success;
+}
+
 /* Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
@@ -112,32 +182,71 @@ sema_try_down (struct semaphore *sema)
    This function may be called from an interrupt handler. */
 void
 sema_up (struct semaphore *sema) 
+{
+  sema_up_many (sema, 1);
+}
+
+/* Performs N "V" operations on SEMA at once, waking up to N of
+   its highest priority waiters.  Unlike calling sema_up() N
+   times, the running thread yields at most once, after all of
+   them are ready, and only if one of them has a higher priority.
+   This function may be called from an interrupt handler. */
+void
+sema_up_many (struct semaphore *sema, unsigned n) 
 {
   enum intr_level old_level;
+  int woken_priority = LOCK_NO_WAITERS;
 
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
+  while (n-- > 0)
+    {
+      int priority = sema_wake_one (sema);
+      if (priority > woken_priority)
+        woken_priority = priority;
+    }
+  yield_to_priority (woken_priority);
+  intr_set_level (old_level);
+}
+
+/* Increments SEMA's value and readies the highest priority thread
+   waiting for SEMA, if any, without yielding.  Returns the woken
+   thread's priority, or LOCK_NO_WAITERS if none was waiting. */
+static int
+sema_wake_one (struct semaphore *sema) 
+{
+  struct thread *highest_priority_waiter;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
   sema->value++;
+  if (list_empty (&sema->waiters))
+    return LOCK_NO_WAITERS;
+
+  highest_priority_waiter = list_entry (waiters_highest (&sema->waiters,
+                          thread_compare_priority), struct thread, elem);
+  list_remove (&highest_priority_waiter->elem);
+  thread_timeout_cancel (highest_priority_waiter);
+  thread_unblock (highest_priority_waiter);
+  return highest_priority_waiter->priority;
+}
 
-  if (!list_empty (&sema->waiters)) 
-  {
-    struct thread *highest_priority_waiter =
-                    list_entry (list_max (&sema->waiters,
-                          thread_compare_priority, NULL), struct thread, elem);
-
-    list_remove (&highest_priority_waiter->elem);
-    thread_unblock (highest_priority_waiter);
-    
-    if (highest_priority_waiter->priority > thread_current ()->priority)
-      {
-        if (intr_context ())
-          intr_yield_on_return ();
-        else
-          thread_yield ();
-      }
-  }
-  intr_set_level (old_level);
+/* Yields the CPU if a thread of PRIORITY was just made ready and
+   should preempt the running thread.  Within an interrupt
+   handler, yields on return instead. */
+static void
+yield_to_priority (int priority) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
 }
 
 static void sema_test_helper (void *sema_);
@@ -198,9 +307,49 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_waiter_priority = LOCK_NO_WAITERS;
+  lock->name = NULL;
+  lock->acquires = lock->contended = 0;
+  lock->wait_ticks = lock->max_wait_ticks = 0;
   sema_init (&lock->semaphore, 1);
 }
 
+/* Gives LOCK the name NAME, which must stay valid for as long as
+   the lock exists, so that its contention statistics are printed
+   by lock_print_stats().  LOCK must live until shutdown. */
+void
+lock_set_name (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  if (lock->name == NULL)
+    list_push_back (&named_locks, &lock->named_elem);
+  lock->name = name;
+  intr_set_level (old_level);
+}
+
+/* Prints the contention statistics of every named lock. */
+void
+lock_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&named_locks); e != list_end (&named_locks);
+       e = list_next (e))
+    {
+      struct lock *l = list_entry (e, struct lock, named_elem);
+
+      printf ("Lock %s: %u acquires, %u contended, "
+              "%lld wait ticks (max %lld)\n",
+              l->name, l->acquires, l->contended,
+              l->wait_ticks, l->max_wait_ticks);
+    }
+}
+
 /* Acquires LOCK, donating its priority and sleeping until it
    becomes available if necessary.  The lock must not already be
    held by the current thread.
@@ -219,28 +368,46 @@ lock_acquire (struct lock *lock)
   ASSERT (!lock_held_by_current_thread (lock));
   
   old_level = intr_disable ();
-  if (thread_mlfqs)
-    {
-      sema_down (&lock->semaphore);
-      lock->holder = thread_current ();
-    } 
+
+  /* Fast path: an uncontended lock is taken without going through
+     the semaphore or the donation machinery. */
+  if (lock->semaphore.value > 0)
+    lock->semaphore.value--;
   else
     {
-    /* Perform priority donation if thread doesn't acquire lock */
-      if (!sema_try_down (&lock->semaphore))
+      int64_t start = timer_ticks ();
+      int64_t waited;
+
+      if (thread_mlfqs)
+        sema_down (&lock->semaphore);
+      else
         {
+          /* Perform priority donation if thread doesn't acquire lock */
           int level = 0;
           thread_current ()->waiting_lock = lock;
           lock_priority_donate (lock, thread_current ()->priority, level);
+          if (lock_adaptive)
+            lock_spin (lock);
           sema_down (&lock->semaphore);
+          thread_current ()->waiting_lock = NULL;
+
+          /* We are no longer a waiter, so the cached maximum may have
+             been ours. */
+          lock_update_max_waiter (lock);
         }
-      
-      thread_current()->waiting_lock = NULL;
 
-      /* Current Thread is the holder */
-      lock->holder = thread_current ();
-      list_push_back (&thread_current ()->locks_held, &lock->locks_held_elem);
+      waited = timer_ticks () - start;
+      lock->contended++;
+      lock->wait_ticks += waited;
+      if (waited > lock->max_wait_ticks)
+        lock->max_wait_ticks = waited;
     }
+  lock->acquires++;
+
+  /* Current Thread is the holder */
+  lock->holder = thread_current ();
+  if (!thread_mlfqs)
+    list_push_back (&thread_current ()->locks_held, &lock->locks_held_elem);
   intr_set_level (old_level);
 }
 
@@ -261,6 +428,7 @@ lock_try_acquire (struct lock *lock)
   success = sema_try_down (&lock->semaphore);
   if (success)
   {
+    lock->acquires++;
     if (thread_mlfqs)
       lock->holder = thread_current ();
     else
@@ -279,6 +447,54 @@ lock_try_acquire (struct lock *lock)
   return success;
 }
 
+/* Tries for at most TICKS timer ticks to acquire LOCK, donating
+   priority to its holder meanwhile.  Returns true if successful,
+   false if the timeout expired first.  The lock must not already
+   be held by the current thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+lock_try_acquire_for (struct lock *lock, int64_t ticks)
+{
+  enum intr_level old_level;
+  struct thread *cur = thread_current ();
+  bool success;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  if (lock->semaphore.value > 0 || thread_mlfqs)
+    success = sema_down_timeout (&lock->semaphore, ticks);
+  else
+    {
+      cur->waiting_lock = lock;
+      lock_priority_donate (lock, cur->priority, 0);
+      success = sema_down_timeout (&lock->semaphore, ticks);
+      cur->waiting_lock = NULL;
+      lock_update_max_waiter (lock);
+
+      /* Take back what we donated to a holder we gave up on.  Any
+         threads further down the chain keep it until they release
+         the locks it passed through. */
+      if (!success && lock->holder != NULL)
+        thread_set_effective_priority (lock->holder,
+                          thread_max_waiting_priority (lock->holder));
+    }
+
+  if (success)
+    {
+      lock->acquires++;
+      lock->holder = cur;
+      if (!thread_mlfqs)
+        list_push_back (&cur->locks_held, &lock->locks_held_elem);
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
 /* Releases LOCK, which must be owned by the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -324,6 +540,7 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
 /* Initializes condition variable COND.  A condition variable
@@ -368,12 +585,52 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  waiter.thread = thread_current ();
+  list_insert_ordered (&cond->waiters, &waiter.elem,
+                       semaphore_elem_higher_priority, NULL);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but stops waiting for COND after TICKS timer
+   ticks.  LOCK is reacquired before returning in either case.
+   Returns true if COND was signaled, false if the timeout expired
+   first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks) 
+{
+  struct semaphore_elem waiter;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+  
+  sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
+  list_insert_ordered (&cond->waiters, &waiter.elem,
+                       semaphore_elem_higher_priority, NULL);
+  lock_release (lock);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  /* Signalers remove waiters under LOCK, so now that we hold it
+     again we can tell whether a signal raced with our timeout. */
+  if (!signaled)
+    {
+      if (waiter.semaphore.value > 0)
+        signaled = true;
+      else
+        list_remove (&waiter.elem);
+    }
+  return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals the highest priority of them to wake up
    from its wait. LOCK must be held before calling this function.
@@ -391,8 +648,8 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 
   if (!list_empty (&cond->waiters))
     {
-      struct list_elem *highest_priority_waiter = list_max (&cond->waiters,
-                compare_semaphore_elem, NULL);
+      struct list_elem *highest_priority_waiter =
+                waiters_highest (&cond->waiters, compare_semaphore_elem);
       list_remove (highest_priority_waiter);
       sema_up (&list_entry (highest_priority_waiter, struct semaphore_elem,
                             elem)->semaphore);
@@ -400,7 +657,9 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
-   LOCK).  LOCK must be held before calling this function.
+   LOCK).  LOCK must be held before calling this function.  All
+   waiters are made ready before the running thread yields, so
+   it is preempted at most once.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -408,33 +667,229 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 void
 cond_broadcast (struct condition *cond, struct lock *lock) 
 {
+  enum intr_level old_level;
+  int woken_priority = LOCK_NO_WAITERS;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+    {
+      struct list_elem *highest_priority_waiter =
+                waiters_highest (&cond->waiters, compare_semaphore_elem);
+      int priority;
+
+      list_remove (highest_priority_waiter);
+      priority = sema_wake_one (&list_entry (highest_priority_waiter,
+                                             struct semaphore_elem,
+                                             elem)->semaphore);
+      if (priority > woken_priority)
+        woken_priority = priority;
+    }
+  yield_to_priority (woken_priority);
+  intr_set_level (old_level);
+}
+
+/* Initializes RWLOCK, which is initially held by nobody. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->writer);
+  lock_init (&rwlock->guard);
+  cond_init (&rwlock->no_readers);
+  rwlock->readers = 0;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it
+   or is waiting for it.  The current thread must not already hold
+   RWLOCK for writing.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  /* Passing through WRITER queues us behind any writer, donating
+     to it while we wait. */
+  lock_acquire (&rwlock->writer);
+  lock_acquire (&rwlock->guard);
+  rwlock->readers++;
+  lock_release (&rwlock->guard);
+  lock_release (&rwlock->writer);
+  thread_current ()->read_locks++;
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   reading.  The last reader out lets a waiting writer in. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->guard);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0)
+    cond_signal (&rwlock->no_readers, &rwlock->guard);
+  lock_release (&rwlock->guard);
+  ASSERT (thread_current ()->read_locks > 0);
+  thread_current ()->read_locks--;
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it.  Readers arriving after us wait until we release it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->writer);
+  lock_acquire (&rwlock->guard);
+  while (rwlock->readers > 0)
+    cond_wait (&rwlock->no_readers, &rwlock->guard);
+  lock_release (&rwlock->guard);
 }
 
-/* Recursively donates priority NEW_PRIORITY to the holder of the
-   LOCK and any threads that the LOCK holder is waiting on with
-   maximum recursion LEVEL 8. */
+/* Releases RWLOCK, which the current thread must hold for
+   writing. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock_held_for_write (rwlock));
+
+  lock_release (&rwlock->writer);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing. */
+bool
+rwlock_held_for_write (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return lock_held_by_current_thread (&rwlock->writer);
+}
+
+/* Donates priority NEW_PRIORITY to the holder of the LOCK and
+   any threads that the LOCK holder is waiting on, following the
+   chain at most 8 levels past LEVEL.  Each lock on the chain
+   records NEW_PRIORITY as its highest waiter priority. */
 void
 lock_priority_donate (struct lock *lock, int new_priority, int level)
 {
-  if (level > 8 || !lock)
-    return;
+  for (; lock != NULL && level <= 8; level++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (new_priority > lock->max_waiter_priority)
+        lock->max_waiter_priority = new_priority;
 
-  struct thread * holder = lock->holder;
-  if (new_priority > holder->priority)
+      if (holder == NULL || new_priority <= holder->priority)
+        return;
+      thread_set_effective_priority (holder, new_priority);
+      lock = holder->waiting_lock;
+      if (lock != NULL)
+        sema_reposition_waiter (&lock->semaphore, holder);
+    }
+}
+
+/* Lets the holder of LOCK run for a while if it was preempted
+   rather than blocked, since it will probably release LOCK soon,
+   sparing us a sleep and wakeup.  On a uniprocessor the
+   holder cannot be running while we are, so instead of spinning
+   we yield; our donation guarantees that the holder is scheduled
+   ahead of or alongside us.  The stride scheduler ignores
+   priorities, so there yielding would not reliably help. */
+static void
+lock_spin (struct lock *lock)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_stride)
+    return;
+  for (i = 0; i < LOCK_SPIN_YIELDS && lock->semaphore.value == 0; i++)
     {
-      holder->priority = new_priority;
-      lock_priority_donate (holder->waiting_lock, new_priority, ++level);
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL || holder->status != THREAD_READY)
+        break;
+      thread_yield ();
     }
 }
 
+/* Recomputes LOCK's cached highest waiter priority from its
+   semaphore's waiters.  Called when a waiter leaves the lock,
+   which is the only time the maximum can fall. */
+static void
+lock_update_max_waiter (struct lock *lock)
+{
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (waiters))
+    lock->max_waiter_priority = LOCK_NO_WAITERS;
+  else
+    lock->max_waiter_priority = list_entry (waiters_highest (waiters,
+                  thread_compare_priority), struct thread, elem)->priority;
+}
+
+/* Moves T, which must be waiting on SEMA, to its place in SEMA's
+   waiters after a change of priority. */
+static void
+sema_reposition_waiter (struct semaphore *sema, struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_BLOCKED);
+
+  list_remove (&t->elem);
+  list_insert_ordered (&sema->waiters, &t->elem, waiter_higher_priority,
+                       NULL);
+}
+
+/* Returns the highest priority element of the nonempty waiter
+   list WAITERS, the earliest among equals.  Waiters are inserted in
+   order, but the order may be stale by now: donation repositions a
+   donee only in the waiters of the lock it is blocked on, not in a
+   semaphore or condition variable it waits on through sema_down()
+   or cond_wait(), and the MLFQS recomputes the priorities of
+   blocked threads without knowing what they wait on.  So the list
+   is searched with LESS. */
+static struct list_elem *
+waiters_highest (struct list *waiters, list_less_func *less)
+{
+  ASSERT (!list_empty (waiters));
+
+  return list_max (waiters, less, NULL);
+}
+
+/* Returns true if the thread of elem A has a higher priority
+   than the thread of elem B.  Used to keep semaphore waiters in
+   descending priority order, first come first served among
+   equals. */
+static bool
+waiter_higher_priority (const struct list_elem *a,
+                        const struct list_elem *b,
+                        void *aux UNUSED)
+{
+  return thread_compare_priority (b, a, NULL);
+}
+
 /* Compares priorities of threads waiting in the semaphores
    of semaphore_elem A and B and returns true if thread waiting
-   on semaphore in A has a higher priority. */
+   on semaphore in A has a lower priority. */
 static bool
 compare_semaphore_elem (const struct list_elem *a,
                         const struct list_elem *b,
@@ -443,7 +898,15 @@ compare_semaphore_elem (const struct list_elem *a,
   struct semaphore_elem *elem1 = list_entry (a, struct semaphore_elem, elem);
   struct semaphore_elem *elem2 = list_entry (b, struct semaphore_elem, elem);
 
-  return thread_compare_priority (list_front (&elem1->semaphore.waiters),
-                                  list_front (&elem2->semaphore.waiters),
-                                  NULL);
-}
\ No newline at end of file
+  return elem1->thread->priority < elem2->thread->priority;
+}
+/* Returns true if the thread waiting in semaphore_elem A has a
+   higher priority than the one in B.  Keeps condition variable
+   waiters in descending priority order. */
+static bool
+semaphore_elem_higher_priority (const struct list_elem *a,
+                                const struct list_elem *b,
+                                void *aux UNUSED)
+{
+  return compare_semaphore_elem (b, a, NULL);
+}
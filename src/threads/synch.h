@@ -3,18 +3,22 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct list waiters;        /* List of waiting threads, highest
+                                   priority first. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_up_many (struct semaphore *, unsigned n);
 void sema_self_test (void);
 
 /* Lock. */
@@ -23,26 +27,77 @@ struct lock
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
     struct list_elem locks_held_elem; /* List element for locks held by thread*/
+    int max_waiter_priority;    /* Highest waiter priority, or
+                                   LOCK_NO_WAITERS. */
+
+    /* Contention statistics, reported by lock_print_stats() for
+       locks given a name with lock_set_name(). */
+    const char *name;           /* Name, or NULL if not reported. */
+    struct list_elem named_elem; /* Element in list of named locks. */
+    unsigned acquires;          /* Number of times acquired. */
+    unsigned contended;         /* Acquisitions that had to wait. */
+    int64_t wait_ticks;         /* Total ticks spent waiting. */
+    int64_t max_wait_ticks;     /* Longest single wait. */
   };
 
+/* Value of max_waiter_priority for a lock nobody waits on. */
+#define LOCK_NO_WAITERS -1
+
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
+bool lock_try_acquire_for (struct lock *, int64_t ticks);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_set_name (struct lock *, const char *name);
+void lock_print_stats (void);
 void lock_priority_donate (struct lock *, int, int);
 
+/* If true, contended locks let a preempted holder run before the
+   waiter blocks.  Controlled by kernel command-line option
+   "-adaptive-locks". */
+extern bool lock_adaptive;
+
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct list waiters;        /* List of waiting threads, highest
+                                   priority first. */
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock.
+
+   Any number of readers may hold the lock at once, or a single
+   writer.  Writers are preferred: once a writer is waiting, new
+   readers queue behind it.  Readers and writers blocked behind a
+   writer donate their priority to it through WRITER.
+
+   The lock does not record which threads hold it for reading, so
+   a reader that exits without releasing it would leave writers
+   waiting forever.  A thread must not exit holding any rwlock for
+   reading, and thread_exit() asserts that it does not. */
+struct rwlock
+  {
+    struct lock writer;         /* Held by the writer, or briefly by an
+                                   arriving reader. */
+    struct lock guard;          /* Protects READERS. */
+    struct condition no_readers; /* Signaled when READERS drops to 0. */
+    unsigned readers;           /* Number of readers holding the lock. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
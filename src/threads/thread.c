@@ -1,22 +1,29 @@
 #include "threads/thread.h"
+#include <arithmetic.h>
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include <sysstat.h>
 #include "devices/timer.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "vm/page.h"
 #include "vm/mmap.h"
-#include <hash.h>
+#include "vm/vma.h"
+#include <ohash.h>
 #endif
 
 /* Random value for struct thread's `magic' member.
@@ -24,21 +31,28 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* List all sleeping processes, that is, proccesses that are
-   blocked by a call to timer_sleep (). Ordered by time until
-   wakeup.  */
-static struct list sleeping_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Hierarchical timing wheel of all sleeping processes, that is,
+   processes that are blocked by a call to timer_sleep ().
+
+   Sleepers due in the current round of SLEEP_NEAR_SIZE ticks are
+   kept in sleep_near, indexed by wake time.  Sleepers due in a
+   later near round of the current far round are kept in sleep_far,
+   indexed by near round, and are cascaded into sleep_near when
+   their round begins.  Anything later waits in sleep_overflow
+   until its far round begins.  Every thread with a wake time of at
+   most sleep_time has been woken. */
+#define SLEEP_NEAR_BITS 8
+#define SLEEP_NEAR_SIZE (1 << SLEEP_NEAR_BITS)
+#define SLEEP_FAR_BITS 6
+#define SLEEP_FAR_SIZE (1 << SLEEP_FAR_BITS)
+static struct list sleep_near[SLEEP_NEAR_SIZE];
+static struct list sleep_far[SLEEP_FAR_SIZE];
+static struct list sleep_overflow;
+static int64_t sleep_time;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -46,6 +60,14 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Cache of pages freed by dying threads.  thread_create() takes
+   pages from here before falling back to the page allocator, and
+   thread_schedule_tail() returns pages here until it is full.
+   Accessed only with interrupts off. */
+#define THREAD_PAGE_CACHE_SIZE 16
+static void *thread_page_cache[THREAD_PAGE_CACHE_SIZE];
+static size_t thread_page_cache_cnt;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -58,21 +80,97 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long slack_cnt;     /* # of wakeups put off by slack. */
+static long long throttle_cnt;  /* # of deadline budget overruns. */
+
+/* Scheduler accounting.  Bucket B of latency_hist counts wakeups
+   that waited in the ready queues between 2**(B-1) and 2**B - 1
+   CPU cycles before running (bucket 0 counts zero-cycle waits). */
+#define LATENCY_BUCKETS 40
+static long long latency_hist[LATENCY_BUCKETS];
+static long long vol_switches;  /* # of switches away from blocking
+                                   or dying threads. */
+static long long invol_switches;/* # of switches away from threads
+                                   that were still ready. */
 
 /* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+#define TIME_SLICE 4            /* Default # of timer ticks per thread. */
+#define MLFQS_PRIORITY_FREQ 4   /* # of timer ticks between MLFQS
+                                   priority recalculations. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Time slice, in timer ticks, for threads in each priority band.
+   Low priority threads are typically batch work that gains from
+   long slices, high priority threads are typically interactive.
+   Controlled by kernel command-line options "-timeslice" and
+   "-quanta". */
+static unsigned band_quantum[QUANTUM_BANDS] =
+  {TIME_SLICE, TIME_SLICE, TIME_SLICE};
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If false (default), the multi-level feedback queue scheduler
+   recomputes recent_cpu and priority for every thread.
+   If true, only the running thread and ready threads are
+   recomputed from the timer interrupt, and blocked threads are
+   brought up to date when they are unblocked.
+   Controlled by kernel command-line option "-mlfqs-lazy". */
+bool thread_mlfqs_lazy;
+
+/* Timer slack of the initial thread, in ticks.  Threads inherit
+   their creator's slack; see thread_set_timer_slack().
+   Controlled by kernel command-line option "-slack". */
+int64_t thread_default_slack;
+
+/* If true, use the stride scheduler, which gives each thread a
+   share of the CPU proportional to a number of tickets derived from
+   its nice value, instead of scheduling by priority.
+   Controlled by kernel command-line option "-stride". */
+bool thread_stride;
+
+/* Stride scheduler.  Ready threads are kept in a leftist min-heap
+   ordered by pass value instead of in ready_queues.  A thread's
+   pass advances by its stride, STRIDE_ONE divided by its tickets,
+   for every tick it runs.  stride_pass is the pass of the most
+   recently scheduled thread; threads that become ready are not let
+   fall behind it, so sleeping earns no credit. */
+#define STRIDE_ONE (1 << 20)
+static struct thread *stride_heap;
+static int64_t stride_pass;
+
+/* Deadline scheduler.  A thread given a runtime, deadline and
+   period by thread_set_deadline() runs ahead of every priority,
+   earliest absolute deadline first, from a leftist min-heap like
+   the stride scheduler's.  Each period it may run for its runtime;
+   a thread that uses it up is throttled, ordinary by its priority
+   until the next period begins.  A thread that wakes with more
+   budget left than its deadline allows at its rate starts a new
+   period instead (the constant bandwidth server rule).  Admission
+   control keeps the runtime/period sum to DEADLINE_BW_MAX, so that
+   other threads always get some CPU.  Bandwidths are fractions of
+   1 << DEADLINE_BW_SHIFT. */
+#define DEADLINE_BW_SHIFT 20
+#define DEADLINE_BW_MAX ((95 << DEADLINE_BW_SHIFT) / 100)
+static struct thread *deadline_heap;
+static struct list deadline_threads;    /* All deadline class threads. */
+static int64_t deadline_bw;             /* Bandwidth admitted. */
+
+/* Number of seconds since boot, as last counted by thread_tick(). */
+static int64_t mlfqs_seconds;
+
+/* Most per-second recent_cpu decays applied to a thread when it
+   is unblocked.  recent_cpu converges well within this many. */
+#define MLFQS_MAX_CATCH_UP 64
+
 /* Estimate of average number of threads ready to run over the past minute. */
 static fixed_point load_avg;
 
-/* The number of threads in the ready_list */
-static int num_ready;
+/* (2*load_avg)/(2*load_avg + 1), the per-second recent cpu decay,
+   recomputed whenever load_avg is. */
+static fixed_point recent_cpu_coeff;
 
 
 static void kernel_thread (thread_func *, void *aux);
@@ -81,23 +179,49 @@ static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static struct thread *highest_priority_ready (void);
+static int ready_queue_max_priority (void);
+static void ready_queue_push (struct thread *t);
+static void ready_queue_remove (struct thread *t);
+static void steal_ready_threads (struct cpu *);
+typedef bool heap_less_func (const struct thread *, const struct thread *);
+static struct thread *heap_merge (struct thread *a, struct thread *b,
+                                  heap_less_func *);
+static heap_less_func stride_less;
+static heap_less_func deadline_less;
+static void stride_set_nice (struct thread *t, int nice);
+static bool is_deadline (const struct thread *t);
+static bool deadline_preempts (const struct thread *t);
+static void deadline_wake (struct thread *t);
+static void deadline_tick (struct thread *cur);
+static int64_t deadline_bandwidth (const struct thread *t);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
+#ifdef USERPROG
 static bool init_child (struct thread *t);
+#endif
 static void *alloc_frame (struct thread *, size_t size);
+static struct thread *thread_page_alloc (void);
+static void thread_page_free (struct thread *);
 static void schedule (void);
+static void account_switch (struct thread *cur, struct thread *next);
+static void print_thread_stats (struct thread *t, void *aux UNUSED);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
-static bool compare_wake_time (const struct list_elem *a,
-                               const struct list_elem *b,
-                               void *aux UNUSED);
+static int64_t apply_slack (const struct thread *t, int64_t wake_time);
+static void sleep_insert (struct thread *t);
+static void sleep_cascade (struct list *list);
+static void timeout_expire (struct thread *t);
 
 static void update_all_recent_cpu_times (void);
+static void update_active_recent_cpu_times (void);
+static void update_active_priorities (void);
+static void mlfqs_catch_up (struct thread *t);
 static void update_system_load_avg (void);
 static void update_all_priorities (void);
 static void update_recent_cpu_time (struct thread *t, void *aux UNUSED);
 static void update_mlfqs_priority (struct thread *t, void *aux UNUSED);
 static int bound (int x, int lower, int upper);
+static int priority_band (int priority);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -115,18 +239,30 @@ static int bound (int x, int lower, int upper);
 void
 thread_init (void) 
 {
+  struct cpu *cpu = cpu_current ();
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Initialize system load average at system boot. */
   load_avg = int_to_fp(0);
 
   /* Naturally, there are zero ready threads at boot. */
-  num_ready = 0;
+  cpu->ready_cnt = 0;
+  cpu->online = true;
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_set_name (&tid_lock, "tid");
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init (&cpu->ready_queues[i]);
+  memset (cpu->ready_bitmap, 0, sizeof cpu->ready_bitmap);
   list_init (&all_list);
-  list_init (&sleeping_list);
+  list_init (&deadline_threads);
+  for (i = 0; i < SLEEP_NEAR_SIZE; i++)
+    list_init (&sleep_near[i]);
+  for (i = 0; i < SLEEP_FAR_SIZE; i++)
+    list_init (&sleep_far[i]);
+  list_init (&sleep_overflow);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -148,58 +284,121 @@ thread_start (void)
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to set the CPU's idle_thread. */
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick, with
+   USER true if the tick interrupted user code.  Thus, this
+   function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user UNUSED) 
 {
   struct thread *t = thread_current ();
 
   /* Update statistics. */
-  if (t == idle_thread)
+  if (t == cpu_current ()->idle_thread)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      user_ticks++;
+      t->process->user_ticks++;
+      if (user)
+        t->process->rusage.user_ticks++;
+      else
+        t->process->rusage.kernel_ticks++;
+    }
 #endif
   else
     kernel_ticks++;
+  /* Charge the running thread for the tick under stride scheduling. */
+  if (thread_stride && t != cpu_current ()->idle_thread)
+    t->pass += t->stride;
+  if (!list_empty (&deadline_threads))
+    deadline_tick (t);
+
   /* Using advanced scheduler. */
   if (thread_mlfqs) 
     {
       /* Every timer interrupt, recent cpu is incremented by 1 for
         the running thread only, unless the idle thread is running. */
-      if (t != idle_thread) 
+      if (t != cpu_current ()->idle_thread) 
         {
           t->recent_cpu_changed = true;
           t->recent_cpu_time = add_int_to_fp (t->recent_cpu_time, 1);
         }
       /* Update system load average and recalculate
         recent cpu for every thread once per second */
-      if (timer_ticks () % TIMER_FREQ == 0) 
+      if (umod64_32 (timer_ticks (), TIMER_FREQ) == 0) 
         {
+          mlfqs_seconds++;
           update_system_load_avg ();
-          update_all_recent_cpu_times ();
+          if (thread_mlfqs_lazy)
+            update_active_recent_cpu_times ();
+          else
+            update_all_recent_cpu_times ();
         } 
       /* Update all priorities every fourth tick. */
-      if (timer_ticks () % TIME_SLICE == 0) 
-        update_all_priorities ();
+      if (timer_ticks () % MLFQS_PRIORITY_FREQ == 0) 
+        {
+          if (thread_mlfqs_lazy)
+            update_active_priorities ();
+          else
+            update_all_priorities ();
+        }
     }
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++thread_ticks >= band_quantum[priority_band (t->priority)])
     intr_yield_on_return ();
 }
 
+/* Fills in the scheduler counters in STATS. */
+void
+thread_get_stats (struct sysstat *stats)
+{
+  enum intr_level old_level = intr_disable ();
+
+  stats->vol_switches = vol_switches;
+  stats->invol_switches = invol_switches;
+  stats->idle_ticks = idle_ticks;
+  stats->kernel_ticks = kernel_ticks;
+  stats->user_ticks = user_ticks;
+  intr_set_level (old_level);
+  stats->load_avg = thread_get_load_avg ();
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  enum intr_level old_level;
+  int b;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld voluntary, %lld involuntary switches\n",
+          vol_switches, invol_switches);
+  printf ("Thread: %lld wakeups coalesced by timer slack\n", slack_cnt);
+  printf ("Thread: %lld deadline budget overruns\n", throttle_cnt);
+  printf ("Thread: wakeup to run latency in cycles:\n");
+  for (b = 0; b < LATENCY_BUCKETS; b++)
+    if (latency_hist[b] != 0)
+      printf ("  < 2^%-2d %lld\n", b, latency_hist[b]);
+
+  old_level = intr_disable ();
+  thread_foreach (print_thread_stats, NULL);
+  intr_set_level (old_level);
+}
+
+/* Prints the scheduler accounting of thread T. */
+static void
+print_thread_stats (struct thread *t, void *aux UNUSED)
+{
+  printf ("  %d %s: %llu cycles running, %llu cycles ready, "
+          "%u voluntary, %u involuntary switches\n",
+          t->tid, t->name, t->run_cycles, t->wait_cycles,
+          t->vol_switches, t->invol_switches);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -230,7 +429,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_alloc ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -241,7 +440,13 @@ thread_create (const char *name, int priority,
   /* Initialize thread's child struct if applicable. */
   #ifdef USERPROG
     if (!init_child (t))
-      return TID_ERROR;
+      {
+        enum intr_level old_level = intr_disable ();
+        list_remove (&t->allelem);
+        thread_page_free (t);
+        intr_set_level (old_level);
+        return TID_ERROR;
+      }
   #endif
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -297,9 +502,20 @@ thread_unblock (struct thread *t)
   ASSERT (is_thread (t));
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back(&ready_list, &t->elem);
-  num_ready++;
+  if (thread_mlfqs_lazy)
+    mlfqs_catch_up (t);
+  t->woken = true;
   t->status = THREAD_READY;
+  if (is_deadline (t))
+    {
+      deadline_wake (t);
+
+      /* Wakeups from the timer are the usual start of a period, so
+         make those prompt; others wait for the next tick. */
+      if (intr_context () && deadline_preempts (t))
+        intr_yield_on_return ();
+    }
+  ready_queue_push (t);
   intr_set_level (old_level);
 }
 
@@ -348,12 +564,22 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+  malloc_thread_exit ();
+  /* Readers are not tracked, so an rwlock held for reading would
+     never be released.  See threads/synch.h. */
+  ASSERT (cur->read_locks == 0);
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
   list_remove (&thread_current()->allelem);
+  if (cur->dl_runtime != 0)
+    {
+      list_remove (&cur->dl_elem);
+      deadline_bw -= deadline_bandwidth (cur);
+    }
   cur->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -370,12 +596,9 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread)
-  {
-    list_push_back(&ready_list, &cur->elem);
-    num_ready++;
-  }
   cur->status = THREAD_READY;
+  if (cur != cpu_current ()->idle_thread)
+    ready_queue_push (cur);
   schedule ();
   intr_set_level (old_level);
 }
@@ -417,12 +640,8 @@ thread_set_priority (int new_priority)
 
   cur->original_priority = new_priority;
 
-  if (!list_empty (&ready_list)) 
-  {
-    
-    if (highest_priority_ready ()->priority > cur->priority)
-      thread_yield ();
-  }
+  if (ready_queue_max_priority () > cur->priority)
+    thread_yield ();
   intr_set_level (old_level);
 }
 
@@ -440,6 +659,70 @@ thread_get_priority (void)
   return priority;
 }
 
+/* Returns the current thread's timer slack, in ticks. */
+int64_t
+thread_get_timer_slack (void)
+{
+  return thread_current ()->timer_slack;
+}
+
+/* Lets the current thread's sleeps and timed waits end up to
+   TICKS ticks late, so that wakeups due close together happen on
+   one tick and an idle tickless CPU is interrupted less often.
+   Zero, the default, wakes the thread at its exact tick. */
+void
+thread_set_timer_slack (int64_t ticks)
+{
+  thread_current ()->timer_slack = ticks > 0 ? ticks : 0;
+}
+
+/* Puts the current thread in the deadline class, to run for up to
+   RUNTIME ticks in every PERIOD ticks, within DEADLINE ticks of the
+   period's start, ahead of all threads scheduled by priority.  Its
+   first period starts now.  A RUNTIME of 0 takes it out of the
+   class again.  Returns false, changing nothing, unless 0 < RUNTIME
+   <= DEADLINE <= PERIOD and the deadline threads' total bandwidth
+   stays within DEADLINE_BW_MAX. */
+bool
+thread_set_deadline (int64_t runtime, int64_t deadline, int64_t period)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t bw = 0;
+  bool success = true;
+
+  if (runtime != 0
+      && (runtime < 0 || deadline < runtime || period < deadline
+          || period > INT32_MAX))
+    return false;
+  if (runtime != 0)
+    bw = (runtime << DEADLINE_BW_SHIFT) / period;
+
+  old_level = intr_disable ();
+  if (deadline_bw - deadline_bandwidth (cur) + bw > DEADLINE_BW_MAX)
+    success = false;
+  else
+    {
+      deadline_bw += bw - deadline_bandwidth (cur);
+      if (cur->dl_runtime == 0 && runtime != 0)
+        list_push_back (&deadline_threads, &cur->dl_elem);
+      else if (cur->dl_runtime != 0 && runtime == 0)
+        list_remove (&cur->dl_elem);
+      cur->dl_runtime = runtime;
+      cur->dl_deadline = deadline;
+      cur->dl_period = period;
+      cur->dl_abs = timer_ticks () + deadline;
+      cur->dl_budget = runtime;
+      cur->dl_throttled = false;
+
+      /* Leaving the class may leave a deadline thread more urgent. */
+      if (deadline_heap != NULL && !intr_context ())
+        thread_yield ();
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
 /* Sets the current thread's nice value to NICE. */
 void
 thread_set_nice (int nice) 
@@ -447,14 +730,19 @@ thread_set_nice (int nice)
   enum intr_level old_level;
   old_level = intr_disable ();
   struct thread *cur = thread_current ();
+  if (thread_stride)
+    {
+      stride_set_nice (cur, nice);
+      if (stride_heap != NULL && stride_heap->pass < cur->pass)
+        thread_yield ();
+      intr_set_level (old_level);
+      return;
+    }
   cur->niceness = bound(nice, NICE_MIN, NICE_MAX);
   update_mlfqs_priority (cur, NULL);
 
-  if (!list_empty (&ready_list)) 
-  {
-    if (highest_priority_ready ()->priority > cur->priority)
-      thread_yield();
-  }
+  if (ready_queue_max_priority () > cur->priority)
+    thread_yield ();
   intr_set_level (old_level);
 }
 
@@ -510,7 +798,7 @@ thread_get_recent_cpu (void)
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
+   point it sets its CPU's idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
@@ -519,7 +807,7 @@ static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  cpu_current ()->idle_thread = thread_current ();
   sema_up (idle_started);
 
   for (;;) 
@@ -527,6 +815,7 @@ idle (void *idle_started_ UNUSED)
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
+      timer_idle_enter ();
 
       /* Re-enable interrupts and wait for the next one.
 
@@ -594,10 +883,22 @@ init_thread (struct thread *t, const char *name, int priority)
   t->priority = priority;
   t->original_priority = priority;
   t->wake_time = 0;
+  t->timer_slack = (t == initial_thread ? thread_default_slack
+                    : thread_current ()->timer_slack);
   t->recent_cpu_changed = true;
   t->wake_sema = NULL;
   t->magic = THREAD_MAGIC;
   t->waiting_lock = NULL;
+  t->cpu = cpu_current ();
+
+  if (thread_stride)
+    {
+      /* Threads inherit their parent's nice value, hence tickets,
+         and start level with the most recently scheduled thread. */
+      stride_set_nice (t, t == initial_thread ? NICE_INITIAL
+                                              : thread_current ()->niceness);
+      t->pass = stride_pass;
+    }
 
   if (thread_mlfqs) {
     /* Initial thread has recent cpu time and nice value of 0.
@@ -613,22 +914,24 @@ init_thread (struct thread *t, const char *name, int priority)
       {
         t->niceness = thread_get_nice ();
         t->recent_cpu_time = int_to_fp (thread_current ()->recent_cpu_time);
+        t->recent_cpu_stamp = mlfqs_seconds;
         update_mlfqs_priority(t, NULL);
       }
   }
 
   #ifdef USERPROG
     t->exit_status = 0;
-    memset (t->fdtable, 0, sizeof (*t->fdtable));
-    /* Set fd = 0 to an invalid ptr */
-    t->fdtable[RESERVED_FD] = (void *)THREAD_MAGIC;
     /* First two FDs reserved */
-    t->next_fd = EXEC_FD + 1;
+    fdtable_init (&t->fds, EXEC_FD + 1);
   
     list_init (&t->children);
+    t->process = t;
+    t->thread_cnt = 1;
+    sema_init (&t->thread_exited, 0);
   #endif
 
   #ifdef VM
+    lock_init (&t->vm_lock);
     t->in_syscall = false;
   #endif
 
@@ -644,13 +947,15 @@ init_thread (struct thread *t, const char *name, int priority)
    T, adds it to the parent thread's children list and adds it to
    the child T. Returns true if successful, including case where
    t is initial thread and requires no set up. Otherwise, returns 
-   false if palloc_get_page fails. */
+   false if out of memory.  The exit information is a small
+   malloc() block, not a page, so that many children fit. */
+#ifdef USERPROG
 static bool
 init_child (struct thread *t)
 {
   if (t != initial_thread)
     {
-      struct child_exit_info *exit_info = palloc_get_page (0);
+      struct child_exit_info *exit_info = malloc (sizeof *exit_info);
       if (exit_info == NULL)
         return false;
 
@@ -666,12 +971,16 @@ init_child (struct thread *t)
       t->exit_info = exit_info;
 
 #ifdef VM
-      hash_init (&t->spt, spt_hash, spt_less, NULL);
-      hash_init (&t->mmap_table, mmap_hash, mmap_less, NULL);
+      ohash_init (&t->spt, spt_hash, spt_equal, NULL);
+      list_init (&t->spte_pages);
+      t->spte_free = NULL;
+      rb_init (&t->vmas, vma_less, NULL);
+      ohash_init (&t->mmap_table, mmap_hash, mmap_equal, NULL);
 #endif
     }
   return true;
 }
+#endif
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
    returns a pointer to the frame's base. */
@@ -686,33 +995,392 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns a page for a new thread's `struct thread' and kernel
+   stack, or a null pointer if none is available.  The page is not
+   zeroed: init_thread() clears `struct thread' itself and the
+   stack needs no initialization. */
+static struct thread *
+thread_page_alloc (void)
+{
+  enum intr_level old_level;
+  struct thread *t = NULL;
+
+  old_level = intr_disable ();
+  if (thread_page_cache_cnt > 0)
+    t = thread_page_cache[--thread_page_cache_cnt];
+  intr_set_level (old_level);
+
+  return t != NULL ? t : palloc_get_page (0);
+}
+
+/* Releases the page of thread T, which is no longer running.
+   Keeps the page for reuse by thread_page_alloc() if the cache has
+   room.  Must be called with interrupts off. */
+static void
+thread_page_free (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->magic = 0;
+  if (thread_page_cache_cnt < THREAD_PAGE_CACHE_SIZE)
+    thread_page_cache[thread_page_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   the CPU's idle thread. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct cpu *cpu = cpu_current ();
+
+  if (cpu->ready_cnt == 0)
+    steal_ready_threads (cpu);
+  if (cpu->ready_cnt == 0)
+    return cpu->idle_thread;
   else
   {
     struct thread *highest_pri_ready = highest_priority_ready ();
-    list_remove (&highest_pri_ready->elem);
-    num_ready--;
+    ready_queue_remove (highest_pri_ready);
     return highest_pri_ready;
   } 
 }
 
-/* Returns the highest priority thread in the ready list */
+/* Returns the highest priority thread in the ready queues, which
+   must not be empty.  Threads of equal priority are returned in
+   the order they became ready. */
 static struct thread *
 highest_priority_ready (void)
 {
-  ASSERT ( intr_get_level () == INTR_OFF);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cpu_current ()->ready_cnt > 0);
+
+  if (deadline_heap != NULL)
+    return deadline_heap;
+  if (thread_stride)
+    return stride_heap;
+
+  return list_entry (list_front (&cpu_current ()->ready_queues[
+                                   ready_queue_max_priority ()]),
+                     struct thread, elem);
+}
+
+/* Returns the priority of the highest priority ready thread, or
+   PRI_MIN - 1 if no thread is ready.  Under the stride scheduler,
+   priorities do not order the ready threads, so always returns
+   PRI_MIN - 1. */
+static int
+ready_queue_max_priority (void)
+{
+  const uint32_t *bitmap = cpu_current ()->ready_bitmap;
+  int word;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_stride)
+    return PRI_MIN - 1;
+
+  for (word = READY_BITMAP_WORDS - 1; word >= 0; word--)
+    if (bitmap[word] != 0)
+      return word * 32 + (31 - __builtin_clz (bitmap[word]));
+  return PRI_MIN - 1;
+}
+
+/* Appends ready thread T to the queue for its priority on the
+   CPU it last ran on. */
+static void
+ready_queue_push (struct thread *t)
+{
+  struct cpu *cpu = t->cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  t->ready_stamp = timer_cycles ();
+  if (is_deadline (t))
+    {
+      t->heap_left = t->heap_right = NULL;
+      t->heap_rank = 1;
+      deadline_heap = heap_merge (deadline_heap, t, deadline_less);
+    }
+  else if (thread_stride)
+    {
+      if (t->pass < stride_pass)
+        t->pass = stride_pass;
+      t->heap_left = t->heap_right = NULL;
+      t->heap_rank = 1;
+      stride_heap = heap_merge (stride_heap, t, stride_less);
+    }
+  else
+    {
+      list_push_back (&cpu->ready_queues[t->priority], &t->elem);
+      cpu->ready_bitmap[t->priority / 32] |= 1u << (t->priority % 32);
+    }
+  cpu->ready_cnt++;
+}
+
+/* Removes ready thread T from the queue for its priority. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  struct cpu *cpu = t->cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (is_deadline (t))
+    {
+      /* Only the earliest deadline thread ever leaves the heap. */
+      ASSERT (t == deadline_heap);
+      deadline_heap = heap_merge (t->heap_left, t->heap_right,
+                                  deadline_less);
+      cpu->ready_cnt--;
+      return;
+    }
+  if (thread_stride)
+    {
+      /* Only the minimum pass thread ever leaves the heap. */
+      ASSERT (t == stride_heap);
+      stride_heap = heap_merge (t->heap_left, t->heap_right, stride_less);
+      stride_pass = t->pass;
+      cpu->ready_cnt--;
+      return;
+    }
+
+  list_remove (&t->elem);
+  if (list_empty (&cpu->ready_queues[t->priority]))
+    cpu->ready_bitmap[t->priority / 32] &= ~(1u << (t->priority % 32));
+  cpu->ready_cnt--;
+}
+
+/* An idle CPU takes work from another CPU only if that one has at
+   least this many threads waiting.  Otherwise threads stay on the
+   CPU whose caches they have warmed. */
+#define STEAL_THRESHOLD 2
+
+/* Moves half of the ready threads of the online CPU with the most
+   of them onto CPU, whose ready queue is empty.  The highest
+   priority threads move, oldest first, so that each priority's
+   threads still run in the order they became ready.  Does nothing
+   if no other CPU has STEAL_THRESHOLD threads ready, or under the
+   stride scheduler, whose single heap every CPU shares. */
+static void
+steal_ready_threads (struct cpu *cpu)
+{
+  struct cpu *busiest = NULL;
+  unsigned i;
+  int cnt, pri;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cpu->ready_cnt == 0);
+
+  if (thread_stride)
+    return;
 
-  return list_entry (list_max (&ready_list, 
-              thread_compare_priority, NULL), struct thread, elem);
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+
+      if (c != cpu && c->online && c->ready_cnt >= STEAL_THRESHOLD
+          && (busiest == NULL || c->ready_cnt > busiest->ready_cnt))
+        busiest = c;
+    }
+  if (busiest == NULL)
+    return;
+
+  cnt = busiest->ready_cnt / 2;
+  for (pri = PRI_MAX; pri >= PRI_MIN && cnt > 0; pri--)
+    {
+      struct list *queue = &busiest->ready_queues[pri];
+
+      while (!list_empty (queue) && cnt-- > 0)
+        {
+          struct thread *t = list_entry (list_front (queue),
+                                         struct thread, elem);
+          uint64_t ready_stamp = t->ready_stamp;
+
+          ready_queue_remove (t);
+          t->cpu = cpu;
+          ready_queue_push (t);
+          t->ready_stamp = ready_stamp;
+        }
+    }
+}
+
+/* Merges the heaps rooted at A and B, either of which may be
+   empty, ordered by LESS, and returns the root of the result.
+   Recurses only down right spines, which are kept shortest, so the
+   depth is logarithmic in the number of ready threads. */
+static struct thread *
+heap_merge (struct thread *a, struct thread *b, heap_less_func *less)
+{
+  struct thread *tmp;
+  int left_rank;
+
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (less (b, a))
+    {
+      tmp = a;
+      a = b;
+      b = tmp;
+    }
+
+  a->heap_right = heap_merge (a->heap_right, b, less);
+  left_rank = a->heap_left != NULL ? a->heap_left->heap_rank : 0;
+  if (left_rank < a->heap_right->heap_rank)
+    {
+      tmp = a->heap_left;
+      a->heap_left = a->heap_right;
+      a->heap_right = tmp;
+    }
+  a->heap_rank = (a->heap_right != NULL ? a->heap_right->heap_rank : 0) + 1;
+  return a;
+}
+
+/* Orders the stride heap by pass. */
+static bool
+stride_less (const struct thread *a, const struct thread *b)
+{
+  return a->pass < b->pass;
+}
+
+/* Orders the deadline heap by absolute deadline. */
+static bool
+deadline_less (const struct thread *a, const struct thread *b)
+{
+  return a->dl_abs < b->dl_abs;
+}
+
+/* Returns true if T is scheduled by deadline: it is in the deadline
+   class and has budget left.  A ready thread is in deadline_heap
+   exactly when this is true. */
+static bool
+is_deadline (const struct thread *t)
+{
+  return t->dl_runtime != 0 && !t->dl_throttled;
+}
+
+/* Returns true if deadline thread T, just made ready, should run
+   ahead of the running thread. */
+static bool
+deadline_preempts (const struct thread *t)
+{
+  struct thread *cur = running_thread ();
+
+  return !is_deadline (cur) || t->dl_abs < cur->dl_abs;
+}
+
+/* Applies the constant bandwidth server rule to deadline thread T
+   as it wakes up: if its deadline has passed, or the budget it has
+   left would run it faster than its bandwidth before the deadline,
+   starts a new period now. */
+static void
+deadline_wake (struct thread *t)
+{
+  int64_t now = timer_ticks ();
+
+  if (now >= t->dl_abs
+      || t->dl_budget * t->dl_period > (t->dl_abs - now) * t->dl_runtime)
+    {
+      t->dl_abs = now + t->dl_deadline;
+      t->dl_budget = t->dl_runtime;
+    }
+}
+
+/* Called by thread_tick() for running thread CUR while there are
+   deadline threads.  Charges CUR's budget for the tick and
+   throttles it if that runs out, replenishes the budget of
+   throttled threads whose next period has begun, and yields on
+   return if a deadline thread should now run instead of CUR. */
+static void
+deadline_tick (struct thread *cur)
+{
+  int64_t now = timer_ticks ();
+  struct list_elem *e;
+
+  if (is_deadline (cur) && --cur->dl_budget <= 0)
+    {
+      cur->dl_throttled = true;
+      throttle_cnt++;
+      intr_yield_on_return ();
+    }
+
+  for (e = list_begin (&deadline_threads); e != list_end (&deadline_threads);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, dl_elem);
+      int64_t next_period = t->dl_abs - t->dl_deadline + t->dl_period;
+
+      if (!t->dl_throttled || now < next_period)
+        continue;
+
+      /* Only the stride heap's root can leave it, so a thread
+         there is replenished once it runs. */
+      if (t->status == THREAD_READY && thread_stride && t != stride_heap)
+        continue;
+      if (t->status == THREAD_READY)
+        ready_queue_remove (t);
+      t->dl_throttled = false;
+      t->dl_abs = next_period + t->dl_deadline;
+      t->dl_budget = t->dl_runtime;
+      if (t->status == THREAD_READY)
+        ready_queue_push (t);
+    }
+
+  if (deadline_heap != NULL && deadline_preempts (deadline_heap))
+    intr_yield_on_return ();
+}
+
+/* Returns the bandwidth T was admitted with, 0 if T is not in the
+   deadline class. */
+static int64_t
+deadline_bandwidth (const struct thread *t)
+{
+  if (t->dl_runtime == 0)
+    return 0;
+  return (t->dl_runtime << DEADLINE_BW_SHIFT) / t->dl_period;
+}
+
+/* Sets the nice value of thread T to NICE, bounded to the legal
+   range, and derives its stride scheduler tickets: from 1 ticket
+   at NICE_MAX up to 41 tickets at NICE_MIN. */
+static void
+stride_set_nice (struct thread *t, int nice)
+{
+  t->niceness = bound (nice, NICE_MIN, NICE_MAX);
+  t->tickets = NICE_MAX - t->niceness + 1;
+  t->stride = STRIDE_ONE / t->tickets;
+}
+
+/* Sets the effective priority of thread T to PRIORITY, moving T to
+   the matching ready queue if it is currently ready to run.  Used
+   whenever the priority of a thread other than the running thread
+   may change, e.g. by donation. */
+void
+thread_set_effective_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY && t != cpu_current ()->idle_thread
+      && t->priority != priority && !thread_stride && !is_deadline (t))
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    t->priority = priority;
+  intr_set_level (old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -744,6 +1412,9 @@ thread_schedule_tail (struct thread *prev)
   /* Start new time slice. */
   thread_ticks = 0;
 
+  /* Let the FPU be used without a trap only if our state is in it. */
+  fpu_switch (cur);
+
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
@@ -757,14 +1428,21 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+#ifdef USERPROG
+      /* The reaper frees it once its address space is gone. */
+      if (prev->reap_pagedir != NULL)
+        process_reap (prev);
+      else
+#endif
+        thread_page_free (prev);
     }
 }
 
 /* Puts the thread T to sleep because of call to timer_sleep () until
    timer ticks >= WAKE_TIME and it is awoken by thread_wake_sleeping ().
    WAKE_SEMA is initialized assigned to T's wake_sema field.
-   T's wake_time is set to WAKE_TIME. */
+   T's wake_time is set to WAKE_TIME, or up to T's timer slack
+   later. */
 void 
 thread_timer_sleep (struct thread *t, struct semaphore *wake_sema,
                     int64_t wake_time)
@@ -774,41 +1452,212 @@ thread_timer_sleep (struct thread *t, struct semaphore *wake_sema,
   t->wake_time = wake_time;
 
   enum intr_level old_level = intr_disable ();
-  list_insert_ordered (&sleeping_list, &(t->sleep_elem),
-                       compare_wake_time, NULL);
-  
+  if (wake_time <= sleep_time)
+    {
+      /* Already due. */
+      intr_set_level (old_level);
+      t->wake_time = 0;
+      t->wake_sema = NULL;
+      return;
+    }
+  t->wake_time = apply_slack (t, wake_time);
+  ASSERT (t->wake_time > sleep_time);
+  sleep_insert (t);
   intr_set_level (old_level);
+
   sema_down (t->wake_sema);
   
   t->wake_time = 0;
   t->wake_sema = NULL;
 }
 
-/* Removes all threads from the sleeping list whose wake_time's are
-less than TIME. */
+/* Wakes all sleeping threads whose wake_time's are at most TIME,
+   advancing the timing wheel one tick at a time up to TIME.  Each
+   tick costs the number of threads woken, plus a cascade of one
+   far slot every SLEEP_NEAR_SIZE ticks. */
 void 
 thread_wake_sleeping (int64_t time)
 {
-  struct list_elem *cur;
-  struct thread *t;
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  while (!list_empty (&sleeping_list))
+  while (sleep_time < time)
     {
-      cur = list_front (&sleeping_list);
-      t = list_entry (cur, struct thread, sleep_elem);
+      struct list *due;
 
-      if (time < t->wake_time)
+      sleep_time++;
+      if ((sleep_time & (SLEEP_NEAR_SIZE - 1)) == 0)
         {
-          return;
+          int64_t near_round = sleep_time >> SLEEP_NEAR_BITS;
+
+          if ((near_round & (SLEEP_FAR_SIZE - 1)) == 0)
+            sleep_cascade (&sleep_overflow);
+          sleep_cascade (&sleep_far[near_round & (SLEEP_FAR_SIZE - 1)]);
+        }
+
+      due = &sleep_near[sleep_time & (SLEEP_NEAR_SIZE - 1)];
+      while (!list_empty (due))
+        {
+          struct thread *t = list_entry (list_pop_front (due), struct thread,
+                                         sleep_elem);
+          ASSERT (t->wake_time == sleep_time);
+          if (t->wake_sema != NULL)
+            sema_up (t->wake_sema);
+          else
+            timeout_expire (t);
         }
-      
-      list_remove (cur);
-      sema_up (t->wake_sema);
     }
 }
 
+/* Arms a timeout for thread T, which is about to block in a timed
+   wait, so that thread_wake_sleeping() unblocks it at WAKE_TIME
+   with its timed_out flag set.  The caller must then queue T on
+   the waiter list it blocks on, through T's elem, and must call
+   thread_timeout_cancel() if T is woken for another reason.
+   Returns false without arming if WAKE_TIME has already passed. */
+bool
+thread_timeout_arm (struct thread *t, int64_t wake_time)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->wake_sema == NULL);
+
+  t->timed_out = false;
+  if (wake_time <= sleep_time)
+    return false;
+  t->wake_time = apply_slack (t, wake_time);
+  ASSERT (t->wake_time > sleep_time);
+  sleep_insert (t);
+  return true;
+}
+
+/* Disarms T's timeout, if one is armed, because T was woken
+   before it expired. */
+void
+thread_timeout_cancel (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->wake_sema == NULL && t->wake_time != 0)
+    {
+      list_remove (&t->sleep_elem);
+      t->wake_time = 0;
+    }
+}
+
+/* Ends the timed wait of blocked thread T, whose timeout has
+   expired, by taking it off the waiter list it blocks on and
+   making it ready. */
+static void
+timeout_expire (struct thread *t)
+{
+  ASSERT (t->status == THREAD_BLOCKED);
+
+  list_remove (&t->elem);
+  t->wake_time = 0;
+  t->timed_out = true;
+  thread_unblock (t);
+  if (t->priority > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+}
+
+/* Returns the earliest tick at which a sleeping thread may need to
+   be woken up.  This is the earliest wake time in the current near
+   round, if any; otherwise it is the start of the next near round,
+   when the timing wheel has to cascade. */
+int64_t
+thread_get_next_wakeup (void)
+{
+  int64_t time;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (time = sleep_time + 1; (time & (SLEEP_NEAR_SIZE - 1)) != 0; time++)
+    if (!list_empty (&sleep_near[time & (SLEEP_NEAR_SIZE - 1)]))
+      break;
+  return time;
+}
+
+/* Returns the tick at which thread T, due to wake at WAKE_TIME,
+   should wake given its timer slack: the first tick within the
+   slack at which a thread in the near wheel wakes already, or else
+   the tick in it that is a multiple of the largest power of 2, so
+   that sleepers with slack that find no company meet anyway. */
+static int64_t
+apply_slack (const struct thread *t, int64_t wake_time)
+{
+  int64_t latest = wake_time + t->timer_slack;
+  int64_t time, grain;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->timer_slack <= 0)
+    return wake_time;
+
+  for (time = wake_time; time <= latest; time++)
+    if (time >> SLEEP_NEAR_BITS != sleep_time >> SLEEP_NEAR_BITS)
+      break;
+    else if (!list_empty (&sleep_near[time & (SLEEP_NEAR_SIZE - 1)]))
+      {
+        if (time != wake_time)
+          slack_cnt++;
+        return time;
+      }
+
+  for (grain = 1; grain * 2 <= t->timer_slack + 1; grain *= 2)
+    continue;
+  time = latest / grain * grain;
+  if (time != wake_time)
+    slack_cnt++;
+  return time;
+}
+
+/* Adds sleeping thread T to the timing wheel slot for its
+   wake_time, which must not be earlier than sleep_time.  A thread
+   cascaded at the start of the round it wakes in has a wake_time
+   equal to sleep_time and lands in slot 0 of the near wheel, which
+   thread_wake_sleeping() drains in the same tick. */
+static void
+sleep_insert (struct thread *t)
+{
+  int64_t near_round = t->wake_time >> SLEEP_NEAR_BITS;
+  int64_t far_round = near_round >> SLEEP_FAR_BITS;
+  struct list *slot;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->wake_time >= sleep_time);
+
+  if (near_round == sleep_time >> SLEEP_NEAR_BITS)
+    slot = &sleep_near[t->wake_time & (SLEEP_NEAR_SIZE - 1)];
+  else if (far_round == sleep_time >> (SLEEP_NEAR_BITS + SLEEP_FAR_BITS))
+    slot = &sleep_far[near_round & (SLEEP_FAR_SIZE - 1)];
+  else
+    slot = &sleep_overflow;
+  list_push_back (slot, &t->sleep_elem);
+}
+
+/* Reinserts every sleeping thread in LIST into the timing wheel,
+   relative to the round that just began.  Threads still beyond
+   the current far round go back into the overflow list. */
+static void
+sleep_cascade (struct list *list)
+{
+  struct list pending;
+
+  list_init (&pending);
+  while (!list_empty (list))
+    list_push_back (&pending, list_pop_front (list));
+  while (!list_empty (&pending))
+    sleep_insert (list_entry (list_pop_front (&pending), struct thread,
+                              sleep_elem));
+}
+
 /* Find the max priority of the threads waiting on all the locks 
-   held by the thread CUR */
+   held by the thread CUR, using each lock's cached maximum so the
+   cost is proportional to the number of locks held. */
 int
 thread_max_waiting_priority (struct thread * cur)
 {
@@ -819,15 +1668,8 @@ thread_max_waiting_priority (struct thread * cur)
     {
       struct lock *lock_owned_by_current_thread = list_entry (e, struct lock, 
                                                               locks_held_elem);
-      if (!list_empty (&lock_owned_by_current_thread->semaphore.waiters))
-        {
-          struct thread *highest_priority_waiter = list_entry (list_max (
-                          &lock_owned_by_current_thread->semaphore.waiters, 
-                          thread_compare_priority, NULL), struct thread, elem);
-          
-          new_priority = (new_priority) > (highest_priority_waiter->priority) ? 
-                          (new_priority) : (highest_priority_waiter->priority);
-        }
+      if (lock_owned_by_current_thread->max_waiter_priority > new_priority)
+        new_priority = lock_owned_by_current_thread->max_waiter_priority;
     }
   return new_priority;
 }
@@ -844,22 +1686,6 @@ thread_compare_priority (const struct list_elem *a,
   return t1->priority < t2->priority;
 }
 
-void
-thread_update_next_fd (struct thread *t)
-{
-  int next_fd = EXEC_FD + 1;
-  for (; next_fd < MAX_FILES; next_fd++) 
-    {
-      if (t->fdtable[next_fd] == NULL)
-      {
-        t->next_fd = next_fd;
-        return;
-      }
-    }
-
-  t->next_fd = -1;
-}
-
 
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
@@ -873,17 +1699,60 @@ schedule (void)
 {
   struct thread *cur = running_thread ();
   struct thread *next = next_thread_to_run ();
+  struct thread *idle_thread = cpu_current ()->idle_thread;
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur == idle_thread && next != idle_thread)
+    timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace (TRACE_SWITCH, cur->tid, next->tid, cur->status, 0);
+      account_switch (cur, next);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
+/* Updates the scheduler accounting for a switch from thread CUR,
+   whose status has already been changed, to thread NEXT. */
+static void
+account_switch (struct thread *cur, struct thread *next)
+{
+  uint64_t now = timer_cycles ();
+
+  cur->run_cycles += now - cur->run_stamp;
+  if (cur->status == THREAD_READY)
+    {
+      cur->invol_switches++;
+      invol_switches++;
+    }
+  else
+    {
+      cur->vol_switches++;
+      vol_switches++;
+    }
+
+  if (next != cpu_current ()->idle_thread)
+    {
+      uint64_t waited = now - next->ready_stamp;
+
+      next->wait_cycles += waited;
+      if (next->woken)
+        {
+          int b = 0;
+          while (b < LATENCY_BUCKETS - 1 && waited >> b != 0)
+            b++;
+          latency_hist[b]++;
+          next->woken = false;
+        }
+    }
+  next->run_stamp = now;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
@@ -902,23 +1771,19 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-/* Compares wake time of threads corresponding to elem A and B
-   and returns true if thread A has an earlier wake time. */
-static bool 
-compare_wake_time (const struct list_elem *a,
-                   const struct list_elem *b,
-                   void *aux UNUSED)
-{
-  struct thread *t1 = list_entry (a, struct thread, sleep_elem);
-  struct thread *t2 = list_entry (b, struct thread, sleep_elem);
-  return t1->wake_time < t2->wake_time;
-}
-
-/* Recalculates recent cpu time for every thread */
+/* Recalculates recent cpu time for every thread in a single pass
+   over all_list, using the coefficient precomputed by
+   update_system_load_avg(). */
 static void
 update_all_recent_cpu_times (void)
 {
-  thread_foreach (update_recent_cpu_time, NULL);
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    update_recent_cpu_time (list_entry (e, struct thread, allelem), NULL);
 }
 
 static void
@@ -926,38 +1791,107 @@ update_all_priorities (void) {
   thread_foreach (update_mlfqs_priority, NULL);
 }
 
+/* Recalculates recent cpu time for the running thread and every
+   ready thread.  Blocked threads are caught up by
+   mlfqs_catch_up() when they are unblocked. */
+static void
+update_active_recent_cpu_times (void)
+{
+  int pri;
+
+  update_recent_cpu_time (running_thread (), NULL);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    {
+      struct list *queue = &cpu_current ()->ready_queues[pri];
+      struct list_elem *e;
+
+      for (e = list_begin (queue); e != list_end (queue); e = list_next (e))
+        update_recent_cpu_time (list_entry (e, struct thread, elem), NULL);
+    }
+}
+
+/* Recalculates the priority of the running thread and of every
+   ready thread whose recent cpu time changed.  Threads whose
+   priority changes move to another ready queue, so the next
+   element is looked up first; a thread moved to a queue not yet
+   visited has recent_cpu_changed cleared and is left alone. */
+static void
+update_active_priorities (void)
+{
+  int pri;
+
+  update_mlfqs_priority (running_thread (), NULL);
+  for (pri = PRI_MAX; pri >= PRI_MIN; pri--)
+    {
+      struct list *queue = &cpu_current ()->ready_queues[pri];
+      struct list_elem *e, *next;
+
+      for (e = list_begin (queue); e != list_end (queue); e = next)
+        {
+          next = list_next (e);
+          update_mlfqs_priority (list_entry (e, struct thread, elem), NULL);
+        }
+    }
+}
+
+/* Applies to blocked thread T the per-second recent cpu decays it
+   missed while the lazy scheduler skipped it, then recalculates
+   its priority.  The current load average stands in for the ones
+   T slept through. */
+static void
+mlfqs_catch_up (struct thread *t)
+{
+  int64_t missed = mlfqs_seconds - t->recent_cpu_stamp;
+
+  if (t == cpu_current ()->idle_thread || missed <= 0)
+    return;
+  if (missed > MLFQS_MAX_CATCH_UP)
+    missed = MLFQS_MAX_CATCH_UP;
+
+  while (missed-- > 0)
+    update_recent_cpu_time (t, NULL);
+  t->recent_cpu_stamp = mlfqs_seconds;
+  t->recent_cpu_changed = true;
+  update_mlfqs_priority (t, NULL);
+}
+
 /* Updates system load average according to this formula: 
    load_avg = (59/60)*load_avg + (1/60)*ready_threads. */
 static void
 update_system_load_avg (void)
 {
-  int ready_threads = num_ready;
+  int ready_threads = cpu_current ()->ready_cnt;
+  fixed_point double_load_avg;
 
-  if (thread_current () != idle_thread) 
+  if (thread_current () != cpu_current ()->idle_thread) 
     ready_threads++;
 
   load_avg = fp_add (fp_mult (LOAD_WEIGHT, load_avg),
                      mult_fp_by_int (READY_WEIGHT, ready_threads));
+
+  /* The recent cpu decay only depends on the load average, so
+     divide once here rather than once per thread. */
+  double_load_avg = mult_fp_by_int (load_avg, 2);
+  recent_cpu_coeff = fp_div (double_load_avg,
+                             add_int_to_fp (double_load_avg, 1));
 }
 
 /* Updates a thead's recent_cpu according to this formula:
-   (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice */
+   (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
+   The leading coefficient is recent_cpu_coeff. */
 static void
 update_recent_cpu_time (struct thread *t, void *aux UNUSED)
 {
   fixed_point new_time;
-  fixed_point double_load_avg;
-  fixed_point coeff;
   fixed_point scaled_recent_cpu;
 
-  double_load_avg = mult_fp_by_int(load_avg, 2);
-  coeff = fp_div (double_load_avg, add_int_to_fp (double_load_avg, 1));
-  scaled_recent_cpu = fp_mult (coeff, t->recent_cpu_time);
+  scaled_recent_cpu = fp_mult (recent_cpu_coeff, t->recent_cpu_time);
   new_time = add_int_to_fp (scaled_recent_cpu, t->niceness);
 
   /* Check if recent CPU time changed. */
   t->recent_cpu_changed = t->recent_cpu_time != new_time;
   t->recent_cpu_time = new_time;
+  t->recent_cpu_stamp = mlfqs_seconds;
 }
 
 /* Updates a thead's priority according to this formula:
@@ -966,7 +1900,7 @@ static void
 update_mlfqs_priority (struct thread *t, void *aux UNUSED)
 {
 
-  if (t != idle_thread && t->recent_cpu_changed)
+  if (t != cpu_current ()->idle_thread && t->recent_cpu_changed)
     {
       fixed_point unbounded_priority;
   
@@ -975,13 +1909,35 @@ update_mlfqs_priority (struct thread *t, void *aux UNUSED)
                                   div_fp_by_int (t->recent_cpu_time, 4));
       unbounded_priority = sub_int_from_fp (unbounded_priority, 
                                             t->niceness * 2);
-      t->priority = bound (fp_to_int (unbounded_priority),
-                          PRI_MIN, PRI_MAX);
+      thread_set_effective_priority (t, bound (fp_to_int (unbounded_priority),
+                                               PRI_MIN, PRI_MAX));
 
       t->recent_cpu_changed = false;
     }
 }
 
+/* Sets the time slices, in timer ticks, of threads in the low,
+   default and high priority bands to LOW, MID and HIGH.  Zero
+   values are treated as 1. */
+void
+thread_set_quanta (unsigned low, unsigned mid, unsigned high)
+{
+  band_quantum[QUANTUM_BAND_LOW] = low > 0 ? low : 1;
+  band_quantum[QUANTUM_BAND_MID] = mid > 0 ? mid : 1;
+  band_quantum[QUANTUM_BAND_HIGH] = high > 0 ? high : 1;
+}
+
+/* Returns the quantum band of PRIORITY. */
+static int
+priority_band (int priority)
+{
+  if (priority < PRI_BAND_MID)
+    return QUANTUM_BAND_LOW;
+  if (priority < PRI_BAND_HIGH)
+    return QUANTUM_BAND_MID;
+  return QUANTUM_BAND_HIGH;
+}
+
 /* Returns value of X bounded by LOWER and UPPER. */
 static int
 bound (int x, int lower, int upper)
@@ -3,10 +3,16 @@
 
 #include <debug.h>
 #include <list.h>
-#include <hash.h>
+#include <ohash.h>
+#include <rbtree.h>
+#include <rusage.h>
 #include <stdint.h>
 #include "threads/fixed-point.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#ifdef USERPROG
+#include "userprog/fdtable.h"
+#endif
 
 
 /* States in a thread's life cycle. */
@@ -28,16 +34,24 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Priority bands with separate time slices.  Priorities below
+   PRI_BAND_MID are low, priorities from PRI_BAND_HIGH up are high. */
+#define PRI_BAND_MID 21                 /* Lowest default band priority. */
+#define PRI_BAND_HIGH 42                /* Lowest high band priority. */
+enum quantum_band
+  {
+    QUANTUM_BAND_LOW,                   /* Batch threads. */
+    QUANTUM_BAND_MID,                   /* Default priority threads. */
+    QUANTUM_BAND_HIGH,                  /* Interactive threads. */
+    QUANTUM_BANDS
+  };
+
 #define NICE_MIN -20                    /* Lowest nice value. */
 #define NICE_INITIAL 0                  /* Initial thread's nice value. */
 #define NICE_MAX 20                     /* Highest nice value. */
 
 #define RECENT_CPU_TIME_INITIAL 0       /* Initial thread's recent cpu time. */
 
-/* Size of the file descriptor table and therefore limit on
-   number of files a process can open */
-#define MAX_FILES 128
-
 /* Reserved file descriptor should never allocate */
 #define RESERVED_FD 0
 /* Reserved file descriptor for process executable */
@@ -66,6 +80,8 @@ struct child_exit_info
     {
         tid_t tid;                              /* Child's tid. */
         int exit_status;                        /* Child's exit status. */
+        struct rusage rusage;                   /* Resources the child
+                                                   used. */
         struct semaphore exited;                /* Sync for waiting parent to
                                                    get exit status of child. */
         int refs_cnt;                           /* Number of references to the
@@ -132,6 +148,10 @@ struct child_exit_info
    ready state is on the run queue, whereas only a thread in the
    blocked state is on a semaphore wait list. */
 
+struct cpu;
+struct dir;
+struct sysstat;
+
 struct thread
   {
    /* Owned by thread.c. */
@@ -144,40 +164,122 @@ struct thread
    int niceness;                       /* Nice value. */
    int64_t wake_time;                  /* Time at which thread should wake
                                           after being put to sleep. */
+   int64_t timer_slack;                /* Ticks a wakeup may be put off
+                                          to share a tick with others. */
    bool recent_cpu_changed;            /* Had recent_cpu change since last
                                           priority change */
    fixed_point recent_cpu_time;        /* Exponentially weighted moving 
                                           average of recent CPU time. */
+   int64_t recent_cpu_stamp;           /* Second at which recent_cpu_time
+                                          was last decayed. */
    struct semaphore *wake_sema;        /* Used to indicate sleeping thread 
                                           should wake up. */
+   bool timed_out;                     /* Timed wait expired? */
    struct list_elem sleep_elem;        /* List element for sleeping threads
                                           list. */
    struct list_elem allelem;           /* List element for all threads list. */
 
+   /* Scheduler accounting, in CPU cycles.  Owned by thread.c. */
+   uint64_t ready_stamp;               /* When last made ready. */
+   uint64_t run_stamp;                 /* When last scheduled. */
+   uint64_t wait_cycles;               /* Time ready but not running. */
+   uint64_t run_cycles;                /* Time running. */
+   unsigned vol_switches;              /* Switches away after blocking. */
+   unsigned invol_switches;            /* Switches away while ready. */
+   bool woken;                         /* Made ready by thread_unblock()? */
+
+   /* Stride scheduler state.  Owned by thread.c. */
+   int tickets;                        /* Share of the CPU. */
+   int64_t stride;                     /* Pass increment per tick run. */
+   int64_t pass;                       /* Virtual time; lowest runs. */
+   struct thread *heap_left;           /* Ready heap children, in the
+                                          stride or deadline heap. */
+   struct thread *heap_right;
+   int heap_rank;                      /* Length of right spine. */
+
+   /* Deadline scheduler state, in timer ticks.  Owned by thread.c. */
+   int64_t dl_runtime;                 /* Budget per period, or 0 if
+                                          not in the deadline class. */
+   int64_t dl_deadline;                /* Deadline, from period start. */
+   int64_t dl_period;                  /* Period. */
+   int64_t dl_abs;                     /* Current absolute deadline. */
+   int64_t dl_budget;                  /* Budget left until dl_abs. */
+   bool dl_throttled;                  /* Budget used up this period? */
+   struct list_elem dl_elem;           /* Element in deadline_threads. */
+
    /* Shared between thread.c and synch.c. */
    struct list_elem elem;              /* List element. */
+   struct cpu *cpu;                    /* CPU whose ready queue it joins. */
 
    struct list locks_held;             /* List of locks held by this thread. */
    struct lock *waiting_lock;          /* Lock we are waiting for (if any). */
+   unsigned read_locks;                /* Rwlocks held for reading. */
 
 #ifdef USERPROG
    /* Owned by userprog/process.c. */
    uint32_t *pagedir;                  /* Page directory. */
-   int next_fd;                        /* Smallest available fd. */
+   uint32_t *reap_pagedir;             /* Page directory left for the
+                                          reaper to tear down. */
    int exit_status;                    /* Exit status of thread. */
    struct list children;               /* List of children's exit 
                                           information. */
-   struct file *fdtable[MAX_FILES];    /* File Descriptor Table. */
+   struct fdtable fds;                 /* File descriptor table. */
    struct child_exit_info *exit_info;  /* Thread's exit information shared with
                                           parent. */
-   struct hash spt;                    /* Supplmentary Page Table*/
-   struct hash mmap_table;             /* Memory map table. */
+   struct ohash spt;                   /* Supplmentary Page Table*/
+   struct list spte_pages;             /* Pages holding SPT's entries. */
+   struct spte *spte_free;             /* Free entries in those pages. */
+   struct rb_tree vmas;                /* File-backed areas, by address. */
+   struct ohash mmap_table;            /* Memory map table. */
+   int64_t user_ticks;                 /* Ticks run with a page directory,
+                                          the process's virtual time. */
+   size_t rss;                         /* Frames holding our pages. */
+   struct rusage rusage;               /* Resources used by the process,
+                                          if PROCESS is us. */
+   size_t rss_limit;                   /* Cap on rss, 0 if none. */
+   struct ioring *ioring;              /* Registered ring, a user address,
+                                          or null.  See syscall.c. */
+   bool stdin_nonblock;                /* O_NONBLOCK set on stdin? */
+   struct dir *cwd;                    /* Working directory, or null for
+                                          the root. */
+
+   /* A process's threads share the page directory and the state
+      above of the thread that started it, which they reach through
+      PROCESS.  That thread tears the state down once THREAD_CNT
+      drops to 1, which happens when the others have exited. */
+   struct thread *process;             /* Thread holding our process's
+                                          state, maybe ourselves. */
+   int thread_cnt;                     /* Threads in our process, if
+                                          PROCESS is us. */
+   struct semaphore thread_exited;     /* Upped as each of them exits. */
 #endif
 
 #ifdef VM
+#define SPTE_CACHE_CNT 4
+   struct spte *spte_cache[SPTE_CACHE_CNT]; /* Recently found sptes, by
+                                               page number. */
+   struct lock vm_lock;                /* Serializes faults and memory
+                                          calls, if PROCESS is us. */
    bool in_syscall;
+   void *ra_next;                      /* Fault that would continue the
+                                          last read-ahead run. */
+   unsigned ra_window;                 /* Pages to read ahead next. */
+   uint8_t *heap_start;                /* First page after the executable. */
+   uint8_t *brk;                       /* End of the heap. */
 #endif
 
+#ifdef FILESYS
+   /* Owned by filesys/journal.c. */
+   int journal_depth;                  /* Nested journal_begin() calls. */
+#endif
+
+   /* Owned by threads/fpu.c. */
+   void *fpu;                          /* Floating-point save area, null
+                                          until the FPU is first used. */
+
+    /* Owned by threads/malloc.c. */
+    struct magazine magazines[MALLOC_CLASS_CNT]; /* Free blocks. */
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -187,10 +289,24 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the stride scheduler.
+   Controlled by kernel command-line option "-stride". */
+extern bool thread_stride;
+
+/* If true, the MLFQS recomputes blocked threads lazily on wakeup.
+   Controlled by kernel command-line option "-mlfqs-lazy". */
+extern bool thread_mlfqs_lazy;
+
+/* Timer slack of the initial thread, inherited by the threads it
+   creates.  Controlled by kernel command-line option "-slack". */
+extern int64_t thread_default_slack;
+
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
+void thread_set_quanta (unsigned low, unsigned mid, unsigned high);
+void thread_get_stats (struct sysstat *);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -215,20 +331,25 @@ void thread_set_priority (int);
 
 int thread_get_nice (void);
 void thread_set_nice (int nice);
+bool thread_set_deadline (int64_t runtime, int64_t deadline,
+                          int64_t period);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+int64_t thread_get_timer_slack (void);
+void thread_set_timer_slack (int64_t ticks);
 int64_t thread_get_next_wakeup (void);
-void thread_set_next_wakeup (int64_t);
 
 void thread_timer_sleep (struct thread *t, struct semaphore *wake_sema,
                    int64_t wake_time);
 void thread_wake_sleeping (int64_t);
+bool thread_timeout_arm (struct thread *, int64_t wake_time);
+void thread_timeout_cancel (struct thread *);
 int thread_max_waiting_priority (struct thread *);
+void thread_set_effective_priority (struct thread *, int priority);
 bool thread_compare_priority (const struct list_elem *a,
                           const struct list_elem *b,
                           void *aux UNUSED);
 
-void thread_update_next_fd (struct thread *t);
 
 #endif /* threads/thread.h */
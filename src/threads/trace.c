@@ -0,0 +1,117 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Kernel event tracing.
+
+   With -trace, the events that call trace() are recorded in a
+   ring of TRACE_CNT binary records, each stamped with the time
+   stamp counter.  Recording takes no lock: with interrupts off,
+   it claims the next sequence number and fills in the record it
+   selects, overwriting the oldest.  The records still in the ring
+   can be fetched with the trace_read system call, and all of them
+   are printed at shutdown for utils/pintos-trace to decode. */
+
+bool trace_enabled;
+
+/* Pages in the ring, and records that fit in them. */
+#define TRACE_PAGES 16
+#define TRACE_CNT (TRACE_PAGES * PGSIZE / sizeof (struct trace_record))
+
+static struct trace_record *ring;
+static uint32_t next_seq;
+
+/* Allocates the ring, if -trace was given. */
+void
+trace_init (void)
+{
+  if (!trace_enabled)
+    return;
+  ring = palloc_get_multiple (0, TRACE_PAGES);
+  if (ring == NULL)
+    {
+      printf ("trace: no memory for trace ring, ignoring -trace.\n");
+      trace_enabled = false;
+    }
+}
+
+/* Records an event of the given TYPE with arguments A through D.
+   Use trace() instead, which first checks whether tracing is on. */
+void
+trace_event (enum trace_type type, uint32_t a, uint32_t b, uint32_t c,
+             uint32_t d)
+{
+  enum intr_level old_level = intr_disable ();
+  struct trace_record *r = &ring[next_seq % TRACE_CNT];
+
+  r->tsc = timer_cycles ();
+  r->seq = next_seq++;
+  r->type = type;
+  r->arg[0] = a;
+  r->arg[1] = b;
+  r->arg[2] = c;
+  r->arg[3] = d;
+  intr_set_level (old_level);
+}
+
+/* Returns the sequence number that the next record will get,
+   which is also the number of records made since boot. */
+uint32_t
+trace_next_seq (void)
+{
+  return next_seq;
+}
+
+/* Returns the sequence number of the oldest record still in the
+   ring. */
+uint32_t
+trace_first_seq (void)
+{
+  return next_seq < TRACE_CNT ? 0 : next_seq - TRACE_CNT;
+}
+
+/* Copies the record with sequence number SEQ into *R.  Returns
+   false if there is no such record, either because it has not been
+   made yet or because it has been overwritten. */
+bool
+trace_get (uint32_t seq, struct trace_record *r)
+{
+  enum intr_level old_level;
+  bool ok;
+
+  if (ring == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  ok = seq < next_seq && next_seq - seq <= TRACE_CNT;
+  if (ok)
+    *r = ring[seq % TRACE_CNT];
+  intr_set_level (old_level);
+  return ok;
+}
+
+/* Prints the records still in the ring, oldest first, one per
+   line, in the form that utils/pintos-trace decodes. */
+void
+trace_print_stats (void)
+{
+  uint32_t seq;
+
+  if (ring == NULL)
+    return;
+
+  printf ("Trace: %"PRIu32" records, last %"PRIu32" follow\n",
+          next_seq, next_seq < TRACE_CNT ? next_seq : (uint32_t) TRACE_CNT);
+  for (seq = trace_first_seq (); seq < next_seq; seq++)
+    {
+      const struct trace_record *r = &ring[seq % TRACE_CNT];
+
+      printf ("trace %u %llu %u %x %x %x %x\n", r->seq, r->tsc, r->type,
+              r->arg[0], r->arg[1], r->arg[2], r->arg[3]);
+    }
+}
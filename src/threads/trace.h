@@ -0,0 +1,27 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <trace.h>
+
+/* -trace: Record trace events? */
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_event (enum trace_type, uint32_t, uint32_t, uint32_t, uint32_t);
+uint32_t trace_first_seq (void);
+uint32_t trace_next_seq (void);
+bool trace_get (uint32_t seq, struct trace_record *);
+void trace_print_stats (void);
+
+/* Records an event of the given TYPE with arguments A through D,
+   if tracing is enabled.  Costs one test and branch otherwise. */
+static inline void
+trace (enum trace_type type, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+  if (trace_enabled)
+    trace_event (type, a, b, c, d);
+}
+
+#endif /* threads/trace.h */
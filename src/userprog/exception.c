@@ -1,12 +1,16 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include <sysstat.h>
+#include "devices/timer.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
+#include "userprog/usercopy.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "vm/page.h"
 #include "vm/frame.h"
@@ -14,9 +18,16 @@
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Page faults resolved by paging in, and the CPU cycles they took. */
+static long long page_fault_resolved;
+static long long page_fault_major;      /* Of those, read from disk. */
+static uint64_t page_fault_cycles;
+static uint64_t page_fault_max_cycles;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 static bool valid_stack_growth (void* esp, void* fault_addr);
+static void fault_resolved (uint64_t start, bool major);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -52,8 +63,6 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -67,11 +76,24 @@ exception_init (void)
   intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
 }
 
+/* Fills in the page fault counts in STATS. */
+void
+exception_get_stats (struct sysstat *stats)
+{
+  stats->page_faults = page_fault_cnt;
+  stats->major_faults = page_fault_major;
+  stats->minor_faults = page_fault_resolved - page_fault_major;
+}
+
 /* Prints exception statistics. */
 void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+  if (page_fault_resolved > 0)
+    printf ("Exception: %lld paged in, %"PRIu64" cycles avg, "
+            "%"PRIu64" max\n", page_fault_resolved,
+            page_fault_cycles / page_fault_resolved, page_fault_max_cycles);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -133,6 +155,7 @@ page_fault (struct intr_frame *f)
   bool user;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
   void *fault_page;  /* Fault page (rounded down to nearest page)*/
+  uint64_t start;    /* Cycle count when the fault was taken. */
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -149,6 +172,9 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  trace (TRACE_PAGE_FAULT, (uintptr_t) fault_addr, f->error_code,
+         thread_tid (), 0);
+  start = timer_cycles ();
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
@@ -160,27 +186,49 @@ page_fault (struct intr_frame *f)
   // Check if page exists in the supplemental page table?
   if (is_user_vaddr (fault_addr))
     {
+      /* The process's other threads may fault too, or change its
+         address space. */
+      bool locked = spt_lock ();
       bool success = false;
-      if (!not_present)
-         exit (-1);
+      bool major = false;
+      struct spte *spte;
 
-      if (valid_stack_growth(f->esp, fault_addr))
+      if (!not_present)
+         {
+            /* Only a write to a copy-on-write page is allowed. */
+            success = write && spt_cow_fault (fault_page);
+         }
+      /* A page the process already has is paged back in even if it
+         is a stack page, and only a page it lacks can be new stack. */
+      else if ((spte = spt_find (fault_page)) != NULL)
+         {
+            /* Only a page that is out on file or swap takes I/O. */
+            major = !spte->in_memory && spte->type != ZERO;
+            success = spt_load_upage (fault_page, write);
+         }
+      else if (valid_stack_growth(f->esp, fault_addr))
          {
             if (spt_try_add_stack_page (fault_page))
                success = true;
          }
-      else if (spt_load_upage (fault_page))
+      else if (spt_load_upage (fault_page, write))
          {
             success = true;
          }
 
+      if (success && !thread_current ()->in_syscall)
+         frame_loaded (fault_addr);
+      spt_unlock (locked);
       if (success)
       {
-         if (!thread_current ()->in_syscall)
-            frame_unpin (fault_addr);
+         fault_resolved (start, major);
          return;
       }
-      
+
+      /* A bad user address hands copy_from_user() or copy_to_user()
+         an error to return rather than killing the process. */
+      if (!user && usercopy_fixup (f))
+         return;
       exit (-1);
     }
 
@@ -201,9 +249,28 @@ page_fault (struct intr_frame *f)
  static bool
  valid_stack_growth (void* esp, void* fault_addr)
  {
-     if (fault_addr < (esp - 32) || fault_addr == NULL || 
-         pg_round_down (fault_addr) < PHYS_BASE - MAX_STACK_SIZE) {
+     if ((uint8_t *) fault_addr < STACK_LIMIT || fault_addr < (esp - 32)) {
        return false;
      }
      return true;
- }
\ No newline at end of file
+ }
+/* Accounts for a page fault taken at cycle count START that was
+   resolved by paging in, reading from disk if MAJOR. */
+static void
+fault_resolved (uint64_t start, bool major)
+{
+  uint64_t cycles = timer_cycles () - start;
+  struct rusage *ru = &thread_current ()->process->rusage;
+
+  page_fault_resolved++;
+  if (major)
+    {
+      page_fault_major++;
+      ru->major_faults++;
+    }
+  else
+    ru->minor_faults++;
+  page_fault_cycles += cycles;
+  if (cycles > page_fault_max_cycles)
+    page_fault_max_cycles = cycles;
+}
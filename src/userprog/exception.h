@@ -6,7 +6,10 @@
 #define PF_W 0x2    /* 0: read, 1: write. */
 #define PF_U 0x4    /* 0: kernel, 1: user process. */
 
+struct sysstat;
+
 void exception_init (void);
+void exception_get_stats (struct sysstat *);
 void exception_print_stats (void);
 
 #endif /* userprog/exception.h */
@@ -0,0 +1,223 @@
+#include "userprog/fdtable.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+
+/* Descriptors the arrays first grow to cover.  A multiple of
+   32, as are all later sizes, so USED is whole words. */
+#define FDTABLE_MIN 32
+
+static struct file *get (const struct fdtable *, int fd);
+static int lowest_free (struct fdtable *);
+static bool set (struct fdtable *, int fd, struct file *);
+static bool grow (struct fdtable *, int fd);
+
+/* Initializes T as an empty table that hands out descriptors
+   from FIRST up.  Allocates nothing, so it is safe to call before
+   the heap is ready. */
+void
+fdtable_init (struct fdtable *t, int first)
+{
+  ASSERT (first >= 0);
+
+  t->files = NULL;
+  t->used = NULL;
+  t->size = 0;
+  t->first = t->hint = first;
+  lock_init (&t->lock);
+}
+
+/* Frees T's arrays.  The files in it are not closed.  No other
+   thread may be using T. */
+void
+fdtable_destroy (struct fdtable *t)
+{
+  free (t->files);
+  free (t->used);
+  fdtable_init (t, t->first);
+}
+
+/* Returns the file open as FD in T, or a null pointer if FD is
+   free or out of range. */
+struct file *
+fdtable_get (struct fdtable *t, int fd)
+{
+  struct file *file;
+
+  lock_acquire (&t->lock);
+  file = get (t, fd);
+  lock_release (&t->lock);
+  return file;
+}
+
+/* Like fdtable_get(), but adds a reference to the file, which
+   the caller drops with file_close(). */
+struct file *
+fdtable_ref (struct fdtable *t, int fd)
+{
+  struct file *file;
+
+  lock_acquire (&t->lock);
+  file = get (t, fd);
+  if (file != NULL)
+    file_dup (file);
+  lock_release (&t->lock);
+  return file;
+}
+
+/* Makes FILE, which must not be null, FD's file in T, replacing
+   any there.  Returns false if FD is out of range or memory runs
+   out. */
+bool
+fdtable_set (struct fdtable *t, int fd, struct file *file)
+{
+  bool success;
+
+  ASSERT (file != NULL);
+
+  lock_acquire (&t->lock);
+  success = set (t, fd, file);
+  lock_release (&t->lock);
+  return success;
+}
+
+/* Returns the lowest free descriptor of T at or above its first,
+   or -1 if all FDTABLE_MAX are in use.  The descriptor may lie
+   past the end of the arrays. */
+int
+fdtable_lowest_free (struct fdtable *t)
+{
+  int fd;
+
+  lock_acquire (&t->lock);
+  fd = lowest_free (t);
+  lock_release (&t->lock);
+  return fd;
+}
+
+/* Puts FILE, which must not be null, in T at the lowest free
+   descriptor and returns it, or -1 if T is full or memory runs
+   out. */
+int
+fdtable_alloc (struct fdtable *t, struct file *file)
+{
+  int fd;
+
+  lock_acquire (&t->lock);
+  fd = lowest_free (t);
+  if (fd >= 0 && !set (t, fd, file))
+    fd = -1;
+  lock_release (&t->lock);
+  return fd;
+}
+
+/* Frees FD in T and returns the file that was open there, or a
+   null pointer if none was. */
+struct file *
+fdtable_remove (struct fdtable *t, int fd)
+{
+  struct file *file;
+
+  lock_acquire (&t->lock);
+  file = get (t, fd);
+  if (file != NULL)
+    {
+      t->files[fd] = NULL;
+      t->used[fd / 32] &= ~(1u << (fd % 32));
+      if (fd < t->hint && fd >= t->first)
+        t->hint = fd;
+    }
+  lock_release (&t->lock);
+  return file;
+}
+
+/* Returns one more than the highest descriptor T can hold
+   without growing, a bound for walking its files. */
+int
+fdtable_end (const struct fdtable *t)
+{
+  return t->size;
+}
+
+/* Returns FD's file in T, or a null pointer. */
+static struct file *
+get (const struct fdtable *t, int fd)
+{
+  return fd >= 0 && fd < t->size ? t->files[fd] : NULL;
+}
+
+/* Makes FILE FD's file in T, as fdtable_set(). */
+static bool
+set (struct fdtable *t, int fd, struct file *file)
+{
+  if (fd < 0 || fd >= FDTABLE_MAX || (fd >= t->size && !grow (t, fd)))
+    return false;
+  t->files[fd] = file;
+  t->used[fd / 32] |= 1u << (fd % 32);
+  if (fd == t->hint)
+    t->hint++;
+  return true;
+}
+
+/* Returns T's lowest free descriptor, as fdtable_lowest_free(). */
+static int
+lowest_free (struct fdtable *t)
+{
+  int w;
+
+  for (w = t->hint / 32; w < t->size / 32; w++)
+    {
+      uint32_t used = t->used[w];
+
+      /* Bits below HINT count as in use. */
+      if (w == t->hint / 32)
+        used |= (1u << (t->hint % 32)) - 1;
+      if (used != UINT32_MAX)
+        {
+          t->hint = w * 32 + __builtin_ctz (~used);
+          return t->hint;
+        }
+    }
+  t->hint = t->size > t->hint ? t->size : t->hint;
+  return t->hint < FDTABLE_MAX ? t->hint : -1;
+}
+
+/* Grows T's arrays to cover FD, which must be less than
+   FDTABLE_MAX, at least doubling them.  Returns false if memory
+   runs out, leaving T unchanged. */
+static bool
+grow (struct fdtable *t, int fd)
+{
+  int size = t->size > 0 ? t->size : FDTABLE_MIN;
+  struct file **files;
+  uint32_t *used;
+
+  while (size <= fd)
+    size *= 2;
+  if (size > FDTABLE_MAX)
+    size = FDTABLE_MAX;
+
+  files = malloc (size * sizeof *files);
+  used = malloc (size / 32 * sizeof *used);
+  if (files == NULL || used == NULL)
+    {
+      free (files);
+      free (used);
+      return false;
+    }
+
+  memset (files, 0, size * sizeof *files);
+  memset (used, 0, size / 32 * sizeof *used);
+  if (t->size > 0)
+    {
+      memcpy (files, t->files, t->size * sizeof *files);
+      memcpy (used, t->used, t->size / 32 * sizeof *used);
+    }
+  free (t->files);
+  free (t->used);
+  t->files = files;
+  t->used = used;
+  t->size = size;
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+struct file;
+
+/* Most descriptors a process may have. */
+#define FDTABLE_MAX 4096
+
+/* A process's open files, indexed by file descriptor.  The
+   arrays live in the kernel heap and grow on demand, so an empty
+   table costs nothing and the thread page keeps its room for the
+   kernel stack.  The threads of a process share its table, so
+   the calls below take its lock.  A file fdtable_get() returns
+   may be closed by another thread at any time; fdtable_ref()
+   keeps it open. */
+struct fdtable
+  {
+    struct file **files;        /* FILES[FD], null if FD is free. */
+    uint32_t *used;             /* Bit FD set if FILES[FD] is in use. */
+    int size;                   /* Descriptors the arrays cover. */
+    int first;                  /* Lowest descriptor to hand out. */
+    int hint;                   /* Descriptors FIRST...HINT-1 in use. */
+    struct lock lock;           /* Guards the members above. */
+  };
+
+void fdtable_init (struct fdtable *, int first);
+void fdtable_destroy (struct fdtable *);
+struct file *fdtable_get (struct fdtable *, int fd);
+struct file *fdtable_ref (struct fdtable *, int fd);
+bool fdtable_set (struct fdtable *, int fd, struct file *);
+int fdtable_alloc (struct fdtable *, struct file *);
+int fdtable_lowest_free (struct fdtable *);
+struct file *fdtable_remove (struct fdtable *, int fd);
+int fdtable_end (const struct fdtable *);
+
+#endif /* userprog/fdtable.h */
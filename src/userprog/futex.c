@@ -0,0 +1,220 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <list.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Futex wait queues.
+
+   A futex is any aligned int in user memory.  Threads waiting on
+   it are kept in one of FUTEX_BUCKETS lists, chosen by hashing the
+   futex's key.  A futex in a process's private memory is keyed on
+   the process and the user address, which stay the same however
+   the page behind it changes: a read fault may map the shared zero
+   page and a later write give it a frame of its own, and
+   copy-on-write moves it likewise.  A futex in a mapped file is
+   keyed instead on the kernel virtual address of the word inside
+   the one frame that every process mapping the page shares, so
+   that those processes share the futex.
+
+   The frame behind a shared futex must not move while a thread
+   waits on it, so futex_wait() pins it before computing the key and
+   unpins it once woken.  Pins nest, so each waiter holds one of
+   its own. */
+#define FUTEX_BUCKETS 64
+
+static struct list futex_buckets[FUTEX_BUCKETS];
+
+/* Orders checking a futex's value against waking it, so that a
+   wakeup between the check and going to sleep is not lost. */
+static struct lock futex_lock;
+
+/* Identifies a futex. */
+struct futex_key
+  {
+    const struct thread *process; /* Owning process, or null if the
+                                     futex is in a shared frame. */
+    uintptr_t addr;               /* User address, or the word's
+                                     kernel address if shared. */
+  };
+
+/* A thread waiting on a futex. */
+struct futex_waiter
+  {
+    struct futex_key key;       /* Futex waited on. */
+    struct semaphore woken;     /* Upped by futex_wake(). */
+    struct list_elem elem;      /* Element in bucket list. */
+  };
+
+static bool futex_shared (int *uaddr);
+static void futex_pin (int *uaddr);
+static bool futex_key_equal (const struct futex_key *,
+                             const struct futex_key *);
+static struct list *futex_bucket (const struct futex_key *key);
+
+/* Initializes the futex wait queues. */
+void
+futex_init (void)
+{
+  int i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++)
+    list_init (&futex_buckets[i]);
+  lock_init (&futex_lock);
+  lock_set_name (&futex_lock, "futex");
+}
+
+/* If the int at user address UADDR equals EXPECTED, sleeps until
+   another thread calls futex_wake() on it and returns 0.
+   Otherwise returns -1 without sleeping.  UADDR must be a valid,
+   aligned user address. */
+int
+futex_wait (int *uaddr, int expected)
+{
+  struct futex_waiter w;
+  bool shared;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  lock_acquire (&futex_lock);
+  shared = futex_shared (uaddr);
+  if (shared)
+    {
+      futex_pin (uaddr);
+      w.key.process = NULL;
+      w.key.addr = (uintptr_t) pagedir_get_page (thread_current ()->pagedir,
+                                                 uaddr);
+    }
+  else
+    {
+      w.key.process = thread_current ()->process;
+      w.key.addr = (uintptr_t) uaddr;
+    }
+  if (*uaddr != expected)
+    {
+      if (shared)
+        frame_unpin (uaddr);
+      lock_release (&futex_lock);
+      return -1;
+    }
+  sema_init (&w.woken, 0);
+  list_push_back (futex_bucket (&w.key), &w.elem);
+  lock_release (&futex_lock);
+
+  sema_down (&w.woken);
+
+  if (shared)
+    frame_unpin (uaddr);
+  return 0;
+}
+
+/* Wakes up to N threads waiting on the int at user address UADDR,
+   oldest first, and returns how many were woken. */
+int
+futex_wake (int *uaddr, int n)
+{
+  struct futex_key key;
+  struct list *bucket;
+  struct list_elem *e;
+  int woken = 0;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  lock_acquire (&futex_lock);
+  if (futex_shared (uaddr))
+    {
+      /* Touch the word so that it is resident.  Waiters' frames are
+         pinned, so if it has been evicted again since, no thread
+         waits on it. */
+      (void) *(volatile int *) uaddr;
+      key.process = NULL;
+      key.addr = (uintptr_t) pagedir_get_page (thread_current ()->pagedir,
+                                               uaddr);
+      if (key.addr == 0)
+        {
+          lock_release (&futex_lock);
+          return 0;
+        }
+    }
+  else
+    {
+      key.process = thread_current ()->process;
+      key.addr = (uintptr_t) uaddr;
+    }
+
+  bucket = futex_bucket (&key);
+  for (e = list_begin (bucket); e != list_end (bucket) && woken < n; )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+      if (futex_key_equal (&w->key, &key))
+        {
+          e = list_remove (e);
+          sema_up (&w->woken);
+          woken++;
+        }
+      else
+        e = list_next (e);
+    }
+  lock_release (&futex_lock);
+  return woken;
+}
+
+/* Returns true if the futex at user address UADDR is in a page of
+   a mapped file, whose frame other processes may share. */
+static bool
+futex_shared (int *uaddr)
+{
+  bool locked = spt_lock ();
+  struct spte *spte = spt_lookup (pg_round_down (uaddr));
+  bool shared = spte != NULL && spte->type == MMAP;
+
+  spt_unlock (locked);
+  return shared;
+}
+
+/* Faults in and pins the frame holding the futex at user address
+   UADDR, as pin_user_range() in userprog/syscall.c does.  Called
+   and returns with futex_lock held, but releases it while faulting
+   the page in. */
+static void
+futex_pin (int *uaddr)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  void *upage = pg_round_down (uaddr);
+
+  for (;;)
+    {
+      bool pinned;
+
+      frame_page_lock (pd, upage);
+      pinned = frame_pin (upage);
+      frame_page_unlock (pd, upage);
+      if (pinned)
+        return;
+
+      lock_release (&futex_lock);
+      (void) *(volatile int *) uaddr;
+      lock_acquire (&futex_lock);
+    }
+}
+
+/* Returns true if futex keys A and B are the same. */
+static bool
+futex_key_equal (const struct futex_key *a, const struct futex_key *b)
+{
+  return a->process == b->process && a->addr == b->addr;
+}
+
+/* Returns the wait queue holding waiters on futexes with KEY. */
+static struct list *
+futex_bucket (const struct futex_key *key)
+{
+  uintptr_t hash = (uintptr_t) key->process / PGSIZE + key->addr / sizeof (int);
+
+  return &futex_buckets[hash % FUTEX_BUCKETS];
+}
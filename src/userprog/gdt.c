@@ -37,7 +37,9 @@ gdt_init (void)
 {
   uint64_t gdtr_operand;
 
-  /* Initialize GDT. */
+  /* Initialize GDT.  SYSENTER and SYSEXIT derive every selector
+     from SEL_KCSEG, assuming kernel data follows it and then user
+     code and data, so this order must not change. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
   gdt[SEL_KCSEG / sizeof *gdt] = make_code_desc (0);
   gdt[SEL_KDSEG / sizeof *gdt] = make_data_desc (0);
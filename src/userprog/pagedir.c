@@ -1,25 +1,92 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/shrinker.h"
 #include "vm/frame.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vaddr);
+static void update_pte (uint32_t *pd, uint32_t *pte, uint32_t new,
+                        const void *vaddr);
+static void destroy_pt (uint32_t *pd, uint32_t *pt);
+static unsigned present_cnt (const uint32_t *table);
+static void set_present_cnt (uint32_t *table, unsigned cnt);
+static uint32_t *table_alloc (void);
+static void table_free (uint32_t *table);
+static size_t table_count (void);
+static size_t table_scan (size_t cnt);
+
+/* Each page table counts its present PTEs, and each page directory
+   its present user PDEs, in the PTE_AVL bits of the table's first
+   PRESENT_WORDS entries, which the CPU ignores whether or not the
+   entries are present.  pagedir_destroy() uses the counts to stop
+   once it has seen every mapping, scanning from both ends, so a
+   small or sparse address space is torn down without reading every
+   entry. */
+#define PRESENT_WORDS 4
+
+/* Page directories and page tables that have been torn down are
+   zeroed and kept here, up to TABLE_CACHE_MAX of them, instead of
+   going back to the kernel pool.  A page fault that needs a new
+   page table, and an exec that needs a new page directory, then
+   take one already zeroed rather than zeroing a page on the spot.
+   The cache gives its pages back through a shrinker. */
+#define TABLE_CACHE_MAX 16
+static uint32_t *table_cache[TABLE_CACHE_MAX];
+static size_t table_cache_cnt;
+
+/* Statistics. */
+static long long table_hits;    /* Tables taken from the cache. */
+static long long table_misses;  /* Tables zeroed on allocation. */
+
+static struct shrinker table_shrinker =
+  {
+    .name = "page tables",
+    .user = false,
+    .count = table_count,
+    .scan = table_scan,
+  };
+
+/* Initializes the page table cache. */
+void
+pagedir_init (void)
+{
+  shrinker_register (&table_shrinker);
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
    Returns the new page directory, or a null pointer if memory
-   allocation fails. */
+   allocation fails.
+
+   The user half of a zeroed table is already empty, so only the
+   kernel half of init_page_dir is copied.  The page table for
+   the top of the stack, which every process maps first, is
+   installed up front if there is memory for it. */
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
-  if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+  size_t kernel_pde = pd_no (PHYS_BASE);
+  uint32_t *pd, *pt;
+
+  pd = table_alloc ();
+  if (pd == NULL)
+    return NULL;
+  memcpy (pd + kernel_pde, init_page_dir + kernel_pde,
+          (PGSIZE / sizeof *pd - kernel_pde) * sizeof *pd);
+
+  pt = table_alloc ();
+  if (pt != NULL)
+    {
+      pd[kernel_pde - 1] = pde_create (pt) | (pd[kernel_pde - 1] & PTE_AVL);
+      set_present_cnt (pd, 1);
+    }
   return pd;
 }
 
@@ -28,24 +95,147 @@ pagedir_create (void)
 void
 pagedir_destroy (uint32_t *pd) 
 {
-  uint32_t *pde;
+  uint32_t *pde, *top;
+  unsigned left;
+  bool up = true;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
-  for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
-      {
-        uint32_t *pt = pde_get_pt (*pde);
-        uint32_t *pte;
-        
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            frame_free_page (pte_get_page (*pte));
-        frame_free_page (pt);
-      }
-  palloc_free_page (pd);
+  ASSERT (active_pd () != pd);
+
+  /* The executable's tables are near the bottom and the stack's at
+     the top, so meet in the middle. */
+  left = present_cnt (pd);
+  for (pde = pd, top = pd + pd_no (PHYS_BASE); left > 0 && pde < top; )
+    {
+      uint32_t *e = up ? pde++ : --top;
+
+      up = !up;
+      if (*e & PTE_P)
+        {
+          destroy_pt (pd, pde_get_pt (*e));
+          left--;
+        }
+    }
+  table_free (pd);
+}
+
+/* Releases the frames mapped by page table PT of PD and frees PT. */
+static void
+destroy_pt (uint32_t *pd, uint32_t *pt)
+{
+  uint32_t *pte = pt, *top = pt + PGSIZE / sizeof *pt;
+  unsigned left = present_cnt (pt);
+  bool up = true;
+
+  while (left > 0 && pte < top)
+    {
+      uint32_t *e = up ? pte++ : --top;
+
+      up = !up;
+      if (*e & PTE_P)
+        {
+          frame_release (pte_get_page (*e), pd);
+          left--;
+        }
+    }
+  table_free (pt);
+}
+
+/* Returns the count of present entries kept in TABLE. */
+static unsigned
+present_cnt (const uint32_t *table)
+{
+  unsigned cnt = 0;
+  int i;
+
+  for (i = 0; i < PRESENT_WORDS; i++)
+    cnt |= ((table[i] & PTE_AVL) >> 9) << (3 * i);
+  return cnt;
+}
+
+/* Sets the count of present entries kept in TABLE to CNT. */
+static void
+set_present_cnt (uint32_t *table, unsigned cnt)
+{
+  int i;
+
+  ASSERT (cnt <= PGSIZE / sizeof *table);
+  for (i = 0; i < PRESENT_WORDS; i++)
+    table[i] = (table[i] & ~PTE_AVL) | (((cnt >> (3 * i)) & 7) << 9);
+}
+
+/* Returns a zeroed page for a page directory or page table, or a
+   null pointer if memory allocation fails. */
+static uint32_t *
+table_alloc (void)
+{
+  enum intr_level old_level;
+  uint32_t *table = NULL;
+
+  old_level = intr_disable ();
+  if (table_cache_cnt > 0)
+    {
+      table = table_cache[--table_cache_cnt];
+      table_hits++;
+    }
+  else
+    table_misses++;
+  intr_set_level (old_level);
+
+  return table != NULL ? table : palloc_get_page (PAL_ZERO);
+}
+
+/* Zeroes TABLE, which no longer maps anything, and keeps it in
+   the cache, or frees it if the cache is full.  Entries that are
+   not present may still hold bits, so the whole page is zeroed. */
+static void
+table_free (uint32_t *table)
+{
+  enum intr_level old_level;
+  bool cached = false;
+
+  memset (table, 0, PGSIZE);
+  old_level = intr_disable ();
+  if (table_cache_cnt < TABLE_CACHE_MAX)
+    {
+      table_cache[table_cache_cnt++] = table;
+      cached = true;
+    }
+  intr_set_level (old_level);
+
+  if (!cached)
+    palloc_free_page (table);
+}
+
+/* Returns the number of tables in the cache. */
+static size_t
+table_count (void)
+{
+  return table_cache_cnt;
+}
+
+/* Frees up to CNT tables from the cache and returns how many it
+   freed. */
+static size_t
+table_scan (size_t cnt)
+{
+  size_t done;
+
+  for (done = 0; done < cnt; done++)
+    {
+      enum intr_level old_level = intr_disable ();
+      uint32_t *table = table_cache_cnt > 0
+                        ? table_cache[--table_cache_cnt] : NULL;
+      intr_set_level (old_level);
+
+      if (table == NULL)
+        break;
+      palloc_free_page (table);
+    }
+  return done;
 }
 
 /* Returns the address of the page table entry for virtual
@@ -67,15 +257,16 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
-  if (*pde == 0) 
+  if ((*pde & PTE_P) == 0) 
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = table_alloc ();
           if (pt == NULL) 
             return NULL; 
       
-          *pde = pde_create (pt);
+          *pde = pde_create (pt) | (*pde & PTE_AVL);
+          set_present_cnt (pd, present_cnt (pd) + 1);
         }
       else
         return NULL;
@@ -111,8 +302,11 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 
   if (pte != NULL) 
     {
+      uint32_t *pt = pg_round_down (pte);
+
       ASSERT ((*pte & PTE_P) == 0);
-      *pte = pte_create_user (kpage, writable);
+      *pte = pte_create_user (kpage, writable) | (*pte & PTE_AVL);
+      set_present_cnt (pt, present_cnt (pt) + 1);
       return true;
     }
   else
@@ -152,8 +346,10 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
-      *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      uint32_t *pt = pg_round_down (pte);
+
+      update_pte (pd, pte, *pte & ~PTE_P, upage);
+      set_present_cnt (pt, present_cnt (pt) - 1);
     }
 }
 
@@ -179,10 +375,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       if (dirty)
         *pte |= PTE_D;
       else 
-        {
-          *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
-        }
+        update_pte (pd, pte, *pte & ~(uint32_t) PTE_D, vpage);
     }
 }
 
@@ -208,10 +401,46 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       if (accessed)
         *pte |= PTE_A;
       else 
-        {
-          *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
-        }
+        update_pte (pd, pte, *pte & ~(uint32_t) PTE_A, vpage);
+    }
+}
+
+/* Clears the accessed bit in the PTE for virtual page VPAGE in
+   PD and returns whether it was set, walking to the PTE once.
+   Returns false if PD contains no PTE for VPAGE.  For clock
+   scans, which test and clear each page they pass. */
+bool
+pagedir_test_and_clear_accessed (uint32_t *pd, const void *vpage)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+
+  if (pte == NULL || (*pte & PTE_A) == 0)
+    return false;
+  update_pte (pd, pte, *pte & ~(uint32_t) PTE_A, vpage);
+  return true;
+}
+
+/* Returns true if the PTE for virtual page VPAGE in PD is
+   writable.  Returns false if PD contains no PTE for VPAGE. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & PTE_W) != 0;
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        update_pte (pd, pte, *pte | PTE_W, vpage);
+      else 
+        update_pte (pd, pte, *pte & ~(uint32_t) PTE_W, vpage);
     }
 }
 
@@ -231,6 +460,21 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Returns true if PD is the page directory loaded in CR3. */
+bool
+pagedir_is_active (uint32_t *pd)
+{
+  return active_pd () == pd;
+}
+
+/* Prints page table cache statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("Page tables: %lld from cache, %lld zeroed, %zu cached\n",
+          table_hits, table_misses, table_cache_cnt);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
@@ -244,21 +488,35 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the changed page.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for VADDR if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Unlike re-activating PD, INVLPG leaves the rest of
+   the TLB alone.  See [IA32-v3a] 3.12 "Translation Lookaside
+   Buffers (TLBs)". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vaddr) 
 {
   if (active_pd () == pd) 
-    {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+    asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
+
+/* Stores NEW into PTE, the entry for VADDR in PD, invalidating
+   the TLB entry only if the store changes a present entry.  The
+   TLB never holds entries that are not present, so a fault path
+   that clears an unmapped page, or a bit that is already clear,
+   costs no INVLPG. */
+static void
+update_pte (uint32_t *pd, uint32_t *pte, uint32_t new, const void *vaddr)
+{
+  uint32_t old = *pte;
+
+  *pte = new;
+  if ((old & PTE_P) && old != new)
+    invalidate_page (pd, vaddr);
 }
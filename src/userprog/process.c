@@ -13,18 +13,107 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
+#include "vm/mmap.h"
 #include "vm/page.h"
+#include "vm/vma.h"
+
+/* Argument passed into fork_process when process_fork() creates a
+   child. The parent waits on 'done' while the child copies its
+   address space, so 'parent' and 'if_' stay valid, and 'success'
+   reports back whether the copy worked. */
+struct fork_arg
+    {
+        struct thread *parent;          /* Forking process. */
+        struct intr_frame *if_;         /* Parent's user context. */
+        bool success;                   /* Whether the copy succeeded. */
+        struct semaphore done;          /* Signals the copy is over. */
+    };
+
+/* Argument passed into spawn_thread when process_spawn() starts a
+   thread. The caller waits on 'started' until the new thread has
+   taken the values it needs. */
+struct spawn_arg
+    {
+        struct thread *process;         /* Process to join. */
+        void (*eip) (void);             /* User code to run. */
+        void *esp;                      /* User stack pointer. */
+        struct semaphore started;       /* Signals they were taken. */
+    };
+
+/* A loadable segment, in the form load_segment() takes it. */
+struct exec_seg
+    {
+        uint32_t file_page;             /* Offset of the first page. */
+        uint8_t *upage;                 /* Address of the first page. */
+        uint32_t read_bytes;            /* Bytes read from the file. */
+        uint32_t zero_bytes;            /* Bytes zeroed after them. */
+        bool writable;                  /* Writable by the process? */
+    };
+
+/* Most PT_LOAD segments an executable may have. */
+#define EXEC_SEG_MAX 8
+
+/* The parsed headers of an executable. */
+struct exec_info
+    {
+        struct inode *inode;            /* Executable, null if unused. */
+        unsigned write_cnt;             /* inode_write_cnt() when parsed. */
+        void (*entry) (void);           /* Entry point. */
+        int seg_cnt;                    /* Number of segments. */
+        struct exec_seg segs[EXEC_SEG_MAX];
+    };
+
+/* Headers of recently executed files, most recently used first, so
+   that running the same program again reads and checks no ELF
+   headers. Each entry keeps its inode open, which keeps the inode's
+   write count meaningful and its pointer unique, and is dropped when
+   the file is written or removed. */
+#define EXEC_CACHE_SIZE 8
+static struct exec_info exec_cache[EXEC_CACHE_SIZE];
+static struct lock exec_cache_lock;
 
 static thread_func start_process NO_RETURN;
+static thread_func fork_process NO_RETURN;
+static thread_func spawn_thread NO_RETURN;
+static thread_func reaper NO_RETURN;
+static bool copy_files (struct thread *parent);
+static bool copy_pipes (struct thread *parent);
+static void set_exec_name (struct process_arg *, const char *cmd_line);
+static bool install_files (struct process_arg *);
+static void release_files (struct process_arg *);
 static bool load (struct process_arg *arg, void (**eip) (void), void **esp);
 
+/* Segments of an executable of at most this many pages are read in
+   whole when it is loaded, so that a short-lived program does not
+   take a page fault per page it touches; larger ones load lazily.
+   Controlled by kernel command-line option "-prefetch". */
+size_t exec_prefetch_pages = 16;
+
+/* Exited processes whose address spaces are still to be torn
+   down, linked through their struct threads' elem, and the thread
+   that tears them down, null until it is started.  The list and
+   REAPER_IDLE are accessed only with interrupts off. */
+static struct list reap_list = LIST_INITIALIZER (reap_list);
+static struct thread *reaper_thread;
+static bool reaper_idle;
+
+/* Initializes the cache of executable headers. */
+void
+process_init (void)
+{
+  lock_init (&exec_cache_lock);
+}
+
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
@@ -38,33 +127,120 @@ process_execute (const char *file_name)
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
+  fn_copy = malloc (strlen (file_name) + 1);
   if (fn_copy == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  strlcpy (fn_copy, file_name, strlen (file_name) + 1);
 
-  char *token;
-  char *save_ptr;
-  token = strtok_r(fn_copy, " ", &save_ptr);
-
-
-  args.exec_name = token;
-  args.save_ptr = save_ptr;
-  args.page = fn_copy;
+  set_exec_name (&args, fn_copy);
+  args.cmd_line = fn_copy;
+  args.parent = thread_current ()->process;
   args.loaded = false;
   sema_init (&args.loaded_sema, 0);
+  args.async = false;
+  args.file_cnt = 0;
+  args.cwd = filesys_cwd (args.parent);
+  if (args.cwd == NULL)
+    {
+      free (fn_copy);
+      return TID_ERROR;
+    }
   
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (token, PRI_DEFAULT, start_process, &args);
-
-  sema_down (&args.loaded_sema);
+  tid = thread_create (args.exec_name, PRI_DEFAULT, start_process, &args);
+  if (tid != TID_ERROR)
+    sema_down (&args.loaded_sema);
+  else
+    dir_close (args.cwd);
+  free (fn_copy);
 
-  if (!args.loaded)
+  if (tid == TID_ERROR || !args.loaded)
     return TID_ERROR;
 
   return tid;
 }
 
+/* Like process_execute(), but returns as soon as the new thread
+   exists, without waiting for it to load, so that a parent can
+   start many children in a row.  A child that fails to load exits
+   with status -1, for process_wait() to report.  Instead of the
+   parent's pipes, the child gets an open copy of the parent's file
+   FDS[I], at the same position, at descriptor EXEC_FD + 1 + I for
+   each I < CNT, or nothing there if FDS[I] is negative.  Returns
+   TID_ERROR if a descriptor in FDS is not an open file or memory is
+   short. */
+tid_t
+process_launch (const char *file_name, const int *fds, size_t cnt)
+{
+  struct thread *process = thread_current ()->process;
+  struct process_arg *args;
+  char *fn_copy;
+  size_t i;
+  tid_t tid;
+
+  ASSERT (cnt <= SPAWN_FD_MAX);
+
+  args = calloc (1, sizeof *args);
+  fn_copy = malloc (strlen (file_name) + 1);
+  if (args == NULL || fn_copy == NULL)
+    goto fail;
+  strlcpy (fn_copy, file_name, strlen (file_name) + 1);
+  set_exec_name (args, fn_copy);
+  args->cmd_line = fn_copy;
+  args->parent = process;
+  args->async = true;
+  args->cwd = filesys_cwd (process);
+  if (args->cwd == NULL)
+    goto fail;
+
+  /* Take the files now: the parent may close them once we return. */
+  args->file_cnt = cnt;
+  for (i = 0; i < cnt; i++)
+    if (fds[i] >= 0)
+      {
+        struct file *file;
+
+        if (fds[i] <= EXEC_FD
+            || (file = fdtable_ref (&process->fds, fds[i])) == NULL)
+          goto fail;
+        args->files[i] = file_reopen (file);
+        if (args->files[i] != NULL)
+          file_seek (args->files[i], file_tell (file));
+        file_close (file);
+        if (args->files[i] == NULL)
+          goto fail;
+      }
+
+  tid = thread_create (args->exec_name, PRI_DEFAULT, start_process, args);
+  if (tid != TID_ERROR)
+    return tid;
+
+ fail:
+  if (args != NULL)
+    {
+      release_files (args);
+      dir_close (args->cwd);
+    }
+  free (args);
+  free (fn_copy);
+  return TID_ERROR;
+}
+
+/* Sets the exec_name of ARGS to the first word of CMD_LINE, which
+   names the executable, and the thread. */
+static void
+set_exec_name (struct process_arg *args, const char *cmd_line)
+{
+  size_t name_len;
+
+  cmd_line += strspn (cmd_line, " ");
+  name_len = strcspn (cmd_line, " ");
+  if (name_len >= sizeof args->exec_name)
+    name_len = sizeof args->exec_name - 1;
+  memcpy (args->exec_name, cmd_line, name_len);
+  args->exec_name[name_len] = '\0';
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
@@ -74,19 +250,35 @@ start_process (void *args_)
   struct intr_frame if_;
   bool success;
 
+  /* Apply the resident set cap before any page is faulted in, and
+     take the working directory, which the executable's name may be
+     relative to. */
+  thread_current ()->rss_limit = frame_rss_limit;
+  thread_current ()->cwd = args->cwd;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (args, &if_.eip, &if_.esp);
+  success = (load (args, &if_.eip, &if_.esp)
+             && (args->async ? install_files (args)
+                             : copy_pipes (args->parent)));
 
-  /* Inform parent of load status. */
-  args->loaded = success;
-  sema_up (&args->loaded_sema);
+  /* Inform parent of load status, unless it did not wait. */
+  if (args->async)
+    {
+      release_files (args);
+      free ((char *) args->cmd_line);
+      free (args);
+    }
+  else
+    {
+      args->loaded = success;
+      sema_up (&args->loaded_sema);
+    }
 
   /* If load failed, quit. */
-  palloc_free_page (args->page);
   if (!success) 
   {
     thread_current ()->exit_status = -1;
@@ -103,15 +295,240 @@ start_process (void *args_)
   NOT_REACHED ();
 }
 
+/* Creates a child process that is a copy of the current one,
+   resuming from the user context in F. Pages are shared with the
+   child copy-on-write rather than copied. Returns the child's
+   thread id, or TID_ERROR if the child cannot be created. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct fork_arg arg;
+  tid_t tid;
+
+  arg.parent = thread_current ();
+  arg.if_ = f;
+  arg.success = false;
+  sema_init (&arg.done, 0);
+
+  tid = thread_create (arg.parent->name, PRI_DEFAULT, fork_process, &arg);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&arg.done);
+
+  return arg.success ? tid : TID_ERROR;
+}
+
+/* A thread function that copies the blocked parent process in
+   ARG_ into the new thread and returns from its system call with
+   zero. */
+static void
+fork_process (void *arg_)
+{
+  struct fork_arg *arg = arg_;
+  struct thread *cur = thread_current ();
+  struct thread *parent = arg->parent->process;
+  struct intr_frame if_ = *arg->if_;
+  bool success = false;
+
+  cur->rss_limit = parent->rss_limit;
+  cur->ioring = parent->ioring;
+  cur->stdin_nonblock = parent->stdin_nonblock;
+  cur->heap_start = parent->heap_start;
+  cur->brk = parent->brk;
+  cur->cwd = filesys_cwd (parent);
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir != NULL && cur->cwd != NULL)
+    {
+      process_activate ();
+
+      /* Keep the parent's other threads from changing its address
+         space under the copy. */
+      lock_acquire (&parent->vm_lock);
+      success = (copy_files (parent)
+                 && fpu_copy (arg->parent)
+                 && vma_copy (parent)
+                 && mmap_copy (parent)
+                 && spt_copy (parent));
+      lock_release (&parent->vm_lock);
+    }
+
+  /* The parent may make its pages writable again once it runs, so
+     the copy must be complete before it is woken. */
+  arg->success = success;
+  sema_up (&arg->done);
+
+  if (!success)
+    {
+      cur->exit_status = -1;
+      thread_exit ();
+    }
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Starts a new thread in the current process, sharing its address
+   space and open files, that enters user mode at EIP with stack
+   pointer ESP.  The caller can wait for it with process_wait(),
+   which returns the status it exits with.  Returns the new thread's
+   id, or TID_ERROR if it cannot be created. */
+tid_t
+process_spawn (void (*eip) (void), void *esp)
+{
+  struct thread *cur = thread_current ();
+  struct spawn_arg arg;
+  enum intr_level old_level;
+  tid_t tid;
+
+  arg.process = cur->process;
+  arg.eip = eip;
+  arg.esp = esp;
+  sema_init (&arg.started, 0);
+
+  /* Counted before it can run, so that the process cannot end
+     under it.  We are one of the process's threads, so it cannot
+     be ending now. */
+  old_level = intr_disable ();
+  arg.process->thread_cnt++;
+  intr_set_level (old_level);
+
+  tid = thread_create (cur->name, PRI_DEFAULT, spawn_thread, &arg);
+  if (tid == TID_ERROR)
+    {
+      old_level = intr_disable ();
+      arg.process->thread_cnt--;
+      intr_set_level (old_level);
+      return TID_ERROR;
+    }
+  sema_down (&arg.started);
+  return tid;
+}
+
+/* A thread function that joins the process in ARG_ and enters
+   user mode as it says. */
+static void
+spawn_thread (void *arg_)
+{
+  struct spawn_arg *arg = arg_;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_;
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = arg->eip;
+  if_.esp = arg->esp;
+
+  cur->process = arg->process;
+  cur->pagedir = arg->process->pagedir;
+  process_activate ();
+  sema_up (&arg->started);
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current thread its own open copy of each of PARENT's
+   files, at the same positions. The executable stays denied
+   writes. Returns false if out of memory. */
+static bool
+copy_files (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  bool success = true;
+
+  for (int fd = EXEC_FD; fd < fdtable_end (&parent->fds) && success; fd++)
+    {
+      struct file *file = fdtable_ref (&parent->fds, fd);
+      struct file *copy;
+      if (file == NULL)
+        continue;
+      copy = file_reopen (file);
+      if (copy == NULL || !fdtable_set (&cur->fds, fd, copy))
+        {
+          file_close (copy);
+          success = false;
+        }
+      else if (fd == EXEC_FD)
+        file_deny_write (copy);
+      else
+        file_seek (copy, file_tell (file));
+      file_close (file);
+    }
+  return success;
+}
+
+/* Gives the current thread, a newly launched process, the files
+   the parent passed in ARGS.  Returns false if out of memory. */
+static bool
+install_files (struct process_arg *args)
+{
+  struct thread *cur = thread_current ();
+  size_t i;
+
+  for (i = 0; i < args->file_cnt; i++)
+    if (args->files[i] != NULL)
+      {
+        if (!fdtable_set (&cur->fds, EXEC_FD + 1 + i, args->files[i]))
+          return false;
+        args->files[i] = NULL;
+      }
+  return true;
+}
+
+/* Closes the files in ARGS that no process took. */
+static void
+release_files (struct process_arg *args)
+{
+  size_t i;
+
+  for (i = 0; i < args->file_cnt; i++)
+    file_close (args->files[i]);
+}
+
+/* Gives the current thread, a newly exec'd process, its own end
+   of each pipe PARENT has open, at the same descriptor, so that a
+   pipeline's stages can be wired up before they are started.
+   Returns false if out of memory. */
+static bool
+copy_pipes (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  bool success = true;
+
+  for (int fd = EXEC_FD + 1; fd < fdtable_end (&parent->fds) && success;
+       fd++)
+    {
+      struct file *file = fdtable_ref (&parent->fds, fd);
+      struct file *copy;
+      if (file == NULL)
+        continue;
+      if (file_get_pipe (file) != NULL)
+        {
+          copy = file_reopen (file);
+          if (copy == NULL || !fdtable_set (&cur->fds, fd, copy))
+            {
+              file_close (copy);
+              success = false;
+            }
+        }
+      file_close (file);
+    }
+  return success;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting. Frees the child exit information
-   if */
+   immediately, without waiting. If RUSAGE is non-null, stores the
+   resources the child used in *RUSAGE on success. Frees the child
+   exit information if */
 int
-process_wait (tid_t child_tid) 
+process_wait (tid_t child_tid, struct rusage *rusage) 
 {
   struct thread *parent;
   struct list *children;
@@ -130,6 +547,8 @@ process_wait (tid_t child_tid)
           /* Wait for child */
           sema_down (&cur_child->exited);
           int status = cur_child->exit_status;
+          if (rusage != NULL)
+            *rusage = cur_child->rusage;
 
           list_remove (&cur_child->child_elem);
 
@@ -139,7 +558,7 @@ process_wait (tid_t child_tid)
 
           /* Parent must free this shared memory if child already exited. */
           if (ref_cnt == 0)
-            palloc_free_page (cur_child);
+            free (cur_child);
 
           return status;
         }
@@ -149,14 +568,64 @@ process_wait (tid_t child_tid)
 
 /* Free the current process's resources. All files it has open,
    locks that it holds and signals all orphaned children that 
-   they can exit. */
+   they can exit.  A thread started by process_spawn() only
+   releases its own locks and children: the process lives on until
+   its first thread has exited and every other one too. */
 void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct thread *process = cur->process;
   uint32_t *pd;
 
-  printf ("%s: exit(%d)\n", cur->name, cur->exit_status);
+  /* Release all locks held by thread, first so that the process's
+     other threads, which we may wait for below, can get them. */
+  for (struct list_elem *e = list_begin (&cur->locks_held);
+       e != list_end (&cur->locks_held); e = list_next (e))
+    {
+      struct lock *l = list_entry (e, struct lock, locks_held_elem);
+      lock_release (l);
+    }
+
+  if (process == cur)
+    {
+      while (cur->thread_cnt > 1)
+        sema_down (&cur->thread_exited);
+
+      /* Write back mapped files and close files before the parent
+         can see the exit, so that it finds them as we left them. */
+      mmap_destroy ();
+      vma_destroy ();
+      for (int fd = EXEC_FD; fd < fdtable_end (&cur->fds); fd++)
+        file_close (fdtable_remove (&cur->fds, fd));
+      fdtable_destroy (&cur->fds);
+      dir_close (cur->cwd);
+      cur->cwd = NULL;
+
+      /* Correct ordering here is crucial.  We must set
+         cur->pagedir to NULL before switching page directories,
+         so that a timer interrupt can't switch back to the
+         process page directory.  We must activate the base page
+         directory before destroying the process's page
+         directory, or our active page directory will be one
+         that's been freed (and cleared).  Freeing the pages is
+         left to the reaper, once we are off the CPU, so that the
+         parent's wait() does not pay for the size of our address
+         space. */
+      pd = cur->pagedir;
+      cur->pagedir = NULL;
+      pagedir_activate (NULL);
+      if (pd != NULL && reaper_thread != NULL)
+        cur->reap_pagedir = pd;
+      else
+        {
+          spt_destroy (cur, pd);
+          pagedir_destroy (pd);
+        }
+
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_status);
+      cur->exit_info->rusage = cur->rusage;
+    }
   cur->exit_info->exit_status = cur->exit_status;
   sema_up (&cur->exit_info->exited);
 
@@ -164,7 +633,7 @@ process_exit (void)
   int ref = --(cur->exit_info->refs_cnt);
   lock_release (&cur->exit_info->refs_lock);
   if (ref == 0)
-    palloc_free_page (cur->exit_info);
+    free (cur->exit_info);
 
   /* Iterate through child processes' child exit info structs and
      decrement the reference count since parent is exiting. Free 
@@ -179,44 +648,72 @@ process_exit (void)
       lock_release (&cp->refs_lock);
 
       if (refs_cnt== 0)
-        palloc_free_page (cp);
+        free (cp);
     }
 
-  mmap_destroy ();
-  /* Close all file descriptors. */
-  for (int fd = EXEC_FD; fd < MAX_FILES; fd++)
+  if (process != cur)
     {
-      if (cur->fdtable[fd] != NULL)
-        {
-          file_close (cur->fdtable[fd]);
-          cur->fdtable[fd] = NULL;
-        }
+      enum intr_level old_level;
+
+      /* Leave the shared page directory before the first thread
+         can destroy it, and keep interrupts off until done with
+         PROCESS, which it frees once it sees our count drop. */
+      cur->pagedir = NULL;
+      pagedir_activate (NULL);
+      old_level = intr_disable ();
+      process->thread_cnt--;
+      sema_up (&process->thread_exited);
+      intr_set_level (old_level);
     }
-  
-  /* Release all locks held by thread. */
-  struct list_elem *e;
-  for (e = list_begin (&cur->locks_held); e != list_end (&cur->locks_held);
-       e = list_next (e))
+}
+
+/* Starts the thread that tears down the address spaces of exited
+   processes.  Until it runs, process_exit() does so itself. */
+void
+process_start_reaper (void)
+{
+  thread_create ("reaper", PRI_DEFAULT, reaper, NULL);
+}
+
+/* Queues T, a dying process whose reap_pagedir is set, for the
+   reaper.  Called by the scheduler, with interrupts off, once T
+   is off the CPU. */
+void
+process_reap (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (reaper_thread != NULL);
+
+  list_push_back (&reap_list, &t->elem);
+  if (reaper_idle)
     {
-      struct lock *l = list_entry (e, struct lock, locks_held_elem);
-      lock_release (l);
+      reaper_idle = false;
+      thread_unblock (reaper_thread);
     }
+}
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
-  pd = cur->pagedir;
-  if (pd != NULL) 
+/* Frees the pages, swap slots and page tables of each process
+   queued by process_reap(), then its thread page. */
+static void
+reaper (void *aux UNUSED)
+{
+  reaper_thread = thread_current ();
+  for (;;)
     {
-      /* Correct ordering here is crucial.  We must set
-         cur->pagedir to NULL before switching page directories,
-         so that a timer interrupt can't switch back to the
-         process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
-         that's been freed (and cleared). */
-      cur->pagedir = NULL;
-      pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      enum intr_level old_level = intr_disable ();
+      struct thread *t;
+
+      while (list_empty (&reap_list))
+        {
+          reaper_idle = true;
+          thread_block ();
+        }
+      t = list_entry (list_pop_front (&reap_list), struct thread, elem);
+      intr_set_level (old_level);
+
+      spt_destroy (t, t->reap_pagedir);
+      pagedir_destroy (t->reap_pagedir);
+      palloc_free_page (t);
     }
 }
 
@@ -228,8 +725,18 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* A kernel thread never enters from user mode and touches only
+     kernel memory, which every page directory maps, so it runs on
+     whatever page directory and kernel stack the last thread left.
+     Whoever frees a page directory switches off it first. */
+  if (t->pagedir == NULL)
+    return;
+
+  /* Activate thread's page tables, unless they are still loaded,
+     as when switching between threads of one process or back from
+     a kernel thread, which keeps the TLB. */
+  if (!pagedir_is_active (t->pagedir))
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -299,10 +806,10 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-/* Pushes a word at SRC to the minimal stack pointed to by *ESP */
-#define PUSH_STACK(ESP) *ESP -= WORD_SIZE
-
-static bool setup_stack (void **esp, char *exec_name, char *save_ptr);
+static bool setup_stack (void **esp, const char *cmd_line);
+static bool read_exec_info (struct file *, struct exec_info *);
+static bool lookup_exec_info (struct inode *, struct exec_info *);
+static void remember_exec_info (const struct exec_info *);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
@@ -316,9 +823,8 @@ bool
 load (struct process_arg *args, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct exec_info info;
   struct file *file = NULL;
-  off_t file_ofs;
   bool success = false;
   int i;
 
@@ -329,7 +835,6 @@ load (struct process_arg *args, void (**eip) (void), void **esp)
   process_activate ();
 
   /* Open executable file. */
-  lock_acquire(&filesys_lock);
   file = filesys_open (args->exec_name);
 
   if (file == NULL) 
@@ -339,18 +844,79 @@ load (struct process_arg *args, void (**eip) (void), void **esp)
     }
 
   file_deny_write (file);
-  /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+  /* Read and verify executable header, unless it is cached. */
+  if (!lookup_exec_info (file_get_inode (file), &info))
+    {
+      if (!read_exec_info (file, &info))
+        {
+          printf ("load: %s: error loading executable\n", args->exec_name);
+          goto done; 
+        }
+      remember_exec_info (&info);
+    }
+
+  for (i = 0; i < info.seg_cnt; i++)
+    {
+      struct exec_seg *seg = &info.segs[i];
+      uint8_t *end = seg->upage + seg->read_bytes + seg->zero_bytes;
+
+      if (!load_segment (file, seg->file_page, seg->upage, seg->read_bytes,
+                         seg->zero_bytes, seg->writable))
+        goto done;
+      if (!seg->writable)
+        spt_map_text (seg->upage, (seg->read_bytes + seg->zero_bytes)
+                                  / PGSIZE);
+      if ((seg->read_bytes + seg->zero_bytes) / PGSIZE <= exec_prefetch_pages)
+        spt_prefetch (seg->upage, DIV_ROUND_UP (seg->read_bytes, PGSIZE));
+      /* The heap starts after the highest segment. */
+      if (end > t->brk)
+        t->heap_start = t->brk = end;
+    }
+
+  /* Set up stack. */
+  if (!setup_stack (esp, args->cmd_line))
+    goto done;
+  
+  /* Start address. */
+  *eip = info.entry;
+
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not. */
+  if (file != NULL && !fdtable_set (&thread_current ()->fds, EXEC_FD, file))
+    {
+      file_close (file);
+      success = false;
+    }
+  return success;
+}
+
+/* load() helpers. */
+
+/* Reads and checks the ELF header and program headers of FILE
+   into INFO.  Returns false if FILE is not an executable we can
+   load. */
+static bool
+read_exec_info (struct file *file, struct exec_info *info)
+{
+  struct Elf32_Ehdr ehdr;
+  off_t file_ofs;
+  int i;
+
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
       || ehdr.e_machine != 3
       || ehdr.e_version != 1
       || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
       || ehdr.e_phnum > 1024) 
-    {
-      printf ("load: %s: error loading executable\n", args->exec_name);
-      goto done; 
-    }
+    return false;
+
+  info->inode = file_get_inode (file);
+  info->write_cnt = inode_write_cnt (info->inode);
+  info->entry = (void (*) (void)) ehdr.e_entry;
+  info->seg_cnt = 0;
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
@@ -359,11 +925,9 @@ load (struct process_arg *args, void (**eip) (void), void **esp)
       struct Elf32_Phdr phdr;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
-
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        return false;
+      if (file_read_at (file, &phdr, sizeof phdr, file_ofs) != sizeof phdr)
+        return false;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -377,58 +941,95 @@ load (struct process_arg *args, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          return false;
         case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
+          if (validate_segment (&phdr, file)
+              && info->seg_cnt < EXEC_SEG_MAX) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+              struct exec_seg *seg = &info->segs[info->seg_cnt++];
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
+
+              seg->writable = (phdr.p_flags & PF_W) != 0;
+              seg->file_page = phdr.p_offset & ~PGMASK;
+              seg->upage = (uint8_t *) (phdr.p_vaddr & ~PGMASK);
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  seg->read_bytes = page_offset + phdr.p_filesz;
+                  seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz,
+                                               PGSIZE)
+                                     - seg->read_bytes);
                 }
               else 
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  seg->read_bytes = 0;
+                  seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz,
+                                              PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
             }
           else
-            goto done;
+            return false;
           break;
         }
     }
+  return true;
+}
 
-  /* Set up stack. */
-  if (!setup_stack (esp, args->exec_name, args->save_ptr))
-    goto done;
-  
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+/* Copies the cached headers of the executable whose inode is
+   INODE into INFO and returns true, or returns false if there are
+   none or the file has changed since they were read. */
+static bool
+lookup_exec_info (struct inode *inode, struct exec_info *info)
+{
+  bool found = false;
+  int i;
 
-  success = true;
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE && exec_cache[i].inode != NULL; i++)
+    if (exec_cache[i].inode == inode)
+      {
+        struct exec_info e = exec_cache[i];
+
+        /* Move the entry to the front, or drop it if stale. */
+        memmove (exec_cache + 1, exec_cache, i * sizeof *exec_cache);
+        if (e.write_cnt == inode_write_cnt (inode)
+            && !inode_is_removed (inode))
+          {
+            exec_cache[0] = *info = e;
+            found = true;
+          }
+        else
+          {
+            memmove (exec_cache, exec_cache + 1,
+                     (EXEC_CACHE_SIZE - 1) * sizeof *exec_cache);
+            exec_cache[EXEC_CACHE_SIZE - 1].inode = NULL;
+            inode_close (e.inode);
+          }
+        break;
+      }
+  lock_release (&exec_cache_lock);
+  return found;
+}
 
- done:
-  /* We arrive here whether the load is successful or not. */
-  lock_release (&filesys_lock);
-  
-  thread_current ()->fdtable[EXEC_FD] = file;
-  return success;
+/* Adds INFO to the front of the executable header cache, evicting
+   the least recently used entry if the cache is full. */
+static void
+remember_exec_info (const struct exec_info *info)
+{
+  struct inode *evicted;
+
+  lock_acquire (&exec_cache_lock);
+  evicted = exec_cache[EXEC_CACHE_SIZE - 1].inode;
+  memmove (exec_cache + 1, exec_cache,
+           (EXEC_CACHE_SIZE - 1) * sizeof *exec_cache);
+  exec_cache[0] = *info;
+  exec_cache[0].inode = inode_reopen (info->inode);
+  lock_release (&exec_cache_lock);
+  inode_close (evicted);
 }
-
-/* load() helpers. */
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -497,107 +1098,60 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  size_t lazy_ofs = ofs;
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      union disk_info disk_info;
-      disk_info.filesys_info.file = file;
-      disk_info.filesys_info.page_read_bytes = page_read_bytes;
-      disk_info.filesys_info.ofs = lazy_ofs;
-      disk_info.filesys_info.writable = writable;
-
-      /* Lazy load */
-      if (!spt_try_add_upage (upage, EXEC, false, true, &disk_info))
-        return false;
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      lazy_ofs += PGSIZE;
-    }
-  return true;
+  /* Lazy load: pages get their spte from the area when first
+     faulted in. */
+  if (vma_overlaps (upage, (read_bytes + zero_bytes) / PGSIZE))
+    return false;
+  return vma_add (upage, (read_bytes + zero_bytes) / PGSIZE, EXEC, file, ofs,
+                  read_bytes, writable);
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Creates a minimal stack by mapping a zeroed page at the top of
+   user virtual memory, and lays CMD_LINE out on it as the
+   arguments to main(): its words, split at spaces, at the top,
+   then the argv[] array, argv, argc and a fake return address.
+   The line is copied up in one piece and split in place, which
+   needs no temporary array of word pointers. */
 static bool
-setup_stack (void **esp, char *exec_name, char *save_ptr) 
+setup_stack (void **esp, const char *cmd_line) 
 {
-  bool success = false;
-
-  uint8_t * stack_upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
-
-  success = spt_try_add_stack_page (stack_upage);
-  if (success)
-    *esp = PHYS_BASE;
-  else
-      return false;
-
-  void * start_height = *esp;
-
-
-  char **argv = palloc_get_page (0);
-  if (argv == NULL)
-    return false;
-
+  uint8_t *stack_upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  size_t length = strlen (cmd_line) + 1;
+  const char *p;
+  char *words, *w;
+  char **argv;
+  uint32_t *sp;
   int argc = 0;
-  for (char *token = exec_name; token != NULL;
-      token = strtok_r (NULL, " ", &save_ptr))
-    {
-      size_t length = strlen (token) + 1;
-      *esp -= length;
-      strlcpy (*esp, token, length);
-      argv[argc] = *esp;
-      argc++;
-    }
-  
-  int padding = (size_t) *esp % WORD_SIZE;
 
-  /* Calculate if will overflow a page. Magic 12 is bytes
-     needed for argc, argv and ret address 3 * WORD_SIZE. */
-  uint32_t stack_bytes_needed = (start_height - *esp) +
-                                (WORD_SIZE * argc) + 12 + padding;
-  
-  if (stack_bytes_needed > PGSIZE)
+  /* Count the words, to know where argv[] goes, and check that
+     everything fits in the page. */
+  for (p = cmd_line; *p != '\0'; p++)
+    if (*p != ' ' && (p == cmd_line || p[-1] == ' '))
+      argc++;
+  if (length + (argc + 4) * WORD_SIZE + WORD_SIZE > PGSIZE)
     return false;
 
-  if (padding)
-    {
-      *esp -= padding;
-      memset (*esp, 0, padding);
-    }
-
-  /* Push Null Pointer Sentinel as required by C standard */
-  *esp -= WORD_SIZE;
-  memset (*esp, 0, WORD_SIZE);
-
-  /* Push arguments in reverse order */
-  for (int i = argc - 1; i >= 0; i--) 
-    {
-      PUSH_STACK (esp);
-      memcpy (*esp, &argv[i], WORD_SIZE);
-    }
-
-  palloc_free_page (argv);
-
-  /* Push address of argv */
-  void *first_arg_addr = *esp;
-  PUSH_STACK (esp);
-  memcpy (*esp, &first_arg_addr, WORD_SIZE);
-
-  /* Push argc */
-  PUSH_STACK(esp);
-  memcpy (*esp, &argc, WORD_SIZE);
-
-  /* Push fake pointer */
-  *esp -= WORD_SIZE;
-  memset (*esp, 0, WORD_SIZE);
+  if (!spt_try_add_stack_page (stack_upage))
+    return false;
 
-  return success;
+  words = (char *) PHYS_BASE - length;
+  argv = (char **) ROUND_DOWN ((uintptr_t) words, WORD_SIZE) - (argc + 1);
+  strlcpy (words, cmd_line, length);
+
+  /* Split the words, recording where each starts.  argv[ARGC] is
+     already null in the zeroed page. */
+  argc = 0;
+  for (w = words; w < (char *) PHYS_BASE - 1; w++)
+    if (*w == ' ')
+      *w = '\0';
+    else if (*w != '\0' && (w == words || w[-1] == '\0'))
+      argv[argc++] = w;
+
+  /* Push argv, argc and a fake return address. */
+  sp = (uint32_t *) argv;
+  *--sp = (uint32_t) argv;
+  *--sp = argc;
+  *--sp = 0;
+  *esp = sp;
+  return true;
 }
@@ -1,34 +1,54 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 
 #define WORD_SIZE sizeof (void *)       /* Word size for use by stack setup. */
+#define SPAWN_FD_MAX 16                 /* Most files process_launch() passes. */
+
+struct file;
 
 /* Argument passed into the thread function start_process when a child
-   thread is created in process_execute (). Process execute does initial
-   parsing so stores executable name 'exec_name' as well as pointer 'save_ptr'
-   to rest of the command line.
-   
-   Member 'page' is a pointer to the temporary buffer on which the command line 
-   is stored, allowing the child process to free it.
-   
+   thread is created in process_execute (). Process execute copies out
+   the executable name 'exec_name', the first word of the kernel copy
+   'cmd_line' of the command line.
+
+   The parent frees 'cmd_line' once 'loaded_sema' is up, by which time
+   load () has copied it onto the new stack.
+
    Member 'loaded' is used to return load status of child back to parent and 
    'loaded_sema' synchronizes parent process with loading child to ensure that 
-   parent waits to find out if child successfully loaded. */
+   parent waits to find out if child successfully loaded.
+
+   For process_launch () the parent does not wait: 'async' is set, the
+   child owns and frees the structure and 'cmd_line', and 'files' holds
+   the files it is to get at descriptors EXEC_FD + 1 on. */
 struct process_arg 
     {
-        char *exec_name;                /* Name of executable. */
-        char *save_ptr;                 /* Save ptr from tokenizing cmd line. */
-        char *page;                     /* Page on which cmd_line stored. */
+        char exec_name[16];             /* Name of executable. */
+        const char *cmd_line;           /* Whole command line. */
+        struct thread *parent;          /* Process running exec(). */
         bool loaded;                    /* Whether child load successful. */
         struct semaphore loaded_sema;   /* Ensure parent waits for child to
                                            load. */
+        bool async;                     /* Started by process_launch ()? */
+        struct file *files[SPAWN_FD_MAX]; /* Files for the child, or nulls. */
+        size_t file_cnt;                /* Entries in 'files'. */
+        struct dir *cwd;                /* Working directory inherited. */
     };
 
+extern size_t exec_prefetch_pages;
+
+void process_init (void);
 tid_t process_execute (const char *file_name);
-int process_wait (tid_t);
+tid_t process_launch (const char *file_name, const int *fds, size_t cnt);
+tid_t process_fork (struct intr_frame *f);
+tid_t process_spawn (void (*eip) (void), void *esp);
+int process_wait (tid_t, struct rusage *);
 void process_exit (void);
 void process_activate (void);
+void process_start_reaper (void);
+void process_reap (struct thread *);
 
 #endif /* userprog/process.h */
@@ -1,28 +1,48 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <ioring.h>
+#include <iovec.h>
+#include <limits.h>
+#include <poll.h>
+#include <round.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <syscall-nr.h>
+#include <sysstat.h>
+#include "devices/block.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
+#include "filesys/pipe.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "userprog/exception.h"
+#include "userprog/futex.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#include "userprog/usercopy.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/mmap.h"
+#include "vm/swap.h"
+#include "vm/vma.h"
 
 static void syscall_handler (struct intr_frame *);
 
 static void sys_halt (void);
 static void sys_exit (uint32_t *esp);
 static pid_t sys_exec (uint32_t *esp);
+static pid_t sys_spawn (uint32_t *esp);
 static int sys_wait (uint32_t *esp);
 static bool sys_create (uint32_t *esp);
 static bool sys_remove (uint32_t *esp);
@@ -35,14 +55,199 @@ static unsigned sys_tell (uint32_t *esp);
 static void sys_close (uint32_t *esp);
 static mapid_t sys_mmap (uint32_t *esp);
 static void sys_munmap (uint32_t *esp);
+static bool sys_chdir (uint32_t *esp);
+static bool sys_mkdir (uint32_t *esp);
+static int sys_wait_on (uint32_t *esp);
+static int sys_wake (uint32_t *esp);
+static bool sys_memstat (uint32_t *esp);
+static pid_t sys_fork (struct intr_frame *f);
+static void sys_msync (uint32_t *esp);
+static bool sys_madvise (uint32_t *esp);
+static void *sys_sbrk (uint32_t *esp);
+static int sys_getdents (uint32_t *esp);
+static bool sys_fallocate (uint32_t *esp);
+static bool sys_fsync (uint32_t *esp);
+static bool sys_fdatasync (uint32_t *esp);
+static bool sync_fd (int fd, bool metadata);
+static bool sys_sched_deadline (uint32_t *esp);
+static bool sys_blockstat (uint32_t *esp);
+static bool sys_ioring_setup (uint32_t *esp);
+static int sys_ioring_enter (uint32_t *esp);
+static int sys_pread (uint32_t *esp);
+static int sys_pwrite (uint32_t *esp);
+static int sys_readv (uint32_t *esp);
+static int sys_writev (uint32_t *esp);
+static int sys_copy_file_range (uint32_t *esp);
+static pid_t sys_thread_spawn (uint32_t *esp);
+static int sys_poll (uint32_t *esp);
+static int sys_fcntl (uint32_t *esp);
+static bool sys_pipe (uint32_t *esp);
+static bool sys_intrstat (uint32_t *esp);
+static int sys_trace_read (uint32_t *esp);
+static int sys_stats (uint32_t *esp);
+static int sys_wait_rusage (uint32_t *esp);
+
+static int do_read (int fd, uint8_t *buffer, unsigned size);
+static int do_write (int fd, char *buffer, unsigned size);
+static int do_pread (int fd, void *buffer, unsigned size, unsigned offset);
+static int do_pwrite (int fd, void *buffer, unsigned size, unsigned offset);
+static int do_vector (uint32_t *esp, bool write);
+static bool do_seek (int fd, unsigned pos);
+static void do_close (int fd);
+static int do_ioring_op (const struct ioring_sqe *);
+static short poll_fd (int fd, short events, bool *pipes);
 
 static char *get_arg_string (void *esp, int pos, int limit);
 static void *get_arg_buffer (void *esp, int pos, int size);
 static int get_arg_int (void *esp, int pos);
 
-static bool is_valid_memory (void *buffer, unsigned size);
+static void pin_user_range (void *buffer, unsigned size, bool write);
+static void unpin_user_range (void *buffer, unsigned size);
 static bool is_valid_address (void *uaddr);
 static bool is_valid_fd (int fd);
+static struct file *get_file (int fd);
+
+/* Adapts sys_NAME, which takes the user stack pointer and
+   returns a value, to the dispatch table's signature. */
+#define SYSCALL(NAME)                                   \
+  static uint32_t                                       \
+  call_##NAME (struct intr_frame *f)                    \
+  {                                                     \
+    return (uint32_t) sys_##NAME (f->esp);              \
+  }
+
+/* Likewise, for a sys_NAME that returns nothing. */
+#define SYSCALL_VOID(NAME)                              \
+  static uint32_t                                       \
+  call_##NAME (struct intr_frame *f)                    \
+  {                                                     \
+    sys_##NAME (f->esp);                                \
+    return 0;                                           \
+  }
+
+static uint32_t call_halt (struct intr_frame *);
+static uint32_t call_exit (struct intr_frame *);
+static uint32_t call_fork (struct intr_frame *);
+SYSCALL (exec)
+SYSCALL (wait)
+SYSCALL (create)
+SYSCALL (remove)
+SYSCALL (open)
+SYSCALL (filesize)
+SYSCALL (read)
+SYSCALL (write)
+SYSCALL_VOID (seek)
+SYSCALL (tell)
+SYSCALL_VOID (close)
+SYSCALL (mmap)
+SYSCALL_VOID (munmap)
+SYSCALL (chdir)
+SYSCALL (mkdir)
+SYSCALL (wait_on)
+SYSCALL (wake)
+SYSCALL (memstat)
+SYSCALL_VOID (msync)
+SYSCALL (madvise)
+SYSCALL (sbrk)
+SYSCALL (getdents)
+SYSCALL (fallocate)
+SYSCALL (blockstat)
+SYSCALL (ioring_setup)
+SYSCALL (ioring_enter)
+SYSCALL (pread)
+SYSCALL (pwrite)
+SYSCALL (readv)
+SYSCALL (writev)
+SYSCALL (copy_file_range)
+SYSCALL (thread_spawn)
+SYSCALL (poll)
+SYSCALL (fcntl)
+SYSCALL (pipe)
+SYSCALL (intrstat)
+SYSCALL (trace_read)
+SYSCALL (stats)
+SYSCALL (wait_rusage)
+SYSCALL (fsync)
+SYSCALL (fdatasync)
+SYSCALL (sched_deadline)
+SYSCALL (spawn)
+
+/* A system call handler, which returns the value for EAX. */
+typedef uint32_t syscall_func (struct intr_frame *);
+
+/* System calls by number. */
+static const struct syscall_entry
+  {
+    syscall_func *handler;      /* Handler, null if unassigned. */
+    const char *name;           /* Name, for statistics. */
+  }
+syscall_table[SYS_CNT] =
+  {
+    [SYS_HALT] = { call_halt, "halt" },
+    [SYS_EXIT] = { call_exit, "exit" },
+    [SYS_EXEC] = { call_exec, "exec" },
+    [SYS_WAIT] = { call_wait, "wait" },
+    [SYS_CREATE] = { call_create, "create" },
+    [SYS_REMOVE] = { call_remove, "remove" },
+    [SYS_OPEN] = { call_open, "open" },
+    [SYS_FILESIZE] = { call_filesize, "filesize" },
+    [SYS_READ] = { call_read, "read" },
+    [SYS_WRITE] = { call_write, "write" },
+    [SYS_SEEK] = { call_seek, "seek" },
+    [SYS_TELL] = { call_tell, "tell" },
+    [SYS_CLOSE] = { call_close, "close" },
+    [SYS_MMAP] = { call_mmap, "mmap" },
+    [SYS_MUNMAP] = { call_munmap, "munmap" },
+    [SYS_CHDIR] = { call_chdir, "chdir" },
+    [SYS_MKDIR] = { call_mkdir, "mkdir" },
+    [SYS_WAIT_ON] = { call_wait_on, "wait_on" },
+    [SYS_WAKE] = { call_wake, "wake" },
+    [SYS_MEMSTAT] = { call_memstat, "memstat" },
+    [SYS_FORK] = { call_fork, "fork" },
+    [SYS_MSYNC] = { call_msync, "msync" },
+    [SYS_MADVISE] = { call_madvise, "madvise" },
+    [SYS_SBRK] = { call_sbrk, "sbrk" },
+    [SYS_GETDENTS] = { call_getdents, "getdents" },
+    [SYS_FALLOCATE] = { call_fallocate, "fallocate" },
+    [SYS_BLOCKSTAT] = { call_blockstat, "blockstat" },
+    [SYS_IORING_SETUP] = { call_ioring_setup, "ioring_setup" },
+    [SYS_IORING_ENTER] = { call_ioring_enter, "ioring_enter" },
+    [SYS_PREAD] = { call_pread, "pread" },
+    [SYS_PWRITE] = { call_pwrite, "pwrite" },
+    [SYS_READV] = { call_readv, "readv" },
+    [SYS_WRITEV] = { call_writev, "writev" },
+    [SYS_COPY_FILE_RANGE] = { call_copy_file_range, "copy_file_range" },
+    [SYS_THREAD_SPAWN] = { call_thread_spawn, "thread_spawn" },
+    [SYS_POLL] = { call_poll, "poll" },
+    [SYS_FCNTL] = { call_fcntl, "fcntl" },
+    [SYS_PIPE] = { call_pipe, "pipe" },
+    [SYS_INTRSTAT] = { call_intrstat, "intrstat" },
+    [SYS_TRACE_READ] = { call_trace_read, "trace_read" },
+    [SYS_STATS] = { call_stats, "stats" },
+    [SYS_WAIT_RUSAGE] = { call_wait_rusage, "wait_rusage" },
+    [SYS_FSYNC] = { call_fsync, "fsync" },
+    [SYS_FDATASYNC] = { call_fdatasync, "fdatasync" },
+    [SYS_SCHED_DEADLINE] = { call_sched_deadline, "sched_deadline" },
+    [SYS_SPAWN] = { call_spawn, "spawn" },
+  };
+
+/* System call statistics.  Bucket B of a latency histogram counts
+   calls that took between 2**(B-1) and 2**B - 1 CPU cycles (bucket
+   0 counts zero-cycle calls).  A call that never returns, such as
+   exit, counts toward call_cnt only. */
+#define SYSCALL_BUCKETS 32
+static struct syscall_stats
+  {
+    unsigned long long call_cnt;        /* Calls made. */
+    unsigned long long error_cnt;       /* Calls that returned -1. */
+    uint64_t cycles;                    /* Cycles in returning calls. */
+    unsigned latency[SYSCALL_BUCKETS];  /* Latency histogram. */
+  }
+syscall_stats[SYS_CNT];
+
+static void count_syscall (struct thread *, uint32_t syscall_num);
+static void account_syscall (uint32_t syscall_num, uint32_t result,
+                             uint64_t cycles);
 
 #define CMD_LINE_MAX 128        /* Maximum number of command line characters */
 
@@ -50,7 +255,7 @@ void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init (&filesys_lock);
+  futex_init ();
 }
 
 static void
@@ -58,6 +263,7 @@ syscall_handler (struct intr_frame *f)
 {
   struct thread *cur;
   uint32_t syscall_num;
+  uint64_t start;
 
   cur = thread_current ();
   cur->in_syscall = true;
@@ -66,70 +272,89 @@ syscall_handler (struct intr_frame *f)
     exit (SYSCALL_ERROR);
 
   syscall_num = get_arg_int (f->esp, 0);
-  switch (syscall_num)
-  {
-    case SYS_HALT:
-      sys_halt ();
-      break;
-    case SYS_EXIT:
-      sys_exit (f->esp);
-      break;
-    case SYS_EXEC:
-      f->eax = sys_exec (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_WAIT:
-      f->eax = sys_wait (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_CREATE:
-      f->eax = sys_create (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_REMOVE:
-      f->eax = sys_remove (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_OPEN:
-      f->eax = sys_open (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_FILESIZE:
-      f->eax = sys_filesize (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_READ:
-      f->eax = sys_read (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_WRITE:
-      f->eax = sys_write (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_SEEK:
-      sys_seek (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_TELL:
-      f->eax = sys_tell (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_CLOSE:
-      sys_close (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_MMAP:
-      f->eax = sys_mmap (f->esp);
-      cur->in_syscall = false;
-      break;
-    case SYS_MUNMAP:
-      sys_munmap (f->esp);
-      cur->in_syscall = false;
-      break;
-    default:
-      exit (SYSCALL_ERROR);
-  }
-  frame_unpin (f->esp);
+  trace (TRACE_SYSCALL, syscall_num, cur->tid, 0, 0);
+  if (syscall_num >= SYS_CNT || syscall_table[syscall_num].handler == NULL)
+    exit (SYSCALL_ERROR);
+  count_syscall (cur, syscall_num);
+  start = timer_cycles ();
+  f->eax = syscall_table[syscall_num].handler (f);
+  account_syscall (syscall_num, f->eax, timer_cycles () - start);
+  cur->in_syscall = false;
+  frame_loaded (f->esp);
+}
+
+static uint32_t
+call_halt (struct intr_frame *f UNUSED)
+{
+  sys_halt ();
+  NOT_REACHED ();
+}
+
+static uint32_t
+call_exit (struct intr_frame *f)
+{
+  sys_exit (f->esp);
+  NOT_REACHED ();
+}
+
+static uint32_t
+call_fork (struct intr_frame *f)
+{
+  return sys_fork (f);
+}
+
+/* Counts a call to system call SYSCALL_NUM by thread T, both
+   system-wide and for T's process. */
+static void
+count_syscall (struct thread *t, uint32_t syscall_num)
+{
+  enum intr_level old_level = intr_disable ();
+
+  syscall_stats[syscall_num].call_cnt++;
+  t->process->rusage.syscalls[syscall_num]++;
+  intr_set_level (old_level);
+}
+
+/* Adds the return of a call to system call SYSCALL_NUM, which
+   returned RESULT after CYCLES cycles, to the statistics. */
+static void
+account_syscall (uint32_t syscall_num, uint32_t result, uint64_t cycles)
+{
+  struct syscall_stats *s = &syscall_stats[syscall_num];
+  enum intr_level old_level;
+  int b = 0;
+
+  while (b < SYSCALL_BUCKETS - 1 && cycles >> b != 0)
+    b++;
+
+  old_level = intr_disable ();
+  if (result == (uint32_t) SYSCALL_ERROR)
+    s->error_cnt++;
+  s->cycles += cycles;
+  s->latency[b]++;
+  intr_set_level (old_level);
+}
+
+/* Prints system call statistics. */
+void
+syscall_print_stats (void)
+{
+  int i;
+
+  printf ("Syscall: calls, errors, avg cycles, latency in cycles:\n");
+  for (i = 0; i < SYS_CNT; i++)
+    {
+      const struct syscall_stats *s = &syscall_stats[i];
+      int b;
+
+      if (s->call_cnt == 0)
+        continue;
+      printf ("  %s: %llu, %llu, %"PRIu64"\n", syscall_table[i].name,
+              s->call_cnt, s->error_cnt, s->cycles / s->call_cnt);
+      for (b = 0; b < SYSCALL_BUCKETS; b++)
+        if (s->latency[b] != 0)
+          printf ("    < 2^%-2d %u\n", b, s->latency[b]);
+    }
 }
 
 /* Interface to the exit syscall to allow the page fault exception handler
@@ -145,11 +370,15 @@ exit (int status)
    to unmap its memory and so do appropriate cleanup for a thread. */
 void munmap (mapid_t mapid)
 {
+  bool locked = spt_lock ();
   struct mmap_table_entry *entry = mmap_find (mapid);
-  if (entry == NULL)
-    return;
-  spt_remove_upages (entry->begin_upage, entry->pg_cnt);
-  mmap_remove (mapid);
+  if (entry != NULL)
+    {
+      vma_remove (entry->begin_upage);
+      spt_remove_upages (entry->begin_upage, entry->pg_cnt);
+      mmap_remove (mapid);
+    }
+  spt_unlock (locked);
 }
 
 static void
@@ -178,7 +407,37 @@ sys_exec (uint32_t *esp)
     return TID_ERROR;
   
   pid = process_execute (cmd_line);
-  frame_unpin (cmd_line);
+  frame_loaded (cmd_line);
+  return pid;
+}
+
+/* Like sys_exec(), but returns without waiting for the child to
+   load, as process_launch() does, and gives the child the files
+   open at the descriptors in the array given as the second
+   argument, whose length is the third, in place of the parent's
+   pipes.  The array may be null if the length is 0.  Exits if the
+   array is invalid. */
+static pid_t
+sys_spawn (uint32_t *esp)
+{
+  unsigned cnt = get_arg_int (esp, 3);
+  int fds[SPAWN_FD_MAX];
+  char *cmd_line;
+  pid_t pid;
+
+  if (cnt > SPAWN_FD_MAX)
+    return TID_ERROR;
+  if (cnt > 0
+      && !copy_from_user (fds, get_arg_buffer (esp, 2, cnt * sizeof *fds),
+                          cnt * sizeof *fds))
+    exit (SYSCALL_ERROR);
+
+  cmd_line = get_arg_string (esp, 1, CMD_LINE_MAX);
+  if (cmd_line == NULL)
+    return TID_ERROR;
+
+  pid = process_launch (cmd_line, fds, cnt);
+  frame_loaded (cmd_line);
   return pid;
 }
 
@@ -189,7 +448,24 @@ sys_wait (uint32_t *esp)
 
   pid = get_arg_int (esp, 1);
 
-  return process_wait (pid);
+  return process_wait (pid, NULL);
+}
+
+/* Like sys_wait(), but also copies the resources the child used
+   to the user buffer given as the second argument, unless the
+   result is -1.  Exits if the buffer is invalid. */
+static int
+sys_wait_rusage (uint32_t *esp)
+{
+  pid_t pid = get_arg_int (esp, 1);
+  struct rusage *buffer = get_arg_buffer (esp, 2, sizeof *buffer);
+  struct rusage rusage;
+  int status;
+
+  status = process_wait (pid, &rusage);
+  if (status != TID_ERROR && !copy_to_user (buffer, &rusage, sizeof rusage))
+    exit (SYSCALL_ERROR);
+  return status;
 }
 
 static bool
@@ -199,15 +475,13 @@ sys_create (uint32_t *esp)
   char *fname;
   off_t initial_size;
 
-  fname = get_arg_string (esp, 1, NAME_MAX);
+  fname = get_arg_string (esp, 1, PATH_MAX);
   if (fname == NULL)
     return false;
 
   initial_size = get_arg_int (esp, 2);
-  lock_acquire (&filesys_lock);
   ret = filesys_create (fname, initial_size);
-  lock_release (&filesys_lock);
-  frame_unpin (fname);
+  frame_loaded (fname);
   return ret;
 }
 
@@ -217,14 +491,12 @@ sys_remove (uint32_t *esp)
   bool ret;
   char *fname;
   
-  fname = get_arg_string (esp, 1, NAME_MAX);
+  fname = get_arg_string (esp, 1, PATH_MAX);
   if (fname == NULL)
     return false;
 
-  lock_acquire (&filesys_lock);
   ret = filesys_remove (fname);
-  lock_release (&filesys_lock);
-  frame_unpin (fname);
+  frame_loaded (fname);
   return ret;
 }
 
@@ -235,26 +507,26 @@ sys_open (uint32_t *esp)
   char *fname;
   struct thread *cur;
 
-  fname = get_arg_string (esp, 1, NAME_MAX);
+  fname = get_arg_string (esp, 1, PATH_MAX);
   if (fname == NULL)
     return SYSCALL_ERROR;
 
-  lock_acquire (&filesys_lock);
   struct file *fp = filesys_open (fname);
-  lock_release (&filesys_lock);
 
-  frame_unpin (fname);
+  frame_loaded (fname);
 
   cur = thread_current ();
-  /* File open unsuccessful or file limit hit */
-  if (fp == NULL || cur->next_fd < 0)
+  /* File open unsuccessful */
+  if (fp == NULL)
     return SYSCALL_ERROR;
 
-  ret = cur->next_fd;
-  cur->fdtable[ret] = fp;
-  
-  /* Find next available fd */
-  thread_update_next_fd (cur);
+  /* File limit hit */
+  ret = fdtable_alloc (&cur->process->fds, fp);
+  if (ret < 0)
+    {
+      file_close (fp);
+      return SYSCALL_ERROR;
+    }
   return ret;
 }
 
@@ -269,13 +541,12 @@ sys_filesize (uint32_t *esp)
   if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO)
     exit (SYSCALL_ERROR);
   
-  struct file *file = thread_current ()->fdtable[fd];
+  struct file *file = get_file (fd);
 	if (file == NULL)
 		exit (SYSCALL_ERROR);
   
-  lock_acquire (&filesys_lock);
 	size = file_length (file);
-  lock_release (&filesys_lock);
+  file_close (file);
   
   return size;
 }
@@ -283,51 +554,69 @@ sys_filesize (uint32_t *esp)
 static int
 sys_read (uint32_t *esp)
 {
-
   int fd;
   uint8_t *buffer;
   unsigned size;
-  int bytes_read = 0;
 
   fd = get_arg_int (esp, 1);
   size = get_arg_int (esp, 3);
   buffer = (uint8_t *) get_arg_buffer (esp, 2, size);
 
+  return do_read (fd, buffer, size);
+}
+
+/* Reads SIZE bytes from fd into the user BUFFER, already checked
+   to lie in user space.  Returns the number of bytes read, or -1
+   if fd is not open for reading.  The console blocks until SIZE
+   keys have been read; with O_NONBLOCK it returns -1 if no key
+   is buffered, and otherwise returns what is buffered. */
+static int
+do_read (int fd, uint8_t *buffer, unsigned size)
+{
+  int bytes_read = 0;
+
   if (!is_valid_fd (fd) || fd == STDOUT_FILENO)
     {
       return SYSCALL_ERROR;
     }
-  else if (fd == STDIN_FILENO)
+
+  if (fd == STDIN_FILENO && size > 0
+      && thread_current ()->process->stdin_nonblock && !input_wait (0))
+    return SYSCALL_ERROR;
+
+  pin_user_range (buffer, size, true);
+  if (fd == STDIN_FILENO)
     {
-      while (size--)
+      bool nonblock = thread_current ()->process->stdin_nonblock;
+
+      while ((unsigned) bytes_read < size)
         {
-          *buffer++ = input_getc ();
-          bytes_read++;
+          bytes_read += input_getbuf (buffer + bytes_read,
+                                      size - bytes_read);
+          if (nonblock && !input_wait (0))
+            break;
         }
     }
   else
     {
-        struct thread *cur = thread_current ();
-        struct file *fp = cur->fdtable[fd];
+        struct file *fp = get_file (fd);
 
         if (fp == NULL)
-          return SYSCALL_ERROR;
-
-        lock_acquire (&filesys_lock);
-        bytes_read = file_read (fp, buffer, size);
-        lock_release (&filesys_lock);
+          bytes_read = SYSCALL_ERROR;
+        else
+          bytes_read = file_read (fp, buffer, size);
+        file_close (fp);
     }
+  unpin_user_range (buffer, size);
+  if (bytes_read > 0)
+    thread_current ()->process->rusage.read_bytes += bytes_read;
   
   return bytes_read;
 }
 
-#define BUF_MAX 512           /* Max bytes to write to console in one call */
-
 static int
 sys_write (uint32_t *esp)
 {
-  int bytes_written = 0;
-
   int fd;
   char *buffer;
   unsigned size;
@@ -336,33 +625,41 @@ sys_write (uint32_t *esp)
   size = get_arg_int (esp, 3);
   buffer = get_arg_buffer (esp, 2, size);
 
+  return do_write (fd, buffer, size);
+}
+
+/* Writes SIZE bytes from the user BUFFER, already checked to lie
+   in user space, to fd.  Returns the number of bytes written, or
+   -1 if fd is not open for writing. */
+static int
+do_write (int fd, char *buffer, unsigned size)
+{
+  int bytes_written = 0;
+
   if (!is_valid_fd (fd) || fd == STDIN_FILENO)
+    return SYSCALL_ERROR;
+
+  pin_user_range (buffer, size, false);
+  if (fd == STDOUT_FILENO)
     {
-      bytes_written = SYSCALL_ERROR;
-    }
-  else if (fd == STDOUT_FILENO)
-    {
-      int remaining = size;
-      while (remaining > 0)
-        {
-          int to_write = remaining > BUF_MAX ? BUF_MAX : remaining;
-          putbuf (buffer, to_write);
-          remaining -= to_write;
-        }
+      /* One putbuf() keeps the write from being interleaved with
+         other output and queues it for the serial port in bulk. */
+      putbuf (buffer, size);
       bytes_written = size;
     }
   else 
     {
-      struct thread *cur = thread_current ();
-      struct file *fp = cur->fdtable[fd];
+      struct file *fp = get_file (fd);
 
       if (fp == NULL) 
-        return SYSCALL_ERROR;
-
-      lock_acquire (&filesys_lock);
-      bytes_written = file_write(fp, buffer, size);
-      lock_release (&filesys_lock);
+        bytes_written = SYSCALL_ERROR;
+      else
+        bytes_written = file_write(fp, buffer, size);
+      file_close (fp);
     }
+  unpin_user_range (buffer, size);
+  if (bytes_written > 0)
+    thread_current ()->process->rusage.write_bytes += bytes_written;
 
   return bytes_written;
 }
@@ -372,18 +669,28 @@ sys_seek (uint32_t *esp)
 {
   int fd;
   unsigned pos;
-  struct thread *cur;
 
   fd = get_arg_int (esp, 1);
   pos = get_arg_int (esp, 2);
-  cur = thread_current ();
 
-  if (!is_valid_fd(fd) || cur->fdtable[fd] == NULL)
+  if (!do_seek (fd, pos))
     exit (SYSCALL_ERROR);
-  
-  lock_acquire (&filesys_lock);
-  file_seek (cur->fdtable[fd], pos);
-  lock_release (&filesys_lock);
+}
+
+/* Moves fd's position to POS.  Returns false if fd is not open. */
+static bool
+do_seek (int fd, unsigned pos)
+{
+  struct file *fp;
+
+  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return false;
+  fp = get_file (fd);
+  if (fp == NULL)
+    return false;
+  file_seek (fp, pos);
+  file_close (fp);
+  return true;
 }
 
 static unsigned
@@ -391,17 +698,16 @@ sys_tell (uint32_t *esp)
 {
   int ret;
   int fd;
-  struct thread *cur;
+  struct file *fp;
 
   fd = get_arg_int (esp, 1);
-  cur = thread_current ();
+  fp = get_file (fd);
 
-  if (cur->fdtable[fd] == NULL)
+  if (fp == NULL)
     exit (SYSCALL_ERROR);
 
-  lock_acquire (&filesys_lock);
-  ret = file_tell (cur->fdtable[fd]);
-  lock_release (&filesys_lock);
+  ret = file_tell (fp);
+  file_close (fp);
 
   return ret;
 }
@@ -409,29 +715,19 @@ sys_tell (uint32_t *esp)
 static void
 sys_close (uint32_t *esp)
 {
-  int fd;
-
-  fd = get_arg_int (esp, 1);
+  do_close (get_arg_int (esp, 1));
+}
 
-  if (fd >= MAX_FILES || fd == STDIN_FILENO || fd == STDOUT_FILENO)
+/* Closes fd, if open. */
+static void
+do_close (int fd)
+{
+  if (fd == STDIN_FILENO || fd == STDOUT_FILENO)
     return;
-  
-  struct thread *cur = thread_current ();
-  struct file *fp = cur->fdtable[fd];
-
-  /* Have previously closed the given file descriptor. */
-  if (fp == NULL)
-    return;
-  
-  lock_acquire (&filesys_lock);
-  file_close (fp);
-  lock_release (&filesys_lock);
-
-  cur->fdtable[fd] = NULL;
-
-  if (fd < cur->next_fd)
-    cur->next_fd = fd;
 
+  /* Does nothing if the descriptor was never open or was
+     closed before. */
+  file_close (fdtable_remove (&thread_current ()->process->fds, fd));
 }
 
 static mapid_t
@@ -442,55 +738,58 @@ sys_mmap (uint32_t *esp)
   mapid_t ret = SYSCALL_ERROR;
   struct thread *cur = thread_current ();
   
-  struct file *fp;
+  struct file *fp = NULL;
+  struct file *map_file;
   off_t file_len;
   int pg_cnt;
+  bool locked = false;
 
   /* Any issues with file descriptors. */
-  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO || 
-      cur->next_fd == -1)
+  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO)
     goto done;
   
-  cur = thread_current ();
-  fp = cur->fdtable[fd];
+  fp = get_file (fd);
   if (fp == NULL)
     goto done;
   
   if (!is_valid_address (addr) || pg_ofs (addr) != 0)
     goto done;
 
-  lock_acquire (&filesys_lock);
   file_len = file_length (fp);
-  lock_release (&filesys_lock);
 
   if (file_len == 0 || !is_user_vaddr (addr + file_len))
     goto done;
 
   pg_cnt = (pg_round_up (addr + file_len) - addr) / PGSIZE;
+  locked = spt_lock ();
+  if (fdtable_lowest_free (&cur->process->fds) < 0)
+    goto done;
   for (int pg = 0; pg < pg_cnt; pg++ )
     {
       /* Check not already mapped. */
       if (spt_find (addr + (pg * PGSIZE)) != NULL)
         goto done;
     }
+  if (vma_overlaps (addr, pg_cnt))
+    goto done;
 
-  lock_acquire (&filesys_lock);
-  fp = file_reopen (fp);
-  lock_release (&filesys_lock);
+  map_file = file_reopen (fp);
   
-  if (fp == NULL)
+  if (map_file == NULL)
     goto done;
   
-  if (!spt_try_add_mmap_pages (addr, fp, pg_cnt, file_len % PGSIZE))
+  if (!vma_add (addr, pg_cnt, MMAP, map_file, 0, file_len, true))
     {
       goto done;
     }
 
   ret = mmap_insert (addr, pg_cnt);
   if (ret == -1)
-    spt_remove_upages (addr, pg_cnt);
+    vma_remove (addr);
 
   done:
+    spt_unlock (locked);
+    file_close (fp);
     return ret;
 }
 
@@ -501,35 +800,806 @@ sys_munmap (uint32_t *esp)
   munmap (mapid);
 }
 
+/* Changes the process's working directory to the one named by the
+   first argument.  Returns false if there is no such directory. */
+static bool
+sys_chdir (uint32_t *esp)
+{
+  char *dname = get_arg_string (esp, 1, PATH_MAX);
+  bool ret;
+
+  if (dname == NULL)
+    return false;
+  ret = filesys_chdir (dname);
+  frame_loaded (dname);
+  return ret;
+}
+
+/* Creates the directory named by the first argument.  Returns
+   false if it exists already or its parent does not. */
+static bool
+sys_mkdir (uint32_t *esp)
+{
+  char *dname = get_arg_string (esp, 1, PATH_MAX);
+  bool ret;
+
+  if (dname == NULL)
+    return false;
+  ret = filesys_mkdir (dname);
+  frame_loaded (dname);
+  return ret;
+}
+
+/* Sleeps while the int at the given user address holds the
+   expected value.  Returns 0 once woken, or -1 immediately if the
+   value differs.  Exits if the address is invalid or unaligned. */
+static int
+sys_wait_on (uint32_t *esp)
+{
+  int *addr;
+  int expected;
+
+  addr = get_arg_buffer (esp, 1, sizeof (int));
+  expected = get_arg_int (esp, 2);
+  if ((uintptr_t) addr % sizeof (int) != 0)
+    exit (SYSCALL_ERROR);
+
+  return futex_wait (addr, expected);
+}
+
+/* Wakes up to N threads sleeping on the given user address and
+   returns the number woken.  Exits if the address is invalid or
+   unaligned. */
+static int
+sys_wake (uint32_t *esp)
+{
+  int *addr;
+  int n;
+
+  addr = get_arg_buffer (esp, 1, sizeof (int));
+  n = get_arg_int (esp, 2);
+  if ((uintptr_t) addr % sizeof (int) != 0)
+    exit (SYSCALL_ERROR);
+
+  return futex_wake (addr, n);
+}
+
+/* Copies the page allocator statistics of the user pool, if the
+   first argument is nonzero, or else the kernel pool, to the
+   given user buffer.  Returns true.  Exits if the buffer is
+   invalid. */
+static bool
+sys_memstat (uint32_t *esp)
+{
+  bool user;
+  struct memstat *buffer;
+  struct memstat stats;
+
+  user = get_arg_int (esp, 1) != 0;
+  buffer = get_arg_buffer (esp, 2, sizeof *buffer);
+
+  palloc_get_stats (user, &stats);
+  if (!copy_to_user (buffer, &stats, sizeof stats))
+    exit (SYSCALL_ERROR);
+  return true;
+}
+
+/* Duplicates the calling process, whose user context is F.
+   Returns the child's pid to the parent, or -1 on failure; the
+   child returns 0. */
+static pid_t
+sys_fork (struct intr_frame *f)
+{
+  return process_fork (f);
+}
+
+/* Writes the dirty pages of mapping MAPID back to its file without
+   unmapping it. */
+static void
+sys_msync (uint32_t *esp)
+{
+  mapid_t mapid = get_arg_int (esp, 1);
+  bool locked = spt_lock ();
+  struct mmap_table_entry *entry = mmap_find (mapid);
+
+  if (entry != NULL)
+    spt_flush_upages (entry->begin_upage, entry->pg_cnt);
+  spt_unlock (locked);
+}
+
+/* Applies ADVICE to the pages covering the LENGTH bytes at the
+   page-aligned user address ADDR.  Returns false if the range or
+   the advice is invalid. */
+static bool
+sys_madvise (uint32_t *esp)
+{
+  void *addr = (void *) get_arg_int (esp, 1);
+  unsigned length = get_arg_int (esp, 2);
+  int advice = get_arg_int (esp, 3);
+  bool locked, success;
+
+  if (length == 0 || pg_ofs (addr) != 0 || !is_valid_address (addr)
+      || !is_user_vaddr ((uint8_t *) addr + length - 1)
+      || (uint8_t *) addr + length < (uint8_t *) addr)
+    return false;
+  locked = spt_lock ();
+  success = spt_advise (addr, DIV_ROUND_UP (length, PGSIZE), advice);
+  spt_unlock (locked);
+  return success;
+}
+
+/* Moves the end of the heap by INCREMENT bytes.  Returns the old
+   end, or (void *) -1 if the heap cannot be moved there. */
+static void *
+sys_sbrk (uint32_t *esp)
+{
+  intptr_t increment = get_arg_int (esp, 1);
+  bool locked = spt_lock ();
+  void *old_brk = spt_sbrk (increment);
+
+  spt_unlock (locked);
+  return old_brk;
+}
+
+/* Fills the user buffer with the names of the directory open as
+   fd, from the fd's position on, as consecutive null-terminated
+   strings, and moves the position past them.  Returns the number
+   of bytes stored, 0 at the end of the directory, or -1 if fd is
+   not a directory or the buffer cannot hold a name. */
+static int
+sys_getdents (uint32_t *esp)
+{
+  int fd = get_arg_int (esp, 1);
+  unsigned size = get_arg_int (esp, 3);
+  char *buffer = get_arg_buffer (esp, 2, size);
+  struct file *fp;
+  off_t pos;
+  int ret;
+
+  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return SYSCALL_ERROR;
+  fp = get_file (fd);
+  if (fp == NULL || file_get_inode (fp) == NULL
+      || !inode_is_dir (file_get_inode (fp)) || size <= NAME_MAX)
+    {
+      file_close (fp);
+      return SYSCALL_ERROR;
+    }
+
+  pin_user_range (buffer, size, true);
+  pos = file_tell (fp);
+  ret = dir_read_names (file_get_inode (fp), &pos, buffer, size);
+  file_seek (fp, pos);
+  unpin_user_range (buffer, size);
+  file_close (fp);
+  return ret;
+}
+
+/* Allocates disk space for the LENGTH bytes at OFFSET in the file
+   open as fd, growing the file to cover them, so that writing them
+   later cannot run out of space.  Returns false if fd is not an
+   open file, writes to the file are denied, or the disk is
+   full. */
+static bool
+sys_fallocate (uint32_t *esp)
+{
+  int fd = get_arg_int (esp, 1);
+  unsigned offset = get_arg_int (esp, 2);
+  unsigned length = get_arg_int (esp, 3);
+  struct file *fp;
+  bool success;
+
+  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO
+      || offset > INT32_MAX || length > INT32_MAX - offset)
+    return false;
+  fp = get_file (fd);
+  if (fp == NULL)
+    return false;
+  success = file_allocate (fp, offset, length);
+  file_close (fp);
+  return success;
+}
+
+/* Writes the data and metadata of the file open as fd to disk.
+   Returns false if fd is not an open file. */
+static bool
+sys_fsync (uint32_t *esp)
+{
+  return sync_fd (get_arg_int (esp, 1), true);
+}
+
+/* Like sys_fsync(), but writes the file's metadata only if it is
+   needed to read back the data, as when the file grew. */
+static bool
+sys_fdatasync (uint32_t *esp)
+{
+  return sync_fd (get_arg_int (esp, 1), false);
+}
+
+/* Puts the calling thread in the deadline scheduling class, to run
+   for the number of milliseconds given as the first argument in
+   every period given as the third, within the deadline given as the
+   second from the period's start, each rounded up to timer ticks.
+   A runtime of 0 returns the thread to scheduling by priority.
+   Returns false if the times are inconsistent or admitting the
+   thread would leave too little CPU for others. */
+static bool
+sys_sched_deadline (uint32_t *esp)
+{
+  unsigned runtime = get_arg_int (esp, 1);
+  unsigned deadline = get_arg_int (esp, 2);
+  unsigned period = get_arg_int (esp, 3);
+
+  return thread_set_deadline (DIV_ROUND_UP ((int64_t) runtime * TIMER_FREQ,
+                                            1000),
+                              DIV_ROUND_UP ((int64_t) deadline * TIMER_FREQ,
+                                            1000),
+                              DIV_ROUND_UP ((int64_t) period * TIMER_FREQ,
+                                            1000));
+}
+
+/* Syncs the file open as FD, with its metadata if METADATA is
+   true.  Returns false if FD is not an open file or a pipe. */
+static bool
+sync_fd (int fd, bool metadata)
+{
+  struct file *fp;
+  bool success;
+
+  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return false;
+  fp = get_file (fd);
+  if (fp == NULL)
+    return false;
+  success = file_sync (fp, metadata);
+  file_close (fp);
+  return success;
+}
+
+/* Copies the I/O statistics of the block device whose index in
+   kernel probe order is the first argument to the given user
+   buffer.  Returns false if there is no such device.  Exits if
+   the buffer is invalid. */
+static bool
+sys_blockstat (uint32_t *esp)
+{
+  unsigned idx = get_arg_int (esp, 1);
+  struct blockstat *buffer = get_arg_buffer (esp, 2, sizeof *buffer);
+  struct blockstat stats;
+
+  if (!block_get_stats (idx, &stats))
+    return false;
+  if (!copy_to_user (buffer, &stats, sizeof stats))
+    exit (SYSCALL_ERROR);
+  return true;
+}
+
+/* Registers the struct ioring at the given user address for
+   ioring_enter(), or unregisters the process's ring if it is
+   null.  Returns false if the ring does not lie in user space. */
+static bool
+sys_ioring_setup (uint32_t *esp)
+{
+  struct ioring *ring = get_arg_buffer (esp, 1, 0);
+
+  if (!is_user_range (ring, sizeof *ring))
+    return false;
+  thread_current ()->process->ioring = ring;
+  return true;
+}
+
+/* Carries out up to the first argument's number of operations
+   queued in the process's registered ring, posting a completion
+   for each, and returns the number done, or -1 if no ring is
+   registered.  Stops early when the submission ring empties or the
+   completion ring fills.  Exits if the ring cannot be read or
+   written.  See lib/ioring.h. */
+static int
+sys_ioring_enter (uint32_t *esp)
+{
+  unsigned n = get_arg_int (esp, 1);
+  struct ioring *uring = thread_current ()->process->ioring;
+  struct ioring ring;
+  unsigned done = 0;
+
+  if (uring == NULL)
+    return SYSCALL_ERROR;
+  if (!copy_from_user (&ring, uring, sizeof ring))
+    exit (SYSCALL_ERROR);
+
+  while (done < n && ring.sq_head != ring.sq_tail
+         && ring.cq_tail - ring.cq_head < ring.entries)
+    {
+      struct ioring_sqe sqe;
+      struct ioring_cqe cqe;
+
+      if (!copy_from_user (&sqe, ring.sq + ring.sq_head % ring.entries,
+                           sizeof sqe))
+        exit (SYSCALL_ERROR);
+      cqe.user_data = sqe.user_data;
+      cqe.result = do_ioring_op (&sqe);
+      if (!copy_to_user (ring.cq + ring.cq_tail % ring.entries, &cqe,
+                         sizeof cqe))
+        exit (SYSCALL_ERROR);
+      ring.sq_head++;
+      ring.cq_tail++;
+      done++;
+    }
+
+  /* The process owns the other counters. */
+  if (!copy_to_user (&uring->sq_head, &ring.sq_head, sizeof ring.sq_head)
+      || !copy_to_user (&uring->cq_tail, &ring.cq_tail, sizeof ring.cq_tail))
+    exit (SYSCALL_ERROR);
+  return done;
+}
+
+static int
+sys_pread (uint32_t *esp)
+{
+  int fd = get_arg_int (esp, 1);
+  unsigned size = get_arg_int (esp, 3);
+  void *buffer = get_arg_buffer (esp, 2, size);
+  unsigned offset = get_arg_int (esp, 4);
+
+  return do_pread (fd, buffer, size, offset);
+}
+
+/* Reads SIZE bytes at byte OFFSET of file fd into the user BUFFER,
+   already checked to lie in user space, leaving the file position
+   alone.  Returns the number of bytes read, or -1 if fd is not an
+   open file. */
+static int
+do_pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  struct file *fp;
+  int bytes_read;
+
+  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return SYSCALL_ERROR;
+  fp = get_file (fd);
+  if (fp == NULL)
+    return SYSCALL_ERROR;
+
+  pin_user_range (buffer, size, true);
+  bytes_read = file_read_at (fp, buffer, size, offset);
+  unpin_user_range (buffer, size);
+  file_close (fp);
+  if (bytes_read > 0)
+    thread_current ()->process->rusage.read_bytes += bytes_read;
+  return bytes_read;
+}
+
+static int
+sys_pwrite (uint32_t *esp)
+{
+  int fd = get_arg_int (esp, 1);
+  unsigned size = get_arg_int (esp, 3);
+  void *buffer = get_arg_buffer (esp, 2, size);
+  unsigned offset = get_arg_int (esp, 4);
+
+  return do_pwrite (fd, buffer, size, offset);
+}
+
+/* Writes SIZE bytes from the user BUFFER, already checked to lie
+   in user space, at byte OFFSET of file fd, leaving the file
+   position alone.  Returns the number of bytes written, or -1 if
+   fd is not an open file. */
+static int
+do_pwrite (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  struct file *fp;
+  int bytes_written;
+
+  if (!is_valid_fd (fd) || fd == STDIN_FILENO || fd == STDOUT_FILENO)
+    return SYSCALL_ERROR;
+  fp = get_file (fd);
+  if (fp == NULL)
+    return SYSCALL_ERROR;
+
+  pin_user_range (buffer, size, false);
+  bytes_written = file_write_at (fp, buffer, size, offset);
+  unpin_user_range (buffer, size);
+  file_close (fp);
+  if (bytes_written > 0)
+    thread_current ()->process->rusage.write_bytes += bytes_written;
+  return bytes_written;
+}
+
+static int
+sys_readv (uint32_t *esp)
+{
+  return do_vector (esp, false);
+}
+
+static int
+sys_writev (uint32_t *esp)
+{
+  return do_vector (esp, true);
+}
+
+/* Reads (if WRITE is false) or writes the buffers of the user
+   struct iovec array at the second argument, whose length is the
+   third, in order at file fd's position.  Stops after a short
+   transfer.  Returns the total bytes moved, or -1 if fd is bad or
+   the count is out of range.  Exits if the array or a buffer is
+   invalid. */
+static int
+do_vector (uint32_t *esp, bool write)
+{
+  int fd = get_arg_int (esp, 1);
+  int iovcnt = get_arg_int (esp, 3);
+  const struct iovec *uiov;
+  int total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return SYSCALL_ERROR;
+  uiov = get_arg_buffer (esp, 2, iovcnt * sizeof *uiov);
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      struct iovec iov;
+      int n;
+
+      if (!copy_from_user (&iov, uiov + i, sizeof iov)
+          || (iov.iov_base == NULL && iov.iov_len > 0)
+          || !is_user_range (iov.iov_base, iov.iov_len))
+        exit (SYSCALL_ERROR);
+      if (iov.iov_len > (size_t) (INT_MAX - total))
+        break;
+
+      n = (write
+           ? do_write (fd, iov.iov_base, iov.iov_len)
+           : do_read (fd, iov.iov_base, iov.iov_len));
+      if (n < 0)
+        return total > 0 ? total : n;
+      total += n;
+      if ((size_t) n < iov.iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Copies up to the third argument's number of bytes from the
+   file open as the first argument to the one open as the second,
+   each at and advancing its own position, inside the kernel.
+   Returns the number of bytes copied, 0 at end of file, or -1 if
+   either fd is not an open file. */
+static int
+sys_copy_file_range (uint32_t *esp)
+{
+  int in_fd = get_arg_int (esp, 1);
+  int out_fd = get_arg_int (esp, 2);
+  unsigned length = get_arg_int (esp, 3);
+  struct file *in, *out;
+  int ret = SYSCALL_ERROR;
+
+  if (in_fd == STDIN_FILENO || in_fd == STDOUT_FILENO
+      || out_fd == STDIN_FILENO || out_fd == STDOUT_FILENO)
+    return SYSCALL_ERROR;
+  in = get_file (in_fd);
+  out = get_file (out_fd);
+  if (length > INT_MAX)
+    length = INT_MAX;
+  if (in != NULL && out != NULL)
+    ret = file_copy (out, in, length);
+  file_close (in);
+  file_close (out);
+  return ret;
+}
+
+/* Starts a thread in the calling process, sharing its memory and
+   files, that calls the user function at the first argument with
+   the second argument on the stack whose top is the third, under
+   a null return address.  Returns the thread's id, which the
+   caller can wait() for, or -1 if the thread cannot be created or
+   its first frame cannot be written to the stack. */
+static pid_t
+sys_thread_spawn (uint32_t *esp)
+{
+  void (*entry) (void) = (void (*) (void)) get_arg_int (esp, 1);
+  uint32_t arg = get_arg_int (esp, 2);
+  uint32_t *stack = (uint32_t *) get_arg_int (esp, 3);
+  uint32_t frame[2];
+
+  if (entry == NULL || !is_user_vaddr ((void *) entry)
+      || (uintptr_t) stack < sizeof frame)
+    return SYSCALL_ERROR;
+  stack -= 2;
+  frame[0] = 0;
+  frame[1] = arg;
+  if (!copy_to_user (stack, frame, sizeof frame))
+    return SYSCALL_ERROR;
+  return process_spawn (entry, stack);
+}
+
+/* Checks the first argument's user array of struct pollfd, whose
+   length is the second, for the conditions each asks about, waiting
+   up to the third argument's number of milliseconds, forever if it
+   is negative, for one to hold.  Returns the number of descriptors
+   with conditions found, 0 on timeout, or -1 if the count is out of
+   range.  Exits if the array is invalid.  Only the console and
+   pipes can become ready later: files never wait.  The console
+   wakes the caller when input arrives, but pipes are checked again
+   each timer tick.  See lib/poll.h. */
+static int
+sys_poll (uint32_t *esp)
+{
+  unsigned nfds = get_arg_int (esp, 2);
+  struct pollfd *ufds = NULL;
+  int timeout = get_arg_int (esp, 3);
+  int64_t deadline = 0;
+
+  if (nfds > FDTABLE_MAX)
+    return SYSCALL_ERROR;
+  if (nfds > 0)
+    ufds = get_arg_buffer (esp, 1, nfds * sizeof *ufds);
+  if (timeout > 0)
+    deadline = timer_ticks () + DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ,
+                                              1000);
+
+  for (;;)
+    {
+      int ready = 0;
+      int64_t ticks = -1;
+      bool pipes = false;
+      unsigned i;
+
+      for (i = 0; i < nfds; i++)
+        {
+          struct pollfd pfd;
+
+          if (!copy_from_user (&pfd, ufds + i, sizeof pfd))
+            exit (SYSCALL_ERROR);
+          pfd.revents = poll_fd (pfd.fd, pfd.events, &pipes);
+          if (!copy_to_user (&ufds[i].revents, &pfd.revents,
+                             sizeof pfd.revents))
+            exit (SYSCALL_ERROR);
+          if (pfd.revents != 0)
+            ready++;
+        }
+      if (ready > 0 || timeout == 0)
+        return ready;
+      if (timeout > 0)
+        {
+          ticks = deadline - timer_ticks ();
+          if (ticks <= 0)
+            return 0;
+        }
+      input_wait (pipes ? 1 : ticks);
+    }
+}
+
+/* Returns the conditions of EVENTS that hold for fd now, and
+   POLLNVAL if fd is not open.  Sets *PIPES to true if fd is a
+   pipe end. */
+static short
+poll_fd (int fd, short events, bool *pipes)
+{
+  struct file *fp;
+  struct pipe *pipe;
+  short revents = POLLIN | POLLOUT;
+
+  if (fd < 0)
+    return 0;
+  if (fd == STDIN_FILENO)
+    return events & (input_wait (0) ? POLLIN : 0);
+  if (fd == STDOUT_FILENO)
+    return events & POLLOUT;
+  fp = get_file (fd);
+  if (fp == NULL)
+    return POLLNVAL;
+  pipe = file_get_pipe (fp);
+  if (pipe != NULL)
+    {
+      *pipes = true;
+      revents = ((pipe_readable (pipe) ? POLLIN : 0)
+                 | (pipe_writable (pipe) ? POLLOUT : 0));
+    }
+  file_close (fp);
+  return events & revents;
+}
+
+/* Carries out fcntl() command CMD, the second argument, on the fd
+   that is the first, with the third as its argument.  F_GETFL
+   returns fd's flags and F_SETFL sets them.  Only the console
+   keeps O_NONBLOCK, as files never wait.  Returns -1 if fd is not
+   open or CMD is unknown.  See lib/fcntl.h. */
+static int
+sys_fcntl (uint32_t *esp)
+{
+  int fd = get_arg_int (esp, 1);
+  int cmd = get_arg_int (esp, 2);
+  int arg = get_arg_int (esp, 3);
+  struct thread *process = thread_current ()->process;
+
+  if (cmd != F_GETFL && cmd != F_SETFL)
+    return SYSCALL_ERROR;
+  if (fd != STDIN_FILENO && fd != STDOUT_FILENO)
+    {
+      struct file *fp = is_valid_fd (fd) ? get_file (fd) : NULL;
+
+      if (fp == NULL)
+        return SYSCALL_ERROR;
+      file_close (fp);
+      return 0;
+    }
+  if (cmd == F_GETFL)
+    return fd == STDIN_FILENO && process->stdin_nonblock ? O_NONBLOCK : 0;
+  if (fd == STDIN_FILENO)
+    process->stdin_nonblock = (arg & O_NONBLOCK) != 0;
+  return 0;
+}
+
+/* Creates a pipe and stores the fds of its reading and writing
+   ends in the first argument's user array of two ints.  Children
+   exec()'d later get both ends at the same fds, as fork() children
+   do.  Returns false if memory or fds are short, and exits if the
+   array is invalid. */
+static bool
+sys_pipe (uint32_t *esp)
+{
+  int *ufds = (int *) get_arg_int (esp, 1);
+  struct fdtable *fds = &thread_current ()->process->fds;
+  struct file *read_end, *write_end;
+  int pair[2];
+
+  if (!pipe_create (&read_end, &write_end))
+    return false;
+  pair[0] = fdtable_alloc (fds, read_end);
+  pair[1] = pair[0] < 0 ? -1 : fdtable_alloc (fds, write_end);
+  if (pair[1] < 0)
+    {
+      if (pair[0] >= 0)
+        fdtable_remove (fds, pair[0]);
+      file_close (read_end);
+      file_close (write_end);
+      return false;
+    }
+  if (!copy_to_user (ufds, pair, sizeof pair))
+    exit (SYSCALL_ERROR);
+  return true;
+}
+
+/* Copies the statistics of the interrupt vector given as the
+   first argument to the given user buffer.  Returns false if
+   there is no such vector.  Exits if the buffer is invalid. */
+static bool
+sys_intrstat (uint32_t *esp)
+{
+  unsigned vec_no = get_arg_int (esp, 1);
+  struct intrstat *buffer = get_arg_buffer (esp, 2, sizeof *buffer);
+  struct intrstat stats;
+
+  if (!intr_get_stats (vec_no, &stats))
+    return false;
+  if (!copy_to_user (buffer, &stats, sizeof stats))
+    exit (SYSCALL_ERROR);
+  return true;
+}
+
+/* Copies the up to CNT most recent kernel trace records into
+   BUFFER, oldest first, and returns the number copied.  Records
+   made while copying may overwrite ones not yet copied, which are
+   then skipped. */
+static int
+sys_trace_read (uint32_t *esp)
+{
+  struct trace_record *buffer;
+  unsigned cnt = get_arg_int (esp, 2);
+  uint32_t seq, next;
+  int n = 0;
+
+  if (cnt > INT_MAX / sizeof *buffer)
+    return SYSCALL_ERROR;
+  buffer = get_arg_buffer (esp, 1, cnt * sizeof *buffer);
+
+  next = trace_next_seq ();
+  seq = trace_first_seq ();
+  if (next - seq > cnt)
+    seq = next - cnt;
+  for (; seq < next; seq++)
+    {
+      struct trace_record r;
+
+      if (trace_get (seq, &r))
+        {
+          if (!copy_to_user (buffer + n, &r, sizeof r))
+            exit (SYSCALL_ERROR);
+          n++;
+        }
+    }
+  return n;
+}
+
+/* Copies a snapshot of the system-wide counters, truncated to the
+   second argument's number of bytes, to the buffer given as the
+   first, and returns the number of bytes copied.  Exits if the
+   buffer is invalid. */
+static int
+sys_stats (uint32_t *esp)
+{
+  unsigned size = get_arg_int (esp, 2);
+  struct sysstat *buffer;
+  struct sysstat stats;
+  struct memstat mem;
+
+  if (size > sizeof stats)
+    size = sizeof stats;
+  buffer = get_arg_buffer (esp, 1, size);
+
+  memset (&stats, 0, sizeof stats);
+  palloc_get_stats (true, &mem);
+  stats.user_pages = mem.total;
+  stats.user_free = mem.free;
+  palloc_get_stats (false, &mem);
+  stats.kernel_pages = mem.total;
+  stats.kernel_free = mem.free;
+  swap_get_stats (&stats);
+  exception_get_stats (&stats);
+  spt_get_stats (&stats);
+  block_get_totals (&stats);
+  thread_get_stats (&stats);
+  stats.ticks = timer_ticks ();
+  stats.timer_freq = TIMER_FREQ;
+
+  if (!copy_to_user (buffer, &stats, size))
+    exit (SYSCALL_ERROR);
+  return size;
+}
+
+/* Carries out the ring operation SQE and returns its result. */
+static int
+do_ioring_op (const struct ioring_sqe *sqe)
+{
+  switch (sqe->op)
+    {
+    case IORING_READ:
+    case IORING_WRITE:
+      if ((sqe->buffer == NULL && sqe->size > 0)
+          || !is_user_range (sqe->buffer, sqe->size))
+        return SYSCALL_ERROR;
+      return (sqe->op == IORING_READ
+              ? do_read (sqe->fd, sqe->buffer, sqe->size)
+              : do_write (sqe->fd, sqe->buffer, sqe->size));
+    case IORING_SEEK:
+      return do_seek (sqe->fd, sqe->size) ? 0 : SYSCALL_ERROR;
+    case IORING_CLOSE:
+      do_close (sqe->fd);
+      return 0;
+    default:
+      return SYSCALL_ERROR;
+    }
+}
+
 /* Returns the int at position POS on stack pointed at
    by ESP. Exits if any of int bytes are in invalid
    memory. */
 static int
 get_arg_int (void *esp, int pos)
 {
-  uint32_t *arg;
-  arg = (uint32_t *)esp + pos;
-  if (!is_valid_memory (arg, sizeof (int)))
-    exit (SYSCALL_ERROR);
+  int arg;
 
-  return *(int *)arg;
+  if (!copy_from_user (&arg, (uint32_t *) esp + pos, sizeof arg))
+    exit (SYSCALL_ERROR);
+  return arg;
 }
 
 /* Returns the buffer at position POS on stack pointed at
-   by ESP, validating SIZE buffer bytes. Exits is any of 
-   buffer pointer bytes or buffer bytes are in invalid
-   memory. */
+   by ESP, checking that its SIZE bytes lie in user space. Exits
+   if the pointer cannot be read or the buffer is null or reaches
+   into the kernel.  Whether the buffer is mapped is left to the
+   page fault handler when it is used. */
 static void *
 get_arg_buffer (void *esp, int pos, int size)
 {
-  void **arg;
+  void *buffer;
 
-  arg = (void **)esp + pos;
-  
-  if (!is_valid_memory (arg, sizeof(char *)) || !is_valid_memory (*arg, size))
+  if (!copy_from_user (&buffer, (void **) esp + pos, sizeof buffer)
+      || size < 0 || (buffer == NULL && size > 0)
+      || !is_user_range (buffer, size))
     exit (SYSCALL_ERROR);
-
-  return *(void **)arg;
+  return buffer;
 }
 
 /* Returns the argument string at position POS on stack pointed at
@@ -539,53 +1609,80 @@ get_arg_buffer (void *esp, int pos, int size)
 static char *
 get_arg_string (void *esp, int pos, int limit)
 {
-  char **str_ptr;
+  char *str;
   char *cur;
   char *end;
 
-  str_ptr = (char **)esp + pos;
-
-  /* Check the bytes of the char * are all in valid memory */
-  if (!is_valid_memory (str_ptr, sizeof (char *)))
+  if (!copy_from_user (&str, (char **) esp + pos, sizeof str)
+      || str == NULL)
     exit (SYSCALL_ERROR);
 
-  end = *str_ptr + limit + 1;
-
-  
-  for (cur = *str_ptr; cur < end; cur++)
+  end = str + limit + 1;
+  for (cur = str; cur < end; cur++)
     {
-      if (!is_valid_address (cur))
+      char c;
+
+      if (!copy_from_user (&c, cur, 1))
         exit (SYSCALL_ERROR);
-      
-      if (*cur == '\0')
+      if (c == '\0')
         break;
-      
     }
-  
+
   /* Either empty string of greater than LIMIT */
-  if (cur == *str_ptr || cur == end)
+  if (cur == str || cur == end)
     return NULL;
-  
-  return *str_ptr;
+
+  return str;
 }
 
-/* Returns whether bytes starting at START are in valid user space */
-static bool 
-is_valid_memory (void *start, unsigned size)
+/* Faults in and pins every page of the SIZE bytes at user address
+   BUFFER, so that file system calls on the buffer do not page fault
+   while holding file system locks and the pages are not evicted under
+   them.  If WRITE is true the pages are made writable first, which
+   copies any copy-on-write page.  Exits if a page cannot be
+   loaded.  Undo with unpin_user_range(). */
+static void
+pin_user_range (void *buffer, unsigned size, bool write)
 {
-  uint8_t *cur;
-  uint8_t *end;
-  unsigned start_offs;
-  
-  end = (uint8_t *)start + size;
-  start_offs = pg_ofs (start);
+  uint32_t *pd = thread_current ()->pagedir;
+  uint8_t *end = (uint8_t *) buffer + size;
+  uint8_t *upage;
 
-  for (cur = start - start_offs; cur < end; cur += PGSIZE)
-    {
-      if (!is_valid_address (cur))
-        return false;
-    }
-  return true;
+  if (size == 0)
+    return;
+  for (upage = pg_round_down (buffer); upage < end; upage += PGSIZE)
+    for (;;)
+      {
+        bool pinned;
+
+        frame_page_lock (pd, upage);
+        pinned = ((!write || pagedir_is_writable (pd, upage))
+                  && frame_pin (upage));
+        frame_page_unlock (pd, upage);
+        if (pinned)
+          break;
+
+        /* Touch the page to fault it in.  The write is an atomic
+           OR of zero, so that it cannot undo a store by another of
+           the process's threads. */
+        if (write)
+          asm volatile ("lock orl $0, %0" : "+m" (*(uint32_t *) upage));
+        else
+          (void) *(volatile uint8_t *) upage;
+      }
+}
+
+/* Unpins the pages pinned by pin_user_range (BUFFER, SIZE). */
+static void
+unpin_user_range (void *buffer, unsigned size)
+{
+  uint8_t *end = (uint8_t *) buffer + size;
+  uint8_t *upage;
+
+  if (size == 0)
+    return;
+  for (upage = pg_round_down (buffer); upage < end; upage += PGSIZE)
+    frame_unpin (upage);
 }
 
 /* Returns whether VADDR is a valid memory address. This means it is
@@ -596,9 +1693,19 @@ is_valid_address (void *vaddr)
   return vaddr != NULL && is_user_vaddr (vaddr);
 }
 
-/* Returns whether FD is between 0 and MAX_FILES */
+/* Returns whether FD is between 0 and FDTABLE_MAX */
 static bool
 is_valid_fd (int fd) 
 {
-  return fd >= 0 && fd < MAX_FILES;
+  return fd >= 0 && fd < FDTABLE_MAX;
+}
+
+/* Returns the file open as FD in the current process, with a
+   reference of its own so that another thread closing FD cannot
+   free it, or a null pointer if FD is not open.  Drop the
+   reference with file_close(). */
+static struct file *
+get_file (int fd)
+{
+  return fdtable_ref (&thread_current ()->process->fds, fd);
 }
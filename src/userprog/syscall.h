@@ -5,10 +5,8 @@
 
 #define SYSCALL_ERROR -1
 typedef int pid_t;
-/* Coarse grain lock for filesystem access */
-struct lock filesys_lock;
-
 void syscall_init (void);
+void syscall_print_stats (void);
 void exit (int status);
 void munmap (mapid_t mapid);
 
@@ -1,6 +1,7 @@
 #include "userprog/tss.h"
 #include <debug.h>
 #include <stddef.h>
+#include <sysenter.h>
 #include "userprog/gdt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
@@ -75,6 +76,18 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* Model-specific registers used by SYSENTER.  See [IA32-v3a]
+   5.8.7 "Performing Fast Calls to System Procedures with the
+   SYSENTER and SYSEXIT Instructions". */
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+/* Fast system call entry, in sysenter.S. */
+void sysenter_entry (void);
+
+static void write_msr (uint32_t msr, uint32_t value);
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +99,16 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+
+  /* SYSENTER loads its stack pointer from an MSR that we would
+     otherwise have to rewrite on every thread switch.  Point it at
+     esp0 instead, which sysenter_entry then loads into %esp. */
+  if (cpu_has_sysenter ())
+    {
+      write_msr (MSR_SYSENTER_CS, SEL_KCSEG);
+      write_msr (MSR_SYSENTER_ESP, (uint32_t) &tss->esp0);
+      write_msr (MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    }
 }
 
 /* Returns the kernel TSS. */
@@ -104,3 +127,10 @@ tss_update (void)
   ASSERT (tss != NULL);
   tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
 }
+
+/* Sets model-specific register MSR to VALUE. */
+static void
+write_msr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
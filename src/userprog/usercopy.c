@@ -0,0 +1,52 @@
+#include "userprog/usercopy.h"
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* In user-memcpy.S. */
+bool user_memcpy (void *dst, const void *src, size_t size);
+extern const char user_memcpy_begin[], user_memcpy_end[];
+extern const char user_memcpy_fault[];
+
+/* Returns true if the SIZE bytes at UADDR lie in user space.  Says
+   nothing about whether they are mapped. */
+bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+
+  return (size <= (uintptr_t) PHYS_BASE
+          && start <= (uintptr_t) PHYS_BASE - size);
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Returns false,
+   having copied some unknown part, if any of them is outside user
+   space or unmapped. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && user_memcpy (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns false,
+   having copied some unknown part, if any of them is outside user
+   space, unmapped or read-only. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && user_memcpy (udst, src, size);
+}
+
+/* Called by the page fault handler for a kernel fault on a user
+   address it could not resolve.  If the fault is in user_memcpy(),
+   makes F resume where that returns false and returns true.
+   Otherwise returns false. */
+bool
+usercopy_fixup (struct intr_frame *f)
+{
+  if ((const char *) f->eip < user_memcpy_begin
+      || (const char *) f->eip >= user_memcpy_end)
+    return false;
+  f->eip = (void (*) (void)) user_memcpy_fault;
+  return true;
+}
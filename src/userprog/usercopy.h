@@ -0,0 +1,14 @@
+#ifndef USERPROG_USERCOPY_H
+#define USERPROG_USERCOPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct intr_frame;
+
+bool is_user_range (const void *uaddr, size_t size);
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+bool usercopy_fixup (struct intr_frame *);
+
+#endif /* userprog/usercopy.h */
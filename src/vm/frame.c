@@ -1,35 +1,210 @@
+#include <debug.h>
 #include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/palloc.h"
-#include "threads/malloc.h"
+#include "threads/shrinker.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* A mapping of a shared frame, either copy-on-write after fork, a
+   read-only executable page, a page of a mapped file or a merged
+   page, other than the one recorded in the frame's fte itself.
+   Together with the fte's own mapping these form the frame's
+   reverse map, through which eviction unmaps the frame from every
+   address space at once. */
+struct frame_ref
+    {
+        uint32_t *pd;                   /* Page directory of the mapping. */
+        void *upage;                    /* User page mapped. */
+        struct spte *spte;              /* Its supplementary page entry. */
+        struct thread *owner;           /* Process it belongs to. */
+        struct list_elem elem;          /* Element in fte's refs. */
+    };
 
-/* Frame table */
-static struct hash frame_table;
-/* Sync for frame table */
+/* Frame table, one entry per page of the user pool, indexed by
+   frame number. */
+static struct fte *frame_table;
+/* First page of the user pool, frame number 0. */
+static uint8_t *frame_base;
+/* Number of entries in the frame table. */
+static size_t frame_cnt;
+/* Pages holding the frame table. */
+static size_t frame_table_pages;
+/* Sync for frame table. Held only for bookkeeping and the victim
+   selection scan, never across I/O. */
 static struct lock frame_lock;
+/* Signalled, with frame_lock, when an eviction finishes. */
+static struct condition evict_done;
+
+/* Striped page locks. A user page's lock, chosen by hashing its
+   page directory and address, is held while the page is being read
+   in or written out, so a fault on a page that is being evicted
+   waits for the write-out without blocking faults on unrelated
+   pages. The eviction scan only ever try-acquires these locks while
+   holding frame_lock, so there is no lock order to violate. */
+#define PAGE_LOCK_CNT 32
+static struct lock page_locks[PAGE_LOCK_CNT];
+/* Index of the next frame the clock will consider. */
+static size_t clock_hand;
+/* Number of frame table entries in use. */
+static size_t frame_used;
+
+/* Use WSClock rather than plain clock to pick eviction victims.
+   WSClock treats a page as part of its owner's working set if it
+   was accessed within the last WS_TAU ticks of the owner's own
+   virtual time, and prefers clean pages outside the working set.
+   Dirty pages outside it are handed to the page-out thread to be
+   written out asynchronously instead of in the faulting thread. */
+bool frame_wsclock;
+#define WS_TAU 20                       /* Working set window, in ticks. */
+
+/* Frames holding read-only executable pages and pages of mapped
+   files, by file position. Protected by frame_lock. */
+static struct ohash text_frames;
+/* Number of the frames in text_frames that hold mapped files'
+   pages, so that file reads and writes can skip the lookups while
+   nothing is mapped. */
+static size_t mmap_frame_cnt;
 
-static void insert_frame (struct fte * fte, void * kpage);
+/* Resident set cap given to each process at exec, 0 for none. A
+   process at its cap replaces one of its own pages on a fault, and
+   eviction takes pages from processes at their cap first. */
+size_t frame_rss_limit;
+
+/* Background page-out. A kernel thread evicts frames ahead of
+   demand whenever fewer than pageout_low frames are free, and stops
+   once pageout_high are free, so that a page fault normally finds a
+   free frame without writing anything out itself. Pages the zeroer
+   holds in palloc's reserve are not frames but are not free either,
+   so they do not count toward either mark. Before it
+   evicts anything it asks the kernel caches on the user pool to
+   shrink, and it does the same for the kernel pool's caches when
+   fewer than kpool_low kernel pages are free, until kpool_high
+   are. See threads/shrinker.c. */
+static size_t pageout_low;              /* Wake the daemon below this. */
+static size_t pageout_high;             /* Daemon stops at this. */
+static size_t kpool_low;                /* Also wake it below this. */
+static size_t kpool_high;               /* Kernel caches shrink to this. */
+static struct semaphore pageout_wanted; /* Upped to wake the daemon. */
+static bool pageout_running;            /* Has the daemon started? */
+static struct thread *pageout_thread;   /* The daemon. */
+static size_t writeback_cnt;            /* Frames queued for it. */
+static unsigned long long writebehind_cnt;  /* Queued pages written. */
+static unsigned long long writebehind_kept; /* ...then used, so kept. */
+
+/* Same-page merging. A kernel thread sweeps the frame table every
+   KSM_INTERVAL ticks and hashes the contents of each anonymous or
+   executable page that is mapped once. A page whose hash is the
+   same as at the previous sweep has stayed put for a while; if
+   another such page with the same contents, belonging to a
+   different process, has been seen in this sweep, the two are
+   merged into one read-only frame, to be copied again on a write
+   just like a frame shared by fork. */
+bool frame_ksm;
+#define KSM_INTERVAL 100                /* Ticks between sweeps. */
+static struct ohash ksm_frames;         /* Stable pages of this sweep,
+                                           by ksm_sum. */
+static unsigned long long ksm_scans;    /* Sweeps done. */
+static unsigned long long ksm_merged;   /* Frames freed by merging. */
+
+static void insert_frame (void * kpage);
 static bool delete_frame (void * vaddr);
-static unsigned frame_hash (const struct hash_elem *fte_, void *aux UNUSED);
-static bool frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
-                        void *aux UNUSED);
 static struct fte *frame_lookup (void *kpage);
+static void *evict_frame (struct thread *owner);
+static struct fte *clock_select (struct thread *owner, bool over_quota);
+static struct fte *wsclock_select (struct thread *owner, bool over_quota);
+static void release_frame (struct fte *fte);
+static void add_ref (struct fte *fte, struct frame_ref *ref, uint32_t *pd,
+                     void *upage, struct spte *spte, struct thread *owner);
+static ohash_hash_func text_hash;
+static ohash_equal_func text_equal;
+static void mmap_copy (block_sector_t sector, off_t ofs, uint8_t *buffer,
+                       size_t size, bool to_frame);
+static ohash_hash_func ksm_hash;
+static ohash_equal_func ksm_equal;
+static inline bool rss_over (const struct thread *t);
+static inline void rss_add (struct thread *t);
+static inline bool is_pinned (const struct fte *fte);
+static struct fte *uaddr_frame (void *uaddr);
+static inline bool evictable (const struct fte *fte,
+                              const struct thread *owner, bool over_quota);
+static void *evict_victim (struct fte *victim);
+static struct fte *select_victim (struct thread *owner);
+static size_t evict_cluster (size_t want);
+static struct lock *page_lock (uint32_t *pd, const void *upage);
+static bool claim (struct fte *fte);
+static bool claim_victim (struct fte *fte);
+static void unclaim (struct fte *fte);
+static size_t victim_mappings (struct fte *victim, uint32_t *pds[],
+                               struct spte *sptes[], void *kpages[]);
+static size_t finish_eviction (struct fte *victim, const bool swapped[]);
+static bool test_and_clear_accessed (struct fte *fte);
+static size_t frames_free (void);
+static void pageout_poke (void);
+static void pageout_wake (void);
+static void pageout_writeback (void);
+static size_t kpool_free (void);
+static thread_func pageout;
+static inline bool mergeable (const struct fte *fte);
+static bool maps_pd (struct fte *fte, const uint32_t *pd);
+static bool ksm_merge (struct fte *keep, struct fte *dup,
+                       struct frame_ref *ref);
+static void ksm_sweep (void);
+static thread_func ksm;
 
 /* Initializes Frame Table to allow for paging. */
 void
 frame_table_init (void)
 {
-    hash_init (&frame_table, frame_hash, frame_less, NULL);
+    size_t i;
+
+    frame_base = palloc_user_base (&frame_cnt);
+    frame_table_pages = DIV_ROUND_UP (frame_cnt * sizeof *frame_table, PGSIZE);
+    frame_table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                       frame_table_pages);
     lock_init(&frame_lock);
+    lock_set_name (&frame_lock, "frame");
+    cond_init (&evict_done);
+    for (i = 0; i < PAGE_LOCK_CNT; i++)
+        lock_init (&page_locks[i]);
+    clock_hand = 0;
+    frame_used = 0;
+    pageout_low = frame_cnt / 32 + 1;
+    pageout_high = 2 * pageout_low;
+    kpool_low = kpool_free () / 32 + 1;
+    kpool_high = 2 * kpool_low;
+    sema_init (&pageout_wanted, 0);
+    ohash_init (&text_frames, text_hash, text_equal, NULL);
+    ohash_init (&ksm_frames, ksm_hash, ksm_equal, NULL);
 }
 
-/* Destroys frame table by freeing memory associated with hash table. */
+/* Starts the background page-out thread, and the same-page merging
+   thread if frame_ksm is set. Must be called after swap and the
+   file system are available. Until then all eviction happens in
+   the faulting thread. */
+void
+frame_start_pageout (void)
+{
+    pageout_running = true;
+    thread_create ("pageout", PRI_DEFAULT, pageout, NULL);
+    if (frame_ksm)
+        thread_create ("ksm", PRI_MIN, ksm, NULL);
+}
+
+/* Destroys frame table by freeing memory associated with it. */
 void frame_table_destroy (void)
 {
-    hash_destroy (&frame_table, NULL);
+    palloc_free_multiple (frame_table, frame_table_pages);
 }
 
 /* Returns a new frame for the user process. It first tries to acquire a
@@ -37,22 +212,52 @@ void frame_table_destroy (void)
    by evicting using the clock algorithm */
 void *
 frame_get_page (enum palloc_flags flags)
+{
+    struct thread *process = thread_current ()->process;
+    void *kpage = NULL;
+    bool evicted = false;
+
+    /* A process at its resident set cap replaces one of its own
+       pages, if it has one that can go. */
+    if ((flags & PAL_USER) && rss_over (process))
+        evicted = (kpage = evict_frame (process)) != NULL;
+    if (kpage == NULL)
+        kpage = palloc_get_page (flags);
+    if (kpage == NULL && (flags & PAL_USER))
+        {
+            kpage = evict_frame (NULL);
+            if (kpage == NULL)
+                PANIC ("Out of frames: every user frame is pinned");
+            evicted = true;
+        }
+    if (kpage == NULL)
+        return NULL;
+    if (evicted && (flags & PAL_ZERO))
+        memset (kpage, 0, PGSIZE);
+
+    insert_frame (kpage);
+    pageout_poke ();
+
+    return kpage;
+}
+
+/* Returns a new frame for the user process like frame_get_page(),
+   but only if one is free: never evicts, and returns a null pointer
+   instead if the pool is empty or the process is at its resident
+   set cap. For speculative uses such as read-ahead. */
+void *
+frame_get_free_page (enum palloc_flags flags)
 {
     void *kpage;
-    struct fte *fte;
 
+    if (rss_over (thread_current ()->process))
+        return NULL;
     kpage = palloc_get_page (flags);
     if (kpage == NULL)
-        /* Implement eviction here that will 
-            a) Use clock to find correct page to evict
-            b) Unload using an spte function
-                i) Unload data to correct location in memory 
-                ii) Set pagedir to have PTE_P as 0*/
-        PANIC ("Eviction not implemented yet");
-    
-    fte = malloc (sizeof (struct fte));
-    insert_frame (fte, kpage);
+        return NULL;
 
+    insert_frame (kpage);
+    pageout_poke ();
     return kpage;
 }
 
@@ -69,113 +274,1300 @@ frame_free_page (void *kpage)
 
 /* Sets the user virtual addres of frame, whose kernel virtual address is
    KPAGE's, to UPAGE */
-void 
+void
 frame_set_udata (void *kpage, void *upage, uint32_t *pd, struct spte *spte)
 {
     struct fte *fte = frame_lookup (kpage);
     if (fte == NULL)
         return;
+    lock_acquire (&frame_lock);
+    if (fte->owner == NULL)
+        {
+            fte->owner = thread_current ()->process;
+            rss_add (fte->owner);
+        }
     fte->upage = upage;
     fte->pd = pd;
     fte->spte = spte;
+    fte->last_use = fte->owner->user_ticks;
+    lock_release (&frame_lock);
     /* TODO: Maybe also unpin here when do eviction */
 }
 
-/* Inserts the frame table entry FTE into the frame table with key KPAGE 
-   corresponding to its physical address. */
-void
-insert_frame (struct fte * fte, void * kpage)
+/* Claims the frame table entry for the frame at kernel virtual page
+   KPAGE. */
+static void
+insert_frame (void * kpage)
 {
+    struct fte *fte = frame_lookup (kpage);
+
+    ASSERT (fte != NULL);
+
+    lock_acquire (&frame_lock);
+    ASSERT (fte->kpage == NULL);
     /* Probably want to make sure isn't evicted until info loaded from
        supplementary page table */
-    fte->pinned = true;
+    fte->loading = true;
+    fte->pin_cnt = 0;
     fte->upage = NULL;
     fte->kpage = kpage;
-
-    lock_acquire (&frame_lock);
-    hash_insert (&frame_table, &fte->hash_elem);
+    fte->owner = NULL;
+    fte->writeback = false;
+    fte->evicting = false;
+    fte->share_cnt = 1;
+    list_init (&fte->refs);
+    fte->text = false;
+    frame_used++;
     lock_release (&frame_lock);
 }
 
-/* Removes the frame table entry that corresponds whose physical address 
-   corresponds to the kernel virtual page KPAGE from the frame table and
-   frees the associated memory. Returns true if the entry was removed and
-   false if the entry could not be found in the table. */
+/* Releases the frame table entry of the frame at kernel virtual page
+   KPAGE. Returns true if the entry was in use and false if KPAGE is
+   not a frame in the table. If the frame is being evicted, waits for
+   the eviction, after which the evicting thread owns the frame. */
 static bool
 delete_frame (void * kpage)
 {
-    /* TODO: Very coarse grain locking here, can it be simpler? */
+    struct fte *fte = frame_lookup (kpage);
+    if (fte == NULL)
+        return false;
+
+    lock_acquire (&frame_lock);
+    while (fte->evicting)
+        cond_wait (&evict_done, &frame_lock);
+    if (fte->kpage == NULL)
+        {
+            lock_release (&frame_lock);
+            return false;
+        }
+    release_frame (fte);
+    lock_release (&frame_lock);
+    return true;
+}
+
+/* Drops the mapping of the frame at kernel virtual page KPAGE in
+   page directory PD. If other mappings of the frame remain it stays
+   allocated; otherwise it is freed like frame_free_page(). */
+void
+frame_release (void *kpage, uint32_t *pd)
+{
+    struct fte *fte = frame_lookup (kpage);
+    struct frame_ref *ref = NULL;
+
+    if (fte == NULL)
+        return;
+
     lock_acquire (&frame_lock);
+    while (fte->evicting)
+        cond_wait (&evict_done, &frame_lock);
+    if (fte->kpage == NULL)
+        {
+            lock_release (&frame_lock);
+            return;
+        }
+    if (fte->share_cnt == 1)
+        {
+            release_frame (fte);
+            lock_release (&frame_lock);
+            palloc_free_page (kpage);
+            return;
+        }
+
+    if (fte->pd == pd)
+        {
+            /* The fte's own mapping is leaving: promote another. */
+            ref = list_entry (list_front (&fte->refs), struct frame_ref,
+                              elem);
+            fte->owner->rss--;
+            fte->pd = ref->pd;
+            fte->upage = ref->upage;
+            fte->spte = ref->spte;
+            fte->owner = ref->owner;
+        }
+    else
+        {
+            struct list_elem *e;
+
+            for (e = list_begin (&fte->refs); e != list_end (&fte->refs);
+                 e = list_next (e))
+                {
+                    ref = list_entry (e, struct frame_ref, elem);
+                    if (ref->pd == pd)
+                        break;
+                    ref = NULL;
+                }
+            if (ref == NULL)
+                {
+                    lock_release (&frame_lock);
+                    return;
+                }
+            ref->owner->rss--;
+        }
+    list_remove (&ref->elem);
+    fte->share_cnt--;
+    lock_release (&frame_lock);
+    free (ref);
+}
+
+/* Adds a mapping of user page UPAGE in page directory PD, described
+   by SPTE and belonging to the current thread, to the frame at
+   kernel virtual page KPAGE, which must already hold the page.
+   Used by fork to share a frame copy-on-write. Returns false if out
+   of memory or the frame is not in a state to be shared. */
+bool
+frame_share (void *kpage, uint32_t *pd, void *upage, struct spte *spte)
+{
     struct fte *fte = frame_lookup (kpage);
+    struct frame_ref *ref;
+
     if (fte == NULL)
+        return false;
+    ref = malloc (sizeof *ref);
+    if (ref == NULL)
+        return false;
+
+    lock_acquire (&frame_lock);
+    if (fte->kpage == NULL || fte->upage == NULL || fte->evicting)
         {
             lock_release (&frame_lock);
+            free (ref);
             return false;
         }
-    hash_delete (&frame_table, &fte->hash_elem);
-    /* TODO: Add to a free list perhaps? */
-    free (fte);
+    add_ref (fte, ref, pd, upage, spte, thread_current ()->process);
     lock_release (&frame_lock);
     return true;
 }
 
-/* Returns the frame table entry that corresponds to the physical frame
-   associated with the kernel virtual page KPAGE. If no such entry exists,
-   returns NULL. */
-struct fte *
-frame_lookup (void *kpage)
+/* Looks for a resident copy of the read-only executable page whose
+   first BYTES bytes come from offset OFS of the file whose inode is
+   at SECTOR, or if MMAP of that page of a mapped file. If there is
+   one, adds a mapping of user page UPAGE in page directory PD,
+   described by SPTE and belonging to the current thread, to its
+   frame and returns the frame's kernel virtual page; the caller
+   must then map it. Otherwise returns a null pointer. */
+void *
+frame_share_text (block_sector_t sector, off_t ofs, size_t bytes,
+                  bool mmap, uint32_t *pd, void *upage, struct spte *spte)
+{
+    struct fte key, *fte;
+    struct frame_ref *ref;
+    void *kpage = NULL;
+
+    ref = malloc (sizeof *ref);
+    if (ref == NULL)
+        return NULL;
+
+    key.text_sector = sector;
+    key.text_ofs = ofs;
+    key.text_bytes = bytes;
+    key.text_mmap = mmap;
+    lock_acquire (&frame_lock);
+    fte = ohash_find (&text_frames, &key);
+    /* A frame being evicted may still be writing out data newer than
+       the file's, so wait for it to go rather than read the file. */
+    while (fte != NULL && fte->evicting)
+        {
+            cond_wait (&evict_done, &frame_lock);
+            fte = ohash_find (&text_frames, &key);
+        }
+    if (fte != NULL && fte->upage != NULL)
+        {
+            add_ref (fte, ref, pd, upage, spte, thread_current ()->process);
+            kpage = fte->kpage;
+            ref = NULL;
+        }
+    lock_release (&frame_lock);
+    free (ref);
+    return kpage;
+}
+
+/* Returns true if the text page cache holds the read-only
+   executable page whose first BYTES bytes come from offset OFS of
+   the file whose inode is at SECTOR. The answer may be out of date
+   by the time the caller acts on it. */
+bool
+frame_has_text (block_sector_t sector, off_t ofs, size_t bytes)
+{
+    struct fte key;
+    bool found;
+
+    key.text_sector = sector;
+    key.text_ofs = ofs;
+    key.text_bytes = bytes;
+    key.text_mmap = false;
+    lock_acquire (&frame_lock);
+    found = ohash_find (&text_frames, &key) != NULL;
+    lock_release (&frame_lock);
+    return found;
+}
+
+/* Enters the frame at kernel virtual page KPAGE, which holds a
+   read-only executable page, or if MMAP a page of a mapped file,
+   whose first BYTES bytes were read from offset OFS of the file
+   whose inode is at SECTOR, in the text page cache. Does nothing if
+   another frame already holds that page. */
+void
+frame_set_text (void *kpage, block_sector_t sector, off_t ofs, size_t bytes,
+                bool mmap)
+{
+    struct fte *fte = frame_lookup (kpage);
+
+    if (fte == NULL)
+        return;
+    lock_acquire (&frame_lock);
+    if (fte->kpage != NULL && !fte->text)
+        {
+            fte->text_sector = sector;
+            fte->text_ofs = ofs;
+            fte->text_bytes = bytes;
+            fte->text_mmap = mmap;
+            fte->text = ohash_insert (&text_frames, fte) == NULL;
+            if (fte->text && mmap)
+                mmap_frame_cnt++;
+        }
+    lock_release (&frame_lock);
+}
+
+/* Overlays the SIZE bytes at offset OFS of the file whose inode is
+   at SECTOR, just read into BUFFER, with the data of any mapped
+   pages of the file resident in the page cache, which may have been
+   written through a mapping and not yet written back. BUFFER must
+   not fault. */
+void
+frame_mmap_read (block_sector_t sector, off_t ofs, void *buffer, size_t size)
+{
+    mmap_copy (sector, ofs, buffer, size, false);
+}
+
+/* Copies the SIZE bytes in BUFFER, just written at offset OFS of
+   the file whose inode is at SECTOR, into any mapped pages of the
+   file resident in the page cache, so that their mappings see the
+   write. BUFFER must not fault. */
+void
+frame_mmap_write (block_sector_t sector, off_t ofs, const void *buffer,
+                  size_t size)
+{
+    mmap_copy (sector, ofs, (uint8_t *) buffer, size, true);
+}
+
+/* Copies between BUFFER and the resident mapped pages holding the
+   SIZE bytes at offset OFS of the file whose inode is at SECTOR,
+   into the frames if TO_FRAME, or else out of them. Only the bytes
+   each page was read from the file are copied; the rest of the page
+   is not file data. */
+static void
+mmap_copy (block_sector_t sector, off_t ofs, uint8_t *buffer, size_t size,
+           bool to_frame)
+{
+    off_t end = ofs + size;
+    off_t pos;
+    struct fte key;
+
+    if (mmap_frame_cnt == 0 || size == 0)
+        return;
+
+    key.text_sector = sector;
+    key.text_mmap = true;
+    lock_acquire (&frame_lock);
+    for (pos = ofs; pos < end; pos = key.text_ofs + PGSIZE)
+        {
+            struct fte *fte;
+            off_t stop;
+            uint8_t *frame, *buf;
+
+            key.text_ofs = ROUND_DOWN (pos, PGSIZE);
+            fte = ohash_find (&text_frames, &key);
+            if (fte == NULL)
+                continue;
+            stop = key.text_ofs + (off_t) fte->text_bytes;
+            if (stop > end)
+                stop = end;
+            if (pos >= stop)
+                continue;
+
+            /* A frame being written back passes its own data in. */
+            frame = (uint8_t *) fte->kpage + (pos - key.text_ofs);
+            buf = buffer + (pos - ofs);
+            if (frame == buf)
+                continue;
+            if (to_frame)
+                memcpy (frame, buf, stop - pos);
+            else
+                memcpy (buf, frame, stop - pos);
+        }
+    lock_release (&frame_lock);
+}
+
+/* Records mapping of user page UPAGE in page directory PD, described
+   by SPTE and belonging to process OWNER, as another mapping of
+   FTE's frame in REF. */
+static void
+add_ref (struct fte *fte, struct frame_ref *ref, uint32_t *pd, void *upage,
+         struct spte *spte, struct thread *owner)
 {
-  struct fte f;
-  struct hash_elem *e;
+    ASSERT (lock_held_by_current_thread (&frame_lock));
 
-  f.kpage = kpage;
-  e = hash_find (&frame_table, &f.hash_elem);
-  return e != NULL ? hash_entry (e, struct fte, hash_elem) : NULL;
+    ref->pd = pd;
+    ref->upage = upage;
+    ref->spte = spte;
+    ref->owner = owner;
+    rss_add (ref->owner);
+    list_push_back (&fte->refs, &ref->elem);
+    fte->share_cnt++;
 }
 
-/* Returns a hash value for a frame f. */
+/* Returns a hash value for the text page held by fte E_. */
 static unsigned
-frame_hash (const struct hash_elem *fte_, void *aux UNUSED)
+text_hash (const void *e_, void *aux UNUSED)
 {
-  const struct fte *fte = hash_entry (fte_, struct fte, hash_elem);
-  return hash_int ((unsigned)fte->kpage);
+    const struct fte *e = e_;
+    return hash_int (hash_int (e->text_sector) + (e->text_ofs >> PGBITS));
 }
 
-/* Returns true if a frame a preceds frame b. */
+/* Returns true if ftes A_ and B_ hold the same text page. */
 static bool
-frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
-            void *aux UNUSED)
+text_equal (const void *a_, const void *b_, void *aux UNUSED)
 {
-  const struct fte *a = hash_entry (a_, struct fte, hash_elem);
-  const struct fte *b = hash_entry (b_, struct fte, hash_elem);
-  
-  return a->kpage < b->kpage;
+    const struct fte *a = a_;
+    const struct fte *b = b_;
+
+    return (a->text_sector == b->text_sector
+            && a->text_ofs == b->text_ofs
+            && a->text_mmap == b->text_mmap
+            && (a->text_mmap || a->text_bytes == b->text_bytes));
 }
 
+/* Returns true if the frame at kernel virtual page KPAGE has more
+   than one mapping. */
 bool
-frame_unpin (void *uaddr)
-{   
+frame_is_shared (void *kpage)
+{
+    struct fte *fte = frame_lookup (kpage);
+    bool shared;
+
+    if (fte == NULL)
+        return false;
+    lock_acquire (&frame_lock);
+    shared = fte->kpage != NULL && fte->share_cnt > 1;
+    lock_release (&frame_lock);
+    return shared;
+}
+
+/* Picks a victim frame with clock or WSClock, writes its page out
+   with spt_evict_upage() and releases its frame table entry.
+   Returns the victim's kernel virtual page, which the caller now
+   owns, or a null pointer if every frame is pinned.
+
+   If OWNER is non-null only its frames are considered. Otherwise
+   frames of processes at their resident set cap are preferred.
+
+   Only the selection runs under the frame lock. The write-out holds
+   just the victim page's striped lock, so a fault on that page by
+   its owner waits in spt_load_upage() until the page is safely on
+   disk, while other faults proceed. */
+static void *
+evict_frame (struct thread *owner)
+{
+    struct fte *victim = NULL;
+    void *kpage = NULL;
+
+    lock_acquire (&frame_lock);
+    victim = select_victim (owner);
+    if (victim != NULL)
+        kpage = evict_victim (victim);
+    lock_release (&frame_lock);
+    return kpage;
+}
+
+/* Picks a victim frame with clock or WSClock and claims its page
+   lock. If OWNER is non-null only its frames are considered;
+   otherwise frames of processes at their resident set cap are
+   preferred. Returns null if no frame can be evicted. */
+static struct fte *
+select_victim (struct thread *owner)
+{
+    struct fte *victim;
+
+    ASSERT (lock_held_by_current_thread (&frame_lock));
+
+    if (owner != NULL)
+        return frame_wsclock ? wsclock_select (owner, false)
+                             : clock_select (owner, false);
+    victim = frame_wsclock ? wsclock_select (NULL, true)
+                           : clock_select (NULL, true);
+    if (victim == NULL)
+        victim = frame_wsclock ? wsclock_select (NULL, false)
+                               : clock_select (NULL, false);
+    return victim;
+}
+
+/* Evicts and frees up to WANT frames, with at most SWAP_CLUSTER
+   mappings among them, in one batch for the page-out daemon. The
+   pages among them that go to swap get adjacent slots and are
+   written with a single request instead of one request per page.
+   Returns the number of frames freed. */
+static size_t
+evict_cluster (size_t want)
+{
+    struct fte *victims[SWAP_CLUSTER];
+    uint32_t *pds[SWAP_CLUSTER];
+    struct spte *sptes[SWAP_CLUSTER];
+    void *kpages[SWAP_CLUSTER];
+    bool swapped[SWAP_CLUSTER];
+    size_t cnt = 0, map_cnt = 0;
+    size_t i;
+
+    if (want > SWAP_CLUSTER)
+        want = SWAP_CLUSTER;
+
+    lock_acquire (&frame_lock);
+    while (cnt < want)
+        {
+            struct fte *victim = select_victim (NULL);
+            if (victim == NULL)
+                break;
+            if (map_cnt + victim->share_cnt > SWAP_CLUSTER)
+                {
+                    unclaim (victim);
+                    break;
+                }
+            victim->evicting = true;
+            victims[cnt++] = victim;
+            map_cnt += victim_mappings (victim, pds + map_cnt,
+                                        sptes + map_cnt, kpages + map_cnt);
+        }
+    lock_release (&frame_lock);
+    if (cnt == 0)
+        return 0;
+
+    spt_evict_upages (pds, sptes, kpages, map_cnt, swapped);
+    for (i = 0; i < cnt; i++)
+        unclaim (victims[i]);
+
+    lock_acquire (&frame_lock);
+    map_cnt = 0;
+    for (i = 0; i < cnt; i++)
+        {
+            kpages[i] = victims[i]->kpage;
+            map_cnt += finish_eviction (victims[i], swapped + map_cnt);
+        }
+    cond_broadcast (&evict_done, &frame_lock);
+    lock_release (&frame_lock);
+
+    for (i = 0; i < cnt; i++)
+        palloc_free_page (kpages[i]);
+    return cnt;
+}
+
+/* Returns the striped lock for user page UPAGE in page directory
+   PD. */
+static struct lock *
+page_lock (uint32_t *pd, const void *upage)
+{
+    return &page_locks[(pg_no (upage) ^ pg_no (pd)) % PAGE_LOCK_CNT];
+}
+
+/* Acquires the lock held while user page UPAGE in page directory PD
+   is read in or written out. Must not be held across a call to
+   frame_get_page(). */
+void
+frame_page_lock (uint32_t *pd, const void *upage)
+{
+    lock_acquire (page_lock (pd, upage));
+}
+
+/* Releases the lock acquired by frame_page_lock(). */
+void
+frame_page_unlock (uint32_t *pd, const void *upage)
+{
+    lock_release (page_lock (pd, upage));
+}
+
+/* Tries to take the page lock of the page in FTE for eviction.
+   Fails if someone, possibly ourselves, is already using that
+   stripe. */
+static bool
+claim (struct fte *fte)
+{
+    struct lock *l = page_lock (fte->pd, fte->upage);
+
+    return !lock_held_by_current_thread (l) && lock_try_acquire (l);
+}
+
+/* Tries to claim the page locks of all the mappings of the frame
+   in FTE for eviction, as claim() does for its own. Returns false,
+   holding none of them, if any is busy. */
+static bool
+claim_victim (struct fte *fte)
+{
+    struct list_elem *e, *f;
+
+    if (!claim (fte))
+        return false;
+    for (e = list_begin (&fte->refs); e != list_end (&fte->refs);
+         e = list_next (e))
+        {
+            struct frame_ref *ref = list_entry (e, struct frame_ref, elem);
+            struct lock *l = page_lock (ref->pd, ref->upage);
+
+            if (lock_held_by_current_thread (l) || !lock_try_acquire (l))
+                break;
+        }
+    if (e == list_end (&fte->refs))
+        return true;
+
+    for (f = list_begin (&fte->refs); f != e; f = list_next (f))
+        {
+            struct frame_ref *ref = list_entry (f, struct frame_ref, elem);
+            lock_release (page_lock (ref->pd, ref->upage));
+        }
+    lock_release (page_lock (fte->pd, fte->upage));
+    return false;
+}
+
+/* Releases the page locks taken by claim_victim (FTE). */
+static void
+unclaim (struct fte *fte)
+{
+    struct list_elem *e;
+
+    for (e = list_begin (&fte->refs); e != list_end (&fte->refs);
+         e = list_next (e))
+        {
+            struct frame_ref *ref = list_entry (e, struct frame_ref, elem);
+            lock_release (page_lock (ref->pd, ref->upage));
+        }
+    lock_release (page_lock (fte->pd, fte->upage));
+}
+
+/* Returns true if any mapping of FTE's frame was accessed since the
+   last call, and clears their accessed bits. */
+static bool
+test_and_clear_accessed (struct fte *fte)
+{
+    bool accessed = pagedir_test_and_clear_accessed (fte->pd, fte->upage);
+    struct list_elem *e;
+
+    for (e = list_begin (&fte->refs); e != list_end (&fte->refs);
+         e = list_next (e))
+        {
+            struct frame_ref *ref = list_entry (e, struct frame_ref, elem);
+
+            if (pagedir_test_and_clear_accessed (ref->pd, ref->upage))
+                accessed = true;
+        }
+    return accessed;
+}
+
+/* Returns true if thread T has reached its resident set cap. */
+static inline bool
+rss_over (const struct thread *t)
+{
+    return t->rss_limit != 0 && t->rss >= t->rss_limit;
+}
+
+/* Adds a frame to thread T's resident set. */
+static inline void
+rss_add (struct thread *t)
+{
+    if (++t->rss > t->rusage.peak_rss)
+        t->rusage.peak_rss = t->rss;
+}
+
+/* Returns true if FTE is pinned, by frame_pin() or because it is
+   still being loaded. */
+static inline bool
+is_pinned (const struct fte *fte)
+{
+    return fte->loading || fte->pin_cnt > 0;
+}
+
+/* Returns true if FTE may be chosen for eviction. If OWNER is
+   non-null, only its frames qualify; if OVER_QUOTA is true, only
+   frames of processes at their resident set cap do. */
+static inline bool
+evictable (const struct fte *fte, const struct thread *owner,
+           bool over_quota)
+{
+    return fte->kpage != NULL && !is_pinned (fte) && fte->upage != NULL
+           && !fte->writeback && !fte->evicting
+           && fte->share_cnt <= SWAP_CLUSTER
+           && (owner == NULL || fte->owner == owner)
+           && (!over_quota || rss_over (fte->owner));
+}
+
+/* Returns the frame under the clock hand and advances the hand. */
+static inline struct fte *
+clock_advance (void)
+{
+    struct fte *fte = &frame_table[clock_hand];
+    if (++clock_hand >= frame_cnt)
+        clock_hand = 0;
+    return fte;
+}
+
+/* Second-chance clock. Frames that are free, pinned or not yet
+   attached to a user page are skipped. A frame whose page was
+   accessed since the clock last passed gets its accessed bit
+   cleared and is passed over once more. Returns null if no frame
+   can be evicted. OWNER and OVER_QUOTA filter the candidates as in
+   evictable(). The returned frame's page lock has been claimed. */
+static struct fte *
+clock_select (struct thread *owner, bool over_quota)
+{
+    size_t i;
+
+    ASSERT (lock_held_by_current_thread (&frame_lock));
+
+    /* Two sweeps clear every accessed bit, so a third would find
+       nothing new. */
+    for (i = 0; i < 2 * frame_cnt; i++)
+        {
+            struct fte *fte = clock_advance ();
+            if (!evictable (fte, owner, over_quota))
+                continue;
+            if (test_and_clear_accessed (fte))
+                continue;
+            if (claim_victim (fte))
+                return fte;
+        }
+    return NULL;
+}
+
+/* WSClock. Sweeps the clock once. An accessed page has its bit
+   cleared and its last use stamped with its owner's virtual time.
+   The first clean page older than WS_TAU is the victim. Old dirty
+   pages are queued for the page-out thread, unless we are that
+   thread, in which case the first one is taken as the victim.
+
+   If the sweep finds no clean old page, falls back to the first
+   clean page seen, then to the first evictable page seen, and
+   returns null only if nothing can be evicted at all. OWNER and
+   OVER_QUOTA filter the candidates as in evictable(). The returned
+   frame's page lock has been claimed; fallback candidates are
+   claimed when first seen and let go if not used. */
+static struct fte *
+wsclock_select (struct thread *owner, bool over_quota)
+{
+    struct fte *clean = NULL, *any = NULL, *victim = NULL;
+    bool async = pageout_running && thread_current () != pageout_thread;
+    size_t queued = 0;
+    size_t i;
+
+    ASSERT (lock_held_by_current_thread (&frame_lock));
+
+    for (i = 0; i < frame_cnt && victim == NULL; i++)
+        {
+            struct fte *fte = clock_advance ();
+            bool dirty, old;
+
+            if (!evictable (fte, owner, over_quota))
+                continue;
+            if (test_and_clear_accessed (fte))
+                {
+                    fte->last_use = fte->owner->user_ticks;
+                    if (any == NULL && claim_victim (fte))
+                        any = fte;
+                    continue;
+                }
+
+            dirty = spt_needs_writeback (fte->pd, fte->spte);
+            old = fte->owner->user_ticks - fte->last_use > WS_TAU;
+            if (old && !dirty)
+                {
+                    if (claim_victim (fte))
+                        victim = fte;
+                }
+            else if (old && async)
+                {
+                    fte->writeback = true;
+                    writeback_cnt++;
+                    queued++;
+                }
+            else if (old)
+                {
+                    if (claim_victim (fte))
+                        victim = fte;
+                }
+            else if (!dirty && clean == NULL)
+                {
+                    if (claim_victim (fte))
+                        clean = fte;
+                }
+            else if (any == NULL && claim_victim (fte))
+                any = fte;
+        }
+    if (queued > 0)
+        pageout_wake ();
+
+    if (victim == NULL)
+        victim = clean != NULL ? clean : any;
+    if (clean != NULL && clean != victim)
+        unclaim (clean);
+    if (any != NULL && any != victim)
+        unclaim (any);
+    return victim;
+}
+
+/* Writes out the page in VICTIM, whose page locks the caller has
+   claimed, from all of its mappings and releases its frame table
+   entry, returning the frame's kernel virtual page. The frame lock
+   is dropped during the write and held again on return; the page
+   locks are released. */
+static void *
+evict_victim (struct fte *victim)
+{
+    uint32_t *pds[SWAP_CLUSTER];
+    struct spte *sptes[SWAP_CLUSTER];
+    void *kpages[SWAP_CLUSTER];
+    bool swapped[SWAP_CLUSTER];
+    size_t cnt;
     void *kpage;
-    struct fte *fte;
-    struct thread *cur;
 
-    cur = thread_current ();
-    kpage = pg_round_down (pagedir_get_page (cur->pagedir, uaddr));
+    ASSERT (lock_held_by_current_thread (&frame_lock));
+    ASSERT (lock_held_by_current_thread (page_lock (victim->pd,
+                                                    victim->upage)));
+
+    victim->evicting = true;
+    cnt = victim_mappings (victim, pds, sptes, kpages);
+    lock_release (&frame_lock);
+
+    spt_evict_upages (pds, sptes, kpages, cnt, swapped);
+    unclaim (victim);
+
+    lock_acquire (&frame_lock);
+    kpage = victim->kpage;
+    finish_eviction (victim, swapped);
+    cond_broadcast (&evict_done, &frame_lock);
+    return kpage;
+}
+
+/* Stores the page directory, spte and kernel page of each mapping of
+   VICTIM, which is being evicted, in PDS, SPTES and KPAGES, its own
+   mapping first and then its refs in order. Returns the number of
+   mappings, VICTIM's share_cnt. */
+static size_t
+victim_mappings (struct fte *victim, uint32_t *pds[], struct spte *sptes[],
+                 void *kpages[])
+{
+    struct list_elem *e;
+    size_t cnt = 0;
+
+    ASSERT (victim->share_cnt <= SWAP_CLUSTER);
+
+    pds[cnt] = victim->pd;
+    sptes[cnt] = victim->spte;
+    kpages[cnt++] = victim->kpage;
+    for (e = list_begin (&victim->refs); e != list_end (&victim->refs);
+         e = list_next (e))
+        {
+            struct frame_ref *ref = list_entry (e, struct frame_ref, elem);
+
+            pds[cnt] = ref->pd;
+            sptes[cnt] = ref->spte;
+            kpages[cnt++] = victim->kpage;
+        }
+    return cnt;
+}
+
+/* Finishes evicting VICTIM once its mappings, in the order of
+   victim_mappings(), have been written out, with SWAPPED telling
+   which went to swap: drops its refs and releases the frame table
+   entry. Returns the number of mappings it had. */
+static size_t
+finish_eviction (struct fte *victim, const bool swapped[])
+{
+    size_t cnt = 0;
+
+    ASSERT (lock_held_by_current_thread (&frame_lock));
+
+    if (swapped[cnt++] && victim->owner != NULL)
+        victim->owner->rusage.swap_outs++;
+    while (!list_empty (&victim->refs))
+        {
+            struct frame_ref *ref = list_entry (list_pop_front (&victim->refs),
+                                                struct frame_ref, elem);
+
+            if (swapped[cnt++])
+                ref->owner->rusage.swap_outs++;
+            ref->owner->rss--;
+            free (ref);
+        }
+    victim->share_cnt = 1;
+    release_frame (victim);
+    victim->evicting = false;
+    return cnt;
+}
+
+/* Marks FTE free and takes it off its owner's resident set. */
+static void
+release_frame (struct fte *fte)
+{
+    ASSERT (lock_held_by_current_thread (&frame_lock));
+
+    if (fte->writeback)
+        writeback_cnt--;
+    if (fte->owner != NULL)
+        fte->owner->rss--;
+    if (fte->text)
+        {
+            ohash_delete (&text_frames, fte);
+            fte->text = false;
+            if (fte->text_mmap)
+                mmap_frame_cnt--;
+        }
+    fte->kpage = NULL;
+    fte->upage = NULL;
+    fte->owner = NULL;
+    frame_used--;
+}
+
+/* Wakes the page-out daemon if free frames have run low and it is
+   waiting. */
+static void
+pageout_poke (void)
+{
+    if (!pageout_running
+        || (frames_free () >= pageout_low && kpool_free () >= kpool_low))
+        return;
+    pageout_wake ();
+}
+
+/* Returns the number of frames free for a fault to take, not
+   counting pages in palloc's zeroed reserve. */
+static size_t
+frames_free (void)
+{
+    size_t unused = frame_cnt - frame_used;
+    size_t zeroed = palloc_zeroed_cnt ();
+
+    return unused > zeroed ? unused - zeroed : 0;
+}
+
+/* Returns the number of free pages in the kernel pool. */
+static size_t
+kpool_free (void)
+{
+    struct memstat stats;
+
+    palloc_get_stats (false, &stats);
+    return stats.free;
+}
+
+/* Wakes the page-out daemon if it is waiting. */
+static void
+pageout_wake (void)
+{
+    enum intr_level old_level;
+
+    old_level = intr_disable ();
+    if (!list_empty (&pageout_wanted.waiters))
+        sema_up (&pageout_wanted);
+    intr_set_level (old_level);
+}
+
+/* Writes out and frees every frame that WSClock queued for the
+   page-out thread. A queued page that has been accessed again in
+   the meantime is back in its working set and is left alone. The
+   write happens while the page is still mapped, so that its owner
+   does not wait on it, and the frame is reclaimed afterward only if
+   the page was not accessed during the write either; otherwise it
+   just stays, clean. */
+static void
+pageout_writeback (void)
+{
+    size_t i;
 
     lock_acquire (&frame_lock);
-    fte = frame_lookup (kpage);
+    for (i = 0; i < frame_cnt && writeback_cnt > 0; i++)
+        {
+            struct fte *fte = &frame_table[i];
+
+            if (fte->kpage == NULL || !fte->writeback)
+                continue;
+            if (is_pinned (fte) || fte->share_cnt > 1
+                || pagedir_is_accessed (fte->pd, fte->upage))
+                {
+                    fte->writeback = false;
+                    writeback_cnt--;
+                    continue;
+                }
+            if (fte->evicting || !claim (fte))
+                continue;
+
+            /* Still queued, the frame is neither chosen for eviction
+               nor merged while the lock is down, and its page lock
+               keeps it mapped. */
+            lock_release (&frame_lock);
+            spt_clean_upage (fte->pd, fte->spte, fte->kpage);
+            lock_acquire (&frame_lock);
+            fte->writeback = false;
+            writeback_cnt--;
+            writebehind_cnt++;
+            if (is_pinned (fte) || fte->share_cnt > 1
+                || pagedir_is_accessed (fte->pd, fte->upage))
+                {
+                    writebehind_kept++;
+                    lock_release (page_lock (fte->pd, fte->upage));
+                    continue;
+                }
+            palloc_free_page (evict_victim (fte));
+        }
+    lock_release (&frame_lock);
+}
+
+/* Background thread that writes out the frames WSClock queued for
+   it, shrinks the kernel caches of each pool running low, and
+   evicts frames until pageout_high are free, then sleeps until it
+   is woken again. */
+static void
+pageout (void *aux UNUSED)
+{
+    pageout_thread = thread_current ();
+    for (;;)
+        {
+            size_t kfree = kpool_free ();
+            size_t avail;
+
+            pageout_writeback ();
+            if (kfree < kpool_high)
+                shrink_caches (false, kpool_high - kfree);
+            avail = frames_free ();
+            if (avail < pageout_high)
+                shrink_caches (true, pageout_high - avail);
+            while ((avail = frames_free ()) < pageout_high)
+                if (evict_cluster (pageout_high - avail) == 0)
+                    break;
+            sema_down (&pageout_wanted);
+        }
+}
+
+/* Returns true if FTE holds an anonymous or executable page that
+   same-page merging may share with another. */
+static inline bool
+mergeable (const struct fte *fte)
+{
+    return fte->kpage != NULL && fte->upage != NULL && fte->owner != NULL
+           && !is_pinned (fte) && !fte->writeback && !fte->evicting
+           && !fte->text && fte->spte->type != MMAP;
+}
+
+/* Returns true if FTE's frame is mapped in page directory PD. */
+static bool
+maps_pd (struct fte *fte, const uint32_t *pd)
+{
+    struct list_elem *e;
+
+    if (fte->pd == pd)
+        return true;
+    for (e = list_begin (&fte->refs); e != list_end (&fte->refs);
+         e = list_next (e))
+        if (list_entry (e, struct frame_ref, elem)->pd == pd)
+            return true;
+    return false;
+}
+
+/* Merges the page in DUP, which must be the frame's only mapping,
+   into KEEP's frame if both still hold the same contents: maps
+   DUP's page to KEEP's frame read-only, recording the mapping in
+   REF, and releases DUP's frame table entry. Both pages become
+   copy-on-write if they were writable. Returns true if merged, in
+   which case the caller must free DUP's old frame. Mappings in the
+   same page directory are never merged, since a frame's mappings
+   are told apart by page directory. */
+static bool
+ksm_merge (struct fte *keep, struct fte *dup, struct frame_ref *ref)
+{
+    uint32_t *pd = dup->pd;
+    void *upage = dup->upage;
+    struct spte *spte = dup->spte;
+    struct lock *keep_lock = NULL;
+    bool keep_writable = false, dup_writable, equal;
+
+    ASSERT (lock_held_by_current_thread (&frame_lock));
+
+    if (keep == dup || !mergeable (keep) || !mergeable (dup)
+        || dup->share_cnt != 1 || maps_pd (keep, pd) || !claim (dup))
+        return false;
+
+    /* Write-protect both pages before comparing them, so that they
+       cannot change once found equal. A frame that is already
+       shared is read-only in every mapping. */
+    if (keep->share_cnt == 1)
+        {
+            if (!claim (keep))
+                {
+                    lock_release (page_lock (pd, upage));
+                    return false;
+                }
+            keep_lock = page_lock (keep->pd, keep->upage);
+            keep_writable = pagedir_is_writable (keep->pd, keep->upage);
+            if (keep_writable)
+                {
+                    keep->spte->cow = true;
+                    pagedir_set_writable (keep->pd, keep->upage, false);
+                }
+        }
+    dup_writable = pagedir_is_writable (pd, upage);
+    if (dup_writable)
+        {
+            spte->cow = true;
+            pagedir_set_writable (pd, upage, false);
+        }
+
+    equal = memcmp (keep->kpage, dup->kpage, PGSIZE) == 0;
+    if (equal)
+        {
+            bool dirty = pagedir_is_dirty (pd, upage);
+            struct thread *owner = dup->owner;
+
+            pagedir_clear_page (pd, upage);
+            pagedir_set_page (pd, upage, keep->kpage, false);
+            pagedir_set_dirty (pd, upage, dirty);
+            release_frame (dup);
+            add_ref (keep, ref, pd, upage, spte, owner);
+        }
+    else
+        {
+            if (dup_writable)
+                {
+                    pagedir_set_writable (pd, upage, true);
+                    spte->cow = false;
+                }
+            if (keep_writable)
+                {
+                    pagedir_set_writable (keep->pd, keep->upage, true);
+                    keep->spte->cow = false;
+                }
+        }
+
+    lock_release (page_lock (pd, upage));
+    if (keep_lock != NULL)
+        lock_release (keep_lock);
+    return equal;
+}
+
+/* Sweeps the frame table once for same-page merging. */
+static void
+ksm_sweep (void)
+{
+    size_t i;
+
+    for (i = 0; i < frame_cnt; i++)
+        {
+            struct fte *fte = &frame_table[i], *keep;
+            struct frame_ref *ref;
+            void *kpage;
+            unsigned sum;
+            bool merged;
+
+            lock_acquire (&frame_lock);
+            kpage = (mergeable (fte) && fte->share_cnt == 1
+                     ? fte->kpage : NULL);
+            lock_release (&frame_lock);
+            if (kpage == NULL)
+                continue;
+
+            /* The page may change or even go away while we hash it,
+               so the hash is only a hint until ksm_merge() compares
+               the pages under the locks. */
+            sum = hash_bytes (kpage, PGSIZE);
+            if (sum != fte->ksm_sum)
+                {
+                    fte->ksm_sum = sum;
+                    continue;
+                }
+
+            keep = ohash_find (&ksm_frames, fte);
+            if (keep == NULL)
+                {
+                    ohash_insert (&ksm_frames, fte);
+                    continue;
+                }
+
+            ref = malloc (sizeof *ref);
+            if (ref == NULL)
+                break;
+            lock_acquire (&frame_lock);
+            merged = ksm_merge (keep, fte, ref);
+            lock_release (&frame_lock);
+            if (merged)
+                {
+                    palloc_free_page (kpage);
+                    ksm_merged++;
+                }
+            else
+                {
+                    /* Let this page stand for its contents instead,
+                       in case KEEP has changed. */
+                    free (ref);
+                    ohash_delete (&ksm_frames, keep);
+                    ohash_insert (&ksm_frames, fte);
+                }
+        }
+    ohash_clear (&ksm_frames, NULL);
+    ksm_scans++;
+}
+
+/* Background thread that sweeps the frame table for pages to merge
+   every KSM_INTERVAL ticks. */
+static void
+ksm (void *aux UNUSED)
+{
+    for (;;)
+        {
+            timer_sleep (KSM_INTERVAL);
+            ksm_sweep ();
+        }
+}
+
+/* Returns a hash value for the contents of the page held by fte
+   E_, as of the last same-page merging sweep. */
+static unsigned
+ksm_hash (const void *e_, void *aux UNUSED)
+{
+    const struct fte *e = e_;
+    return e->ksm_sum;
+}
+
+/* Returns true if ftes A_ and B_ hashed the same in the last
+   same-page merging sweep. */
+static bool
+ksm_equal (const void *a_, const void *b_, void *aux UNUSED)
+{
+    const struct fte *a = a_;
+    const struct fte *b = b_;
+
+    return a->ksm_sum == b->ksm_sum;
+}
+
+/* Prints write-behind and same-page merging statistics. */
+void
+frame_print_stats (void)
+{
+    if (writebehind_cnt > 0)
+        printf ("Frame: %llu pages written behind, %llu kept after use\n",
+                writebehind_cnt, writebehind_kept);
+    if (frame_ksm)
+        printf ("Frame: %llu merging sweeps, %llu frames merged\n",
+                ksm_scans, ksm_merged);
+}
+
+/* Returns the frame table entry that corresponds to the physical frame
+   associated with the kernel virtual page KPAGE, whether or not the
+   frame is in use. If KPAGE is not in the user pool, returns NULL. */
+static struct fte *
+frame_lookup (void *kpage)
+{
+  size_t idx = ((uint8_t *) kpage - frame_base) / PGSIZE;
+
+  if ((uint8_t *) kpage < frame_base || idx >= frame_cnt)
+    return NULL;
+  return &frame_table[idx];
+}
+
+/* Evicts the current thread's page held in the frame at kernel
+   virtual page KPAGE now, as if the clock had picked it, and frees
+   the frame. The caller must not hold the page's page lock. Returns
+   false if the frame cannot be evicted, for instance because it is
+   pinned or shared. */
+bool
+frame_evict (void *kpage)
+{
+    struct fte *fte = frame_lookup (kpage);
+    void *victim = NULL;
+
     if (fte == NULL)
-    {
-        lock_release (&frame_lock);
         return false;
-    }
-    /* TODO: does it matter that we unpin an unpinned page??*/
-    if (!fte->pinned)
-    {
-        lock_release (&frame_lock);
+
+    lock_acquire (&frame_lock);
+    if (evictable (fte, thread_current ()->process, false)
+        && fte->share_cnt == 1 && claim_victim (fte))
+        victim = evict_victim (fte);
+    lock_release (&frame_lock);
+    if (victim == NULL)
         return false;
-    }
-    fte->pinned = false;
+    palloc_free_page (victim);
+    return true;
+}
+
+/* Pins the frame holding the current thread's resident page at user
+   address UADDR so that it is not evicted until a matching
+   frame_unpin(). Pins nest. The caller must hold the page's page
+   lock. Returns false if the page
+   is not resident. A page mapped to memory outside the user pool,
+   such as the shared zero page, is never evicted and counts as
+   pinned already. */
+bool
+frame_pin (void *uaddr)
+{
+    struct thread *cur = thread_current ();
+    void *kpage = pagedir_get_page (cur->pagedir, uaddr);
+    struct fte *fte;
+
+    if (kpage == NULL)
+        return false;
+    fte = frame_lookup (pg_round_down (kpage));
+    if (fte == NULL)
+        return true;
+
+    lock_acquire (&frame_lock);
+    if (fte->kpage == NULL)
+        {
+            lock_release (&frame_lock);
+            return false;
+        }
+    fte->pin_cnt++;
     lock_release (&frame_lock);
     return true;
-}
\ No newline at end of file
+}
+
+/* Returns the frame table entry for the frame holding the current
+   thread's page at user address UADDR, or a null pointer if the
+   page is not resident in the user pool. */
+static struct fte *
+uaddr_frame (void *uaddr)
+{
+    void *kpage = pagedir_get_page (thread_current ()->pagedir, uaddr);
+
+    return kpage != NULL ? frame_lookup (pg_round_down (kpage)) : NULL;
+}
+
+/* Drops one pin taken by frame_pin() on the frame holding the
+   current thread's page at user address UADDR. Returns false if
+   the page is not resident or not pinned. */
+bool
+frame_unpin (void *uaddr)
+{
+    struct fte *fte = uaddr_frame (uaddr);
+    bool success = false;
+
+    if (fte == NULL)
+        return false;
+
+    lock_acquire (&frame_lock);
+    if (fte->kpage != NULL && fte->pin_cnt > 0)
+        {
+            fte->pin_cnt--;
+            success = true;
+        }
+    lock_release (&frame_lock);
+    return success;
+}
+
+/* Marks the frame holding the current thread's page at user address
+   UADDR, if it is resident, as loaded, so that it may be evicted
+   once no frame_pin() holds it. */
+void
+frame_loaded (void *uaddr)
+{
+    struct fte *fte = uaddr_frame (uaddr);
+
+    if (fte == NULL)
+        return;
+
+    lock_acquire (&frame_lock);
+    if (fte->kpage != NULL)
+        fte->loading = false;
+    lock_release (&frame_lock);
+}
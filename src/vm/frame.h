@@ -1,7 +1,11 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
-#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 
@@ -13,12 +17,25 @@
    by the kernel virtual page `kpage` to a user processes' user virtual
    page `upage`. 
 
-   The `pinned` member is for use by the eviction algorithm, if a frame is
-   pinned it is not considered for eviction.
+   A frame that is `loading` or has a nonzero `pin_cnt` is pinned and
+   not considered for eviction.  A new frame is loading until whoever
+   faulted it in calls frame_loaded(); frame_pin() and frame_unpin()
+   add and drop pins of their own, so callers that pin the same frame
+   independently do not unpin it under each other.
    `tid` represents the thread that currently owns the frame. It is used
    during eviction to get access to a the frame owner's page directory and
    supplementary page table and `upage` is the key to both of these table.
-   `hash_elem` is the element in the frame table. */
+   The frame table is an array with one entry per user pool frame, so an
+   entry's index is its frame number and a null `kpage` marks it free.
+
+   A frame holding a read-only page of an executable is also entered
+   in a page cache keyed by `text_sector`, `text_ofs` and
+   `text_bytes`, so that other processes running the same executable
+   map the same frame instead of reading their own copy. So is a
+   frame holding a page of a mapped file, marked by `text_mmap` and
+   keyed without `text_bytes`: every process mapping that page maps
+   the one frame writable, and file reads and writes of the page go
+   through it too, so that all of them see the same data. */
 struct fte
     {
         /* 
@@ -32,16 +49,69 @@ struct fte
         uint32_t *pd;                   /* Pagedirectory of owner thread. */
         struct spte *spte;              /* Supplementary page table entry
                                            of owner. */
-        bool pinned;                    /* If the frame can be evicted. */
-        struct hash_elem hash_elem;     /* Frame Table element */
+        bool loading;                   /* Not yet released by the code
+                                           that faulted it in. */
+        unsigned pin_cnt;               /* Number of frame_pin() calls
+                                           not yet undone. */
+        struct thread *owner;           /* Process whose page this is. */
+        int64_t last_use;               /* Owner's user_ticks when the page
+                                           was last seen accessed. */
+        bool writeback;                 /* Queued for the page-out thread
+                                           to write out and free. */
+        bool evicting;                  /* Being written out; the frame
+                                           is busy until this clears. */
+        unsigned share_cnt;             /* Number of mappings of the
+                                           frame, 1 unless shared. */
+        struct list refs;               /* Mappings besides the one above,
+                                           as struct frame_ref: with it,
+                                           the frame's reverse map. */
+        bool text;                      /* In the text page cache? */
+        block_sector_t text_sector;     /* Inode sector of the file. */
+        off_t text_ofs;                 /* File offset of the page. */
+        size_t text_bytes;              /* Bytes read from the file. */
+        bool text_mmap;                 /* A mapped file's page, not
+                                           text? */
+        unsigned ksm_sum;               /* Hash of the contents at the
+                                           last same-page merging
+                                           scan. */
     };
 
+/* Use WSClock rather than plain clock to pick eviction victims. */
+extern bool frame_wsclock;
+
+/* Resident set cap given to each process at exec, 0 for none. */
+extern size_t frame_rss_limit;
+
+/* Merge identical anonymous and executable pages in the background. */
+extern bool frame_ksm;
+
 void frame_table_init (void);
+void frame_start_pageout (void);
 void frame_table_destroy (void);
 void *frame_get_page (enum palloc_flags flags);
+void *frame_get_free_page (enum palloc_flags flags);
 void frame_free_page (void *kpage);
+void frame_release (void *kpage, uint32_t *pd);
+bool frame_share (void *kpage, uint32_t *pd, void *upage, struct spte *spte);
+bool frame_is_shared (void *kpage);
+void *frame_share_text (block_sector_t sector, off_t ofs, size_t bytes,
+                        bool mmap, uint32_t *pd, void *upage,
+                        struct spte *spte);
+bool frame_has_text (block_sector_t sector, off_t ofs, size_t bytes);
+void frame_set_text (void *kpage, block_sector_t sector, off_t ofs,
+                     size_t bytes, bool mmap);
+void frame_mmap_read (block_sector_t sector, off_t ofs, void *buffer,
+                      size_t size);
+void frame_mmap_write (block_sector_t sector, off_t ofs,
+                       const void *buffer, size_t size);
 void frame_set_udata (void *kpage, void *upage, uint32_t *pd,
                       struct spte *spte);
-bool frame_unpin (void *kpage);
+bool frame_pin (void *uaddr);
+bool frame_evict (void *kpage);
+bool frame_unpin (void *uaddr);
+void frame_loaded (void *uaddr);
+void frame_page_lock (uint32_t *pd, const void *upage);
+void frame_page_unlock (uint32_t *pd, const void *upage);
+void frame_print_stats (void);
 
 #endif /* vm/frame.h */
\ No newline at end of file
@@ -1,11 +1,23 @@
 #include <hash.h>
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "userprog/syscall.h"
 #include "vm/mmap.h"
 #include "vm/page.h"
+#include "vm/vma.h"
 
-static void mmap_destructor_fn (struct hash_elem *e, void *aux UNUSED);
+static void mmap_destructor_fn (void *e, void *aux UNUSED);
+
+/* Mmap table entries of all processes. */
+static struct kmem_cache mmap_cache;
+
+/* Initializes the allocator for mmap table entries. */
+void
+mmap_init (void)
+{
+  kmem_cache_init (&mmap_cache, "mmap", sizeof (struct mmap_table_entry),
+                   NULL, NULL);
+}
 
 /* Adds an entry to the current thread's mmap table with mapping from
    the first user virtual page BEGIN_UPAGE to the first page END_UPAGE
@@ -18,18 +30,22 @@ mmap_insert (void *begin_upage, int pg_cnt)
   mapid_t mapid;
   struct mmap_table_entry *new_entry;
 
-  new_entry = malloc (sizeof (struct mmap_table_entry));
+  new_entry = kmem_cache_alloc (&mmap_cache);
   if (new_entry == NULL)
     return -1;
 
-  cur = thread_current ();
-  /* Verified in caller function that new_fd is not -1. */
-  mapid = cur->next_fd;
+  cur = thread_current ()->process;
+  /* Verified in caller function that this is not -1. */
+  mapid = fdtable_lowest_free (&cur->fds);
 
   new_entry->begin_upage = begin_upage;
   new_entry->pg_cnt = pg_cnt;
   new_entry->mapid = mapid;
-  hash_insert (&cur->mmap_table, &new_entry->hash_elem);
+  if (ohash_insert (&cur->mmap_table, new_entry) != NULL)
+    {
+      kmem_cache_free (&mmap_cache, new_entry);
+      return -1;
+    }
 
   return mapid;
 }
@@ -43,8 +59,8 @@ mmap_remove (mapid_t mapid)
     if (m == NULL)
         return;
     
-    hash_delete (&thread_current ()->mmap_table, &m->hash_elem);
-    free (m);
+    ohash_delete (&thread_current ()->process->mmap_table, m);
+    kmem_cache_free (&mmap_cache, m);
 }
 
 /* Looks up mmap entry in a mmap table HASH with mapid MAPID.
@@ -52,48 +68,70 @@ mmap_remove (mapid_t mapid)
 struct mmap_table_entry *
 mmap_find (mapid_t mapid)
 {
-  struct mmap_table_entry mmap_table_entry;
-  struct hash_elem *e;
+  struct mmap_table_entry key;
 
-  mmap_table_entry.mapid = mapid;
-  e = hash_find (&thread_current ()->mmap_table, &mmap_table_entry.hash_elem);
-  return e != NULL ? hash_entry (e, struct mmap_table_entry, hash_elem) : NULL;
+  key.mapid = mapid;
+  return ohash_find (&thread_current ()->process->mmap_table, &key);
 }
 
 /* Returns a hash value for a mmap entry M_. */
 unsigned
-mmap_hash (const struct hash_elem *m_, void *aux UNUSED)
+mmap_hash (const void *m_, void *aux UNUSED)
 {
-  const struct mmap_table_entry *m = hash_entry (m_, struct mmap_table_entry, hash_elem);
+  const struct mmap_table_entry *m = m_;
   return hash_int ((unsigned)m->mapid);
 }
 
-/* Returns true if a mmap entry A_ precedes spte B_. */
+/* Returns true if mmap entries A_ and B_ have the same map id. */
 bool
-mmap_less (const struct hash_elem *a_, const struct hash_elem *b_,
-           void *aux UNUSED)
+mmap_equal (const void *a_, const void *b_, void *aux UNUSED)
 {
-  const struct mmap_table_entry *a = hash_entry (a_, struct mmap_table_entry,
-                                                 hash_elem);
-  const struct mmap_table_entry *b = hash_entry (b_, struct mmap_table_entry,
-                                                 hash_elem);
-  return a->mapid < b->mapid;
+  const struct mmap_table_entry *a = a_;
+  const struct mmap_table_entry *b = b_;
+  return a->mapid == b->mapid;
+}
+
+/* Copies the mmap table of PARENT, which must be blocked, into the
+   current thread for fork, keeping the same map ids. Returns false
+   if out of memory. */
+bool
+mmap_copy (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct ohash_iterator i;
+  struct mmap_table_entry *p;
+
+  ohash_first (&i, &parent->mmap_table);
+  while ((p = ohash_next (&i)) != NULL)
+    {
+      struct mmap_table_entry *m = kmem_cache_alloc (&mmap_cache);
+      if (m == NULL)
+        return false;
+      *m = *p;
+      if (ohash_insert (&cur->mmap_table, m) != NULL)
+        {
+          kmem_cache_free (&mmap_cache, m);
+          return false;
+        }
+    }
+  return true;
 }
 
 void
 mmap_destroy ()
 {
-  hash_destroy (&thread_current ()->mmap_table, &mmap_destructor_fn);
+  ohash_destroy (&thread_current ()->process->mmap_table,
+                &mmap_destructor_fn);
 }
 
 /* Destructor function for each mmap_entry E of the current thread's 
    mmap_table. This writes any dirty pages back to memory and frees the
    mmap_table_entry memory. */
 static void 
-mmap_destructor_fn (struct hash_elem *e, void *aux UNUSED)
+mmap_destructor_fn (void *e, void *aux UNUSED)
 {
-    struct mmap_table_entry *m = hash_entry (e, struct mmap_table_entry,
-                                                   hash_elem);
+    struct mmap_table_entry *m = e;
+    vma_remove (m->begin_upage);
     spt_remove_upages (m->begin_upage, m->pg_cnt);
-    free (m);
+    kmem_cache_free (&mmap_cache, m);
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #ifndef VM_MMAP_H
 #define VM_MMAP_H
 
-#include <hash.h>
+#include <ohash.h>
+
+struct thread;
 
 typedef int mapid_t;
 
@@ -10,15 +12,15 @@ struct mmap_table_entry
         mapid_t mapid;                  /* Map id of mmap file. */
         void *begin_upage;              /* Start user virtual address. */
         int pg_cnt;                     /* Number of mappped pages. */
-        struct hash_elem hash_elem;     /* Memory Map Table hash elem. */
     };
 
+void mmap_init (void);
 void mmap_destroy (void);
+bool mmap_copy (struct thread *parent);
 mapid_t mmap_insert (void *begin_upage, int pg_cnt);
 void mmap_remove (mapid_t mapid);
 struct mmap_table_entry * mmap_find (mapid_t mapid);
-unsigned mmap_hash (const struct hash_elem *m_, void *aux UNUSED);
-bool mmap_less (const struct hash_elem *a_, const struct hash_elem *b_,
-                void *aux UNUSED);
+unsigned mmap_hash (const void *m_, void *aux UNUSED);
+bool mmap_equal (const void *a_, const void *b_, void *aux UNUSED);
 
 #endif /* vm/mmap.h */
\ No newline at end of file
@@ -1,16 +1,103 @@
 #include <hash.h>
+#include <madvise.h>
 #include <string.h>
+#include <sysstat.h>
 #include "filesys/file.h"
-#include "threads/malloc.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/vma.h"
 
 static bool install_file (void *kpage, struct filesys_info filesys_info);
+static void read_ahead (void *upage, struct spte *spte);
+static bool prefetch (void *upage, struct spte *spte);
+static bool is_shared_text (const struct spte *spte);
+static block_sector_t text_sector (const struct spte *spte);
+static bool load_shared_text (void *upage);
+static bool load_zero_page (void *upage);
+static bool is_shared (void *kpage);
+static void spt_forget (struct spte *spte);
+static struct spte *spte_alloc (struct thread *process);
+static void spte_free (struct thread *process, struct spte *spte);
+static void reap_upage (void *e, void *pd);
+static bool unmap_for_eviction (uint32_t *pd, struct spte *spte,
+                                void *kpage);
+static void flush_run (struct file *file, off_t ofs, uint8_t *start,
+                       int pg_cnt);
+static void write_mapped (struct file *file, const void *buffer, off_t size,
+                          off_t ofs);
+
+/* Fault-around. After a fault on a file-backed page, up to
+   ra_window following pages of the same file are read in as well,
+   and after a write fault on an untouched anonymous page, up to
+   ra_window following untouched pages get zeroed frames, so that a
+   big array or heap is populated in runs rather than a fault per
+   page. The window doubles, up to RA_MAX, each time a fault lands
+   right after the previous run, and halves on any other fault. */
+#define RA_MAX 16
+
+/* A page of a process's supplementary page table entries.  Each
+   process carves its entries out of pages of its own, on its
+   SPTE_PAGES list, so that spt_destroy() can free the whole table a
+   page at a time instead of an entry at a time.  Entries removed
+   before then go on the process's SPTE_FREE list, linked through
+   their UPAGE members, for reuse. */
+struct spte_page
+  {
+    struct list_elem elem;      /* Element in process's spte_pages. */
+    size_t used;                /* Entries handed out so far. */
+    struct spte sptes[];        /* The entries. */
+  };
+
+#define SPTES_PER_PAGE \
+  ((PGSIZE - sizeof (struct spte_page)) / sizeof (struct spte))
+
+/* A page of zeroes from the kernel pool, mapped read-only for reads
+   of ZERO pages that have not been written yet. Never freed, and
+   not in the frame table, so it is never evicted. */
+static void *zero_page;
+
+/* Pages evicted, for spt_get_stats(). */
+static unsigned long long evict_cnt;
+
+/* Initializes the supplementary page table module. */
+void
+spt_init (void)
+{
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+}
+
+/* Acquires the current process's vm_lock, which keeps its threads
+   from faulting or changing the address space at the same time,
+   unless the current thread holds it already, as in a fault taken
+   during a memory call. Returns whether it was acquired. Pass the
+   result to spt_unlock(). */
+bool
+spt_lock (void)
+{
+    struct lock *lock = &thread_current ()->process->vm_lock;
+
+    if (lock_held_by_current_thread (lock))
+        return false;
+    lock_acquire (lock);
+    return true;
+}
+
+/* Releases the vm_lock taken by spt_lock(), if LOCKED. */
+void
+spt_unlock (bool locked)
+{
+    if (locked)
+        lock_release (&thread_current ()->process->vm_lock);
+}
 
 /* Stores the mapping from the user virtual address UPAGE to the
    relevant information to load the PGSIZE segement into memory from
@@ -32,13 +119,15 @@ spt_try_add_upage (void *upage, enum page_type type, bool in_memory,
     ASSERT (pg_ofs (upage) == 0);
 
     struct spte * spte;
+    bool fresh = false;
 
     spte = spt_find (upage);
     if (spte == NULL)
         {
-            spte = malloc (sizeof (struct spte));
+            spte = spte_alloc (thread_current ()->process);
             if (spte == NULL)
                 return false;
+            fresh = true;
         }
     
     spte->upage = upage;
@@ -46,50 +135,18 @@ spt_try_add_upage (void *upage, enum page_type type, bool in_memory,
     spte->in_memory = in_memory;
     spte->filesys_page = filesys_page;
     spte->disk_info = *disk_info;
+    spte->cow = false;
+    spte->swap_kept = false;
 
-    hash_insert (&thread_current ()->spt, &spte->hash_elem);
+    if (fresh && ohash_insert (&thread_current ()->process->spt, spte) != NULL)
+        {
+            spte_free (thread_current ()->process, spte);
+            return false;
+        }
 
     return true;
 }
 
-/* Attempts to add PG_CNT consecutive user virtual pages starting from 
-   BEGIN_UPAGE to the supplementary page table. To lazily read, the
-   spt needs to store the file pointer FP for each. Each page contains all
-   read bytes except the final page which has FINAL_READ_BYTES read bytes.
-   
-   Returns true on success of adding mappings for all pages. */
-bool spt_try_add_mmap_pages (void *begin_upage, struct file *fp, int pg_cnt,
-                            size_t final_read_bytes)
-{
-  union disk_info disk_info;
-  int pg;
-
-  disk_info.filesys_info.file = fp;
-  disk_info.filesys_info.page_read_bytes = PGSIZE;
-  disk_info.filesys_info.ofs = 0;
-
-  for (pg = 0; pg < pg_cnt - 1; pg += 1)
-    {
-        if (!spt_try_add_upage (begin_upage + (pg * PGSIZE), MMAP, false, true,
-                                &disk_info))
-            {
-                spt_remove_upages (begin_upage, pg);
-                return false;
-            }
-        disk_info.filesys_info.ofs += PGSIZE;
-    }
-  
-  /* Final case. */
-  disk_info.filesys_info.page_read_bytes = final_read_bytes % PGSIZE;
-  if (!spt_try_add_upage (begin_upage + (pg * PGSIZE), MMAP, true, true,
-                          &disk_info))
-    {
-        spt_remove_upages (begin_upage, pg);
-        return false;
-    }
-  return true;
-}
-
 /* Attempt to add a stack page with user virtual page UPAGE to the 
    supplementary page table and adding a mapping to the current 
    thread's page table from UPAGE to kernel virtual page KPAGE. */
@@ -100,7 +157,7 @@ spt_try_add_stack_page (void *upage)
     union disk_info empty_disk_info;
 
     kpage = frame_get_page (PAL_USER | PAL_ZERO);
-    if (spt_try_add_upage (upage, TMP, true, false, &empty_disk_info))
+    if (spt_try_add_upage (upage, ZERO, true, false, &empty_disk_info))
     {
         struct thread *t = thread_current ();
 
@@ -108,7 +165,10 @@ spt_try_add_stack_page (void *upage)
            address, then map our page there. */
         if (pagedir_get_page (t->pagedir, upage) == NULL
                 && pagedir_set_page (t->pagedir, upage, kpage, true))
+            {
+                frame_set_udata (kpage, upage, t->pagedir, spt_find (upage));
                 return true;
+            }
         else
             spt_remove_upages (upage, 1);
     }
@@ -123,40 +183,215 @@ spt_try_add_stack_page (void *upage)
 void
 spt_remove_upages (void * begin_upage, int num_pages)
 {
-    struct hash * spt = &thread_current ()->spt;
+    struct ohash * spt = &thread_current ()->process->spt;
     uint32_t *pd = thread_current ()->pagedir;
     struct spte * spte;
+
+    spt_flush_upages (begin_upage, num_pages);
     for (int pg = 0; pg < num_pages; pg ++)
         {
             void *cur_upage = begin_upage + (pg * PGSIZE);
             spte = spt_find (cur_upage);
             if (spte == NULL)
                 continue;
-            /* Commit to file if a diry MMAP page. */
+            /* Let an eviction of this page finish first. */
+            frame_page_lock (pd, cur_upage);
+            /* Commit to file if a diry MMAP page, which only happens
+               if it was written again since spt_flush_upages(). */
             if (spte->in_memory)
                 {
+                    void *kpage = pagedir_get_page (pd, cur_upage);
+
                     if (spte->type == MMAP && pagedir_is_dirty (pd, cur_upage))
-                        {
+                        write_mapped (spte->disk_info.filesys_info.file,
+                                      cur_upage, PGSIZE,
+                                      spte->disk_info.filesys_info.ofs);
+                    pagedir_clear_page (pd, cur_upage);
+                    if (kpage != NULL)
+                        frame_release (pg_round_down (kpage), pd);
+                    if (spte->swap_kept)
+                        swap_free (spte->disk_info.swap_id);
+                }
+            else if (!spte->filesys_page && spte->type != ZERO)
+                    swap_free (spte->disk_info.swap_id);
+            frame_page_unlock (pd, cur_upage);
+            ohash_delete (spt, spte);
+            spt_forget (spte);
+            spte_free (thread_current ()->process, spte);
+        }
+}
 
-                            lock_acquire (&filesys_lock);
-                            file_write_at (spte->disk_info.filesys_info.file,
-                                        cur_upage, PGSIZE,
-                                        spte->disk_info.filesys_info.ofs);
-                            lock_release (&filesys_lock);
+/* Frees every page of PROCESS, whose page directory PD is no
+   longer active: resident frames go back to the frame table and
+   swap slots are released, then the entries' pages are freed all
+   at once.  PROCESS may be
+   another, exited, thread, so nothing here touches user addresses,
+   and its mapped files must already have been written back. */
+void
+spt_destroy (struct thread *process, uint32_t *pd)
+{
+    /* ohash_destroy() hands the table's aux to reap_upage(). */
+    process->spt.aux = pd;
+    ohash_destroy (&process->spt, reap_upage);
+    process->spt.aux = NULL;
+
+    while (!list_empty (&process->spte_pages))
+        palloc_free_page (list_entry (list_pop_front (&process->spte_pages),
+                                      struct spte_page, elem));
+    process->spte_free = NULL;
+    swap_release_owner (pd);
+}
+
+/* Returns a new supplementary page table entry from PROCESS's
+   arena, or a null pointer if memory is short. */
+static struct spte *
+spte_alloc (struct thread *process)
+{
+    struct spte_page *p;
+    struct spte *spte;
+
+    if (process->spte_free != NULL)
+        {
+            spte = process->spte_free;
+            process->spte_free = spte->upage;
+            return spte;
+        }
+
+    if (list_empty (&process->spte_pages)
+        || (p = list_entry (list_back (&process->spte_pages),
+                            struct spte_page, elem))->used == SPTES_PER_PAGE)
+        {
+            p = palloc_get_page (0);
+            if (p == NULL)
+                return NULL;
+            p->used = 0;
+            list_push_back (&process->spte_pages, &p->elem);
+        }
+    return &p->sptes[p->used++];
+}
+
+/* Returns SPTE, which is no longer in PROCESS's table, to
+   PROCESS's arena. */
+static void
+spte_free (struct thread *process, struct spte *spte)
+{
+    spte->upage = process->spte_free;
+    process->spte_free = spte;
+}
+
+/* Frees the page of spt entry E in page directory PD, for
+   spt_destroy(). */
+static void
+reap_upage (void *e, void *pd)
+{
+    struct spte *spte = e;
+
+    /* Let an eviction of this page finish first. */
+    frame_page_lock (pd, spte->upage);
+    if (spte->in_memory)
+        {
+            void *kpage = pagedir_get_page (pd, spte->upage);
+
+            pagedir_clear_page (pd, spte->upage);
+            if (kpage != NULL)
+                frame_release (pg_round_down (kpage), pd);
+            if (spte->swap_kept)
+                swap_free (spte->disk_info.swap_id);
+        }
+    else if (!spte->filesys_page && spte->type != ZERO)
+        swap_free (spte->disk_info.swap_id);
+    frame_page_unlock (pd, spte->upage);
+}
+
+/* Writes back the dirty MMAP pages among the current thread's
+   NUM_PAGES pages starting at BEGIN_UPAGE. Pages that are adjacent
+   both in memory and in the same file are gathered into runs, and
+   each run is written with a single file_write_at(), which lets the
+   file system write whole runs of sectors instead of a page at a
+   time. The written pages are left resident and clean. */
+void
+spt_flush_upages (void *begin_upage, int num_pages)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+    struct file *run_file = NULL;
+    uint8_t *run_start = NULL;
+    off_t run_ofs = 0;
+    int run_cnt = 0;
+
+    for (int pg = 0; pg < num_pages; pg++)
+        {
+            uint8_t *upage = (uint8_t *) begin_upage + pg * PGSIZE;
+            struct spte *spte = spt_find (upage);
+            struct filesys_info *info;
+
+            if (spte == NULL || spte->type != MMAP)
+                continue;
+            info = &spte->disk_info.filesys_info;
+
+            /* Pinned so the run stays resident until it is written. */
+            frame_page_lock (pd, upage);
+            if (spte->in_memory && pagedir_is_dirty (pd, upage)
+                && frame_pin (upage))
+                {
+                    if (run_cnt > 0
+                        && (info->file != run_file
+                            || info->ofs != run_ofs + run_cnt * PGSIZE
+                            || upage != run_start + run_cnt * PGSIZE))
+                        {
+                            flush_run (run_file, run_ofs, run_start, run_cnt);
+                            run_cnt = 0;
                         }
-                    frame_free_page (cur_upage);
+                    if (run_cnt == 0)
+                        {
+                            run_file = info->file;
+                            run_ofs = info->ofs;
+                            run_start = upage;
+                        }
+                    run_cnt++;
                 }
-            else if (!spte->filesys_page)
-                    swap_free (spte->disk_info.swap_id);
-            hash_delete (spt, &spte->hash_elem);
-            free (spte);
+            frame_page_unlock (pd, upage);
         }
+    if (run_cnt > 0)
+        flush_run (run_file, run_ofs, run_start, run_cnt);
+}
+
+/* Writes the PG_CNT pinned pages starting at user page START to
+   FILE at offset OFS, then marks them clean and unpins them. */
+static void
+flush_run (struct file *file, off_t ofs, uint8_t *start, int pg_cnt)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+
+    write_mapped (file, start, pg_cnt * PGSIZE, ofs);
+    for (int pg = 0; pg < pg_cnt; pg++)
+        {
+            pagedir_set_dirty (pd, start + pg * PGSIZE, false);
+            frame_unpin (start + pg * PGSIZE);
+        }
+}
+
+/* Writes the SIZE bytes at BUFFER, pages of a mapping of FILE, to
+   FILE at offset OFS, but only up to the end of the file.  Bytes of
+   a mapping past the end of its file are discarded rather than
+   written, since a write there would extend the file. */
+static void
+write_mapped (struct file *file, const void *buffer, off_t size, off_t ofs)
+{
+    off_t length = file_length (file);
+
+    if (ofs >= length)
+        return;
+    if (size > length - ofs)
+        size = length - ofs;
+    file_write_at (file, buffer, size, ofs);
 }
 
 /* Loading the current thread's virtual page UPAGE into the frame KPAGE
-   using information from the current thread's supplementary page table. */
+   using information from the current thread's supplementary page table.
+   WRITE says whether the fault was a write, which decides whether a
+   ZERO page needs a frame of its own yet. */
 bool
-spt_load_upage (void *upage)
+spt_load_upage (void *upage, bool write)
 {
     ASSERT (pg_ofs (upage) == 0);
 
@@ -165,12 +400,18 @@ spt_load_upage (void *upage)
     struct spte *spte;
     union disk_info disk_info;
 
-    kpage = frame_get_page (PAL_USER | PAL_ZERO);
+    /* Not PAL_ZERO: install_file() and swap_try_read() overwrite
+       the whole frame. */
+    if (load_shared_text (upage) || (!write && load_zero_page (upage)))
+        return true;
+    kpage = frame_get_page (PAL_USER);
 
     pd = thread_current ()->pagedir;
+    /* Wait out any eviction of this page still writing it out. */
+    frame_page_lock (pd, upage);
     pagedir_clear_page (pd, upage);
 
-    spte = spt_find (upage);
+    spte = spt_lookup (upage);
     if (spte == NULL)
         goto fail;
 
@@ -183,67 +424,335 @@ spt_load_upage (void *upage)
     
     disk_info = spte->disk_info;
     /* Assuming it is a page now. */
-    if (spte->filesys_page)
+    if (spte->type == ZERO)
+        memset (kpage, 0, PGSIZE);
+    else if (spte->filesys_page)
         {
             if (!install_file (kpage, disk_info.filesys_info))
                 goto fail;
         }
     else
         {
-            if (!swap_try_read (disk_info.swap_id, upage))
+            /* After a read fault keep the slot, so that the page need
+               not be written again if it is evicted still clean. */
+            if (!swap_try_read (disk_info.swap_id, upage, !write))
                 goto fail;
+            spte->swap_kept = !write;
+            thread_current ()->process->rusage.swap_ins++;
         }
 
     pagedir_set_accessed (pd, upage, true);
     pagedir_set_dirty (pd, upage, false);
 
     frame_set_udata (kpage, upage, pd, spte);
+    if (is_shared_text (spte))
+        frame_set_text (kpage, text_sector (spte),
+                        disk_info.filesys_info.ofs,
+                        disk_info.filesys_info.page_read_bytes,
+                        spte->type == MMAP);
     spte->in_memory = true;
+    spte->cow = false;
+    frame_page_unlock (pd, upage);
+
+    if (spte->filesys_page || spte->type == ZERO)
+        read_ahead (upage, spte);
     return true;
 
     fail:
+        frame_page_unlock (pd, upage);
         frame_free_page (kpage);
         return false;
 }
 
-/* This is not a complete funciton but more to demonstrate the logic for
-   eviction once an evicted page has been selected by our eviction
-   algorithm. After this function we would write over the upage. */
-void 
-spt_evict_upage (void *upage)
+/* Returns true if SPTE's page goes in the page cache: a read-only
+   page of an executable, which processes running the same
+   executable can share, or a page of a mapped file, which every
+   mapping of it shares. */
+static bool
+is_shared_text (const struct spte *spte)
 {
+    return spte->filesys_page
+           && (spte->type == MMAP
+               || (spte->type == EXEC
+                   && !spte->disk_info.filesys_info.writable));
+}
 
-    struct thread * cur = thread_current ();
-    struct spte *spte = spt_find (upage);
-    if (spte == NULL)
+/* Returns the inode sector of the file SPTE's page is read from. */
+static block_sector_t
+text_sector (const struct spte *spte)
+{
+    return inode_get_inumber (file_get_inode (
+                                spte->disk_info.filesys_info.file));
+}
+
+/* Maps the current thread's user page UPAGE to a frame already
+   holding the same executable text page or mapped file page for
+   another mapping, if its spte is shared text and there is one.
+   Returns true if successful, false if the page must be read in. */
+static bool
+load_shared_text (void *upage)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+    struct filesys_info *info;
+    struct spte *spte;
+    void *kpage;
+    bool success = false;
+
+    frame_page_lock (pd, upage);
+    spte = spt_lookup (upage);
+    if (spte != NULL && !spte->in_memory && is_shared_text (spte))
+        {
+            info = &spte->disk_info.filesys_info;
+            kpage = frame_share_text (text_sector (spte), info->ofs,
+                                      info->page_read_bytes,
+                                      spte->type == MMAP, pd, upage, spte);
+            if (kpage != NULL)
+                {
+                    if (pagedir_set_page (pd, upage, kpage,
+                                          spte->type == MMAP))
+                        {
+                            pagedir_set_accessed (pd, upage, true);
+                            spte->in_memory = true;
+                            spte->cow = false;
+                            success = true;
+                        }
+                    else
+                        frame_release (kpage, pd);
+                }
+        }
+    frame_page_unlock (pd, upage);
+    return success;
+}
+
+/* Maps those of the current thread's PG_CNT pages starting at START,
+   read-only executable pages, that other processes running the same
+   executable already have resident, so that a program run again and
+   again takes no page faults on its hot text. Pages not resident
+   elsewhere are left to be loaded on first use, without an spte. */
+void
+spt_map_text (void *start, size_t pg_cnt)
+{
+    struct vma *vma = vma_find (start);
+    struct filesys_info info;
+    block_sector_t sector;
+
+    if (vma == NULL || vma->type != EXEC || vma->writable)
         return;
-    
+    sector = inode_get_inumber (file_get_inode (vma->file));
+    for (size_t pg = 0; pg < pg_cnt; pg++)
+        {
+            uint8_t *upage = (uint8_t *) start + pg * PGSIZE;
+
+            vma_page_info (vma, upage, &info);
+            if (info.page_read_bytes > 0
+                && frame_has_text (sector, info.ofs, info.page_read_bytes))
+                load_shared_text (upage);
+        }
+}
+
+/* Maps the current thread's user page UPAGE read-only to the shared
+   zero page if its spte is a ZERO page that is not resident. The
+   first write then takes a copy-on-write fault. Returns true if
+   successful. */
+static bool
+load_zero_page (void *upage)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+    struct spte *spte;
+    bool success = false;
+
+    frame_page_lock (pd, upage);
+    spte = spt_lookup (upage);
+    if (spte != NULL && spte->type == ZERO && !spte->in_memory
+        && pagedir_set_page (pd, upage, zero_page, false))
+        {
+            spte->in_memory = true;
+            spte->cow = true;
+            success = true;
+        }
+    frame_page_unlock (pd, upage);
+    return success;
+}
+
+/* Evicts the page described by SPTE, which is mapped in page
+   directory PD and held in the frame KPAGE. The page is unmapped
+   first so its owner cannot dirty it while it is being written
+   out, then its contents are saved wherever SPTE says they belong.
+   The owner need not be the current thread. After this function
+   the frame may be written over. Returns true if the page was
+   written to swap. */
+bool
+spt_evict_upage (uint32_t *pd, struct spte *spte, void *kpage)
+{
+    bool swapped;
+
+    spt_evict_upages (&pd, &spte, &kpage, 1, &swapped);
+    return swapped;
+}
+
+/* Evicts CNT pages at once, at most SWAP_CLUSTER, as if by
+   spt_evict_upage (PDS[I], SPTES[I], KPAGES[I]) for each. The pages
+   that go to swap are given adjacent slots where possible and
+   written out together. Sets SWAPPED[I] to whether page I went to
+   swap. */
+void
+spt_evict_upages (uint32_t *const pds[], struct spte *const sptes[],
+                  void *const kpages[], size_t cnt, bool swapped[])
+{
+    void *swap_pages[SWAP_CLUSTER];
+    void *swap_owners[SWAP_CLUSTER];
+    struct spte *swap_sptes[SWAP_CLUSTER];
+    size_t swap_ids[SWAP_CLUSTER];
+    size_t swap_cnt = 0;
+    size_t i;
+
+    ASSERT (cnt <= SWAP_CLUSTER);
+
+    for (i = 0; i < cnt; i++)
+        if ((swapped[i] = unmap_for_eviction (pds[i], sptes[i], kpages[i])))
+            {
+                swap_pages[swap_cnt] = kpages[i];
+                swap_owners[swap_cnt] = pds[i];
+                swap_sptes[swap_cnt++] = sptes[i];
+            }
+    evict_cnt += cnt;
+    trace (TRACE_EVICT, cnt, swap_cnt, 0, 0);
+    if (swap_cnt == 0)
+        return;
+    swap_write_cluster (swap_pages, swap_owners, swap_cnt, swap_ids);
+    for (i = 0; i < swap_cnt; i++)
+        swap_sptes[i]->disk_info.swap_id = swap_ids[i];
+}
+
+/* Fills in the eviction count in STATS. */
+void
+spt_get_stats (struct sysstat *stats)
+{
+    stats->evictions = evict_cnt;
+}
+
+/* Unmaps the page described by SPTE, mapped in page directory PD
+   and held in the frame KPAGE, for eviction and writes it back to
+   its file if it must be. Returns true if the caller must write it
+   to swap and record its slot in SPTE. */
+static bool
+unmap_for_eviction (uint32_t *pd, struct spte *spte, void *kpage)
+{
+    void *upage = spte->upage;
+    enum intr_level old_level;
+    bool to_swap = false;
+    bool dirty;
+
     ASSERT (spte->in_memory);
+
+    /* Once the page is unmapped the owner may exit and free PD, so
+       read the dirty bit without being preempted in between. */
+    old_level = intr_disable ();
+    pagedir_clear_page (pd, upage);
+    dirty = pagedir_is_dirty (pd, upage);
+    intr_set_level (old_level);
     switch (spte->type)
     {
-        case (MMAP):
-            /* Only need to write if MMAP is written. */
-            if (pagedir_is_dirty(cur->pagedir, upage))
+        case (ZERO):
+            /* A page never written reads back as zeroes. */
+            if (dirty)
                 {
-                    /* Write back to memory. */
-                    lock_acquire (&filesys_lock);
-                    file_write_at (spte->disk_info.filesys_info.file, upage,
-                                   PGSIZE, spte->disk_info.filesys_info.ofs);
-                    lock_release (&filesys_lock);
+                    spte->type = TMP;
+                    to_swap = true;
                 }
             break;
+        case (MMAP):
+            /* Only need to write if MMAP is written. */
+            if (dirty)
+                write_mapped (spte->disk_info.filesys_info.file, kpage,
+                              PGSIZE, spte->disk_info.filesys_info.ofs);
+            break;
         case (EXEC):
             /* If an executable page has never been written to, do nothing.
                Otherwise write to swap. */
             if (spte->filesys_page && (!spte->disk_info.filesys_info.writable ||
-                !pagedir_is_dirty(cur->pagedir, upage)))
+                !dirty))
                 break;
         default:
             spte->filesys_page = false; 
-            spte->disk_info.swap_id = swap_write (upage);
+            if (spte->swap_kept)
+                {
+                    /* A clean page is still in its slot. */
+                    spte->swap_kept = false;
+                    if (!dirty)
+                        break;
+                    swap_free (spte->disk_info.swap_id);
+                }
+            to_swap = true;
             break;
     }
     spte->in_memory = false;
+    return to_swap;
+}
+
+/* Returns true if evicting the page described by SPTE, mapped in
+   page directory PD, would have to write it out first, following
+   the same rules as spt_evict_upage(). */
+bool
+spt_needs_writeback (uint32_t *pd, struct spte *spte)
+{
+    bool dirty = pagedir_is_dirty (pd, spte->upage);
+
+    switch (spte->type)
+    {
+        case (ZERO):
+        case (MMAP):
+            return dirty;
+        case (EXEC):
+            if (spte->filesys_page && (!spte->disk_info.filesys_info.writable ||
+                !dirty))
+                return false;
+            return !spte->swap_kept || dirty;
+        default:
+            return !spte->swap_kept || dirty;
+    }
+}
+
+/* Writes the page described by SPTE, mapped in page directory PD
+   and held in frame KPAGE, out to its swap slot or file if evicting
+   it would have to, while it stays mapped, so that a later eviction
+   needs no I/O. The caller must hold the page's page lock. The
+   dirty bit is cleared before the write, so that a store made
+   during it leaves the page dirty, to be written again. */
+void
+spt_clean_upage (uint32_t *pd, struct spte *spte, void *kpage)
+{
+    ASSERT (spte->in_memory);
+
+    if (!spt_needs_writeback (pd, spte))
+        return;
+    pagedir_set_dirty (pd, spte->upage, false);
+    if (spte->type == MMAP)
+        {
+            write_mapped (spte->disk_info.filesys_info.file, kpage, PGSIZE,
+                          spte->disk_info.filesys_info.ofs);
+            return;
+        }
+
+    /* Like unmap_for_eviction(), the page now lives in swap. */
+    if (spte->type == ZERO)
+        spte->type = TMP;
+    spte->filesys_page = false;
+    if (spte->swap_kept)
+        swap_free (spte->disk_info.swap_id);
+    spte->disk_info.swap_id = swap_write (kpage, pd);
+    spte->swap_kept = true;
+}
+
+/* Drops SPTE, which is about to be freed, from the current thread's
+   cache of recently found entries. */
+static void
+spt_forget (struct spte *spte)
+{
+    struct spte **slot = &thread_current ()->process->spte_cache[
+        pg_no (spte->upage) % SPTE_CACHE_CNT];
+    if (*slot == spte)
+        *slot = NULL;
 }
 
 /* Looks up UPAGE page in a supplemental page table HASH.
@@ -251,31 +760,424 @@ spt_evict_upage (void *upage)
 struct spte *
 spt_find (void *upage)
 {
-  struct spte spte;
-  struct hash_elem *e;
+  struct thread *t = thread_current ()->process;
+  struct spte **slot = &t->spte_cache[pg_no (upage) % SPTE_CACHE_CNT];
+  struct spte key, *spte;
+
+  if (*slot != NULL && (*slot)->upage == upage)
+    return *slot;
+
+  key.upage = upage;
+  spte = ohash_find (&t->spt, &key);
+  if (spte != NULL)
+    *slot = spte;
+  return spte;
+}
+
+/* Like spt_find(), but if UPAGE has no spte yet and lies in one of
+   the current thread's virtual memory areas, creates its spte from
+   the area first. Returns NULL if UPAGE is not part of the address
+   space or memory is short. */
+struct spte *
+spt_lookup (void *upage)
+{
+  struct spte *spte = spt_find (upage);
+  union disk_info disk_info;
+  struct vma *vma;
 
-  spte.upage = upage;
-  e = hash_find (&thread_current ()->spt, &spte.hash_elem);
-  return e != NULL ? hash_entry (e, struct spte, hash_elem) : NULL;
+  if (spte != NULL)
+    return spte;
+  vma = vma_find (upage);
+  if (vma == NULL)
+    return NULL;
+  vma_page_info (vma, upage, &disk_info.filesys_info);
+  if (disk_info.filesys_info.page_read_bytes == 0
+      && disk_info.filesys_info.writable)
+    {
+      /* Whole page of BSS. */
+      if (!spt_try_add_upage (upage, ZERO, false, false, &disk_info))
+        return NULL;
+    }
+  else if (!spt_try_add_upage (upage, vma->type, false, true, &disk_info))
+    return NULL;
+  return spt_find (upage);
 }
 
 /* Returns a hash value for a spte P. */
 unsigned
-spt_hash (const struct hash_elem *p_, void *aux UNUSED)
+spt_hash (const void *p_, void *aux UNUSED)
 {
-  const struct spte *spte = hash_entry (p_, struct spte, hash_elem);
-  return hash_int ((unsigned)spte->upage);
+  const struct spte *spte = p_;
+  return hash_int (pg_no (spte->upage));
 }
 
-/* Returns true if a spte A_ precedes spte B_. */
+/* Returns true if sptes A_ and B_ map the same page. */
 bool
-spt_less (const struct hash_elem *a_, const struct hash_elem *b_,
-           void *aux UNUSED)
+spt_equal (const void *a_, const void *b_, void *aux UNUSED)
 {
-  const struct spte *a = hash_entry (a_, struct spte, hash_elem);
-  const struct spte *b = hash_entry (b_, struct spte, hash_elem);
-  
-  return a->upage < b->upage;
+  const struct spte *a = a_;
+  const struct spte *b = b_;
+
+  return a->upage == b->upage;
+}
+
+/* Handles a write fault on the current thread's present page
+   UPAGE. If the page is mapped copy-on-write, gives the thread its
+   own writable copy, or simply makes the page writable again if no
+   one else shares its frame any more, and returns true. Returns
+   false if the page is not copy-on-write. */
+bool
+spt_cow_fault (void *upage)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+    struct spte *spte = spt_find (upage);
+    void *kpage, *copy = NULL;
+
+    if (spte == NULL || !spte->cow)
+        return false;
+
+    for (;;)
+        {
+            frame_page_lock (pd, upage);
+            kpage = pagedir_get_page (pd, upage);
+            if (kpage == NULL || !is_shared (kpage) || copy != NULL)
+                break;
+            /* The page lock must not be held across frame_get_page(). */
+            frame_page_unlock (pd, upage);
+            copy = frame_get_page (PAL_USER);
+        }
+
+    if (kpage == NULL)
+        {
+            /* Evicted once no longer shared: fault it back in. */
+            frame_page_unlock (pd, upage);
+            if (copy != NULL)
+                frame_free_page (copy);
+            return true;
+        }
+
+    if (is_shared (kpage))
+        {
+            memcpy (copy, kpage, PGSIZE);
+            pagedir_clear_page (pd, upage);
+            frame_release (kpage, pd);
+            pagedir_set_page (pd, upage, copy, true);
+            pagedir_set_dirty (pd, upage, true);
+            frame_set_udata (copy, upage, pd, spte);
+        }
+    else
+        {
+            pagedir_set_writable (pd, upage, true);
+            if (copy != NULL)
+                frame_free_page (copy);
+        }
+    spte->cow = false;
+    frame_page_unlock (pd, upage);
+    return true;
+}
+
+/* Returns true if the frame at kernel virtual page KPAGE is mapped
+   more than once, so it must be copied before it is written. */
+static bool
+is_shared (void *kpage)
+{
+    return kpage == zero_page || frame_is_shared (kpage);
+}
+
+/* Shares the frame holding PARENT_SPTE's page in page directory
+   PARENT_PD with the current thread, mapping it at the same address
+   for CHILD_SPTE. A page of a mapped file stays shared, writable by
+   both; any other writable page becomes read-only and copy-on-write
+   for both. The caller must hold the parent page's page lock, so
+   that the page cannot be evicted after it was found resident.
+   Returns false if memory is short. */
+static bool
+share_page (uint32_t *parent_pd, struct spte *parent_spte,
+            struct spte *child_spte)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+    void *upage = parent_spte->upage;
+    bool mmap = parent_spte->type == MMAP && !parent_spte->cow;
+    void *kpage;
+    bool success = false;
+
+    kpage = pagedir_get_page (parent_pd, upage);
+    if (kpage == zero_page)
+        {
+            success = pagedir_set_page (pd, upage, kpage, false);
+            child_spte->cow = true;
+        }
+    else if (kpage != NULL && pagedir_set_page (pd, upage, kpage, mmap))
+        {
+            if (frame_share (kpage, pd, upage, child_spte))
+                {
+                    if (!mmap && pagedir_is_writable (parent_pd, upage))
+                        {
+                            pagedir_set_writable (parent_pd, upage, false);
+                            parent_spte->cow = child_spte->cow = true;
+                        }
+                    pagedir_set_dirty (pd, upage,
+                                       pagedir_is_dirty (parent_pd, upage));
+                    success = true;
+                }
+            else
+                pagedir_clear_page (pd, upage);
+        }
+    return success;
+}
+
+/* Copies the supplementary page table of PARENT, which must be
+   blocked, into the current thread for fork. Resident pages share
+   their frame with the parent copy-on-write, swapped pages get a
+   swap slot of their own, and pages still in a file are pointed at
+   the current thread's copy of that file, so the areas must have
+   been copied already. Returns false if memory is short. */
+bool
+spt_copy (struct thread *parent)
+{
+    struct ohash_iterator i;
+    struct spte *p;
+
+    ohash_first (&i, &parent->spt);
+    while ((p = ohash_next (&i)) != NULL)
+        {
+            union disk_info disk_info;
+            struct spte *c;
+            bool success;
+
+            /* The pageout daemon may still evict the parent's pages,
+               so look at each one only under its page lock. */
+            frame_page_lock (parent->pagedir, p->upage);
+            disk_info = p->disk_info;
+
+            if (p->filesys_page)
+                {
+                    struct vma *vma = vma_find (p->upage);
+                    if (vma != NULL)
+                        disk_info.filesys_info.file = vma->file;
+                }
+            else if (!p->in_memory && p->type != ZERO)
+                disk_info.swap_id = swap_copy (p->disk_info.swap_id,
+                                               thread_current ()->pagedir);
+
+            success = spt_try_add_upage (p->upage, p->type, p->in_memory,
+                                         p->filesys_page, &disk_info);
+            if (success && p->in_memory)
+                {
+                    c = spt_find (p->upage);
+                    success = share_page (parent->pagedir, p, c);
+                }
+            frame_page_unlock (parent->pagedir, p->upage);
+            if (!success)
+                return false;
+        }
+    return true;
+}
+
+/* Reads ahead after a fault on file-backed or untouched anonymous
+   page UPAGE described by SPTE: maps in following pages of the
+   current thread that come from the same file, or are untouched
+   anonymous pages too, and are not yet resident, as far as the
+   read-ahead window allows. Stops at the first page that does not
+   qualify or when no frame is free, since evicting to read ahead
+   would only throw out pages that are more likely to be used. */
+static void
+read_ahead (void *upage, struct spte *spte)
+{
+    struct thread *t = thread_current ();
+    bool zero = spte->type == ZERO;
+    struct file *file = zero ? NULL : spte->disk_info.filesys_info.file;
+    struct vma *vma = vma_find (upage);
+    unsigned i;
+
+    if (vma != NULL && vma->advice == MADV_RANDOM)
+        return;
+    if (vma != NULL && vma->advice == MADV_SEQUENTIAL)
+        t->ra_window = RA_MAX;
+    else if (upage == t->ra_next)
+        t->ra_window = t->ra_window == 0 ? 1 : t->ra_window * 2;
+    else
+        t->ra_window /= 2;
+    if (t->ra_window > RA_MAX)
+        t->ra_window = RA_MAX;
+    /* Any fault on the page after this one counts as sequential. */
+    if (t->ra_window == 0)
+        {
+            t->ra_next = upage + PGSIZE;
+            return;
+        }
+
+    for (i = 1; i <= t->ra_window; i++)
+        {
+            void *next = upage + i * PGSIZE;
+            struct spte *s = spt_lookup (next);
+
+            if (s == NULL || s->in_memory
+                || (zero ? s->type != ZERO
+                         : !s->filesys_page
+                           || s->disk_info.filesys_info.file != file)
+                || !prefetch (next, s))
+                break;
+        }
+    t->ra_next = upage + i * PGSIZE;
+}
+
+/* Reads the current thread's file-backed page UPAGE, described by
+   SPTE and not resident, into a free frame without marking it
+   accessed, or gives it a zeroed frame if it is an untouched
+   anonymous page. Until written, such a frame is dropped rather
+   than swapped out if evicted. Returns false if no frame is free or
+   the read fails. */
+static bool
+prefetch (void *upage, struct spte *spte)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+    bool zero = spte->type == ZERO;
+    void *kpage;
+    bool writable = true;
+
+    if (!zero && load_shared_text (upage))
+        return true;
+    kpage = frame_get_free_page (PAL_USER | (zero ? PAL_ZERO : 0));
+    if (kpage == NULL)
+        return false;
+
+    if (spte->type == EXEC)
+        writable = spte->disk_info.filesys_info.writable;
+    frame_page_lock (pd, upage);
+    if ((!zero && !install_file (kpage, spte->disk_info.filesys_info))
+        || !pagedir_set_page (pd, upage, kpage, writable))
+        {
+            frame_page_unlock (pd, upage);
+            frame_free_page (kpage);
+            return false;
+        }
+    /* Not accessed yet, so the clock may take it back first. */
+    pagedir_set_accessed (pd, upage, false);
+    pagedir_set_dirty (pd, upage, false);
+    frame_set_udata (kpage, upage, pd, spte);
+    if (is_shared_text (spte))
+        frame_set_text (kpage, text_sector (spte),
+                        spte->disk_info.filesys_info.ofs,
+                        spte->disk_info.filesys_info.page_read_bytes,
+                        spte->type == MMAP);
+    spte->in_memory = true;
+    spte->cow = false;
+    frame_page_unlock (pd, upage);
+    frame_loaded (upage);
+    return true;
+}
+
+/* Moves the current thread's heap break by INCREMENT bytes and
+   returns the old break, or (void *) -1 if the heap would shrink
+   below its start, run into the stack area or overlap a mapping. New
+   heap pages are ZERO pages, so they cost nothing until touched. */
+void *
+spt_sbrk (intptr_t increment)
+{
+    struct thread *t = thread_current ()->process;
+    uint8_t *old_brk = t->brk;
+    uint8_t *new_brk = old_brk + increment;
+    uint8_t *old_top = pg_round_up (old_brk);
+    uint8_t *new_top = pg_round_up (new_brk);
+    union disk_info empty_disk_info;
+
+    if (increment < 0 ? new_brk < t->heap_start || new_brk > old_brk
+                      : new_brk < old_brk
+                        || new_top > STACK_LIMIT)
+        return (void *) -1;
+
+    if (new_top > old_top)
+        {
+            size_t pg_cnt = (new_top - old_top) / PGSIZE;
+            size_t i;
+
+            if (vma_overlaps (old_top, pg_cnt))
+                return (void *) -1;
+            for (i = 0; i < pg_cnt; i++)
+                if (spt_find (old_top + i * PGSIZE) != NULL)
+                    return (void *) -1;
+            for (i = 0; i < pg_cnt; i++)
+                if (!spt_try_add_upage (old_top + i * PGSIZE, ZERO, false,
+                                        false, &empty_disk_info))
+                    {
+                        spt_remove_upages (old_top, i);
+                        return (void *) -1;
+                    }
+        }
+    else if (new_top < old_top)
+        spt_remove_upages (new_top, (old_top - new_top) / PGSIZE);
+
+    t->brk = new_brk;
+    return old_brk;
+}
+
+/* Reads those of the current thread's PG_CNT pages starting at
+   START that are file-backed and not resident into free frames, as
+   far as there are free frames, so that they take no page faults. */
+void
+spt_prefetch (void *start, size_t pg_cnt)
+{
+    size_t i;
+
+    for (i = 0; i < pg_cnt; i++)
+        {
+            void *upage = (uint8_t *) start + i * PGSIZE;
+            struct spte *spte = spt_lookup (upage);
+
+            if (spte != NULL && !spte->in_memory
+                && spte->filesys_page && !prefetch (upage, spte))
+                break;
+        }
+}
+
+/* Applies madvise() advice ADVICE to the current thread's PG_CNT
+   pages starting at START. MADV_NORMAL, MADV_RANDOM and
+   MADV_SEQUENTIAL set the read-ahead policy of the file-backed areas
+   there, MADV_WILLNEED reads in what file-backed pages fit in free
+   frames, and MADV_DONTNEED evicts the resident pages, writing them
+   out first as eviction would. Returns false for unknown advice. */
+bool
+spt_advise (void *start, size_t pg_cnt, int advice)
+{
+    uint32_t *pd = thread_current ()->pagedir;
+    size_t i;
+
+    switch (advice)
+    {
+        case MADV_NORMAL:
+        case MADV_RANDOM:
+        case MADV_SEQUENTIAL:
+            vma_set_advice (start, pg_cnt, advice);
+            return true;
+        case MADV_WILLNEED:
+            spt_prefetch (start, pg_cnt);
+            return true;
+        case MADV_DONTNEED:
+            for (i = 0; i < pg_cnt; i++)
+                {
+                    void *upage = (uint8_t *) start + i * PGSIZE;
+                    struct spte *spte = spt_find (upage);
+                    void *kpage;
+
+                    if (spte == NULL || !spte->in_memory)
+                        continue;
+                    kpage = pagedir_get_page (pd, upage);
+                    if (kpage == zero_page)
+                        {
+                            frame_page_lock (pd, upage);
+                            pagedir_clear_page (pd, upage);
+                            spte->in_memory = false;
+                            spte->cow = false;
+                            frame_page_unlock (pd, upage);
+                        }
+                    else if (kpage != NULL)
+                        frame_evict (kpage);
+                }
+            return true;
+        default:
+            return false;
+    }
 }
 
 static bool
@@ -285,12 +1187,13 @@ install_file (void *upage, struct filesys_info filesys_info)
         memset (upage, 0, PGSIZE);
     else
         {
+            struct inode *inode = file_get_inode (filesys_info.file);
             size_t page_zero_bytes;
-            /* Don't have locking here because from a page fault we will
-               already have the lock */
-            int bytes_read = file_read_at (filesys_info.file, upage, 
-                                           filesys_info.page_read_bytes,
-                                           filesys_info.ofs);
+            /* The frame keeps the data, so it need not stay in the
+               buffer cache as well. */
+            int bytes_read = inode_read_direct (inode, upage,
+                                                filesys_info.page_read_bytes,
+                                                filesys_info.ofs);
 
             if (bytes_read != (int) filesys_info.page_read_bytes)
                 return false;
@@ -1,13 +1,21 @@
 #ifndef VM_PAGE_H
 #define VM_PAGE_H
 
-#include <hash.h>
+#include <debug.h>
+#include <ohash.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/off_t.h"
+#include "threads/vaddr.h"
+
+struct thread;
 
 /* User stack limited to 1MB. */
 #define MAX_STACK_SIZE 1024 * 1024
 
+/* Lowest address the stack may grow down to. */
+#define STACK_LIMIT ((uint8_t *) PHYS_BASE - MAX_STACK_SIZE)
+
 /* The type of page that the supplementary page table entry represents.
    Used when deciding where to write to memory and what to clean up when
    evicting and removing pages from the spt.
@@ -18,12 +26,18 @@
         is dirty. Otherwise they are just read from filesys.
         - TMP data is local data to the user process e.g. the stack.
         It is stored in SWAP whenever evicted / before lazy loading and
-        discarded once the process exits. */
+        discarded once the process exits.
+        - ZERO pages are anonymous pages that have never been written,
+        such as fresh stack pages and whole pages of BSS. They read as
+        zeroes without touching swap or the filesys, and until first
+        written are mapped to one shared zero page. Once evicted dirty
+        they become TMP. */
 enum page_type
     {
         EXEC,                       /* An executable file's page. */
         MMAP,                       /* A memory mapped page. */
         TMP,                        /* A temporary page such as the stack. */
+        ZERO,                       /* A page still all zeroes. */
     };
 
 
@@ -65,7 +79,8 @@ union disk_info
    recently stored (depending on whether it is currently `in_memory` or not).
    `disk_info` is the pertinent information to load a page from disk and is 
    interpreted based on the `type` of page it is and what the `filesys_page`
-   bit. Finally the `hash_elem` is the element of the supplementary page table
+   bit. The supplementary page table holds pointers to its sptes, so
+   they embed no table element.
    */
 
 struct spte
@@ -77,20 +92,41 @@ struct spte
         bool filesys_page;              /* If stored in filesys. */
         union disk_info disk_info;      /* Info how to read and  write to 
                                            disk */
-        struct hash_elem hash_elem;     /* Page Table hash elem. */
+        bool cow;                       /* Mapped read-only in a frame
+                                           shared copy-on-write, or to
+                                           the zero page. */
+        bool swap_kept;                 /* Resident, and the slot in
+                                           disk_info still holds a copy
+                                           of the page. */
     };
 
+struct sysstat;
+
+void spt_init (void);
+bool spt_lock (void);
+void spt_unlock (bool locked);
 bool spt_try_add_upage (void *upage, enum page_type type, bool in_memory,
                         bool filesys_page, union disk_info *disk_info);
-bool spt_try_add_mmap_pages (void *begin_upage, struct file *fp, int pg_cnt,
-                            size_t final_read_bytes);
 bool spt_try_add_stack_page (void *upage);
 void spt_remove_upages (void * begin_upage, int num_pages);
-void spt_evict_upage (void *upage);
-bool spt_load_upage (void *upage);
+void spt_destroy (struct thread *process, uint32_t *pd);
+bool spt_evict_upage (uint32_t *pd, struct spte *spte, void *kpage);
+void spt_evict_upages (uint32_t *const pds[], struct spte *const sptes[],
+                       void *const kpages[], size_t cnt, bool swapped[]);
+bool spt_needs_writeback (uint32_t *pd, struct spte *spte);
+void spt_clean_upage (uint32_t *pd, struct spte *spte, void *kpage);
+bool spt_load_upage (void *upage, bool write);
+bool spt_cow_fault (void *upage);
+bool spt_copy (struct thread *parent);
+void spt_flush_upages (void *begin_upage, int num_pages);
+bool spt_advise (void *start, size_t pg_cnt, int advice);
+void spt_map_text (void *start, size_t pg_cnt);
+void spt_prefetch (void *start, size_t pg_cnt);
+void *spt_sbrk (intptr_t increment);
 struct spte * spt_find (void *upage);
-unsigned spt_hash (const struct hash_elem *p_, void *aux UNUSED);
-bool spt_less (const struct hash_elem *a_, const struct hash_elem *b_,
-                void *aux UNUSED);
+struct spte * spt_lookup (void *upage);
+unsigned spt_hash (const void *p_, void *aux UNUSED);
+bool spt_equal (const void *a_, const void *b_, void *aux UNUSED);
+void spt_get_stats (struct sysstat *);
 
 #endif /* vm/page.h */
\ No newline at end of file
@@ -1,66 +1,898 @@
 #include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sysstat.h>
 #include "devices/block.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 
-/* Mutual exclusion of table and block_sector. */
+/* Mutual exclusion of the slot tables. Not held across I/O: a slot
+   belongs to one page from allocation until it is freed. */
 struct lock swap_lock;
-/* Bitmap of free slots in swap device. */  
+/* Bitmap of slots in use on all swap devices, one bit per slot. */
 struct bitmap *used_map;
-/* Block device interface. */
-struct block * swap_block;
+
+/* Free space is tracked in clusters of SWAP_CLUSTER adjacent slots
+   so that a batch of evicted pages can be given adjacent slots and
+   written with one request. Clusters with no slot in use sit on a
+   stack; the free slots of the other clusters, and of the few slots
+   past the last whole cluster, are on a doubly linked list. Every
+   operation touches at most one cluster's worth of slots, so takes
+   constant time however full swap is.
+
+   The slots of all swap devices are numbered in one space, each
+   device's starting on a cluster boundary, and each device has its
+   own cluster stack and loose slot list. New slots come from the
+   devices of highest priority that have room, taken in turn, so
+   that devices on separate channels share the load. */
+#define NO_SLOT UINT32_MAX
+#define SWAP_DEV_MAX 4
+
+struct swap_dev
+    {
+        struct block *block;            /* Block device. */
+        int priority;                   /* Higher is used first. */
+        uint32_t base;                  /* First slot. */
+        block_sector_t skip;            /* Sectors before the first. */
+        size_t slot_cnt;                /* Slots on the device. */
+        size_t cluster_cnt;             /* Whole clusters. */
+        uint32_t *free_clusters;        /* Stack of empty clusters. */
+        size_t free_cluster_cnt;        /* Number on free_clusters. */
+        uint32_t slot_head;             /* First loose free slot. */
+        size_t used_cnt;                /* Slots in use. */
+        size_t peak_cnt;                /* Most slots ever in use. */
+        unsigned long long read_cnt;    /* Pages read. */
+        unsigned long long write_cnt;   /* Pages written. */
+    };
+static struct swap_dev devs[SWAP_DEV_MAX];
+static size_t dev_cnt;
+static size_t dev_rotor;                /* Device last allocated from. */
+
+/* Swap regions. So that one address space's pages sit together on
+   the device and read-ahead at swap-in finds them, the clusters a
+   cluster write takes come from a region reserved for the owner of
+   its first page: a run of adjacent empty clusters, taken off the
+   device's stack and handed out in increasing order. A region
+   that runs out grows by an extent twice the size of the last, up
+   to REGION_MAX clusters, right after its end if those clusters
+   are still empty or else wherever the next empty cluster is.
+   Regions are kept for the REGION_CNT owners that wrote to swap
+   most recently; the clusters a region has not handed out go back
+   to the stack when its owner exits, when it is replaced, or when
+   swap runs out of empty clusters. */
+#define REGION_CNT 16                   /* Owners with a region. */
+#define REGION_MIN 2                    /* Clusters in a first extent. */
+#define REGION_MAX 32                   /* Most clusters in an extent. */
+
+struct swap_region
+    {
+        void *owner;                    /* Address space, null if free. */
+        struct swap_dev *dev;           /* Device of the clusters. */
+        uint32_t next;                  /* Next cluster to hand out. */
+        uint32_t end;                   /* End of the reserved clusters. */
+        size_t extent;                  /* Clusters in the last extent. */
+        unsigned long long used;        /* region_clock when last used. */
+    };
+static struct swap_region regions[REGION_CNT];
+static unsigned long long region_clock; /* Cluster writes so far. */
+static unsigned long long region_hits;  /* Clusters taken from regions. */
+
+static size_t slot_cnt;                 /* Slots, including gaps. */
+static uint8_t *cluster_used;           /* Slots in use, per cluster. */
+static uint32_t *cluster_pos;           /* Index of each cluster in its
+                                           device's stack, or NO_SLOT. */
+static uint32_t *slot_next;             /* Free slot list links. */
+static uint32_t *slot_prev;
+static void **slot_owner;               /* Owner token of each slot. */
+
+/* Swap cache. Swapping in a slot also reads the adjacent slots with
+   the same owner, which were most likely swapped out in the same
+   cluster, into these pages with the same request, so that faults
+   on them soon after are a copy instead of a disk read. An entry
+   stays busy while being filled; a freed slot drops its entry. */
+struct swap_cache
+    {
+        uint32_t slot;                  /* Slot held, or NO_SLOT. */
+        bool busy;                      /* Being read in. */
+        void *page;                     /* Copy of the slot. */
+    };
+static struct swap_cache cache[SWAP_CACHE_CNT];
+static size_t cache_hand;               /* Next entry to replace. */
+static struct condition cache_filled;   /* Signaled when a read ends. */
+
+static void write_cluster (void *const pages[], void *const owners[],
+                           size_t cnt, size_t ids[]);
+static size_t alloc_slot (void *owner);
+static struct swap_dev *pick_dev (bool need_cluster);
+static uint32_t pop_cluster (struct swap_dev *d);
+static void push_cluster (struct swap_dev *d, uint32_t c);
+static void take_cluster (struct swap_dev *d, uint32_t c);
+static uint32_t region_cluster (void *owner, struct swap_dev **devp);
+static void release_region (struct swap_region *r);
+static void release_regions (void);
+static struct swap_dev *slot_dev (uint32_t slot);
+static bool in_cluster (const struct swap_dev *d, uint32_t slot);
+static void mark_slot (struct swap_dev *d, uint32_t slot, void *owner);
+static void push_slot (struct swap_dev *d, uint32_t slot);
+static void remove_slot (struct swap_dev *d, uint32_t slot);
+static struct swap_cache *cache_find (uint32_t slot);
+static struct swap_cache *cache_claim (uint32_t slot);
+static bool read_ahead_ok (uint32_t slot, void *owner);
+static void copy_slot (size_t from_id, size_t to_id);
+static void read_slots (size_t start_id, void *const pages[], size_t cnt);
+static void write_slots (size_t start_id, void *const pages[], size_t cnt);
+
+/* Adds BLOCK as a swap device with the given PRIORITY. Must be
+   called before swap_init(). */
+void
+swap_add_device (struct block *block, int priority)
+{
+    if (dev_cnt >= SWAP_DEV_MAX)
+        PANIC ("More than %d swap devices", SWAP_DEV_MAX);
+    devs[dev_cnt].block = block;
+    devs[dev_cnt].priority = priority;
+    dev_cnt++;
+}
 
 void
 swap_init (void)
 {
-    swap_block = block_get_role (BLOCK_SWAP);
+    size_t cluster_total, bytes, i;
+    uint32_t *free_clusters;
+    uint8_t *p;
+
     lock_init (&swap_lock);
-    used_map = bitmap_create (block_size (swap_block));
+    lock_set_name (&swap_lock, "swap");
+    cond_init (&cache_filled);
+    zswap_init ();
+
+    for (i = 0; i < dev_cnt; i++)
+        {
+            struct swap_dev *d = &devs[i];
+
+            /* Start the slots on a boundary of the device's units, so
+               that a page is never split across two of them. */
+            d->base = slot_cnt;
+            d->skip = block_io_align (d->block) % SECTORS_PER_SLOT;
+            d->slot_cnt = 0;
+            if (block_size (d->block) > d->skip)
+                d->slot_cnt = ((block_size (d->block) - d->skip)
+                               / SECTORS_PER_SLOT);
+            d->cluster_cnt = d->slot_cnt / SWAP_CLUSTER;
+            slot_cnt = ROUND_UP (d->base + d->slot_cnt, SWAP_CLUSTER);
+        }
+    /* Sector numbers must not collide with compressed pool ids. */
+    ASSERT (!zswap_is_id (slot_cnt * SECTORS_PER_SLOT));
+    cluster_total = slot_cnt / SWAP_CLUSTER;
+    used_map = bitmap_create (slot_cnt);
+
+    bytes = (cluster_total * sizeof *free_clusters
+             + 2 * slot_cnt * sizeof *slot_next
+             + cluster_total * sizeof *cluster_pos
+             + slot_cnt * sizeof *slot_owner + cluster_total);
+    p = NULL;
+    if (bytes > 0)
+        p = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                 DIV_ROUND_UP (bytes, PGSIZE));
+    free_clusters = (uint32_t *) p;
+    slot_next = free_clusters + cluster_total;
+    slot_prev = slot_next + slot_cnt;
+    cluster_pos = slot_prev + slot_cnt;
+    slot_owner = (void **) (cluster_pos + cluster_total);
+    cluster_used = (uint8_t *) (slot_owner + slot_cnt);
+    for (i = 0; i < cluster_total; i++)
+        cluster_pos[i] = NO_SLOT;
+
+    for (i = 0; i < dev_cnt; i++)
+        {
+            struct swap_dev *d = &devs[i];
+            uint32_t first = d->base / SWAP_CLUSTER;
+            uint32_t s;
+            size_t c;
+
+            /* Pushed in reverse so the lowest clusters are handed out
+               first. */
+            d->free_clusters = free_clusters + first;
+            for (c = 0; c < d->cluster_cnt; c++)
+                {
+                    d->free_clusters[c] = first + d->cluster_cnt - 1 - c;
+                    cluster_pos[d->free_clusters[c]] = c;
+                }
+            d->free_cluster_cnt = d->cluster_cnt;
+            d->slot_head = NO_SLOT;
+            for (s = d->base + d->slot_cnt;
+                 s-- > d->base + d->cluster_cnt * SWAP_CLUSTER; )
+                push_slot (d, s);
+        }
+
+    for (i = 0; i < SWAP_CACHE_CNT; i++)
+        {
+            cache[i].slot = NO_SLOT;
+            cache[i].page = palloc_get_page (PAL_ASSERT);
+        }
 }
 
+/* Reads the slot starting at sector START_ID into UPAGE and frees
+   the slot unless KEEP, in which case it still holds a copy of the
+   page. The slot is taken from the swap cache if it was read ahead;
+   otherwise the read takes in as many of the adjacent slots with the
+   same owner on the same device as fit in the swap cache. Returns
+   false if the slot is not in use. */
 bool
-swap_try_read (size_t start_id, void *upage)
+swap_try_read (size_t start_id, void *upage, bool keep)
 {
-    bool ret = true;
+    uint32_t slot = start_id / SECTORS_PER_SLOT;
+    struct swap_cache *claimed[SWAP_CACHE_CNT];
+    void *pages[SWAP_CACHE_CNT + 1];
+    struct swap_cache *c;
+    struct swap_dev *d;
+    uint32_t first, last;
+    size_t cnt, i;
+
+    if (zswap_is_id (start_id))
+        {
+            zswap_load (start_id, upage);
+            if (!keep)
+                zswap_free (start_id);
+            return true;
+        }
+
     lock_acquire (&swap_lock);
-    for (size_t id = start_id; id < SECTORS_PER_SLOT; id++)
+    if (!bitmap_test (used_map, slot))
         {
-            if (!bitmap_test (used_map, start_id))
-                {
-                    ret = false;
-                    break;
-                }
-            block_read (swap_block, id, upage + id * SECTORS_PER_SLOT);
-            bitmap_reset (used_map, id);
+            lock_release (&swap_lock);
+            return false;
+        }
+    while ((c = cache_find (slot)) != NULL && c->busy)
+        cond_wait (&cache_filled, &swap_lock);
+    if (c != NULL)
+        {
+            memcpy (upage, c->page, PGSIZE);
+            c->slot = NO_SLOT;
+            lock_release (&swap_lock);
+            if (!keep)
+                swap_free (start_id);
+            return true;
         }
+
+    /* Grow the run downward first: stacks fault back in from the top,
+       and clusters are written in increasing address order. */
+    d = slot_dev (slot);
+    first = last = slot;
+    cnt = 0;
+    while (cnt < SWAP_CACHE_CNT && first > d->base
+           && read_ahead_ok (first - 1, slot_owner[slot])
+           && (claimed[cnt] = cache_claim (first - 1)) != NULL)
+        {
+            first--;
+            cnt++;
+        }
+    while (cnt < SWAP_CACHE_CNT && last + 1 < d->base + d->slot_cnt
+           && read_ahead_ok (last + 1, slot_owner[slot])
+           && (claimed[cnt] = cache_claim (last + 1)) != NULL)
+        {
+            last++;
+            cnt++;
+        }
+    pages[slot - first] = upage;
+    for (i = 0; i < cnt; i++)
+        pages[claimed[i]->slot - first] = claimed[i]->page;
     lock_release (&swap_lock);
-    return ret;
+
+    read_slots (first * SECTORS_PER_SLOT, pages, cnt + 1);
+
+    if (cnt > 0)
+        {
+            lock_acquire (&swap_lock);
+            for (i = 0; i < cnt; i++)
+                claimed[i]->busy = false;
+            cond_broadcast (&cache_filled, &swap_lock);
+            lock_release (&swap_lock);
+        }
+    if (!keep)
+        swap_free (start_id);
+    return true;
 }
 
+/* Writes UPAGE, belonging to OWNER, to a free slot and returns the
+   slot's id. */
 size_t
-swap_write (void *upage)
+swap_write (void *upage, void *owner)
 {
-    lock_acquire (&swap_lock);
+    size_t start_id;
 
-    size_t start_id = bitmap_scan_and_flip (used_map, 0, 8, true);
-    if (start_id == BITMAP_ERROR)
-        PANIC ("Swap is full");
-    
-    for (block_sector_t id = start_id; id < SECTORS_PER_SLOT; id++)
+    swap_write_cluster (&upage, &owner, 1, &start_id);
+    return start_id;
+}
+
+/* Writes the CNT pages PAGES[] to swap, CNT at most SWAP_CLUSTER,
+   storing the id each page went to in IDS[]. OWNERS[] identifies the
+   address space of each page, so swap-in reads ahead only within it.
+   Pages that fit in the compressed pool go there; the rest are
+   written to the device by write_cluster(). */
+void
+swap_write_cluster (void *const pages[], void *const owners[], size_t cnt,
+                    size_t ids[])
+{
+    void *disk_pages[SWAP_CLUSTER];
+    void *disk_owners[SWAP_CLUSTER];
+    size_t disk_ids[SWAP_CLUSTER];
+    size_t disk_idx[SWAP_CLUSTER];
+    size_t disk_cnt = 0;
+    size_t i;
+
+    ASSERT (cnt <= SWAP_CLUSTER);
+
+    for (i = 0; i < cnt; i++)
+        if (!zswap_store (pages[i], &ids[i]))
+            {
+                disk_pages[disk_cnt] = pages[i];
+                disk_owners[disk_cnt] = owners[i];
+                disk_idx[disk_cnt++] = i;
+            }
+    if (disk_cnt == 0)
+        return;
+    write_cluster (disk_pages, disk_owners, disk_cnt, disk_ids);
+    for (i = 0; i < disk_cnt; i++)
+        ids[disk_idx[i]] = disk_ids[i];
+}
+
+/* Writes the CNT pages PAGES[], CNT at most SWAP_CLUSTER, to the
+   swap device for swap_write_cluster(). If an empty cluster is
+   available the pages get adjacent slots, in the region of the
+   first page's owner, and go out in a single request. Panics if
+   swap is full. */
+static void
+write_cluster (void *const pages[], void *const owners[], size_t cnt,
+               size_t ids[])
+{
+    struct swap_dev *d = NULL;
+    size_t first = NO_SLOT;
+    uint32_t c;
+    size_t i;
+
+    ASSERT (cnt <= SWAP_CLUSTER);
+
+    lock_acquire (&swap_lock);
+    c = region_cluster (owners[0], &d);
+    if (c == NO_SLOT)
+        {
+            d = pick_dev (true);
+            if (d == NULL)
+                {
+                    release_regions ();
+                    d = pick_dev (true);
+                }
+            if (d != NULL)
+                c = pop_cluster (d);
+        }
+    if (c != NO_SLOT)
         {
-            block_write (swap_block, id, upage + id * SECTORS_PER_SLOT);
+            first = c * SWAP_CLUSTER;
+            for (i = 0; i < cnt; i++)
+                mark_slot (d, first + i, owners[i]);
+            for (i = SWAP_CLUSTER; i-- > cnt; )
+                push_slot (d, first + i);
         }
     lock_release (&swap_lock);
-    return start_id;
+
+    if (first != NO_SLOT)
+        {
+            for (i = 0; i < cnt; i++)
+                ids[i] = (first + i) * SECTORS_PER_SLOT;
+            write_slots (ids[0], pages, cnt);
+        }
+    else
+        for (i = 0; i < cnt; i++)
+            {
+                ids[i] = alloc_slot (owners[i]);
+                write_slots (ids[i], &pages[i], 1);
+            }
 }
 
 void 
 swap_free (size_t start_id)
 {
+    uint32_t slot = start_id / SECTORS_PER_SLOT;
+    uint32_t c = slot / SWAP_CLUSTER;
+    struct swap_cache *e;
+    struct swap_dev *d;
+
+    if (zswap_is_id (start_id))
+        {
+            zswap_free (start_id);
+            return;
+        }
+
     lock_acquire (&swap_lock);
-    for (size_t id = start_id; id < SECTORS_PER_SLOT; id++)
+    ASSERT (bitmap_test (used_map, slot));
+    bitmap_reset (used_map, slot);
+    d = slot_dev (slot);
+    d->used_cnt--;
+    e = cache_find (slot);
+    if (e != NULL)
+        e->slot = NO_SLOT;
+    if (!in_cluster (d, slot))
+        push_slot (d, slot);
+    else if (--cluster_used[c] == 0)
         {
-            bitmap_reset (used_map, id);
+            /* The cluster's other slots are all loose: gather them. */
+            uint32_t s;
+
+            for (s = c * SWAP_CLUSTER; s < (c + 1) * SWAP_CLUSTER; s++)
+                if (s != slot)
+                    remove_slot (d, s);
+            push_cluster (d, c);
         }
+    else
+        push_slot (d, slot);
+    lock_release (&swap_lock);
+}
+
+/* Gives back the clusters reserved for OWNER that it has not used,
+   as its address space goes away. */
+void
+swap_release_owner (void *owner)
+{
+    size_t i;
+
+    lock_acquire (&swap_lock);
+    for (i = 0; i < REGION_CNT; i++)
+        if (regions[i].owner == owner)
+            release_region (&regions[i]);
     lock_release (&swap_lock);
-}
\ No newline at end of file
+}
+
+/* Copies the swap slot starting at START_ID into a newly allocated
+   slot owned by OWNER and returns the new slot's id, for a forked
+   child. */
+size_t
+swap_copy (size_t start_id, void *owner)
+{
+    size_t copy_id;
+
+    if (zswap_is_id (start_id))
+        {
+            void *page;
+
+            if (zswap_copy (start_id, &copy_id))
+                return copy_id;
+            page = palloc_get_page (PAL_ASSERT);
+            zswap_load (start_id, page);
+            write_cluster (&page, &owner, 1, &copy_id);
+            palloc_free_page (page);
+            return copy_id;
+        }
+
+    copy_id = alloc_slot (owner);
+    copy_slot (start_id, copy_id);
+    return copy_id;
+}
+
+/* Prints usage statistics for each swap device. */
+void
+swap_print_stats (void)
+{
+    size_t i;
+
+    for (i = 0; i < dev_cnt; i++)
+        {
+            struct swap_dev *d = &devs[i];
+
+            printf ("swap %s (priority %d): %zu of %zu slots in use, "
+                    "peak %zu, %llu pages read, %llu written\n",
+                    block_name (d->block), d->priority, d->used_cnt,
+                    d->slot_cnt, d->peak_cnt, d->read_cnt, d->write_cnt);
+        }
+    if (region_hits > 0)
+        printf ("swap: %llu clusters written in owners' regions\n",
+                region_hits);
+}
+
+/* Fills in the swap usage and traffic in STATS. */
+void
+swap_get_stats (struct sysstat *stats)
+{
+    size_t i;
+
+    stats->swap_slots = stats->swap_used = 0;
+    stats->swap_ins = stats->swap_outs = 0;
+    for (i = 0; i < dev_cnt; i++)
+        {
+            stats->swap_slots += devs[i].slot_cnt;
+            stats->swap_used += devs[i].used_cnt;
+            stats->swap_ins += devs[i].read_cnt;
+            stats->swap_outs += devs[i].write_cnt;
+        }
+}
+
+/* Allocates a single slot for OWNER and returns the id of its first
+   sector, preferring a loose slot so as to leave empty clusters
+   whole. Panics if swap is full. */
+static size_t
+alloc_slot (void *owner)
+{
+    struct swap_dev *d;
+    uint32_t slot;
+
+    lock_acquire (&swap_lock);
+    d = pick_dev (false);
+    if (d == NULL)
+        {
+            release_regions ();
+            d = pick_dev (false);
+        }
+    if (d == NULL)
+        PANIC ("Swap is full");
+    if (d->slot_head != NO_SLOT)
+        {
+            slot = d->slot_head;
+            remove_slot (d, slot);
+        }
+    else
+        {
+            uint32_t s;
+
+            slot = pop_cluster (d) * SWAP_CLUSTER;
+            for (s = slot + SWAP_CLUSTER - 1; s > slot; s--)
+                push_slot (d, s);
+        }
+    mark_slot (d, slot, owner);
+    lock_release (&swap_lock);
+    return slot * SECTORS_PER_SLOT;
+}
+
+/* Returns the device to allocate from next: of the devices with an
+   empty cluster, if NEED_CLUSTER, or else with any free slot, one of
+   the highest priority, going round those of equal priority in turn.
+   Returns a null pointer if there is none. */
+static struct swap_dev *
+pick_dev (bool need_cluster)
+{
+    struct swap_dev *best = NULL;
+    size_t i;
+
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    for (i = 1; i <= dev_cnt; i++)
+        {
+            struct swap_dev *d = &devs[(dev_rotor + i) % dev_cnt];
+
+            if (d->free_cluster_cnt == 0
+                && (need_cluster || d->slot_head == NO_SLOT))
+                continue;
+            if (best == NULL || d->priority > best->priority)
+                best = d;
+        }
+    if (best != NULL)
+        dev_rotor = best - devs;
+    return best;
+}
+
+/* Takes the empty cluster on top of device D's stack, which must
+   not be empty, and returns its number. */
+static uint32_t
+pop_cluster (struct swap_dev *d)
+{
+    uint32_t c;
+
+    ASSERT (d->free_cluster_cnt > 0);
+
+    c = d->free_clusters[--d->free_cluster_cnt];
+    cluster_pos[c] = NO_SLOT;
+    return c;
+}
+
+/* Puts empty cluster C on device D's stack. */
+static void
+push_cluster (struct swap_dev *d, uint32_t c)
+{
+    cluster_pos[c] = d->free_cluster_cnt;
+    d->free_clusters[d->free_cluster_cnt++] = c;
+}
+
+/* Takes empty cluster C, wherever it is in device D's stack, off
+   the stack, moving the top cluster into its place. */
+static void
+take_cluster (struct swap_dev *d, uint32_t c)
+{
+    uint32_t pos = cluster_pos[c];
+    uint32_t top = d->free_clusters[--d->free_cluster_cnt];
+
+    ASSERT (pos != NO_SLOT);
+
+    d->free_clusters[pos] = top;
+    cluster_pos[top] = pos;
+    cluster_pos[c] = NO_SLOT;
+}
+
+/* Returns true if cluster C is a whole, empty cluster of device D. */
+static bool
+cluster_free (const struct swap_dev *d, uint32_t c)
+{
+    return (c >= d->base / SWAP_CLUSTER
+            && c < d->base / SWAP_CLUSTER + d->cluster_cnt
+            && cluster_pos[c] != NO_SLOT);
+}
+
+/* Returns OWNER's region, or a new one for it in place of the
+   least recently used, or a null pointer if OWNER is null. */
+static struct swap_region *
+find_region (void *owner)
+{
+    struct swap_region *lru = &regions[0];
+    size_t i;
+
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    if (owner == NULL)
+        return NULL;
+    for (i = 0; i < REGION_CNT; i++)
+        {
+            struct swap_region *r = &regions[i];
+
+            if (r->owner == owner)
+                return r;
+            if (r->owner == NULL ? lru->owner != NULL : r->used < lru->used)
+                lru = r;
+        }
+    release_region (lru);
+    lru->owner = owner;
+    return lru;
+}
+
+/* Reserves another extent of clusters for region R, right after its
+   end if possible. Returns false if no empty cluster is left. */
+static bool
+reserve_extent (struct swap_region *r)
+{
+    size_t want = r->extent == 0 ? REGION_MIN : 2 * r->extent;
+    struct swap_dev *d = r->dev;
+    uint32_t start;
+
+    if (want > REGION_MAX)
+        want = REGION_MAX;
+    if (d != NULL && cluster_free (d, r->end))
+        start = r->end;
+    else
+        {
+            d = pick_dev (true);
+            if (d == NULL)
+                return false;
+            start = d->free_clusters[d->free_cluster_cnt - 1];
+        }
+
+    r->dev = d;
+    r->next = r->end = start;
+    r->extent = want;
+    while (r->end - start < want && cluster_free (d, r->end))
+        take_cluster (d, r->end++);
+    return true;
+}
+
+/* Takes the next cluster of OWNER's region, reserving more for it
+   as needed, and returns it, storing its device in *DEVP. Returns
+   NO_SLOT if OWNER is null or no empty cluster is left. */
+static uint32_t
+region_cluster (void *owner, struct swap_dev **devp)
+{
+    struct swap_region *r = find_region (owner);
+
+    if (r == NULL || (r->next == r->end && !reserve_extent (r)))
+        return NO_SLOT;
+    r->used = ++region_clock;
+    region_hits++;
+    *devp = r->dev;
+    return r->next++;
+}
+
+/* Puts the clusters region R has not handed out back on their
+   device's stack and frees R. */
+static void
+release_region (struct swap_region *r)
+{
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    while (r->next < r->end)
+        push_cluster (r->dev, r->next++);
+    r->owner = NULL;
+    r->dev = NULL;
+    r->next = r->end = 0;
+    r->extent = 0;
+}
+
+/* Gives back every region's unused clusters, for when swap has no
+   empty cluster left. Owners keep their regions, which grow anew
+   once clusters are free again. */
+static void
+release_regions (void)
+{
+    size_t i;
+
+    for (i = 0; i < REGION_CNT; i++)
+        while (regions[i].next < regions[i].end)
+            push_cluster (regions[i].dev, regions[i].next++);
+}
+
+/* Returns the device holding SLOT. */
+static struct swap_dev *
+slot_dev (uint32_t slot)
+{
+    size_t i;
+
+    for (i = 0; i < dev_cnt; i++)
+        if (slot >= devs[i].base && slot < devs[i].base + devs[i].slot_cnt)
+            return &devs[i];
+    NOT_REACHED ();
+}
+
+/* Returns true if SLOT of device D lies in one of its whole
+   clusters. */
+static bool
+in_cluster (const struct swap_dev *d, uint32_t slot)
+{
+    return (slot - d->base) / SWAP_CLUSTER < d->cluster_cnt;
+}
+
+/* Marks free SLOT of device D in use by OWNER. */
+static void
+mark_slot (struct swap_dev *d, uint32_t slot, void *owner)
+{
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    bitmap_mark (used_map, slot);
+    slot_owner[slot] = owner;
+    if (in_cluster (d, slot))
+        cluster_used[slot / SWAP_CLUSTER]++;
+    if (++d->used_cnt > d->peak_cnt)
+        d->peak_cnt = d->used_cnt;
+}
+
+/* Puts free SLOT at the head of device D's loose slot list. */
+static void
+push_slot (struct swap_dev *d, uint32_t slot)
+{
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    slot_prev[slot] = NO_SLOT;
+    slot_next[slot] = d->slot_head;
+    if (d->slot_head != NO_SLOT)
+        slot_prev[d->slot_head] = slot;
+    d->slot_head = slot;
+}
+
+/* Takes SLOT off device D's loose slot list. */
+static void
+remove_slot (struct swap_dev *d, uint32_t slot)
+{
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    if (slot_prev[slot] != NO_SLOT)
+        slot_next[slot_prev[slot]] = slot_next[slot];
+    else
+        d->slot_head = slot_next[slot];
+    if (slot_next[slot] != NO_SLOT)
+        slot_prev[slot_next[slot]] = slot_prev[slot];
+}
+
+/* Returns the swap cache entry holding SLOT, busy or not, or a null
+   pointer. */
+static struct swap_cache *
+cache_find (uint32_t slot)
+{
+    size_t i;
+
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    for (i = 0; i < SWAP_CACHE_CNT; i++)
+        if (cache[i].slot == slot)
+            return &cache[i];
+    return NULL;
+}
+
+/* Takes a swap cache entry that is not being filled for SLOT and
+   marks it busy, or returns a null pointer if all are busy. */
+static struct swap_cache *
+cache_claim (uint32_t slot)
+{
+    size_t i;
+
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    for (i = 0; i < SWAP_CACHE_CNT; i++)
+        {
+            struct swap_cache *c = &cache[cache_hand];
+
+            cache_hand = (cache_hand + 1) % SWAP_CACHE_CNT;
+            if (!c->busy)
+                {
+                    c->slot = slot;
+                    c->busy = true;
+                    return c;
+                }
+        }
+    return NULL;
+}
+
+/* Returns true if SLOT is worth reading ahead on a swap-in of a
+   slot owned by OWNER: it is in use by the same owner and not
+   already cached. */
+static bool
+read_ahead_ok (uint32_t slot, void *owner)
+{
+    ASSERT (lock_held_by_current_thread (&swap_lock));
+
+    return (owner != NULL && bitmap_test (used_map, slot)
+            && slot_owner[slot] == owner && cache_find (slot) == NULL);
+}
+
+/* Reads the CNT adjacent slots starting at sector START_ID into
+   PAGES[] with one request. */
+static void
+read_slots (size_t start_id, void *const pages[], size_t cnt)
+{
+    struct swap_dev *d = slot_dev (start_id / SECTORS_PER_SLOT);
+    void *sectors[(SWAP_CACHE_CNT + 1) * SECTORS_PER_SLOT];
+    size_t i, j;
+
+    ASSERT (cnt <= SWAP_CACHE_CNT + 1);
+
+    trace (TRACE_SWAP_READ, start_id, cnt, 0, 0);
+    for (i = 0; i < cnt; i++)
+        for (j = 0; j < SECTORS_PER_SLOT; j++)
+            sectors[i * SECTORS_PER_SLOT + j]
+              = (uint8_t *) pages[i] + j * BLOCK_SECTOR_SIZE;
+    block_read_multiple (d->block,
+                         start_id - d->base * SECTORS_PER_SLOT + d->skip,
+                         cnt * SECTORS_PER_SLOT, sectors);
+    d->read_cnt += cnt;
+}
+
+/* Writes the CNT pages PAGES[] to the adjacent slots starting at
+   sector START_ID with one request. */
+static void
+write_slots (size_t start_id, void *const pages[], size_t cnt)
+{
+    struct swap_dev *d = slot_dev (start_id / SECTORS_PER_SLOT);
+    const void *sectors[SWAP_CLUSTER * SECTORS_PER_SLOT];
+    size_t i, j;
+
+    ASSERT (cnt <= SWAP_CLUSTER);
+
+    trace (TRACE_SWAP_WRITE, start_id, cnt, 0, 0);
+    for (i = 0; i < cnt; i++)
+        for (j = 0; j < SECTORS_PER_SLOT; j++)
+            sectors[i * SECTORS_PER_SLOT + j]
+              = (const uint8_t *) pages[i] + j * BLOCK_SECTOR_SIZE;
+    block_write_multiple (d->block,
+                          start_id - d->base * SECTORS_PER_SLOT + d->skip,
+                          cnt * SECTORS_PER_SLOT, sectors);
+    d->write_cnt += cnt;
+}
+
+/* Copies the slot starting at sector FROM_ID to the one starting at
+   TO_ID, which may be on another device. */
+static void
+copy_slot (size_t from_id, size_t to_id)
+{
+    struct swap_dev *from = slot_dev (from_id / SECTORS_PER_SLOT);
+    struct swap_dev *to = slot_dev (to_id / SECTORS_PER_SLOT);
+    uint8_t buffer[BLOCK_SECTOR_SIZE];
+    size_t i;
+
+    from_id = from_id - from->base * SECTORS_PER_SLOT + from->skip;
+    to_id = to_id - to->base * SECTORS_PER_SLOT + to->skip;
+    for (i = 0; i < SECTORS_PER_SLOT; i++)
+        {
+            block_read (from->block, from_id + i, buffer);
+            block_write (to->block, to_id + i, buffer);
+        }
+    from->read_cnt++;
+    to->write_cnt++;
+}
@@ -4,11 +4,26 @@
 #include "threads/vaddr.h"
 #include "devices/block.h"
 
-#define SECTORS_PER_SLOT PGSIZE / BLOCK_SECTOR_SIZE
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
 
+/* Most pages written to adjacent slots in one request. */
+#define SWAP_CLUSTER 8
+
+/* Pages the swap cache holds read ahead of a fault. */
+#define SWAP_CACHE_CNT 8
+
+struct sysstat;
+
+void swap_add_device (struct block *, int priority);
 void swap_init (void);
-bool swap_try_read (size_t swap_id, void *upage);
-size_t swap_write (void *upage);
+bool swap_try_read (size_t swap_id, void *upage, bool keep);
+size_t swap_write (void *upage, void *owner);
+void swap_write_cluster (void *const pages[], void *const owners[],
+                         size_t cnt, size_t ids[]);
 void swap_free (size_t swap_id);
+void swap_release_owner (void *owner);
+size_t swap_copy (size_t swap_id, void *owner);
+void swap_get_stats (struct sysstat *);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "vm/vma.h"
+#include <debug.h>
+#include <madvise.h>
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+
+/* Virtual memory areas of all processes. */
+static struct kmem_cache vma_cache;
+
+static size_t pg_count (const struct vma *);
+static struct vma *first_ending_after (const void *addr);
+static struct vma *next_vma (struct vma *);
+static rb_action_func free_vma;
+
+/* Initializes the allocator for virtual memory areas. */
+void
+vma_init (void)
+{
+  kmem_cache_init (&vma_cache, "vma", sizeof (struct vma), NULL, NULL);
+}
+
+/* Adds an area of PG_CNT pages starting at user page START to the
+   current thread, of page type TYPE. Its first READ_BYTES bytes come
+   from FILE starting at offset OFS and the rest are zero. Returns
+   true if successful, false if out of memory. The caller must make
+   sure the area does not overlap an existing one. */
+bool
+vma_add (void *start, size_t pg_cnt, enum page_type type, struct file *file,
+         off_t ofs, size_t read_bytes, bool writable)
+{
+  struct vma *vma;
+
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (read_bytes <= pg_cnt * PGSIZE);
+
+  vma = kmem_cache_alloc (&vma_cache);
+  if (vma == NULL)
+    return false;
+
+  vma->start = start;
+  vma->end = (uint8_t *) start + pg_cnt * PGSIZE;
+  vma->file = file;
+  vma->ofs = ofs;
+  vma->read_bytes = read_bytes;
+  vma->type = type;
+  vma->writable = writable;
+  vma->advice = MADV_NORMAL;
+  rb_insert (&thread_current ()->process->vmas, &vma->elem);
+  return true;
+}
+
+/* Returns the current thread's area that contains UPAGE, or a null
+   pointer if there is none. */
+struct vma *
+vma_find (const void *upage)
+{
+  struct vma key, *vma;
+  struct rb_elem *e;
+
+  /* Only the last area starting at or before UPAGE can hold it. */
+  key.start = (void *) upage;
+  e = rb_floor (&thread_current ()->process->vmas, &key.elem);
+  if (e == NULL)
+    return NULL;
+  vma = rb_entry (e, struct vma, elem);
+  return upage < vma->end ? vma : NULL;
+}
+
+/* Returns true if any of the PG_CNT pages starting at START lies in
+   one of the current thread's areas. */
+bool
+vma_overlaps (const void *start, size_t pg_cnt)
+{
+  const uint8_t *end = (const uint8_t *) start + pg_cnt * PGSIZE;
+  struct vma *vma = first_ending_after (start);
+
+  return vma != NULL && (const void *) end > vma->start;
+}
+
+/* Removes the current thread's area that starts at START, if any.
+   Pages of the area that were faulted in keep their spte, which the
+   caller must remove with spt_remove_upages(). */
+void
+vma_remove (void *start)
+{
+  struct vma *vma = vma_find (start);
+
+  if (vma == NULL || vma->start != start)
+    return;
+  rb_remove (&thread_current ()->process->vmas, &vma->elem);
+  kmem_cache_free (&vma_cache, vma);
+}
+
+/* Records access pattern ADVICE, one of MADV_NORMAL, MADV_RANDOM
+   or MADV_SEQUENTIAL, for every area of the current thread that
+   overlaps the PG_CNT pages starting at START. Advice applies to
+   whole areas. */
+void
+vma_set_advice (const void *start, size_t pg_cnt, int advice)
+{
+  const uint8_t *end = (const uint8_t *) start + pg_cnt * PGSIZE;
+  struct vma *vma;
+
+  for (vma = first_ending_after (start);
+       vma != NULL && (const void *) end > vma->start; vma = next_vma (vma))
+    vma->advice = advice;
+}
+
+/* Frees all of the current thread's areas. */
+void
+vma_destroy (void)
+{
+  rb_clear (&thread_current ()->process->vmas, free_vma);
+}
+
+/* Copies the areas of PARENT, which must be blocked, into the
+   current thread for fork. Executable areas use the current thread's
+   own executable, which must already be open; mapped files are
+   reopened. Returns false if out of memory. */
+bool
+vma_copy (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct rb_elem *e;
+
+  for (e = rb_first (&parent->vmas); e != NULL; e = rb_next (e))
+    {
+      struct vma *p = rb_entry (e, struct vma, elem);
+      struct file *file;
+
+      if (p->file == fdtable_get (&parent->fds, EXEC_FD))
+        file = fdtable_get (&cur->fds, EXEC_FD);
+      else
+        file = file_reopen (p->file);
+      if (file == NULL
+          || !vma_add (p->start, pg_count (p), p->type, file, p->ofs,
+                       p->read_bytes, p->writable))
+        return false;
+      vma_find (p->start)->advice = p->advice;
+    }
+  return true;
+}
+
+/* Fills in *INFO with where user page UPAGE of area VMA is loaded
+   from. */
+void
+vma_page_info (const struct vma *vma, const void *upage,
+               struct filesys_info *info)
+{
+  size_t offset = (const uint8_t *) upage - (const uint8_t *) vma->start;
+
+  ASSERT (upage >= vma->start && upage < vma->end);
+
+  info->file = vma->file;
+  info->ofs = vma->ofs + offset;
+  if (offset >= vma->read_bytes)
+    info->page_read_bytes = 0;
+  else if (vma->read_bytes - offset < PGSIZE)
+    info->page_read_bytes = vma->read_bytes - offset;
+  else
+    info->page_read_bytes = PGSIZE;
+  info->writable = vma->writable;
+}
+
+/* Returns the number of pages in VMA. */
+static size_t
+pg_count (const struct vma *vma)
+{
+  return ((uint8_t *) vma->end - (uint8_t *) vma->start) / PGSIZE;
+}
+
+/* Returns the current thread's first area that ends after ADDR,
+   or a null pointer if there is none. */
+static struct vma *
+first_ending_after (const void *addr)
+{
+  struct rb_tree *vmas = &thread_current ()->process->vmas;
+  struct vma key, *vma;
+  struct rb_elem *e;
+
+  key.start = (void *) addr;
+  e = rb_floor (vmas, &key.elem);
+  if (e == NULL)
+    e = rb_first (vmas);
+  if (e == NULL)
+    return NULL;
+  vma = rb_entry (e, struct vma, elem);
+  return addr < vma->end ? vma : next_vma (vma);
+}
+
+/* Returns the current thread's area that follows VMA, or a null
+   pointer if VMA is the last. */
+static struct vma *
+next_vma (struct vma *vma)
+{
+  struct rb_elem *e = rb_next (&vma->elem);
+
+  return e != NULL ? rb_entry (e, struct vma, elem) : NULL;
+}
+
+/* Frees area E, for vma_destroy(). */
+static void
+free_vma (struct rb_elem *e, void *aux UNUSED)
+{
+  kmem_cache_free (&vma_cache, rb_entry (e, struct vma, elem));
+}
+
+/* Orders areas by start address. */
+bool
+vma_less (const struct rb_elem *a_, const struct rb_elem *b_,
+          void *aux UNUSED)
+{
+  const struct vma *a = rb_entry (a_, struct vma, elem);
+  const struct vma *b = rb_entry (b_, struct vma, elem);
+
+  return a->start < b->start;
+}
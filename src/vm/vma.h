@@ -0,0 +1,51 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/file.h"
+#include "filesys/off_t.h"
+#include "vm/page.h"
+
+/* A virtual memory area: a run of user pages backed by one file.
+
+   Executable segments and memory mapped files are recorded as areas
+   rather than one supplementary page table entry per page. The
+   `read_bytes` bytes starting at `start` come from `file` at offset
+   `ofs`; the rest of the area up to `end` is zero-filled. A page's
+   spte is only created, from its area, when the page is first
+   faulted in, so pages that are never touched cost nothing.
+
+   Each process keeps its areas in the `vmas` tree in its thread,
+   ordered by start address, so the area containing an address is
+   found in O(log n) time. */
+struct vma
+    {
+        void *start;                    /* First page of the area. */
+        void *end;                      /* Page after the last page. */
+        struct file *file;              /* Backing file. */
+        off_t ofs;                      /* File offset of START. */
+        size_t read_bytes;              /* Bytes read from FILE. */
+        enum page_type type;            /* EXEC or MMAP. */
+        bool writable;                  /* Whether pages are writable. */
+        int advice;                     /* MADV_* access pattern. */
+        struct rb_elem elem;            /* Element in thread's vmas. */
+    };
+
+void vma_init (void);
+bool vma_add (void *start, size_t pg_cnt, enum page_type type,
+              struct file *file, off_t ofs, size_t read_bytes,
+              bool writable);
+struct vma *vma_find (const void *upage);
+bool vma_overlaps (const void *start, size_t pg_cnt);
+void vma_remove (void *start);
+void vma_destroy (void);
+void vma_set_advice (const void *start, size_t pg_cnt, int advice);
+bool vma_copy (struct thread *parent);
+void vma_page_info (const struct vma *vma, const void *upage,
+                    struct filesys_info *info);
+bool vma_less (const struct rb_elem *a_, const struct rb_elem *b_,
+               void *aux UNUSED);
+
+#endif /* vm/vma.h */
@@ -0,0 +1,151 @@
+#include <debug.h>
+#include <lz.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/shrinker.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+
+/* Compressed pool in front of the swap device. An evicted page that
+   compresses well is kept in a kernel heap block instead of being
+   written out, so getting it back costs a decompression rather than
+   a disk read. The pool lives in the kernel pool, which user pages
+   never use, and is capped at zswap_limit pages. When it is full or
+   a page does not compress well, the page goes to disk as before.
+
+   An entry's id is its address. Being a kernel virtual address it
+   lies above every sector number of a swap device, so the spte's
+   swap_id holds either kind of id. */
+struct zpage
+    {
+        size_t size;                    /* Bytes in data. */
+        uint8_t data[];                 /* Compressed page. */
+    };
+
+/* Largest entry stored. malloc() packs blocks of up to 1 kB into
+   shared pages; a bigger one would take a whole page and save
+   nothing. */
+#define ZPAGE_MAX 1024
+
+size_t zswap_limit;
+
+static struct lock zswap_lock;          /* Guards the variables below. */
+static uint8_t work[LZ_WORK_SIZE];      /* lz_compress() scratch. */
+static uint8_t staging[ZPAGE_MAX - sizeof (struct zpage)];
+static size_t pool_bytes;               /* Bytes held by entries. */
+static unsigned long long store_cnt;    /* Pages stored. */
+static unsigned long long reject_cnt;   /* Pages sent on to disk. */
+static unsigned long long load_cnt;     /* Pages read back. */
+
+void
+zswap_init (void)
+{
+    lock_init (&zswap_lock);
+    lock_set_name (&zswap_lock, "zswap");
+}
+
+/* Compresses PAGE into the pool and stores the entry's id in *ID.
+   Returns false, storing nothing, if the pool is off or full or the
+   page does not compress to ZPAGE_MAX bytes. */
+bool
+zswap_store (const void *page, size_t *id)
+{
+    struct zpage *z = NULL;
+    size_t size;
+
+    /* The pool would grow at the expense of a kernel pool already
+       short of memory. */
+    if (zswap_limit == 0 || shrinker_pressure (false))
+        return false;
+
+    lock_acquire (&zswap_lock);
+    size = lz_compress (page, PGSIZE, staging, sizeof staging, work);
+    if (size != 0 && pool_bytes + sizeof *z + size <= zswap_limit * PGSIZE)
+        z = malloc (sizeof *z + size);
+    if (z != NULL)
+        {
+            z->size = size;
+            memcpy (z->data, staging, size);
+            pool_bytes += sizeof *z + size;
+            store_cnt++;
+        }
+    else
+        reject_cnt++;
+    lock_release (&zswap_lock);
+
+    if (z == NULL)
+        return false;
+    *id = (size_t) z;
+    return true;
+}
+
+/* Returns true if swap id ID names a pool entry rather than a slot
+   on the swap device. */
+bool
+zswap_is_id (size_t id)
+{
+    return id >= (size_t) PHYS_BASE;
+}
+
+/* Decompresses entry ID into PAGE. The entry stays in the pool. */
+void
+zswap_load (size_t id, void *page)
+{
+    struct zpage *z = (struct zpage *) id;
+    size_t size UNUSED;
+
+    size = lz_decompress (z->data, z->size, page, PGSIZE);
+    ASSERT (size == PGSIZE);
+
+    lock_acquire (&zswap_lock);
+    load_cnt++;
+    lock_release (&zswap_lock);
+}
+
+/* Removes entry ID from the pool. */
+void
+zswap_free (size_t id)
+{
+    struct zpage *z = (struct zpage *) id;
+
+    lock_acquire (&zswap_lock);
+    pool_bytes -= sizeof *z + z->size;
+    lock_release (&zswap_lock);
+    free (z);
+}
+
+/* Copies entry ID into a new entry and stores its id in *COPY_ID,
+   for a forked child. Returns false if the pool has no room. */
+bool
+zswap_copy (size_t id, size_t *copy_id)
+{
+    struct zpage *z = (struct zpage *) id;
+    struct zpage *copy = NULL;
+
+    lock_acquire (&zswap_lock);
+    if (pool_bytes + sizeof *z + z->size <= zswap_limit * PGSIZE)
+        copy = malloc (sizeof *z + z->size);
+    if (copy != NULL)
+        pool_bytes += sizeof *z + z->size;
+    lock_release (&zswap_lock);
+
+    if (copy == NULL)
+        return false;
+    memcpy (copy, z, sizeof *z + z->size);
+    *copy_id = (size_t) copy;
+    return true;
+}
+
+/* Prints compressed pool statistics, if the pool is on. */
+void
+zswap_print_stats (void)
+{
+    if (zswap_limit == 0)
+        return;
+    printf ("zswap: %llu pages stored, %llu sent to disk, %llu loaded, "
+            "%zu bytes in use\n",
+            store_cnt, reject_cnt, load_cnt, pool_bytes);
+}
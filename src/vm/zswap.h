@@ -0,0 +1,19 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Most pages of kernel memory the compressed pool may use; 0, the
+   default, turns the pool off. */
+extern size_t zswap_limit;
+
+void zswap_init (void);
+bool zswap_store (const void *page, size_t *id);
+bool zswap_is_id (size_t id);
+void zswap_load (size_t id, void *page);
+void zswap_free (size_t id);
+bool zswap_copy (size_t id, size_t *copy_id);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */